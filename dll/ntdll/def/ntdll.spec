@@ -482,7 +482,7 @@
 @ stdcall NtReleaseSemaphore(long long ptr)
 @ stub -version=0x600+ NtReleaseWorkerFactoryWorker
 @ stdcall NtRemoveIoCompletion(ptr ptr ptr ptr ptr)
-@ stub -version=0x600+ NtRemoveIoCompletionEx
+@ stdcall -version=0x600+ NtRemoveIoCompletionEx(ptr ptr long ptr ptr long)
 @ stdcall NtRemoveProcessDebug(ptr ptr)
 @ stdcall NtRenameKey(ptr ptr)
 @ stub -version=0x600+ NtRenameTransactionManager
@@ -1311,45 +1311,45 @@
 @ stub -version=0x600+ ShipAssertMsgA
 @ stub -version=0x600+ ShipAssertMsgW
 @ stub -version=0x600+ TpAllocAlpcCompletion
-@ stub -version=0x600+ TpAllocCleanupGroup
-@ stub -version=0x600+ TpAllocIoCompletion
-@ stub -version=0x600+ TpAllocPool
-@ stub -version=0x600+ TpAllocTimer
-@ stub -version=0x600+ TpAllocWait
-@ stub -version=0x600+ TpAllocWork
-@ stub -version=0x600+ TpCallbackLeaveCriticalSectionOnCompletion
-@ stub -version=0x600+ TpCallbackMayRunLong
-@ stub -version=0x600+ TpCallbackReleaseMutexOnCompletion
-@ stub -version=0x600+ TpCallbackReleaseSemaphoreOnCompletion
-@ stub -version=0x600+ TpCallbackSetEventOnCompletion
-@ stub -version=0x600+ TpCallbackUnloadDllOnCompletion
-@ stub -version=0x600+ TpCancelAsyncIoOperation
+@ stdcall -version=0x600+ TpAllocCleanupGroup(ptr)
+@ stdcall -version=0x600+ TpAllocIoCompletion(ptr ptr ptr ptr ptr)
+@ stdcall -version=0x600+ TpAllocPool(ptr ptr)
+@ stdcall -version=0x600+ TpAllocTimer(ptr ptr ptr ptr)
+@ stdcall -version=0x600+ TpAllocWait(ptr ptr ptr ptr)
+@ stdcall -version=0x600+ TpAllocWork(ptr ptr ptr ptr)
+@ stdcall -version=0x600+ TpCallbackLeaveCriticalSectionOnCompletion(ptr ptr)
+@ stdcall -version=0x600+ TpCallbackMayRunLong(ptr)
+@ stdcall -version=0x600+ TpCallbackReleaseMutexOnCompletion(ptr ptr)
+@ stdcall -version=0x600+ TpCallbackReleaseSemaphoreOnCompletion(ptr ptr long)
+@ stdcall -version=0x600+ TpCallbackSetEventOnCompletion(ptr ptr)
+@ stdcall -version=0x600+ TpCallbackUnloadDllOnCompletion(ptr ptr)
+@ stdcall -version=0x600+ TpCancelAsyncIoOperation(ptr)
 @ stub -version=0x600+ TpCaptureCaller
 @ stub -version=0x600+ TpCheckTerminateWorker
 @ stub -version=0x600+ TpDbgDumpHeapUsage
 @ stub -version=0x600+ TpDbgSetLogRoutine
-@ stub -version=0x600+ TpDisassociateCallback
-@ stub -version=0x600+ TpIsTimerSet
-@ stub -version=0x600+ TpPostWork
+@ stdcall -version=0x600+ TpDisassociateCallback(ptr)
+@ stdcall -version=0x600+ TpIsTimerSet(ptr)
+@ stdcall -version=0x600+ TpPostWork(ptr)
 @ stub -version=0x600+ TpReleaseAlpcCompletion
-@ stub -version=0x600+ TpReleaseCleanupGroup
-@ stub -version=0x600+ TpReleaseCleanupGroupMembers
-@ stub -version=0x600+ TpReleaseIoCompletion
-@ stub -version=0x600+ TpReleasePool
-@ stub -version=0x600+ TpReleaseTimer
-@ stub -version=0x600+ TpReleaseWait
-@ stub -version=0x600+ TpReleaseWork
-@ stub -version=0x600+ TpSetPoolMaxThreads
-@ stub -version=0x600+ TpSetPoolMinThreads
-@ stub -version=0x600+ TpSetTimer
-@ stub -version=0x600+ TpSetWait
-@ stub -version=0x600+ TpSimpleTryPost
-@ stub -version=0x600+ TpStartAsyncIoOperation
+@ stdcall -version=0x600+ TpReleaseCleanupGroup(ptr)
+@ stdcall -version=0x600+ TpReleaseCleanupGroupMembers(ptr long ptr)
+@ stdcall -version=0x600+ TpReleaseIoCompletion(ptr)
+@ stdcall -version=0x600+ TpReleasePool(ptr)
+@ stdcall -version=0x600+ TpReleaseTimer(ptr)
+@ stdcall -version=0x600+ TpReleaseWait(ptr)
+@ stdcall -version=0x600+ TpReleaseWork(ptr)
+@ stdcall -version=0x600+ TpSetPoolMaxThreads(ptr long)
+@ stdcall -version=0x600+ TpSetPoolMinThreads(ptr long)
+@ stdcall -version=0x600+ TpSetTimer(ptr ptr long long)
+@ stdcall -version=0x600+ TpSetWait(ptr ptr ptr)
+@ stdcall -version=0x600+ TpSimpleTryPost(ptr ptr ptr)
+@ stdcall -version=0x600+ TpStartAsyncIoOperation(ptr)
 @ stub -version=0x600+ TpWaitForAlpcCompletion
-@ stub -version=0x600+ TpWaitForIoCompletion
-@ stub -version=0x600+ TpWaitForTimer
-@ stub -version=0x600+ TpWaitForWait
-@ stub -version=0x600+ TpWaitForWork
+@ stdcall -version=0x600+ TpWaitForIoCompletion(ptr long)
+@ stdcall -version=0x600+ TpWaitForTimer(ptr long)
+@ stdcall -version=0x600+ TpWaitForWait(ptr long)
+@ stdcall -version=0x600+ TpWaitForWork(ptr long)
 @ stdcall -ret64 VerSetConditionMask(double long long)
 @ stub -version=0x600+ WerCheckEventEscalation
 @ stub -version=0x600+ WerReportSQMEvent
@@ -1640,7 +1640,7 @@
 @ stdcall ZwReleaseSemaphore(long long ptr)
 @ stub -version=0x600+ ZwReleaseWorkerFactoryWorker
 @ stdcall ZwRemoveIoCompletion(ptr ptr ptr ptr ptr)
-@ stub -version=0x600+ ZwRemoveIoCompletionEx
+@ stdcall -version=0x600+ ZwRemoveIoCompletionEx(ptr ptr long ptr ptr long)
 @ stdcall ZwRemoveProcessDebug(ptr ptr)
 @ stdcall ZwRenameKey(ptr ptr)
 @ stub -version=0x600+ ZwRenameTransactionManager
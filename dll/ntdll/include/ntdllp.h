@@ -218,6 +218,59 @@ VOID
 NTAPI
 LdrpFinalizeAndDeallocateDataTableEntry(IN PLDR_DATA_TABLE_ENTRY Entry);
 
+BOOLEAN
+NTAPI
+LdrpResolveDllName(PWSTR DllPath,
+                   PWSTR DllName,
+                   PUNICODE_STRING FullDllName,
+                   PUNICODE_STRING BaseDllName);
+
+NTSTATUS
+NTAPI
+LdrpCheckForKnownDll(PWSTR DllName,
+                     PUNICODE_STRING FullDllName,
+                     PUNICODE_STRING BaseDllName,
+                     HANDLE *SectionHandle);
+
+/* ldrwork.c */
+extern ULONG LdrpMaxLoaderThreads;
+
+BOOLEAN
+NTAPI
+LdrpIsLoaderWorker(VOID);
+
+PVOID
+NTAPI
+LdrpPrefetchImports(IN PWSTR DllPath OPTIONAL,
+                    IN PLDR_DATA_TABLE_ENTRY LdrEntry,
+                    IN PIMAGE_IMPORT_DESCRIPTOR ImportEntry);
+
+PVOID
+NTAPI
+LdrpPrefetchDll(IN PWSTR DllPath OPTIONAL,
+                IN PUNICODE_STRING DllName);
+
+VOID
+NTAPI
+LdrpPublishPrefetchBatch(IN PVOID Context);
+
+VOID
+NTAPI
+LdrpReleasePrefetchBatch(IN PVOID Context);
+
+BOOLEAN
+NTAPI
+LdrpTakePrefetchedDll(IN PWSTR DllPath OPTIONAL,
+                      IN PWSTR DllName,
+                      OUT PUNICODE_STRING FullDllName,
+                      OUT PUNICODE_STRING BaseDllName,
+                      OUT PHANDLE SectionHandle,
+                      OUT PVOID *ViewBase,
+                      OUT PSIZE_T ViewSize,
+                      OUT PNTSTATUS MapStatus,
+                      OUT PBOOLEAN Relocated,
+                      OUT PBOOLEAN KnownDll);
+
 
 /* path.c */
 BOOLEAN
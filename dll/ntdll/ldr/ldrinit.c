@@ -1483,6 +1483,13 @@ LdrpInitializeExecutionOptions(PUNICODE_STRING ImagePathName, PPEB Peb, PHANDLE
                                    sizeof(RtlpShutdownProcessFlags),
                                    NULL);
 
+        LdrQueryImageFileKeyOption(KeyHandle,
+                                   L"MaxLoaderThreads",
+                                   REG_DWORD,
+                                   &LdrpMaxLoaderThreads,
+                                   sizeof(LdrpMaxLoaderThreads),
+                                   NULL);
+
         LdrQueryImageFileKeyOption(KeyHandle,
                                    L"MinimumStackCommitInBytes",
                                    REG_DWORD,
@@ -2600,6 +2607,9 @@ LdrpInit(PCONTEXT Context,
         Teb->DeallocationStack = MemoryBasicInfo.AllocationBase;
     }
 
+    /* Loader workers run no DLL code and may start while the process initializes */
+    if (LdrpIsLoaderWorker()) return;
+
     /* Now check if the process is already being initialized */
     while (_InterlockedCompareExchange(&LdrpProcessInitialized,
                                       1,
@@ -13,10 +13,26 @@
 #define NDEBUG
 #include <debug.h>
 
+/* Hint misses against one image before we hash its export names */
+#define LDRP_EXPORT_INDEX_THRESHOLD 32
+
+typedef struct _LDRP_EXPORT_INDEX
+{
+    struct _LDRP_EXPORT_INDEX *Next;
+    ULONG TimeDateStamp;
+    ULONG CheckSum;
+    ULONG SizeOfImage;
+    ULONG NumberOfNames;
+    ULONG Misses;
+    ULONG Mask;
+    PUSHORT Slots;
+} LDRP_EXPORT_INDEX, *PLDRP_EXPORT_INDEX;
+
 /* GLOBALS *******************************************************************/
 
 PLDR_MANIFEST_PROBER_ROUTINE LdrpManifestProberRoutine;
 ULONG LdrpNormalSnap;
+PLDRP_EXPORT_INDEX LdrpExportIndexList;
 
 /* FUNCTIONS *****************************************************************/
 
@@ -390,16 +406,13 @@ LdrpHandleOneNewFormatImportDescriptor(IN LPWSTR DllPath OPTIONAL,
         }
         else
         {
-            /* Show debug message */
+            /* Show debug message, but a stale module binding stays stale */
             if (ShowSnaps)
             {
                 DPRINT1("LDR: %wZ has correct binding to %s\n",
                         &LdrEntry->BaseDllName,
                         ForwarderName);
             }
-
-            /* Remember it's valid */
-            Stale = FALSE;
         }
 
         /* Move to the next one */
@@ -519,7 +532,7 @@ LdrpHandleOneOldFormatImportDescriptor(IN LPWSTR DllPath OPTIONAL,
 {
     LPSTR ImportName;
     NTSTATUS Status;
-    BOOLEAN AlreadyLoaded = FALSE;
+    BOOLEAN AlreadyLoaded = FALSE, BoundImage;
     PLDR_DATA_TABLE_ENTRY DllLdrEntry;
     PIMAGE_THUNK_DATA FirstThunk;
     PPEB Peb = NtCurrentPeb();
@@ -562,16 +575,7 @@ LdrpHandleOneOldFormatImportDescriptor(IN LPWSTR DllPath OPTIONAL,
         return Status;
     }
 
-    /* Show debug message */
-    if (ShowSnaps)
-    {
-        DPRINT1("LDR: Snapping imports for %wZ from %s\n",
-                &LdrEntry->BaseDllName,
-                ImportName);
-    }
-
     /* Check if it wasn't already loaded */
-    ++LdrpNormalSnap;
     if (!AlreadyLoaded)
     {
         /* Add the DLL to our list */
@@ -579,8 +583,31 @@ LdrpHandleOneOldFormatImportDescriptor(IN LPWSTR DllPath OPTIONAL,
                        &DllLdrEntry->InInitializationOrderLinks);
     }
 
+    /*
+     * An old style binding stores the timestamp of the DLL in the descriptor.
+     * It holds as long as that very DLL got mapped at its preferred base, and
+     * only the forwarders in the chain need to be snapped then. A timestamp
+     * of -1 means a new style binding, which we only get here without the
+     * bound import directory, or when the import could have been redirected.
+     */
+    BoundImage = ((*ImportEntry)->TimeDateStamp != 0) &&
+                 ((*ImportEntry)->TimeDateStamp != (ULONG)-1) &&
+                 ((*ImportEntry)->TimeDateStamp == DllLdrEntry->TimeDateStamp) &&
+                 !(DllLdrEntry->Flags & LDRP_IMAGE_NOT_AT_BASE) &&
+                 !(LdrEntry->Flags & LDRP_REDIRECTED);
+
+    /* Show debug message */
+    if (ShowSnaps)
+    {
+        DPRINT1("LDR: Snapping %s for %wZ from %s\n",
+                BoundImage ? "forwarders" : "imports",
+                &LdrEntry->BaseDllName,
+                ImportName);
+    }
+
     /* Now snap the IAT Entry */
-    Status = LdrpSnapIAT(DllLdrEntry, LdrEntry, *ImportEntry, FALSE);
+    if (!BoundImage) ++LdrpNormalSnap;
+    Status = LdrpSnapIAT(DllLdrEntry, LdrEntry, *ImportEntry, BoundImage);
     if (!NT_SUCCESS(Status))
     {
         /* Fail */
@@ -665,6 +692,153 @@ LdrpNameToOrdinal(IN LPSTR ImportName,
     return OrdinalTable[Next];
 }
 
+static
+ULONG
+LdrpHashExportName(IN LPSTR Name)
+{
+    ULONG Hash = 2166136261UL;
+
+    /* FNV-1a, export names are short */
+    while (*Name)
+    {
+        Hash ^= (UCHAR)*Name++;
+        Hash *= 16777619UL;
+    }
+
+    return Hash;
+}
+
+PLDRP_EXPORT_INDEX
+NTAPI
+LdrpGetExportIndex(IN PVOID ExportBase,
+                   IN PIMAGE_EXPORT_DIRECTORY ExportDirectory,
+                   IN PULONG NameTable,
+                   IN LPSTR DllName OPTIONAL)
+{
+    PIMAGE_NT_HEADERS NtHeader;
+    PLDRP_EXPORT_INDEX Index;
+    ULONG i, Count, Slot;
+
+    /* The slots hold a name index plus one */
+    if (!ExportDirectory->NumberOfNames ||
+        ExportDirectory->NumberOfNames >= MAXUSHORT)
+    {
+        return NULL;
+    }
+
+    NtHeader = RtlImageNtHeader(ExportBase);
+    if (!NtHeader) return NULL;
+
+    /*
+     * Look for this image. The index only holds positions in the name table,
+     * so it stays good for any mapping of the same file, even after the DLL
+     * got unloaded and mapped again somewhere else.
+     */
+    for (Index = LdrpExportIndexList; Index; Index = Index->Next)
+    {
+        if ((Index->TimeDateStamp == NtHeader->FileHeader.TimeDateStamp) &&
+            (Index->CheckSum == NtHeader->OptionalHeader.CheckSum) &&
+            (Index->SizeOfImage == NtHeader->OptionalHeader.SizeOfImage) &&
+            (Index->NumberOfNames == ExportDirectory->NumberOfNames))
+        {
+            break;
+        }
+    }
+
+    if (!Index)
+    {
+        /* First miss against this image, start counting */
+        Index = RtlAllocateHeap(LdrpHeap, HEAP_ZERO_MEMORY, sizeof(*Index));
+        if (!Index) return NULL;
+
+        Index->TimeDateStamp = NtHeader->FileHeader.TimeDateStamp;
+        Index->CheckSum = NtHeader->OptionalHeader.CheckSum;
+        Index->SizeOfImage = NtHeader->OptionalHeader.SizeOfImage;
+        Index->NumberOfNames = ExportDirectory->NumberOfNames;
+        Index->Next = LdrpExportIndexList;
+        LdrpExportIndexList = Index;
+    }
+
+    /* Already hashed? */
+    if (Index->Slots) return Index;
+
+    /* A binary search is cheaper than hashing every name for a few lookups */
+    if (++Index->Misses < LDRP_EXPORT_INDEX_THRESHOLD) return NULL;
+
+    /* Keep the table at most half full */
+    Count = 1;
+    while (Count < Index->NumberOfNames * 2) Count <<= 1;
+
+    Index->Slots = RtlAllocateHeap(LdrpHeap, HEAP_ZERO_MEMORY, Count * sizeof(USHORT));
+    if (!Index->Slots)
+    {
+        /* Try again later */
+        Index->Misses = 0;
+        return NULL;
+    }
+
+    /* Insert every name, probing linearly */
+    for (i = 0; i < Index->NumberOfNames; i++)
+    {
+        Slot = LdrpHashExportName((LPSTR)((ULONG_PTR)ExportBase + NameTable[i])) & (Count - 1);
+        while (Index->Slots[Slot]) Slot = (Slot + 1) & (Count - 1);
+        Index->Slots[Slot] = (USHORT)(i + 1);
+    }
+    Index->Mask = Count - 1;
+
+    /* Show debug message */
+    if (ShowSnaps)
+    {
+        DPRINT1("LDR: Indexed %lu export names of %s\n",
+                Index->NumberOfNames,
+                DllName ? DllName : "Unknown");
+    }
+
+    return Index;
+}
+
+USHORT
+NTAPI
+LdrpLookupExportName(IN LPSTR ImportName,
+                     IN PVOID ExportBase,
+                     IN PIMAGE_EXPORT_DIRECTORY ExportDirectory,
+                     IN PULONG NameTable,
+                     IN PUSHORT OrdinalTable,
+                     IN LPSTR DllName OPTIONAL)
+{
+    PLDRP_EXPORT_INDEX Index;
+    ULONG Slot, Name;
+
+    /* Callers hold the loader lock, which also guards the index list */
+    Index = LdrpGetExportIndex(ExportBase, ExportDirectory, NameTable, DllName);
+    if (Index)
+    {
+        /* Probe until we hit the name or an empty slot */
+        Slot = LdrpHashExportName(ImportName) & Index->Mask;
+        while (Index->Slots[Slot])
+        {
+            Name = Index->Slots[Slot] - 1;
+            if (!strcmp(ImportName, (PCHAR)((ULONG_PTR)ExportBase + NameTable[Name])))
+            {
+                return OrdinalTable[Name];
+            }
+            Slot = (Slot + 1) & Index->Mask;
+        }
+
+        /*
+         * Not there. The key is no proof that this is the same file though,
+         * so let the binary search have the final word. Missing exports are
+         * rare enough for that not to matter.
+         */
+    }
+
+    return LdrpNameToOrdinal(ImportName,
+                             ExportDirectory->NumberOfNames,
+                             ExportBase,
+                             NameTable,
+                             OrdinalTable);
+}
+
 NTSTATUS
 NTAPI
 LdrpWalkImportDescriptor(IN LPWSTR DllPath OPTIONAL,
@@ -676,6 +850,7 @@ LdrpWalkImportDescriptor(IN LPWSTR DllPath OPTIONAL,
     PIMAGE_BOUND_IMPORT_DESCRIPTOR BoundEntry = NULL;
     PIMAGE_IMPORT_DESCRIPTOR ImportEntry;
     ULONG BoundSize, IatSize;
+    PVOID Prefetch = NULL;
 
     DPRINT("LdrpWalkImportDescriptor - BEGIN (%wZ %p '%S')\n", &LdrEntry->BaseDllName, LdrEntry, DllPath);
 
@@ -747,6 +922,9 @@ LdrpWalkImportDescriptor(IN LPWSTR DllPath OPTIONAL,
                                                IMAGE_DIRECTORY_ENTRY_IMPORT,
                                                &IatSize);
 
+    /* Let the loader workers find and open the DLLs we are about to need */
+    if (ImportEntry) Prefetch = LdrpPrefetchImports(DllPath, LdrEntry, ImportEntry);
+
     /* Check if we got at least one */
     if ((BoundEntry) || (ImportEntry))
     {
@@ -794,6 +972,9 @@ LdrpWalkImportDescriptor(IN LPWSTR DllPath OPTIONAL,
         }
     }
 
+    /* Drop whatever they opened that wasn't used */
+    if (Prefetch) LdrpReleasePrefetchBatch(Prefetch);
+
     /* Release the activation context */
     RtlDeactivateActivationContextUnsafeFast(&ActCtx);
 
@@ -1013,11 +1194,12 @@ LdrpSnapThunk(IN PVOID ExportBase,
         else
         {
             /* Well bummer, hint didn't work, do it the long way */
-            Ordinal = LdrpNameToOrdinal(ImportName,
-                                        ExportDirectory->NumberOfNames,
-                                        ExportBase,
-                                        NameTable,
-                                        OrdinalTable);
+            Ordinal = LdrpLookupExportName(ImportName,
+                                           ExportBase,
+                                           ExportDirectory,
+                                           NameTable,
+                                           OrdinalTable,
+                                           DllName);
         }
     }
 
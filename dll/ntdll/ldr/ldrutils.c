@@ -1051,6 +1051,7 @@ LdrpMapDll(IN PWSTR SearchPath OPTIONAL,
     ULONG_PTR CandidateBase, CandidateEnd;
     UNICODE_STRING OverlapDll;
     BOOLEAN RelocatableDll = TRUE;
+    BOOLEAN Relocated = FALSE;
     UNICODE_STRING IllegalDll;
     PVOID RelocData;
     ULONG RelocDataSize = 0;
@@ -1064,6 +1065,23 @@ LdrpMapDll(IN PWSTR SearchPath OPTIONAL,
                 SearchPath ? SearchPath : L"");
     }
 
+    /* A loader worker may have found it, created the section and mapped it already */
+    if (!Redirect &&
+        LdrpTakePrefetchedDll(SearchPath,
+                              DllName,
+                              &FullDllName,
+                              &BaseDllName,
+                              &SectionHandle,
+                              &ViewBase,
+                              &ViewSize,
+                              &Status,
+                              &Relocated,
+                              &KnownDll))
+    {
+        if (ViewBase) goto SectionMapped;
+        goto MapSection;
+    }
+
     /* Check if we have a known dll directory */
     if (LdrpKnownDllObjectDirectory && Redirect == FALSE)
     {
@@ -1184,6 +1202,7 @@ SkipCheck:
         KnownDll = TRUE;
     }
 
+MapSection:
     /* Stuff the image name in the TIB, for the debugger */
     ArbitraryUserPointer = Teb->NtTib.ArbitraryUserPointer;
     Teb->NtTib.ArbitraryUserPointer = FullDllName.Buffer;
@@ -1213,6 +1232,7 @@ SkipCheck:
         return Status;
     }
 
+SectionMapped:
     /* Get the NT Header */
     if (!(NtHeaders = RtlImageNtHeader(ViewBase)))
     {
@@ -1438,6 +1458,13 @@ SkipCheck:
                 goto FailRelocate;
             }
 
+            /* A loader worker may have applied the fixups already */
+            if (Relocated)
+            {
+                Status = STATUS_SUCCESS;
+                goto FailRelocate;
+            }
+
             /* Change the protection to prepare for relocation */
             Status = LdrpSetProtection(ViewBase, FALSE);
 
@@ -2448,6 +2475,8 @@ LdrpLoadDll(IN BOOLEAN Redirected,
     UNICODE_STRING RawDllName;
     PLDR_DATA_TABLE_ENTRY LdrEntry;
     BOOLEAN InInit = LdrpInLdrInit;
+    BOOLEAN Loaded;
+    PVOID Prefetch = NULL;
 
     /* Save the Raw DLL Name */
     if (DllName->Length >= sizeof(NameBuffer)) return STATUS_NAME_TOO_LONG;
@@ -2498,9 +2527,26 @@ LdrpLoadDll(IN BOOLEAN Redirected,
                                              &LdrApiDefaultExtension);
     }
 
+    /* Search for a new DLL and open it without holding up other loads */
+    if (!InInit && !Redirected)
+    {
+        RtlEnterCriticalSection(&LdrpLoaderLock);
+        Loaded = LdrpCheckForLoadedDll(DllPath,
+                                       &RawDllName,
+                                       FALSE,
+                                       Redirected,
+                                       &LdrEntry);
+        RtlLeaveCriticalSection(&LdrpLoaderLock);
+
+        if (!Loaded) Prefetch = LdrpPrefetchDll(DllPath, &RawDllName);
+    }
+
     /* Check for init flag and acquire lock */
     if (!InInit) RtlEnterCriticalSection(&LdrpLoaderLock);
 
+    /* LdrpMapDll picks up the section if it's still needed */
+    if (Prefetch) LdrpPublishPrefetchBatch(Prefetch);
+
     _SEH2_TRY
     {
         /* Show debug message */
@@ -2644,6 +2690,9 @@ LdrpLoadDll(IN BOOLEAN Redirected,
     }
     _SEH2_FINALLY
     {
+        /* Drop the section if another thread loaded the DLL meanwhile */
+        if (Prefetch) LdrpReleasePrefetchBatch(Prefetch);
+
         /* Release the lock */
         if (!InInit) RtlLeaveCriticalSection(&LdrpLoaderLock);
     }
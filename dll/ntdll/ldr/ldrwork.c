@@ -0,0 +1,801 @@
+/*
+ * PROJECT:     ReactOS NT User Mode Library
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Loader worker threads, finding and opening DLLs in parallel
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include <ntdll.h>
+
+#define NDEBUG
+#include <debug.h>
+
+/*
+ * Before a module's imports are walked, the ones that aren't loaded yet are
+ * looked up on the search path, their image sections are created and mapped,
+ * and relocated if they didn't get their preferred base, by a few worker
+ * threads impersonating the loading thread. The thread walking the imports
+ * keeps the loader lock, inserts each DLL in the module list and snaps it in
+ * order as before, since snapping loads and looks up other modules, but it
+ * usually finds the image mapped. Workers never run DLL code and skip the
+ * per-thread loader setup, so they can run while the loader lock is held or
+ * the process initializes. They go away after being idle for a while.
+ */
+
+/* GLOBALS *******************************************************************/
+
+#define LDRP_MAX_LOADER_WORKERS     16
+#define LDRP_DEFAULT_LOADER_WORKERS 4
+#define LDRP_LOADER_WORKER_IDLE_MS  10000
+
+#define LDRP_PREFETCH_QUEUED   0
+#define LDRP_PREFETCH_RUNNING  1
+#define LDRP_PREFETCH_DONE     2
+#define LDRP_PREFETCH_CONSUMED 3
+
+typedef struct _LDRP_PREFETCH_BATCH *PLDRP_PREFETCH_BATCH;
+
+typedef struct _LDRP_PREFETCH_ENTRY
+{
+    LIST_ENTRY Links;
+    LIST_ENTRY WorkLinks;
+    PLDRP_PREFETCH_BATCH Batch;
+    volatile LONG State;
+    PWSTR DllPath;
+    UNICODE_STRING DllName;
+    UNICODE_STRING FullDllName;
+    UNICODE_STRING BaseDllName;
+    HANDLE SectionHandle;
+    PVOID ViewBase;
+    SIZE_T ViewSize;
+    NTSTATUS MapStatus;
+    BOOLEAN Relocated;
+    BOOLEAN KnownDll;
+    NTSTATUS Status;
+} LDRP_PREFETCH_ENTRY, *PLDRP_PREFETCH_ENTRY;
+
+typedef struct _LDRP_PREFETCH_BATCH
+{
+    PVOID ActivationContext;
+    HANDLE Token;
+    BOOLEAN Published;
+    ULONG Count;
+    LDRP_PREFETCH_ENTRY Entries[ANYSIZE_ARRAY];
+} LDRP_PREFETCH_BATCH;
+
+ULONG LdrpMaxLoaderThreads = LDRP_DEFAULT_LOADER_WORKERS;
+
+/* Published entries, protected by the loader lock */
+static LIST_ENTRY LdrpPrefetchList = { &LdrpPrefetchList, &LdrpPrefetchList };
+
+static BOOLEAN LdrpLoaderWorkersInitialized;
+static BOOLEAN LdrpLoaderWorkersReady;
+
+/* Live workers, free slots are NULL, protected by LdrpWorkQueueLock */
+static ULONG LdrpLoaderWorkerCount;
+static HANDLE LdrpLoaderWorkerIds[LDRP_MAX_LOADER_WORKERS];
+
+static RTL_CRITICAL_SECTION LdrpWorkQueueLock;
+static LIST_ENTRY LdrpWorkQueue;
+static HANDLE LdrpWorkSemaphore;
+static HANDLE LdrpWorkDoneEvent;
+
+/* FUNCTIONS *****************************************************************/
+
+BOOLEAN
+NTAPI
+LdrpIsLoaderWorker(VOID)
+{
+    HANDLE ThreadId = NtCurrentTeb()->ClientId.UniqueThread;
+    ULONG i;
+
+    /* A worker's slot is set before it runs and cleared before it exits */
+    for (i = 0; i < LDRP_MAX_LOADER_WORKERS; i++)
+    {
+        if (LdrpLoaderWorkerIds[i] == ThreadId) return TRUE;
+    }
+
+    return FALSE;
+}
+
+static
+BOOLEAN
+LdrpPrefetchKnownDll(IN PLDRP_PREFETCH_ENTRY Entry)
+{
+    PWCHAR p;
+    NTSTATUS Status;
+
+    /* Same rules as LdrpMapDll: no Known DLL lookup for paths */
+    if (!LdrpKnownDllObjectDirectory) return FALSE;
+    for (p = Entry->DllName.Buffer; *p; p++)
+    {
+        if (*p == L'\\' || *p == L'/') return FALSE;
+    }
+
+    Status = LdrpCheckForKnownDll(Entry->DllName.Buffer,
+                                  &Entry->FullDllName,
+                                  &Entry->BaseDllName,
+                                  &Entry->SectionHandle);
+    if (!NT_SUCCESS(Status))
+    {
+        /* Let LdrpMapDll fail on its own */
+        Entry->Status = Status;
+        return TRUE;
+    }
+
+    if (!Entry->SectionHandle) return FALSE;
+
+    Entry->KnownDll = TRUE;
+    Entry->Status = STATUS_SUCCESS;
+    return TRUE;
+}
+
+static
+VOID
+LdrpPrefetchDllView(IN PLDRP_PREFETCH_ENTRY Entry)
+{
+    PTEB Teb = NtCurrentTeb();
+    PIMAGE_NT_HEADERS NtHeaders;
+    PVOID ArbitraryUserPointer, RelocData;
+    ULONG RelocDataSize = 0;
+    NTSTATUS Status;
+
+    /* Stuff the image name in the TIB, for the debugger */
+    ArbitraryUserPointer = Teb->NtTib.ArbitraryUserPointer;
+    Teb->NtTib.ArbitraryUserPointer = Entry->FullDllName.Buffer;
+    Status = NtMapViewOfSection(Entry->SectionHandle,
+                                NtCurrentProcess(),
+                                &Entry->ViewBase,
+                                0,
+                                0,
+                                NULL,
+                                &Entry->ViewSize,
+                                ViewShare,
+                                0,
+                                PAGE_READWRITE);
+    Teb->NtTib.ArbitraryUserPointer = ArbitraryUserPointer;
+
+    /* LdrpMapDll maps it again and reports the failure itself */
+    if (!NT_SUCCESS(Status))
+    {
+        Entry->ViewBase = NULL;
+        Entry->ViewSize = 0;
+        return;
+    }
+
+    Entry->MapStatus = Status;
+    if (Status != STATUS_IMAGE_NOT_AT_BASE) return;
+
+    /*
+     * Only apply the fixups LdrpMapDll would apply without further ado: a DLL
+     * with relocations that isn't a Known DLL. Anything else, including the
+     * hard errors, stays with it.
+     */
+    NtHeaders = RtlImageNtHeader(Entry->ViewBase);
+    if (!NtHeaders ||
+        !(NtHeaders->FileHeader.Characteristics & IMAGE_FILE_DLL) ||
+        (NtHeaders->FileHeader.Characteristics & IMAGE_FILE_RELOCS_STRIPPED))
+    {
+        return;
+    }
+
+    RelocData = RtlImageDirectoryEntryToData(Entry->ViewBase,
+                                             TRUE,
+                                             IMAGE_DIRECTORY_ENTRY_BASERELOC,
+                                             &RelocDataSize);
+    if (!RelocData && !RelocDataSize) return;
+
+    Status = LdrpSetProtection(Entry->ViewBase, FALSE);
+    if (NT_SUCCESS(Status))
+    {
+        Status = LdrRelocateImageWithBias(Entry->ViewBase, 0LL, NULL, STATUS_SUCCESS,
+            STATUS_CONFLICTING_ADDRESSES, STATUS_INVALID_IMAGE_FORMAT);
+        if (NT_SUCCESS(Status)) Status = LdrpSetProtection(Entry->ViewBase, TRUE);
+    }
+
+    if (!NT_SUCCESS(Status))
+    {
+        /* Start over from a clean view in LdrpMapDll */
+        NtUnmapViewOfSection(NtCurrentProcess(), Entry->ViewBase);
+        Entry->ViewBase = NULL;
+        Entry->ViewSize = 0;
+        return;
+    }
+
+    if (ShowSnaps)
+    {
+        DPRINT1("LDR: Prefetch fixups applied to %wZ @ %p\n",
+                &Entry->FullDllName, Entry->ViewBase);
+    }
+
+    Entry->Relocated = TRUE;
+}
+
+static
+VOID
+LdrpPrefetchDllSection(IN PLDRP_PREFETCH_ENTRY Entry)
+{
+    UNICODE_STRING NtPathDllName;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatusBlock;
+    HANDLE FileHandle;
+    NTSTATUS Status;
+
+    if (!LdrpResolveDllName(Entry->DllPath,
+                            Entry->DllName.Buffer,
+                            &Entry->FullDllName,
+                            &Entry->BaseDllName))
+    {
+        Entry->Status = STATUS_DLL_NOT_FOUND;
+        return;
+    }
+
+    if (!RtlDosPathNameToNtPathName_U(Entry->FullDllName.Buffer,
+                                      &NtPathDllName,
+                                      NULL,
+                                      NULL))
+    {
+        Status = STATUS_OBJECT_PATH_SYNTAX_BAD;
+        goto Failure;
+    }
+
+    /* Unlike LdrpCreateDllSection no hard errors, LdrpMapDll retries failures itself */
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &NtPathDllName,
+                               OBJ_CASE_INSENSITIVE,
+                               NULL,
+                               NULL);
+    Status = NtOpenFile(&FileHandle,
+                        SYNCHRONIZE | FILE_EXECUTE | FILE_READ_DATA,
+                        &ObjectAttributes,
+                        &IoStatusBlock,
+                        FILE_SHARE_READ | FILE_SHARE_DELETE,
+                        FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, NtPathDllName.Buffer);
+    if (!NT_SUCCESS(Status)) goto Failure;
+
+    Status = NtCreateSection(&Entry->SectionHandle,
+                             SECTION_MAP_READ | SECTION_MAP_EXECUTE |
+                             SECTION_MAP_WRITE | SECTION_QUERY,
+                             NULL,
+                             NULL,
+                             PAGE_EXECUTE,
+                             SEC_IMAGE,
+                             FileHandle);
+    NtClose(FileHandle);
+    if (!NT_SUCCESS(Status))
+    {
+        Entry->SectionHandle = NULL;
+        goto Failure;
+    }
+
+    if (ShowSnaps)
+    {
+        DPRINT1("LDR: Prefetched %wZ\n", &Entry->FullDllName);
+    }
+
+    LdrpPrefetchDllView(Entry);
+    Entry->Status = STATUS_SUCCESS;
+    return;
+
+Failure:
+    LdrpFreeUnicodeString(&Entry->FullDllName);
+    LdrpFreeUnicodeString(&Entry->BaseDllName);
+    Entry->Status = Status;
+}
+
+static
+ULONG
+NTAPI
+LdrpLoaderWorker(IN PVOID Parameter)
+{
+    HANDLE ThreadId = NtCurrentTeb()->ClientId.UniqueThread;
+    PLDRP_PREFETCH_ENTRY Entry;
+    LARGE_INTEGER Timeout;
+    HANDLE Token;
+    NTSTATUS Status;
+    ULONG i;
+
+    Timeout.QuadPart = Int32x32To64(LDRP_LOADER_WORKER_IDLE_MS, -10000);
+
+    for (;;)
+    {
+        Status = NtWaitForSingleObject(LdrpWorkSemaphore, FALSE, &Timeout);
+
+        /* The loading thread may have taken it back already */
+        RtlEnterCriticalSection(&LdrpWorkQueueLock);
+        if (IsListEmpty(&LdrpWorkQueue))
+        {
+            /* Leave with the lock held, nothing can be queued for us meanwhile */
+            if (Status == STATUS_TIMEOUT) break;
+
+            RtlLeaveCriticalSection(&LdrpWorkQueueLock);
+            continue;
+        }
+        Entry = CONTAINING_RECORD(RemoveHeadList(&LdrpWorkQueue),
+                                  LDRP_PREFETCH_ENTRY,
+                                  WorkLinks);
+        Entry->State = LDRP_PREFETCH_RUNNING;
+        RtlLeaveCriticalSection(&LdrpWorkQueueLock);
+
+        /* Search and open the file as the loading thread would */
+        Token = Entry->Batch->Token;
+        Status = STATUS_SUCCESS;
+        if (Token)
+        {
+            Status = NtSetInformationThread(NtCurrentThread(),
+                                            ThreadImpersonationToken,
+                                            &Token,
+                                            sizeof(Token));
+        }
+
+        if (NT_SUCCESS(Status))
+            LdrpPrefetchDllSection(Entry);
+        else
+            Entry->Status = Status;
+
+        if (Token)
+        {
+            Token = NULL;
+            NtSetInformationThread(NtCurrentThread(),
+                                   ThreadImpersonationToken,
+                                   &Token,
+                                   sizeof(Token));
+        }
+
+        /* The entry may be gone once it's done, don't touch it anymore */
+        InterlockedExchange(&Entry->State, LDRP_PREFETCH_DONE);
+        NtSetEvent(LdrpWorkDoneEvent, NULL);
+    }
+
+    /* Idle for a while, give the slot back */
+    for (i = 0; i < LDRP_MAX_LOADER_WORKERS; i++)
+    {
+        if (LdrpLoaderWorkerIds[i] == ThreadId)
+        {
+            LdrpLoaderWorkerIds[i] = NULL;
+            LdrpLoaderWorkerCount--;
+            break;
+        }
+    }
+    RtlLeaveCriticalSection(&LdrpWorkQueueLock);
+
+    /* No DLL was told about this thread, so don't tell them it's leaving */
+    NtCurrentTeb()->FreeStackOnTermination = TRUE;
+    NtTerminateThread(NtCurrentThread(), STATUS_SUCCESS);
+    return 0;
+}
+
+static
+BOOLEAN
+LdrpInitializeLoaderWorkers(VOID)
+{
+    NTSTATUS Status;
+
+    if (LdrpLoaderWorkersInitialized) return LdrpLoaderWorkersReady;
+    LdrpLoaderWorkersInitialized = TRUE;
+
+    if (!min(LdrpMaxLoaderThreads, LDRP_MAX_LOADER_WORKERS)) return FALSE;
+
+    InitializeListHead(&LdrpWorkQueue);
+    Status = RtlInitializeCriticalSection(&LdrpWorkQueueLock);
+    if (!NT_SUCCESS(Status)) return FALSE;
+
+    Status = NtCreateSemaphore(&LdrpWorkSemaphore,
+                               SEMAPHORE_ALL_ACCESS,
+                               NULL,
+                               0,
+                               MAXLONG);
+    if (!NT_SUCCESS(Status)) return FALSE;
+
+    Status = NtCreateEvent(&LdrpWorkDoneEvent,
+                           EVENT_ALL_ACCESS,
+                           NULL,
+                           SynchronizationEvent,
+                           FALSE);
+    if (!NT_SUCCESS(Status)) return FALSE;
+
+    LdrpLoaderWorkersReady = TRUE;
+    return TRUE;
+}
+
+static
+VOID
+LdrpAddLoaderWorkers(IN ULONG Queued)
+{
+    CLIENT_ID ClientId;
+    HANDLE ThreadHandle;
+    NTSTATUS Status;
+    ULONG Count, i;
+
+    /* Called with LdrpWorkQueueLock held, anything queued is taken back if this fails */
+    Count = min(min(LdrpMaxLoaderThreads, LDRP_MAX_LOADER_WORKERS), Queued);
+
+    for (i = 0; i < LDRP_MAX_LOADER_WORKERS && LdrpLoaderWorkerCount < Count; i++)
+    {
+        if (LdrpLoaderWorkerIds[i]) continue;
+
+        /* Record the thread before it runs, so LdrpInit recognizes it */
+        Status = RtlCreateUserThread(NtCurrentProcess(),
+                                     NULL,
+                                     TRUE,
+                                     0,
+                                     0,
+                                     0,
+                                     LdrpLoaderWorker,
+                                     NULL,
+                                     &ThreadHandle,
+                                     &ClientId);
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("LDR: Failed to create a loader worker, status 0x%08lx\n", Status);
+            break;
+        }
+
+        LdrpLoaderWorkerIds[i] = ClientId.UniqueThread;
+        LdrpLoaderWorkerCount++;
+        NtResumeThread(ThreadHandle, NULL);
+        NtClose(ThreadHandle);
+    }
+}
+
+static
+VOID
+LdrpWaitForPrefetch(IN PLDRP_PREFETCH_ENTRY Entry,
+                    IN BOOLEAN Cancel)
+{
+    /* Nobody is working on it yet, take it back */
+    if (Entry->State == LDRP_PREFETCH_QUEUED)
+    {
+        RtlEnterCriticalSection(&LdrpWorkQueueLock);
+        if (Entry->State == LDRP_PREFETCH_QUEUED)
+        {
+            RemoveEntryList(&Entry->WorkLinks);
+            Entry->State = LDRP_PREFETCH_RUNNING;
+            RtlLeaveCriticalSection(&LdrpWorkQueueLock);
+
+            if (Cancel)
+                Entry->Status = STATUS_CANCELLED;
+            else
+                LdrpPrefetchDllSection(Entry);
+
+            Entry->State = LDRP_PREFETCH_DONE;
+            return;
+        }
+        RtlLeaveCriticalSection(&LdrpWorkQueueLock);
+    }
+
+    /* Only the loader lock owner waits, so one auto-reset event is enough */
+    while (Entry->State == LDRP_PREFETCH_RUNNING)
+    {
+        NtWaitForSingleObject(LdrpWorkDoneEvent, FALSE, NULL);
+    }
+}
+
+static
+PLDRP_PREFETCH_BATCH
+LdrpAllocatePrefetchBatch(IN ULONG Count)
+{
+    PLDRP_PREFETCH_BATCH Batch;
+
+    Batch = RtlAllocateHeap(LdrpHeap,
+                            HEAP_ZERO_MEMORY,
+                            FIELD_OFFSET(LDRP_PREFETCH_BATCH, Entries[Count]));
+    if (!Batch) return NULL;
+
+    if (!NT_SUCCESS(RtlGetActiveActivationContext(&Batch->ActivationContext)))
+    {
+        RtlFreeHeap(LdrpHeap, 0, Batch);
+        return NULL;
+    }
+
+    return Batch;
+}
+
+static
+BOOLEAN
+LdrpInitializePrefetchEntry(IN PLDRP_PREFETCH_BATCH Batch,
+                            IN PWSTR DllPath,
+                            IN PCUNICODE_STRING DllName)
+{
+    PLDRP_PREFETCH_ENTRY Entry = &Batch->Entries[Batch->Count];
+
+    Entry->DllName.Length = DllName->Length;
+    Entry->DllName.MaximumLength = DllName->Length + sizeof(UNICODE_NULL);
+    Entry->DllName.Buffer = RtlAllocateHeap(LdrpHeap, 0, Entry->DllName.MaximumLength);
+    if (!Entry->DllName.Buffer) return FALSE;
+
+    RtlCopyMemory(Entry->DllName.Buffer, DllName->Buffer, DllName->Length);
+    Entry->DllName.Buffer[DllName->Length / sizeof(WCHAR)] = UNICODE_NULL;
+    Entry->Batch = Batch;
+    Entry->DllPath = DllPath;
+    Entry->State = LDRP_PREFETCH_DONE;
+    Entry->Status = STATUS_UNSUCCESSFUL;
+    Batch->Count++;
+    return TRUE;
+}
+
+static
+PLDRP_PREFETCH_ENTRY
+LdrpFindPrefetchEntry(IN PWSTR DllPath,
+                      IN PCUNICODE_STRING DllName,
+                      IN PVOID ActivationContext)
+{
+    PLIST_ENTRY NextEntry;
+    PLDRP_PREFETCH_ENTRY Entry;
+
+    for (NextEntry = LdrpPrefetchList.Flink;
+         NextEntry != &LdrpPrefetchList;
+         NextEntry = NextEntry->Flink)
+    {
+        Entry = CONTAINING_RECORD(NextEntry, LDRP_PREFETCH_ENTRY, Links);
+        if (Entry->State != LDRP_PREFETCH_CONSUMED &&
+            Entry->DllPath == DllPath &&
+            Entry->Batch->ActivationContext == ActivationContext &&
+            RtlEqualUnicodeString(&Entry->DllName, DllName, TRUE))
+        {
+            return Entry;
+        }
+    }
+
+    return NULL;
+}
+
+VOID
+NTAPI
+LdrpPublishPrefetchBatch(IN PVOID Context)
+{
+    PLDRP_PREFETCH_BATCH Batch = Context;
+    ULONG i;
+
+    /* Called with the loader lock held */
+    for (i = 0; i < Batch->Count; i++)
+    {
+        InsertTailList(&LdrpPrefetchList, &Batch->Entries[i].Links);
+    }
+    Batch->Published = TRUE;
+}
+
+VOID
+NTAPI
+LdrpReleasePrefetchBatch(IN PVOID Context)
+{
+    PLDRP_PREFETCH_BATCH Batch = Context;
+    PLDRP_PREFETCH_ENTRY Entry;
+    ULONG i;
+
+    for (i = 0; i < Batch->Count; i++)
+    {
+        Entry = &Batch->Entries[i];
+        if (Batch->Published) RemoveEntryList(&Entry->Links);
+
+        /* Whatever wasn't used is dropped, a worker may still be on it */
+        LdrpWaitForPrefetch(Entry, TRUE);
+        if (Entry->State == LDRP_PREFETCH_DONE && NT_SUCCESS(Entry->Status))
+        {
+            if (Entry->ViewBase) NtUnmapViewOfSection(NtCurrentProcess(), Entry->ViewBase);
+            NtClose(Entry->SectionHandle);
+            LdrpFreeUnicodeString(&Entry->FullDllName);
+            LdrpFreeUnicodeString(&Entry->BaseDllName);
+        }
+        RtlFreeHeap(LdrpHeap, 0, Entry->DllName.Buffer);
+    }
+
+    if (Batch->Token) NtClose(Batch->Token);
+    RtlReleaseActivationContext(Batch->ActivationContext);
+    RtlFreeHeap(LdrpHeap, 0, Batch);
+}
+
+PVOID
+NTAPI
+LdrpPrefetchDll(IN PWSTR DllPath OPTIONAL,
+                IN PUNICODE_STRING DllName)
+{
+    PLDRP_PREFETCH_BATCH Batch;
+    PLDRP_PREFETCH_ENTRY Entry;
+
+    /* Done by the caller itself, without the loader lock */
+    Batch = LdrpAllocatePrefetchBatch(1);
+    if (!Batch) return NULL;
+
+    if (!LdrpInitializePrefetchEntry(Batch, DllPath, DllName))
+    {
+        LdrpReleasePrefetchBatch(Batch);
+        return NULL;
+    }
+
+    Entry = &Batch->Entries[0];
+    if (!LdrpPrefetchKnownDll(Entry)) LdrpPrefetchDllSection(Entry);
+
+    return Batch;
+}
+
+PVOID
+NTAPI
+LdrpPrefetchImports(IN PWSTR DllPath OPTIONAL,
+                    IN PLDR_DATA_TABLE_ENTRY LdrEntry,
+                    IN PIMAGE_IMPORT_DESCRIPTOR ImportEntry)
+{
+    PIMAGE_IMPORT_DESCRIPTOR Descriptor;
+    PIMAGE_THUNK_DATA FirstThunk;
+    PLDRP_PREFETCH_BATCH Batch;
+    PLDRP_PREFETCH_ENTRY Entry;
+    PLDR_DATA_TABLE_ENTRY DllLdrEntry;
+    UNICODE_STRING DllName, RedirectedName;
+    PUNICODE_STRING NewName;
+    ANSI_STRING AnsiName;
+    WCHAR NameBuffer[MAX_PATH + 6];
+    ULONG Count = 0, Queued = 0, i;
+    NTSTATUS Status;
+
+    if (!LdrpMaxLoaderThreads) return NULL;
+
+    /* Nothing to overlap with a single import */
+    for (Descriptor = ImportEntry;
+         Descriptor->Name && Descriptor->FirstThunk;
+         Descriptor++)
+    {
+        Count++;
+    }
+    if (Count < 2) return NULL;
+
+    Batch = LdrpAllocatePrefetchBatch(Count);
+    if (!Batch) return NULL;
+
+    for (Descriptor = ImportEntry;
+         Descriptor->Name && Descriptor->FirstThunk;
+         Descriptor++)
+    {
+        /* Same entries LdrpHandleOneOldFormatImportDescriptor skips */
+        FirstThunk = (PIMAGE_THUNK_DATA)((ULONG_PTR)LdrEntry->DllBase + Descriptor->FirstThunk);
+        if (!FirstThunk->u1.Function) continue;
+
+        /* Same name LdrpLoadImportModule will ask for */
+        RtlInitAnsiString(&AnsiName, (PSTR)((ULONG_PTR)LdrEntry->DllBase + Descriptor->Name));
+        RtlInitEmptyUnicodeString(&DllName, NameBuffer, sizeof(NameBuffer) - sizeof(UNICODE_NULL));
+        if (!NT_SUCCESS(RtlAnsiStringToUnicodeString(&DllName, &AnsiName, FALSE))) continue;
+        NameBuffer[DllName.Length / sizeof(WCHAR)] = UNICODE_NULL;
+        if (!wcschr(NameBuffer, L'.'))
+        {
+            if (!NT_SUCCESS(RtlAppendUnicodeStringToString(&DllName, &LdrApiDefaultExtension))) continue;
+            NameBuffer[DllName.Length / sizeof(WCHAR)] = UNICODE_NULL;
+        }
+
+        /* Leave redirected, loaded and already pending DLLs alone */
+        RtlInitEmptyUnicodeString(&RedirectedName, NULL, 0);
+        NewName = &DllName;
+        Status = RtlDosApplyFileIsolationRedirection_Ustr(TRUE,
+                                                          &DllName,
+                                                          &LdrApiDefaultExtension,
+                                                          NULL,
+                                                          &RedirectedName,
+                                                          &NewName,
+                                                          NULL,
+                                                          NULL,
+                                                          NULL);
+        RtlFreeUnicodeString(&RedirectedName);
+        if (Status != STATUS_SXS_KEY_NOT_FOUND) continue;
+
+        if (LdrpCheckForLoadedDll(DllPath, &DllName, TRUE, FALSE, &DllLdrEntry)) continue;
+        if (LdrpFindPrefetchEntry(DllPath, &DllName, Batch->ActivationContext)) continue;
+
+        for (i = 0; i < Batch->Count; i++)
+        {
+            if (RtlEqualUnicodeString(&Batch->Entries[i].DllName, &DllName, TRUE)) break;
+        }
+        if (i < Batch->Count) continue;
+
+        if (!LdrpInitializePrefetchEntry(Batch, DllPath, &DllName)) break;
+    }
+
+    if (!Batch->Count)
+    {
+        LdrpReleasePrefetchBatch(Batch);
+        return NULL;
+    }
+
+    /* Known DLLs are just an NtOpenSection, do them here */
+    for (i = 0; i < Batch->Count; i++)
+    {
+        Entry = &Batch->Entries[i];
+        if (LdrpPrefetchKnownDll(Entry)) continue;
+
+        Entry->State = LDRP_PREFETCH_QUEUED;
+        Queued++;
+    }
+
+    /* Workers impersonate the caller, if it impersonates anyone */
+    if (Queued)
+    {
+        Status = NtOpenThreadToken(NtCurrentThread(),
+                                   TOKEN_IMPERSONATE,
+                                   TRUE,
+                                   &Batch->Token);
+        if (!NT_SUCCESS(Status))
+        {
+            Batch->Token = NULL;
+            if (Status != STATUS_NO_TOKEN) Queued = 0;
+        }
+    }
+
+    if (!Queued || !LdrpInitializeLoaderWorkers())
+    {
+        /* Put them back so LdrpReleasePrefetchBatch won't wait on them */
+        for (i = 0; i < Batch->Count; i++)
+        {
+            Entry = &Batch->Entries[i];
+            if (Entry->State == LDRP_PREFETCH_QUEUED)
+            {
+                Entry->State = LDRP_PREFETCH_DONE;
+                Entry->Status = STATUS_CANCELLED;
+            }
+        }
+        Queued = 0;
+    }
+
+    if (Queued)
+    {
+        RtlEnterCriticalSection(&LdrpWorkQueueLock);
+        for (i = 0; i < Batch->Count; i++)
+        {
+            Entry = &Batch->Entries[i];
+            if (Entry->State == LDRP_PREFETCH_QUEUED)
+            {
+                InsertTailList(&LdrpWorkQueue, &Entry->WorkLinks);
+            }
+        }
+
+        /* Under the same lock an idle worker checks the queue before leaving */
+        LdrpAddLoaderWorkers(Queued);
+        RtlLeaveCriticalSection(&LdrpWorkQueueLock);
+        NtReleaseSemaphore(LdrpWorkSemaphore, Queued, NULL);
+    }
+
+    LdrpPublishPrefetchBatch(Batch);
+    return Batch;
+}
+
+BOOLEAN
+NTAPI
+LdrpTakePrefetchedDll(IN PWSTR DllPath OPTIONAL,
+                      IN PWSTR DllName,
+                      OUT PUNICODE_STRING FullDllName,
+                      OUT PUNICODE_STRING BaseDllName,
+                      OUT PHANDLE SectionHandle,
+                      OUT PVOID *ViewBase,
+                      OUT PSIZE_T ViewSize,
+                      OUT PNTSTATUS MapStatus,
+                      OUT PBOOLEAN Relocated,
+                      OUT PBOOLEAN KnownDll)
+{
+    PLDRP_PREFETCH_ENTRY Entry;
+    UNICODE_STRING Name;
+    PVOID ActivationContext;
+
+    /* Called with the loader lock held */
+    if (IsListEmpty(&LdrpPrefetchList)) return FALSE;
+
+    if (!NT_SUCCESS(RtlGetActiveActivationContext(&ActivationContext))) return FALSE;
+    RtlInitUnicodeString(&Name, DllName);
+    Entry = LdrpFindPrefetchEntry(DllPath, &Name, ActivationContext);
+    RtlReleaseActivationContext(ActivationContext);
+    if (!Entry) return FALSE;
+
+    LdrpWaitForPrefetch(Entry, FALSE);
+    if (!NT_SUCCESS(Entry->Status)) return FALSE;
+
+    /* The mapping owns the strings, the section and the view from now on */
+    *FullDllName = Entry->FullDllName;
+    *BaseDllName = Entry->BaseDllName;
+    *SectionHandle = Entry->SectionHandle;
+    *ViewBase = Entry->ViewBase;
+    *ViewSize = Entry->ViewSize;
+    *MapStatus = Entry->MapStatus;
+    *Relocated = Entry->Relocated;
+    *KnownDll = Entry->KnownDll;
+    Entry->State = LDRP_PREFETCH_CONSUMED;
+    return TRUE;
+}
+
+/* EOF */
@@ -22,143 +22,422 @@ DEBUG_CHANNEL(kernel32file);
 /* FUNCTIONS ****************************************************************/
 
 
+/* Not in the headers we are built against */
+#if (_WIN32_WINNT < 0x0600)
+#define COPY_FILE_NO_BUFFERING 0x00001000
+#endif
+
+#ifndef FSCTL_DUPLICATE_EXTENTS_TO_FILE
+#define FSCTL_DUPLICATE_EXTENTS_TO_FILE CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 209, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+typedef struct _DUPLICATE_EXTENTS_DATA
+{
+    HANDLE FileHandle;
+    LARGE_INTEGER SourceFileOffset;
+    LARGE_INTEGER TargetFileOffset;
+    LARGE_INTEGER ByteCount;
+} DUPLICATE_EXTENTS_DATA, *PDUPLICATE_EXTENTS_DATA;
+#endif
+
+/* Buffers kept in flight, and the bounds of the chunk each one moves */
+#define COPY_BUFFER_COUNT   4
+#define COPY_MIN_CHUNK      0x10000
+#define COPY_MAX_CHUNK      0x100000
+
+typedef struct _COPY_BUFFER
+{
+    HANDLE Event;
+    IO_STATUS_BLOCK IoStatusBlock;
+    LARGE_INTEGER Offset;
+    ULONG Length;
+    BOOLEAN Busy;
+    BOOLEAN Pending;
+    PUCHAR Data;
+} COPY_BUFFER, *PCOPY_BUFFER;
+
+static NTSTATUS
+CopyWaitBuffer(
+    PCOPY_BUFFER Buffer
+)
+{
+    /* Requests that didn't pend already filled in the status block */
+    if (Buffer->Pending)
+    {
+        NtWaitForSingleObject(Buffer->Event, FALSE, NULL);
+        Buffer->Pending = FALSE;
+    }
+
+    return Buffer->IoStatusBlock.Status;
+}
+
+static VOID
+CopyStartIo(
+    HANDLE FileHandle,
+    PCOPY_BUFFER Buffer,
+    ULONG Length,
+    BOOL Write
+)
+{
+    NTSTATUS errCode;
+
+    Buffer->Busy = TRUE;
+    Buffer->IoStatusBlock.Status = STATUS_SUCCESS;
+    Buffer->IoStatusBlock.Information = 0;
+
+    if (Write)
+    {
+        errCode = NtWriteFile(FileHandle,
+                              Buffer->Event,
+                              NULL,
+                              NULL,
+                              &Buffer->IoStatusBlock,
+                              Buffer->Data,
+                              Length,
+                              &Buffer->Offset,
+                              NULL);
+    }
+    else
+    {
+        errCode = NtReadFile(FileHandle,
+                             Buffer->Event,
+                             NULL,
+                             NULL,
+                             &Buffer->IoStatusBlock,
+                             Buffer->Data,
+                             Length,
+                             &Buffer->Offset,
+                             NULL);
+    }
+
+    /* Requests failed right away touch neither the status block nor the event */
+    Buffer->Pending = (errCode == STATUS_PENDING);
+    if (!Buffer->Pending && NT_ERROR(errCode))
+    {
+        Buffer->IoStatusBlock.Status = errCode;
+    }
+}
+
+static NTSTATUS
+CopyOffload(
+    HANDLE FileHandleSource,
+    HANDLE FileHandleDest,
+    LARGE_INTEGER SourceFileSize,
+    ULONG ClusterSize,
+    HANDLE Event
+)
+{
+    NTSTATUS errCode;
+    IO_STATUS_BLOCK IoStatusBlock;
+    DUPLICATE_EXTENTS_DATA Extents;
+
+    /* Whole clusters only, the destination was already extended to cover them */
+    Extents.FileHandle = FileHandleSource;
+    Extents.SourceFileOffset.QuadPart = 0;
+    Extents.TargetFileOffset.QuadPart = 0;
+    Extents.ByteCount.QuadPart = (SourceFileSize.QuadPart + ClusterSize - 1) & ~((LONGLONG)ClusterSize - 1);
+
+    errCode = NtFsControlFile(FileHandleDest,
+                              Event,
+                              NULL,
+                              NULL,
+                              &IoStatusBlock,
+                              FSCTL_DUPLICATE_EXTENTS_TO_FILE,
+                              &Extents,
+                              sizeof(Extents),
+                              NULL,
+                              0);
+    if (errCode == STATUS_PENDING)
+    {
+        NtWaitForSingleObject(Event, FALSE, NULL);
+        errCode = IoStatusBlock.Status;
+    }
+
+    return errCode;
+}
+
 static NTSTATUS
 CopyLoop (
     HANDLE			FileHandleSource,
     HANDLE			FileHandleDest,
     LARGE_INTEGER		SourceFileSize,
+    BOOL                 NoBuffering,
     LPPROGRESS_ROUTINE	lpProgressRoutine,
     LPVOID			lpData,
     BOOL			*pbCancel,
     BOOL                 *KeepDest
 )
 {
-    NTSTATUS errCode;
+    NTSTATUS errCode, IoStatus;
     IO_STATUS_BLOCK IoStatusBlock;
+    FILE_FS_SIZE_INFORMATION FileFsSize;
+    FILE_END_OF_FILE_INFORMATION EndOfFile;
+    COPY_BUFFER Buffers[COPY_BUFFER_COUNT];
+    PCOPY_BUFFER Buffer;
     UCHAR *lpBuffer = NULL;
-    SIZE_T RegionSize = 0x10000;
-    LARGE_INTEGER BytesCopied;
+    SIZE_T RegionSize;
+    ULONG ChunkSize, SectorSize, ClusterSize, Length, i;
+    ULONG Head, Active, Writing;
+    LARGE_INTEGER BytesCopied, NextOffset;
     DWORD CallbackReason;
     DWORD ProgressResult;
-    BOOL EndOfFileFound;
+    BOOL EndOfFileFound, TryOffload;
 
     *KeepDest = FALSE;
+
+    /* Unbuffered writes must be whole sectors of the destination */
+    SectorSize = 512;
+    ClusterSize = 4096;
+    errCode = NtQueryVolumeInformationFile(FileHandleDest,
+                                           &IoStatusBlock,
+                                           &FileFsSize,
+                                           sizeof(FILE_FS_SIZE_INFORMATION),
+                                           FileFsSizeInformation);
+    if (NT_SUCCESS(errCode) && FileFsSize.BytesPerSector != 0)
+    {
+        SectorSize = FileFsSize.BytesPerSector;
+        ClusterSize = SectorSize * max(FileFsSize.SectorsPerAllocationUnit, 1);
+    }
+
+    /* Large files move in large chunks, a few of them keep both disks busy */
+    ChunkSize = (ULONG)min(SourceFileSize.QuadPart / (COPY_BUFFER_COUNT * 4), COPY_MAX_CHUNK);
+    ChunkSize = max(ChunkSize, COPY_MIN_CHUNK);
+    ChunkSize = ROUND_UP(ChunkSize, max(ClusterSize, COPY_MIN_CHUNK));
+
+    RegionSize = (SIZE_T)ChunkSize * COPY_BUFFER_COUNT;
     errCode = NtAllocateVirtualMemory(NtCurrentProcess(),
                                       (PVOID *)&lpBuffer,
                                       0,
                                       &RegionSize,
                                       MEM_RESERVE | MEM_COMMIT,
                                       PAGE_READWRITE);
+    if (!NT_SUCCESS(errCode))
+    {
+        TRACE("Error 0x%08x allocating buffer of %lu bytes\n", errCode, RegionSize);
+        return errCode;
+    }
 
-    if (NT_SUCCESS(errCode))
+    Head = 0;
+    Active = 0;
+    Writing = 0;
+    RtlZeroMemory(Buffers, sizeof(Buffers));
+    for (i = 0; i < COPY_BUFFER_COUNT; i++)
     {
-        BytesCopied.QuadPart = 0;
-        EndOfFileFound = FALSE;
-        CallbackReason = CALLBACK_STREAM_SWITCH;
-        while (! EndOfFileFound &&
-                NT_SUCCESS(errCode) &&
-                (NULL == pbCancel || ! *pbCancel))
+        Buffers[i].Data = lpBuffer + (SIZE_T)i * ChunkSize;
+        errCode = NtCreateEvent(&Buffers[i].Event,
+                                EVENT_ALL_ACCESS,
+                                NULL,
+                                NotificationEvent,
+                                FALSE);
+        if (!NT_SUCCESS(errCode))
         {
-            if (NULL != lpProgressRoutine)
+            TRACE("Error 0x%08x creating copy event\n", errCode);
+            goto Cleanup;
+        }
+    }
+
+    /* Allocate the whole destination at once, but it's only a hint */
+    EndOfFile.EndOfFile = SourceFileSize;
+    errCode = NtSetInformationFile(FileHandleDest,
+                                   &IoStatusBlock,
+                                   &EndOfFile,
+                                   sizeof(FILE_END_OF_FILE_INFORMATION),
+                                   FileEndOfFileInformation);
+    if (!NT_SUCCESS(errCode))
+    {
+        TRACE("Error 0x%08x extending dest\n", errCode);
+    }
+
+    BytesCopied.QuadPart = 0;
+    NextOffset.QuadPart = 0;
+    EndOfFileFound = FALSE;
+    TryOffload = (SourceFileSize.QuadPart != 0);
+    CallbackReason = CALLBACK_STREAM_SWITCH;
+    errCode = STATUS_SUCCESS;
+
+    while (TRUE)
+    {
+        if (NULL != lpProgressRoutine && CallbackReason != 0)
+        {
+            ProgressResult = (*lpProgressRoutine)(SourceFileSize,
+                                                  BytesCopied,
+                                                  SourceFileSize,
+                                                  BytesCopied,
+                                                  0,
+                                                  CallbackReason,
+                                                  FileHandleSource,
+                                                  FileHandleDest,
+                                                  lpData);
+            switch (ProgressResult)
             {
-                ProgressResult = (*lpProgressRoutine)(SourceFileSize,
-                                                      BytesCopied,
-                                                      SourceFileSize,
-                                                      BytesCopied,
-                                                      0,
-                                                      CallbackReason,
-                                                      FileHandleSource,
-                                                      FileHandleDest,
-                                                      lpData);
-                switch (ProgressResult)
-                {
-                case PROGRESS_CANCEL:
-                    TRACE("Progress callback requested cancel\n");
-                    errCode = STATUS_REQUEST_ABORTED;
-                    break;
-                case PROGRESS_STOP:
-                    TRACE("Progress callback requested stop\n");
-                    errCode = STATUS_REQUEST_ABORTED;
-                    *KeepDest = TRUE;
-                    break;
-                case PROGRESS_QUIET:
-                    lpProgressRoutine = NULL;
-                    break;
-                case PROGRESS_CONTINUE:
-                default:
-                    break;
-                }
+            case PROGRESS_CANCEL:
+                TRACE("Progress callback requested cancel\n");
+                errCode = STATUS_REQUEST_ABORTED;
+                break;
+            case PROGRESS_STOP:
+                TRACE("Progress callback requested stop\n");
+                errCode = STATUS_REQUEST_ABORTED;
+                *KeepDest = TRUE;
+                break;
+            case PROGRESS_QUIET:
+                lpProgressRoutine = NULL;
+                break;
+            case PROGRESS_CONTINUE:
+            default:
+                break;
+            }
+        }
+        CallbackReason = 0;
+
+        if (NULL != pbCancel && *pbCancel)
+        {
+            TRACE("User requested cancel\n");
+            errCode = STATUS_REQUEST_ABORTED;
+        }
+        if (!NT_SUCCESS(errCode))
+        {
+            break;
+        }
+
+        /* Let the file system copy the data itself when it can */
+        if (TryOffload)
+        {
+            TryOffload = FALSE;
+            if (NT_SUCCESS(CopyOffload(FileHandleSource,
+                                       FileHandleDest,
+                                       SourceFileSize,
+                                       ClusterSize,
+                                       Buffers[0].Event)))
+            {
+                TRACE("Copy offloaded to the file system\n");
+                BytesCopied = SourceFileSize;
+                EndOfFileFound = TRUE;
                 CallbackReason = CALLBACK_CHUNK_FINISHED;
+                continue;
             }
-            if (NT_SUCCESS(errCode))
+        }
+
+        /* Keep the free buffers reading ahead. Past the expected size, read
+         * one at a time until the end of file shows up, the file may grow */
+        while (!EndOfFileFound && Active < COPY_BUFFER_COUNT &&
+               (NextOffset.QuadPart < SourceFileSize.QuadPart || Active == 0))
+        {
+            Buffer = &Buffers[(Head + Active) % COPY_BUFFER_COUNT];
+            Buffer->Offset = NextOffset;
+            CopyStartIo(FileHandleSource, Buffer, ChunkSize, FALSE);
+            NextOffset.QuadPart += ChunkSize;
+            Active++;
+        }
+
+        if (Active == 0)
+        {
+            break;
+        }
+
+        /* Turn the oldest finished read into a write, until only writes are left */
+        if (Writing < Active)
+        {
+            Buffer = &Buffers[(Head + Writing) % COPY_BUFFER_COUNT];
+            IoStatus = CopyWaitBuffer(Buffer);
+            Writing++;
+
+            /* With async read, 0 length or STATUS_END_OF_FILE mean EOF. Reads
+             * issued past a short one have nothing to write either */
+            if (EndOfFileFound || IoStatus == STATUS_END_OF_FILE ||
+                (NT_SUCCESS(IoStatus) && Buffer->IoStatusBlock.Information == 0))
             {
-                errCode = NtReadFile(FileHandleSource,
-                                     NULL,
-                                     NULL,
-                                     NULL,
-                                     (PIO_STATUS_BLOCK)&IoStatusBlock,
-                                     lpBuffer,
-                                     RegionSize,
-                                     NULL,
-                                     NULL);
-                /* With sync read, 0 length + status success mean EOF:
-                 * https://msdn.microsoft.com/en-us/library/windows/desktop/aa365467(v=vs.85).aspx
-                 */
-                if (NT_SUCCESS(errCode) && IoStatusBlock.Information == 0)
-                {
-                    errCode = STATUS_END_OF_FILE;
-                }
-                if (NT_SUCCESS(errCode) && (NULL == pbCancel || ! *pbCancel))
-                {
-                    errCode = NtWriteFile(FileHandleDest,
-                                          NULL,
-                                          NULL,
-                                          NULL,
-                                          (PIO_STATUS_BLOCK)&IoStatusBlock,
-                                          lpBuffer,
-                                          IoStatusBlock.Information,
-                                          NULL,
-                                          NULL);
-                    if (NT_SUCCESS(errCode))
-                    {
-                        BytesCopied.QuadPart += IoStatusBlock.Information;
-                    }
-                    else
-                    {
-                        WARN("Error 0x%08x reading writing to dest\n", errCode);
-                    }
-                }
-                else if (!NT_SUCCESS(errCode))
-                {
-                    if (STATUS_END_OF_FILE == errCode)
-                    {
-                        EndOfFileFound = TRUE;
-                        errCode = STATUS_SUCCESS;
-                    }
-                    else
-                    {
-                        WARN("Error 0x%08x reading from source\n", errCode);
-                    }
-                }
+                EndOfFileFound = TRUE;
+                Buffer->IoStatusBlock.Status = STATUS_SUCCESS;
+                Buffer->Length = 0;
+                continue;
+            }
+            if (!NT_SUCCESS(IoStatus))
+            {
+                WARN("Error 0x%08x reading from source\n", IoStatus);
+                errCode = IoStatus;
+                break;
+            }
+
+            Buffer->Length = (ULONG)Buffer->IoStatusBlock.Information;
+            if (Buffer->Length < ChunkSize)
+            {
+                EndOfFileFound = TRUE;
+            }
+
+            /* The sector padding is cut off again once we are done */
+            Length = Buffer->Length;
+            if (NoBuffering)
+            {
+                Length = ROUND_UP(Length, SectorSize);
+                RtlZeroMemory(Buffer->Data + Buffer->Length, Length - Buffer->Length);
             }
+
+            CopyStartIo(FileHandleDest, Buffer, Length, TRUE);
+            continue;
         }
 
-        if (! EndOfFileFound && (NULL != pbCancel && *pbCancel))
+        /* Everything is being written, retire the writes in file order */
+        Buffer = &Buffers[Head];
+        IoStatus = CopyWaitBuffer(Buffer);
+        if (!NT_SUCCESS(IoStatus))
         {
-            TRACE("User requested cancel\n");
-            errCode = STATUS_REQUEST_ABORTED;
+            WARN("Error 0x%08x reading writing to dest\n", IoStatus);
+            errCode = IoStatus;
+            break;
         }
 
-        NtFreeVirtualMemory(NtCurrentProcess(),
-                            (PVOID *)&lpBuffer,
-                            &RegionSize,
-                            MEM_RELEASE);
+        Buffer->Busy = FALSE;
+        Head = (Head + 1) % COPY_BUFFER_COUNT;
+        Active--;
+        Writing--;
+
+        if (Buffer->Length != 0)
+        {
+            BytesCopied.QuadPart += Buffer->Length;
+            CallbackReason = CALLBACK_CHUNK_FINISHED;
+        }
     }
-    else
+
+Cleanup:
+    /* Nothing may still be using the buffers once they are freed */
+    if (Active != 0)
     {
-        TRACE("Error 0x%08x allocating buffer of %lu bytes\n", errCode, RegionSize);
+        NtCancelIoFile(FileHandleSource, &IoStatusBlock);
+        NtCancelIoFile(FileHandleDest, &IoStatusBlock);
+    }
+    for (i = 0; i < COPY_BUFFER_COUNT; i++)
+    {
+        if (Buffers[i].Busy)
+        {
+            CopyWaitBuffer(&Buffers[i]);
+        }
+        if (Buffers[i].Event != NULL)
+        {
+            NtClose(Buffers[i].Event);
+        }
     }
 
+    /* Trim what the pre-allocation and the sector padding added */
+    if (NT_SUCCESS(errCode) &&
+        (NoBuffering || BytesCopied.QuadPart != SourceFileSize.QuadPart))
+    {
+        EndOfFile.EndOfFile = BytesCopied;
+        errCode = NtSetInformationFile(FileHandleDest,
+                                       &IoStatusBlock,
+                                       &EndOfFile,
+                                       sizeof(FILE_END_OF_FILE_INFORMATION),
+                                       FileEndOfFileInformation);
+        if (!NT_SUCCESS(errCode))
+        {
+            WARN("Error 0x%08x setting the size of dest\n", errCode);
+        }
+    }
+
+    RegionSize = 0;
+    NtFreeVirtualMemory(NtCurrentProcess(),
+                        (PVOID *)&lpBuffer,
+                        &RegionSize,
+                        MEM_RELEASE);
+
     return errCode;
 }
 
@@ -216,14 +495,14 @@ BasepCopyFileExW(IN LPCWSTR lpExistingFileName,
     FILE_BASIC_INFORMATION FileBasic;
     BOOL RC = FALSE;
     BOOL KeepDestOnError = FALSE;
-    DWORD SystemError;
+    DWORD SystemError, DestFlags;
 
     FileHandleSource = CreateFileW(lpExistingFileName,
                                    GENERIC_READ,
                                    FILE_SHARE_READ | FILE_SHARE_WRITE,
                                    NULL,
                                    OPEN_EXISTING,
-                                   FILE_ATTRIBUTE_NORMAL|FILE_FLAG_NO_BUFFERING,
+                                   FILE_ATTRIBUTE_NORMAL|FILE_FLAG_NO_BUFFERING|FILE_FLAG_OVERLAPPED,
                                    NULL);
     if (INVALID_HANDLE_VALUE != FileHandleSource)
     {
@@ -250,18 +529,25 @@ BasepCopyFileExW(IN LPCWSTR lpExistingFileName,
             }
             else
             {
+                DestFlags = FileBasic.FileAttributes | FILE_FLAG_OVERLAPPED;
+                if (dwCopyFlags & COPY_FILE_NO_BUFFERING)
+                {
+                    DestFlags |= FILE_FLAG_NO_BUFFERING;
+                }
+
                 FileHandleDest = CreateFileW(lpNewFileName,
                                              GENERIC_WRITE,
                                              FILE_SHARE_WRITE,
                                              NULL,
-                                             dwCopyFlags ? CREATE_NEW : CREATE_ALWAYS,
-                                             FileBasic.FileAttributes,
+                                             (dwCopyFlags & COPY_FILE_FAIL_IF_EXISTS) ? CREATE_NEW : CREATE_ALWAYS,
+                                             DestFlags,
                                              NULL);
                 if (INVALID_HANDLE_VALUE != FileHandleDest)
                 {
                     errCode = CopyLoop(FileHandleSource,
                                        FileHandleDest,
                                        FileStandard.EndOfFile,
+                                       (dwCopyFlags & COPY_FILE_NO_BUFFERING) != 0,
                                        lpProgressRoutine,
                                        lpData,
                                        pbCancel,
@@ -5,6 +5,7 @@
 @ stdcall InitOnceInitialize(ptr) NTDLL.RtlRunOnceInitialize
 
 @ stdcall GetFileInformationByHandleEx(long long ptr long)
+@ stdcall GetQueuedCompletionStatusEx(ptr ptr long ptr long long)
 @ stdcall -ret64 GetTickCount64()
 
 @ stdcall InitializeSRWLock(ptr)
@@ -21,6 +22,40 @@
 
 @ stdcall InitializeCriticalSectionEx(ptr long long)
 
+@ stdcall CallbackMayRunLong(ptr)
+@ stdcall CancelThreadpoolIo(ptr)
+@ stdcall CloseThreadpool(ptr)
+@ stdcall CloseThreadpoolCleanupGroup(ptr)
+@ stdcall CloseThreadpoolCleanupGroupMembers(ptr long ptr)
+@ stdcall CloseThreadpoolIo(ptr)
+@ stdcall CloseThreadpoolTimer(ptr)
+@ stdcall CloseThreadpoolWait(ptr)
+@ stdcall CloseThreadpoolWork(ptr)
+@ stdcall CreateThreadpool(ptr)
+@ stdcall CreateThreadpoolCleanupGroup()
+@ stdcall CreateThreadpoolIo(ptr ptr ptr ptr)
+@ stdcall CreateThreadpoolTimer(ptr ptr ptr)
+@ stdcall CreateThreadpoolWait(ptr ptr ptr)
+@ stdcall CreateThreadpoolWork(ptr ptr ptr)
+@ stdcall DisassociateCurrentThreadFromCallback(ptr)
+@ stdcall FreeLibraryWhenCallbackReturns(ptr ptr)
+@ stdcall IsThreadpoolTimerSet(ptr)
+@ stdcall LeaveCriticalSectionWhenCallbackReturns(ptr ptr)
+@ stdcall ReleaseMutexWhenCallbackReturns(ptr ptr)
+@ stdcall ReleaseSemaphoreWhenCallbackReturns(ptr ptr long)
+@ stdcall SetEventWhenCallbackReturns(ptr ptr)
+@ stdcall SetThreadpoolThreadMaximum(ptr long)
+@ stdcall SetThreadpoolThreadMinimum(ptr long)
+@ stdcall SetThreadpoolTimer(ptr ptr long long)
+@ stdcall SetThreadpoolWait(ptr ptr ptr)
+@ stdcall StartThreadpoolIo(ptr)
+@ stdcall SubmitThreadpoolWork(ptr)
+@ stdcall TrySubmitThreadpoolCallback(ptr ptr ptr)
+@ stdcall WaitForThreadpoolIoCallbacks(ptr long)
+@ stdcall WaitForThreadpoolTimerCallbacks(ptr long)
+@ stdcall WaitForThreadpoolWaitCallbacks(ptr long)
+@ stdcall WaitForThreadpoolWorkCallbacks(ptr long)
+
 @ stdcall GetFirmwareEnvironmentVariableExA(str str ptr long long)
 @ stdcall GetFirmwareEnvironmentVariableExW(wstr wstr ptr long long)
 @ stdcall GetFirmwareType(ptr)
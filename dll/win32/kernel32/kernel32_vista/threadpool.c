@@ -0,0 +1,452 @@
+/*
+ * PROJECT:     ReactOS Win32 Base API
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Thread pool API, on top of the ntdll Tp* routines
+ */
+
+#include "k32_vista.h"
+
+#define NDEBUG
+#include <debug.h>
+
+/* Pools and cleanup groups **************************************************/
+
+PTP_POOL
+WINAPI
+CreateThreadpool(
+    _Reserved_ PVOID reserved)
+{
+    PTP_POOL Pool;
+    NTSTATUS Status;
+
+    Status = TpAllocPool(&Pool, reserved);
+    if (!NT_SUCCESS(Status))
+    {
+        BaseSetLastNTError(Status);
+        return NULL;
+    }
+
+    return Pool;
+}
+
+VOID
+WINAPI
+CloseThreadpool(
+    _Inout_ PTP_POOL ptpp)
+{
+    TpReleasePool(ptpp);
+}
+
+VOID
+WINAPI
+SetThreadpoolThreadMaximum(
+    _Inout_ PTP_POOL ptpp,
+    _In_ DWORD cthrdMost)
+{
+    TpSetPoolMaxThreads(ptpp, (LONG)cthrdMost);
+}
+
+BOOL
+WINAPI
+SetThreadpoolThreadMinimum(
+    _Inout_ PTP_POOL ptpp,
+    _In_ DWORD cthrdMic)
+{
+    NTSTATUS Status;
+
+    Status = TpSetPoolMinThreads(ptpp, (LONG)cthrdMic);
+    if (!NT_SUCCESS(Status))
+    {
+        BaseSetLastNTError(Status);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+PTP_CLEANUP_GROUP
+WINAPI
+CreateThreadpoolCleanupGroup(VOID)
+{
+    PTP_CLEANUP_GROUP Group;
+    NTSTATUS Status;
+
+    Status = TpAllocCleanupGroup(&Group);
+    if (!NT_SUCCESS(Status))
+    {
+        BaseSetLastNTError(Status);
+        return NULL;
+    }
+
+    return Group;
+}
+
+VOID
+WINAPI
+CloseThreadpoolCleanupGroup(
+    _Inout_ PTP_CLEANUP_GROUP ptpcg)
+{
+    TpReleaseCleanupGroup(ptpcg);
+}
+
+VOID
+WINAPI
+CloseThreadpoolCleanupGroupMembers(
+    _Inout_ PTP_CLEANUP_GROUP ptpcg,
+    _In_ BOOL fCancelPendingCallbacks,
+    _Inout_opt_ PVOID pvCleanupContext)
+{
+    TpReleaseCleanupGroupMembers(ptpcg, fCancelPendingCallbacks != FALSE, pvCleanupContext);
+}
+
+/* Work **********************************************************************/
+
+BOOL
+WINAPI
+TrySubmitThreadpoolCallback(
+    _In_ PTP_SIMPLE_CALLBACK pfns,
+    _Inout_opt_ PVOID pv,
+    _In_opt_ PTP_CALLBACK_ENVIRON pcbe)
+{
+    NTSTATUS Status;
+
+    Status = TpSimpleTryPost(pfns, pv, pcbe);
+    if (!NT_SUCCESS(Status))
+    {
+        BaseSetLastNTError(Status);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+PTP_WORK
+WINAPI
+CreateThreadpoolWork(
+    _In_ PTP_WORK_CALLBACK pfnwk,
+    _Inout_opt_ PVOID pv,
+    _In_opt_ PTP_CALLBACK_ENVIRON pcbe)
+{
+    PTP_WORK Work;
+    NTSTATUS Status;
+
+    Status = TpAllocWork(&Work, pfnwk, pv, pcbe);
+    if (!NT_SUCCESS(Status))
+    {
+        BaseSetLastNTError(Status);
+        return NULL;
+    }
+
+    return Work;
+}
+
+VOID
+WINAPI
+SubmitThreadpoolWork(
+    _Inout_ PTP_WORK pwk)
+{
+    TpPostWork(pwk);
+}
+
+VOID
+WINAPI
+WaitForThreadpoolWorkCallbacks(
+    _Inout_ PTP_WORK pwk,
+    _In_ BOOL fCancelPendingCallbacks)
+{
+    TpWaitForWork(pwk, fCancelPendingCallbacks != FALSE);
+}
+
+VOID
+WINAPI
+CloseThreadpoolWork(
+    _Inout_ PTP_WORK pwk)
+{
+    TpReleaseWork(pwk);
+}
+
+/* Timers ********************************************************************/
+
+PTP_TIMER
+WINAPI
+CreateThreadpoolTimer(
+    _In_ PTP_TIMER_CALLBACK pfnti,
+    _Inout_opt_ PVOID pv,
+    _In_opt_ PTP_CALLBACK_ENVIRON pcbe)
+{
+    PTP_TIMER Timer;
+    NTSTATUS Status;
+
+    Status = TpAllocTimer(&Timer, pfnti, pv, pcbe);
+    if (!NT_SUCCESS(Status))
+    {
+        BaseSetLastNTError(Status);
+        return NULL;
+    }
+
+    return Timer;
+}
+
+VOID
+WINAPI
+SetThreadpoolTimer(
+    _Inout_ PTP_TIMER pti,
+    _In_opt_ PFILETIME pftDueTime,
+    _In_ DWORD msPeriod,
+    _In_opt_ DWORD msWindowLength)
+{
+    LARGE_INTEGER DueTime;
+
+    /* Same encoding as the native one: negative is relative, zero is now */
+    if (pftDueTime)
+    {
+        DueTime.LowPart = pftDueTime->dwLowDateTime;
+        DueTime.HighPart = pftDueTime->dwHighDateTime;
+    }
+
+    TpSetTimer(pti, pftDueTime ? &DueTime : NULL, msPeriod, msWindowLength);
+}
+
+BOOL
+WINAPI
+IsThreadpoolTimerSet(
+    _Inout_ PTP_TIMER pti)
+{
+    return TpIsTimerSet(pti);
+}
+
+VOID
+WINAPI
+WaitForThreadpoolTimerCallbacks(
+    _Inout_ PTP_TIMER pti,
+    _In_ BOOL fCancelPendingCallbacks)
+{
+    TpWaitForTimer(pti, fCancelPendingCallbacks != FALSE);
+}
+
+VOID
+WINAPI
+CloseThreadpoolTimer(
+    _Inout_ PTP_TIMER pti)
+{
+    TpReleaseTimer(pti);
+}
+
+/* Waits *********************************************************************/
+
+PTP_WAIT
+WINAPI
+CreateThreadpoolWait(
+    _In_ PTP_WAIT_CALLBACK pfnwa,
+    _Inout_opt_ PVOID pv,
+    _In_opt_ PTP_CALLBACK_ENVIRON pcbe)
+{
+    PTP_WAIT Wait;
+    NTSTATUS Status;
+
+    Status = TpAllocWait(&Wait, pfnwa, pv, pcbe);
+    if (!NT_SUCCESS(Status))
+    {
+        BaseSetLastNTError(Status);
+        return NULL;
+    }
+
+    return Wait;
+}
+
+VOID
+WINAPI
+SetThreadpoolWait(
+    _Inout_ PTP_WAIT pwa,
+    _In_opt_ HANDLE h,
+    _In_opt_ PFILETIME pftTimeout)
+{
+    LARGE_INTEGER Timeout;
+
+    /* No timeout means waiting forever */
+    if (pftTimeout)
+    {
+        Timeout.LowPart = pftTimeout->dwLowDateTime;
+        Timeout.HighPart = pftTimeout->dwHighDateTime;
+    }
+
+    TpSetWait(pwa, h, pftTimeout ? &Timeout : NULL);
+}
+
+VOID
+WINAPI
+WaitForThreadpoolWaitCallbacks(
+    _Inout_ PTP_WAIT pwa,
+    _In_ BOOL fCancelPendingCallbacks)
+{
+    TpWaitForWait(pwa, fCancelPendingCallbacks != FALSE);
+}
+
+VOID
+WINAPI
+CloseThreadpoolWait(
+    _Inout_ PTP_WAIT pwa)
+{
+    TpReleaseWait(pwa);
+}
+
+/* I/O ***********************************************************************/
+
+static
+VOID
+NTAPI
+BasepTpIoCallback(
+    _Inout_ PTP_CALLBACK_INSTANCE Instance,
+    _Inout_opt_ PVOID Context,
+    _In_ PVOID ApcContext,
+    _In_ PIO_STATUS_BLOCK IoStatusBlock,
+    _In_ PTP_IO Io)
+{
+    /* ntdll leaves the first field of the object to us */
+    PTP_WIN32_IO_CALLBACK Callback = *(PTP_WIN32_IO_CALLBACK *)Io;
+
+    Callback(Instance,
+             Context,
+             ApcContext,
+             RtlNtStatusToDosError(IoStatusBlock->Status),
+             IoStatusBlock->Information,
+             Io);
+}
+
+PTP_IO
+WINAPI
+CreateThreadpoolIo(
+    _In_ HANDLE fl,
+    _In_ PTP_WIN32_IO_CALLBACK pfnio,
+    _Inout_opt_ PVOID pv,
+    _In_opt_ PTP_CALLBACK_ENVIRON pcbe)
+{
+    PTP_IO Io;
+    NTSTATUS Status;
+
+    if (!pfnio)
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return NULL;
+    }
+
+    Status = TpAllocIoCompletion(&Io, fl, BasepTpIoCallback, pv, pcbe);
+    if (!NT_SUCCESS(Status))
+    {
+        BaseSetLastNTError(Status);
+        return NULL;
+    }
+
+    /* No completion can arrive before StartThreadpoolIo */
+    *(PTP_WIN32_IO_CALLBACK *)Io = pfnio;
+
+    return Io;
+}
+
+VOID
+WINAPI
+StartThreadpoolIo(
+    _Inout_ PTP_IO pio)
+{
+    TpStartAsyncIoOperation(pio);
+}
+
+VOID
+WINAPI
+CancelThreadpoolIo(
+    _Inout_ PTP_IO pio)
+{
+    TpCancelAsyncIoOperation(pio);
+}
+
+VOID
+WINAPI
+WaitForThreadpoolIoCallbacks(
+    _Inout_ PTP_IO pio,
+    _In_ BOOL fCancelPendingCallbacks)
+{
+    TpWaitForIoCompletion(pio, fCancelPendingCallbacks != FALSE);
+}
+
+VOID
+WINAPI
+CloseThreadpoolIo(
+    _Inout_ PTP_IO pio)
+{
+    TpReleaseIoCompletion(pio);
+}
+
+/* Callback instances ********************************************************/
+
+BOOL
+WINAPI
+CallbackMayRunLong(
+    _Inout_ PTP_CALLBACK_INSTANCE pci)
+{
+    NTSTATUS Status;
+
+    Status = TpCallbackMayRunLong(pci);
+    if (!NT_SUCCESS(Status))
+    {
+        BaseSetLastNTError(Status);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+VOID
+WINAPI
+DisassociateCurrentThreadFromCallback(
+    _Inout_ PTP_CALLBACK_INSTANCE pci)
+{
+    TpDisassociateCallback(pci);
+}
+
+VOID
+WINAPI
+SetEventWhenCallbackReturns(
+    _Inout_ PTP_CALLBACK_INSTANCE pci,
+    _In_ HANDLE evt)
+{
+    TpCallbackSetEventOnCompletion(pci, evt);
+}
+
+VOID
+WINAPI
+ReleaseSemaphoreWhenCallbackReturns(
+    _Inout_ PTP_CALLBACK_INSTANCE pci,
+    _In_ HANDLE sem,
+    _In_ DWORD crel)
+{
+    TpCallbackReleaseSemaphoreOnCompletion(pci, sem, (LONG)crel);
+}
+
+VOID
+WINAPI
+ReleaseMutexWhenCallbackReturns(
+    _Inout_ PTP_CALLBACK_INSTANCE pci,
+    _In_ HANDLE mut)
+{
+    TpCallbackReleaseMutexOnCompletion(pci, mut);
+}
+
+VOID
+WINAPI
+LeaveCriticalSectionWhenCallbackReturns(
+    _Inout_ PTP_CALLBACK_INSTANCE pci,
+    _Inout_ PCRITICAL_SECTION pcs)
+{
+    TpCallbackLeaveCriticalSectionOnCompletion(pci, (PRTL_CRITICAL_SECTION)pcs);
+}
+
+VOID
+WINAPI
+FreeLibraryWhenCallbackReturns(
+    _Inout_ PTP_CALLBACK_INSTANCE pci,
+    _In_ HMODULE mod)
+{
+    TpCallbackUnloadDllOnCompletion(pci, mod);
+}
+
+/* EOF */
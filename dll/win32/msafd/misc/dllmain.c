@@ -815,6 +815,11 @@ ok:
     NtClose((HANDLE)Handle);
     NtClose(SockEvent);
 
+    /* Poll sets may still have the handle, and it may come back for another
+     * socket. A select that starts before the handle is gone would cache the
+     * new generation with the old handle, so only bump it now. */
+    SockPollSetSocketClosed();
+
     if( Socket->SharedDataHandle != INVALID_HANDLE_VALUE )
     {
         /* It is a duplicated socket, so unmap the memory */
@@ -1071,44 +1076,23 @@ WSPSelect(IN int nfds,
 {
     IO_STATUS_BLOCK     IOSB;
     PAFD_POLL_INFO      PollInfo;
+    PSOCK_POLL_SET      PollSet;
+    PSOCK_SELECT_HANDLE SelectHandles, Entry;
     NTSTATUS            Status;
     ULONG               HandleCount;
     ULONG               PollBufferSize;
-    PVOID               PollBuffer;
-    ULONG               i, j = 0, x;
-    HANDLE              SockEvent;
+    ULONG               i, x;
     LARGE_INTEGER       Timeout;
     PSOCKET_INFORMATION Socket;
     SOCKET              Handle;
-    ULONG               Events;
-    fd_set              selectfds;
-
-    /* Find out how many sockets we have, and how large the buffer needs
-     * to be */
-    FD_ZERO(&selectfds);
-    if (readfds != NULL)
-    {
-        for (i = 0; i < readfds->fd_count; i++)
-        {
-            FD_SET(readfds->fd_array[i], &selectfds);
-        }
-    }
-    if (writefds != NULL)
-    {
-        for (i = 0; i < writefds->fd_count; i++)
-        {
-            FD_SET(writefds->fd_array[i], &selectfds);
-        }
-    }
-    if (exceptfds != NULL)
-    {
-        for (i = 0; i < exceptfds->fd_count; i++)
-        {
-            FD_SET(exceptfds->fd_array[i], &selectfds);
-        }
-    }
+    ULONG               Events, Sets;
+    fd_set              *fds[3] = { readfds, writefds, exceptfds };
+    ULONG               Set;
 
-    HandleCount = selectfds.fd_count;
+    /* Find out how many sockets we have */
+    HandleCount = (readfds ? readfds->fd_count : 0) +
+                  (writefds ? writefds->fd_count : 0) +
+                  (exceptfds ? exceptfds->fd_count : 0);
 
     if ( HandleCount == 0 )
     {
@@ -1117,10 +1101,6 @@ WSPSelect(IN int nfds,
         return SOCKET_ERROR;
     }
 
-    PollBufferSize = sizeof(*PollInfo) + ((HandleCount - 1) * sizeof(AFD_HANDLE));
-
-    TRACE("HandleCount: %u BufferSize: %u\n", HandleCount, PollBufferSize);
-
     /* Convert Timeout to NT Format */
     if (timeout == NULL)
     {
@@ -1146,154 +1126,105 @@ WSPSelect(IN int nfds,
                      Timeout.u.LowPart);
     }
 
-    Status = NtCreateEvent(&SockEvent,
-                           EVENT_ALL_ACCESS,
-                           NULL,
-                           SynchronizationEvent,
-                           FALSE);
-
-    if(!NT_SUCCESS(Status))
+    SelectHandles = HeapAlloc(GlobalHeap, 0, HandleCount * sizeof(*SelectHandles));
+    if (!SelectHandles)
     {
-        if (lpErrno)
-            *lpErrno = WSAEFAULT;
-
-        ERR("NtCreateEvent failed, 0x%08x\n", Status);
+        if (lpErrno) *lpErrno = WSAENOBUFS;
         return SOCKET_ERROR;
     }
 
-    /* Allocate */
-    PollBuffer = HeapAlloc(GlobalHeap, 0, PollBufferSize);
-
-    if (!PollBuffer)
+    /* Gather the sets, a socket in more than one of them is waited on once */
+    HandleCount = 0;
+    for (Set = 0; Set < 3; Set++)
     {
-        if (lpErrno)
-            *lpErrno = WSAEFAULT;
-        NtClose(SockEvent);
-        return SOCKET_ERROR;
-    }
+        if (!fds[Set])
+            continue;
 
-    PollInfo = (PAFD_POLL_INFO)PollBuffer;
-
-    RtlZeroMemory( PollInfo, PollBufferSize );
+        for (i = 0; i < fds[Set]->fd_count; i++)
+        {
+            SelectHandles[HandleCount].Handle = fds[Set]->fd_array[i];
+            SelectHandles[HandleCount].Events = 0;
+            SelectHandles[HandleCount].Sets = 1 << Set;
+            HandleCount++;
+        }
+    }
+    HandleCount = SockSortSelectHandles(SelectHandles, HandleCount);
 
-    /* Number of handles for AFD to Check */
-    PollInfo->Exclusive = FALSE;
-    PollInfo->Timeout = Timeout;
+    TRACE("HandleCount: %u\n", HandleCount);
 
-    for (i = 0; i < selectfds.fd_count; i++)
+    for (i = 0; i < HandleCount; i++)
     {
-        PollInfo->Handles[i].Handle = selectfds.fd_array[i];
-    }
-    if (readfds != NULL) {
-        for (i = 0; i < readfds->fd_count; i++)
+        Entry = &SelectHandles[i];
+        Socket = GetSocketStructure(Entry->Handle);
+        if (!Socket)
         {
-            for (j = 0; j < HandleCount; j++)
-            {
-                if (PollInfo->Handles[j].Handle == readfds->fd_array[i])
-                    break;
-            }
-            if (j >= HandleCount)
-            {
-                ERR("Error while counting readfds %ld > %ld\n", j, HandleCount);
-                if (lpErrno) *lpErrno = WSAEFAULT;
-                HeapFree(GlobalHeap, 0, PollBuffer);
-                NtClose(SockEvent);
-                return SOCKET_ERROR;
-            }
-            Socket = GetSocketStructure(readfds->fd_array[i]);
-            if (!Socket)
-            {
-                ERR("Invalid socket handle provided in readfds %d\n", readfds->fd_array[i]);
-                if (lpErrno) *lpErrno = WSAENOTSOCK;
-                HeapFree(GlobalHeap, 0, PollBuffer);
-                NtClose(SockEvent);
-                return SOCKET_ERROR;
-            }
-            PollInfo->Handles[j].Events |= AFD_EVENT_RECEIVE |
-                                           AFD_EVENT_DISCONNECT |
-                                           AFD_EVENT_ABORT |
-                                           AFD_EVENT_CLOSE |
-                                           AFD_EVENT_ACCEPT;
+            ERR("Invalid socket handle provided %d\n", Entry->Handle);
+            if (lpErrno) *lpErrno = WSAENOTSOCK;
+            HeapFree(GlobalHeap, 0, SelectHandles);
+            return SOCKET_ERROR;
+        }
+        Entry->Socket = Socket;
+
+        if (Entry->Sets & SOCK_SELECT_READ)
+        {
+            Entry->Events |= AFD_EVENT_RECEIVE |
+                             AFD_EVENT_DISCONNECT |
+                             AFD_EVENT_ABORT |
+                             AFD_EVENT_CLOSE |
+                             AFD_EVENT_ACCEPT;
             //if (Socket->SharedData->OobInline != 0)
-            //    PollInfo->Handles[j].Events |= AFD_EVENT_OOB_RECEIVE;
+            //    Entry->Events |= AFD_EVENT_OOB_RECEIVE;
         }
-    }
-    if (writefds != NULL)
-    {
-        for (i = 0; i < writefds->fd_count; i++)
+        if (Entry->Sets & SOCK_SELECT_WRITE)
         {
-            for (j = 0; j < HandleCount; j++)
-            {
-                if (PollInfo->Handles[j].Handle == writefds->fd_array[i])
-                    break;
-            }
-            if (j >= HandleCount)
-            {
-                ERR("Error while counting writefds %ld > %ld\n", j, HandleCount);
-                if (lpErrno) *lpErrno = WSAEFAULT;
-                HeapFree(GlobalHeap, 0, PollBuffer);
-                NtClose(SockEvent);
-                return SOCKET_ERROR;
-            }
-            Socket = GetSocketStructure(writefds->fd_array[i]);
-            if (!Socket)
-            {
-                ERR("Invalid socket handle provided in writefds %d\n", writefds->fd_array[i]);
-                if (lpErrno) *lpErrno = WSAENOTSOCK;
-                HeapFree(GlobalHeap, 0, PollBuffer);
-                NtClose(SockEvent);
-                return SOCKET_ERROR;
-            }
-            PollInfo->Handles[j].Handle = writefds->fd_array[i];
-            PollInfo->Handles[j].Events |= AFD_EVENT_SEND;
+            Entry->Events |= AFD_EVENT_SEND;
             if (Socket->SharedData->NonBlocking != 0)
-                PollInfo->Handles[j].Events |= AFD_EVENT_CONNECT;
+                Entry->Events |= AFD_EVENT_CONNECT;
         }
-    }
-    if (exceptfds != NULL)
-    {
-        for (i = 0; i < exceptfds->fd_count; i++)
+        if (Entry->Sets & SOCK_SELECT_EXCEPT)
         {
-            for (j = 0; j < HandleCount; j++)
-            {
-                if (PollInfo->Handles[j].Handle == exceptfds->fd_array[i])
-                    break;
-            }
-            if (j > HandleCount)
-            {
-                ERR("Error while counting exceptfds %ld > %ld\n", j, HandleCount);
-                if (lpErrno) *lpErrno = WSAEFAULT;
-                HeapFree(GlobalHeap, 0, PollBuffer);
-                NtClose(SockEvent);
-                return SOCKET_ERROR;
-            }
-            Socket = GetSocketStructure(exceptfds->fd_array[i]);
-            if (!Socket)
-            {
-                TRACE("Invalid socket handle provided in exceptfds %d\n", exceptfds->fd_array[i]);
-                if (lpErrno) *lpErrno = WSAENOTSOCK;
-                HeapFree(GlobalHeap, 0, PollBuffer);
-                NtClose(SockEvent);
-                return SOCKET_ERROR;
-            }
-            PollInfo->Handles[j].Handle = exceptfds->fd_array[i];
             if (Socket->SharedData->OobInline == 0)
-                PollInfo->Handles[j].Events |= AFD_EVENT_OOB_RECEIVE;
+                Entry->Events |= AFD_EVENT_OOB_RECEIVE;
             if (Socket->SharedData->NonBlocking != 0)
-                PollInfo->Handles[j].Events |= AFD_EVENT_CONNECT_FAIL;
+                Entry->Events |= AFD_EVENT_CONNECT_FAIL;
         }
     }
 
+    /* The sockets stay in AFD's poll set between calls, so selecting on
+     * the same sockets again only costs what is ready */
+    PollSet = SockAcquirePollSet();
+    if (!PollSet)
+    {
+        if (lpErrno) *lpErrno = WSAENOBUFS;
+        HeapFree(GlobalHeap, 0, SelectHandles);
+        return SOCKET_ERROR;
+    }
+
+    PollBufferSize = FIELD_OFFSET(AFD_POLL_INFO, Handles) + HandleCount * sizeof(AFD_HANDLE);
+    PollInfo = HeapAlloc(GlobalHeap, 0, PollBufferSize);
+
+    Status = PollInfo ? SockUpdatePollSet(PollSet, SelectHandles, HandleCount) : STATUS_NO_MEMORY;
+    if (!NT_SUCCESS(Status))
+    {
+        ERR("Updating the poll set failed: 0x%08x\n", Status);
+        if (lpErrno) *lpErrno = (Status == STATUS_NO_MEMORY) ? WSAENOBUFS : WSAEINVAL;
+        SockReleasePollSet(PollSet, Status != STATUS_NO_MEMORY);
+        if (PollInfo) HeapFree(GlobalHeap, 0, PollInfo);
+        HeapFree(GlobalHeap, 0, SelectHandles);
+        return SOCKET_ERROR;
+    }
+
+    PollInfo->Timeout = Timeout;
     PollInfo->HandleCount = HandleCount;
-    PollBufferSize = FIELD_OFFSET(AFD_POLL_INFO, Handles) + PollInfo->HandleCount * sizeof(AFD_HANDLE);
+    PollInfo->Exclusive = FALSE;
 
     /* Send IOCTL */
-    Status = NtDeviceIoControlFile((HANDLE)PollInfo->Handles[0].Handle,
-                                   SockEvent,
+    Status = NtDeviceIoControlFile(PollSet->Handle,
+                                   PollSet->Event,
                                    NULL,
                                    NULL,
                                    &IOSB,
-                                   IOCTL_AFD_SELECT,
+                                   IOCTL_AFD_POLL_SET_WAIT,
                                    PollInfo,
                                    PollBufferSize,
                                    PollInfo,
@@ -1304,9 +1235,13 @@ WSPSelect(IN int nfds,
     /* Wait for Completion */
     if (Status == STATUS_PENDING)
     {
-        WaitForSingleObject(SockEvent, INFINITE);
+        WaitForSingleObject(PollSet->Event, INFINITE);
         Status = IOSB.Status;
     }
+    else
+    {
+        IOSB.Status = Status;
+    }
 
     /* Clear the Structures */
     if( readfds )
@@ -1316,25 +1251,24 @@ WSPSelect(IN int nfds,
     if( exceptfds )
         FD_ZERO(exceptfds);
 
-    /* Loop through return structure */
-    HandleCount = PollInfo->HandleCount;
+    /* Only the ready sockets come back */
+    if (!NT_SUCCESS(Status) || Status == STATUS_TIMEOUT)
+        PollInfo->HandleCount = 0;
 
     /* Return in FDSET Format */
-    for (i = 0; i < HandleCount; i++)
+    for (i = 0; i < PollInfo->HandleCount; i++)
     {
         Events = PollInfo->Handles[i].Events;
         Handle = PollInfo->Handles[i].Handle;
+
+        Entry = SockFindSelectHandle(SelectHandles, HandleCount, Handle);
+        if (!Entry)
+            continue;
+        Socket = Entry->Socket;
+
+        Sets = 0;
         for(x = 1; x; x<<=1)
         {
-            Socket = GetSocketStructure(Handle);
-            if (!Socket)
-            {
-                TRACE("Invalid socket handle found %d\n", Handle);
-                if (lpErrno) *lpErrno = WSAENOTSOCK;
-                HeapFree(GlobalHeap, 0, PollBuffer);
-                NtClose(SockEvent);
-                return SOCKET_ERROR;
-            }
             switch (Events & x)
             {
                 case AFD_EVENT_RECEIVE:
@@ -1349,45 +1283,53 @@ WSPSelect(IN int nfds,
                         Socket->SharedData->SocketLastError = WSAECONNRESET;
                     if ((Events & x) == AFD_EVENT_ABORT)
                         Socket->SharedData->SocketLastError = WSAECONNABORTED;
-                    if( readfds )
-                        FD_SET(Handle, readfds);
+                    Sets |= SOCK_SELECT_READ;
                     break;
                 case AFD_EVENT_SEND:
                     TRACE("Event %x on handle %x\n",
                         Events,
                         Handle);
-                    if (writefds)
-                        FD_SET(Handle, writefds);
+                    Sets |= SOCK_SELECT_WRITE;
                     break;
                 case AFD_EVENT_CONNECT:
                     TRACE("Event %x on handle %x\n",
                         Events,
                         Handle);
-                    if( writefds && Socket->SharedData->NonBlocking != 0 )
-                        FD_SET(Handle, writefds);
+                    if( Socket->SharedData->NonBlocking != 0 )
+                        Sets |= SOCK_SELECT_WRITE;
                     break;
                 case AFD_EVENT_OOB_RECEIVE:
                     TRACE("Event %x on handle %x\n",
                         Events,
                         Handle);
-                    if( readfds && Socket->SharedData->OobInline != 0 )
-                        FD_SET(Handle, readfds);
-                    if( exceptfds && Socket->SharedData->OobInline == 0 )
-                        FD_SET(Handle, exceptfds);
+                    if( Socket->SharedData->OobInline != 0 )
+                        Sets |= SOCK_SELECT_READ;
+                    else
+                        Sets |= SOCK_SELECT_EXCEPT;
                     break;
                 case AFD_EVENT_CONNECT_FAIL:
                     TRACE("Event %x on handle %x\n",
                         Events,
                         Handle);
-                    if( exceptfds && Socket->SharedData->NonBlocking != 0 )
-                        FD_SET(Handle, exceptfds);
+                    if( Socket->SharedData->NonBlocking != 0 )
+                        Sets |= SOCK_SELECT_EXCEPT;
                     break;
             }
         }
+
+        /* Each socket comes back once, so there is no need to look for it
+         * and no FD_SETSIZE limit on sets the caller made bigger */
+        Sets &= Entry->Sets;
+        for (Set = 0; Set < 3; Set++)
+        {
+            if (Sets & (1 << Set))
+                fds[Set]->fd_array[fds[Set]->fd_count++] = Handle;
+        }
     }
 
-    HeapFree( GlobalHeap, 0, PollBuffer );
-    NtClose( SockEvent );
+    SockReleasePollSet(PollSet, FALSE);
+    HeapFree( GlobalHeap, 0, PollInfo );
+    HeapFree( GlobalHeap, 0, SelectHandles );
 
     if( lpErrno )
     {
@@ -0,0 +1,269 @@
+/*
+ * COPYRIGHT:   See COPYING in the top level directory
+ * PROJECT:     ReactOS Ancillary Function Driver DLL
+ * FILE:        dll/win32/msafd/misc/pollset.c
+ * PURPOSE:     AFD poll sets behind select
+ */
+
+#include <msafd.h>
+
+#include <stdlib.h>
+
+/* Poll sets nobody is selecting on, each remembers what AFD has in it */
+static SLIST_HEADER SockPollSetCache;
+
+/* Bumped for every closed socket, see SockUpdatePollSet */
+static LONG SockPollSetGeneration;
+
+static
+int
+__cdecl
+SockCompareSelectHandles(
+    const void *First,
+    const void *Second)
+{
+    SOCKET Handle1 = ((const SOCK_SELECT_HANDLE *)First)->Handle;
+    SOCKET Handle2 = ((const SOCK_SELECT_HANDLE *)Second)->Handle;
+
+    return Handle1 < Handle2 ? -1 : Handle1 > Handle2;
+}
+
+/*
+ * Sort the handles and merge the ones given more than once,
+ * returns how many different ones there are
+ */
+ULONG
+SockSortSelectHandles(
+    PSOCK_SELECT_HANDLE Handles,
+    ULONG Count)
+{
+    ULONG i, Unique = 0;
+
+    if (!Count)
+        return 0;
+
+    qsort(Handles, Count, sizeof(*Handles), SockCompareSelectHandles);
+
+    for (i = 1; i < Count; i++)
+    {
+        if (Handles[i].Handle == Handles[Unique].Handle)
+        {
+            Handles[Unique].Events |= Handles[i].Events;
+            Handles[Unique].Sets |= Handles[i].Sets;
+        }
+        else
+        {
+            Handles[++Unique] = Handles[i];
+        }
+    }
+
+    return Unique + 1;
+}
+
+PSOCK_SELECT_HANDLE
+SockFindSelectHandle(
+    PSOCK_SELECT_HANDLE Handles,
+    ULONG Count,
+    SOCKET Handle)
+{
+    SOCK_SELECT_HANDLE Key;
+
+    Key.Handle = Handle;
+    return bsearch(&Key, Handles, Count, sizeof(*Handles), SockCompareSelectHandles);
+}
+
+PSOCK_POLL_SET
+SockAcquirePollSet(VOID)
+{
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoSb;
+    UNICODE_STRING AfdName;
+    PSLIST_ENTRY Entry;
+    PSOCK_POLL_SET PollSet;
+    NTSTATUS Status;
+
+    Entry = InterlockedPopEntrySList(&SockPollSetCache);
+    if (Entry)
+        return CONTAINING_RECORD(Entry, SOCK_POLL_SET, ListEntry);
+
+    PollSet = HeapAlloc(GlobalHeap, HEAP_ZERO_MEMORY, sizeof(*PollSet));
+    if (!PollSet)
+        return NULL;
+
+    /* Any handle to AFD that isn't a socket will do */
+    RtlInitUnicodeString(&AfdName, L"\\Device\\Afd\\PollSet");
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &AfdName,
+                               OBJ_CASE_INSENSITIVE,
+                               NULL,
+                               NULL);
+
+    Status = NtCreateFile(&PollSet->Handle,
+                          GENERIC_READ | GENERIC_WRITE | SYNCHRONIZE,
+                          &ObjectAttributes,
+                          &IoSb,
+                          NULL,
+                          0,
+                          FILE_SHARE_READ | FILE_SHARE_WRITE,
+                          FILE_OPEN_IF,
+                          0,
+                          NULL,
+                          0);
+    if (!NT_SUCCESS(Status))
+    {
+        ERR("Opening a poll set failed: 0x%08x\n", Status);
+        HeapFree(GlobalHeap, 0, PollSet);
+        return NULL;
+    }
+
+    Status = NtCreateEvent(&PollSet->Event,
+                           EVENT_ALL_ACCESS,
+                           NULL,
+                           SynchronizationEvent,
+                           FALSE);
+    if (!NT_SUCCESS(Status))
+    {
+        ERR("NtCreateEvent failed: 0x%08x\n", Status);
+        NtClose(PollSet->Handle);
+        HeapFree(GlobalHeap, 0, PollSet);
+        return NULL;
+    }
+
+    PollSet->Generation = SockPollSetGeneration;
+    return PollSet;
+}
+
+VOID
+SockReleasePollSet(
+    PSOCK_POLL_SET PollSet,
+    BOOLEAN Discard)
+{
+    if (!Discard)
+    {
+        InterlockedPushEntrySList(&SockPollSetCache, &PollSet->ListEntry);
+        return;
+    }
+
+    /* AFD takes the sockets out when the handle goes */
+    NtClose(PollSet->Event);
+    NtClose(PollSet->Handle);
+    if (PollSet->Handles)
+        HeapFree(GlobalHeap, 0, PollSet->Handles);
+    HeapFree(GlobalHeap, 0, PollSet);
+}
+
+VOID
+SockPollSetSocketClosed(VOID)
+{
+    InterlockedIncrement(&SockPollSetGeneration);
+}
+
+/*
+ * Make AFD's copy of the set look like Wanted, which is sorted. Only the
+ * differences to the last select on this set go down to AFD.
+ */
+NTSTATUS
+SockUpdatePollSet(
+    PSOCK_POLL_SET PollSet,
+    PSOCK_SELECT_HANDLE Wanted,
+    ULONG Count)
+{
+    IO_STATUS_BLOCK IoSb;
+    PAFD_POLL_SET_INFO UpdateInfo;
+    PAFD_HANDLE Registered, Change;
+    ULONG i = 0, j = 0, Size;
+    LONG Generation;
+    BOOLEAN Resend, Same;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    /* A closed socket's handle may belong to a new one by now, AFD only
+     * knows the old one left. Tell it about everything again then. */
+    Generation = SockPollSetGeneration;
+    Resend = (Generation != PollSet->Generation);
+
+    Registered = HeapAlloc(GlobalHeap, 0, Count * sizeof(AFD_HANDLE));
+    Size = FIELD_OFFSET(AFD_POLL_SET_INFO, Handles) + (PollSet->Count + Count) * sizeof(AFD_HANDLE);
+    UpdateInfo = HeapAlloc(GlobalHeap, 0, Size);
+    if (!Registered || !UpdateInfo)
+    {
+        if (Registered) HeapFree(GlobalHeap, 0, Registered);
+        if (UpdateInfo) HeapFree(GlobalHeap, 0, UpdateInfo);
+        return STATUS_NO_MEMORY;
+    }
+
+    UpdateInfo->HandleCount = 0;
+    while (i < PollSet->Count || j < Count)
+    {
+        Change = &UpdateInfo->Handles[UpdateInfo->HandleCount];
+
+        if (j == Count || (i < PollSet->Count && PollSet->Handles[i].Handle < Wanted[j].Handle))
+        {
+            /* Not selected on anymore */
+            Change->Handle = PollSet->Handles[i].Handle;
+            Change->Events = 0;
+            Change->Status = STATUS_SUCCESS;
+            UpdateInfo->HandleCount++;
+            i++;
+            continue;
+        }
+
+        Same = FALSE;
+        if (i < PollSet->Count && PollSet->Handles[i].Handle == Wanted[j].Handle)
+        {
+            Same = !Resend && PollSet->Handles[i].Events == Wanted[j].Events;
+            i++;
+        }
+
+        if (!Same)
+        {
+            Change->Handle = Wanted[j].Handle;
+            Change->Events = Wanted[j].Events;
+            Change->Status = STATUS_SUCCESS;
+            UpdateInfo->HandleCount++;
+        }
+
+        Registered[j].Handle = Wanted[j].Handle;
+        Registered[j].Events = Wanted[j].Events;
+        Registered[j].Status = STATUS_SUCCESS;
+        j++;
+    }
+
+    TRACE("%lu of %lu handles changed\n", UpdateInfo->HandleCount, Count);
+
+    if (UpdateInfo->HandleCount)
+    {
+        Status = NtDeviceIoControlFile(PollSet->Handle,
+                                       PollSet->Event,
+                                       NULL,
+                                       NULL,
+                                       &IoSb,
+                                       IOCTL_AFD_POLL_SET_UPDATE,
+                                       UpdateInfo,
+                                       FIELD_OFFSET(AFD_POLL_SET_INFO, Handles) +
+                                       UpdateInfo->HandleCount * sizeof(AFD_HANDLE),
+                                       NULL,
+                                       0);
+        if (Status == STATUS_PENDING)
+        {
+            WaitForSingleObject(PollSet->Event, INFINITE);
+            Status = IoSb.Status;
+        }
+    }
+
+    HeapFree(GlobalHeap, 0, UpdateInfo);
+
+    if (!NT_SUCCESS(Status))
+    {
+        /* The caller throws the set away, AFD's copy is unknown now */
+        HeapFree(GlobalHeap, 0, Registered);
+        return Status;
+    }
+
+    if (PollSet->Handles)
+        HeapFree(GlobalHeap, 0, PollSet->Handles);
+    PollSet->Handles = Registered;
+    PollSet->Count = Count;
+    PollSet->Generation = Generation;
+
+    return STATUS_SUCCESS;
+}
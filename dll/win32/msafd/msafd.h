@@ -117,6 +117,27 @@ typedef struct _SOCKET_INFORMATION {
 } SOCKET_INFORMATION, *PSOCKET_INFORMATION;
 
 
+/* A select set entry, the same socket may be in all three sets */
+typedef struct _SOCK_SELECT_HANDLE {
+	SOCKET Handle;
+	ULONG Events;
+	ULONG Sets;
+	PSOCKET_INFORMATION Socket;
+} SOCK_SELECT_HANDLE, *PSOCK_SELECT_HANDLE;
+
+#define SOCK_SELECT_READ    0x1
+#define SOCK_SELECT_WRITE   0x2
+#define SOCK_SELECT_EXCEPT  0x4
+
+typedef struct _SOCK_POLL_SET {
+	SLIST_ENTRY ListEntry;
+	HANDLE Handle;
+	HANDLE Event;
+	LONG Generation;
+	ULONG Count;
+	PAFD_HANDLE Handles;
+} SOCK_POLL_SET, *PSOCK_POLL_SET;
+
 typedef struct _SOCKET_CONTEXT {
 	SOCK_SHARED_INFO SharedData;
 	ULONG SizeOfHelperData;
@@ -539,6 +560,42 @@ SockReenableAsyncSelectEvent (
     IN ULONG Event
     );
 
+ULONG
+SockSortSelectHandles(
+	PSOCK_SELECT_HANDLE Handles,
+	ULONG Count
+);
+
+PSOCK_SELECT_HANDLE
+SockFindSelectHandle(
+	PSOCK_SELECT_HANDLE Handles,
+	ULONG Count,
+	SOCKET Handle
+);
+
+PSOCK_POLL_SET
+SockAcquirePollSet(
+	VOID
+);
+
+VOID
+SockReleasePollSet(
+	PSOCK_POLL_SET PollSet,
+	BOOLEAN Discard
+);
+
+VOID
+SockPollSetSocketClosed(
+	VOID
+);
+
+NTSTATUS
+SockUpdatePollSet(
+	PSOCK_POLL_SET PollSet,
+	PSOCK_SELECT_HANDLE Wanted,
+	ULONG Count
+);
+
 typedef VOID (*PASYNC_COMPLETION_ROUTINE)(PVOID Context, PIO_STATUS_BLOCK IoStatusBlock);
 
 FORCEINLINE
@@ -215,3 +215,227 @@ WSAEventSelect(IN SOCKET s,
     SetLastError(ErrorCode);
     return SOCKET_ERROR;
 }
+
+static
+int
+__cdecl
+WsCompareSockets(const void *First,
+                 const void *Second)
+{
+    SOCKET Socket1 = *(const SOCKET *)First;
+    SOCKET Socket2 = *(const SOCKET *)Second;
+
+    return Socket1 < Socket2 ? -1 : Socket1 > Socket2;
+}
+
+static
+BOOLEAN
+WsIsSocketInSortedSet(IN SOCKET s,
+                      IN LPFD_SET set)
+{
+    return bsearch(&s, set->fd_array, set->fd_count, sizeof(SOCKET), WsCompareSockets) != NULL;
+}
+
+static
+SHORT
+WsPollReadEvents(IN SOCKET s)
+{
+    INT Type, Error, Length;
+    BOOL Listening;
+    u_long Available;
+
+    /* Connections waiting to be accepted and datagrams are plain data */
+    Length = sizeof(Listening);
+    if (!getsockopt(s, SOL_SOCKET, SO_ACCEPTCONN, (PCHAR)&Listening, &Length) && Listening)
+        return POLLRDNORM;
+
+    Length = sizeof(Type);
+    if (getsockopt(s, SOL_SOCKET, SO_TYPE, (PCHAR)&Type, &Length) || Type != SOCK_STREAM)
+        return POLLRDNORM;
+
+    if (!ioctlsocket(s, FIONREAD, &Available) && Available)
+        return POLLRDNORM;
+
+    /* Nothing to read, so the connection went away. select recorded how */
+    Length = sizeof(Error);
+    if (!getsockopt(s, SOL_SOCKET, SO_ERROR, (PCHAR)&Error, &Length) && Error == WSAECONNABORTED)
+        return POLLERR;
+
+    return POLLHUP;
+}
+
+static
+SHORT
+WsPollExceptEvents(IN SOCKET s)
+{
+    SOCKADDR_STORAGE Address;
+    INT Length = sizeof(Address);
+
+    /* The exception set holds failed connects and out-of-band data */
+    if (getpeername(s, (LPSOCKADDR)&Address, &Length))
+        return POLLERR;
+
+    return POLLPRI | POLLRDBAND;
+}
+
+/*
+ * @implemented
+ */
+INT
+WSAAPI
+WSAPoll(IN OUT LPWSAPOLLFD fdArray,
+        IN ULONG fds,
+        IN INT timeout)
+{
+    PWSSOCKET Socket;
+    LPFD_SET Sets[3];
+    PCHAR Buffer;
+    ULONG SetSize, i, j;
+    INT Status, Count = 0, Selected = 0;
+    INT ErrorCode;
+    SHORT Events;
+    u_long Available;
+    struct timeval Timeout;
+    DWORD Start, Elapsed;
+    INT Remaining;
+
+    DPRINT("WSAPoll: %p %lu %d\n", fdArray, fds, timeout);
+
+    /* Check for WSAStartup */
+    ErrorCode = WsQuickProlog();
+    if (ErrorCode != ERROR_SUCCESS)
+    {
+        SetLastError(ErrorCode);
+        return SOCKET_ERROR;
+    }
+
+    if (!fdArray || !fds)
+    {
+        SetLastError(WSAEINVAL);
+        return SOCKET_ERROR;
+    }
+
+    /* Sets big enough for all of them, select doesn't care about FD_SETSIZE */
+    SetSize = FIELD_OFFSET(fd_set, fd_array) + max(fds, FD_SETSIZE) * sizeof(SOCKET);
+    Buffer = HeapAlloc(WsSockHeap, 0, 3 * SetSize);
+    if (!Buffer)
+    {
+        SetLastError(WSAENOBUFS);
+        return SOCKET_ERROR;
+    }
+
+    for (j = 0; j < 3; j++)
+        Sets[j] = (LPFD_SET)(Buffer + j * SetSize);
+
+    Start = GetTickCount();
+    Remaining = timeout;
+
+    /* A socket that is only watched for hangups wakes select when data
+     * arrives as well. Nothing is reported for it then, so wait again for
+     * what is left of the timeout. The data keeps it out of the read set. */
+    for (;;)
+    {
+        for (j = 0; j < 3; j++)
+            Sets[j]->fd_count = 0;
+        Selected = 0;
+
+        for (i = 0; i < fds; i++)
+        {
+            fdArray[i].revents = 0;
+
+            /* These are skipped on purpose */
+            if (fdArray[i].fd == INVALID_SOCKET)
+                continue;
+
+            Socket = WsSockGetSocket(fdArray[i].fd);
+            if (!Socket)
+            {
+                fdArray[i].revents = POLLNVAL;
+                Count++;
+                continue;
+            }
+            WsSockDereference(Socket);
+
+            /* Hangups and errors are always reported, and only the read set sees them.
+             * Unread data would make a socket that isn't read from ready at once, though */
+            if ((fdArray[i].events & POLLIN) ||
+                ioctlsocket(fdArray[i].fd, FIONREAD, &Available) ||
+                !Available)
+            {
+                Sets[0]->fd_array[Sets[0]->fd_count++] = fdArray[i].fd;
+            }
+            if (fdArray[i].events & POLLOUT)
+                Sets[1]->fd_array[Sets[1]->fd_count++] = fdArray[i].fd;
+
+            /* Failed connects are errors as well, out-of-band data is sorted out afterwards */
+            Sets[2]->fd_array[Sets[2]->fd_count++] = fdArray[i].fd;
+            Selected++;
+        }
+
+        /* Invalid sockets are ready right away */
+        if (!Selected || Count)
+        {
+            HeapFree(WsSockHeap, 0, Buffer);
+            if (Count)
+                return Count;
+
+            SetLastError(WSAEINVAL);
+            return SOCKET_ERROR;
+        }
+
+        Timeout.tv_sec = Remaining / 1000;
+        Timeout.tv_usec = (Remaining % 1000) * 1000;
+
+        /* The provider keeps the sockets registered between calls, so polling
+         * the same array again only costs what became ready */
+        Status = select(0, Sets[0], Sets[1], Sets[2], timeout < 0 ? NULL : &Timeout);
+        if (Status == SOCKET_ERROR)
+        {
+            ErrorCode = GetLastError();
+            HeapFree(WsSockHeap, 0, Buffer);
+            SetLastError(ErrorCode);
+            return SOCKET_ERROR;
+        }
+
+        for (j = 0; j < 3; j++)
+            qsort(Sets[j]->fd_array, Sets[j]->fd_count, sizeof(SOCKET), WsCompareSockets);
+
+        for (i = 0; i < fds; i++)
+        {
+            if (fdArray[i].fd == INVALID_SOCKET)
+                continue;
+
+            /* A closed connection shows up as readable as well */
+            if (WsIsSocketInSortedSet(fdArray[i].fd, Sets[0]))
+                Events = WsPollReadEvents(fdArray[i].fd);
+            else
+                Events = 0;
+            if (WsIsSocketInSortedSet(fdArray[i].fd, Sets[1]))
+                Events |= POLLOUT;
+            if (WsIsSocketInSortedSet(fdArray[i].fd, Sets[2]))
+                Events |= WsPollExceptEvents(fdArray[i].fd);
+
+            /* Errors and hangups are reported whether they were asked for or not */
+            fdArray[i].revents = Events & (fdArray[i].events | POLLERR | POLLHUP);
+
+            if (fdArray[i].revents)
+                Count++;
+        }
+
+        /* Something was reported, or the time is up */
+        if (Count || !Status)
+            break;
+
+        if (timeout >= 0)
+        {
+            Elapsed = GetTickCount() - Start;
+            if (Elapsed >= (DWORD)timeout)
+                break;
+
+            Remaining = timeout - (INT)Elapsed;
+        }
+    }
+
+    HeapFree(WsSockHeap, 0, Buffer);
+    return Count;
+}
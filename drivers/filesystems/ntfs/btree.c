@@ -390,49 +390,40 @@ CreateEmptyBTree(PB_TREE *NewTree)
 }
 
 /**
-* @name CompareTreeKeys
+* @name CompareIndexEntryName
 * @implemented
 *
-* Compare two B_TREE_KEY's to determine their order in the tree.
+* Compares a file name with the key of an index entry, in the order of the keys in the tree.
 *
-* @param Key1
-* Pointer to a B_TREE_KEY that will be compared.
+* @param Name
+* Pointer to a UNICODE_STRING with the name that will be compared.
 *
-* @param Key2
-* Pointer to the other B_TREE_KEY that will be compared.
+* @param IndexEntry
+* Pointer to the INDEX_ENTRY_ATTRIBUTE it will be compared with.
 *
 * @param CaseSensitive
-* Boolean indicating if the function should operate in case-sensitive mode. This will be TRUE
-* if an application created the file with the FILE_FLAG_POSIX_SEMANTICS flag.
+* Boolean indicating if the function should operate in case-sensitive mode.
 *
 * @returns
-* 0 if the two keys are equal.
-* < 0 if key1 is less thank key2
-* > 0 if key1 is greater than key2
-*
-* @remarks
-* Any other key is always less than the final (dummy) key in a node. Key1 must not be the dummy node.
+* 0 if the name and the key are equal.
+* < 0 if the name sorts before the key, or if IndexEntry is the final (dummy) entry of a node.
+* > 0 if the name sorts after the key.
 */
 LONG
-CompareTreeKeys(PB_TREE_KEY Key1, PB_TREE_KEY Key2, BOOLEAN CaseSensitive)
+CompareIndexEntryName(PUNICODE_STRING Name, PINDEX_ENTRY_ATTRIBUTE IndexEntry, BOOLEAN CaseSensitive)
 {
     UNICODE_STRING Key1Name, Key2Name;
     LONG Comparison;
 
-    // Key1 must not be the final key (AKA the dummy key)
-    ASSERT(!(Key1->IndexEntry->Flags & NTFS_INDEX_ENTRY_END));
-
-    // If Key2 is the "dummy key", key 1 will always come first
-    if (Key2->NextKey == NULL)
+    // The "dummy key" comes after every name
+    if (IndexEntry->Flags & NTFS_INDEX_ENTRY_END)
         return -1;
 
-    Key1Name.Buffer = Key1->IndexEntry->FileName.Name;
-    Key1Name.Length = Key1Name.MaximumLength
-        = Key1->IndexEntry->FileName.NameLength * sizeof(WCHAR);
+    Key1Name = *Name;
 
-    Key2Name.Buffer = Key2->IndexEntry->FileName.Name;
+    Key2Name.Buffer = IndexEntry->FileName.Name;
     Key2Name.Length = Key2Name.MaximumLength
-        = Key2->IndexEntry->FileName.NameLength * sizeof(WCHAR);
+        = IndexEntry->FileName.NameLength * sizeof(WCHAR);
 
     // Are the two keys the same length?
     if (Key1Name.Length == Key2Name.Length)
@@ -468,6 +459,49 @@ CompareTreeKeys(PB_TREE_KEY Key1, PB_TREE_KEY Key2, BOOLEAN CaseSensitive)
     return Comparison;
 }
 
+/**
+* @name CompareTreeKeys
+* @implemented
+*
+* Compare two B_TREE_KEY's to determine their order in the tree.
+*
+* @param Key1
+* Pointer to a B_TREE_KEY that will be compared.
+*
+* @param Key2
+* Pointer to the other B_TREE_KEY that will be compared.
+*
+* @param CaseSensitive
+* Boolean indicating if the function should operate in case-sensitive mode. This will be TRUE
+* if an application created the file with the FILE_FLAG_POSIX_SEMANTICS flag.
+*
+* @returns
+* 0 if the two keys are equal.
+* < 0 if key1 is less thank key2
+* > 0 if key1 is greater than key2
+*
+* @remarks
+* Any other key is always less than the final (dummy) key in a node. Key1 must not be the dummy node.
+*/
+LONG
+CompareTreeKeys(PB_TREE_KEY Key1, PB_TREE_KEY Key2, BOOLEAN CaseSensitive)
+{
+    UNICODE_STRING Key1Name;
+
+    // Key1 must not be the final key (AKA the dummy key)
+    ASSERT(!(Key1->IndexEntry->Flags & NTFS_INDEX_ENTRY_END));
+
+    // If Key2 is the "dummy key", key 1 will always come first
+    if (Key2->NextKey == NULL)
+        return -1;
+
+    Key1Name.Buffer = Key1->IndexEntry->FileName.Name;
+    Key1Name.Length = Key1Name.MaximumLength
+        = Key1->IndexEntry->FileName.NameLength * sizeof(WCHAR);
+
+    return CompareIndexEntryName(&Key1Name, Key2->IndexEntry, CaseSensitive);
+}
+
 /**
 * @name CountBTreeKeys
 * @implemented
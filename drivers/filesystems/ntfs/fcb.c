@@ -32,6 +32,10 @@
 #define NDEBUG
 #include <debug.h>
 
+#ifdef __GNUC__
+#include <wctype.h> /* towlower prototype */
+#endif
+
 /* FUNCTIONS ****************************************************************/
 
 static
@@ -52,6 +56,23 @@ NtfsGetNextPathElement(PCWSTR FileName)
 }
 
 
+/* Must fold case the same way as the _wcsicmp in NtfsGrabFCBFromTable */
+static
+ULONG
+NtfsHashFCBName(PCWSTR FileName)
+{
+    ULONG Hash = 0;
+
+    while (*FileName != L'\0')
+    {
+        Hash = Hash * 31 + towlower(*FileName);
+        FileName++;
+    }
+
+    return Hash;
+}
+
+
 static
 VOID
 NtfsWSubString(PWCHAR pTarget,
@@ -89,6 +110,7 @@ NtfsCreateFCB(PCWSTR FileName,
     if (FileName)
     {
         wcscpy(Fcb->PathName, FileName);
+        Fcb->PathHash = NtfsHashFCBName(FileName);
         if (wcsrchr(Fcb->PathName, '\\') != 0)
         {
             Fcb->ObjectName = wcsrchr(Fcb->PathName, '\\');
@@ -213,7 +235,7 @@ NtfsAddFCBToTable(PNTFS_VCB Vcb,
 
     KeAcquireSpinLock(&Vcb->FcbListLock, &oldIrql);
     Fcb->Vcb = Vcb;
-    InsertTailList(&Vcb->FcbListHead, &Fcb->FcbListEntry);
+    InsertTailList(&Vcb->FcbHashTable[Fcb->PathHash % NTFS_FCB_HASH_SIZE], &Fcb->FcbListEntry);
     KeReleaseSpinLock(&Vcb->FcbListLock, oldIrql);
 }
 
@@ -225,25 +247,31 @@ NtfsGrabFCBFromTable(PNTFS_VCB Vcb,
     KIRQL oldIrql;
     PNTFS_FCB Fcb;
     PLIST_ENTRY current_entry;
-
-    KeAcquireSpinLock(&Vcb->FcbListLock, &oldIrql);
+    PLIST_ENTRY bucket;
+    ULONG Hash;
 
     if (FileName == NULL || *FileName == 0)
     {
         DPRINT("Return FCB for stream file object\n");
+        KeAcquireSpinLock(&Vcb->FcbListLock, &oldIrql);
         Fcb = Vcb->StreamFileObject->FsContext;
         Fcb->RefCount++;
         KeReleaseSpinLock(&Vcb->FcbListLock, oldIrql);
         return Fcb;
     }
 
-    current_entry = Vcb->FcbListHead.Flink;
-    while (current_entry != &Vcb->FcbListHead)
+    Hash = NtfsHashFCBName(FileName);
+    bucket = &Vcb->FcbHashTable[Hash % NTFS_FCB_HASH_SIZE];
+
+    KeAcquireSpinLock(&Vcb->FcbListLock, &oldIrql);
+
+    current_entry = bucket->Flink;
+    while (current_entry != bucket)
     {
         Fcb = CONTAINING_RECORD(current_entry, NTFS_FCB, FcbListEntry);
 
         DPRINT("Comparing '%S' and '%S'\n", FileName, Fcb->PathName);
-        if (_wcsicmp(FileName, Fcb->PathName) == 0)
+        if (Fcb->PathHash == Hash && _wcsicmp(FileName, Fcb->PathName) == 0)
         {
             Fcb->RefCount++;
             KeReleaseSpinLock(&Vcb->FcbListLock, oldIrql);
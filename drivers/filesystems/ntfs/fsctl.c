@@ -424,6 +424,7 @@ NtfsMountVolume(PDEVICE_OBJECT DeviceObject,
     PNTFS_VCB Vcb = NULL;
     NTSTATUS Status;
     BOOLEAN Lookaside = FALSE;
+    ULONG i;
 
     DPRINT("NtfsMountVolume() called\n");
 
@@ -459,6 +460,9 @@ NtfsMountVolume(PDEVICE_OBJECT DeviceObject,
     Vcb->Identifier.Type = NTFS_TYPE_VCB;
     Vcb->Identifier.Size = sizeof(NTFS_TYPE_VCB);
 
+    /* Reading the volume data goes through the file record cache already */
+    NtfsInitializeMftCache(Vcb);
+
     Status = NtfsGetVolumeData(DeviceToMount,
                                Vcb);
     if (!NT_SUCCESS(Status))
@@ -478,7 +482,10 @@ NtfsMountVolume(PDEVICE_OBJECT DeviceObject,
     Vcb->StreamFileObject = IoCreateStreamFileObject(NULL,
                                                      Vcb->StorageDevice);
 
-    InitializeListHead(&Vcb->FcbListHead);
+    for (i = 0; i < NTFS_FCB_HASH_SIZE; i++)
+    {
+        InitializeListHead(&Vcb->FcbHashTable[i]);
+    }
 
     Fcb = NtfsCreateFCB(NULL, NULL, Vcb);
     if (Fcb == NULL)
@@ -564,6 +571,9 @@ ByeBye:
         if (Ccb)
             ExFreePool(Ccb);
 
+        if (Vcb)
+            NtfsFlushMftCache(Vcb);
+
         if (Lookaside)
             ExDeleteNPagedLookasideList(&Vcb->FileRecLookasideList);
 
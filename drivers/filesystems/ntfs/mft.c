@@ -1627,15 +1627,206 @@ Cleanup:
     return Status;
 }
 
+VOID
+NtfsInitializeMftCache(PNTFS_VCB Vcb)
+{
+    ULONG i;
+
+    KeInitializeSpinLock(&Vcb->MftCacheLock);
+    InitializeListHead(&Vcb->MftCacheLruList);
+    for (i = 0; i < NTFS_MFT_CACHE_HASH_SIZE; i++)
+    {
+        InitializeListHead(&Vcb->MftCacheHashTable[i]);
+    }
+    Vcb->MftCacheEntries = 0;
+    Vcb->MftCacheGeneration = 0;
+}
+
+VOID
+NtfsFlushMftCache(PNTFS_VCB Vcb)
+{
+    KIRQL OldIrql;
+    PLIST_ENTRY ListEntry;
+    PNTFS_MFT_CACHE_ENTRY Entry;
+    LIST_ENTRY FreeList;
+
+    InitializeListHead(&FreeList);
+
+    KeAcquireSpinLock(&Vcb->MftCacheLock, &OldIrql);
+    while (!IsListEmpty(&Vcb->MftCacheLruList))
+    {
+        ListEntry = RemoveHeadList(&Vcb->MftCacheLruList);
+        Entry = CONTAINING_RECORD(ListEntry, NTFS_MFT_CACHE_ENTRY, LruEntry);
+        RemoveEntryList(&Entry->HashEntry);
+        InsertTailList(&FreeList, &Entry->LruEntry);
+    }
+    Vcb->MftCacheEntries = 0;
+    Vcb->MftCacheGeneration++;
+    KeReleaseSpinLock(&Vcb->MftCacheLock, OldIrql);
+
+    while (!IsListEmpty(&FreeList))
+    {
+        ListEntry = RemoveHeadList(&FreeList);
+        Entry = CONTAINING_RECORD(ListEntry, NTFS_MFT_CACHE_ENTRY, LruEntry);
+        ExFreePoolWithTag(Entry, TAG_FILE_REC);
+    }
+}
+
+/* Caller holds MftCacheLock */
+static
+PNTFS_MFT_CACHE_ENTRY
+NtfsLookupMftCache(PNTFS_VCB Vcb,
+                   ULONGLONG MftIndex)
+{
+    PLIST_ENTRY Bucket;
+    PLIST_ENTRY ListEntry;
+    PNTFS_MFT_CACHE_ENTRY Entry;
+
+    Bucket = &Vcb->MftCacheHashTable[MftIndex % NTFS_MFT_CACHE_HASH_SIZE];
+    for (ListEntry = Bucket->Flink; ListEntry != Bucket; ListEntry = ListEntry->Flink)
+    {
+        Entry = CONTAINING_RECORD(ListEntry, NTFS_MFT_CACHE_ENTRY, HashEntry);
+        if (Entry->MFTIndex == MftIndex)
+        {
+            return Entry;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+* @name NtfsCacheFileRecord
+* @implemented
+*
+* Copies a fixed-up file record into the volume's file record cache, evicting
+* the least recently used record if the cache is full.
+*
+* @param Vcb
+* Pointer to the VCB of the volume the record belongs to.
+*
+* @param MftIndex
+* Index of the record in the master file table.
+*
+* @param FileRecord
+* Pointer to the file record, with the update sequence array fixups applied.
+*
+* @param Generation
+* Optional pointer to the value of MftCacheGeneration when FileRecord was read from disk.
+* The record isn't cached if the generation changed since, it might be older than what
+* was written in the meantime. NULL when FileRecord was just written, which only refreshes
+* a record that's already cached.
+*/
+static
+VOID
+NtfsCacheFileRecord(PNTFS_VCB Vcb,
+                    ULONGLONG MftIndex,
+                    PFILE_RECORD_HEADER FileRecord,
+                    PULONG Generation)
+{
+    KIRQL OldIrql;
+    PNTFS_MFT_CACHE_ENTRY Entry;
+    PNTFS_MFT_CACHE_ENTRY NewEntry = NULL;
+    PNTFS_MFT_CACHE_ENTRY Victim = NULL;
+
+    if (Generation != NULL)
+    {
+        NewEntry = ExAllocatePoolWithTag(NonPagedPool,
+                                         FIELD_OFFSET(NTFS_MFT_CACHE_ENTRY, Record) + Vcb->NtfsInfo.BytesPerFileRecord,
+                                         TAG_FILE_REC);
+        if (NewEntry == NULL)
+        {
+            return;
+        }
+    }
+
+    KeAcquireSpinLock(&Vcb->MftCacheLock, &OldIrql);
+
+    // a record written to disk invalidates whatever is being read concurrently
+    if (Generation == NULL)
+        Vcb->MftCacheGeneration++;
+
+    Entry = NtfsLookupMftCache(Vcb, MftIndex);
+    if (Entry != NULL)
+    {
+        RtlCopyMemory(Entry->Record, FileRecord, Vcb->NtfsInfo.BytesPerFileRecord);
+        RemoveEntryList(&Entry->LruEntry);
+        InsertHeadList(&Vcb->MftCacheLruList, &Entry->LruEntry);
+    }
+    else if (NewEntry != NULL && *Generation == Vcb->MftCacheGeneration)
+    {
+        if (Vcb->MftCacheEntries == NTFS_MFT_CACHE_MAX_ENTRIES)
+        {
+            Victim = CONTAINING_RECORD(RemoveTailList(&Vcb->MftCacheLruList), NTFS_MFT_CACHE_ENTRY, LruEntry);
+            RemoveEntryList(&Victim->HashEntry);
+            Vcb->MftCacheEntries--;
+        }
+
+        NewEntry->MFTIndex = MftIndex;
+        RtlCopyMemory(NewEntry->Record, FileRecord, Vcb->NtfsInfo.BytesPerFileRecord);
+        InsertHeadList(&Vcb->MftCacheHashTable[MftIndex % NTFS_MFT_CACHE_HASH_SIZE], &NewEntry->HashEntry);
+        InsertHeadList(&Vcb->MftCacheLruList, &NewEntry->LruEntry);
+        Vcb->MftCacheEntries++;
+        NewEntry = NULL;
+    }
+
+    KeReleaseSpinLock(&Vcb->MftCacheLock, OldIrql);
+
+    if (NewEntry != NULL)
+        ExFreePoolWithTag(NewEntry, TAG_FILE_REC);
+    if (Victim != NULL)
+        ExFreePoolWithTag(Victim, TAG_FILE_REC);
+}
+
+static
+VOID
+NtfsInvalidateFileRecord(PNTFS_VCB Vcb,
+                         ULONGLONG MftIndex)
+{
+    KIRQL OldIrql;
+    PNTFS_MFT_CACHE_ENTRY Entry;
+
+    KeAcquireSpinLock(&Vcb->MftCacheLock, &OldIrql);
+    Entry = NtfsLookupMftCache(Vcb, MftIndex);
+    if (Entry != NULL)
+    {
+        RemoveEntryList(&Entry->HashEntry);
+        RemoveEntryList(&Entry->LruEntry);
+        Vcb->MftCacheEntries--;
+    }
+    Vcb->MftCacheGeneration++;
+    KeReleaseSpinLock(&Vcb->MftCacheLock, OldIrql);
+
+    if (Entry != NULL)
+        ExFreePoolWithTag(Entry, TAG_FILE_REC);
+}
+
 NTSTATUS
 ReadFileRecord(PDEVICE_EXTENSION Vcb,
                ULONGLONG index,
                PFILE_RECORD_HEADER file)
 {
     ULONGLONG BytesRead;
+    KIRQL OldIrql;
+    PNTFS_MFT_CACHE_ENTRY Entry;
+    ULONG Generation;
+    NTSTATUS Status;
 
     DPRINT("ReadFileRecord(%p, %I64x, %p)\n", Vcb, index, file);
 
+    KeAcquireSpinLock(&Vcb->MftCacheLock, &OldIrql);
+    Entry = NtfsLookupMftCache(Vcb, index);
+    if (Entry != NULL)
+    {
+        RtlCopyMemory(file, Entry->Record, Vcb->NtfsInfo.BytesPerFileRecord);
+        RemoveEntryList(&Entry->LruEntry);
+        InsertHeadList(&Vcb->MftCacheLruList, &Entry->LruEntry);
+        KeReleaseSpinLock(&Vcb->MftCacheLock, OldIrql);
+        return STATUS_SUCCESS;
+    }
+    Generation = Vcb->MftCacheGeneration;
+    KeReleaseSpinLock(&Vcb->MftCacheLock, OldIrql);
+
     BytesRead = ReadAttribute(Vcb, Vcb->MFTContext, index * Vcb->NtfsInfo.BytesPerFileRecord, (PCHAR)file, Vcb->NtfsInfo.BytesPerFileRecord);
     if (BytesRead != Vcb->NtfsInfo.BytesPerFileRecord)
     {
@@ -1645,7 +1836,13 @@ ReadFileRecord(PDEVICE_EXTENSION Vcb,
 
     /* Apply update sequence array fixups. */
     DPRINT("Sequence number: %u\n", file->SequenceNumber);
-    return FixupUpdateSequenceArray(Vcb, &file->Ntfs);
+    Status = FixupUpdateSequenceArray(Vcb, &file->Ntfs);
+    if (NT_SUCCESS(Status))
+    {
+        NtfsCacheFileRecord(Vcb, index, file, &Generation);
+    }
+
+    return Status;
 }
 
 
@@ -1957,6 +2154,12 @@ UpdateFileRecord(PDEVICE_EXTENSION Vcb,
     // remove the fixup array (so the file record pointer can still be used)
     FixupUpdateSequenceArray(Vcb, &FileRecord->Ntfs);
 
+    // keep a cached copy in step with the disk, but don't fill the cache with records nobody read
+    if (NT_SUCCESS(Status))
+        NtfsCacheFileRecord(Vcb, MftIndex, FileRecord, NULL);
+    else
+        NtfsInvalidateFileRecord(Vcb, MftIndex);
+
     return Status;
 }
 
@@ -3142,6 +3345,201 @@ BrowseIndexEntries(PDEVICE_EXTENSION Vcb,
     return STATUS_OBJECT_PATH_NOT_FOUND;
 }
 
+/**
+* @name NtfsLookupIndexEntry
+* @implemented
+*
+* Looks a file name up in a directory by descending its $I30 B+tree, reading only the
+* index buffers on the path from the root to the entry.
+*
+* @param Vcb
+* Pointer to the VCB of the volume.
+*
+* @param MftRecord
+* Pointer to the file record of the directory.
+*
+* @param IndexRoot
+* Pointer to the index root of the directory.
+*
+* @param IndexBlockSize
+* Size of an index buffer, in bytes.
+*
+* @param FileName
+* Pointer to the name being looked up. It must not contain wildcards.
+*
+* @param CaseSensitive
+* Boolean indicating if the name must match case-sensitively.
+*
+* @param OutMFTIndex
+* Pointer to a ULONGLONG which will receive the MFT index of the file.
+*
+* @returns
+* STATUS_SUCCESS if the file was found.
+* STATUS_OBJECT_PATH_NOT_FOUND if the directory doesn't contain the file.
+* STATUS_MORE_PROCESSING_REQUIRED if the tree can't answer reliably, the caller must then
+* browse every entry of the directory.
+*
+* @remarks
+* The keys are ordered with the volume's $UpCase table, names are compared here with
+* RtlUpcaseUnicodeChar(). Both agree on ASCII, so a miss is only trusted for ASCII names.
+*/
+static
+NTSTATUS
+NtfsLookupIndexEntry(PDEVICE_EXTENSION Vcb,
+                     PFILE_RECORD_HEADER MftRecord,
+                     PINDEX_ROOT_ATTRIBUTE IndexRoot,
+                     ULONG IndexBlockSize,
+                     PUNICODE_STRING FileName,
+                     BOOLEAN CaseSensitive,
+                     ULONGLONG *OutMFTIndex)
+{
+    PNTFS_ATTR_CONTEXT IndexAllocationContext = NULL;
+    PINDEX_BUFFER IndexBuffer = NULL;
+    PINDEX_HEADER_ATTRIBUTE Header;
+    PINDEX_ENTRY_ATTRIBUTE IndexEntry, LastEntry;
+    ULONGLONG Offset;
+    ULONG BytesRead, Depth, i;
+    LONG Comparison;
+    BOOLEAN Large;
+    NTSTATUS Status;
+
+    DPRINT("NtfsLookupIndexEntry(%p, %p, %p, %lu, %wZ, %s, %p)\n",
+           Vcb,
+           MftRecord,
+           IndexRoot,
+           IndexBlockSize,
+           FileName,
+           CaseSensitive ? "TRUE" : "FALSE",
+           OutMFTIndex);
+
+    Header = &IndexRoot->Header;
+    Large = (IndexRoot->Header.Flags & INDEX_ROOT_LARGE) != 0;
+
+    // Depth is bounded so a corrupted tree can't loop forever
+    for (Depth = 0; Depth < 32; Depth++)
+    {
+        IndexEntry = (PINDEX_ENTRY_ATTRIBUTE)((ULONG_PTR)Header + Header->FirstEntryOffset);
+        LastEntry = (PINDEX_ENTRY_ATTRIBUTE)((ULONG_PTR)Header + Header->TotalSizeOfEntries);
+
+        // Find the first key that doesn't sort before the name
+        for (;;)
+        {
+            if (IndexEntry >= LastEntry || IndexEntry->Length < sizeof(INDEX_ENTRY_ATTRIBUTE))
+            {
+                DPRINT1("Index entries run past the end of the node!\n");
+                Status = STATUS_MORE_PROCESSING_REQUIRED;
+                goto Cleanup;
+            }
+
+            // The tree is ordered case-insensitively, whatever the lookup wants
+            Comparison = CompareIndexEntryName(FileName, IndexEntry, FALSE);
+            if (Comparison <= 0)
+                break;
+
+            IndexEntry = (PINDEX_ENTRY_ATTRIBUTE)((PCHAR)IndexEntry + IndexEntry->Length);
+        }
+
+        if (Comparison == 0)
+        {
+            // Leave short names, POSIX duplicates and metafiles to the full browse
+            if ((IndexEntry->Data.Directory.IndexedFile & NTFS_MFT_MASK) < NTFS_FILE_FIRST_USER_FILE ||
+                IndexEntry->FileName.NameType == NTFS_FILE_NAME_DOS ||
+                !CompareFileName(FileName, IndexEntry, FALSE, CaseSensitive))
+            {
+                Status = STATUS_MORE_PROCESSING_REQUIRED;
+                goto Cleanup;
+            }
+
+            *OutMFTIndex = (IndexEntry->Data.Directory.IndexedFile & NTFS_MFT_MASK);
+            Status = STATUS_SUCCESS;
+            goto Cleanup;
+        }
+
+        // The name sorts before this key, it can only be in the key's subnode
+        if (!(IndexEntry->Flags & NTFS_INDEX_ENTRY_NODE))
+        {
+            Status = STATUS_OBJECT_PATH_NOT_FOUND;
+
+            // RtlUpcaseUnicodeChar() and $UpCase may disagree outside of ASCII
+            for (i = 0; i < FileName->Length / sizeof(WCHAR); i++)
+            {
+                if (FileName->Buffer[i] > 0x7F)
+                {
+                    Status = STATUS_MORE_PROCESSING_REQUIRED;
+                    break;
+                }
+            }
+
+            goto Cleanup;
+        }
+
+        if (!Large)
+        {
+            DPRINT1("Filesystem corruption detected!\n");
+            Status = STATUS_MORE_PROCESSING_REQUIRED;
+            goto Cleanup;
+        }
+
+        if (IndexBuffer == NULL)
+        {
+            Status = FindAttribute(Vcb, MftRecord, AttributeIndexAllocation, L"$I30", 4, &IndexAllocationContext, NULL);
+            if (!NT_SUCCESS(Status))
+            {
+                DPRINT1("Filesystem corruption detected!\n");
+                IndexAllocationContext = NULL;
+                Status = STATUS_MORE_PROCESSING_REQUIRED;
+                goto Cleanup;
+            }
+
+            IndexBuffer = ExAllocatePoolWithTag(NonPagedPool, IndexBlockSize, TAG_NTFS);
+            if (IndexBuffer == NULL)
+            {
+                Status = STATUS_INSUFFICIENT_RESOURCES;
+                goto Cleanup;
+            }
+        }
+
+        // Read the subnode, it replaces its parent in the buffer
+        Offset = GetAllocationOffsetFromVCN(Vcb, IndexBlockSize, GetIndexEntryVCN(IndexEntry));
+        BytesRead = ReadAttribute(Vcb, IndexAllocationContext, Offset, (PCHAR)IndexBuffer, IndexBlockSize);
+        if (BytesRead != IndexBlockSize || IndexBuffer->Ntfs.Type != NRH_INDX_TYPE)
+        {
+            DPRINT1("Unable to read index record!\n");
+            Status = STATUS_MORE_PROCESSING_REQUIRED;
+            goto Cleanup;
+        }
+
+        Status = FixupUpdateSequenceArray(Vcb, &((PFILE_RECORD_HEADER)IndexBuffer)->Ntfs);
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("Failed to apply fixup array!\n");
+            Status = STATUS_MORE_PROCESSING_REQUIRED;
+            goto Cleanup;
+        }
+
+        Header = &IndexBuffer->Header;
+        if (FIELD_OFFSET(INDEX_BUFFER, Header) + Header->TotalSizeOfEntries > IndexBlockSize)
+        {
+            DPRINT1("Filesystem corruption detected!\n");
+            Status = STATUS_MORE_PROCESSING_REQUIRED;
+            goto Cleanup;
+        }
+
+        Large = (Header->Flags & INDEX_NODE_LARGE) != 0;
+    }
+
+    DPRINT1("Index is deeper than expected!\n");
+    Status = STATUS_MORE_PROCESSING_REQUIRED;
+
+Cleanup:
+    if (IndexBuffer)
+        ExFreePoolWithTag(IndexBuffer, TAG_NTFS);
+    if (IndexAllocationContext)
+        ReleaseAttributeContext(IndexAllocationContext);
+
+    return Status;
+}
+
 NTSTATUS
 NtfsFindMftRecord(PDEVICE_EXTENSION Vcb,
                   ULONGLONG MFTIndex,
@@ -3206,6 +3604,24 @@ NtfsFindMftRecord(PDEVICE_EXTENSION Vcb,
 
     DPRINT("IndexRecordSize: %x IndexBlockSize: %x\n", Vcb->NtfsInfo.BytesPerIndexRecord, IndexRoot->SizeOfEntry);
 
+    // Looking up a single name, descend the tree instead of browsing the whole directory
+    if (!DirSearch)
+    {
+        Status = NtfsLookupIndexEntry(Vcb,
+                                      MftRecord,
+                                      IndexRoot,
+                                      IndexRoot->SizeOfEntry,
+                                      FileName,
+                                      CaseSensitive,
+                                      OutMFTIndex);
+        if (Status != STATUS_MORE_PROCESSING_REQUIRED)
+        {
+            ExFreePoolWithTag(IndexRecord, TAG_NTFS);
+            ExFreeToNPagedLookasideList(&Vcb->FileRecLookasideList, MftRecord);
+            return Status;
+        }
+    }
+
     Status = BrowseIndexEntries(Vcb,
                                 MftRecord,
                                 (PINDEX_ROOT_ATTRIBUTE)IndexRecord,
@@ -21,6 +21,13 @@
 
 #define DEVICE_NAME L"\\Ntfs"
 
+/* Buckets of the FCB table, keyed by a case-insensitive hash of the path */
+#define NTFS_FCB_HASH_SIZE 256
+
+/* Fixed-up file records kept per volume, keyed by MFT index */
+#define NTFS_MFT_CACHE_HASH_SIZE 64
+#define NTFS_MFT_CACHE_MAX_ENTRIES 256
+
 #include <pshpack1.h>
 typedef struct _BIOS_PARAMETERS_BLOCK
 {
@@ -104,7 +111,13 @@ typedef struct
 //    ERESOURCE FatResource;
 
     KSPIN_LOCK FcbListLock;
-    LIST_ENTRY FcbListHead;
+    LIST_ENTRY FcbHashTable[NTFS_FCB_HASH_SIZE];
+
+    KSPIN_LOCK MftCacheLock;
+    LIST_ENTRY MftCacheLruList;
+    LIST_ENTRY MftCacheHashTable[NTFS_MFT_CACHE_HASH_SIZE];
+    ULONG MftCacheEntries;
+    ULONG MftCacheGeneration;
 
     PVPB Vpb;
     PDEVICE_OBJECT StorageDevice;
@@ -528,6 +541,7 @@ typedef struct _FCB
     ERESOURCE MainResource;
 
     LIST_ENTRY FcbListEntry;
+    ULONG PathHash;
     struct _FCB* ParentFcb;
 
     ULONG DirIndex;
@@ -562,6 +576,14 @@ typedef struct
     USHORT Array[];
 } FIXUP_ARRAY, *PFIXUP_ARRAY;
 
+typedef struct _NTFS_MFT_CACHE_ENTRY
+{
+    LIST_ENTRY HashEntry;
+    LIST_ENTRY LruEntry;
+    ULONGLONG MFTIndex;
+    UCHAR Record[ANYSIZE_ARRAY];    /* BytesPerFileRecord, fixups applied */
+} NTFS_MFT_CACHE_ENTRY, *PNTFS_MFT_CACHE_ENTRY;
+
 extern PNTFS_GLOBAL_DATA NtfsGlobalData;
 
 FORCEINLINE
@@ -742,6 +764,11 @@ NtfsDeviceIoControl(IN PDEVICE_OBJECT DeviceObject,
 
 /* btree.c */
 
+LONG
+CompareIndexEntryName(PUNICODE_STRING Name,
+                      PINDEX_ENTRY_ATTRIBUTE IndexEntry,
+                      BOOLEAN CaseSensitive);
+
 LONG
 CompareTreeKeys(PB_TREE_KEY Key1,
                 PB_TREE_KEY Key2,
@@ -1113,6 +1140,12 @@ CompareFileName(PUNICODE_STRING FileName,
 NTSTATUS
 UpdateMftMirror(PNTFS_VCB Vcb);
 
+VOID
+NtfsInitializeMftCache(PNTFS_VCB Vcb);
+
+VOID
+NtfsFlushMftCache(PNTFS_VCB Vcb);
+
 NTSTATUS
 ReadFileRecord(PDEVICE_EXTENSION Vcb,
                ULONGLONG index,
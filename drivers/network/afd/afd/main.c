@@ -367,6 +367,7 @@ AfdCreateSocket(PDEVICE_OBJECT DeviceObject, PIRP Irp,
 
     InitializeListHead( &FCB->DatagramList );
     InitializeListHead( &FCB->PendingConnections );
+    InitializeListHead( &FCB->PollSetMembers );
 
     AFD_DbgPrint(MID_TRACE,("%p: Checking command channel\n", FCB));
 
@@ -451,7 +452,14 @@ AfdCleanupSocket(PDEVICE_OBJECT DeviceObject, PIRP Irp,
         }
     }
 
+    /* Direct transfers aren't queued, the transport has to give them back */
+    if (FCB->DirectRecvIrp)
+        IoCancelIrp(FCB->DirectRecvIrp);
+    if (FCB->DirectSendIrp)
+        IoCancelIrp(FCB->DirectSendIrp);
+
     KillSelectsForFCB( FCB->DeviceExt, FileObject, FALSE );
+    KillPollSetsForFCB( FCB->DeviceExt, FCB );
 
     return UnlockAndMaybeComplete(FCB, STATUS_SUCCESS, Irp, 0);
 }
@@ -491,6 +499,7 @@ AfdCloseSocket(PDEVICE_OBJECT DeviceObject, PIRP Irp,
     }
 
     KillSelectsForFCB( FCB->DeviceExt, FileObject, FALSE );
+    KillPollSetsForFCB( FCB->DeviceExt, FCB );
 
     ASSERT(IsListEmpty(&FCB->PendingIrpList[FUNCTION_CONNECT]));
     ASSERT(IsListEmpty(&FCB->PendingIrpList[FUNCTION_SEND]));
@@ -968,6 +977,12 @@ AfdDispatch(PDEVICE_OBJECT DeviceObject, PIRP Irp)
         case IOCTL_AFD_ENUM_NETWORK_EVENTS:
             return AfdEnumEvents( DeviceObject, Irp, IrpSp );
 
+        case IOCTL_AFD_POLL_SET_UPDATE:
+            return AfdPollSetUpdate( DeviceObject, Irp, IrpSp );
+
+        case IOCTL_AFD_POLL_SET_WAIT:
+            return AfdPollSetWait( DeviceObject, Irp, IrpSp );
+
         case IOCTL_AFD_RECV_DATAGRAM:
             return AfdPacketSocketReadData( DeviceObject, Irp, IrpSp );
 
@@ -1264,6 +1279,12 @@ AfdCancelHandler(PDEVICE_OBJECT DeviceObject,
             DbgPrint("WARNING!!! IRP cancellation race could lead to a process hang! (IOCTL_AFD_SELECT)\n");
             return;
 
+        case IOCTL_AFD_POLL_SET_WAIT:
+            /* Whoever completed it first took it off the set */
+            CancelPollSetWait(DeviceExt, FCB, Irp);
+            SocketStateUnlock(FCB);
+            return;
+
         case IOCTL_AFD_DISCONNECT:
             Function = FUNCTION_DISCONNECT;
             break;
@@ -1274,6 +1295,23 @@ AfdCancelHandler(PDEVICE_OBJECT DeviceObject,
             return;
     }
 
+    /* The transport owns the pages of a direct transfer, so cancel its
+     * request and let the completion routine finish ours */
+    if (Function == FUNCTION_RECV && Irp == FCB->DirectRecvIrp)
+    {
+        if (FCB->ReceiveIrp.InFlightRequest)
+            IoCancelIrp(FCB->ReceiveIrp.InFlightRequest);
+        SocketStateUnlock(FCB);
+        return;
+    }
+    else if (Function == FUNCTION_SEND && Irp == FCB->DirectSendIrp)
+    {
+        if (FCB->SendIrp.InFlightRequest)
+            IoCancelIrp(FCB->SendIrp.InFlightRequest);
+        SocketStateUnlock(FCB);
+        return;
+    }
+
     CurrentEntry = FCB->PendingIrpList[Function].Flink;
     while (CurrentEntry != &FCB->PendingIrpList[Function])
     {
@@ -10,6 +10,55 @@
 
 #include "afd.h"
 
+static IO_COMPLETION_ROUTINE DirectReceiveComplete;
+
+static BOOLEAN StartDirectReceive( PAFD_FCB FCB )
+{
+    PLIST_ENTRY NextIrpEntry;
+    PIRP NextIrp;
+    PAFD_RECV_INFO RecvReq;
+    PAFD_MAPBUF Map;
+
+    NextIrpEntry = FCB->PendingIrpList[FUNCTION_RECV].Flink;
+    NextIrp = CONTAINING_RECORD(NextIrpEntry, IRP, Tail.Overlay.ListEntry);
+    RecvReq = GetLockedData(NextIrp, IoGetCurrentIrpStackLocation(NextIrp));
+    Map = (PAFD_MAPBUF)(RecvReq->BufferArray + RecvReq->BufferCount);
+
+    /* It has to be one large buffer taking the data, for a caller that waits */
+    if (RecvReq->BufferCount != 1 ||
+        RecvReq->BufferArray[0].len < AFD_DIRECT_TRANSFER_SIZE ||
+        !Map[0].Mdl ||
+        (RecvReq->TdiFlags & TDI_RECEIVE_PEEK) ||
+        NextIrp->Cancel ||
+        (!(RecvReq->AfdFlags & AFD_OVERLAPPED) &&
+         ((RecvReq->AfdFlags & AFD_IMMEDIATE) || (FCB->NonBlocking))))
+    {
+        return FALSE;
+    }
+
+    AFD_DbgPrint(MID_TRACE,("Receiving straight into %p (%u bytes)\n",
+                            NextIrp, RecvReq->BufferArray[0].len));
+
+    /* Nothing else touches the IRP while the transport has its pages */
+    RemoveEntryList(NextIrpEntry);
+    FCB->DirectRecvIrp = NextIrp;
+
+    if (TdiReceiveMdl(&FCB->ReceiveIrp.InFlightRequest,
+                      FCB->Connection.Object,
+                      TDI_RECEIVE_NORMAL,
+                      Map[0].Mdl,
+                      RecvReq->BufferArray[0].len,
+                      DirectReceiveComplete,
+                      FCB) != STATUS_PENDING)
+    {
+        FCB->DirectRecvIrp = NULL;
+        InsertHeadList(&FCB->PendingIrpList[FUNCTION_RECV], NextIrpEntry);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 static VOID RefillSocketBuffer( PAFD_FCB FCB )
 {
     /* Make sure nothing's in flight first */
@@ -18,6 +67,15 @@ static VOID RefillSocketBuffer( PAFD_FCB FCB )
     /* Now ensure that receive is still allowed */
     if (FCB->TdiReceiveClosed) return;
 
+    /* With nothing buffered, a large receive that is already waiting can
+     * take the data without a copy through the window */
+    if (FCB->Recv.Content == FCB->Recv.BytesUsed &&
+        !IsListEmpty(&FCB->PendingIrpList[FUNCTION_RECV]) &&
+        StartDirectReceive(FCB))
+    {
+        return;
+    }
+
     /* Check if the buffer is full */
     if (FCB->Recv.Content == FCB->Recv.Size)
     {
@@ -310,6 +368,75 @@ NTSTATUS NTAPI ReceiveComplete
     return STATUS_SUCCESS;
 }
 
+static NTSTATUS NTAPI DirectReceiveComplete
+( PDEVICE_OBJECT DeviceObject,
+  PIRP Irp,
+  PVOID Context ) {
+    NTSTATUS Status = Irp->IoStatus.Status;
+    PAFD_FCB FCB = (PAFD_FCB)Context;
+    PIRP UserIrp;
+    PIO_STACK_LOCATION UserIrpSp;
+    PAFD_RECV_INFO RecvReq;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    AFD_DbgPrint(MID_TRACE,("Called, status %x, %u bytes\n",
+                            Irp->IoStatus.Status,
+                            Irp->IoStatus.Information));
+
+    /* The pages belong to the user request */
+    Irp->MdlAddress = NULL;
+
+    if( !SocketAcquireStateLock( FCB ) )
+        return STATUS_FILE_CLOSED;
+
+    ASSERT(FCB->ReceiveIrp.InFlightRequest == Irp);
+    FCB->ReceiveIrp.InFlightRequest = NULL;
+
+    UserIrp = FCB->DirectRecvIrp;
+    ASSERT(UserIrp);
+    FCB->DirectRecvIrp = NULL;
+    UserIrpSp = IoGetCurrentIrpStackLocation(UserIrp);
+    RecvReq = GetLockedData(UserIrp, UserIrpSp);
+
+    if( FCB->State == SOCKET_STATE_CLOSED ) {
+        Status = STATUS_FILE_CLOSED;
+    } else if( NT_SUCCESS(Status) ) {
+        /* Same as for the window, no data means graceful closure */
+        if( Irp->IoStatus.Information == 0 ) {
+            FCB->LastReceiveStatus = Status;
+            FCB->TdiReceiveClosed = TRUE;
+        }
+    } else if( !UserIrp->Cancel && !FCB->TdiReceiveClosed ) {
+        /* Unexpected closure, later receives see it as usual */
+        FCB->LastReceiveStatus = Status;
+        FCB->TdiReceiveClosed = TRUE;
+    }
+
+    AFD_DbgPrint(MID_TRACE,("Completing recv %p (%u)\n", UserIrp,
+                            NT_SUCCESS(Status) ? Irp->IoStatus.Information : 0));
+    UnlockBuffers( RecvReq->BufferArray, RecvReq->BufferCount, FALSE );
+    UserIrp->IoStatus.Status = Status;
+    UserIrp->IoStatus.Information = NT_SUCCESS(Status) ? Irp->IoStatus.Information : 0;
+    if( UserIrp->MdlAddress ) UnlockRequest( UserIrp, UserIrpSp );
+    (void)IoSetCancelRoutine(UserIrp, NULL);
+    IoCompleteRequest( UserIrp, IO_NETWORK_INCREMENT );
+
+    if( FCB->State == SOCKET_STATE_CLOSED ) {
+        SocketStateUnlock( FCB );
+        return STATUS_FILE_CLOSED;
+    }
+
+    /* Go on with the next receive, direct or into the window */
+    RefillSocketBuffer( FCB );
+
+    ReceiveActivity( FCB, NULL );
+
+    SocketStateUnlock( FCB );
+
+    return STATUS_SUCCESS;
+}
+
 static NTSTATUS NTAPI
 SatisfyPacketRecvRequest( PAFD_FCB FCB, PIRP Irp,
                          PAFD_STORED_DATAGRAM DatagramRecv,
@@ -378,6 +378,388 @@ AfdEnumEvents( PDEVICE_OBJECT DeviceObject, PIRP Irp,
     return UnlockAndMaybeComplete( FCB, STATUS_SUCCESS, Irp, 0 );
 }
 
+/* * * Poll sets * * */
+
+/* The device extension lock is held for all of these */
+
+static VOID DropPollSetMember( PAFD_POLL_SET_MEMBER Member ) {
+    RemoveEntryList( &Member->SetEntry );
+    RemoveEntryList( &Member->SocketEntry );
+    if( Member->Ready ) RemoveEntryList( &Member->ReadyEntry );
+    ObDereferenceObject( Member->FileObject );
+    ExFreePoolWithTag( Member, TAG_AFD_POLL_SET );
+}
+
+static UINT DrainPollSet( PAFD_POLL_SET PollSet, PAFD_POLL_INFO PollReq,
+                          UINT Capacity ) {
+    PLIST_ENTRY ListEntry;
+    PAFD_POLL_SET_MEMBER Member;
+    PAFD_FCB FCB;
+    LIST_ENTRY Reported;
+    ULONG Events;
+    UINT Count = 0;
+
+    InitializeListHead( &Reported );
+
+    while( Count < Capacity && !IsListEmpty( &PollSet->ReadyList ) ) {
+        ListEntry = RemoveHeadList( &PollSet->ReadyList );
+        Member = CONTAINING_RECORD( ListEntry, AFD_POLL_SET_MEMBER, ReadyEntry );
+        FCB = Member->FileObject->FsContext;
+
+        /* Whatever queued it may have been consumed since */
+        Events = Member->Events & FCB->PollState;
+        if( !Events ) {
+            Member->Ready = FALSE;
+            continue;
+        }
+
+        PollReq->Handles[Count].Handle = Member->Handle;
+        PollReq->Handles[Count].Events = Events;
+        PollReq->Handles[Count].Status = STATUS_SUCCESS;
+        Count++;
+
+        InsertTailList( &Reported, &Member->ReadyEntry );
+    }
+
+    /* Like select, the next wait sees it again while it stays ready, but
+     * behind the others so a short buffer doesn't starve them */
+    while( !IsListEmpty( &Reported ) ) {
+        ListEntry = RemoveHeadList( &Reported );
+        InsertTailList( &PollSet->ReadyList, ListEntry );
+    }
+
+    return Count;
+}
+
+static VOID CompletePollSetWait( PAFD_POLL_SET PollSet, UINT Count,
+                                 NTSTATUS Status ) {
+    PIRP Irp = PollSet->WaitIrp;
+    PAFD_POLL_INFO PollReq = Irp->AssociatedIrp.SystemBuffer;
+
+    PollSet->WaitIrp = NULL;
+
+    /* A timeout DPC that is already on its way belongs to this wait, it
+     * must not complete the next one */
+    if( PollSet->TimerArmed ) {
+        PollSet->TimerArmed = FALSE;
+        if( !KeCancelTimer( &PollSet->Timer ) )
+            PollSet->StaleTimeouts++;
+    }
+
+    PollReq->HandleCount = Count;
+    Irp->IoStatus.Status = Status;
+    Irp->IoStatus.Information =
+        FIELD_OFFSET(AFD_POLL_INFO, Handles) + sizeof(AFD_HANDLE) * Count;
+    (void)IoSetCancelRoutine( Irp, NULL );
+    IoCompleteRequest( Irp, IO_NETWORK_INCREMENT );
+}
+
+static VOID WakePollSet( PAFD_POLL_SET PollSet ) {
+    PAFD_POLL_INFO PollReq;
+    UINT Count;
+
+    if( !PollSet->WaitIrp ) return;
+
+    /* The wait keeps its capacity in HandleCount until it completes */
+    PollReq = PollSet->WaitIrp->AssociatedIrp.SystemBuffer;
+    Count = DrainPollSet( PollSet, PollReq, PollReq->HandleCount );
+    if( Count ) CompletePollSetWait( PollSet, Count, STATUS_SUCCESS );
+}
+
+static VOID QueuePollSetMember( PAFD_POLL_SET_MEMBER Member, PAFD_FCB FCB ) {
+    if( Member->Ready || !(Member->Events & FCB->PollState) ) return;
+
+    InsertTailList( &Member->PollSet->ReadyList, &Member->ReadyEntry );
+    Member->Ready = TRUE;
+    WakePollSet( Member->PollSet );
+}
+
+static VOID SignalPollSets( PAFD_FCB FCB ) {
+    PLIST_ENTRY ListEntry;
+    PAFD_POLL_SET_MEMBER Member;
+
+    /* Only the sets this socket is in, not every one there is */
+    for( ListEntry = FCB->PollSetMembers.Flink;
+         ListEntry != &FCB->PollSetMembers;
+         ListEntry = ListEntry->Flink ) {
+        Member = CONTAINING_RECORD( ListEntry, AFD_POLL_SET_MEMBER, SocketEntry );
+        QueuePollSetMember( Member, FCB );
+    }
+}
+
+static PAFD_POLL_SET_MEMBER FindPollSetMember( PAFD_POLL_SET PollSet,
+                                               PAFD_FCB FCB,
+                                               SOCKET Handle ) {
+    PLIST_ENTRY ListEntry;
+    PAFD_POLL_SET_MEMBER Member;
+
+    /* A socket is rarely in more than one or two sets */
+    for( ListEntry = FCB->PollSetMembers.Flink;
+         ListEntry != &FCB->PollSetMembers;
+         ListEntry = ListEntry->Flink ) {
+        Member = CONTAINING_RECORD( ListEntry, AFD_POLL_SET_MEMBER, SocketEntry );
+        if( Member->PollSet == PollSet && Member->Handle == Handle )
+            return Member;
+    }
+
+    return NULL;
+}
+
+static KDEFERRED_ROUTINE PollSetTimeout;
+static VOID NTAPI PollSetTimeout( PKDPC Dpc,
+                                  PVOID DeferredContext,
+                                  PVOID SystemArgument1,
+                                  PVOID SystemArgument2 ) {
+    PAFD_POLL_SET PollSet = DeferredContext;
+    KIRQL OldIrql;
+
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(SystemArgument1);
+    UNREFERENCED_PARAMETER(SystemArgument2);
+
+    KeAcquireSpinLock( &PollSet->DeviceExt->Lock, &OldIrql );
+    if( PollSet->StaleTimeouts ) {
+        /* The wait this was armed for completed before it ran. The DPC
+         * was still queued if the current wait's timer fired meanwhile,
+         * so that one is only seen in the timer state */
+        PollSet->StaleTimeouts--;
+        if( PollSet->WaitIrp && PollSet->TimerArmed &&
+            KeReadStateTimer( &PollSet->Timer ) ) {
+            PollSet->TimerArmed = FALSE;
+            CompletePollSetWait( PollSet, 0, STATUS_TIMEOUT );
+        }
+    } else if( PollSet->WaitIrp ) {
+        PollSet->TimerArmed = FALSE;
+        CompletePollSetWait( PollSet, 0, STATUS_TIMEOUT );
+    }
+    KeReleaseSpinLock( &PollSet->DeviceExt->Lock, OldIrql );
+}
+
+NTSTATUS NTAPI
+AfdPollSetUpdate( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                  PIO_STACK_LOCATION IrpSp ) {
+    PAFD_DEVICE_EXTENSION DeviceExt = DeviceObject->DeviceExtension;
+    PAFD_FCB SetFCB = IrpSp->FileObject->FsContext;
+    PAFD_POLL_SET_INFO UpdateReq = Irp->AssociatedIrp.SystemBuffer;
+    ULONG Length = IrpSp->Parameters.DeviceIoControl.InputBufferLength;
+    PAFD_POLL_SET PollSet;
+    PAFD_POLL_SET_MEMBER Member, NewMember;
+    PFILE_OBJECT FileObject;
+    PAFD_FCB FCB;
+    KIRQL OldIrql;
+    NTSTATUS Status;
+    UINT i;
+
+    if( !SocketAcquireStateLock( SetFCB ) ) return LostSocket( Irp );
+
+    if( Length < FIELD_OFFSET(AFD_POLL_SET_INFO, Handles) ||
+        (Length - FIELD_OFFSET(AFD_POLL_SET_INFO, Handles)) / sizeof(AFD_HANDLE) <
+        UpdateReq->HandleCount ) {
+        return UnlockAndMaybeComplete( SetFCB, STATUS_INVALID_PARAMETER, Irp, 0 );
+    }
+
+    /* Any AFD handle can be a set, it becomes one when first filled */
+    PollSet = SetFCB->PollSet;
+    if( !PollSet ) {
+        PollSet = ExAllocatePoolWithTag( NonPagedPool,
+                                         sizeof(AFD_POLL_SET),
+                                         TAG_AFD_POLL_SET );
+        if( !PollSet )
+            return UnlockAndMaybeComplete( SetFCB, STATUS_NO_MEMORY, Irp, 0 );
+
+        InitializeListHead( &PollSet->Members );
+        InitializeListHead( &PollSet->ReadyList );
+        PollSet->WaitIrp = NULL;
+        PollSet->DeviceExt = DeviceExt;
+        PollSet->TimerArmed = FALSE;
+        PollSet->StaleTimeouts = 0;
+        KeInitializeTimerEx( &PollSet->Timer, NotificationTimer );
+        KeInitializeDpc( &PollSet->TimeoutDpc, PollSetTimeout, PollSet );
+
+        KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
+        SetFCB->PollSet = PollSet;
+        KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
+    }
+
+    AFD_DbgPrint(MID_TRACE,("Updating %u handles in set %p\n",
+                            UpdateReq->HandleCount, PollSet));
+
+    for( i = 0; i < UpdateReq->HandleCount; i++ ) {
+        Status = ObReferenceObjectByHandle( (HANDLE)UpdateReq->Handles[i].Handle,
+                                            0,
+                                            *IoFileObjectType,
+                                            Irp->RequestorMode,
+                                            (PVOID *)&FileObject,
+                                            NULL );
+        if( !NT_SUCCESS(Status) ) {
+            UpdateReq->Handles[i].Status = Status;
+            continue;
+        }
+
+        FCB = FileObject->FsContext;
+        if( FileObject->DeviceObject != DeviceObject || !FCB || FCB == SetFCB ) {
+            ObDereferenceObject( FileObject );
+            UpdateReq->Handles[i].Status = STATUS_INVALID_HANDLE;
+            continue;
+        }
+
+        /* Allocate up front, the lock can't be dropped for it */
+        NewMember = NULL;
+        if( UpdateReq->Handles[i].Events ) {
+            NewMember = ExAllocatePoolWithTag( NonPagedPool,
+                                               sizeof(AFD_POLL_SET_MEMBER),
+                                               TAG_AFD_POLL_SET );
+            if( !NewMember ) {
+                ObDereferenceObject( FileObject );
+                UpdateReq->Handles[i].Status = STATUS_NO_MEMORY;
+                continue;
+            }
+        }
+
+        KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
+
+        Member = FindPollSetMember( PollSet, FCB, UpdateReq->Handles[i].Handle );
+        if( !UpdateReq->Handles[i].Events ) {
+            if( Member ) DropPollSetMember( Member );
+        } else if( Member ) {
+            Member->Events = UpdateReq->Handles[i].Events;
+            QueuePollSetMember( Member, FCB );
+        } else {
+            /* The member keeps our reference */
+            NewMember->PollSet = PollSet;
+            NewMember->FileObject = FileObject;
+            NewMember->Handle = UpdateReq->Handles[i].Handle;
+            NewMember->Events = UpdateReq->Handles[i].Events;
+            NewMember->Ready = FALSE;
+            InsertTailList( &PollSet->Members, &NewMember->SetEntry );
+            InsertTailList( &FCB->PollSetMembers, &NewMember->SocketEntry );
+            QueuePollSetMember( NewMember, FCB );
+            NewMember = NULL;
+            FileObject = NULL;
+        }
+
+        KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
+
+        if( NewMember ) ExFreePoolWithTag( NewMember, TAG_AFD_POLL_SET );
+        if( FileObject ) ObDereferenceObject( FileObject );
+        UpdateReq->Handles[i].Status = STATUS_SUCCESS;
+    }
+
+    /* The per handle status goes back if there is room for it */
+    return UnlockAndMaybeComplete( SetFCB, STATUS_SUCCESS, Irp,
+                                   IrpSp->Parameters.DeviceIoControl.OutputBufferLength >= Length ?
+                                   Length : 0 );
+}
+
+NTSTATUS NTAPI
+AfdPollSetWait( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                PIO_STACK_LOCATION IrpSp ) {
+    PAFD_DEVICE_EXTENSION DeviceExt = DeviceObject->DeviceExtension;
+    PAFD_FCB SetFCB = IrpSp->FileObject->FsContext;
+    PAFD_POLL_INFO PollReq = Irp->AssociatedIrp.SystemBuffer;
+    ULONG Length = IrpSp->Parameters.DeviceIoControl.OutputBufferLength;
+    PAFD_POLL_SET PollSet;
+    KIRQL OldIrql;
+    UINT Count;
+
+    if( !SocketAcquireStateLock( SetFCB ) ) return LostSocket( Irp );
+
+    PollSet = SetFCB->PollSet;
+    if( !PollSet ||
+        IrpSp->Parameters.DeviceIoControl.InputBufferLength < FIELD_OFFSET(AFD_POLL_INFO, Handles) ||
+        Length < FIELD_OFFSET(AFD_POLL_INFO, Handles) ) {
+        return UnlockAndMaybeComplete( SetFCB, STATUS_INVALID_PARAMETER, Irp, 0 );
+    }
+
+    /* Never report more than the output buffer holds */
+    PollReq->HandleCount = min(PollReq->HandleCount,
+                               (Length - FIELD_OFFSET(AFD_POLL_INFO, Handles)) / sizeof(AFD_HANDLE));
+
+    KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
+
+    if( PollSet->WaitIrp ) {
+        KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
+        return UnlockAndMaybeComplete( SetFCB, STATUS_DEVICE_BUSY, Irp, 0 );
+    }
+
+    /* Only the queued members are looked at, however many there are */
+    Count = DrainPollSet( PollSet, PollReq, PollReq->HandleCount );
+    if( Count || !PollReq->Timeout.QuadPart || !PollReq->HandleCount ) {
+        KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
+        PollReq->HandleCount = Count;
+        return UnlockAndMaybeComplete( SetFCB, Count ? STATUS_SUCCESS : STATUS_TIMEOUT, Irp,
+                                       FIELD_OFFSET(AFD_POLL_INFO, Handles) +
+                                       sizeof(AFD_HANDLE) * Count );
+    }
+
+    PollSet->WaitIrp = Irp;
+    IoMarkIrpPending( Irp );
+    (void)IoSetCancelRoutine( Irp, AfdCancelHandler );
+    if( Irp->Cancel && IoSetCancelRoutine( Irp, NULL ) ) {
+        /* Cancelled before there was a cancel routine to see it */
+        CompletePollSetWait( PollSet, 0, STATUS_CANCELLED );
+    } else {
+        KeSetTimer( &PollSet->Timer, PollReq->Timeout, &PollSet->TimeoutDpc );
+        PollSet->TimerArmed = TRUE;
+    }
+
+    KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
+    SocketStateUnlock( SetFCB );
+
+    return STATUS_PENDING;
+}
+
+BOOLEAN CancelPollSetWait( PAFD_DEVICE_EXTENSION DeviceExt, PAFD_FCB FCB, PIRP Irp ) {
+    KIRQL OldIrql;
+    BOOLEAN Found = FALSE;
+
+    KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
+    if( FCB->PollSet && FCB->PollSet->WaitIrp == Irp ) {
+        CompletePollSetWait( FCB->PollSet, 0, STATUS_CANCELLED );
+        Found = TRUE;
+    }
+    KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
+
+    return Found;
+}
+
+VOID KillPollSetsForFCB( PAFD_DEVICE_EXTENSION DeviceExt, PAFD_FCB FCB ) {
+    PAFD_POLL_SET PollSet;
+    PAFD_POLL_SET_MEMBER Member;
+    KIRQL OldIrql;
+
+    KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
+
+    /* The socket leaves every set it is in */
+    while( !IsListEmpty( &FCB->PollSetMembers ) ) {
+        Member = CONTAINING_RECORD( FCB->PollSetMembers.Flink,
+                                    AFD_POLL_SET_MEMBER, SocketEntry );
+        DropPollSetMember( Member );
+    }
+
+    /* And if it is a set itself, its members go with it */
+    PollSet = FCB->PollSet;
+    FCB->PollSet = NULL;
+    if( PollSet ) {
+        if( PollSet->WaitIrp )
+            CompletePollSetWait( PollSet, 0, STATUS_CANCELLED );
+
+        while( !IsListEmpty( &PollSet->Members ) ) {
+            Member = CONTAINING_RECORD( PollSet->Members.Flink,
+                                        AFD_POLL_SET_MEMBER, SetEntry );
+            DropPollSetMember( Member );
+        }
+    }
+
+    KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
+
+    if( PollSet ) {
+        /* The timeout may have fired already */
+        KeFlushQueuedDpcs();
+        ExFreePoolWithTag( PollSet, TAG_AFD_POLL_SET );
+    }
+}
+
 /* * * NOTE ALWAYS CALLED AT DISPATCH_LEVEL * * */
 static BOOLEAN UpdatePollWithFCB( PAFD_ACTIVE_POLL Poll, PFILE_OBJECT FileObject ) {
     UINT i;
@@ -440,6 +822,9 @@ VOID PollReeval( PAFD_DEVICE_EXTENSION DeviceExt, PFILE_OBJECT FileObject ) {
             ThePollEnt = ThePollEnt->Flink;
     }
 
+    /* Queue it on the poll sets that want what it has now */
+    SignalPollSets( FCB );
+
     KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
 
     if((FCB->EventSelect) &&
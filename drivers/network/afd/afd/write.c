@@ -10,6 +10,26 @@
 
 #include "afd.h"
 
+static VOID AbortPendingSends( PAFD_FCB FCB, NTSTATUS Status ) {
+    PLIST_ENTRY NextIrpEntry;
+    PIRP NextIrp;
+    PIO_STACK_LOCATION NextIrpSp;
+    PAFD_SEND_INFO SendReq;
+
+    while( !IsListEmpty( &FCB->PendingIrpList[FUNCTION_SEND] ) ) {
+        NextIrpEntry = RemoveHeadList(&FCB->PendingIrpList[FUNCTION_SEND]);
+        NextIrp = CONTAINING_RECORD(NextIrpEntry, IRP, Tail.Overlay.ListEntry);
+        NextIrpSp = IoGetCurrentIrpStackLocation( NextIrp );
+        SendReq = GetLockedData(NextIrp, NextIrpSp);
+        NextIrp->IoStatus.Status = Status;
+        NextIrp->IoStatus.Information = 0;
+        UnlockBuffers(SendReq->BufferArray, SendReq->BufferCount, FALSE);
+        if( NextIrp->MdlAddress ) UnlockRequest( NextIrp, NextIrpSp );
+        (void)IoSetCancelRoutine(NextIrp, NULL);
+        IoCompleteRequest( NextIrp, IO_NETWORK_INCREMENT );
+    }
+}
+
 static IO_COMPLETION_ROUTINE SendComplete;
 static NTSTATUS NTAPI SendComplete
 ( PDEVICE_OBJECT DeviceObject,
@@ -50,18 +70,7 @@ static NTSTATUS NTAPI SendComplete
 
     if( FCB->State == SOCKET_STATE_CLOSED ) {
         /* Cleanup our IRP queue because the FCB is being destroyed */
-        while( !IsListEmpty( &FCB->PendingIrpList[FUNCTION_SEND] ) ) {
-            NextIrpEntry = RemoveHeadList(&FCB->PendingIrpList[FUNCTION_SEND]);
-            NextIrp = CONTAINING_RECORD(NextIrpEntry, IRP, Tail.Overlay.ListEntry);
-            NextIrpSp = IoGetCurrentIrpStackLocation( NextIrp );
-            SendReq = GetLockedData(NextIrp, NextIrpSp);
-            NextIrp->IoStatus.Status = STATUS_FILE_CLOSED;
-            NextIrp->IoStatus.Information = 0;
-            UnlockBuffers(SendReq->BufferArray, SendReq->BufferCount, FALSE);
-            if( NextIrp->MdlAddress ) UnlockRequest( NextIrp, IoGetCurrentIrpStackLocation( NextIrp ) );
-            (void)IoSetCancelRoutine(NextIrp, NULL);
-            IoCompleteRequest( NextIrp, IO_NETWORK_INCREMENT );
-        }
+        AbortPendingSends( FCB, STATUS_FILE_CLOSED );
 
         RetryDisconnectCompletion(FCB);
 
@@ -71,26 +80,7 @@ static NTSTATUS NTAPI SendComplete
 
     if( !NT_SUCCESS(Status) ) {
         /* Complete all following send IRPs with error */
-
-        while( !IsListEmpty( &FCB->PendingIrpList[FUNCTION_SEND] ) ) {
-            NextIrpEntry =
-                RemoveHeadList(&FCB->PendingIrpList[FUNCTION_SEND]);
-            NextIrp =
-                CONTAINING_RECORD(NextIrpEntry, IRP, Tail.Overlay.ListEntry);
-            NextIrpSp = IoGetCurrentIrpStackLocation( NextIrp );
-            SendReq = GetLockedData(NextIrp, NextIrpSp);
-
-            UnlockBuffers( SendReq->BufferArray,
-                           SendReq->BufferCount,
-                           FALSE );
-
-            NextIrp->IoStatus.Status = Status;
-            NextIrp->IoStatus.Information = 0;
-
-            if ( NextIrp->MdlAddress ) UnlockRequest( NextIrp, IoGetCurrentIrpStackLocation( NextIrp ) );
-            (void)IoSetCancelRoutine(NextIrp, NULL);
-            IoCompleteRequest( NextIrp, IO_NETWORK_INCREMENT );
-        }
+        AbortPendingSends( FCB, Status );
 
         RetryDisconnectCompletion(FCB);
 
@@ -257,6 +247,178 @@ static NTSTATUS NTAPI SendComplete
     return STATUS_SUCCESS;
 }
 
+static VOID CompleteDirectSend( PAFD_FCB FCB, NTSTATUS Status, UINT Information ) {
+    PIRP Irp = FCB->DirectSendIrp;
+    PIO_STACK_LOCATION IrpSp = IoGetCurrentIrpStackLocation( Irp );
+    PAFD_SEND_INFO SendReq = GetLockedData(Irp, IrpSp);
+
+    FCB->DirectSendIrp = NULL;
+
+    Irp->IoStatus.Status = Status;
+    Irp->IoStatus.Information = Information;
+    (void)IoSetCancelRoutine(Irp, NULL);
+    UnlockBuffers( SendReq->BufferArray, SendReq->BufferCount, FALSE );
+    if( Irp->MdlAddress ) UnlockRequest( Irp, IrpSp );
+    IoCompleteRequest( Irp, IO_NETWORK_INCREMENT );
+}
+
+static IO_COMPLETION_ROUTINE DirectSendComplete;
+static NTSTATUS NTAPI DirectSendComplete
+( PDEVICE_OBJECT DeviceObject,
+  PIRP Irp,
+  PVOID Context ) {
+    NTSTATUS Status = Irp->IoStatus.Status;
+    PAFD_FCB FCB = (PAFD_FCB)Context;
+    PIRP UserIrp;
+    PAFD_SEND_INFO SendReq;
+    PAFD_MAPBUF Map;
+    PMDL Mdl;
+    PCHAR Remainder;
+    UINT BytesSent, SendLength;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    AFD_DbgPrint(MID_TRACE,("Called, status %x, %u bytes used\n",
+                            Irp->IoStatus.Status,
+                            Irp->IoStatus.Information));
+
+    /* The pages belong to the user request, only a partial MDL is ours */
+    Mdl = Irp->MdlAddress;
+    Irp->MdlAddress = NULL;
+    if( Mdl->MdlFlags & MDL_PARTIAL ) {
+        MmPrepareMdlForReuse( Mdl );
+        IoFreeMdl( Mdl );
+    }
+
+    if( !SocketAcquireStateLock( FCB ) )
+        return STATUS_FILE_CLOSED;
+
+    ASSERT(FCB->SendIrp.InFlightRequest == Irp);
+    FCB->SendIrp.InFlightRequest = NULL;
+    /* Request is not in flight any longer */
+
+    UserIrp = FCB->DirectSendIrp;
+    ASSERT(UserIrp);
+    SendReq = GetLockedData(UserIrp, IoGetCurrentIrpStackLocation(UserIrp));
+    Map = (PAFD_MAPBUF)(SendReq->BufferArray + SendReq->BufferCount);
+
+    BytesSent = (UINT)(ULONG_PTR)UserIrp->Tail.Overlay.DriverContext[3];
+    if( NT_SUCCESS(Status) )
+        BytesSent += Irp->IoStatus.Information;
+    SendLength = SendReq->BufferArray[0].len;
+
+    if( FCB->State == SOCKET_STATE_CLOSED ) {
+        CompleteDirectSend( FCB, STATUS_FILE_CLOSED, 0 );
+        AbortPendingSends( FCB, STATUS_FILE_CLOSED );
+
+        RetryDisconnectCompletion(FCB);
+
+        SocketStateUnlock( FCB );
+        return STATUS_FILE_CLOSED;
+    }
+
+    /* The transport takes what fits in its buffers, give it the rest */
+    if( NT_SUCCESS(Status) && Irp->IoStatus.Information &&
+        BytesSent < SendLength && !UserIrp->Cancel ) {
+        Remainder = (PCHAR)MmGetMdlVirtualAddress( Map[0].Mdl ) + BytesSent;
+        Mdl = IoAllocateMdl( Remainder, SendLength - BytesSent,
+                             FALSE, FALSE, NULL );
+        if( Mdl ) {
+            IoBuildPartialMdl( Map[0].Mdl, Mdl, Remainder, SendLength - BytesSent );
+            UserIrp->Tail.Overlay.DriverContext[3] = (PVOID)(ULONG_PTR)BytesSent;
+
+            if( TdiSendMdl( &FCB->SendIrp.InFlightRequest,
+                            FCB->Connection.Object,
+                            0,
+                            Mdl,
+                            SendLength - BytesSent,
+                            DirectSendComplete,
+                            FCB ) == STATUS_PENDING ) {
+                SocketStateUnlock( FCB );
+                return STATUS_SUCCESS;
+            }
+
+            IoFreeMdl( Mdl );
+        }
+    }
+
+    /* What the transport took counts, like a partial copy into the window */
+    CompleteDirectSend( FCB, BytesSent ? STATUS_SUCCESS : Status, BytesSent );
+
+    if( !NT_SUCCESS(Status) ) {
+        /* Complete all following send IRPs with error */
+        AbortPendingSends( FCB, Status );
+
+        RetryDisconnectCompletion(FCB);
+
+        SocketStateUnlock( FCB );
+
+        return STATUS_SUCCESS;
+    }
+
+    if (FCB->Send.Size - FCB->Send.BytesUsed != 0 && !FCB->SendClosed &&
+        IsListEmpty(&FCB->PendingIrpList[FUNCTION_SEND]))
+    {
+        FCB->PollState |= AFD_EVENT_SEND;
+        FCB->PollStatus[FD_WRITE_BIT] = STATUS_SUCCESS;
+        PollReeval( FCB->DeviceExt, FCB->FileObject );
+    }
+
+    /* Sends copied into the window behind this one go now */
+    if( FCB->Send.BytesUsed )
+    {
+        TdiSend( &FCB->SendIrp.InFlightRequest,
+                 FCB->Connection.Object,
+                 0,
+                 FCB->Send.Window,
+                 FCB->Send.BytesUsed,
+                 SendComplete,
+                 FCB );
+    }
+    else
+    {
+        /* Nothing is waiting so try to complete a pending disconnect */
+        RetryDisconnectCompletion(FCB);
+    }
+
+    SocketStateUnlock( FCB );
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS StartDirectSend( PAFD_FCB FCB, PIRP Irp, PAFD_SEND_INFO SendReq ) {
+    PAFD_MAPBUF Map = (PAFD_MAPBUF)(SendReq->BufferArray + SendReq->BufferCount);
+    NTSTATUS Status;
+
+    AFD_DbgPrint(MID_TRACE,("Sending %u bytes straight from the user buffer\n",
+                            SendReq->BufferArray[0].len));
+
+    /* We use the IRP tail for the bytes the transport took so far */
+    Irp->Tail.Overlay.DriverContext[3] = 0;
+
+    Status = QueueUserModeIrp(FCB, Irp, FUNCTION_SEND);
+    if (Status == STATUS_PENDING)
+    {
+        /* Nothing else touches the IRP while the transport has its pages */
+        RemoveEntryList(&Irp->Tail.Overlay.ListEntry);
+        FCB->DirectSendIrp = Irp;
+
+        Status = TdiSendMdl(&FCB->SendIrp.InFlightRequest,
+                            FCB->Connection.Object,
+                            0,
+                            Map[0].Mdl,
+                            SendReq->BufferArray[0].len,
+                            DirectSendComplete,
+                            FCB);
+        if (Status != STATUS_PENDING)
+            CompleteDirectSend(FCB, Status, 0);
+    }
+
+    SocketStateUnlock(FCB);
+
+    return STATUS_PENDING;
+}
+
 static IO_COMPLETION_ROUTINE PacketSocketSendComplete;
 static NTSTATUS NTAPI PacketSocketSendComplete
 ( PDEVICE_OBJECT DeviceObject,
@@ -472,6 +634,19 @@ AfdConnectedSocketWriteData(PDEVICE_OBJECT DeviceObject, PIRP Irp,
         SendLength += SendReq->BufferArray[i].len;
     }
 
+    /* A large send that has nothing queued ahead of it is handed to the
+     * transport in the user's own pages, if the caller can wait for it */
+    if (SendLength >= AFD_DIRECT_TRANSFER_SIZE &&
+        SendReq->BufferCount == 1 &&
+        FCB->Send.BytesUsed == 0 &&
+        !FCB->SendIrp.InFlightRequest &&
+        IsListEmpty(&FCB->PendingIrpList[FUNCTION_SEND]) &&
+        ((SendReq->AfdFlags & AFD_OVERLAPPED) ||
+         !((SendReq->AfdFlags & AFD_IMMEDIATE) || (FCB->NonBlocking))))
+    {
+        return StartDirectSend(FCB, Irp, SendReq);
+    }
+
     /* Make sure we've got the space */
     if (SendLength > SpaceAvail)
     {
@@ -47,6 +47,7 @@
 #define TAG_AFD_POLL_HANDLE                'hpfA'
 #define TAG_AFD_FCB                        'cffA'
 #define TAG_AFD_ACTIVE_POLL                'pafA'
+#define TAG_AFD_POLL_SET                   'spfA'
 #define TAG_AFD_EA_INFO                    'aefA'
 #define TAG_AFD_STORED_DATAGRAM            'gsfA'
 #define TAG_AFD_SNMP_ADDRESS_INFO          'asfA'
@@ -96,6 +97,11 @@ typedef struct IPADDR_ENTRY {
 					   * for ancillary data on packet
 					   * requests. */
 
+#define AFD_DIRECT_TRANSFER_SIZE        0x10000 /* Stream requests this large
+                                                 * go between the user's pages
+                                                 * and the transport without
+                                                 * a copy through the window. */
+
 /* XXX This is a hack we should clean up later
  * We do this in order to get some storage for the locked handle table
  * Maybe I'll use some tail item in the irp instead */
@@ -123,6 +129,31 @@ typedef struct _AFD_ACTIVE_POLL {
     BOOLEAN Exclusive;
 } AFD_ACTIVE_POLL, *PAFD_ACTIVE_POLL;
 
+/* A registered set of sockets. Members are queued on ReadyList as their
+ * state changes, so a wait doesn't look at the idle ones. Everything here
+ * is protected by the device extension lock. */
+typedef struct _AFD_POLL_SET {
+    LIST_ENTRY Members;
+    LIST_ENTRY ReadyList;
+    PIRP WaitIrp;
+    PAFD_DEVICE_EXTENSION DeviceExt;
+    KDPC TimeoutDpc;
+    KTIMER Timer;
+    BOOLEAN TimerArmed;
+    UINT StaleTimeouts;
+} AFD_POLL_SET, *PAFD_POLL_SET;
+
+typedef struct _AFD_POLL_SET_MEMBER {
+    LIST_ENTRY SetEntry;
+    LIST_ENTRY SocketEntry;
+    LIST_ENTRY ReadyEntry;
+    BOOLEAN Ready;
+    PAFD_POLL_SET PollSet;
+    PFILE_OBJECT FileObject;
+    SOCKET Handle;
+    ULONG Events;
+} AFD_POLL_SET_MEMBER, *PAFD_POLL_SET_MEMBER;
+
 typedef struct _IRP_LIST {
     LIST_ENTRY ListEntry;
     PIRP Irp;
@@ -176,6 +207,7 @@ typedef struct _AFD_FCB {
     AFD_TDI_OBJECT AddressFile, Connection;
     AFD_IN_FLIGHT_REQUEST ConnectIrp, ListenIrp, ReceiveIrp, SendIrp, DisconnectIrp;
     AFD_DATA_WINDOW Send, Recv;
+    PIRP DirectSendIrp, DirectRecvIrp;
     KMUTEX Mutex;
     PKEVENT EventSelect;
     DWORD EventSelectTriggers;
@@ -201,6 +233,8 @@ typedef struct _AFD_FCB {
     LIST_ENTRY PendingIrpList[MAX_FUNCTIONS];
     LIST_ENTRY DatagramList;
     LIST_ENTRY PendingConnections;
+    PAFD_POLL_SET PollSet;
+    LIST_ENTRY PollSetMembers;
 } AFD_FCB, *PAFD_FCB;
 
 /* bind.c */
@@ -328,6 +362,14 @@ AfdEventSelect( PDEVICE_OBJECT DeviceObject, PIRP Irp,
 NTSTATUS NTAPI
 AfdEnumEvents( PDEVICE_OBJECT DeviceObject, PIRP Irp,
 	       PIO_STACK_LOCATION IrpSp );
+NTSTATUS NTAPI
+AfdPollSetUpdate( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                  PIO_STACK_LOCATION IrpSp );
+NTSTATUS NTAPI
+AfdPollSetWait( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                PIO_STACK_LOCATION IrpSp );
+BOOLEAN CancelPollSetWait( PAFD_DEVICE_EXTENSION DeviceExt, PAFD_FCB FCB, PIRP Irp );
+VOID KillPollSetsForFCB( PAFD_DEVICE_EXTENSION DeviceExt, PAFD_FCB FCB );
 VOID PollReeval( PAFD_DEVICE_EXTENSION DeviceObject, PFILE_OBJECT FileObject );
 VOID KillSelectsForFCB( PAFD_DEVICE_EXTENSION DeviceExt,
                         PFILE_OBJECT FileObject, BOOLEAN ExclusiveOnly );
@@ -379,6 +421,24 @@ NTSTATUS TdiSend
   PIO_COMPLETION_ROUTINE  CompletionRoutine,
   PVOID CompletionContext);
 
+NTSTATUS TdiReceiveMdl
+( PIRP *Irp,
+  PFILE_OBJECT ConnectionObject,
+  USHORT Flags,
+  PMDL Mdl,
+  UINT BufferLength,
+  PIO_COMPLETION_ROUTINE  CompletionRoutine,
+  PVOID CompletionContext);
+
+NTSTATUS TdiSendMdl
+( PIRP *Irp,
+  PFILE_OBJECT ConnectionObject,
+  USHORT Flags,
+  PMDL Mdl,
+  UINT BufferLength,
+  PIO_COMPLETION_ROUTINE  CompletionRoutine,
+  PVOID CompletionContext);
+
 NTSTATUS TdiReceiveDatagram(
     PIRP *Irp,
     PFILE_OBJECT TransportObject,
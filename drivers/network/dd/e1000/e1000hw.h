@@ -34,6 +34,19 @@ typedef struct _ETH_HEADER {
 C_ASSERT(sizeof(ETH_HEADER) == 14);
 
 
+/* What the offloads need to know of IPv4 and TCP headers */
+#define IPV4_HEADER_MINIMUM_SIZE    20
+#define IPV4_HEADER_MAXIMUM_SIZE    60
+#define IPV4_HEADER_CHECKSUM        10
+#define IPV4_HEADER_LENGTH(VerIHL)  (((VerIHL) & 0x0F) << 2)
+
+#define TCP_HEADER_MINIMUM_SIZE     20
+#define TCP_HEADER_MAXIMUM_SIZE     60
+#define TCP_HEADER_DATA_OFFSET      12
+#define TCP_HEADER_CHECKSUM         16
+#define TCP_HEADER_LENGTH(Offset)   (((Offset) >> 4) << 2)
+
+
 typedef enum _E1000_RCVBUF_SIZE
 {
     E1000_RCVBUF_2048 = 0,
@@ -57,10 +70,15 @@ typedef enum _E1000_RCVBUF_SIZE
 /* 3.2.3 Receive Descriptor Format */
 
 #define E1000_RDESC_STATUS_PIF          (1 << 7)    /* Passed in-exact filter */
+#define E1000_RDESC_STATUS_IPCS         (1 << 6)    /* IP Checksum Calculated on Packet */
+#define E1000_RDESC_STATUS_TCPCS        (1 << 5)    /* TCP Checksum Calculated on Packet */
 #define E1000_RDESC_STATUS_IXSM         (1 << 2)    /* Ignore Checksum Indication */
 #define E1000_RDESC_STATUS_EOP          (1 << 1)    /* End of Packet */
 #define E1000_RDESC_STATUS_DD           (1 << 0)    /* Descriptor Done */
 
+#define E1000_RDESC_ERR_IPE             (1 << 6)    /* IP Checksum Error */
+#define E1000_RDESC_ERR_TCPE            (1 << 5)    /* TCP/UDP Checksum Error */
+
 typedef struct _E1000_RECEIVE_DESCRIPTOR
 {
     UINT64 Address;
@@ -96,11 +114,66 @@ typedef struct _E1000_TRANSMIT_DESCRIPTOR
 
 } E1000_TRANSMIT_DESCRIPTOR, *PE1000_TRANSMIT_DESCRIPTOR;
 
+
+/* 3.3.6 TCP/IP Context Transmit Descriptor Format */
+
+#define E1000_TCTXD_CMD_IDE             (1UL << 31) /* Interrupt Delay Enable */
+#define E1000_TCTXD_CMD_DEXT            (1 << 29)   /* Descriptor Extension */
+#define E1000_TCTXD_CMD_RS              (1 << 27)   /* Report Status */
+#define E1000_TCTXD_CMD_TSE             (1 << 26)   /* TCP Segmentation Enable */
+#define E1000_TCTXD_CMD_IP              (1 << 25)   /* Packet Type is IPv4 */
+#define E1000_TCTXD_CMD_TCP             (1 << 24)   /* Packet Type is TCP */
+#define E1000_TCTXD_DTYP                (0 << 20)   /* Descriptor Type */
+#define E1000_TCTXD_PAYLEN_MASK         0xFFFFF     /* TCP Payload Length */
+
+typedef struct _E1000_CONTEXT_DESCRIPTOR
+{
+    UCHAR IpChecksumStart;
+    UCHAR IpChecksumOffset;
+    USHORT IpChecksumEnd;
+    UCHAR TcpChecksumStart;
+    UCHAR TcpChecksumOffset;
+    USHORT TcpChecksumEnd;
+
+    ULONG CommandLength;
+    UCHAR Status;
+    UCHAR HeaderLength;
+    USHORT MaximumSegmentSize;
+
+} E1000_CONTEXT_DESCRIPTOR, *PE1000_CONTEXT_DESCRIPTOR;
+
+
+/* 3.3.7 TCP/IP Data Descriptor Format */
+
+#define E1000_TDATD_CMD_IDE             (1UL << 31) /* Interrupt Delay Enable */
+#define E1000_TDATD_CMD_DEXT            (1 << 29)   /* Descriptor Extension */
+#define E1000_TDATD_CMD_RS              (1 << 27)   /* Report Status */
+#define E1000_TDATD_CMD_TSE             (1 << 26)   /* TCP Segmentation Enable */
+#define E1000_TDATD_CMD_IFCS            (1 << 25)   /* Insert FCS */
+#define E1000_TDATD_CMD_EOP             (1 << 24)   /* End Of Packet */
+#define E1000_TDATD_DTYP                (1 << 20)   /* Descriptor Type */
+
+#define E1000_TDATD_POPTS_IXSM          (1 << 0)    /* Insert IP Checksum */
+#define E1000_TDATD_POPTS_TXSM          (1 << 1)    /* Insert TCP/UDP Checksum */
+
+typedef struct _E1000_DATA_DESCRIPTOR
+{
+    UINT64 Address;
+
+    ULONG CommandLength;
+    UCHAR Status;
+    UCHAR Options;
+    USHORT Special;
+
+} E1000_DATA_DESCRIPTOR, *PE1000_DATA_DESCRIPTOR;
+
 #include <poppack.h>
 
 
 C_ASSERT(sizeof(E1000_RECEIVE_DESCRIPTOR) == 16);
 C_ASSERT(sizeof(E1000_TRANSMIT_DESCRIPTOR) == 16);
+C_ASSERT(sizeof(E1000_CONTEXT_DESCRIPTOR) == 16);
+C_ASSERT(sizeof(E1000_DATA_DESCRIPTOR) == 16);
 
 
 /* Valid Range: 80-256 for 82542 and 82543 gigabit ethernet controllers
@@ -143,6 +216,8 @@ C_ASSERT(sizeof(E1000_TRANSMIT_DESCRIPTOR) == 16);
 #define E1000_REG_TADV              0x382C      /* Transmit Absolute Delay Timer, R/W */
 
 
+#define E1000_REG_RXCSUM            0x5000      /* Receive Checksum Control, R/W */
+
 #define E1000_REG_RAL               0x5400      /* Receive Address Low, R/W */
 #define E1000_REG_RAH               0x5404      /* Receive Address High, R/W */
 
@@ -217,6 +292,11 @@ C_ASSERT(sizeof(E1000_TRANSMIT_DESCRIPTOR) == 16);
 #define E1000_TIPG_IPGR2_DEF        (10 << 20)  /* IPG Receive Time 2 */
 
 
+/* E1000_REG_RXCSUM */
+#define E1000_RXCSUM_IPOFL          (1 << 8)    /* IP Checksum Off-load Enable */
+#define E1000_RXCSUM_TUOFL          (1 << 9)    /* TCP/UDP Checksum Off-load Enable */
+
+
 /* E1000_REG_RAH */
 #define E1000_RAH_AV                (1 << 31)   /* Address Valid */
 
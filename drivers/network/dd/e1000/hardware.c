@@ -227,6 +227,9 @@ NICRecognizeHardware(
     {
         if (SupportedDevices[n] == Adapter->DeviceID)
         {
+            /* The 82542 offloads nothing, the 82543 can't segment TCP */
+            Adapter->ChecksumCapable = (Adapter->DeviceID != 0x1000);
+            Adapter->LargeSendCapable = (Adapter->DeviceID > 0x1004);
             return TRUE;
         }
     }
@@ -384,6 +387,49 @@ NICAllocateIoResources(
         Descriptor->Address = Adapter->ReceiveBufferPa.QuadPart + n * Adapter->ReceiveBufferEntrySize;
     }
 
+    NdisAllocatePacketPool(&Status,
+                           &Adapter->ReceivePacketPool,
+                           NUM_RECEIVE_DESCRIPTORS,
+                           PROTOCOL_RESERVED_SIZE_IN_PACKET);
+    if (Status != NDIS_STATUS_SUCCESS)
+    {
+        NDIS_DbgPrint(MIN_TRACE, ("Unable to allocate receive packet pool\n"));
+        return NDIS_STATUS_RESOURCES;
+    }
+
+    NdisAllocateBufferPool(&Status, &Adapter->ReceiveBufferPool, NUM_RECEIVE_DESCRIPTORS);
+    if (Status != NDIS_STATUS_SUCCESS)
+    {
+        NDIS_DbgPrint(MIN_TRACE, ("Unable to allocate receive buffer pool\n"));
+        return NDIS_STATUS_RESOURCES;
+    }
+
+    for (n = 0; n < NUM_RECEIVE_DESCRIPTORS; ++n)
+    {
+        PNDIS_BUFFER Buffer;
+
+        NdisAllocatePacket(&Status, &Adapter->ReceivePackets[n], Adapter->ReceivePacketPool);
+        if (Status != NDIS_STATUS_SUCCESS)
+        {
+            NDIS_DbgPrint(MIN_TRACE, ("Unable to allocate receive packet\n"));
+            return NDIS_STATUS_RESOURCES;
+        }
+
+        NdisAllocateBuffer(&Status,
+                           &Buffer,
+                           Adapter->ReceiveBufferPool,
+                           (PVOID)(Adapter->ReceiveBuffer + n * Adapter->ReceiveBufferEntrySize),
+                           Adapter->ReceiveBufferEntrySize);
+        if (Status != NDIS_STATUS_SUCCESS)
+        {
+            NDIS_DbgPrint(MIN_TRACE, ("Unable to allocate receive buffer\n"));
+            return NDIS_STATUS_RESOURCES;
+        }
+
+        NdisChainBufferAtFront(Adapter->ReceivePackets[n], Buffer);
+        NDIS_SET_PACKET_HEADER_SIZE(Adapter->ReceivePackets[n], sizeof(ETH_HEADER));
+    }
+
     return NDIS_STATUS_SUCCESS;
 }
 
@@ -433,8 +479,37 @@ NTAPI
 NICReleaseIoResources(
     IN PE1000_ADAPTER Adapter)
 {
+    UINT n;
+
     NDIS_DbgPrint(MAX_TRACE, ("Called.\n"));
 
+    for (n = 0; n < NUM_RECEIVE_DESCRIPTORS; ++n)
+    {
+        PNDIS_BUFFER Buffer;
+
+        if (Adapter->ReceivePackets[n] == NULL)
+            continue;
+
+        NdisUnchainBufferAtFront(Adapter->ReceivePackets[n], &Buffer);
+        if (Buffer != NULL)
+            NdisFreeBuffer(Buffer);
+
+        NdisFreePacket(Adapter->ReceivePackets[n]);
+        Adapter->ReceivePackets[n] = NULL;
+    }
+
+    if (Adapter->ReceiveBufferPool != NULL)
+    {
+        NdisFreeBufferPool(Adapter->ReceiveBufferPool);
+        Adapter->ReceiveBufferPool = NULL;
+    }
+
+    if (Adapter->ReceivePacketPool != NULL)
+    {
+        NdisFreePacketPool(Adapter->ReceivePacketPool);
+        Adapter->ReceivePacketPool = NULL;
+    }
+
     if (Adapter->ReceiveDescriptors != NULL)
     {
         /* Disassociate our shared buffer before freeing it to avoid NIC-induced memory corruption */
@@ -631,6 +706,8 @@ NICEnableTxRx(
     /* Add our current packet filter */
     Value |= PacketFilterToMask(Adapter->PacketFilter);
 
+    NICApplyReceiveChecksum(Adapter);
+
     E1000WriteUlong(Adapter, E1000_REG_RCTL, Value);
 
     return NDIS_STATUS_SUCCESS;
@@ -735,6 +812,21 @@ NICApplyPacketFilter(
     return NDIS_STATUS_SUCCESS;
 }
 
+VOID
+NTAPI
+NICApplyReceiveChecksum(
+    IN PE1000_ADAPTER Adapter)
+{
+    ULONG Value = 0;
+
+    if (Adapter->Offload.ReceiveIpChecksum)
+        Value |= E1000_RXCSUM_IPOFL;
+    if (Adapter->Offload.ReceiveTcpChecksum)
+        Value |= E1000_RXCSUM_TUOFL;
+
+    E1000WriteUlong(Adapter, E1000_REG_RXCSUM, Value);
+}
+
 VOID
 NTAPI
 NICUpdateLinkStatus(
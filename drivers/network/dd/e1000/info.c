@@ -46,6 +46,9 @@ static NDIS_OID SupportedOidList[] =
     OID_GEN_RCV_NO_BUFFER,
 
     OID_PNP_CAPABILITIES,
+
+    /* Offload */
+    OID_TCP_TASK_OFFLOAD,
 };
 
 static
@@ -68,6 +71,210 @@ NICFillPowerManagementCapabilities(
     return NDIS_STATUS_NOT_SUPPORTED;
 }
 
+static
+NDIS_STATUS
+NICGetTcpTaskOffload(
+    _In_ PE1000_ADAPTER Adapter,
+    _In_ PNDIS_TASK_OFFLOAD_HEADER TaskOffloadHeader,
+    _In_ ULONG InformationBufferLength,
+    _Out_ PULONG BytesWritten,
+    _Out_ PULONG BytesNeeded)
+{
+    ULONG InfoLength;
+    PNDIS_TASK_OFFLOAD TaskOffload;
+    PNDIS_TASK_TCP_IP_CHECKSUM ChecksumTask;
+    PNDIS_TASK_TCP_LARGE_SEND LargeSendTask;
+
+    if (!Adapter->ChecksumCapable)
+    {
+        *BytesWritten = 0;
+        *BytesNeeded = 0;
+        return NDIS_STATUS_NOT_SUPPORTED;
+    }
+
+    InfoLength = sizeof(NDIS_TASK_OFFLOAD_HEADER) +
+                 FIELD_OFFSET(NDIS_TASK_OFFLOAD, TaskBuffer) +
+                 sizeof(NDIS_TASK_TCP_IP_CHECKSUM);
+    if (Adapter->LargeSendCapable)
+    {
+        InfoLength += FIELD_OFFSET(NDIS_TASK_OFFLOAD, TaskBuffer) +
+                      sizeof(NDIS_TASK_TCP_LARGE_SEND);
+    }
+
+    if (InformationBufferLength < InfoLength)
+    {
+        *BytesWritten = 0;
+        *BytesNeeded = InfoLength;
+        return NDIS_STATUS_BUFFER_TOO_SHORT;
+    }
+
+    if ((TaskOffloadHeader->EncapsulationFormat.Encapsulation != IEEE_802_3_Encapsulation) &&
+        (TaskOffloadHeader->EncapsulationFormat.Encapsulation != UNSPECIFIED_Encapsulation ||
+         TaskOffloadHeader->EncapsulationFormat.EncapsulationHeaderSize != sizeof(ETH_HEADER)))
+    {
+        *BytesWritten = 0;
+        *BytesNeeded = 0;
+        return NDIS_STATUS_NOT_SUPPORTED;
+    }
+    if (TaskOffloadHeader->Version != NDIS_TASK_OFFLOAD_VERSION)
+    {
+        *BytesWritten = 0;
+        *BytesNeeded = 0;
+        return NDIS_STATUS_NOT_SUPPORTED;
+    }
+
+    TaskOffloadHeader->OffsetFirstTask = sizeof(NDIS_TASK_OFFLOAD_HEADER);
+    TaskOffload = (PNDIS_TASK_OFFLOAD)(TaskOffloadHeader + 1);
+
+    TaskOffload->Size = sizeof(NDIS_TASK_OFFLOAD);
+    TaskOffload->Version = NDIS_TASK_OFFLOAD_VERSION;
+    TaskOffload->Task = TcpIpChecksumNdisTask;
+    TaskOffload->TaskBufferLength = sizeof(NDIS_TASK_TCP_IP_CHECKSUM);
+    TaskOffload->OffsetNextTask = 0;
+
+    ChecksumTask = (PNDIS_TASK_TCP_IP_CHECKSUM)TaskOffload->TaskBuffer;
+    NdisZeroMemory(ChecksumTask, sizeof(*ChecksumTask));
+
+    /* UDP would work as well, but the stack doesn't ask for it */
+    ChecksumTask->V4Transmit.IpOptionsSupported = 1;
+    ChecksumTask->V4Transmit.TcpOptionsSupported = 1;
+    ChecksumTask->V4Transmit.TcpChecksum = 1;
+    ChecksumTask->V4Transmit.IpChecksum = 1;
+
+    ChecksumTask->V4Receive.IpOptionsSupported = 1;
+    ChecksumTask->V4Receive.TcpOptionsSupported = 1;
+    ChecksumTask->V4Receive.TcpChecksum = 1;
+    ChecksumTask->V4Receive.IpChecksum = 1;
+
+    if (Adapter->LargeSendCapable)
+    {
+        TaskOffload->OffsetNextTask = FIELD_OFFSET(NDIS_TASK_OFFLOAD, TaskBuffer) +
+                                      sizeof(NDIS_TASK_TCP_IP_CHECKSUM);
+        TaskOffload = (PNDIS_TASK_OFFLOAD)(ChecksumTask + 1);
+
+        TaskOffload->Size = sizeof(NDIS_TASK_OFFLOAD);
+        TaskOffload->Version = NDIS_TASK_OFFLOAD_VERSION;
+        TaskOffload->Task = TcpLargeSendNdisTask;
+        TaskOffload->TaskBufferLength = sizeof(NDIS_TASK_TCP_LARGE_SEND);
+        TaskOffload->OffsetNextTask = 0;
+
+        LargeSendTask = (PNDIS_TASK_TCP_LARGE_SEND)TaskOffload->TaskBuffer;
+        LargeSendTask->Version = NDIS_TASK_TCP_LARGE_SEND_V0;
+        LargeSendTask->MinSegmentCount = MINIMUM_LSO_SEGMENT_COUNT;
+        LargeSendTask->MaxOffLoadSize = MAXIMUM_LSO_FRAME_SIZE;
+        LargeSendTask->IpOptions = TRUE;
+        LargeSendTask->TcpOptions = TRUE;
+    }
+
+    *BytesWritten = InfoLength;
+    *BytesNeeded = 0;
+
+    return NDIS_STATUS_SUCCESS;
+}
+
+static
+NDIS_STATUS
+NICSetTcpTaskOffload(
+    _Inout_ PE1000_ADAPTER Adapter,
+    _In_ PNDIS_TASK_OFFLOAD_HEADER TaskOffloadHeader,
+    _In_ ULONG InformationBufferLength)
+{
+    ULONG Offset, Position, Remaining;
+    PNDIS_TASK_OFFLOAD TaskOffload;
+    E1000_OFFLOAD Offload;
+
+    if (TaskOffloadHeader->Version != NDIS_TASK_OFFLOAD_VERSION)
+    {
+        return NDIS_STATUS_NOT_SUPPORTED;
+    }
+
+    if ((TaskOffloadHeader->EncapsulationFormat.Encapsulation != IEEE_802_3_Encapsulation) &&
+        (TaskOffloadHeader->EncapsulationFormat.Encapsulation != UNSPECIFIED_Encapsulation ||
+         TaskOffloadHeader->EncapsulationFormat.EncapsulationHeaderSize != sizeof(ETH_HEADER)))
+    {
+        return NDIS_STATUS_NOT_SUPPORTED;
+    }
+
+    /* Whatever isn't in the list is turned off. Nothing changes until the
+     * whole request checked out, a rejected one keeps the current offloads. */
+    NdisZeroMemory(&Offload, sizeof(Offload));
+
+    /* The first offset is from the header, the others from the previous task */
+    Position = 0;
+    Offset = TaskOffloadHeader->OffsetFirstTask;
+
+    while (Offset)
+    {
+        /* Each task header and its buffer must be within the information buffer */
+        if (Offset >= InformationBufferLength - Position)
+            return NDIS_STATUS_INVALID_LENGTH;
+        Position += Offset;
+        Remaining = InformationBufferLength - Position;
+
+        if (Remaining < FIELD_OFFSET(NDIS_TASK_OFFLOAD, TaskBuffer))
+            return NDIS_STATUS_INVALID_LENGTH;
+
+        TaskOffload = (PNDIS_TASK_OFFLOAD)((PUCHAR)TaskOffloadHeader + Position);
+        if (TaskOffload->TaskBufferLength > Remaining - FIELD_OFFSET(NDIS_TASK_OFFLOAD, TaskBuffer))
+            return NDIS_STATUS_INVALID_LENGTH;
+
+        switch (TaskOffload->Task)
+        {
+            case TcpIpChecksumNdisTask:
+            {
+                PNDIS_TASK_TCP_IP_CHECKSUM Task;
+
+                if (!Adapter->ChecksumCapable ||
+                    TaskOffload->TaskBufferLength < sizeof(NDIS_TASK_TCP_IP_CHECKSUM))
+                {
+                    return NDIS_STATUS_NOT_SUPPORTED;
+                }
+
+                Task = (PNDIS_TASK_TCP_IP_CHECKSUM)TaskOffload->TaskBuffer;
+
+                Offload.SendTcpChecksum = !!Task->V4Transmit.TcpChecksum;
+                Offload.SendIpChecksum = !!Task->V4Transmit.IpChecksum;
+
+                Offload.ReceiveTcpChecksum = !!Task->V4Receive.TcpChecksum;
+                Offload.ReceiveIpChecksum = !!Task->V4Receive.IpChecksum;
+                break;
+            }
+
+            case TcpLargeSendNdisTask:
+            {
+                PNDIS_TASK_TCP_LARGE_SEND Task;
+
+                if (!Adapter->LargeSendCapable ||
+                    TaskOffload->TaskBufferLength < sizeof(NDIS_TASK_TCP_LARGE_SEND))
+                {
+                    return NDIS_STATUS_NOT_SUPPORTED;
+                }
+
+                Task = (PNDIS_TASK_TCP_LARGE_SEND)TaskOffload->TaskBuffer;
+
+                if (Task->MinSegmentCount < MINIMUM_LSO_SEGMENT_COUNT)
+                    return NDIS_STATUS_NOT_SUPPORTED;
+
+                if (Task->MaxOffLoadSize > MAXIMUM_LSO_FRAME_SIZE)
+                    return NDIS_STATUS_NOT_SUPPORTED;
+
+                Offload.LargeSend = TRUE;
+                break;
+            }
+
+            default:
+                break;
+        }
+
+        Offset = TaskOffload->OffsetNextTask;
+    }
+
+    Adapter->Offload = Offload;
+    NICApplyReceiveChecksum(Adapter);
+
+    return NDIS_STATUS_SUCCESS;
+}
+
 NDIS_STATUS
 NTAPI
 MiniportQueryInformation(
@@ -239,6 +446,22 @@ MiniportQueryInformation(
         break;
     }
 
+    case OID_TCP_TASK_OFFLOAD:
+    {
+        if (InformationBufferLength < sizeof(NDIS_TASK_OFFLOAD_HEADER))
+        {
+            *BytesWritten = 0;
+            *BytesNeeded = sizeof(NDIS_TASK_OFFLOAD_HEADER);
+            return NDIS_STATUS_BUFFER_TOO_SHORT;
+        }
+
+        return NICGetTcpTaskOffload(Adapter,
+                                    InformationBuffer,
+                                    InformationBufferLength,
+                                    BytesWritten,
+                                    BytesNeeded);
+    }
+
     default:
         NDIS_DbgPrint(MIN_TRACE, ("Unknown OID 0x%x(%s)\n", Oid, Oid2Str(Oid)));
         status = NDIS_STATUS_NOT_SUPPORTED;
@@ -376,6 +599,23 @@ MiniportSetInformation(
         NICUpdateMulticastList(Adapter);
         break;
 
+    case OID_TCP_TASK_OFFLOAD:
+        if (InformationBufferLength < sizeof(NDIS_TASK_OFFLOAD_HEADER))
+        {
+            *BytesRead = 0;
+            *BytesNeeded = sizeof(NDIS_TASK_OFFLOAD_HEADER);
+            status = NDIS_STATUS_INVALID_LENGTH;
+            break;
+        }
+
+        status = NICSetTcpTaskOffload(Adapter, InformationBuffer, InformationBufferLength);
+        if (status != NDIS_STATUS_SUCCESS)
+        {
+            *BytesRead = 0;
+            *BytesNeeded = 0;
+        }
+        break;
+
     default:
         NDIS_DbgPrint(MIN_TRACE, ("Unknown OID 0x%x(%s)\n", Oid, Oid2Str(Oid)));
         status = NDIS_STATUS_NOT_SUPPORTED;
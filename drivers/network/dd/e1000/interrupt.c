@@ -11,6 +11,40 @@
 
 #include <debug.h>
 
+static
+ULONG
+NICGetReceiveChecksum(
+    _In_ PE1000_ADAPTER Adapter,
+    _In_ UCHAR Status,
+    _In_ UCHAR Errors)
+{
+    NDIS_TCP_IP_CHECKSUM_PACKET_INFO ChecksumInfo;
+
+    ChecksumInfo.Value = 0;
+
+    if (Status & E1000_RDESC_STATUS_IXSM)
+        return ChecksumInfo.Value;
+
+    if ((Status & E1000_RDESC_STATUS_IPCS) && Adapter->Offload.ReceiveIpChecksum)
+    {
+        if (Errors & E1000_RDESC_ERR_IPE)
+            ChecksumInfo.Receive.NdisPacketIpChecksumFailed = 1;
+        else
+            ChecksumInfo.Receive.NdisPacketIpChecksumSucceeded = 1;
+    }
+
+    /* UDP is checked as well, but nobody asked for that */
+    if ((Status & E1000_RDESC_STATUS_TCPCS) && Adapter->Offload.ReceiveTcpChecksum)
+    {
+        if (Errors & E1000_RDESC_ERR_TCPE)
+            ChecksumInfo.Receive.NdisPacketTcpChecksumFailed = 1;
+        else
+            ChecksumInfo.Receive.NdisPacketTcpChecksumSucceeded = 1;
+    }
+
+    return ChecksumInfo.Value;
+}
+
 VOID
 NTAPI
 MiniportISR(
@@ -75,8 +109,9 @@ MiniportHandleInterrupt(
     if (InterruptPending & (E1000_IMS_RXDMT0 | E1000_IMS_RXT0))
     {
         volatile PE1000_RECEIVE_DESCRIPTOR ReceiveDescriptor;
-        PETH_HEADER EthHeader;
-        ULONG BufferOffset;
+        PNDIS_PACKET Packet;
+        PNDIS_BUFFER Buffer;
+        ULONG ChecksumInfo;
         BOOLEAN bGotAny = FALSE;
         ULONG RxDescHead, RxDescTail, CurrRxDesc;
 
@@ -89,7 +124,6 @@ MiniportHandleInterrupt(
         while (((RxDescTail + 1) % NUM_RECEIVE_DESCRIPTORS) != RxDescHead)
         {
             CurrRxDesc = (RxDescTail + 1) % NUM_RECEIVE_DESCRIPTORS;
-            BufferOffset = CurrRxDesc * Adapter->ReceiveBufferEntrySize;
             ReceiveDescriptor = Adapter->ReceiveDescriptors + CurrRxDesc;
 
             /* Check if the hardware have released this descriptor (DD - Descriptor Done) */
@@ -99,8 +133,13 @@ MiniportHandleInterrupt(
                 break;
             }
 
+            ChecksumInfo = NICGetReceiveChecksum(Adapter,
+                                                 ReceiveDescriptor->Status,
+                                                 ReceiveDescriptor->Errors);
+
             /* Ignoring these flags for now */
-            ReceiveDescriptor->Status &= ~(E1000_RDESC_STATUS_IXSM | E1000_RDESC_STATUS_PIF);
+            ReceiveDescriptor->Status &= ~(E1000_RDESC_STATUS_IXSM | E1000_RDESC_STATUS_PIF |
+                                           E1000_RDESC_STATUS_IPCS | E1000_RDESC_STATUS_TCPCS);
 
             if (ReceiveDescriptor->Status != (E1000_RDESC_STATUS_EOP | E1000_RDESC_STATUS_DD))
             {
@@ -113,17 +152,19 @@ MiniportHandleInterrupt(
                 goto NextReceiveDescriptor;
             }
 
-            if (ReceiveDescriptor->Length != 0 && ReceiveDescriptor->Address != 0)
+            if (ReceiveDescriptor->Length >= sizeof(ETH_HEADER) && ReceiveDescriptor->Address != 0)
             {
-                EthHeader = (PETH_HEADER)(Adapter->ReceiveBuffer + BufferOffset);
-
-                NdisMEthIndicateReceive(Adapter->AdapterHandle,
-                                        NULL,
-                                        (PCHAR)EthHeader,
-                                        sizeof(ETH_HEADER),
-                                        (PCHAR)(EthHeader + 1),
-                                        ReceiveDescriptor->Length - sizeof(ETH_HEADER),
-                                        ReceiveDescriptor->Length - sizeof(ETH_HEADER));
+                /* Indicated as a packet, so the checksum results go along.
+                 * The protocol has to copy it, the buffer stays ours */
+                Packet = Adapter->ReceivePackets[CurrRxDesc];
+                NdisQueryPacket(Packet, NULL, NULL, &Buffer, NULL);
+                NdisAdjustBufferLength(Buffer, ReceiveDescriptor->Length);
+                NdisRecalculatePacketCounts(Packet);
+
+                NDIS_PER_PACKET_INFO_FROM_PACKET(Packet, TcpIpChecksumPacketInfo) = UlongToPtr(ChecksumInfo);
+                NDIS_SET_PACKET_STATUS(Packet, NDIS_STATUS_RESOURCES);
+
+                NdisMIndicateReceivePacket(Adapter->AdapterHandle, &Packet, 1);
 
                 bGotAny = TRUE;
             }
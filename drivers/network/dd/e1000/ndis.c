@@ -169,8 +169,11 @@ MiniportInitialize(
     }
 
     /* Allocate the DMA resources */
+    /* A large send is its payload plus no more than one frame of headers */
     Status = NdisMInitializeScatterGatherDma(MiniportAdapterHandle,
                                              FALSE, // 64bit is supported but can be buggy
+                                             Adapter->LargeSendCapable ?
+                                             MAXIMUM_LSO_FRAME_SIZE + MAXIMUM_FRAME_SIZE :
                                              MAXIMUM_FRAME_SIZE);
     if (Status != NDIS_STATUS_SUCCESS)
     {
@@ -19,11 +19,24 @@
 #define MAXIMUM_FRAME_SIZE   1522
 #define RECEIVE_BUFFER_SIZE  2048
 
+#define MAXIMUM_LSO_FRAME_SIZE          0xFC00
+#define MINIMUM_LSO_SEGMENT_COUNT       2
+
 #define DRIVER_VERSION 1
 
 #define DEFAULT_INTERRUPT_MASK  (E1000_IMS_LSC | E1000_IMS_TXDW | E1000_IMS_TXQE | E1000_IMS_RXDMT0 | E1000_IMS_RXT0 | E1000_IMS_TXD_LOW)
 
 
+/* Offloads negotiated through OID_TCP_TASK_OFFLOAD */
+typedef struct _E1000_OFFLOAD
+{
+    BOOLEAN SendIpChecksum;
+    BOOLEAN SendTcpChecksum;
+    BOOLEAN ReceiveIpChecksum;
+    BOOLEAN ReceiveTcpChecksum;
+    BOOLEAN LargeSend;
+} E1000_OFFLOAD, *PE1000_OFFLOAD;
+
 typedef struct _E1000_ADAPTER
 {
     /* NIC Memory */
@@ -74,6 +87,7 @@ typedef struct _E1000_ADAPTER
     PE1000_TRANSMIT_DESCRIPTOR TransmitDescriptors;
     NDIS_PHYSICAL_ADDRESS TransmitDescriptorsPa;
 
+    /* Stored at the last descriptor of each packet */
     PNDIS_PACKET TransmitPackets[NUM_TRANSMIT_DESCRIPTORS];
 
     ULONG CurrentTxDesc;
@@ -90,6 +104,18 @@ typedef struct _E1000_ADAPTER
     NDIS_PHYSICAL_ADDRESS ReceiveBufferPa;
     ULONG ReceiveBufferEntrySize;
 
+    /* One packet per receive buffer, to pass the checksum results up with */
+    NDIS_HANDLE ReceivePacketPool;
+    NDIS_HANDLE ReceiveBufferPool;
+    PNDIS_PACKET ReceivePackets[NUM_RECEIVE_DESCRIPTORS];
+
+
+    /* Offload */
+    BOOLEAN ChecksumCapable;
+    BOOLEAN LargeSendCapable;
+
+    E1000_OFFLOAD Offload;
+
 } E1000_ADAPTER, *PE1000_ADAPTER;
 
 
@@ -144,6 +170,11 @@ NTAPI
 NICDisableTxRx(
     IN PE1000_ADAPTER Adapter);
 
+VOID
+NTAPI
+NICApplyReceiveChecksum(
+    IN PE1000_ADAPTER Adapter);
+
 NDIS_STATUS
 NTAPI
 NICGetPermanentMacAddress(
@@ -10,12 +10,51 @@
 
 #include <debug.h>
 
+#define MAXIMUM_HEADERS_SIZE \
+    (sizeof(ETH_HEADER) + IPV4_HEADER_MAXIMUM_SIZE + TCP_HEADER_MAXIMUM_SIZE)
+
+typedef struct _E1000_OFFLOAD_CONTEXT
+{
+    ULONG Command;
+    UCHAR Options;
+    ULONG IpHeaderLength;
+    ULONG HeadersLength;
+    ULONG Mss;
+} E1000_OFFLOAD_CONTEXT, *PE1000_OFFLOAD_CONTEXT;
+
+static
+ULONG
+NICFreeTransmitDescriptors(
+    _In_ PE1000_ADAPTER Adapter)
+{
+    if (Adapter->TxFull)
+        return 0;
+
+    return (Adapter->LastTxDesc + NUM_TRANSMIT_DESCRIPTORS - Adapter->CurrentTxDesc - 1) %
+           NUM_TRANSMIT_DESCRIPTORS + 1;
+}
+
+static
+VOID
+NICAdvanceTransmitDescriptor(
+    _In_ PE1000_ADAPTER Adapter)
+{
+    Adapter->CurrentTxDesc = (Adapter->CurrentTxDesc + 1) % NUM_TRANSMIT_DESCRIPTORS;
+
+    if (Adapter->CurrentTxDesc == Adapter->LastTxDesc)
+    {
+        NDIS_DbgPrint(MID_TRACE, ("All TX descriptors are full now\n"));
+        Adapter->TxFull = TRUE;
+    }
+}
+
 static
 NDIS_STATUS
 NICTransmitPacket(
     _In_ PE1000_ADAPTER Adapter,
     _In_ PHYSICAL_ADDRESS PhysicalAddress,
-    _In_ ULONG Length)
+    _In_ ULONG Length,
+    _In_ BOOLEAN EndOfPacket)
 {
     volatile PE1000_TRANSMIT_DESCRIPTOR TransmitDescriptor;
 
@@ -25,23 +64,168 @@ NICTransmitPacket(
     TransmitDescriptor->Address = PhysicalAddress.QuadPart;
     TransmitDescriptor->Length = Length;
     TransmitDescriptor->ChecksumOffset = 0;
-    TransmitDescriptor->Command = E1000_TDESC_CMD_RS | E1000_TDESC_CMD_IFCS |
-                                  E1000_TDESC_CMD_EOP | E1000_TDESC_CMD_IDE;
+    TransmitDescriptor->Command = E1000_TDESC_CMD_RS | E1000_TDESC_CMD_IFCS | E1000_TDESC_CMD_IDE;
+    if (EndOfPacket)
+        TransmitDescriptor->Command |= E1000_TDESC_CMD_EOP;
     TransmitDescriptor->Status = 0;
     TransmitDescriptor->ChecksumStartField = 0;
     TransmitDescriptor->Special = 0;
 
-    Adapter->CurrentTxDesc = (Adapter->CurrentTxDesc + 1) % NUM_TRANSMIT_DESCRIPTORS;
+    NICAdvanceTransmitDescriptor(Adapter);
 
-    E1000WriteUlong(Adapter, E1000_REG_TDT, Adapter->CurrentTxDesc);
+    return NDIS_STATUS_SUCCESS;
+}
 
-    if (Adapter->CurrentTxDesc == Adapter->LastTxDesc)
+static
+VOID
+NICTransmitContext(
+    _In_ PE1000_ADAPTER Adapter,
+    _In_ PE1000_OFFLOAD_CONTEXT Context,
+    _In_ ULONG TotalLength)
+{
+    volatile PE1000_CONTEXT_DESCRIPTOR ContextDescriptor;
+    ULONG TcpStart = sizeof(ETH_HEADER) + Context->IpHeaderLength;
+
+    ContextDescriptor = (PE1000_CONTEXT_DESCRIPTOR)(Adapter->TransmitDescriptors + Adapter->CurrentTxDesc);
+    ContextDescriptor->IpChecksumStart = sizeof(ETH_HEADER);
+    ContextDescriptor->IpChecksumOffset = sizeof(ETH_HEADER) + IPV4_HEADER_CHECKSUM;
+    ContextDescriptor->IpChecksumEnd = TcpStart - 1;
+    ContextDescriptor->TcpChecksumStart = TcpStart;
+    ContextDescriptor->TcpChecksumOffset = TcpStart + TCP_HEADER_CHECKSUM;
+    ContextDescriptor->TcpChecksumEnd = 0;
+    ContextDescriptor->CommandLength = E1000_TCTXD_CMD_RS | E1000_TCTXD_CMD_IDE |
+                                       E1000_TCTXD_CMD_DEXT | E1000_TCTXD_DTYP |
+                                       E1000_TCTXD_CMD_IP | E1000_TCTXD_CMD_TCP;
+    ContextDescriptor->Status = 0;
+    ContextDescriptor->HeaderLength = 0;
+    ContextDescriptor->MaximumSegmentSize = 0;
+
+    if (Context->Mss)
     {
-        NDIS_DbgPrint(MID_TRACE, ("All TX descriptors are full now\n"));
-        Adapter->TxFull = TRUE;
+        ContextDescriptor->CommandLength |= E1000_TCTXD_CMD_TSE |
+                                            ((TotalLength - Context->HeadersLength) & E1000_TCTXD_PAYLEN_MASK);
+        ContextDescriptor->HeaderLength = Context->HeadersLength;
+        ContextDescriptor->MaximumSegmentSize = Context->Mss;
     }
 
-    return NDIS_STATUS_SUCCESS;
+    NICAdvanceTransmitDescriptor(Adapter);
+}
+
+static
+VOID
+NICTransmitData(
+    _In_ PE1000_ADAPTER Adapter,
+    _In_ PE1000_OFFLOAD_CONTEXT Context,
+    _In_ PHYSICAL_ADDRESS PhysicalAddress,
+    _In_ ULONG Length,
+    _In_ BOOLEAN EndOfPacket)
+{
+    volatile PE1000_DATA_DESCRIPTOR DataDescriptor;
+
+    DataDescriptor = (PE1000_DATA_DESCRIPTOR)(Adapter->TransmitDescriptors + Adapter->CurrentTxDesc);
+    DataDescriptor->Address = PhysicalAddress.QuadPart;
+    DataDescriptor->CommandLength = Length | Context->Command | E1000_TDATD_DTYP |
+                                    E1000_TDATD_CMD_DEXT | E1000_TDATD_CMD_RS |
+                                    E1000_TDATD_CMD_IFCS | E1000_TDATD_CMD_IDE;
+    if (EndOfPacket)
+        DataDescriptor->CommandLength |= E1000_TDATD_CMD_EOP;
+    DataDescriptor->Status = 0;
+    DataDescriptor->Options = Context->Options;
+    DataDescriptor->Special = 0;
+
+    NICAdvanceTransmitDescriptor(Adapter);
+}
+
+static
+ULONG
+NICCopyPacketHeaders(
+    _In_ PNDIS_PACKET Packet,
+    _Out_writes_bytes_(Length) PUCHAR Headers,
+    _In_ ULONG Length)
+{
+    PNDIS_BUFFER Buffer;
+    PVOID Address;
+    UINT BufferLength;
+    ULONG Copied = 0;
+
+    NdisQueryPacket(Packet, NULL, NULL, &Buffer, NULL);
+    while (Buffer && Copied < Length)
+    {
+        NdisQueryBufferSafe(Buffer, &Address, &BufferLength, HighPagePriority);
+        if (!Address)
+            break;
+
+        BufferLength = min(BufferLength, Length - Copied);
+        NdisMoveMemory(Headers + Copied, Address, BufferLength);
+        Copied += BufferLength;
+
+        NdisGetNextBuffer(Buffer, &Buffer);
+    }
+
+    return Copied;
+}
+
+static
+BOOLEAN
+NICGetOffloadContext(
+    _In_ PE1000_ADAPTER Adapter,
+    _In_ PNDIS_PACKET Packet,
+    _Out_ PE1000_OFFLOAD_CONTEXT Context)
+{
+    NDIS_TCP_IP_CHECKSUM_PACKET_INFO ChecksumInfo;
+    UCHAR Headers[MAXIMUM_HEADERS_SIZE];
+    PUCHAR IpHeader, TcpHeader;
+    ULONG Copied;
+
+    NdisZeroMemory(Context, sizeof(*Context));
+
+    if (NDIS_GET_PACKET_PROTOCOL_TYPE(Packet) != NDIS_PROTOCOL_ID_TCP_IP)
+        return FALSE;
+
+    if (Adapter->Offload.LargeSend)
+    {
+        Context->Mss = PtrToUlong(NDIS_PER_PACKET_INFO_FROM_PACKET(Packet, TcpLargeSendPacketInfo));
+    }
+
+    if (Context->Mss)
+    {
+        /* The hardware does both checksums for each segment */
+        Context->Command = E1000_TDATD_CMD_TSE;
+        Context->Options = E1000_TDATD_POPTS_IXSM | E1000_TDATD_POPTS_TXSM;
+    }
+    else
+    {
+        ChecksumInfo.Value = PtrToUlong(NDIS_PER_PACKET_INFO_FROM_PACKET(Packet,
+                                                                         TcpIpChecksumPacketInfo));
+        if (!ChecksumInfo.Transmit.NdisPacketChecksumV4)
+            return FALSE;
+
+        if (ChecksumInfo.Transmit.NdisPacketTcpChecksum && Adapter->Offload.SendTcpChecksum)
+            Context->Options |= E1000_TDATD_POPTS_TXSM;
+        if (ChecksumInfo.Transmit.NdisPacketIpChecksum && Adapter->Offload.SendIpChecksum)
+            Context->Options |= E1000_TDATD_POPTS_IXSM;
+
+        if (!Context->Options)
+            return FALSE;
+    }
+
+    Copied = NICCopyPacketHeaders(Packet, Headers, sizeof(Headers));
+    if (Copied < sizeof(ETH_HEADER) + IPV4_HEADER_MINIMUM_SIZE)
+        return FALSE;
+
+    IpHeader = Headers + sizeof(ETH_HEADER);
+    Context->IpHeaderLength = IPV4_HEADER_LENGTH(IpHeader[0]);
+    if (Context->IpHeaderLength < IPV4_HEADER_MINIMUM_SIZE ||
+        Copied < sizeof(ETH_HEADER) + Context->IpHeaderLength + TCP_HEADER_MINIMUM_SIZE)
+    {
+        return FALSE;
+    }
+
+    TcpHeader = IpHeader + Context->IpHeaderLength;
+    Context->HeadersLength = sizeof(ETH_HEADER) + Context->IpHeaderLength +
+                             TCP_HEADER_LENGTH(TcpHeader[TCP_HEADER_DATA_OFFSET]);
+
+    return TRUE;
 }
 
 NDIS_STATUS
@@ -53,33 +237,77 @@ MiniportSend(
 {
     PE1000_ADAPTER Adapter = (PE1000_ADAPTER)MiniportAdapterContext;
     PSCATTER_GATHER_LIST sgList;
-    ULONG TransmitLength;
-    PHYSICAL_ADDRESS TransmitBuffer;
+    E1000_OFFLOAD_CONTEXT Context;
+    BOOLEAN Offload;
+    ULONG TotalLength = 0, Needed, i;
     NDIS_STATUS Status;
 
     sgList = NDIS_PER_PACKET_INFO_FROM_PACKET(Packet, ScatterGatherListPacketInfo);
 
     ASSERT(sgList != NULL);
-    ASSERT(sgList->NumberOfElements == 1);
-    ASSERT((sgList->Elements[0].Address.LowPart & 3) == 0);
-    ASSERT(sgList->Elements[0].Length <= MAXIMUM_FRAME_SIZE);
+    ASSERT(sgList->NumberOfElements >= 1);
 
-    if (Adapter->TxFull)
+    for (i = 0; i < sgList->NumberOfElements; i++)
+        TotalLength += sgList->Elements[i].Length;
+
+    Offload = NICGetOffloadContext(Adapter, Packet, &Context);
+    if (!Offload && Context.Mss)
+    {
+        NDIS_DbgPrint(MIN_TRACE, ("Large send without TCP/IP headers\n"));
+        return NDIS_STATUS_INVALID_PACKET;
+    }
+    ASSERT(Context.Mss || TotalLength <= MAXIMUM_FRAME_SIZE);
+
+    /* One descriptor is always left free, a full ring would look empty to the NIC */
+    Needed = sgList->NumberOfElements + (Offload ? 1 : 0);
+    if (Needed >= NICFreeTransmitDescriptors(Adapter))
     {
         NDIS_DbgPrint(MIN_TRACE, ("All TX descriptors are full\n"));
         return NDIS_STATUS_RESOURCES;
     }
 
-    TransmitLength = sgList->Elements[0].Length;
-    TransmitBuffer = sgList->Elements[0].Address;
-    Adapter->TransmitPackets[Adapter->CurrentTxDesc] = Packet;
+    if (Offload)
+    {
+        NICTransmitContext(Adapter, &Context, TotalLength);
+    }
 
-    Status = NICTransmitPacket(Adapter, TransmitBuffer, TransmitLength);
-    if (Status != NDIS_STATUS_SUCCESS)
+    for (i = 0; i < sgList->NumberOfElements; i++)
     {
-        NDIS_DbgPrint(MIN_TRACE, ("Transmit packet failed\n"));
-        return Status;
+        BOOLEAN EndOfPacket = (i == sgList->NumberOfElements - 1);
+
+        /* The packet is completed once its last descriptor is done */
+        Adapter->TransmitPackets[Adapter->CurrentTxDesc] = EndOfPacket ? Packet : NULL;
+
+        if (Offload)
+        {
+            NICTransmitData(Adapter,
+                            &Context,
+                            sgList->Elements[i].Address,
+                            sgList->Elements[i].Length,
+                            EndOfPacket);
+        }
+        else
+        {
+            Status = NICTransmitPacket(Adapter,
+                                       sgList->Elements[i].Address,
+                                       sgList->Elements[i].Length,
+                                       EndOfPacket);
+            if (Status != NDIS_STATUS_SUCCESS)
+            {
+                NDIS_DbgPrint(MIN_TRACE, ("Transmit packet failed\n"));
+                return Status;
+            }
+        }
     }
 
+    if (Context.Mss)
+    {
+        /* The protocol passed the MSS in, it gets the payload length back */
+        NDIS_PER_PACKET_INFO_FROM_PACKET(Packet, TcpLargeSendPacketInfo) =
+            UlongToPtr(TotalLength - Context.HeadersLength);
+    }
+
+    E1000WriteUlong(Adapter, E1000_REG_TDT, Adapter->CurrentTxDesc);
+
     return NDIS_STATUS_PENDING;
 }
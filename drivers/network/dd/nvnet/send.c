@@ -336,13 +336,14 @@ NvNetSendPacketLargeSend(
         return NDIS_STATUS_RESOURCES;
     }
 
+    /* The protocol passed the MSS in, it gets the payload length back */
+    Mss = PtrToUlong(NDIS_PER_PACKET_INFO_FROM_PACKET(Packet, TcpLargeSendPacketInfo));
+
     NDIS_PER_PACKET_INFO_FROM_PACKET(Packet, TcpLargeSendPacketInfo) =
         UlongToPtr(TotalLength - Adapter->IpHeaderOffset - Length);
 
     --Adapter->Send.TcbSlots;
 
-    Mss = PtrToUlong(NDIS_PER_PACKET_INFO_FROM_PACKET(Packet, TcpLargeSendPacketInfo));
-
     Tcb = Adapter->Send.CurrentTcb;
     Tcb->Mss = Mss;
     Tcb->Packet = Packet;
@@ -328,7 +328,7 @@ NdisConvertStringToAtmAddress(
 
 
 /*
- * @unimplemented
+ * @implemented
  */
 PNDIS_PACKET
 EXPORT
@@ -336,15 +336,26 @@ NdisGetReceivedPacket(
     IN  PNDIS_HANDLE    NdisBindingHandle,
     IN  PNDIS_HANDLE    MacContext)
 /*
- * FUNCTION:
+ * FUNCTION: Returns the packet behind a receive indication
  * ARGUMENTS:
+ *     NdisBindingHandle = Adapter binding handle
+ *     MacContext        = MAC receive context passed to ProtocolReceive
+ * RETURNS:
+ *     The indicated packet, NULL if the miniport indicated raw data
  * NOTES:
  *    NDIS 5.0
+ *    Only valid from within ProtocolReceive
  */
 {
-    UNIMPLEMENTED;
+    PADAPTER_BINDING AdapterBinding = GET_ADAPTER_BINDING(NdisBindingHandle);
+    PLOGICAL_ADAPTER Adapter = AdapterBinding->Adapter;
+    PNDIS_PACKET Packet;
 
-    return NULL;
+    Packet = Adapter->NdisMiniportBlock.IndicatedPacket[KeGetCurrentProcessorNumber()];
+    if (Packet != (PNDIS_PACKET)MacContext)
+        return NULL;
+
+    return Packet;
 }
 
 
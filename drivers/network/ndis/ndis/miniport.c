@@ -347,30 +347,45 @@ MiniIndicateReceivePacket(
 
                 LookAheadSize = TotalBufferLength - HeaderSize;
 
-                LookAheadBuffer = ExAllocatePool(NonPagedPool, LookAheadSize);
-                if (!LookAheadBuffer)
+                if (FirstBufferLength >= TotalBufferLength)
                 {
-                    NDIS_DbgPrint(MIN_TRACE, ("Failed to allocate lookahead buffer!\n"));
-                    KeReleaseSpinLock(&Adapter->NdisMiniportBlock.Lock, OldIrql);
-                    return;
+                    /* The whole packet is in one buffer, no need to copy it */
+                    LookAheadBuffer = (PUCHAR)NdisBufferVA + HeaderSize;
                 }
+                else
+                {
+                    LookAheadBuffer = ExAllocatePool(NonPagedPool, LookAheadSize);
+                    if (!LookAheadBuffer)
+                    {
+                        NDIS_DbgPrint(MIN_TRACE, ("Failed to allocate lookahead buffer!\n"));
+                        KeReleaseSpinLock(&Adapter->NdisMiniportBlock.Lock, OldIrql);
+                        return;
+                    }
 
-                CopyBufferChainToBuffer(LookAheadBuffer,
-                                        NdisBuffer,
-                                        HeaderSize,
-                                        LookAheadSize);
+                    CopyBufferChainToBuffer(LookAheadBuffer,
+                                            NdisBuffer,
+                                            HeaderSize,
+                                            LookAheadSize);
+                }
+
+                /* The packet is the receive context, so NdisTransferData and
+                 * NdisGetReceivedPacket can find it while the protocol looks at it */
+                Adapter->NdisMiniportBlock.IndicatedPacket[KeGetCurrentProcessorNumber()] = PacketArray[i];
 
                 NDIS_DbgPrint(MID_TRACE, ("Indicating packet to protocol's legacy Receive handler\n"));
                 (*AdapterBinding->ProtocolBinding->Chars.ReceiveHandler)(
                      AdapterBinding->NdisOpenBlock.ProtocolBindingContext,
-                     AdapterBinding->NdisOpenBlock.MacHandle,
+                     PacketArray[i],
                      NdisBufferVA,
                      HeaderSize,
                      LookAheadBuffer,
                      LookAheadSize,
                      TotalBufferLength - HeaderSize);
 
-                ExFreePool(LookAheadBuffer);
+                Adapter->NdisMiniportBlock.IndicatedPacket[KeGetCurrentProcessorNumber()] = NULL;
+
+                if (FirstBufferLength < TotalBufferLength)
+                    ExFreePool(LookAheadBuffer);
             }
         }
 
@@ -284,13 +284,13 @@ ProIndicatePacket(
   if (BufferedLength > Adapter->MediumHeaderSize)
     {
       /* XXX Change this to call SendPackets so we don't have to duplicate this wacky logic */
-      MiniIndicateData(Adapter, NULL, LookaheadBuffer, Adapter->MediumHeaderSize,
+      MiniIndicateData(Adapter, Packet, LookaheadBuffer, Adapter->MediumHeaderSize,
           &LookaheadBuffer[Adapter->MediumHeaderSize], BufferedLength - Adapter->MediumHeaderSize,
           PacketLength - Adapter->MediumHeaderSize);
     }
   else
     {
-      MiniIndicateData(Adapter, NULL, LookaheadBuffer, Adapter->MediumHeaderSize, NULL, 0, 0);
+      MiniIndicateData(Adapter, Packet, LookaheadBuffer, Adapter->MediumHeaderSize, NULL, 0, 0);
     }
 
   ExFreePool(LookaheadBuffer);
@@ -668,10 +668,10 @@ ProTransferData(
 	NDIS_DbgPrint(MAX_TRACE, ("LoopPacket\n"));
         /* NDIS is responsible for looping this packet */
         NdisCopyFromPacketToPacket(Packet,
-                                   ByteOffset + Adapter->MediumHeaderSize,
-                                   BytesToTransfer + Adapter->MediumHeaderSize,
-                                   Adapter->NdisMiniportBlock.IndicatedPacket[KeGetCurrentProcessorNumber()],
                                    0,
+                                   BytesToTransfer,
+                                   Adapter->NdisMiniportBlock.IndicatedPacket[KeGetCurrentProcessorNumber()],
+                                   ByteOffset + Adapter->MediumHeaderSize,
                                    BytesTransferred);
         return NDIS_STATUS_SUCCESS;
     }
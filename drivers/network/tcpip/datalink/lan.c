@@ -313,6 +313,7 @@ VOID LanReceiveWorker( PVOID Context ) {
     IP_PACKET IPPacket;
     BOOLEAN LegacyReceive;
     PIP_INTERFACE Interface;
+    NDIS_TCP_IP_CHECKSUM_PACKET_INFO ChecksumInfo;
 
     TI_DbgPrint(DEBUG_DATALINK, ("Called.\n"));
 
@@ -330,6 +331,23 @@ VOID LanReceiveWorker( PVOID Context ) {
     IPPacket.NdisPacket = Packet;
     IPPacket.ReturnPacket = !LegacyReceive;
 
+    /* Skip the checksums the adapter verified for us */
+    if (Interface->Offload & (IP_OFFLOAD_RX_IP_CHECKSUM | IP_OFFLOAD_RX_TCP_CHECKSUM))
+    {
+        ChecksumInfo.Value = PtrToUlong(NDIS_PER_PACKET_INFO_FROM_PACKET(Packet,
+                                                                         TcpIpChecksumPacketInfo));
+        if ((Interface->Offload & IP_OFFLOAD_RX_IP_CHECKSUM) &&
+            ChecksumInfo.Receive.NdisPacketIpChecksumSucceeded)
+        {
+            IPPacket.Flags |= IP_PACKET_FLAG_IP_CHECKSUM_OK;
+        }
+        if ((Interface->Offload & IP_OFFLOAD_RX_TCP_CHECKSUM) &&
+            ChecksumInfo.Receive.NdisPacketTcpChecksumSucceeded)
+        {
+            IPPacket.Flags |= IP_PACKET_FLAG_TCP_CHECKSUM_OK;
+        }
+    }
+
     if (LegacyReceive)
     {
         /* Packet type is precomputed */
@@ -485,8 +503,9 @@ NDIS_STATUS NTAPI ProtocolReceive(
     UINT BytesTransferred;
     PCHAR BufferData;
     NDIS_STATUS NdisStatus;
-    PNDIS_PACKET NdisPacket;
+    PNDIS_PACKET NdisPacket, ReceivedPacket;
     PLAN_ADAPTER Adapter = (PLAN_ADAPTER)BindingContext;
+    PIP_INTERFACE Interface = Adapter->Context;
 
     TI_DbgPrint(DEBUG_DATALINK, ("Called. (packetsize %d)\n",PacketSize));
 
@@ -519,6 +538,18 @@ NDIS_STATUS NTAPI ProtocolReceive(
 
     PC(NdisPacket)->PacketType = PacketType;
 
+    /* The checksum results come with the packet, if there is one */
+    if (Interface &&
+        (Interface->Offload & (IP_OFFLOAD_RX_IP_CHECKSUM | IP_OFFLOAD_RX_TCP_CHECKSUM)))
+    {
+        ReceivedPacket = NdisGetReceivedPacket(Adapter->NdisHandle, MacReceiveContext);
+        if (ReceivedPacket)
+        {
+            NDIS_PER_PACKET_INFO_FROM_PACKET(NdisPacket, TcpIpChecksumPacketInfo) =
+                NDIS_PER_PACKET_INFO_FROM_PACKET(ReceivedPacket, TcpIpChecksumPacketInfo);
+        }
+    }
+
     TI_DbgPrint(DEBUG_DATALINK, ("pretransfer LookaheadBufferSize %d packsize %d\n",LookaheadBufferSize,PacketSize));
 
     GetDataPtr( NdisPacket, 0, &BufferData, &PacketSize );
@@ -999,6 +1030,17 @@ VOID LANTransmit(
 
     RtlCopyMemory(Data + Adapter->HeaderSize, OldData, OldSize);
 
+    /* Pass on the checksum and segmentation work for the adapter */
+    if (NDIS_PER_PACKET_INFO_FROM_PACKET(NdisPacket, TcpIpChecksumPacketInfo) ||
+        NDIS_PER_PACKET_INFO_FROM_PACKET(NdisPacket, TcpLargeSendPacketInfo))
+    {
+        NDIS_PER_PACKET_INFO_FROM_PACKET(XmitPacket, TcpIpChecksumPacketInfo) =
+            NDIS_PER_PACKET_INFO_FROM_PACKET(NdisPacket, TcpIpChecksumPacketInfo);
+        NDIS_PER_PACKET_INFO_FROM_PACKET(XmitPacket, TcpLargeSendPacketInfo) =
+            NDIS_PER_PACKET_INFO_FROM_PACKET(NdisPacket, TcpLargeSendPacketInfo);
+        NdisSetPacketFlags(XmitPacket, NDIS_PROTOCOL_ID_TCP_IP);
+    }
+
     (*PC(NdisPacket)->DLComplete)(PC(NdisPacket)->Context, NdisPacket, NDIS_STATUS_SUCCESS);
 
     switch (Adapter->Media) {
@@ -1049,12 +1091,6 @@ VOID LANTransmit(
 		   ((PCHAR)LinkAddress)[5] & 0xff));
 	}
 
-    if (Adapter->MTU < Size) {
-        /* This is NOT a pointer. MSDN explicitly says so. */
-        NDIS_PER_PACKET_INFO_FROM_PACKET(NdisPacket,
-                                         TcpLargeSendPacketInfo) = (PVOID)((ULONG_PTR)Adapter->MTU);
-    }
-
     /* Update interface stats */
     Interface->Stats.OutBytes += Size;
 
@@ -1302,6 +1338,182 @@ VOID GetName( PUNICODE_STRING RegistryKey,
     AppendUnicodeString( OutName, &PartialRegistryKey, FALSE );
 }
 
+/* Enough for every task NDIS 5 knows about */
+#define TASK_OFFLOAD_BUFFER_SIZE 512
+
+static VOID NegotiateOffload(
+    PLAN_ADAPTER Adapter,
+    PIP_INTERFACE IF)
+/*
+ * FUNCTION: Agrees with the miniport on the TCP/IP work it does for us
+ * ARGUMENTS:
+ *     Adapter = Pointer to LAN_ADAPTER structure
+ *     IF      = Pointer to the IP interface of the adapter
+ * NOTES:
+ *     We only ask for checksums on IPv4 and TCP, and for large sends.
+ *     Whatever the miniport can't do, we keep doing ourselves
+ */
+{
+    PUCHAR Buffer;
+    PNDIS_TASK_OFFLOAD_HEADER Header;
+    PNDIS_TASK_OFFLOAD Task;
+    PNDIS_TASK_TCP_IP_CHECKSUM ChecksumTask;
+    PNDIS_TASK_TCP_LARGE_SEND LargeSendTask;
+    NDIS_TASK_TCP_IP_CHECKSUM Checksum;
+    NDIS_TASK_TCP_LARGE_SEND LargeSend;
+    NDIS_STATUS NdisStatus;
+    ULONG Offload = 0;
+    ULONG Offset, Length;
+
+    if (Adapter->Media != NdisMedium802_3)
+        return;
+
+    Buffer = ExAllocatePoolWithTag(NonPagedPool, TASK_OFFLOAD_BUFFER_SIZE, TASK_OFFLOAD_TAG);
+    if (!Buffer)
+        return;
+
+    RtlZeroMemory(Buffer, TASK_OFFLOAD_BUFFER_SIZE);
+    Header = (PNDIS_TASK_OFFLOAD_HEADER)Buffer;
+    Header->Version = NDIS_TASK_OFFLOAD_VERSION;
+    Header->Size = sizeof(NDIS_TASK_OFFLOAD_HEADER);
+    Header->EncapsulationFormat.Encapsulation = IEEE_802_3_Encapsulation;
+    Header->EncapsulationFormat.Flags.FixedHeaderSize = 1;
+    Header->EncapsulationFormat.EncapsulationHeaderSize = Adapter->HeaderSize;
+
+    NdisStatus = NDISCall(Adapter,
+                          NdisRequestQueryInformation,
+                          OID_TCP_TASK_OFFLOAD,
+                          Buffer,
+                          TASK_OFFLOAD_BUFFER_SIZE);
+    if (NdisStatus != NDIS_STATUS_SUCCESS) {
+        TI_DbgPrint(DEBUG_DATALINK, ("No task offload (0x%X).\n", NdisStatus));
+        ExFreePoolWithTag(Buffer, TASK_OFFLOAD_TAG);
+        return;
+    }
+
+    RtlZeroMemory(&Checksum, sizeof(Checksum));
+    RtlZeroMemory(&LargeSend, sizeof(LargeSend));
+
+    /* Pick the tasks we can use */
+    Offset = Header->OffsetFirstTask;
+    while (Offset &&
+           Offset <= TASK_OFFLOAD_BUFFER_SIZE - FIELD_OFFSET(NDIS_TASK_OFFLOAD, TaskBuffer))
+    {
+        Task = (PNDIS_TASK_OFFLOAD)(Buffer + Offset);
+        if (Task->TaskBufferLength > TASK_OFFLOAD_BUFFER_SIZE - Offset -
+                                     FIELD_OFFSET(NDIS_TASK_OFFLOAD, TaskBuffer))
+            break;
+
+        switch (Task->Task) {
+            case TcpIpChecksumNdisTask:
+                if (Task->TaskBufferLength < sizeof(NDIS_TASK_TCP_IP_CHECKSUM))
+                    break;
+                ChecksumTask = (PNDIS_TASK_TCP_IP_CHECKSUM)Task->TaskBuffer;
+
+                /* lwIP sends TCP options (timestamps), but no IP options */
+                if (ChecksumTask->V4Transmit.TcpChecksum &&
+                    ChecksumTask->V4Transmit.TcpOptionsSupported) {
+                    Checksum.V4Transmit.TcpChecksum = 1;
+                    Checksum.V4Transmit.TcpOptionsSupported = 1;
+                    Offload |= IP_OFFLOAD_TX_TCP_CHECKSUM;
+                }
+                if (ChecksumTask->V4Transmit.IpChecksum) {
+                    Checksum.V4Transmit.IpChecksum = 1;
+                    Offload |= IP_OFFLOAD_TX_IP_CHECKSUM;
+                }
+
+                /* Packets the miniport can't check aren't marked as checked */
+                Checksum.V4Receive.IpOptionsSupported = ChecksumTask->V4Receive.IpOptionsSupported;
+                Checksum.V4Receive.TcpOptionsSupported = ChecksumTask->V4Receive.TcpOptionsSupported;
+                if (ChecksumTask->V4Receive.TcpChecksum) {
+                    Checksum.V4Receive.TcpChecksum = 1;
+                    Offload |= IP_OFFLOAD_RX_TCP_CHECKSUM;
+                }
+                if (ChecksumTask->V4Receive.IpChecksum) {
+                    Checksum.V4Receive.IpChecksum = 1;
+                    Offload |= IP_OFFLOAD_RX_IP_CHECKSUM;
+                }
+                break;
+
+            case TcpLargeSendNdisTask:
+                if (Task->TaskBufferLength < sizeof(NDIS_TASK_TCP_LARGE_SEND))
+                    break;
+                LargeSendTask = (PNDIS_TASK_TCP_LARGE_SEND)Task->TaskBuffer;
+
+                /* Anything above the MTU spans at least two segments */
+                if (LargeSendTask->TcpOptions &&
+                    LargeSendTask->MinSegmentCount <= 2 &&
+                    LargeSendTask->MaxOffLoadSize != 0) {
+                    LargeSend = *LargeSendTask;
+                    Offload |= IP_OFFLOAD_LARGE_SEND;
+                }
+                break;
+
+            default:
+                break;
+        }
+
+        if (!Task->OffsetNextTask)
+            break;
+        Offset += Task->OffsetNextTask;
+    }
+
+    /* Tell the miniport what we use, it turns all of it on at once */
+    Length = sizeof(NDIS_TASK_OFFLOAD_HEADER);
+    Header->OffsetFirstTask = 0;
+    Task = NULL;
+    if (Offload & (IP_OFFLOAD_TX_IP_CHECKSUM | IP_OFFLOAD_TX_TCP_CHECKSUM |
+                   IP_OFFLOAD_RX_IP_CHECKSUM | IP_OFFLOAD_RX_TCP_CHECKSUM)) {
+        Task = (PNDIS_TASK_OFFLOAD)(Buffer + Length);
+        Task->Version = NDIS_TASK_OFFLOAD_VERSION;
+        Task->Size = sizeof(NDIS_TASK_OFFLOAD);
+        Task->Task = TcpIpChecksumNdisTask;
+        Task->OffsetNextTask = 0;
+        Task->TaskBufferLength = sizeof(Checksum);
+        RtlCopyMemory(Task->TaskBuffer, &Checksum, sizeof(Checksum));
+
+        Header->OffsetFirstTask = Length;
+        Length += FIELD_OFFSET(NDIS_TASK_OFFLOAD, TaskBuffer) + sizeof(Checksum);
+    }
+    if (Offload & IP_OFFLOAD_LARGE_SEND) {
+        if (Task)
+            Task->OffsetNextTask = Length - Header->OffsetFirstTask;
+        else
+            Header->OffsetFirstTask = Length;
+
+        Task = (PNDIS_TASK_OFFLOAD)(Buffer + Length);
+        Task->Version = NDIS_TASK_OFFLOAD_VERSION;
+        Task->Size = sizeof(NDIS_TASK_OFFLOAD);
+        Task->Task = TcpLargeSendNdisTask;
+        Task->OffsetNextTask = 0;
+        Task->TaskBufferLength = sizeof(LargeSend);
+        RtlCopyMemory(Task->TaskBuffer, &LargeSend, sizeof(LargeSend));
+
+        Length += FIELD_OFFSET(NDIS_TASK_OFFLOAD, TaskBuffer) + sizeof(LargeSend);
+    }
+
+    if (Offload) {
+        NdisStatus = NDISCall(Adapter,
+                              NdisRequestSetInformation,
+                              OID_TCP_TASK_OFFLOAD,
+                              Buffer,
+                              Length);
+        if (NdisStatus != NDIS_STATUS_SUCCESS) {
+            TI_DbgPrint(MIN_TRACE, ("Could not enable task offload (0x%X).\n", NdisStatus));
+            Offload = 0;
+        }
+    }
+
+    ExFreePoolWithTag(Buffer, TASK_OFFLOAD_TAG);
+
+    TI_DbgPrint(DEBUG_DATALINK, ("Offload 0x%x, large sends up to %u bytes.\n",
+                                 Offload, LargeSend.MaxOffLoadSize));
+
+    IF->Offload = Offload;
+    IF->LargeSendSize = min(LargeSend.MaxOffLoadSize, IP_MAXIMUM_LARGE_SEND_SIZE);
+    TCPUpdateInterfaceOffload(IF);
+}
+
 BOOLEAN BindAdapter(
     PLAN_ADAPTER Adapter,
     PNDIS_STRING RegistryPath)
@@ -1371,6 +1583,9 @@ BOOLEAN BindAdapter(
     TI_DbgPrint(DEBUG_DATALINK,("Adapter Description: %wZ\n",
                 &IF->Description));
 
+    /* Let the miniport take over what it can */
+    NegotiateOffload(Adapter, IF);
+
     /* Register interface with IP layer */
     IPRegisterInterface(IF);
 
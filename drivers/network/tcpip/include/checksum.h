@@ -21,6 +21,11 @@ csum_partial(
   int len,
   unsigned int sum);
 
+ULONG
+TCPv4PseudoHeaderChecksum(
+  PIPv4_HEADER IPHeader,
+  ULONG TCPLength);
+
 ULONG
 UDPv4ChecksumCalculate(
   PIPv4_HEADER IPHeader,
@@ -91,6 +91,8 @@ typedef struct _IP_PACKET {
 } IP_PACKET, *PIP_PACKET;
 
 #define IP_PACKET_FLAG_RAW      0x01    /* Raw IP packet */
+#define IP_PACKET_FLAG_IP_CHECKSUM_OK  0x02 /* Link layer verified the IP header checksum */
+#define IP_PACKET_FLAG_TCP_CHECKSUM_OK 0x04 /* Link layer verified the TCP checksum */
 
 
 /* Packet context */
@@ -168,8 +170,19 @@ typedef struct _IP_INTERFACE {
     LL_TRANSMIT_ROUTINE Transmit; /* Pointer to transmit function */
     PVOID TCPContext;             /* TCP Content for this interface */
     SEND_RECV_STATS Stats;        /* Send/Receive statistics */
+    ULONG Offload;                /* Work the link layer does for us (see IP_OFFLOAD_xx below) */
+    UINT  LargeSendSize;          /* Most TCP data the link layer segments at once */
 } IP_INTERFACE, *PIP_INTERFACE;
 
+#define IP_OFFLOAD_TX_IP_CHECKSUM   0x01  /* Computes IPv4 header checksums */
+#define IP_OFFLOAD_TX_TCP_CHECKSUM  0x02  /* Computes TCP checksums */
+#define IP_OFFLOAD_RX_IP_CHECKSUM   0x04  /* Verifies IPv4 header checksums */
+#define IP_OFFLOAD_RX_TCP_CHECKSUM  0x08  /* Verifies TCP checksums */
+#define IP_OFFLOAD_LARGE_SEND       0x10  /* Splits large TCP segments up */
+
+/* Leaves room for the headers, so the datagram stays below 64k */
+#define IP_MAXIMUM_LARGE_SEND_SIZE  0xFC00
+
 typedef struct _IP_SET_ADDRESS {
     ULONG NteIndex;
     IPv4_RAW_ADDRESS Address;
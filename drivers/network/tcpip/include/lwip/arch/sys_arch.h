@@ -15,6 +15,12 @@ typedef struct _sys_mbox_t
     int Valid;
 } sys_mbox_t;
 
+typedef struct _sys_mutex_t
+{
+    KMUTEX Mutex;
+    int Valid;
+} sys_mutex_t;
+
 typedef KIRQL sys_prot_t;
 
 typedef u32_t sys_thread_t;
@@ -10,7 +10,7 @@
 
 /* Define LWIP_COMPAT_MUTEX if the port has no mutexes and binary semaphores
  should be used instead */
-#define LWIP_COMPAT_MUTEX               1
+#define LWIP_COMPAT_MUTEX               0
 
 #define MEM_ALIGNMENT                   4
 
@@ -30,6 +30,15 @@
 
 #define IP_SOF_BROADCAST_RECV           1
 
+/* Checksums are done by our glue, or by the NIC when it offers to */
+#define CHECKSUM_GEN_IP                 0
+
+#define CHECKSUM_GEN_TCP                0
+
+#define CHECKSUM_CHECK_IP               0
+
+#define CHECKSUM_CHECK_TCP              0
+
 #define LWIP_ICMP                       0
 
 #define LWIP_RAW                        0
@@ -80,6 +89,10 @@
 
 #define LWIP_NETIF_API                  1
 
+/* Our glue calls the raw API from any thread under the core lock,
+ * instead of queueing everything to the tcpip thread */
+#define LWIP_TCPIP_CORE_LOCKING         1
+
 #define LWIP_SOCKET                     0
 
 #define LWIP_NETCONN                    0
@@ -45,3 +45,4 @@
 #define HEADER_TAG 'rhCT'
 #define REG_STR_TAG 'srCT'
 #define DEVICE_OBJ_SECURITY_TAG 'eSeD'
+#define TASK_OFFLOAD_TAG 'otCT'
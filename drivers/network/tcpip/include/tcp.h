@@ -194,6 +194,9 @@ TCPUpdateInterfaceLinkStatus(PIP_INTERFACE IF);
 VOID
 TCPUpdateInterfaceIPInformation(PIP_INTERFACE IF);
 
+VOID
+TCPUpdateInterfaceOffload(PIP_INTERFACE IF);
+
 VOID
 FlushListenQueue(PCONNECTION_ENDPOINT Connection, const NTSTATUS Status);
 
@@ -217,4 +220,10 @@ VOID CompleteBucket(PCONNECTION_ENDPOINT Connection, PTDI_BUCKET Bucket, const B
 void
 LibTCPDumpPcb(PVOID SocketContext);
 
+void
+LibTCPLockCore(void);
+
+void
+LibTCPUnlockCore(void);
+
 NTSTATUS TCPGetSocketStatus(PCONNECTION_ENDPOINT Connection, PULONG State);
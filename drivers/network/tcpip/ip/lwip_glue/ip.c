@@ -1,17 +1,180 @@
 #include <lwip/netif.h>
+#include <lwip/ip.h>
+#include <lwip/sys.h>
 #include <lwip/tcpip.h>
 
+#include "lwip_glue.h"
+
 typedef struct netif* PNETIF;
 
+/* Packets processed per core lock acquisition, so API calls don't starve */
+#define LWIP_INPUT_BATCH 16
+
+typedef struct _LWIP_INPUT_PACKET
+{
+    LIST_ENTRY ListEntry;
+    struct pbuf *p;
+    PNETIF netif;
+} LWIP_INPUT_PACKET, *PLWIP_INPUT_PACKET;
+
+typedef struct _LWIP_INPUT_QUEUE
+{
+    KSPIN_LOCK Lock;
+    LIST_ENTRY ListHead;
+    KEVENT Event;
+    ULONG Processor;
+    PKTHREAD Thread;
+
+    /* Connections to indicate received data to once the core lock is dropped */
+    ULONG DeferredCount;
+    PCONNECTION_ENDPOINT Deferred[LWIP_INPUT_BATCH];
+} LWIP_INPUT_QUEUE, *PLWIP_INPUT_QUEUE;
+
+extern KEVENT TerminationEvent;
+
+static PLWIP_INPUT_QUEUE InputQueues;
+static ULONG InputQueueCount;
+static NPAGED_LOOKASIDE_LIST InputPacketLookasideList;
+
 void
 sys_shutdown(void);
 
+static
+ULONG
+LibIPHashPacket(const UCHAR *data, const u32_t size)
+{
+    ULONG HeaderLength, Hash;
+
+    if (size < IP_HLEN)
+        return 0;
+
+    /* Source and destination address */
+    Hash = *(UNALIGNED ULONG *)(data + 12) ^ *(UNALIGNED ULONG *)(data + 16);
+
+    /* Add both ports if this is an unfragmented TCP segment, fragments
+     * only have to be consistent among themselves */
+    HeaderLength = (data[0] & 0x0F) * 4;
+    if (data[9] == IP_PROTO_TCP &&
+        !(*(UNALIGNED USHORT *)(data + 6) & PP_HTONS(IP_MF | IP_OFFMASK)) &&
+        size >= HeaderLength + 4)
+    {
+        Hash ^= *(UNALIGNED ULONG *)(data + HeaderLength);
+    }
+
+    Hash ^= Hash >> 16;
+    Hash ^= Hash >> 8;
+
+    return Hash % InputQueueCount;
+}
+
+static
+void
+LibIPInputThread(void *arg)
+{
+    PLWIP_INPUT_QUEUE Queue = arg;
+    PLWIP_INPUT_PACKET Packet;
+    PLIST_ENTRY Entry;
+    LIST_ENTRY Batch;
+    KIRQL OldIrql;
+    ULONG Count, i;
+    PVOID WaitObjects[] = {&Queue->Event, &TerminationEvent};
+
+    /* Connections hashing to this queue are processed on this processor */
+    KeSetSystemAffinityThread((KAFFINITY)1 << Queue->Processor);
+    Queue->Thread = KeGetCurrentThread();
+
+    while (KeWaitForMultipleObjects(2,
+                                    WaitObjects,
+                                    WaitAny,
+                                    Executive,
+                                    KernelMode,
+                                    FALSE,
+                                    NULL,
+                                    NULL) == STATUS_WAIT_0)
+    {
+        for (;;)
+        {
+            /* Take a batch off the queue */
+            InitializeListHead(&Batch);
+            KeAcquireSpinLock(&Queue->Lock, &OldIrql);
+            for (Count = 0; Count < LWIP_INPUT_BATCH && !IsListEmpty(&Queue->ListHead); Count++)
+            {
+                Entry = RemoveHeadList(&Queue->ListHead);
+                InsertTailList(&Batch, Entry);
+            }
+            if (IsListEmpty(&Queue->ListHead))
+                KeClearEvent(&Queue->Event);
+            KeReleaseSpinLock(&Queue->Lock, OldIrql);
+
+            if (IsListEmpty(&Batch))
+                break;
+
+            LOCK_TCPIP_CORE();
+            while (!IsListEmpty(&Batch))
+            {
+                Entry = RemoveHeadList(&Batch);
+                Packet = CONTAINING_RECORD(Entry, LWIP_INPUT_PACKET, ListEntry);
+
+                ip_input(Packet->p, Packet->netif);
+
+                ExFreeToNPagedLookasideList(&InputPacketLookasideList, Packet);
+            }
+            UNLOCK_TCPIP_CORE();
+
+            /* Copying into the receive buffers doesn't need lwIP, so other
+             * input threads can get on with the protocol work meanwhile */
+            for (i = 0; i < Queue->DeferredCount; i++)
+            {
+                TCPRecvEventHandler(Queue->Deferred[i]);
+                DereferenceObject(Queue->Deferred[i]);
+            }
+            Queue->DeferredCount = 0;
+        }
+    }
+
+    /* DON'T remove ourselves from the thread list! */
+    PsTerminateSystemThread(STATUS_SUCCESS);
+}
+
+BOOLEAN
+LibIPDeferRecvEvent(PCONNECTION_ENDPOINT Connection)
+{
+    PLWIP_INPUT_QUEUE Queue;
+    ULONG Processor, i;
+
+    /* Only an input thread can do it later, it's bound to its queue's processor */
+    Processor = KeGetCurrentProcessorNumber();
+    if (Processor >= InputQueueCount)
+        return FALSE;
+
+    Queue = &InputQueues[Processor];
+    if (Queue->Thread != KeGetCurrentThread())
+        return FALSE;
+
+    for (i = 0; i < Queue->DeferredCount; i++)
+    {
+        if (Queue->Deferred[i] == Connection)
+            return TRUE;
+    }
+
+    if (Queue->DeferredCount == LWIP_INPUT_BATCH)
+        return FALSE;
+
+    ReferenceObject(Connection);
+    Queue->Deferred[Queue->DeferredCount++] = Connection;
+
+    return TRUE;
+}
+
 void
 LibIPInsertPacket(void *ifarg,
                   const void *const data,
                   const u32_t size)
 {
     struct pbuf *p;
+    PLWIP_INPUT_PACKET Packet;
+    PLWIP_INPUT_QUEUE Queue;
+    KIRQL OldIrql;
 
     ASSERT(ifarg);
     ASSERT(data);
@@ -25,20 +188,105 @@ LibIPInsertPacket(void *ifarg,
 
         RtlCopyMemory(p->payload, data, p->len);
 
-        ((PNETIF)ifarg)->input(p, (PNETIF)ifarg);
+        /* With one processor, the tcpip thread does it all */
+        if (!InputQueueCount)
+        {
+            ((PNETIF)ifarg)->input(p, (PNETIF)ifarg);
+            return;
+        }
+
+        Packet = ExAllocateFromNPagedLookasideList(&InputPacketLookasideList);
+        if (!Packet)
+        {
+            pbuf_free(p);
+            return;
+        }
+
+        Packet->p = p;
+        Packet->netif = ifarg;
+
+        /* Steer it to the processor that owns the connection, which also keeps
+         * the segments of one connection in order */
+        Queue = &InputQueues[LibIPHashPacket(data, size)];
+
+        KeAcquireSpinLock(&Queue->Lock, &OldIrql);
+        InsertTailList(&Queue->ListHead, &Packet->ListEntry);
+        KeSetEvent(&Queue->Event, IO_NO_INCREMENT, FALSE);
+        KeReleaseSpinLock(&Queue->Lock, OldIrql);
     }
 }
 
 void
 LibIPInitialize(void)
 {
+    ULONG i;
+
     /* This completes asynchronously */
     tcpip_init(NULL, NULL);
+
+    /* One input thread per processor, the core lock keeps them apart */
+    if (KeNumberProcessors < 2)
+        return;
+
+    InputQueues = ExAllocatePoolWithTag(NonPagedPool,
+                                        KeNumberProcessors * sizeof(LWIP_INPUT_QUEUE),
+                                        LWIP_QUEUE_TAG);
+    if (!InputQueues)
+        return;
+
+    ExInitializeNPagedLookasideList(&InputPacketLookasideList,
+                                    NULL,
+                                    NULL,
+                                    0,
+                                    sizeof(LWIP_INPUT_PACKET),
+                                    LWIP_QUEUE_TAG,
+                                    0);
+
+    for (i = 0; i < (ULONG)KeNumberProcessors; i++)
+    {
+        KeInitializeSpinLock(&InputQueues[i].Lock);
+        InitializeListHead(&InputQueues[i].ListHead);
+        KeInitializeEvent(&InputQueues[i].Event, NotificationEvent, FALSE);
+        InputQueues[i].Processor = i;
+        InputQueues[i].Thread = NULL;
+        InputQueues[i].DeferredCount = 0;
+
+        /* Make do with the processors we got a thread for */
+        if (!sys_thread_new("lwip_input", LibIPInputThread, &InputQueues[i], 0, 0))
+            break;
+    }
+
+    InputQueueCount = i;
 }
 
 void
 LibIPShutdown(void)
 {
+    PLIST_ENTRY Entry;
+    PLWIP_INPUT_PACKET Packet;
+    ULONG i;
+
     /* This is synchronous */
     sys_shutdown();
-}
\ No newline at end of file
+
+    if (!InputQueues)
+        return;
+
+    /* The input threads are gone, drop what they didn't get to */
+    for (i = 0; i < InputQueueCount; i++)
+    {
+        while (!IsListEmpty(&InputQueues[i].ListHead))
+        {
+            Entry = RemoveHeadList(&InputQueues[i].ListHead);
+            Packet = CONTAINING_RECORD(Entry, LWIP_INPUT_PACKET, ListEntry);
+
+            pbuf_free(Packet->p);
+            ExFreeToNPagedLookasideList(&InputPacketLookasideList, Packet);
+        }
+    }
+    InputQueueCount = 0;
+
+    ExDeleteNPagedLookasideList(&InputPacketLookasideList);
+    ExFreePoolWithTag(InputQueues, LWIP_QUEUE_TAG);
+    InputQueues = NULL;
+}
@@ -46,7 +46,7 @@ struct lwip_callback_msg
         struct {
             PCONNECTION_ENDPOINT Connection;
             void *Data;
-            u16_t DataLength;
+            u32_t DataLength;
         } Send;
         struct {
             PCONNECTION_ENDPOINT Connection;
@@ -105,7 +105,7 @@ PTCP_PCB    LibTCPSocket(void *arg);
 VOID        LibTCPFreeSocket(PTCP_PCB pcb);
 err_t       LibTCPBind(PCONNECTION_ENDPOINT Connection, struct ip_addr *const ipaddr, const u16_t port);
 PTCP_PCB    LibTCPListen(PCONNECTION_ENDPOINT Connection, const u8_t backlog);
-err_t       LibTCPSend(PCONNECTION_ENDPOINT Connection, void *const dataptr, const u16_t len, u32_t *sent, const int safe);
+err_t       LibTCPSend(PCONNECTION_ENDPOINT Connection, void *const dataptr, const u32_t len, u32_t *sent, const int safe);
 err_t       LibTCPConnect(PCONNECTION_ENDPOINT Connection, struct ip_addr *const ipaddr, const u16_t port);
 err_t       LibTCPShutdown(PCONNECTION_ENDPOINT Connection, const int shut_rx, const int shut_tx);
 err_t       LibTCPClose(PCONNECTION_ENDPOINT Connection, const int safe, const int callback);
@@ -118,6 +118,7 @@ void        LibTCPGetSocketStatus(PTCP_PCB pcb, PULONG State);
 
 /* IP functions */
 void LibIPInsertPacket(void *ifarg, const void *const data, const u32_t size);
+BOOLEAN LibIPDeferRecvEvent(PCONNECTION_ENDPOINT Connection);
 void LibIPInitialize(void);
 void LibIPShutdown(void);
 
@@ -124,6 +124,50 @@ sys_arch_sem_wait(sys_sem_t* sem, u32_t timeout)
     return SYS_ARCH_TIMEOUT;
 }
 
+err_t
+sys_mutex_new(sys_mutex_t *mutex)
+{
+    /* This is the core lock. A kernel mutex may be acquired recursively, which our
+     * event handlers rely on, and lets waiters keep running at PASSIVE_LEVEL */
+    KeInitializeMutex(&mutex->Mutex, 0);
+
+    mutex->Valid = 1;
+
+    return ERR_OK;
+}
+
+int sys_mutex_valid(sys_mutex_t *mutex)
+{
+    return mutex->Valid;
+}
+
+void sys_mutex_set_invalid(sys_mutex_t *mutex)
+{
+    mutex->Valid = 0;
+}
+
+void
+sys_mutex_free(sys_mutex_t *mutex)
+{
+    sys_mutex_set_invalid(mutex);
+}
+
+void
+sys_mutex_lock(sys_mutex_t *mutex)
+{
+    KeWaitForSingleObject(&mutex->Mutex,
+                          Executive,
+                          KernelMode,
+                          FALSE,
+                          NULL);
+}
+
+void
+sys_mutex_unlock(sys_mutex_t *mutex)
+{
+    KeReleaseMutex(&mutex->Mutex, FALSE);
+}
+
 err_t
 sys_mbox_new(sys_mbox_t *mbox, int size)
 {
@@ -298,7 +342,8 @@ sys_thread_new(const char *name, lwip_thread_fn thread, void *arg, int stacksize
         return 0;
     }
 
-    return 0;
+    /* lwIP itself doesn't look at it, our input threads do */
+    return 1;
 }
 
 void
@@ -18,12 +18,17 @@ static const char * const tcp_state_str[] = {
 };
 
 /* The way that lwIP does multi-threading is really not ideal for our purposes but
- * we best go along with it unless we want another unstable TCP library. lwIP uses
- * a thread called the "tcpip thread" which is the only one allowed to call raw API
- * functions. Since this is the case, for each of our LibTCP* functions, we queue a request
- * for a callback to "tcpip thread" which calls our LibTCP*Callback functions. Yes, this is
- * a lot of unnecessary thread swapping and it could definitely be faster, but I don't want
- * to going messing around in lwIP because I have no desire to create another mess like oskittcp */
+ * we best go along with it unless we want another unstable TCP library. lwIP only
+ * allows one thread at a time to call raw API functions. We used to queue a request
+ * for each of our LibTCP* functions to the "tcpip thread", which meant two thread
+ * switches per call and one processor doing the work of all connections. lwIP keeps
+ * its PCB lists, timers and pools in globals, so we can't run one copy of it per
+ * processor either. Instead we build it with core locking: LibTCP* functions take
+ * the core lock and run their LibTCP*Callback right away on the caller's processor,
+ * and received packets get processed by per-processor input threads (see ip.c).
+ * The core lock is recursive, as our event handlers run with it held, and is always
+ * taken before any connection or address file lock. The input threads only hold it
+ * for the protocol work, received data is copied out once they dropped it. */
 
 extern KEVENT TerminationEvent;
 extern NPAGED_LOOKASIDE_LIST MessageLookasideList;
@@ -32,6 +37,29 @@ extern NPAGED_LOOKASIDE_LIST QueueEntryLookasideList;
 /* Required for ERR_T to NTSTATUS translation in receive error handling */
 NTSTATUS TCPTranslateError(const err_t err);
 
+static
+void
+LibTCPCallCore(tcpip_callback_fn function, struct lwip_callback_msg *msg)
+{
+    LOCK_TCPIP_CORE();
+    function(msg);
+    UNLOCK_TCPIP_CORE();
+}
+
+/* The core lock comes before any object lock, as in the event handlers. Callers
+ * that have to keep a connection locked across LibTCP* calls take it first */
+void
+LibTCPLockCore(void)
+{
+    LOCK_TCPIP_CORE();
+}
+
+void
+LibTCPUnlockCore(void)
+{
+    UNLOCK_TCPIP_CORE();
+}
+
 void
 LibTCPDumpPcb(PVOID SocketContext)
 {
@@ -61,7 +89,7 @@ LibTCPEmptyQueue(PCONNECTION_ENDPOINT Connection)
         Entry = RemoveHeadList(&Connection->PacketQueue);
         qp = CONTAINING_RECORD(Entry, QUEUE_ENTRY, ListEntry);
 
-        /* We're in the tcpip thread here so this is safe */
+        /* We hold the core lock here so this is safe */
         pbuf_free(qp->p);
 
         ExFreeToNPagedLookasideList(&QueueEntryLookasideList, qp);
@@ -229,7 +257,9 @@ InternalRecvEventHandler(void *arg, PTCP_PCB pcb, struct pbuf *p, const err_t er
 
         tcp_recved(pcb, p->tot_len);
 
-        TCPRecvEventHandler(arg);
+        /* On an input thread, fill the receive buffers after dropping the core lock */
+        if (!LibIPDeferRecvEvent(Connection))
+            TCPRecvEventHandler(arg);
     }
     else if (err == ERR_OK)
     {
@@ -343,7 +373,7 @@ LibTCPSocket(void *arg)
         KeInitializeEvent(&msg->Event, NotificationEvent, FALSE);
         msg->Input.Socket.Arg = arg;
 
-        tcpip_callback_with_block(LibTCPSocketCallback, msg, 1);
+        LibTCPCallCore(LibTCPSocketCallback, msg);
 
         if (WaitForEventSafely(&msg->Event))
             ret = msg->Output.Socket.NewPcb;
@@ -379,7 +409,7 @@ void LibTCPFreeSocket(PTCP_PCB pcb)
     KeInitializeEvent(&msg.Event, NotificationEvent, FALSE);
     msg.Input.FreeSocket.pcb = pcb;
 
-    tcpip_callback_with_block(LibTCPFreeSocketCallback, &msg, 1);
+    LibTCPCallCore(LibTCPFreeSocketCallback, &msg);
 
     WaitForEventSafely(&msg.Event);
 }
@@ -425,7 +455,7 @@ LibTCPBind(PCONNECTION_ENDPOINT Connection, struct ip_addr *const ipaddr, const
         msg->Input.Bind.IpAddress = ipaddr;
         msg->Input.Bind.Port = port;
 
-        tcpip_callback_with_block(LibTCPBindCallback, msg, 1);
+        LibTCPCallCore(LibTCPBindCallback, msg);
 
         if (WaitForEventSafely(&msg->Event))
             ret = msg->Output.Bind.Error;
@@ -478,7 +508,7 @@ LibTCPListen(PCONNECTION_ENDPOINT Connection, const u8_t backlog)
         msg->Input.Listen.Connection = Connection;
         msg->Input.Listen.Backlog = backlog;
 
-        tcpip_callback_with_block(LibTCPListenCallback, msg, 1);
+        LibTCPCallCore(LibTCPListenCallback, msg);
 
         if (WaitForEventSafely(&msg->Event))
             ret = msg->Output.Listen.NewPcb;
@@ -526,7 +556,8 @@ LibTCPSendCallback(void *arg)
     }
     else if (tcp_sndbuf(pcb) < SendLength)
     {
-        /* We've got some room so let's send what we can */
+        /* We've got some room so let's send what we can, this also keeps
+         * requests larger than 64K within what tcp_write takes */
         SendLength = tcp_sndbuf(pcb);
 
         /* Don't set the push flag */
@@ -554,7 +585,7 @@ done:
 }
 
 err_t
-LibTCPSend(PCONNECTION_ENDPOINT Connection, void *const dataptr, const u16_t len, u32_t *sent, const int safe)
+LibTCPSend(PCONNECTION_ENDPOINT Connection, void *const dataptr, const u32_t len, u32_t *sent, const int safe)
 {
     err_t ret;
     struct lwip_callback_msg *msg;
@@ -570,7 +601,7 @@ LibTCPSend(PCONNECTION_ENDPOINT Connection, void *const dataptr, const u16_t len
         if (safe)
             LibTCPSendCallback(msg);
         else
-            tcpip_callback_with_block(LibTCPSendCallback, msg, 1);
+            LibTCPCallCore(LibTCPSendCallback, msg);
 
         if (WaitForEventSafely(&msg->Event))
             ret = msg->Output.Send.Error;
@@ -632,7 +663,7 @@ LibTCPConnect(PCONNECTION_ENDPOINT Connection, struct ip_addr *const ipaddr, con
         msg->Input.Connect.IpAddress = ipaddr;
         msg->Input.Connect.Port = port;
 
-        tcpip_callback_with_block(LibTCPConnectCallback, msg, 1);
+        LibTCPCallCore(LibTCPConnectCallback, msg);
 
         if (WaitForEventSafely(&msg->Event))
         {
@@ -728,7 +759,7 @@ LibTCPShutdown(PCONNECTION_ENDPOINT Connection, const int shut_rx, const int shu
         msg->Input.Shutdown.shut_rx = shut_rx;
         msg->Input.Shutdown.shut_tx = shut_tx;
 
-        tcpip_callback_with_block(LibTCPShutdownCallback, msg, 1);
+        LibTCPCallCore(LibTCPShutdownCallback, msg);
 
         if (WaitForEventSafely(&msg->Event))
             ret = msg->Output.Shutdown.Error;
@@ -811,7 +842,7 @@ LibTCPClose(PCONNECTION_ENDPOINT Connection, const int safe, const int callback)
         if (safe)
             LibTCPCloseCallback(msg);
         else
-            tcpip_callback_with_block(LibTCPCloseCallback, msg, 1);
+            LibTCPCallCore(LibTCPCloseCallback, msg);
 
         if (WaitForEventSafely(&msg->Event))
             ret = msg->Output.Close.Error;
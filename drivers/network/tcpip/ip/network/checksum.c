@@ -56,6 +56,30 @@ ULONG ChecksumCompute(
   return Sum;
 }
 
+ULONG
+TCPv4PseudoHeaderChecksum(
+  PIPv4_HEADER IPHeader,
+  ULONG TCPLength)
+/*
+ * FUNCTION: Calculate the unfolded sum of a TCP pseudo header
+ * ARGUMENTS:
+ *     IPHeader  = Pointer to the IPv4 header of the datagram
+ *     TCPLength = Length of the TCP segment, 0 to leave it out
+ * RETURNS:
+ *     Sum to seed ChecksumCompute() with for the TCP segment
+ */
+{
+  TCPv4_PSEUDO_HEADER PseudoHeader;
+
+  PseudoHeader.SourceAddress = IPHeader->SrcAddr;
+  PseudoHeader.DestinationAddress = IPHeader->DstAddr;
+  PseudoHeader.Zero = 0;
+  PseudoHeader.Protocol = IPPROTO_TCP;
+  PseudoHeader.TCPLength = WH2N((USHORT)TCPLength);
+
+  return ChecksumCompute(&PseudoHeader, sizeof(PseudoHeader), 0);
+}
+
 ULONG
 UDPv4ChecksumCalculate(
   PIPv4_HEADER IPHeader,
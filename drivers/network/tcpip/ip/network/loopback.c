@@ -78,6 +78,11 @@ VOID LoopTransmit(
 
             IPPacket->MappedHeader = TRUE;
 
+            /* Checksums were left out on the way down, nothing can
+             * have damaged the data since */
+            IPPacket->Flags = IP_PACKET_FLAG_IP_CHECKSUM_OK |
+                              IP_PACKET_FLAG_TCP_CHECKSUM_OK;
+
             if (!ChewCreate(LoopPassiveWorker, IPPacket))
             {
                 IPPacket->Free(IPPacket);
@@ -122,6 +127,14 @@ NDIS_STATUS LoopRegisterAdapter(
 
   Loopback->MTU = 16384;
 
+  /* Pretend to offload everything, there is no wire to protect against
+   * and large TCP segments are received as they are */
+  Loopback->Offload = IP_OFFLOAD_TX_IP_CHECKSUM | IP_OFFLOAD_TX_TCP_CHECKSUM |
+                      IP_OFFLOAD_RX_IP_CHECKSUM | IP_OFFLOAD_RX_TCP_CHECKSUM |
+                      IP_OFFLOAD_LARGE_SEND;
+  Loopback->LargeSendSize = IP_MAXIMUM_LARGE_SEND_SIZE;
+  TCPUpdateInterfaceOffload(Loopback);
+
   Loopback->Name.Buffer = L"Loopback";
   Loopback->Name.MaximumLength = Loopback->Name.Length =
       (USHORT)wcslen(Loopback->Name.Buffer) * sizeof(WCHAR);
@@ -292,6 +292,7 @@ VOID ProcessFragment(
   IP_PACKET Datagram;
   PIP_FRAGMENT Fragment;
   BOOLEAN Success;
+  BOOLEAN NewAssembly;
 
   /* FIXME: Assume IPv4 */
 
@@ -299,6 +300,7 @@ VOID ProcessFragment(
 
   /* Check if we already have an reassembly structure for this datagram */
   IPDR = GetReassemblyInfo(IPPacket);
+  NewAssembly = (IPDR == NULL);
   if (IPDR) {
     TI_DbgPrint(DEBUG_IP, ("Continueing assembly.\n"));
     /* We have a reassembly structure */
@@ -461,6 +463,10 @@ VOID ProcessFragment(
     /* FIXME: Assumes IPv4 */
     IPInitializePacket(&Datagram, IP_ADDRESS_V4);
 
+    /* What the link layer checked still holds if it came in one piece */
+    if (NewAssembly && FragFirst == 0 && !MoreFragments)
+      Datagram.Flags |= IPPacket->Flags & IP_PACKET_FLAG_TCP_CHECKSUM_OK;
+
     Success = ReassembleDatagram(&Datagram, IPDR);
 
     FreeIPDR(IPDR);
@@ -611,8 +617,9 @@ VOID IPv4Receive(PIP_INTERFACE IF, PIP_PACKET IPPacket)
         return;
     }
 
-    /* Checksum IPv4 header */
-    if (!IPv4CorrectChecksum(IPPacket->Header, IPPacket->HeaderSize)) {
+    /* Checksum IPv4 header, unless the link layer did */
+    if (!(IPPacket->Flags & IP_PACKET_FLAG_IP_CHECKSUM_OK) &&
+        !IPv4CorrectChecksum(IPPacket->Header, IPPacket->HeaderSize)) {
         TI_DbgPrint(MIN_TRACE, ("Datagram received with bad checksum. Checksum field (0x%X)\n",
 	      WN2H(((PIPv4_HEADER)IPPacket->Header)->Checksum)));
         /* Discard packet */
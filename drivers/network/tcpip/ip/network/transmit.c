@@ -75,6 +75,7 @@ BOOLEAN PrepareNextFragment(
     PIPv4_HEADER Header;
     BOOLEAN MoreFragments;
     USHORT FragOfs;
+    NDIS_TCP_IP_CHECKSUM_PACKET_INFO ChecksumInfo;
 
     TI_DbgPrint(MAX_TRACE, ("Called. IFC (0x%X)\n", IFC));
 
@@ -112,9 +113,14 @@ BOOLEAN PrepareNextFragment(
 
         /* FIXME: Handle options */
 
-        /* Calculate checksum of IP header */
+        /* Calculate checksum of IP header, unless the link layer does it.
+         * A large send gets one for each segment */
+        ChecksumInfo.Value = PtrToUlong(NDIS_PER_PACKET_INFO_FROM_PACKET(IFC->NdisPacket,
+                                                                         TcpIpChecksumPacketInfo));
         Header->Checksum = 0;
-        Header->Checksum = (USHORT)IPv4Checksum(Header, IFC->HeaderSize, 0);
+        if (!ChecksumInfo.Transmit.NdisPacketIpChecksum &&
+            !NDIS_PER_PACKET_INFO_FROM_PACKET(IFC->NdisPacket, TcpLargeSendPacketInfo))
+            Header->Checksum = (USHORT)IPv4Checksum(Header, IFC->HeaderSize, 0);
 	TI_DbgPrint(MID_TRACE,("IP Check: %x\n", Header->Checksum));
 
         /* Update pointers */
@@ -148,12 +154,18 @@ NTSTATUS SendFragments(
     PIPFRAGMENT_CONTEXT IFC;
     NDIS_STATUS NdisStatus;
     PVOID Data;
-    UINT BufferSize = PathMTU, InSize;
+    UINT BufferSize, InSize;
     PCHAR InData;
 
     TI_DbgPrint(MAX_TRACE, ("Called. IPPacket (0x%X)  NCE (0x%X)  PathMTU (%d).\n",
         IPPacket, NCE, PathMTU));
 
+    /* A large send goes down in one piece, the link layer segments it */
+    if (NDIS_PER_PACKET_INFO_FROM_PACKET(IPPacket->NdisPacket, TcpLargeSendPacketInfo))
+        PathMTU = IPPacket->TotalSize;
+
+    BufferSize = PathMTU;
+
     /* Make a smaller buffer if we will only send one fragment */
     GetDataPtr( IPPacket->NdisPacket, IPPacket->Position, &InData, &InSize );
     if( InSize < BufferSize ) BufferSize = InSize;
@@ -179,6 +191,16 @@ NTSTATUS SendFragments(
 
     GetDataPtr( IFC->NdisPacket, 0, (PCHAR *)&Data, &InSize );
 
+    /* Pass on the work the link layer is to do for us, it can't be done
+     * on fragments */
+    if (IPPacket->TotalSize <= PathMTU)
+    {
+        NDIS_PER_PACKET_INFO_FROM_PACKET(IFC->NdisPacket, TcpIpChecksumPacketInfo) =
+            NDIS_PER_PACKET_INFO_FROM_PACKET(IPPacket->NdisPacket, TcpIpChecksumPacketInfo);
+        NDIS_PER_PACKET_INFO_FROM_PACKET(IFC->NdisPacket, TcpLargeSendPacketInfo) =
+            NDIS_PER_PACKET_INFO_FROM_PACKET(IPPacket->NdisPacket, TcpLargeSendPacketInfo);
+    }
+
     IFC->Header       = ((PCHAR)Data);
     IFC->Datagram     = IPPacket->NdisPacket;
     IFC->DatagramData = ((PCHAR)IPPacket->Header) + IPPacket->HeaderSize;
@@ -52,6 +52,8 @@ NTSTATUS TCPListen(PCONNECTION_ENDPOINT Connection, UINT Backlog)
 
     ASSERT(Connection);
 
+    /* Same order as the event handlers, we call into lwIP with the connection locked */
+    LibTCPLockCore();
     LockObject(Connection);
 
     ASSERT_KM_POINTER(Connection->AddressFile);
@@ -83,6 +85,7 @@ NTSTATUS TCPListen(PCONNECTION_ENDPOINT Connection, UINT Backlog)
                 {
                     DbgPrint("ERR: No more ports available.\n");
                     UnlockObject(Connection);
+                    LibTCPUnlockCore();
                     return STATUS_TOO_MANY_ADDRESSES;
                 }
                 Connection->AddressFile->Port = AllocatedPort;
@@ -98,6 +101,7 @@ NTSTATUS TCPListen(PCONNECTION_ENDPOINT Connection, UINT Backlog)
     }
 
     UnlockObject(Connection);
+    LibTCPUnlockCore();
 
     TI_DbgPrint(DEBUG_TCP,("[IP, TCPListen] Leaving. Status = %x\n", Status));
 
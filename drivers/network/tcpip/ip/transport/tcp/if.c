@@ -8,6 +8,70 @@
 #include "lwip/tcpip.h"
 #include <ipifcons.h>
 
+static
+VOID
+TCPPrepareChecksum(PIP_INTERFACE Interface,
+                   struct netif *netif,
+                   PIP_PACKET Packet)
+{
+    PIPv4_HEADER Header = Packet->Header;
+    PTCPv4_HEADER TCPHeader;
+    NDIS_TCP_IP_CHECKSUM_PACKET_INFO ChecksumInfo;
+    ULONG TCPLength;
+    BOOLEAN LargeSend = FALSE;
+
+    if (Header->Protocol != IPPROTO_TCP)
+        return;
+
+    TCPHeader = (PTCPv4_HEADER)((PCHAR)Header + Packet->HeaderSize);
+    TCPLength = Packet->TotalSize - Packet->HeaderSize;
+    TCPHeader->Checksum = 0;
+
+    ChecksumInfo.Value = 0;
+    if (Packet->TotalSize > Interface->MTU)
+    {
+        /* Segments merged by lwIP, unless we landed on another interface.
+         * The link layer splits them up and does all checksums then */
+        LargeSend = (Interface->Offload & IP_OFFLOAD_LARGE_SEND) &&
+                    netif->lso_mss != 0 &&
+                    TCPLength - TCP_DATA_OFFSET(TCPHeader->DataOffset) <= Interface->LargeSendSize;
+    }
+    else
+    {
+        if (Interface->Offload & IP_OFFLOAD_TX_TCP_CHECKSUM)
+            ChecksumInfo.Transmit.NdisPacketTcpChecksum = 1;
+        if (Interface->Offload & IP_OFFLOAD_TX_IP_CHECKSUM)
+            ChecksumInfo.Transmit.NdisPacketIpChecksum = 1;
+    }
+
+    if (LargeSend)
+    {
+        /* The length differs for each segment, so it is left out */
+        TCPHeader->Checksum = (USHORT)ChecksumFold(TCPv4PseudoHeaderChecksum(Header, 0));
+
+        NDIS_PER_PACKET_INFO_FROM_PACKET(Packet->NdisPacket, TcpLargeSendPacketInfo) =
+            UlongToPtr(netif->lso_mss);
+    }
+    else if (ChecksumInfo.Transmit.NdisPacketTcpChecksum)
+    {
+        /* The link layer adds the rest */
+        TCPHeader->Checksum = (USHORT)ChecksumFold(TCPv4PseudoHeaderChecksum(Header, TCPLength));
+
+        ChecksumInfo.Transmit.NdisPacketChecksumV4 = 1;
+    }
+    else
+    {
+        TCPHeader->Checksum = (USHORT)~ChecksumFold(
+            ChecksumCompute(TCPHeader, TCPLength, TCPv4PseudoHeaderChecksum(Header, TCPLength)));
+
+        if (ChecksumInfo.Transmit.NdisPacketIpChecksum)
+            ChecksumInfo.Transmit.NdisPacketChecksumV4 = 1;
+    }
+
+    NDIS_PER_PACKET_INFO_FROM_PACKET(Packet->NdisPacket, TcpIpChecksumPacketInfo) =
+        UlongToPtr(ChecksumInfo.Value);
+}
+
 err_t
 TCPSendDataCallback(struct netif *netif, struct pbuf *p, struct ip_addr *dest)
 {
@@ -71,6 +135,8 @@ TCPSendDataCallback(struct netif *netif, struct pbuf *p, struct ip_addr *dest)
     Packet.SrcAddr = LocalAddress;
     Packet.DstAddr = RemoteAddress;
 
+    TCPPrepareChecksum(NCE->Interface, netif, &Packet);
+
     NdisStatus = IPSendDatagram(&Packet, NCE);
     if (!NT_SUCCESS(NdisStatus))
         return ERR_RTE;
@@ -101,6 +167,8 @@ TCPInterfaceInit(struct netif *netif)
 
     netif->output = TCPSendDataCallback;
     netif->mtu = IF->MTU;
+    netif->lso_max_size = IF->LargeSendSize;
+    netif->lso_mss = 0;
 
     netif->name[0] = 'e';
     netif->name[1] = 'n';
@@ -114,6 +182,15 @@ TCPInterfaceInit(struct netif *netif)
     return 0;
 }
 
+VOID
+TCPUpdateInterfaceOffload(PIP_INTERFACE IF)
+{
+    struct netif *netif = IF->TCPContext;
+
+    /* lwIP only merges segments for interfaces that split them up again */
+    netif->lso_max_size = (IF->Offload & IP_OFFLOAD_LARGE_SEND) ? IF->LargeSendSize : 0;
+}
+
 VOID
 TCPRegisterInterface(PIP_INTERFACE IF)
 {
@@ -155,6 +155,7 @@ NTSTATUS TCPSocket( PCONNECTION_ENDPOINT Connection,
 {
     NTSTATUS Status;
 
+    LibTCPLockCore();
     LockObject(Connection);
 
     TI_DbgPrint(DEBUG_TCP,("[IP, TCPSocket] Called: Connection %x, Family %d, Type %d, "
@@ -168,6 +169,7 @@ NTSTATUS TCPSocket( PCONNECTION_ENDPOINT Connection,
         Status = STATUS_INSUFFICIENT_RESOURCES;
 
     UnlockObject(Connection);
+    LibTCPUnlockCore();
 
     TI_DbgPrint(DEBUG_TCP,("[IP, TCPSocket] Leaving. Status = 0x%x\n", Status));
 
@@ -198,10 +200,27 @@ VOID TCPReceive(PIP_INTERFACE Interface, PIP_PACKET IPPacket)
  *     This is the low level interface for receiving TCP data
  */
 {
+    PIPv4_HEADER IPv4Header = IPPacket->Header;
+    ULONG TCPLength = IPPacket->TotalSize - IPPacket->HeaderSize;
+    ULONG Sum;
+
     TI_DbgPrint(DEBUG_TCP,("Sending packet %d (%d) to lwIP\n",
                            IPPacket->TotalSize,
                            IPPacket->HeaderSize));
 
+    /* lwIP leaves this to us, unless the link layer did it already */
+    if (!(IPPacket->Flags & IP_PACKET_FLAG_TCP_CHECKSUM_OK))
+    {
+        Sum = ChecksumCompute((PCHAR)IPPacket->Header + IPPacket->HeaderSize,
+                              TCPLength,
+                              TCPv4PseudoHeaderChecksum(IPv4Header, TCPLength));
+        if (ChecksumFold(Sum) != 0xFFFF)
+        {
+            TI_DbgPrint(MIN_TRACE, ("Bad TCP checksum, dropping packet.\n"));
+            return;
+        }
+    }
+
     LibIPInsertPacket(Interface->TCPContext, IPPacket->Header, IPPacket->TotalSize);
 }
 
@@ -332,11 +351,14 @@ NTSTATUS TCPConnect
                  RemoteAddress.Address.IPv4Address,
                  RemotePort));
 
+    /* Same order as the event handlers, we bind with the connection locked */
+    LibTCPLockCore();
     LockObject(Connection);
 
     if (!Connection->AddressFile)
     {
         UnlockObject(Connection);
+        LibTCPUnlockCore();
         return STATUS_INVALID_PARAMETER;
     }
 
@@ -345,6 +367,7 @@ NTSTATUS TCPConnect
         if (!(NCE = RouteGetRouteToDestination(&RemoteAddress)))
         {
             UnlockObject(Connection);
+            LibTCPUnlockCore();
             return STATUS_NETWORK_UNREACHABLE;
         }
 
@@ -362,6 +385,7 @@ NTSTATUS TCPConnect
     if (!NT_SUCCESS(Status))
     {
         UnlockObject(Connection);
+        LibTCPUnlockCore();
         return Status;
     }
 
@@ -377,6 +401,7 @@ NTSTATUS TCPConnect
         if (!NT_SUCCESS(Status))
         {
             UnlockObject(Connection);
+            LibTCPUnlockCore();
             return Status;
         }
 
@@ -387,6 +412,7 @@ NTSTATUS TCPConnect
         {
             DbgPrint("ERR: No more ports available.\n");
             UnlockObject(Connection);
+            LibTCPUnlockCore();
             return STATUS_TOO_MANY_ADDRESSES;
         }
         Connection->AddressFile->Port = AllocatedPort;
@@ -398,6 +424,7 @@ NTSTATUS TCPConnect
     if (!Bucket)
     {
         UnlockObject(Connection);
+        LibTCPUnlockCore();
         return STATUS_NO_MEMORY;
     }
 
@@ -407,6 +434,7 @@ NTSTATUS TCPConnect
     InsertTailList( &Connection->ConnectRequest, &Bucket->Entry );
 
     UnlockObject(Connection);
+    LibTCPUnlockCore();
 
     Status = TCPTranslateError(LibTCPConnect(Connection,
                                                 &connaddr,
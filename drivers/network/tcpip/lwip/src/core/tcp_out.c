@@ -429,6 +429,13 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
 
     /* Usable space at the end of the last unsent segment */
     unsent_optlen = LWIP_TCP_OPT_LENGTH(last_unsent->flags);
+#ifdef __REACTOS__
+    /* A retransmitted segment may have been merged for large send offload
+       and be bigger than mss_local */
+    if (last_unsent->len + unsent_optlen >= mss_local) {
+      space = 0;
+    } else
+#endif /* __REACTOS__ */
     space = mss_local - (last_unsent->len + unsent_optlen);
 
     /*
@@ -887,6 +894,53 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
   return ERR_OK;
 }
 
+#ifdef __REACTOS__
+/**
+ * Merge the unsent segments following seg into seg, as long as the link
+ * layer splits the result up for us again (large send offload) and the
+ * window lets all of it go out at once.
+ *
+ * @param pcb the tcp_pcb for the TCP connection seg is sent on
+ * @param seg the first unsent segment, which is about to be sent
+ * @param netif the interface seg is going out on
+ * @param wnd the usable send window
+ */
+static void
+tcp_output_merge_segments(struct tcp_pcb *pcb, struct tcp_seg *seg,
+                          struct netif *netif, u32_t wnd)
+{
+  struct tcp_seg *next;
+  u16_t hdrlen = TCP_HLEN + LWIP_TCP_OPT_LENGTH(seg->flags);
+
+  /* The link layer puts this much data in each segment it sends */
+  netif->lso_mss = pcb->mss - LWIP_TCP_OPT_LENGTH(seg->flags);
+
+  while ((next = seg->next) != NULL &&
+         (TCPH_FLAGS(seg->tcphdr) & (TCP_SYN | TCP_FIN | TCP_RST)) == 0 &&
+         (TCPH_FLAGS(next->tcphdr) & (TCP_SYN | TCP_RST)) == 0 &&
+         next->flags == seg->flags &&
+         ntohl(next->tcphdr->seqno) == ntohl(seg->tcphdr->seqno) + seg->len &&
+         (u32_t)seg->len + next->len <= netif->lso_max_size &&
+         ntohl(seg->tcphdr->seqno) - pcb->lastack + seg->len + next->len <= wnd) {
+    /* Only keep the data, the header of seg covers all of it. A segment
+       that went out before (tcp_rexmit_rto) still has its payload moved
+       back to the IP header, strip that too */
+    pbuf_header(next->p, -(s16_t)((u8_t *)next->tcphdr - (u8_t *)next->p->payload + hdrlen));
+    pbuf_cat(seg->p, next->p);
+    seg->len += next->len;
+    TCPH_SET_FLAG(seg->tcphdr, TCPH_FLAGS(next->tcphdr) & (TCP_PSH | TCP_FIN));
+#if TCP_OVERSIZE_DBGCHECK
+    /* seg goes out right away, so it can't be grown anymore */
+    seg->oversize_left = 0;
+#endif /* TCP_OVERSIZE_DBGCHECK */
+
+    seg->next = next->next;
+    next->p = NULL;
+    tcp_seg_free(next);
+  }
+}
+#endif /* __REACTOS__ */
+
 /**
  * Find out what we can send and send it
  *
@@ -899,6 +953,9 @@ tcp_output(struct tcp_pcb *pcb)
 {
   struct tcp_seg *seg, *useg;
   u32_t wnd, snd_nxt;
+#ifdef __REACTOS__
+  struct netif *lso_netif = NULL;
+#endif /* __REACTOS__ */
 #if TCP_CWND_DEBUG
   s16_t i = 0;
 #endif /* TCP_CWND_DEBUG */
@@ -931,6 +988,16 @@ tcp_output(struct tcp_pcb *pcb)
      return tcp_send_empty_ack(pcb);
   }
 
+#ifdef __REACTOS__
+  /* Segments can only be merged if the interface splits them up again */
+  if (seg != NULL) {
+    lso_netif = ip_route(&(pcb->remote_ip));
+    if (lso_netif != NULL && lso_netif->lso_max_size == 0) {
+      lso_netif = NULL;
+    }
+  }
+#endif /* __REACTOS__ */
+
   /* useg should point to last segment on unacked queue */
   useg = pcb->unacked;
   if (useg != NULL) {
@@ -983,6 +1050,12 @@ tcp_output(struct tcp_pcb *pcb)
     ++i;
 #endif /* TCP_CWND_DEBUG */
 
+#ifdef __REACTOS__
+    if (lso_netif != NULL) {
+      tcp_output_merge_segments(pcb, seg, lso_netif, wnd);
+    }
+#endif /* __REACTOS__ */
+
     pcb->unsent = seg->next;
 
     if (pcb->state != SYN_SENT) {
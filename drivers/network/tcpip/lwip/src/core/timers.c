@@ -82,6 +82,11 @@ tcpip_tcp_timer(void *arg)
 
   /* call TCP timer handler */
   tcp_tmr();
+#ifdef __REACTOS__
+  /* Keep it running. With core locking, tcp_timer_needed() gets called outside
+     tcpip_thread, which has to stay the only one to touch the timeout list */
+  sys_timeout(TCP_TMR_INTERVAL, tcpip_tcp_timer, NULL);
+#else
   /* timer still needed? */
   if (tcp_active_pcbs || tcp_tw_pcbs) {
     /* restart timer */
@@ -90,6 +95,7 @@ tcpip_tcp_timer(void *arg)
     /* disable timer */
     tcpip_tcp_timer_active = 0;
   }
+#endif
 }
 
 /**
@@ -222,6 +228,10 @@ dns_timer(void *arg)
 /** Initialize this module */
 void sys_timeouts_init(void)
 {
+#if defined(__REACTOS__) && LWIP_TCP
+  tcpip_tcp_timer_active = 1;
+  sys_timeout(TCP_TMR_INTERVAL, tcpip_tcp_timer, NULL);
+#endif /* __REACTOS__ && LWIP_TCP */
 #if IP_REASSEMBLY
   sys_timeout(IP_TMR_INTERVAL, ip_reass_timer, NULL);
 #endif /* IP_REASSEMBLY */
@@ -184,6 +184,14 @@ struct netif {
 #endif /* LWIP_NETIF_HOSTNAME */
   /** maximum transfer unit (in bytes) */
   u16_t mtu;
+#ifdef __REACTOS__
+  /** most TCP data (headers not included) the link layer splits up
+      for us in one segment, 0 without large send offload */
+  u16_t lso_max_size;
+  /** payload size of the pieces, set by tcp_output() for the segment
+      it is about to send */
+  u16_t lso_mss;
+#endif /* __REACTOS__ */
   /** number of bytes used in hwaddr */
   u8_t hwaddr_len;
   /** link level hardware address of this interface */
@@ -492,6 +492,90 @@ START_TEST(test_tcp_rto_rexmit_wraparound)
 }
 END_TEST
 
+#ifdef __REACTOS__
+/** Send 3 segments, let the RTO fire and check that a large send merge of the
+ * segments that went out before keeps the data intact. */
+START_TEST(test_tcp_rto_rexmit_lso_merge)
+{
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb* pcb;
+  ip_addr_t remote_ip, local_ip, netmask;
+  u16_t remote_port = 0x100, local_port = 0x101;
+  err_t err;
+  u16_t i, sent_total = 0;
+  u8_t sent[5 * TCP_MSS];
+  LWIP_UNUSED_ARG(_i);
+
+  for (i = 0; i < sizeof(tx_data); i++) {
+    tx_data[i] = (u8_t)i;
+  }
+
+  /* initialize local vars */
+  IP4_ADDR(&local_ip,  192, 168,   1, 1);
+  IP4_ADDR(&remote_ip, 192, 168,   1, 2);
+  IP4_ADDR(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, &txcounters, &local_ip, &netmask);
+  memset(&counters, 0, sizeof(counters));
+
+  /* create and initialize the pcb */
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &local_ip, &remote_ip, local_port, remote_port);
+  pcb->mss = TCP_MSS;
+  /* disable initial congestion window (we don't send a SYN here...) */
+  pcb->cwnd = 3*TCP_MSS;
+
+  /* send 6 mss-sized segments, the first 3 go out one by one */
+  for (i = 0; i < 6; i++) {
+    err = tcp_write(pcb, &tx_data[sent_total], TCP_MSS, TCP_WRITE_FLAG_COPY);
+    EXPECT_RET(err == ERR_OK);
+    sent_total += TCP_MSS;
+  }
+  err = tcp_output(pcb);
+  EXPECT(txcounters.num_tx_calls == 3);
+  memset(&txcounters, 0, sizeof(txcounters));
+
+  /* RTO rexmit fires and sends the first segment again. The 2nd and 3rd go
+     back on unsent with their payload still moved to the IP header */
+  for (i = 0; i < 11; i++) {
+    test_tcp_tmr();
+  }
+  EXPECT(txcounters.num_tx_calls == 1);
+  memset(&txcounters, 0, sizeof(txcounters));
+
+  /* now let the netif split large segments, and open the window */
+  netif.lso_max_size = 5 * TCP_MSS;
+  pcb->cwnd = pcb->snd_wnd;
+  txcounters.copy_tx_packets = 1;
+  err = tcp_output(pcb);
+  txcounters.copy_tx_packets = 0;
+  EXPECT(err == ERR_OK);
+  EXPECT(pcb->unsent == NULL);
+
+  /* everything after the first segment went out as one, without any
+     header bytes in the data */
+  EXPECT(txcounters.num_tx_calls == 1);
+  EXPECT(txcounters.num_tx_bytes == 5 * TCP_MSS + 40U);
+  EXPECT(txcounters.tx_packets != NULL);
+  if (txcounters.tx_packets != NULL) {
+    u16_t ret;
+    ret = pbuf_copy_partial(txcounters.tx_packets, sent, sizeof(sent), 40U);
+    EXPECT(ret == sizeof(sent));
+    EXPECT(memcmp(sent, &tx_data[TCP_MSS], sizeof(sent)) == 0);
+    pbuf_free(txcounters.tx_packets);
+    txcounters.tx_packets = NULL;
+  }
+
+  /* make sure the pcb is freed */
+  EXPECT_RET(lwip_stats.memp[MEMP_TCP_PCB].used == 1);
+  tcp_abort(pcb);
+  EXPECT_RET(lwip_stats.memp[MEMP_TCP_PCB].used == 0);
+}
+END_TEST
+#endif /* __REACTOS__ */
+
 /** Provoke fast retransmission by duplicate ACKs and then recover by ACKing all sent data.
  * At the end, send more data. */
 static void test_tcp_tx_full_window_lost(u8_t zero_window_probe_from_unsent)
@@ -660,6 +744,9 @@ tcp_suite(void)
     test_tcp_fast_retx_recover,
     test_tcp_fast_rexmit_wraparound,
     test_tcp_rto_rexmit_wraparound,
+#ifdef __REACTOS__
+    test_tcp_rto_rexmit_lso_merge,
+#endif /* __REACTOS__ */
     test_tcp_tx_full_window_lost_from_unacked,
     test_tcp_tx_full_window_lost_from_unsent
   };
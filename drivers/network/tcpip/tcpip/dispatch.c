@@ -594,12 +594,16 @@ NTSTATUS DispTdiListen(
        Irp,
        (PDRIVER_CANCEL)DispCancelListenRequest);
 
+  /* The listener is created with both objects locked, so take the lwIP core
+   * lock first like the event handlers do */
+  LibTCPLockCore();
   LockObject(Connection);
 
   if (Connection->AddressFile == NULL)
   {
      TI_DbgPrint(MID_TRACE, ("No associated address file\n"));
      UnlockObject(Connection);
+     LibTCPUnlockCore();
      Status = STATUS_INVALID_PARAMETER;
      goto done;
   }
@@ -647,6 +651,7 @@ NTSTATUS DispTdiListen(
 
   UnlockObject(Connection->AddressFile);
   UnlockObject(Connection);
+  LibTCPUnlockCore();
 
 done:
   if (Status != STATUS_PENDING) {
@@ -499,6 +499,7 @@ AhciHwPassiveInitialize (
             PortExtension = &AdapterExtension->PortExtension[index];
             PortExtension->DeviceParams.IsActive = AhciStartPort(PortExtension);
             StorPortInitializeDpc(AdapterExtension, &PortExtension->CommandCompletion, AhciCommandCompletionDpcRoutine);
+            StorPortInitializeDpc(AdapterExtension, &PortExtension->ErrorRecovery, AhciErrorRecoveryDpcRoutine);
         }
     }
 
@@ -579,9 +580,10 @@ AhciCompleteIssuedSrb (
 
     for (i = 0; i < NCS; i++)
     {
-        if (((1 << i) & CommandsToComplete) != 0)
+        if (((1UL << i) & CommandsToComplete) != 0)
         {
             Srb = PortExtension->Slot[i];
+            PortExtension->Slot[i] = NULL;
 
             if (Srb == NULL)
             {
@@ -608,9 +610,208 @@ AhciCompleteIssuedSrb (
     return;
 }// -- AhciCompleteIssuedSrb();
 
+/**
+ * @name AhciPortErrorRecovery
+ * @implemented
+ *
+ * Restart the port after a fatal error (section 6.2.2) and give back
+ * the commands it aborted. Runs at DISPATCH_LEVEL, the interrupt handler
+ * has latched the error and turned the port interrupts off.
+ *
+ * @param PortExtension
+ *
+ */
+VOID
+AhciPortErrorRecovery (
+    __in PAHCI_PORT_EXTENSION PortExtension
+    )
+{
+    AHCI_PORT_CMD cmd;
+    AHCI_TASK_FILE_DATA tfd;
+    AHCI_SERIAL_ATA_STATUS ssts;
+    AHCI_SERIAL_ATA_CONTROL sctl;
+    PSCSI_REQUEST_BLOCK Srb;
+    PAHCI_SRB_EXTENSION SrbExtension;
+    PSCSI_REQUEST_BLOCK failedSrb = NULL;
+    PAHCI_ADAPTER_EXTENSION AdapterExtension;
+    STOR_LOCK_HANDLE lockhandle = {0};
+    ULONG aborted, failedSlot, index, i, NCS;
+
+    AhciDebugPrint("AhciPortErrorRecovery()\n");
+
+    AdapterExtension = PortExtension->AdapterExtension;
+    NCS = AHCI_Global_Port_CAP_NCS(AdapterExtension->CAP);
+
+    // Nothing else touches the halted port until ErrorRecoveryPending is cleared,
+    // so the register polling below runs without the interrupt lock
+    aborted = PortExtension->AbortedSlots;
+    failedSlot = PortExtension->FailedSlot;
+
+    // 10.4.2 clear PxCMD.ST and wait up to 500 milliseconds for PxCMD.CR to clear
+    cmd.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->CMD);
+    cmd.ST = 0;
+    StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->CMD, cmd.Status);
+
+    index = 0;
+    do
+    {
+        StorPortStallExecution(1000);
+        cmd.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->CMD);
+        index++;
+    }
+    while ((cmd.CR != 0) && (index < 500));
+
+    StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->SERR, (ULONG)~0);
+    StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->IS, (ULONG)~0);
+
+    // After a native queued command failed, the device aborts the others and refuses new ones
+    // until its NCQ error log is read. Reading the log needs a command table of its own,
+    // a COMRESET clears that state as well as a device stuck in BSY or DRQ.
+    tfd.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->TFD);
+    if (((aborted & PortExtension->QueuedSlots) != 0) || tfd.STS.BSY || tfd.STS.DRQ)
+    {
+        AhciDebugPrint("\tCOMRESET\n");
+
+        sctl.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->SCTL);
+        sctl.DET = 1;
+        StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->SCTL, sctl.Status);
+
+        StorPortStallExecution(1000);
+
+        sctl.DET = 0;
+        StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->SCTL, sctl.Status);
+
+        index = 0;
+        do
+        {
+            StorPortStallExecution(1000);
+            ssts.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->SSTS);
+            index++;
+        }
+        while ((ssts.DET != 0x3) && (index < 30));
+
+        StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->SERR, (ULONG)~0);
+
+        // the device sends its signature once it is out of reset
+        index = 0;
+        do
+        {
+            StorPortStallExecution(1000);
+            tfd.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->TFD);
+            index++;
+        }
+        while ((tfd.STS.BSY || tfd.STS.DRQ) && (index < 500));
+
+        if (tfd.STS.BSY || tfd.STS.DRQ)
+        {
+            AhciDebugPrint("\tDevice still busy after COMRESET\n");
+        }
+
+        StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->IS, (ULONG)~0);
+    }
+
+    cmd.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->CMD);
+    cmd.ST = 1;
+    StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->CMD, cmd.Status);
+
+    StorPortAcquireSpinLock(AdapterExtension, InterruptLock, NULL, &lockhandle);
+
+    PortExtension->CommandIssuedSlots &= ~aborted;
+
+    for (i = 0; i < NCS; i++)
+    {
+        if ((aborted & (1UL << i)) == 0)
+        {
+            continue;
+        }
+
+        Srb = PortExtension->Slot[i];
+        PortExtension->Slot[i] = NULL;
+
+        if (Srb == NULL)
+        {
+            continue;
+        }
+
+        SrbExtension = GetSrbExtension(Srb);
+
+        if ((SrbExtension->Flags & ATA_FLAGS_QUEUED) != 0)
+        {
+            // We can't tell which one failed, so each is tried again without queuing
+            // and only the one at fault fails the next time
+            SrbExtension->Flags &= ~ATA_FLAGS_QUEUED;
+            SrbExtension->CommandReg = (SrbExtension->Flags & ATA_FLAGS_DATA_IN) ?
+                                       IDE_COMMAND_READ_DMA_EXT : IDE_COMMAND_WRITE_DMA_EXT;
+            SrbExtension->SectorCountLow = SrbExtension->FeaturesLow;
+            SrbExtension->SectorCountHigh = SrbExtension->FeaturesHigh;
+            SrbExtension->FeaturesLow = 0;
+            SrbExtension->FeaturesHigh = 0;
+            SrbExtension->Device = (0xA0 | IDE_LBA_MODE);
+
+            AddQueue(&PortExtension->SrbQueue, Srb);
+        }
+        else if (i == failedSlot)
+        {
+            AhciDebugPrint("\tCommand %x failed, TFD: %x\n", SrbExtension->CommandReg, tfd.Status);
+            Srb->SrbStatus = SRB_STATUS_ERROR;
+            failedSrb = Srb;
+        }
+        else
+        {
+            AddQueue(&PortExtension->SrbQueue, Srb);
+        }
+    }
+
+    PortExtension->QueuedSlots &= ~aborted;
+    PortExtension->AbortedSlots = 0;
+    PortExtension->ErrorRecoveryPending = FALSE;
+
+    // the port is running again, let it interrupt and take the requeued commands
+    StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->IS, (ULONG)~0);
+    StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->IE, PortExtension->InterruptEnable);
+    AhciStartQueuedSrbs(PortExtension);
+
+    StorPortReleaseSpinLock(AdapterExtension, &lockhandle);
+
+    if (failedSrb != NULL)
+    {
+        StorPortNotification(RequestComplete, AdapterExtension, failedSrb);
+    }
+
+    return;
+}// -- AhciPortErrorRecovery();
+
+/**
+ * @name AhciErrorRecoveryDpcRoutine
+ * @implemented
+ *
+ * Recovers a port from a fatal error outside of the interrupt handler
+ *
+ * @param Dpc
+ * @param AdapterExtension
+ * @param SystemArgument1
+ * @param SystemArgument2
+ */
+VOID
+AhciErrorRecoveryDpcRoutine (
+    __in PSTOR_DPC Dpc,
+    __in PVOID HwDeviceExtension,
+    __in PVOID SystemArgument1,
+    __in PVOID SystemArgument2
+  )
+{
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(HwDeviceExtension);
+    UNREFERENCED_PARAMETER(SystemArgument2);
+
+    AhciDebugPrint("AhciErrorRecoveryDpcRoutine()\n");
+
+    AhciPortErrorRecovery((PAHCI_PORT_EXTENSION)SystemArgument1);
+}// -- AhciErrorRecoveryDpcRoutine();
+
 /**
  * @name AhciInterruptHandler
- * @not_implemented
+ * @implemented
  *
  * Interrupt Handler for PortExtension
  *
@@ -622,7 +823,8 @@ AhciInterruptHandler (
     __in PAHCI_PORT_EXTENSION PortExtension
     )
 {
-    ULONG is, ci, sact, outstanding;
+    ULONG is, ci, sact, outstanding, completed;
+    AHCI_PORT_CMD cmd;
     AHCI_INTERRUPT_STATUS PxIS;
     AHCI_INTERRUPT_STATUS PxISMasked;
     PAHCI_ADAPTER_EXTENSION AdapterExtension;
@@ -663,6 +865,36 @@ AhciInterruptHandler (
         // non-queued commands were being issued or native command queuing commands were being issued.
 
         AhciDebugPrint("\tFatal Error: %x\n", PxIS.Status);
+
+        // Stopping and resetting the port polls for up to a second, that is left to a DPC.
+        // Here, complete what finished before the error and latch what it aborted.
+        ci = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->CI);
+        sact = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->SACT);
+
+        completed = PortExtension->CommandIssuedSlots & (~(ci | sact));
+        if (completed != 0)
+        {
+            AhciCompleteIssuedSrb(PortExtension, completed);
+            PortExtension->CommandIssuedSlots &= ~completed;
+            PortExtension->QueuedSlots &= ~completed;
+        }
+
+        // For non-queued commands PxCMD.CCS holds the one that failed
+        cmd.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->CMD);
+        PortExtension->AbortedSlots = PortExtension->CommandIssuedSlots;
+        PortExtension->FailedSlot = cmd.CCS;
+        PortExtension->ErrorRecoveryPending = TRUE;
+
+        // keep the halted port quiet until it is restarted
+        PortExtension->InterruptEnable = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->IE);
+        StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->IE, 0);
+        StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->IS, PxIS.Status);
+
+        is = (1 << PortExtension->PortNumber);
+        StorPortWriteRegisterUlong(AdapterExtension, AdapterExtension->IS, is);
+
+        StorPortIssueDpc(AdapterExtension, &PortExtension->ErrorRecovery, PortExtension, NULL);
+        return;
     }
 
     // Normal Command Completion
@@ -693,12 +925,17 @@ AhciInterruptHandler (
     sact = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->SACT);
 
     outstanding = ci | sact; // NOTE: Including both non-NCQ and NCQ based commands
-    if ((PortExtension->CommandIssuedSlots & (~outstanding)) != 0)
+    completed = PortExtension->CommandIssuedSlots & (~outstanding);
+    if (completed != 0)
     {
-        AhciCompleteIssuedSrb(PortExtension, (PortExtension->CommandIssuedSlots & (~outstanding)));
+        AhciCompleteIssuedSrb(PortExtension, completed);
         PortExtension->CommandIssuedSlots &= outstanding;
+        PortExtension->QueuedSlots &= ~completed;
     }
 
+    // the freed slots can take what was waiting for them
+    AhciStartQueuedSrbs(PortExtension);
+
     return;
 }// -- AhciInterruptHandler();
 
@@ -1247,6 +1484,12 @@ AhciATA_CFIS (
     cmdTable->CFIS[AHCI_ATA_CFIS_SectorCountLow] = SrbExtension->SectorCountLow;
     cmdTable->CFIS[AHCI_ATA_CFIS_SectorCountHigh] = SrbExtension->SectorCountHigh;
 
+    // native queued commands carry their tag in the sector count
+    if ((SrbExtension->Flags & ATA_FLAGS_QUEUED) != 0)
+    {
+        cmdTable->CFIS[AHCI_ATA_CFIS_SectorCountLow] = (UCHAR)(SrbExtension->SlotIndex << 3);
+    }
+
     return 5;
 }// -- AhciATA_CFIS();
 
@@ -1467,7 +1710,11 @@ AhciProcessSrb (
 
     // mark this slot
     PortExtension->Slot[SlotIndex] = Srb;
-    PortExtension->QueueSlots |= 1 << SlotIndex;
+    PortExtension->QueueSlots |= 1UL << SlotIndex;
+    if ((SrbExtension->Flags & ATA_FLAGS_QUEUED) != 0)
+    {
+        PortExtension->QueuedSlots |= 1UL << SlotIndex;
+    }
     return;
 }// -- AhciProcessSrb();
 
@@ -1492,7 +1739,7 @@ AhciActivatePort (
     )
 {
     AHCI_PORT_CMD cmd;
-    ULONG QueueSlots, slotToActivate, tmp;
+    ULONG QueueSlots, queuedSlots;
     PAHCI_ADAPTER_EXTENSION AdapterExtension;
 
     AhciDebugPrint("AhciActivatePort()\n");
@@ -1514,23 +1761,22 @@ AhciActivatePort (
         return;
     }
 
-    // get the lowest set bit
-    tmp = QueueSlots & (QueueSlots - 1);
-
-    if (tmp == 0)
-        slotToActivate = QueueSlots;
-    else
-        slotToActivate = (QueueSlots & (~tmp));
-
-    // mark that bit off in QueueSlots
-    // so we can know we it is really needed to activate port or not
-    PortExtension->QueueSlots &= ~slotToActivate;
+    // all prepared slots go at once
+    PortExtension->QueueSlots = 0;
     // mark this CommandIssuedSlots
     // to validate in completeIssuedCommand
-    PortExtension->CommandIssuedSlots |= slotToActivate;
+    PortExtension->CommandIssuedSlots |= QueueSlots;
+
+    // section 5.3.1
+    // the tags of native queued commands must be set in PxSACT before the slots are set in PxCI
+    queuedSlots = QueueSlots & PortExtension->QueuedSlots;
+    if (queuedSlots != 0)
+    {
+        StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->SACT, queuedSlots);
+    }
 
-    // tell the HBA to issue this Command Slot to the given port
-    StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->CI, slotToActivate);
+    // tell the HBA to issue these Command Slots to the given port
+    StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->CI, QueueSlots);
 
     return;
 }// -- AhciActivatePort();
@@ -1539,6 +1785,84 @@ AhciActivatePort (
     #pragma warning(pop)
 #endif
 
+/**
+ * @name AhciStartQueuedSrbs
+ * @implemented
+ *
+ * Move pending Srbs to free command slots and issue them.
+ * Caller holds the interrupt lock.
+ *
+ * @param PortExtension
+ *
+ */
+VOID
+AhciStartQueuedSrbs (
+    __in PAHCI_PORT_EXTENSION PortExtension
+    )
+{
+    BOOLEAN queued;
+    PSCSI_REQUEST_BLOCK tmpSrb;
+    PAHCI_ADAPTER_EXTENSION AdapterExtension;
+    ULONG occupiedSlots, slotIndex, NCS;
+
+    AhciDebugPrint("AhciStartQueuedSrbs()\n");
+
+    // the error recovery DPC restarts the port and issues what is queued then
+    if (PortExtension->ErrorRecoveryPending)
+    {
+        return;
+    }
+
+    AdapterExtension = PortExtension->AdapterExtension;
+
+    occupiedSlots = (PortExtension->QueueSlots | PortExtension->CommandIssuedSlots); // Busy command slots for given port
+    NCS = AHCI_Global_Port_CAP_NCS(AdapterExtension->CAP);
+
+    // iterate over HBA port slots
+    for (slotIndex = 0; slotIndex < NCS; slotIndex++)
+    {
+        if ((occupiedSlots & (1UL << slotIndex)) != 0)
+        {
+            continue;
+        }
+
+        tmpSrb = PeekQueue(&PortExtension->SrbQueue);
+        if (tmpSrb == NULL)
+        {
+            break;
+        }
+
+        // native queued and other commands can't be outstanding at the same time,
+        // keep the order and let the others drain first
+        queued = (GetSrbExtension(tmpSrb)->Flags & ATA_FLAGS_QUEUED) != 0;
+        if (queued && ((occupiedSlots & ~PortExtension->QueuedSlots) != 0))
+        {
+            break;
+        }
+
+        // the slot is the NCQ tag, which must be below the queue depth the drive reported
+        if (queued && (slotIndex >= PortExtension->MaxPortQueueDepth))
+        {
+            break;
+        }
+
+        if (!queued && ((occupiedSlots & PortExtension->QueuedSlots) != 0))
+        {
+            break;
+        }
+
+        RemoveQueue(&PortExtension->SrbQueue);
+        NT_ASSERT(tmpSrb->PathId == PortExtension->PortNumber);
+        AhciProcessSrb(PortExtension, tmpSrb, slotIndex);
+        occupiedSlots |= 1UL << slotIndex;
+    }
+
+    // program HBA port
+    AhciActivatePort(PortExtension);
+
+    return;
+}// -- AhciStartQueuedSrbs();
+
 /**
  * @name AhciProcessIO
  * @implemented
@@ -1558,10 +1882,8 @@ AhciProcessIO (
     __in PSCSI_REQUEST_BLOCK Srb
     )
 {
-    PSCSI_REQUEST_BLOCK tmpSrb;
     STOR_LOCK_HANDLE lockhandle = {0};
     PAHCI_PORT_EXTENSION PortExtension;
-    ULONG commandSlotMask, occupiedSlots, slotIndex, NCS;
 
     AhciDebugPrint("AhciProcessIO()\n");
     AhciDebugPrint("\tPathId: %d\n", PathId);
@@ -1583,39 +1905,7 @@ AhciProcessIO (
         return; // we should wait for device to get active
     }
 
-    occupiedSlots = (PortExtension->QueueSlots | PortExtension->CommandIssuedSlots); // Busy command slots for given port
-    NCS = AHCI_Global_Port_CAP_NCS(AdapterExtension->CAP);
-    commandSlotMask = (1 << NCS) - 1; // available slots mask
-
-    commandSlotMask = (commandSlotMask & ~occupiedSlots);
-    if(commandSlotMask != 0)
-    {
-        // iterate over HBA port slots
-        for (slotIndex = 0; slotIndex < NCS; slotIndex++)
-        {
-            // find first free slot
-            if ((commandSlotMask & (1 << slotIndex)) != 0)
-            {
-                tmpSrb = RemoveQueue(&PortExtension->SrbQueue);
-                if (tmpSrb != NULL)
-                {
-                    NT_ASSERT(tmpSrb->PathId == PathId);
-                    AhciProcessSrb(PortExtension, tmpSrb, slotIndex);
-                }
-                else
-                {
-                    break;
-                }
-            }
-            else
-            {
-                break;
-            }
-        }
-    }
-
-    // program HBA port
-    AhciActivatePort(PortExtension);
+    AhciStartQueuedSrbs(PortExtension);
 
     // Release Lock
     StorPortReleaseSpinLock(AdapterExtension, &lockhandle);
@@ -1735,6 +2025,22 @@ InquiryCompletion (
             PortExtension->DeviceParams.Lba48BitMode = 1;
         }
 
+        // Native command queuing needs the HBA, the device and 48 bit addressing
+        PortExtension->DeviceParams.NcqSupported = 0;
+        PortExtension->MaxPortQueueDepth = AHCI_Global_Port_CAP_NCS(AdapterExtension->CAP);
+        if ((AdapterExtension->CAP & AHCI_Global_HBA_CAP_SNCQ) &&
+            (IDENTIFY_SATA_CAPABILITIES(IdentifyDeviceData) != 0xFFFF) &&
+            (IDENTIFY_SATA_CAPABILITIES(IdentifyDeviceData) & IDENTIFY_SATA_CAPABILITIES_NCQ) &&
+            PortExtension->DeviceParams.Lba48BitMode)
+        {
+            PortExtension->DeviceParams.NcqSupported = 1;
+
+            // word 75, 0's based
+            PortExtension->MaxPortQueueDepth = min(PortExtension->MaxPortQueueDepth,
+                                                   IdentifyDeviceData->QueueDepth + 1UL);
+            AhciDebugPrint("\tNCQ, queue depth %d\n", PortExtension->MaxPortQueueDepth);
+        }
+
         PortExtension->DeviceParams.AccessType = DIRECT_ACCESS_DEVICE;
 
         /* Device max address lba */
@@ -1798,7 +2104,7 @@ InquiryCompletion (
     // prepare data to send
     InquiryData->Versions = 2;
     InquiryData->Wide32Bit = 1;
-    InquiryData->CommandQueue = 0; // NCQ not supported
+    InquiryData->CommandQueue = PortExtension->DeviceParams.NcqSupported;
     InquiryData->ResponseDataFormat = 0x2;
     InquiryData->DeviceTypeModifier = 0;
     InquiryData->DeviceTypeQualifier = DEVICE_CONNECTED;
@@ -1820,7 +2126,7 @@ InquiryCompletion (
                                          Srb->PathId,
                                          Srb->TargetId,
                                          Srb->Lun,
-                                         AHCI_Global_Port_CAP_NCS(AdapterExtension->CAP));
+                                         PortExtension->MaxPortQueueDepth);
 
     NT_ASSERT(status == TRUE);
     return;
@@ -2076,6 +2382,19 @@ DeviceRequestReadWrite (
 
     NT_ASSERT(SectorCount < 0x100);
 
+    if (PortExtension->DeviceParams.NcqSupported)
+    {
+        // FPDMA QUEUED takes the count in the features,
+        // the tag goes to the sector count once the command has a slot
+        SrbExtension->Flags |= ATA_FLAGS_QUEUED;
+        SrbExtension->CommandReg = IsReading ? IDE_COMMAND_READ_FPDMA_QUEUED : IDE_COMMAND_WRITE_FPDMA_QUEUED;
+        SrbExtension->FeaturesLow = SrbExtension->SectorCountLow;
+        SrbExtension->FeaturesHigh = SrbExtension->SectorCountHigh;
+        SrbExtension->SectorCountLow = 0;
+        SrbExtension->SectorCountHigh = 0;
+        SrbExtension->Device = IDE_LBA_MODE;
+    }
+
     SrbExtension->pSgl = (PLOCAL_SCATTER_GATHER_LIST)StorPortGetScatterGatherList(AdapterExtension, Srb);
 
     return SRB_STATUS_PENDING;
@@ -2547,6 +2866,33 @@ RemoveQueue (
     return Srb;
 }// -- RemoveQueue();
 
+/**
+ * @name PeekQueue
+ * @implemented
+ *
+ * Return Srb at the front of Queue without removing it
+ *
+ * @param Queue
+ *
+ * @return
+ * return Srb
+ *
+ */
+FORCEINLINE
+PVOID
+PeekQueue (
+    __in PAHCI_QUEUE Queue
+    )
+{
+    NT_ASSERT(Queue->Head < MAXIMUM_QUEUE_BUFFER_SIZE);
+    NT_ASSERT(Queue->Tail < MAXIMUM_QUEUE_BUFFER_SIZE);
+
+    if (Queue->Head == Queue->Tail)
+        return NULL;
+
+    return Queue->Buffer[Queue->Tail];
+}// -- PeekQueue();
+
 /**
  * @name GetSrbExtension
  * @implemented
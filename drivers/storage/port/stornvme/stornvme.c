@@ -0,0 +1,1741 @@
+/*
+ * PROJECT:     ReactOS NVMe Storport Miniport
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     NVMe miniport with one I/O queue pair per processor
+ */
+
+#include "stornvme.h"
+
+/**
+ * @name NvmeDoorbell
+ * @implemented
+ *
+ * Doorbell Index is 2y for the tail of submission queue y
+ * and 2y + 1 for the head of completion queue y
+ *
+ * @param AdapterExtension
+ * @param Index
+ *
+ * @return
+ * return address of the doorbell register
+ */
+FORCEINLINE
+PULONG
+NvmeDoorbell (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in ULONG Index
+    )
+{
+    return &AdapterExtension->Registers->Doorbell[Index * AdapterExtension->DoorbellStride];
+}// -- NvmeDoorbell();
+
+/**
+ * @name GetSrbExtension
+ * @implemented
+ *
+ * GetSrbExtension from Srb
+ *
+ * @param Srb
+ *
+ * @return
+ * return SrbExtension
+ */
+FORCEINLINE
+PNVME_SRB_EXTENSION
+GetSrbExtension (
+    __in PSCSI_REQUEST_BLOCK Srb
+    )
+{
+    ULONG Offset;
+    ULONG_PTR SrbExtension;
+
+    SrbExtension = (ULONG_PTR)Srb->SrbExtension;
+    Offset = SrbExtension % NVME_SRB_EXTENSION_ALIGNMENT;
+
+    // 512 byte alignment keeps the PRP list within one page
+    if (Offset != 0)
+        Offset = NVME_SRB_EXTENSION_ALIGNMENT - Offset;
+
+    return (PNVME_SRB_EXTENSION)(SrbExtension + Offset);
+}// -- GetSrbExtension();
+
+/**
+ * @name NvmeInitializeQueue
+ * @implemented
+ *
+ * Set up the software state of a submission and completion queue pair
+ *
+ * @param AdapterExtension
+ * @param Queue
+ * @param QueueId
+ * @param Depth
+ * @param SubmissionQueue
+ * @param CompletionQueue
+ */
+VOID
+NvmeInitializeQueue (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PNVME_QUEUE Queue,
+    __in USHORT QueueId,
+    __in USHORT Depth,
+    __in PVOID SubmissionQueue,
+    __in PVOID CompletionQueue
+    )
+{
+    ULONG length;
+
+    StorPortZeroMemory(Queue, sizeof(NVME_QUEUE));
+    StorPortZeroMemory(SubmissionQueue, Depth * sizeof(NVME_COMMAND));
+    StorPortZeroMemory(CompletionQueue, Depth * sizeof(NVME_COMPLETION));
+
+    Queue->SubmissionQueue = SubmissionQueue;
+    Queue->CompletionQueue = CompletionQueue;
+    Queue->SubmissionQueuePhysical = StorPortGetPhysicalAddress(AdapterExtension, NULL, SubmissionQueue, &length);
+    Queue->CompletionQueuePhysical = StorPortGetPhysicalAddress(AdapterExtension, NULL, CompletionQueue, &length);
+    Queue->SubmissionDoorbell = NvmeDoorbell(AdapterExtension, 2 * QueueId);
+    Queue->CompletionDoorbell = NvmeDoorbell(AdapterExtension, 2 * QueueId + 1);
+
+    Queue->QueueId = QueueId;
+    Queue->Depth = Depth;
+
+    // the controller flips the phase tag on every pass through the queue, the first pass posts 1
+    Queue->Phase = 1;
+}// -- NvmeInitializeQueue();
+
+/**
+ * @name NvmeWaitReady
+ * @implemented
+ *
+ * Wait for CSTS.RDY to reach the given state, at most CAP.TO
+ *
+ * @param AdapterExtension
+ * @param Ready
+ *
+ * @return
+ * return TRUE if CSTS.RDY reached the state
+ */
+BOOLEAN
+NvmeWaitReady (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in BOOLEAN Ready
+    )
+{
+    ULONG index, csts;
+
+    for (index = 0; index < AdapterExtension->ReadyTimeout; index++)
+    {
+        csts = StorPortReadRegisterUlong(AdapterExtension, &AdapterExtension->Registers->CSTS);
+        if (((csts & NVME_CSTS_RDY) != 0) == Ready)
+        {
+            return TRUE;
+        }
+
+        if ((csts & NVME_CSTS_CFS) != 0)
+        {
+            NvmeDebugPrint("\tController fatal status\n");
+            return FALSE;
+        }
+
+        StorPortStallExecution(1000);
+    }
+
+    NvmeDebugPrint("\tCSTS.RDY did not become %d\n", Ready);
+    return FALSE;
+}// -- NvmeWaitReady();
+
+/**
+ * @name NvmeSubmitAdminCommand
+ * @implemented
+ *
+ * Run an admin command and poll for its completion.
+ * Only used while the adapter is being set up, with interrupts masked.
+ *
+ * @param AdapterExtension
+ * @param Command
+ * @param Result
+ *
+ * @return
+ * return TRUE if the command completed successfully
+ */
+BOOLEAN
+NvmeSubmitAdminCommand (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PNVME_COMMAND Command,
+    __out_opt PULONG Result
+    )
+{
+    ULONG index;
+    USHORT status;
+    PNVME_QUEUE Queue;
+    PNVME_COMPLETION Completion;
+
+    Queue = &AdapterExtension->AdminQueue;
+
+    Command->CommandId = Queue->SqTail;
+    StorPortCopyMemory(&Queue->SubmissionQueue[Queue->SqTail], Command, sizeof(NVME_COMMAND));
+
+    Queue->SqTail = (Queue->SqTail + 1) % Queue->Depth;
+    StorPortWriteRegisterUlong(AdapterExtension, Queue->SubmissionDoorbell, Queue->SqTail);
+
+    Completion = &Queue->CompletionQueue[Queue->CqHead];
+    for (index = 0; index < NVME_ADMIN_TIMEOUT; index++)
+    {
+        status = *(volatile USHORT *)&Completion->Status;
+        if ((status & NVME_STATUS_PHASE) == Queue->Phase)
+        {
+            break;
+        }
+
+        StorPortStallExecution(10);
+    }
+
+    if (index == NVME_ADMIN_TIMEOUT)
+    {
+        NvmeDebugPrint("\tAdmin command %x timed out\n", Command->Opcode);
+        return FALSE;
+    }
+
+    if (Result != NULL)
+    {
+        *Result = Completion->Result;
+    }
+
+    Queue->CqHead++;
+    if (Queue->CqHead == Queue->Depth)
+    {
+        Queue->CqHead = 0;
+        Queue->Phase ^= 1;
+    }
+
+    StorPortWriteRegisterUlong(AdapterExtension, Queue->CompletionDoorbell, Queue->CqHead);
+
+    if (NVME_STATUS_CODE(status) != 0)
+    {
+        NvmeDebugPrint("\tAdmin command %x failed: %x\n", Command->Opcode, NVME_STATUS_CODE(status));
+        return FALSE;
+    }
+
+    return TRUE;
+}// -- NvmeSubmitAdminCommand();
+
+/**
+ * @name NvmeIdentify
+ * @implemented
+ *
+ * Read identify data into the adapter's identify buffer
+ *
+ * @param AdapterExtension
+ * @param Cns
+ * @param NamespaceId
+ *
+ * @return
+ * return TRUE if successful
+ */
+BOOLEAN
+NvmeIdentify (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in ULONG Cns,
+    __in ULONG NamespaceId
+    )
+{
+    NVME_COMMAND Command;
+
+    StorPortZeroMemory(&Command, sizeof(Command));
+    Command.Opcode = NVME_ADMIN_IDENTIFY;
+    Command.NamespaceId = NamespaceId;
+    Command.Prp1 = AdapterExtension->IdentifyBufferPhysical.QuadPart;
+    Command.Cdw10 = Cns;
+
+    return NvmeSubmitAdminCommand(AdapterExtension, &Command, NULL);
+}// -- NvmeIdentify();
+
+/**
+ * @name NvmeIdentifyController
+ * @implemented
+ *
+ * Read controller limits and strings, and the namespaces behind it
+ *
+ * @param AdapterExtension
+ *
+ * @return
+ * return TRUE if successful
+ */
+BOOLEAN
+NvmeIdentifyController (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension
+    )
+{
+    ULONG index, lbaFormat, mpsMin;
+    PNVME_NAMESPACE Namespace;
+    PNVME_IDENTIFY_CONTROLLER IdentifyController;
+    PNVME_IDENTIFY_NAMESPACE IdentifyNamespace;
+
+    if (!NvmeIdentify(AdapterExtension, NVME_IDENTIFY_CNS_CONTROLLER, 0))
+    {
+        return FALSE;
+    }
+
+    IdentifyController = (PNVME_IDENTIFY_CONTROLLER)AdapterExtension->IdentifyBuffer;
+
+    // last byte should be NULL
+    StorPortCopyMemory(AdapterExtension->SerialNumber, IdentifyController->SerialNumber, sizeof(IdentifyController->SerialNumber));
+    StorPortCopyMemory(AdapterExtension->ModelNumber, IdentifyController->ModelNumber, sizeof(IdentifyController->ModelNumber));
+    StorPortCopyMemory(AdapterExtension->FirmwareRevision, IdentifyController->FirmwareRevision, sizeof(IdentifyController->FirmwareRevision));
+
+    AdapterExtension->SerialNumber[sizeof(AdapterExtension->SerialNumber) - 1] = '\0';
+    AdapterExtension->ModelNumber[sizeof(AdapterExtension->ModelNumber) - 1] = '\0';
+    AdapterExtension->FirmwareRevision[sizeof(AdapterExtension->FirmwareRevision) - 1] = '\0';
+
+    AdapterExtension->MaximumTransferLength = MAXIMUM_TRANSFER_LENGTH;
+    if (IdentifyController->Mdts != 0)
+    {
+        mpsMin = NVME_CAP_MPSMIN(StorPortReadRegisterUlong(AdapterExtension, &AdapterExtension->Registers->CAP[1]));
+        if ((IdentifyController->Mdts + mpsMin + 12) < 32)
+        {
+            AdapterExtension->MaximumTransferLength = min(AdapterExtension->MaximumTransferLength,
+                                                          1UL << (IdentifyController->Mdts + mpsMin + 12));
+        }
+    }
+
+    AdapterExtension->VolatileWriteCache = (IdentifyController->VolatileWriteCache & 1) != 0;
+    AdapterExtension->NamespaceCount = min(IdentifyController->NamespaceCount, NVME_MAX_NAMESPACES);
+
+    NvmeDebugPrint("\tModel: %s  Namespaces: %d\n", AdapterExtension->ModelNumber, IdentifyController->NamespaceCount);
+
+    // namespace ids start at 1, the LUN is the id - 1
+    for (index = 0; index < AdapterExtension->NamespaceCount; index++)
+    {
+        Namespace = &AdapterExtension->Namespace[index];
+        Namespace->Active = FALSE;
+
+        if (!NvmeIdentify(AdapterExtension, NVME_IDENTIFY_CNS_NAMESPACE, index + 1))
+        {
+            continue;
+        }
+
+        IdentifyNamespace = (PNVME_IDENTIFY_NAMESPACE)AdapterExtension->IdentifyBuffer;
+        if (IdentifyNamespace->Size == 0)
+        {
+            continue;
+        }
+
+        lbaFormat = IdentifyNamespace->LbaFormat[IdentifyNamespace->FormattedLbaSize & 0xF];
+
+        Namespace->Active = TRUE;
+        Namespace->BlockCount = IdentifyNamespace->Size;
+        Namespace->BlockSize = 1UL << NVME_LBAF_LBADS(lbaFormat);
+
+        NvmeDebugPrint("\tNamespace %d: %I64u blocks of %d bytes\n",
+                       index + 1, Namespace->BlockCount, Namespace->BlockSize);
+    }
+
+    return TRUE;
+}// -- NvmeIdentifyController();
+
+/**
+ * @name NvmeCreateIoQueues
+ * @implemented
+ *
+ * Ask for one I/O queue pair per processor and create as many as the controller gives us
+ *
+ * @param AdapterExtension
+ * @param Memory
+ * @param QueueCount
+ * @param Depth
+ *
+ * @return
+ * return TRUE if at least one queue pair was created
+ */
+BOOLEAN
+NvmeCreateIoQueues (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PUCHAR Memory,
+    __in ULONG QueueCount,
+    __in USHORT Depth
+    )
+{
+    ULONG index, result;
+    PNVME_QUEUE Queue;
+    NVME_COMMAND Command;
+
+    // Number of Queues feature, both counts are 0's based
+    StorPortZeroMemory(&Command, sizeof(Command));
+    Command.Opcode = NVME_ADMIN_SET_FEATURES;
+    Command.Cdw10 = NVME_FEATURE_NUMBER_OF_QUEUES;
+    Command.Cdw11 = (QueueCount - 1) | ((QueueCount - 1) << 16);
+
+    if (!NvmeSubmitAdminCommand(AdapterExtension, &Command, &result))
+    {
+        return FALSE;
+    }
+
+    QueueCount = min(QueueCount, (result & 0xFFFF) + 1);
+    QueueCount = min(QueueCount, (result >> 16) + 1);
+
+    for (index = 0; index < QueueCount; index++)
+    {
+        Queue = &AdapterExtension->IoQueue[index];
+
+        // a page for the submission queue, the completion queue follows
+        NvmeInitializeQueue(AdapterExtension,
+                            Queue,
+                            (USHORT)(index + 1),
+                            Depth,
+                            Memory + (2 * index) * NVME_PAGE_SIZE,
+                            Memory + (2 * index + 1) * NVME_PAGE_SIZE);
+
+        // Message 0 is the admin queue's, the I/O queues get one each
+        // as far as they go. Without MSI-X all of them use vector 0.
+        if (AdapterExtension->MessageCount > 1)
+        {
+            Queue->MessageId = (USHORT)(1 + index % (AdapterExtension->MessageCount - 1));
+        }
+
+        // The completion queue has to exist first.
+        StorPortZeroMemory(&Command, sizeof(Command));
+        Command.Opcode = NVME_ADMIN_CREATE_IO_CQ;
+        Command.Prp1 = Queue->CompletionQueuePhysical.QuadPart;
+        Command.Cdw10 = Queue->QueueId | ((Depth - 1) << 16);
+        Command.Cdw11 = NVME_QUEUE_PHYS_CONTIG | NVME_CQ_IRQ_ENABLED | NVME_CQ_IRQ_VECTOR(Queue->MessageId);
+
+        if (!NvmeSubmitAdminCommand(AdapterExtension, &Command, NULL))
+        {
+            break;
+        }
+
+        StorPortZeroMemory(&Command, sizeof(Command));
+        Command.Opcode = NVME_ADMIN_CREATE_IO_SQ;
+        Command.Prp1 = Queue->SubmissionQueuePhysical.QuadPart;
+        Command.Cdw10 = Queue->QueueId | ((Depth - 1) << 16);
+        Command.Cdw11 = NVME_QUEUE_PHYS_CONTIG | (Queue->QueueId << 16);
+
+        if (!NvmeSubmitAdminCommand(AdapterExtension, &Command, NULL))
+        {
+            break;
+        }
+    }
+
+    AdapterExtension->QueueCount = index;
+    NvmeDebugPrint("\t%d I/O queue pairs of %d entries\n", index, Depth);
+
+    return (index != 0);
+}// -- NvmeCreateIoQueues();
+
+/**
+ * @name NvmeHwFindAdapter
+ * @implemented
+ *
+ * Map the controller, reset it, bring up the admin queue
+ * and identify the controller
+ *
+ * @param DeviceExtension
+ * @param HwContext
+ * @param BusInformation
+ * @param ArgumentString
+ * @param ConfigInfo
+ * @param Reserved3
+ *
+ * @return
+ * return SP_RETURN_FOUND if the controller is ready
+ */
+ULONG
+NTAPI
+NvmeHwFindAdapter (
+    __in PVOID DeviceExtension,
+    __in PVOID HwContext,
+    __in PVOID BusInformation,
+    __in PCHAR ArgumentString,
+    __inout PPORT_CONFIGURATION_INFORMATION ConfigInfo,
+    __in PBOOLEAN Reserved3
+    )
+{
+    ULONG index, pci_cfg_len, capLow, capHigh, cc, queueCount;
+    USHORT adminDepth, ioDepth;
+    PUCHAR memory;
+    PACCESS_RANGE accessRange;
+    PHYSICAL_ADDRESS barAddress;
+    PNVME_CONTROLLER_REGISTERS registers;
+    PPCI_COMMON_CONFIG pciConfigData;
+    PNVME_ADAPTER_EXTENSION adapterExtension;
+    UCHAR pci_cfg_buf[sizeof(PCI_COMMON_CONFIG)];
+
+    NvmeDebugPrint("NvmeHwFindAdapter()\n");
+
+    UNREFERENCED_PARAMETER(HwContext);
+    UNREFERENCED_PARAMETER(BusInformation);
+    UNREFERENCED_PARAMETER(ArgumentString);
+    UNREFERENCED_PARAMETER(Reserved3);
+
+    adapterExtension = DeviceExtension;
+
+    // get PCI configuration header
+    pci_cfg_len = StorPortGetBusData(adapterExtension,
+                                     PCIConfiguration,
+                                     ConfigInfo->SystemIoBusNumber,
+                                     ConfigInfo->SlotNumber,
+                                     pci_cfg_buf,
+                                     sizeof(PCI_COMMON_CONFIG));
+
+    if (pci_cfg_len != sizeof(PCI_COMMON_CONFIG))
+    {
+        return SP_RETURN_ERROR;
+    }
+
+    pciConfigData = (PPCI_COMMON_CONFIG)pci_cfg_buf;
+    if ((pciConfigData->BaseClass != PCI_CLASS_MASS_STORAGE_CTLR) ||
+        (pciConfigData->SubClass != 0x08) ||
+        (pciConfigData->ProgIf != 0x02))
+    {
+        return SP_RETURN_NOT_FOUND;
+    }
+
+    // BAR0 and BAR1 hold the 64 bit register base
+    barAddress.LowPart = pciConfigData->u.type0.BaseAddresses[0] & 0xFFFFFFF0;
+    barAddress.HighPart = 0;
+    if ((pciConfigData->u.type0.BaseAddresses[0] & 0x6) == 0x4)
+    {
+        barAddress.HighPart = pciConfigData->u.type0.BaseAddresses[1];
+    }
+
+    registers = NULL;
+    accessRange = *(ConfigInfo->AccessRanges);
+    for (index = 0; index < ConfigInfo->NumberOfAccessRanges; index++)
+    {
+        if (accessRange[index].RangeStart.QuadPart == barAddress.QuadPart)
+        {
+            registers = StorPortGetDeviceBase(adapterExtension,
+                                              ConfigInfo->AdapterInterfaceType,
+                                              ConfigInfo->SystemIoBusNumber,
+                                              accessRange[index].RangeStart,
+                                              accessRange[index].RangeLength,
+                                              !accessRange[index].RangeInMemory);
+            break;
+        }
+    }
+
+    if (registers == NULL)
+    {
+        NvmeDebugPrint("\tregisters == NULL\n");
+        return SP_RETURN_ERROR;
+    }
+
+    adapterExtension->Registers = registers;
+
+    capLow = StorPortReadRegisterUlong(adapterExtension, &registers->CAP[0]);
+    capHigh = StorPortReadRegisterUlong(adapterExtension, &registers->CAP[1]);
+
+    adapterExtension->DoorbellStride = 1UL << NVME_CAP_DSTRD(capHigh);
+    adapterExtension->ReadyTimeout = max(NVME_CAP_TO(capLow), 1) * 500;
+
+    NvmeDebugPrint("\tVersion: %x  CAP: %08x%08x\n",
+                   StorPortReadRegisterUlong(adapterExtension, &registers->VS),
+                   capHigh,
+                   capLow);
+
+    // we only use 4K controller pages
+    if (NVME_CAP_MPSMIN(capHigh) != 0)
+    {
+        NvmeDebugPrint("\tMinimum page size not supported\n");
+        return SP_RETURN_ERROR;
+    }
+
+    adminDepth = (USHORT)min(NVME_ADMIN_QUEUE_DEPTH, NVME_CAP_MQES(capLow) + 1);
+    ioDepth = (USHORT)min(NVME_IO_QUEUE_DEPTH, NVME_CAP_MQES(capLow) + 1);
+    queueCount = min((ULONG)KeNumberProcessors, NVME_MAX_IO_QUEUES);
+
+    // 7.6.1 reset the controller to have it in known state
+    cc = StorPortReadRegisterUlong(adapterExtension, &registers->CC);
+    if ((cc & NVME_CC_EN) != 0)
+    {
+        StorPortWriteRegisterUlong(adapterExtension, &registers->CC, cc & ~NVME_CC_EN);
+    }
+
+    if (!NvmeWaitReady(adapterExtension, FALSE))
+    {
+        return SP_RETURN_ERROR;
+    }
+
+    // Page 0: admin submission and completion queue
+    // Page 1: identify data
+    // Then two pages for each I/O queue pair
+    memory = StorPortGetUncachedExtension(adapterExtension,
+                                          ConfigInfo,
+                                          (2 + 2 * queueCount) * NVME_PAGE_SIZE);
+    if (memory == NULL)
+    {
+        NvmeDebugPrint("\tUncached extension == NULL\n");
+        return SP_RETURN_ERROR;
+    }
+
+    NvmeInitializeQueue(adapterExtension,
+                        &adapterExtension->AdminQueue,
+                        0,
+                        adminDepth,
+                        memory,
+                        memory + NVME_ADMIN_QUEUE_DEPTH * sizeof(NVME_COMMAND));
+
+    adapterExtension->IdentifyBuffer = memory + NVME_PAGE_SIZE;
+    adapterExtension->IdentifyBufferPhysical = StorPortGetPhysicalAddress(adapterExtension,
+                                                                          NULL,
+                                                                          adapterExtension->IdentifyBuffer,
+                                                                          &index);
+
+    // admin commands are polled, the interrupt stays masked until HwInitialize
+    StorPortWriteRegisterUlong(adapterExtension, &registers->INTMS, 1);
+
+    StorPortWriteRegisterUlong(adapterExtension, &registers->AQA, (adminDepth - 1) | ((adminDepth - 1) << 16));
+    StorPortWriteRegisterUlong(adapterExtension, &registers->ASQ[0], adapterExtension->AdminQueue.SubmissionQueuePhysical.LowPart);
+    StorPortWriteRegisterUlong(adapterExtension, &registers->ASQ[1], adapterExtension->AdminQueue.SubmissionQueuePhysical.HighPart);
+    StorPortWriteRegisterUlong(adapterExtension, &registers->ACQ[0], adapterExtension->AdminQueue.CompletionQueuePhysical.LowPart);
+    StorPortWriteRegisterUlong(adapterExtension, &registers->ACQ[1], adapterExtension->AdminQueue.CompletionQueuePhysical.HighPart);
+
+    // 64 byte commands, 16 byte completions, 4K pages, NVM command set
+    cc = NVME_CC_EN | NVME_CC_CSS_NVM | NVME_CC_MPS(0) | NVME_CC_IOSQES(6) | NVME_CC_IOCQES(4);
+    StorPortWriteRegisterUlong(adapterExtension, &registers->CC, cc);
+
+    if (!NvmeWaitReady(adapterExtension, TRUE))
+    {
+        return SP_RETURN_ERROR;
+    }
+
+    if (!NvmeIdentifyController(adapterExtension))
+    {
+        return SP_RETURN_ERROR;
+    }
+
+    adapterExtension->IoQueueMemory = memory + 2 * NVME_PAGE_SIZE;
+    adapterExtension->IoQueueCount = queueCount;
+    adapterExtension->IoQueueDepth = ioDepth;
+
+    ConfigInfo->Master = TRUE;
+    ConfigInfo->AlignmentMask = 0x3;
+    ConfigInfo->ScatterGather = TRUE;
+    ConfigInfo->DmaWidth = Width32Bits;
+    ConfigInfo->WmiDataProvider = FALSE;
+    ConfigInfo->Dma32BitAddresses = TRUE;
+    ConfigInfo->Dma64BitAddresses = TRUE;
+
+    ConfigInfo->NumberOfBuses = 1;
+    ConfigInfo->MaximumNumberOfTargets = 1;
+    ConfigInfo->MaximumNumberOfLogicalUnits = NVME_MAX_NAMESPACES;
+    ConfigInfo->MaximumTransferLength = adapterExtension->MaximumTransferLength;
+    ConfigInfo->NumberOfPhysicalBreaks = adapterExtension->MaximumTransferLength / NVME_PAGE_SIZE + 1;
+    ConfigInfo->SynchronizationModel = StorSynchronizeFullDuplex;
+
+    // each queue only touches its own completions, see NvmeHwMSInterrupt
+    ConfigInfo->HwMSInterruptRoutine = NvmeHwMSInterrupt;
+    ConfigInfo->InterruptSynchronizationMode = InterruptSynchronizePerMessage;
+
+    return SP_RETURN_FOUND;
+}// -- NvmeHwFindAdapter();
+
+/**
+ * @name NvmeHwPassiveInitialize
+ * @implemented
+ *
+ * Count the interrupt messages we got, create the I/O queues
+ * on them and let the controller interrupt
+ *
+ * @param DeviceExtension
+ *
+ * @return
+ * return TRUE if at least one I/O queue pair was created
+ */
+BOOLEAN
+NvmeHwPassiveInitialize (
+    __in PVOID DeviceExtension
+    )
+{
+    ULONG messageCount;
+    PNVME_ADAPTER_EXTENSION AdapterExtension;
+    MESSAGE_INTERRUPT_INFORMATION messageInfo;
+
+    NvmeDebugPrint("NvmeHwPassiveInitialize()\n");
+
+    AdapterExtension = (PNVME_ADAPTER_EXTENSION)DeviceExtension;
+
+    // one for the admin queue and one per I/O queue is all we can use
+    for (messageCount = 0; messageCount <= AdapterExtension->IoQueueCount; messageCount++)
+    {
+        if (StorPortGetMSIInfo(AdapterExtension, messageCount, &messageInfo) != STOR_STATUS_SUCCESS)
+        {
+            break;
+        }
+    }
+
+    AdapterExtension->MessageCount = messageCount;
+    NvmeDebugPrint("\t%d interrupt messages\n", messageCount);
+
+    if (!NvmeCreateIoQueues(AdapterExtension,
+                            AdapterExtension->IoQueueMemory,
+                            AdapterExtension->IoQueueCount,
+                            AdapterExtension->IoQueueDepth))
+    {
+        return FALSE;
+    }
+
+    // INTMC must not be touched with MSI-X
+    if (messageCount <= 1)
+    {
+        StorPortWriteRegisterUlong(AdapterExtension, &AdapterExtension->Registers->INTMC, 1);
+    }
+
+    return TRUE;
+}// -- NvmeHwPassiveInitialize();
+
+/**
+ * @name NvmeHwInitialize
+ * @implemented
+ *
+ * Interrupt messages are known once we get here, the queues are
+ * created at PASSIVE_LEVEL because admin commands are polled
+ *
+ * @param DeviceExtension
+ *
+ * @return
+ * return TRUE
+ */
+BOOLEAN
+NTAPI
+NvmeHwInitialize (
+    __in PVOID DeviceExtension
+    )
+{
+    NvmeDebugPrint("NvmeHwInitialize()\n");
+
+    StorPortEnablePassiveInitialization(DeviceExtension, NvmeHwPassiveInitialize);
+
+    return TRUE;
+}// -- NvmeHwInitialize();
+
+/**
+ * @name NvmeProcessCompletions
+ * @implemented
+ *
+ * Complete the Srbs of every new entry in a completion queue
+ *
+ * @param AdapterExtension
+ * @param Queue
+ *
+ * @return
+ * return TRUE if the queue had new entries
+ */
+BOOLEAN
+NvmeProcessCompletions (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PNVME_QUEUE Queue
+    )
+{
+    BOOLEAN processed;
+    USHORT status, commandId;
+    PSCSI_REQUEST_BLOCK Srb;
+    PNVME_COMPLETION Completion;
+
+    processed = FALSE;
+
+    for (;;)
+    {
+        Completion = &Queue->CompletionQueue[Queue->CqHead];
+        status = *(volatile USHORT *)&Completion->Status;
+        if ((status & NVME_STATUS_PHASE) != Queue->Phase)
+        {
+            break;
+        }
+
+        // submission queue entries up to here may be reused
+        Queue->SqHead = Completion->SqHead;
+
+        commandId = Completion->CommandId;
+        Srb = (commandId < Queue->Depth) ? Queue->Srb[commandId] : NULL;
+
+        if (Srb != NULL)
+        {
+            Queue->Srb[commandId] = NULL;
+            InterlockedAnd(&Queue->CommandIdBitmap[commandId / 32], ~(1L << (commandId % 32)));
+
+            if (NVME_STATUS_CODE(status) == 0)
+            {
+                Srb->SrbStatus = SRB_STATUS_SUCCESS;
+            }
+            else
+            {
+                NvmeDebugPrint("\tCommand %x failed: %x\n", GetSrbExtension(Srb)->Command.Opcode, NVME_STATUS_CODE(status));
+                Srb->SrbStatus = SRB_STATUS_ERROR;
+            }
+
+            StorPortNotification(RequestComplete, AdapterExtension, Srb);
+        }
+
+        Queue->CqHead++;
+        if (Queue->CqHead == Queue->Depth)
+        {
+            Queue->CqHead = 0;
+            Queue->Phase ^= 1;
+        }
+
+        processed = TRUE;
+    }
+
+    if (processed)
+    {
+        StorPortWriteRegisterUlong(AdapterExtension, Queue->CompletionDoorbell, Queue->CqHead);
+    }
+
+    return processed;
+}// -- NvmeProcessCompletions();
+
+/**
+ * @name NvmeHwInterrupt
+ * @implemented
+ *
+ * Without message signaled interrupts every completion queue shares one vector
+ *
+ * @param DeviceExtension
+ *
+ * @return
+ * return TRUE if any completion queue had new entries
+ */
+BOOLEAN
+NTAPI
+NvmeHwInterrupt (
+    __in PVOID DeviceExtension
+    )
+{
+    ULONG index;
+    BOOLEAN interrupted;
+    PNVME_ADAPTER_EXTENSION AdapterExtension;
+
+    AdapterExtension = (PNVME_ADAPTER_EXTENSION)DeviceExtension;
+
+    if (AdapterExtension->Removed)
+    {
+        return FALSE;
+    }
+
+    interrupted = FALSE;
+    for (index = 0; index < AdapterExtension->QueueCount; index++)
+    {
+        if (NvmeProcessCompletions(AdapterExtension, &AdapterExtension->IoQueue[index]))
+        {
+            interrupted = TRUE;
+        }
+    }
+
+    return interrupted;
+}// -- NvmeHwInterrupt();
+
+/**
+ * @name NvmeHwMSInterrupt
+ * @implemented
+ *
+ * With MSI-X every message only has the completion queues created on it
+ *
+ * @param DeviceExtension
+ * @param MessageId
+ *
+ * @return
+ * return TRUE if any of them had new entries
+ */
+BOOLEAN
+NTAPI
+NvmeHwMSInterrupt (
+    __in PVOID DeviceExtension,
+    __in ULONG MessageId
+    )
+{
+    ULONG index;
+    BOOLEAN interrupted;
+    PNVME_ADAPTER_EXTENSION AdapterExtension;
+
+    AdapterExtension = (PNVME_ADAPTER_EXTENSION)DeviceExtension;
+
+    // a single message is shared by all of them
+    if (AdapterExtension->MessageCount <= 1)
+    {
+        return NvmeHwInterrupt(DeviceExtension);
+    }
+
+    if (AdapterExtension->Removed)
+    {
+        return FALSE;
+    }
+
+    // message 0 is the admin queue, which is polled
+    interrupted = FALSE;
+    for (index = 0; index < AdapterExtension->QueueCount; index++)
+    {
+        if ((AdapterExtension->IoQueue[index].MessageId == MessageId) &&
+            NvmeProcessCompletions(AdapterExtension, &AdapterExtension->IoQueue[index]))
+        {
+            interrupted = TRUE;
+        }
+    }
+
+    return interrupted;
+}// -- NvmeHwMSInterrupt();
+
+/**
+ * @name NvmeAllocateCommandId
+ * @implemented
+ *
+ * Only StartIo sets bits and only the interrupt clears them
+ *
+ * @param Queue
+ *
+ * @return
+ * return a free command id, or Queue->Depth if there is none
+ */
+USHORT
+NvmeAllocateCommandId (
+    __in PNVME_QUEUE Queue
+    )
+{
+    ULONG index, bit;
+    LONG bitmap;
+
+    for (index = 0; index < Queue->Depth; index += 32)
+    {
+        bitmap = Queue->CommandIdBitmap[index / 32];
+        if (bitmap == -1)
+        {
+            continue;
+        }
+
+        for (bit = 0; (bitmap & (1L << bit)) != 0; bit++);
+
+        if ((index + bit) >= Queue->Depth)
+        {
+            break;
+        }
+
+        InterlockedOr(&Queue->CommandIdBitmap[index / 32], 1L << bit);
+        return (USHORT)(index + bit);
+    }
+
+    return Queue->Depth;
+}// -- NvmeAllocateCommandId();
+
+/**
+ * @name NvmeSubmitCommand
+ * @implemented
+ *
+ * Put the Srb's command on the I/O queue of the processor that issued it,
+ * or of the next one with room if it is full. StartIo may run elsewhere,
+ * e.g. when storport starts a queued request from its completion DPC.
+ *
+ * @param AdapterExtension
+ * @param Srb
+ *
+ * @return
+ * return FALSE if every queue is full
+ */
+BOOLEAN
+NvmeSubmitCommand (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PSCSI_REQUEST_BLOCK Srb
+    )
+{
+    ULONG index, first;
+    USHORT commandId, nextTail;
+    PNVME_QUEUE Queue;
+    PNVME_SRB_EXTENSION SrbExtension;
+
+    SrbExtension = GetSrbExtension(Srb);
+    first = SrbExtension->Processor % AdapterExtension->QueueCount;
+
+    for (index = 0; index < AdapterExtension->QueueCount; index++)
+    {
+        Queue = &AdapterExtension->IoQueue[(first + index) % AdapterExtension->QueueCount];
+
+        nextTail = (Queue->SqTail + 1) % Queue->Depth;
+        if (nextTail == Queue->SqHead)
+        {
+            continue;
+        }
+
+        commandId = NvmeAllocateCommandId(Queue);
+        if (commandId == Queue->Depth)
+        {
+            continue;
+        }
+
+        Queue->Srb[commandId] = Srb;
+        SrbExtension->Command.CommandId = commandId;
+
+        StorPortCopyMemory(&Queue->SubmissionQueue[Queue->SqTail], &SrbExtension->Command, sizeof(NVME_COMMAND));
+        Queue->SqTail = nextTail;
+
+        StorPortWriteRegisterUlong(AdapterExtension, Queue->SubmissionDoorbell, Queue->SqTail);
+        return TRUE;
+    }
+
+    return FALSE;
+}// -- NvmeSubmitCommand();
+
+/**
+ * @name NvmeBuildPrps
+ * @implemented
+ *
+ * Describe the Srb's scatter gather list with PRP entries
+ *
+ * @param AdapterExtension
+ * @param Srb
+ *
+ * @return
+ * return FALSE if the list can't be described by PRPs
+ */
+BOOLEAN
+NvmeBuildPrps (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PSCSI_REQUEST_BLOCK Srb
+    )
+{
+    ULONG index, length, chunk, prpCount;
+    ULONGLONG address;
+    BOOLEAN first;
+    STOR_PHYSICAL_ADDRESS prpListPhysical;
+    PSTOR_SCATTER_GATHER_LIST sgl;
+    PNVME_SRB_EXTENSION SrbExtension;
+
+    SrbExtension = GetSrbExtension(Srb);
+    sgl = StorPortGetScatterGatherList(AdapterExtension, Srb);
+
+    if ((sgl == NULL) || (sgl->NumberOfElements == 0))
+    {
+        return FALSE;
+    }
+
+    first = TRUE;
+    prpCount = 0;
+
+    for (index = 0; index < sgl->NumberOfElements; index++)
+    {
+        address = sgl->List[index].PhysicalAddress.QuadPart;
+        length = sgl->List[index].Length;
+
+        // Only the first entry may start inside a page and only the last may end inside one
+        if ((index != 0) && ((address & (NVME_PAGE_SIZE - 1)) != 0))
+        {
+            return FALSE;
+        }
+
+        if ((index != sgl->NumberOfElements - 1) && (((address + length) & (NVME_PAGE_SIZE - 1)) != 0))
+        {
+            return FALSE;
+        }
+
+        while (length != 0)
+        {
+            chunk = min(length, NVME_PAGE_SIZE - (ULONG)(address & (NVME_PAGE_SIZE - 1)));
+
+            if (first)
+            {
+                SrbExtension->Command.Prp1 = address;
+                first = FALSE;
+            }
+            else
+            {
+                if (prpCount == NVME_MAX_PRP_LIST_ENTRIES)
+                {
+                    return FALSE;
+                }
+
+                SrbExtension->PrpList[prpCount++] = address;
+            }
+
+            address += chunk;
+            length -= chunk;
+        }
+    }
+
+    // A second page goes directly into PRP2, more than that need the list
+    if (prpCount == 0)
+    {
+        SrbExtension->Command.Prp2 = 0;
+    }
+    else if (prpCount == 1)
+    {
+        SrbExtension->Command.Prp2 = SrbExtension->PrpList[0];
+    }
+    else
+    {
+        prpListPhysical = StorPortGetPhysicalAddress(AdapterExtension, NULL, SrbExtension->PrpList, &length);
+        SrbExtension->Command.Prp2 = prpListPhysical.QuadPart;
+    }
+
+    return TRUE;
+}// -- NvmeBuildPrps();
+
+/**
+ * @name NvmeBuildReadWrite
+ * @implemented
+ *
+ * Translate SCSI read, write and synchronize cache into an NVM command
+ *
+ * @param AdapterExtension
+ * @param Srb
+ *
+ * @return
+ * return TRUE if the command is ready to be submitted,
+ * otherwise Srb->SrbStatus tells how the Srb is to be completed
+ */
+BOOLEAN
+NvmeBuildReadWrite (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PSCSI_REQUEST_BLOCK Srb
+    )
+{
+    PCDB cdb;
+    ULONG blockCount;
+    ULONG64 lba;
+    BOOLEAN fua;
+    PNVME_NAMESPACE Namespace;
+    PNVME_SRB_EXTENSION SrbExtension;
+
+    cdb = (PCDB)&Srb->Cdb;
+    SrbExtension = GetSrbExtension(Srb);
+
+    if ((Srb->Lun >= AdapterExtension->NamespaceCount) || !AdapterExtension->Namespace[Srb->Lun].Active)
+    {
+        Srb->SrbStatus = SRB_STATUS_SELECTION_TIMEOUT;
+        return FALSE;
+    }
+
+    Namespace = &AdapterExtension->Namespace[Srb->Lun];
+
+    StorPortZeroMemory(&SrbExtension->Command, sizeof(NVME_COMMAND));
+    SrbExtension->Command.NamespaceId = Srb->Lun + 1;
+
+    switch (cdb->CDB10.OperationCode)
+    {
+        case SCSIOP_SYNCHRONIZE_CACHE:
+        case SCSIOP_SYNCHRONIZE_CACHE16:
+            // nothing to do when writes are never cached
+            if (!AdapterExtension->VolatileWriteCache)
+            {
+                Srb->SrbStatus = SRB_STATUS_SUCCESS;
+                return FALSE;
+            }
+
+            SrbExtension->Command.Opcode = NVME_NVM_FLUSH;
+            SrbExtension->CommandReady = TRUE;
+            return TRUE;
+        case SCSIOP_READ:
+        case SCSIOP_WRITE:
+            lba = ((ULONG)cdb->CDB10.LogicalBlockByte0 << 24) |
+                  ((ULONG)cdb->CDB10.LogicalBlockByte1 << 16) |
+                  ((ULONG)cdb->CDB10.LogicalBlockByte2 << 8) |
+                  ((ULONG)cdb->CDB10.LogicalBlockByte3 << 0);
+            fua = cdb->CDB10.ForceUnitAccess;
+            break;
+        case SCSIOP_READ16:
+        case SCSIOP_WRITE16:
+            REVERSE_BYTES_QUAD(&lba, cdb->CDB16.LogicalBlock);
+            fua = cdb->CDB16.ForceUnitAccess;
+            break;
+        default:
+            Srb->SrbStatus = SRB_STATUS_INVALID_REQUEST;
+            return FALSE;
+    }
+
+    blockCount = Srb->DataTransferLength / Namespace->BlockSize;
+    Srb->DataTransferLength = blockCount * Namespace->BlockSize;
+
+    if (blockCount == 0)
+    {
+        Srb->SrbStatus = SRB_STATUS_SUCCESS;
+        return FALSE;
+    }
+
+    if ((blockCount > 0x10000) || (lba + blockCount > Namespace->BlockCount))
+    {
+        Srb->SrbStatus = SRB_STATUS_INVALID_REQUEST;
+        return FALSE;
+    }
+
+    if (!NvmeBuildPrps(AdapterExtension, Srb))
+    {
+        NvmeDebugPrint("\tScatter gather list not PRP compatible\n");
+        Srb->SrbStatus = SRB_STATUS_INVALID_REQUEST;
+        return FALSE;
+    }
+
+    SrbExtension->Command.Opcode = ((cdb->CDB10.OperationCode == SCSIOP_READ) ||
+                                    (cdb->CDB10.OperationCode == SCSIOP_READ16)) ? NVME_NVM_READ : NVME_NVM_WRITE;
+    SrbExtension->Command.Cdw10 = (ULONG)lba;
+    SrbExtension->Command.Cdw11 = (ULONG)(lba >> 32);
+    SrbExtension->Command.Cdw12 = (blockCount - 1) | (fua ? NVME_RW_FUA : 0);
+
+    SrbExtension->CommandReady = TRUE;
+    return TRUE;
+}// -- NvmeBuildReadWrite();
+
+/**
+ * @name NvmeHwBuildIo
+ * @implemented
+ *
+ * Build NVM commands before storport takes its StartIo lock,
+ * and note the processor to submit them on
+ *
+ * @param DeviceExtension
+ * @param Srb
+ *
+ * @return
+ * return FALSE if the Srb has been completed already
+ */
+BOOLEAN
+NTAPI
+NvmeHwBuildIo (
+    __in PVOID DeviceExtension,
+    __in PSCSI_REQUEST_BLOCK Srb
+    )
+{
+    PCDB cdb;
+    PNVME_ADAPTER_EXTENSION AdapterExtension;
+
+    AdapterExtension = (PNVME_ADAPTER_EXTENSION)DeviceExtension;
+    cdb = (PCDB)&Srb->Cdb;
+
+    // BuildIo runs on the issuing processor, StartIo not necessarily
+    GetSrbExtension(Srb)->Processor = KeGetCurrentProcessorNumber();
+    GetSrbExtension(Srb)->CommandReady = FALSE;
+
+    if ((Srb->Function != SRB_FUNCTION_EXECUTE_SCSI) || (Srb->CdbLength == 0))
+    {
+        return TRUE;
+    }
+
+    switch (cdb->CDB10.OperationCode)
+    {
+        case SCSIOP_READ:
+        case SCSIOP_WRITE:
+        case SCSIOP_READ16:
+        case SCSIOP_WRITE16:
+        case SCSIOP_SYNCHRONIZE_CACHE:
+        case SCSIOP_SYNCHRONIZE_CACHE16:
+            if (!NvmeBuildReadWrite(AdapterExtension, Srb))
+            {
+                StorPortNotification(RequestComplete, AdapterExtension, Srb);
+                return FALSE;
+            }
+            break;
+        default:
+            break;
+    }
+
+    return TRUE;
+}// -- NvmeHwBuildIo();
+
+/**
+ * @name NvmeInquiry
+ * @implemented
+ *
+ * Standard inquiry data and the supported and serial number VPD pages
+ *
+ * @param AdapterExtension
+ * @param Srb
+ * @param Cdb
+ *
+ * @return
+ * return SRB status
+ */
+UCHAR
+NvmeInquiry (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PSCSI_REQUEST_BLOCK Srb,
+    __in PCDB Cdb
+    )
+{
+    ULONG length;
+    PINQUIRYDATA InquiryData;
+    PVPD_SUPPORTED_PAGES_PAGE SupportedPages;
+    PVPD_SERIAL_NUMBER_PAGE SerialNumberPage;
+
+    if ((Srb->Lun >= AdapterExtension->NamespaceCount) || !AdapterExtension->Namespace[Srb->Lun].Active)
+    {
+        return SRB_STATUS_SELECTION_TIMEOUT;
+    }
+
+    if (Srb->DataBuffer == NULL)
+    {
+        return SRB_STATUS_INVALID_REQUEST;
+    }
+
+    StorPortZeroMemory(Srb->DataBuffer, Srb->DataTransferLength);
+
+    if (Cdb->CDB6INQUIRY3.EnableVitalProductData == 0)
+    {
+        if (Srb->DataTransferLength < INQUIRYDATABUFFERSIZE)
+        {
+            return SRB_STATUS_INVALID_REQUEST;
+        }
+
+        InquiryData = Srb->DataBuffer;
+        InquiryData->DeviceType = DIRECT_ACCESS_DEVICE;
+        InquiryData->Versions = 5;
+        InquiryData->ResponseDataFormat = 2;
+        InquiryData->AdditionalLength = INQUIRYDATABUFFERSIZE - 5;
+        InquiryData->CommandQueue = 1;
+
+        StorPortCopyMemory(InquiryData->VendorId, "NVMe    ", sizeof(InquiryData->VendorId));
+        StorPortCopyMemory(InquiryData->ProductId, AdapterExtension->ModelNumber, sizeof(InquiryData->ProductId));
+        StorPortCopyMemory(InquiryData->ProductRevisionLevel, AdapterExtension->FirmwareRevision, sizeof(InquiryData->ProductRevisionLevel));
+
+        Srb->DataTransferLength = INQUIRYDATABUFFERSIZE;
+
+        // every queue pair can hold Depth - 1 commands
+        StorPortSetDeviceQueueDepth(AdapterExtension,
+                                    Srb->PathId,
+                                    Srb->TargetId,
+                                    Srb->Lun,
+                                    min(NVME_LUN_QUEUE_DEPTH,
+                                        AdapterExtension->QueueCount * (AdapterExtension->IoQueue[0].Depth - 1)));
+
+        return SRB_STATUS_SUCCESS;
+    }
+
+    switch (Cdb->CDB6INQUIRY3.PageCode)
+    {
+        case VPD_SUPPORTED_PAGES:
+            length = sizeof(VPD_SUPPORTED_PAGES_PAGE) + 2;
+            if (Srb->DataTransferLength < length)
+            {
+                return SRB_STATUS_INVALID_REQUEST;
+            }
+
+            SupportedPages = Srb->DataBuffer;
+            SupportedPages->DeviceType = DIRECT_ACCESS_DEVICE;
+            SupportedPages->PageCode = VPD_SUPPORTED_PAGES;
+            SupportedPages->PageLength = 2;
+            SupportedPages->SupportedPageList[0] = VPD_SUPPORTED_PAGES;
+            SupportedPages->SupportedPageList[1] = VPD_SERIAL_NUMBER;
+            break;
+        case VPD_SERIAL_NUMBER:
+            length = sizeof(VPD_SERIAL_NUMBER_PAGE) + sizeof(AdapterExtension->SerialNumber) - 1;
+            if (Srb->DataTransferLength < length)
+            {
+                return SRB_STATUS_INVALID_REQUEST;
+            }
+
+            SerialNumberPage = Srb->DataBuffer;
+            SerialNumberPage->DeviceType = DIRECT_ACCESS_DEVICE;
+            SerialNumberPage->PageCode = VPD_SERIAL_NUMBER;
+            SerialNumberPage->PageLength = sizeof(AdapterExtension->SerialNumber) - 1;
+            StorPortCopyMemory(SerialNumberPage->SerialNumber,
+                               AdapterExtension->SerialNumber,
+                               sizeof(AdapterExtension->SerialNumber) - 1);
+            break;
+        default:
+            return SRB_STATUS_INVALID_REQUEST;
+    }
+
+    Srb->DataTransferLength = length;
+    return SRB_STATUS_SUCCESS;
+}// -- NvmeInquiry();
+
+/**
+ * @name NvmeReadCapacity
+ * @implemented
+ *
+ * Handle READ CAPACITY (10) and (16)
+ *
+ * @param AdapterExtension
+ * @param Srb
+ * @param Cdb
+ *
+ * @return
+ * return SRB status
+ */
+UCHAR
+NvmeReadCapacity (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PSCSI_REQUEST_BLOCK Srb,
+    __in PCDB Cdb
+    )
+{
+    ULONG maxLba, blockSize;
+    ULONG64 maxLba64;
+    PNVME_NAMESPACE Namespace;
+    PREAD_CAPACITY_DATA ReadCapacity;
+    PREAD_CAPACITY_DATA_EX ReadCapacityEx;
+
+    if ((Srb->Lun >= AdapterExtension->NamespaceCount) || !AdapterExtension->Namespace[Srb->Lun].Active)
+    {
+        return SRB_STATUS_SELECTION_TIMEOUT;
+    }
+
+    Namespace = &AdapterExtension->Namespace[Srb->Lun];
+    blockSize = Namespace->BlockSize;
+    maxLba64 = Namespace->BlockCount - 1;
+
+    if (Cdb->CDB10.OperationCode == SCSIOP_READ_CAPACITY)
+    {
+        if ((Srb->DataBuffer == NULL) || (Srb->DataTransferLength < sizeof(READ_CAPACITY_DATA)))
+        {
+            return SRB_STATUS_INVALID_REQUEST;
+        }
+
+        // too big for 32 bits, the class driver asks again with READ CAPACITY (16)
+        maxLba = (maxLba64 > 0xFFFFFFFF) ? 0xFFFFFFFF : (ULONG)maxLba64;
+
+        ReadCapacity = Srb->DataBuffer;
+        REVERSE_BYTES(&ReadCapacity->BytesPerBlock, &blockSize);
+        REVERSE_BYTES(&ReadCapacity->LogicalBlockAddress, &maxLba);
+
+        Srb->DataTransferLength = sizeof(READ_CAPACITY_DATA);
+        return SRB_STATUS_SUCCESS;
+    }
+
+    if ((Srb->Cdb[1] & 0x1F) != SERVICE_ACTION_READ_CAPACITY16)
+    {
+        return SRB_STATUS_INVALID_REQUEST;
+    }
+
+    if ((Srb->DataBuffer == NULL) || (Srb->DataTransferLength < sizeof(READ_CAPACITY_DATA_EX)))
+    {
+        return SRB_STATUS_INVALID_REQUEST;
+    }
+
+    ReadCapacityEx = Srb->DataBuffer;
+    REVERSE_BYTES(&ReadCapacityEx->BytesPerBlock, &blockSize);
+    REVERSE_BYTES_QUAD(&ReadCapacityEx->LogicalBlockAddress, &maxLba64);
+
+    Srb->DataTransferLength = sizeof(READ_CAPACITY_DATA_EX);
+    return SRB_STATUS_SUCCESS;
+}// -- NvmeReadCapacity();
+
+/**
+ * @name NvmeModeSense
+ * @implemented
+ *
+ * Return a mode parameter header without pages
+ *
+ * @param AdapterExtension
+ * @param Srb
+ * @param Cdb
+ *
+ * @return
+ * return SRB status
+ */
+UCHAR
+NvmeModeSense (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PSCSI_REQUEST_BLOCK Srb,
+    __in PCDB Cdb
+    )
+{
+    PMODE_PARAMETER_HEADER ModeHeader;
+    PMODE_PARAMETER_HEADER10 ModeHeader10;
+
+    UNREFERENCED_PARAMETER(AdapterExtension);
+
+    if (Srb->DataBuffer == NULL)
+    {
+        return SRB_STATUS_INVALID_REQUEST;
+    }
+
+    StorPortZeroMemory(Srb->DataBuffer, Srb->DataTransferLength);
+
+    if (Cdb->CDB10.OperationCode == SCSIOP_MODE_SENSE)
+    {
+        if (Srb->DataTransferLength < sizeof(MODE_PARAMETER_HEADER))
+        {
+            return SRB_STATUS_INVALID_REQUEST;
+        }
+
+        ModeHeader = Srb->DataBuffer;
+        ModeHeader->ModeDataLength = sizeof(MODE_PARAMETER_HEADER) - 1;
+        Srb->DataTransferLength = sizeof(MODE_PARAMETER_HEADER);
+    }
+    else
+    {
+        if (Srb->DataTransferLength < sizeof(MODE_PARAMETER_HEADER10))
+        {
+            return SRB_STATUS_INVALID_REQUEST;
+        }
+
+        ModeHeader10 = Srb->DataBuffer;
+        ModeHeader10->ModeDataLength[1] = sizeof(MODE_PARAMETER_HEADER10) - 2;
+        Srb->DataTransferLength = sizeof(MODE_PARAMETER_HEADER10);
+    }
+
+    return SRB_STATUS_SUCCESS;
+}// -- NvmeModeSense();
+
+/**
+ * @name NvmeReportLuns
+ * @implemented
+ *
+ * One LUN for each active namespace
+ *
+ * @param AdapterExtension
+ * @param Srb
+ *
+ * @return
+ * return SRB status
+ */
+UCHAR
+NvmeReportLuns (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PSCSI_REQUEST_BLOCK Srb
+    )
+{
+    ULONG index, count, length;
+    PLUN_LIST LunList;
+
+    if ((Srb->DataBuffer == NULL) || (Srb->DataTransferLength < sizeof(LUN_LIST)))
+    {
+        return SRB_STATUS_INVALID_REQUEST;
+    }
+
+    LunList = Srb->DataBuffer;
+    StorPortZeroMemory(LunList, Srb->DataTransferLength);
+
+    count = 0;
+    for (index = 0; index < AdapterExtension->NamespaceCount; index++)
+    {
+        if (!AdapterExtension->Namespace[index].Active)
+        {
+            continue;
+        }
+
+        if (sizeof(LUN_LIST) + (count + 1) * 8 <= Srb->DataTransferLength)
+        {
+            LunList->Lun[count][1] = (UCHAR)index;
+        }
+
+        count++;
+    }
+
+    // the list length tells the class driver how much room it would have needed
+    length = count * 8;
+    REVERSE_BYTES(&LunList->LunListLength, &length);
+
+    Srb->DataTransferLength = min(Srb->DataTransferLength, sizeof(LUN_LIST) + length);
+    return SRB_STATUS_SUCCESS;
+}// -- NvmeReportLuns();
+
+/**
+ * @name NvmeExecuteScsi
+ * @implemented
+ *
+ * Handle SRB_FUNCTION_EXECUTE_SCSI
+ *
+ * @param AdapterExtension
+ * @param Srb
+ *
+ * @return
+ * return SRB_STATUS_PENDING if the Srb went to the controller
+ */
+UCHAR
+NvmeExecuteScsi (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PSCSI_REQUEST_BLOCK Srb
+    )
+{
+    PCDB cdb;
+
+    cdb = (PCDB)&Srb->Cdb;
+
+    if ((Srb->PathId != 0) || (Srb->TargetId != 0) || (Srb->CdbLength == 0))
+    {
+        return SRB_STATUS_SELECTION_TIMEOUT;
+    }
+
+    switch (cdb->CDB10.OperationCode)
+    {
+        case SCSIOP_READ:
+        case SCSIOP_WRITE:
+        case SCSIOP_READ16:
+        case SCSIOP_WRITE16:
+        case SCSIOP_SYNCHRONIZE_CACHE:
+        case SCSIOP_SYNCHRONIZE_CACHE16:
+            if (!GetSrbExtension(Srb)->CommandReady &&
+                !NvmeBuildReadWrite(AdapterExtension, Srb))
+            {
+                return Srb->SrbStatus;
+            }
+
+            // storport sends it again once something has completed
+            if (!NvmeSubmitCommand(AdapterExtension, Srb))
+            {
+                return SRB_STATUS_BUSY;
+            }
+
+            return SRB_STATUS_PENDING;
+        case SCSIOP_INQUIRY:
+            return NvmeInquiry(AdapterExtension, Srb, cdb);
+        case SCSIOP_READ_CAPACITY:
+        case SCSIOP_READ_CAPACITY16:
+            return NvmeReadCapacity(AdapterExtension, Srb, cdb);
+        case SCSIOP_MODE_SENSE:
+        case SCSIOP_MODE_SENSE10:
+            return NvmeModeSense(AdapterExtension, Srb, cdb);
+        case SCSIOP_REPORT_LUNS:
+            return NvmeReportLuns(AdapterExtension, Srb);
+        case SCSIOP_TEST_UNIT_READY:
+        case SCSIOP_START_STOP_UNIT:
+        case SCSIOP_VERIFY:
+            if ((Srb->Lun >= AdapterExtension->NamespaceCount) || !AdapterExtension->Namespace[Srb->Lun].Active)
+            {
+                return SRB_STATUS_SELECTION_TIMEOUT;
+            }
+            return SRB_STATUS_SUCCESS;
+        default:
+            NvmeDebugPrint("\tOperationCode: %x\n", cdb->CDB10.OperationCode);
+            return SRB_STATUS_INVALID_REQUEST;
+    }
+}// -- NvmeExecuteScsi();
+
+/**
+ * @name NvmeHwStartIo
+ * @implemented
+ *
+ * The Storport driver calls the HwStorStartIo routine one time for each incoming I/O request.
+ *
+ * @param DeviceExtension
+ * @param Srb
+ *
+ * @return
+ * return TRUE if the request was accepted
+ */
+BOOLEAN
+NTAPI
+NvmeHwStartIo (
+    __in PVOID DeviceExtension,
+    __in PSCSI_REQUEST_BLOCK Srb
+    )
+{
+    UCHAR status;
+    PNVME_ADAPTER_EXTENSION AdapterExtension;
+
+    AdapterExtension = (PNVME_ADAPTER_EXTENSION)DeviceExtension;
+
+    if (AdapterExtension->Removed)
+    {
+        Srb->SrbStatus = SRB_STATUS_NO_DEVICE;
+        StorPortNotification(RequestComplete, AdapterExtension, Srb);
+        return TRUE;
+    }
+
+    switch (Srb->Function)
+    {
+        case SRB_FUNCTION_EXECUTE_SCSI:
+            status = NvmeExecuteScsi(AdapterExtension, Srb);
+            break;
+        case SRB_FUNCTION_PNP:
+            {
+                PSCSI_PNP_REQUEST_BLOCK pnpRequest;
+
+                pnpRequest = (PSCSI_PNP_REQUEST_BLOCK)Srb;
+                status = SRB_STATUS_SUCCESS;
+
+                if (((pnpRequest->SrbPnPFlags & SRB_PNP_FLAGS_ADAPTER_REQUEST) != 0) &&
+                    ((pnpRequest->PnPAction == StorRemoveDevice) ||
+                     (pnpRequest->PnPAction == StorSurpriseRemoval)))
+                {
+                    AdapterExtension->Removed = TRUE;
+                }
+            }
+            break;
+        case SRB_FUNCTION_FLUSH:
+        case SRB_FUNCTION_SHUTDOWN:
+        case SRB_FUNCTION_RESET_BUS:
+        case SRB_FUNCTION_RESET_DEVICE:
+        case SRB_FUNCTION_RESET_LOGICAL_UNIT:
+            // the disk class flushes with SYNCHRONIZE CACHE, outstanding commands finish on their own
+            status = SRB_STATUS_SUCCESS;
+            break;
+        default:
+            NvmeDebugPrint("\tUnknown function code recieved: %x\n", Srb->Function);
+            status = SRB_STATUS_INVALID_REQUEST;
+            break;
+    }
+
+    if (status != SRB_STATUS_PENDING)
+    {
+        Srb->SrbStatus = status;
+        StorPortNotification(RequestComplete, AdapterExtension, Srb);
+    }
+
+    return TRUE;
+}// -- NvmeHwStartIo();
+
+/**
+ * @name NvmeHwResetBus
+ * @implemented
+ *
+ * Nothing to reset, commands complete or fail on their own
+ *
+ * @param DeviceExtension
+ * @param PathId
+ *
+ * @return
+ * return TRUE
+ */
+BOOLEAN
+NTAPI
+NvmeHwResetBus (
+    __in PVOID DeviceExtension,
+    __in ULONG PathId
+    )
+{
+    UNREFERENCED_PARAMETER(DeviceExtension);
+    UNREFERENCED_PARAMETER(PathId);
+
+    NvmeDebugPrint("NvmeHwResetBus()\n");
+    return TRUE;
+}// -- NvmeHwResetBus();
+
+/**
+ * @name DriverEntry
+ * @implemented
+ *
+ * Initial Entrypoint for stornvme miniport driver
+ *
+ * @param DriverObject
+ * @param RegistryPath
+ *
+ * @return
+ * NT_STATUS in case of driver loaded successfully.
+ */
+ULONG
+NTAPI
+DriverEntry (
+    __in PVOID DriverObject,
+    __in PVOID RegistryPath
+    )
+{
+    ULONG status;
+    HW_INITIALIZATION_DATA hwInitializationData = {0};
+
+    hwInitializationData.HwInitializationDataSize = sizeof(HW_INITIALIZATION_DATA);
+
+    hwInitializationData.HwStartIo = NvmeHwStartIo;
+    hwInitializationData.HwBuildIo = NvmeHwBuildIo;
+    hwInitializationData.HwResetBus = NvmeHwResetBus;
+    hwInitializationData.HwInterrupt = NvmeHwInterrupt;
+    hwInitializationData.HwInitialize = NvmeHwInitialize;
+    hwInitializationData.HwFindAdapter = NvmeHwFindAdapter;
+
+    hwInitializationData.TaggedQueuing = TRUE;
+    hwInitializationData.AutoRequestSense = TRUE;
+    hwInitializationData.MultipleRequestPerLu = TRUE;
+    hwInitializationData.NeedPhysicalAddresses = TRUE;
+
+    hwInitializationData.NumberOfAccessRanges = 6;
+    hwInitializationData.AdapterInterfaceType = PCIBus;
+    hwInitializationData.MapBuffers = STOR_MAP_NON_READ_WRITE_BUFFERS;
+
+    // room to align the extension, see GetSrbExtension
+    hwInitializationData.SrbExtensionSize = sizeof(NVME_SRB_EXTENSION) + NVME_SRB_EXTENSION_ALIGNMENT;
+    hwInitializationData.DeviceExtensionSize = sizeof(NVME_ADAPTER_EXTENSION);
+
+    status = StorPortInitialize(DriverObject,
+                                RegistryPath,
+                                &hwInitializationData,
+                                NULL);
+
+    NT_ASSERT(status == STATUS_SUCCESS);
+    return status;
+}// -- DriverEntry();
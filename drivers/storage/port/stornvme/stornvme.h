@@ -0,0 +1,315 @@
+/*
+ * PROJECT:     ReactOS NVMe Storport Miniport
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     NVMe controller definitions
+ */
+
+#include <ntddk.h>
+#include <storport.h>
+
+#define NDEBUG
+#include <debug.h>
+
+#if defined(_MSC_VER)
+#pragma warning(disable:4214) // bit field types other than int
+#pragma warning(disable:4201) // nameless struct/union
+#endif
+
+#define NVME_PAGE_SIZE                      4096
+#define NVME_ADMIN_QUEUE_DEPTH              32
+#define NVME_IO_QUEUE_DEPTH                 64
+#define NVME_MAX_IO_QUEUES                  16
+#define NVME_MAX_NAMESPACES                 8
+#define NVME_LUN_QUEUE_DEPTH                254
+#define MAXIMUM_TRANSFER_LENGTH             (128 * 1024) // 128 KB
+
+// An unaligned transfer touches one page more than its length
+#define NVME_MAX_PRP_LIST_ENTRIES           (MAXIMUM_TRANSFER_LENGTH / NVME_PAGE_SIZE)
+
+// Polling limit for admin commands during initialization, in 10 microsecond steps
+#define NVME_ADMIN_TIMEOUT                  (500 * 1000 / 10)
+
+#ifndef SERVICE_ACTION_READ_CAPACITY16
+#define SERVICE_ACTION_READ_CAPACITY16      0x10
+#endif
+
+#define NvmeDebugPrint(format, ...) DbgPrint("(%s:%d) " format, __RELFILE__, __LINE__, ##__VA_ARGS__)
+
+//////////////////////////////////////////////////////////////
+//                 ---- Controller ----                     //
+//////////////////////////////////////////////////////////////
+
+// section 3.1, CAP
+#define NVME_CAP_MQES(Low)                  ((Low) & 0xFFFF)            // 0's based
+#define NVME_CAP_TO(Low)                    (((Low) >> 24) & 0xFF)      // 500 ms units
+#define NVME_CAP_DSTRD(High)                ((High) & 0xF)
+#define NVME_CAP_MPSMIN(High)               (((High) >> 16) & 0xF)
+
+// section 3.1.5, CC
+#define NVME_CC_EN                          (1 << 0)
+#define NVME_CC_CSS_NVM                     (0 << 4)
+#define NVME_CC_MPS(x)                      ((x) << 7)
+#define NVME_CC_SHN_NORMAL                  (1 << 14)
+#define NVME_CC_SHN_MASK                    (3 << 14)
+#define NVME_CC_IOSQES(x)                   ((x) << 16)
+#define NVME_CC_IOCQES(x)                   ((x) << 20)
+
+// section 3.1.6, CSTS
+#define NVME_CSTS_RDY                       (1 << 0)
+#define NVME_CSTS_CFS                       (1 << 1)
+#define NVME_CSTS_SHST_MASK                 (3 << 2)
+#define NVME_CSTS_SHST_COMPLETE             (2 << 2)
+
+typedef struct _NVME_CONTROLLER_REGISTERS
+{
+    ULONG CAP[2];                               // 0x00, Controller capabilities
+    ULONG VS;                                   // 0x08, Version
+    ULONG INTMS;                                // 0x0C, Interrupt mask set
+    ULONG INTMC;                                // 0x10, Interrupt mask clear
+    ULONG CC;                                   // 0x14, Controller configuration
+    ULONG Reserved0;                            // 0x18
+    ULONG CSTS;                                 // 0x1C, Controller status
+    ULONG NSSR;                                 // 0x20, NVM subsystem reset
+    ULONG AQA;                                  // 0x24, Admin queue attributes
+    ULONG ASQ[2];                               // 0x28, Admin submission queue base
+    ULONG ACQ[2];                               // 0x30, Admin completion queue base
+    ULONG Reserved1[(0x1000 - 0x38) / 4];       // 0x38 - 0xFFF, command set specific
+    ULONG Doorbell[1];                          // 0x1000, SQ tail and CQ head doorbells
+} NVME_CONTROLLER_REGISTERS, *PNVME_CONTROLLER_REGISTERS;
+
+//////////////////////////////////////////////////////////////
+//                  ---- Commands ----                      //
+//////////////////////////////////////////////////////////////
+
+// section 5, admin commands
+#define NVME_ADMIN_CREATE_IO_SQ             0x01
+#define NVME_ADMIN_CREATE_IO_CQ             0x05
+#define NVME_ADMIN_IDENTIFY                 0x06
+#define NVME_ADMIN_SET_FEATURES             0x09
+
+#define NVME_IDENTIFY_CNS_NAMESPACE         0x00
+#define NVME_IDENTIFY_CNS_CONTROLLER        0x01
+
+#define NVME_FEATURE_NUMBER_OF_QUEUES       0x07
+
+// Create I/O queue, CDW11
+#define NVME_QUEUE_PHYS_CONTIG              (1 << 0)
+#define NVME_CQ_IRQ_ENABLED                 (1 << 1)
+#define NVME_CQ_IRQ_VECTOR(x)               ((x) << 16)
+
+// section 6, NVM commands
+#define NVME_NVM_FLUSH                      0x00
+#define NVME_NVM_WRITE                      0x01
+#define NVME_NVM_READ                       0x02
+
+#define NVME_RW_FUA                         (1 << 30)
+
+// section 4.2
+typedef struct _NVME_COMMAND
+{
+    UCHAR Opcode;
+    UCHAR Flags;                                // FUSE and PSDT, 0 for PRPs
+    USHORT CommandId;
+    ULONG NamespaceId;
+    ULONG Reserved[2];
+    ULONGLONG MetadataPointer;
+    ULONGLONG Prp1;
+    ULONGLONG Prp2;
+    ULONG Cdw10;
+    ULONG Cdw11;
+    ULONG Cdw12;
+    ULONG Cdw13;
+    ULONG Cdw14;
+    ULONG Cdw15;
+} NVME_COMMAND, *PNVME_COMMAND;
+
+// section 4.6
+#define NVME_STATUS_PHASE                   (1 << 0)
+#define NVME_STATUS_CODE(Status)            (((Status) >> 1) & 0x7FF)   // type and code
+
+typedef struct _NVME_COMPLETION
+{
+    ULONG Result;
+    ULONG Reserved;
+    USHORT SqHead;
+    USHORT SqId;
+    USHORT CommandId;
+    USHORT Status;
+} NVME_COMPLETION, *PNVME_COMPLETION;
+
+// Figure 247, only what we use
+typedef struct _NVME_IDENTIFY_CONTROLLER
+{
+    USHORT VendorId;
+    USHORT SubsystemVendorId;
+    UCHAR SerialNumber[20];
+    UCHAR ModelNumber[40];
+    UCHAR FirmwareRevision[8];
+    UCHAR Rab;
+    UCHAR Ieee[3];
+    UCHAR Cmic;
+    UCHAR Mdts;                                 // power of two in CAP.MPSMIN pages, 0 = no limit
+    UCHAR Reserved0[516 - 78];
+    ULONG NamespaceCount;
+    UCHAR Reserved1[525 - 520];
+    UCHAR VolatileWriteCache;
+    UCHAR Reserved2[4096 - 526];
+} NVME_IDENTIFY_CONTROLLER, *PNVME_IDENTIFY_CONTROLLER;
+
+// Figure 249, only what we use
+typedef struct _NVME_IDENTIFY_NAMESPACE
+{
+    ULONGLONG Size;                             // in logical blocks
+    ULONGLONG Capacity;
+    ULONGLONG Utilization;
+    UCHAR Features;
+    UCHAR LbaFormatCount;
+    UCHAR FormattedLbaSize;                     // bits 3:0 index LbaFormat
+    UCHAR Reserved0[128 - 27];
+    ULONG LbaFormat[16];                        // bits 23:16 LBA data size, power of two
+    UCHAR Reserved1[4096 - 192];
+} NVME_IDENTIFY_NAMESPACE, *PNVME_IDENTIFY_NAMESPACE;
+
+#define NVME_LBAF_LBADS(x)                  (((x) >> 16) & 0xFF)
+
+//////////////////////////////////////////////////////////////
+//              ---- Support Structures ---                 //
+//////////////////////////////////////////////////////////////
+
+// One submission queue and the completion queue it posts to
+typedef struct _NVME_QUEUE
+{
+    PNVME_COMMAND SubmissionQueue;
+    PNVME_COMPLETION CompletionQueue;
+    STOR_PHYSICAL_ADDRESS SubmissionQueuePhysical;
+    STOR_PHYSICAL_ADDRESS CompletionQueuePhysical;
+    PULONG SubmissionDoorbell;
+    PULONG CompletionDoorbell;
+
+    USHORT QueueId;
+    USHORT Depth;
+    USHORT SqTail;                              // written by StartIo only
+    volatile USHORT SqHead;                     // as last reported by the controller
+    USHORT CqHead;
+    USHORT Phase;
+    USHORT MessageId;                           // interrupt vector of the completion queue
+
+    // Command ids in use, set at submission and cleared from the interrupt
+    volatile LONG CommandIdBitmap[NVME_IO_QUEUE_DEPTH / 32];
+    PSCSI_REQUEST_BLOCK Srb[NVME_IO_QUEUE_DEPTH];
+} NVME_QUEUE, *PNVME_QUEUE;
+
+typedef struct _NVME_NAMESPACE
+{
+    BOOLEAN Active;
+    ULONG BlockSize;
+    ULONGLONG BlockCount;
+} NVME_NAMESPACE, *PNVME_NAMESPACE;
+
+// Holds Adapter Information
+typedef struct _NVME_ADAPTER_EXTENSION
+{
+    PNVME_CONTROLLER_REGISTERS Registers;
+    ULONG DoorbellStride;                       // in ULONGs
+    ULONG ReadyTimeout;                         // in milliseconds
+    ULONG MaximumTransferLength;
+    ULONG QueueCount;                           // I/O queue pairs
+    ULONG MessageCount;                         // MSI-X messages, 0 or 1 if they all share one
+    ULONG NamespaceCount;
+    BOOLEAN VolatileWriteCache;
+    BOOLEAN Removed;
+
+    PUCHAR IdentifyBuffer;
+    STOR_PHYSICAL_ADDRESS IdentifyBufferPhysical;
+
+    // I/O queues are created once the interrupt messages are known
+    PUCHAR IoQueueMemory;
+    ULONG IoQueueCount;
+    USHORT IoQueueDepth;
+
+    UCHAR SerialNumber[21];
+    UCHAR ModelNumber[41];
+    UCHAR FirmwareRevision[9];
+
+    NVME_NAMESPACE Namespace[NVME_MAX_NAMESPACES];
+    NVME_QUEUE AdminQueue;
+    NVME_QUEUE IoQueue[NVME_MAX_IO_QUEUES];
+} NVME_ADAPTER_EXTENSION, *PNVME_ADAPTER_EXTENSION;
+
+// The PRP list may not cross a page, so the extension is aligned to its own size
+#define NVME_SRB_EXTENSION_ALIGNMENT        512
+
+typedef struct _NVME_SRB_EXTENSION
+{
+    ULONGLONG PrpList[NVME_MAX_PRP_LIST_ENTRIES];
+    NVME_COMMAND Command;
+    ULONG Processor;                            // that issued it, see HwBuildIo
+    BOOLEAN CommandReady;                       // built by HwBuildIo
+} NVME_SRB_EXTENSION, *PNVME_SRB_EXTENSION;
+
+//////////////////////////////////////////////////////////////
+//                       Declarations                       //
+//////////////////////////////////////////////////////////////
+
+BOOLEAN
+NvmeSubmitAdminCommand (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PNVME_COMMAND Command,
+    __out_opt PULONG Result
+    );
+
+BOOLEAN
+NvmeBuildReadWrite (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PSCSI_REQUEST_BLOCK Srb
+    );
+
+UCHAR
+NvmeExecuteScsi (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PSCSI_REQUEST_BLOCK Srb
+    );
+
+BOOLEAN
+NTAPI
+NvmeHwMSInterrupt (
+    __in PVOID DeviceExtension,
+    __in ULONG MessageId
+    );
+
+FORCEINLINE
+PNVME_SRB_EXTENSION
+GetSrbExtension (
+    __in PSCSI_REQUEST_BLOCK Srb
+    );
+
+FORCEINLINE
+PULONG
+NvmeDoorbell (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in ULONG Index
+    );
+
+//////////////////////////////////////////////////////////////
+//                       Assertions                         //
+//////////////////////////////////////////////////////////////
+
+C_ASSERT(FIELD_OFFSET(NVME_CONTROLLER_REGISTERS, CC)        == 0x14);
+C_ASSERT(FIELD_OFFSET(NVME_CONTROLLER_REGISTERS, CSTS)      == 0x1C);
+C_ASSERT(FIELD_OFFSET(NVME_CONTROLLER_REGISTERS, AQA)       == 0x24);
+C_ASSERT(FIELD_OFFSET(NVME_CONTROLLER_REGISTERS, ACQ)       == 0x30);
+C_ASSERT(FIELD_OFFSET(NVME_CONTROLLER_REGISTERS, Doorbell)  == 0x1000);
+
+C_ASSERT(sizeof(NVME_COMMAND)                       == 64);
+C_ASSERT(sizeof(NVME_COMPLETION)                    == 16);
+
+C_ASSERT(FIELD_OFFSET(NVME_IDENTIFY_CONTROLLER, Mdts)               == 77);
+C_ASSERT(FIELD_OFFSET(NVME_IDENTIFY_CONTROLLER, NamespaceCount)     == 516);
+C_ASSERT(FIELD_OFFSET(NVME_IDENTIFY_CONTROLLER, VolatileWriteCache) == 525);
+C_ASSERT(sizeof(NVME_IDENTIFY_CONTROLLER)                           == 4096);
+
+C_ASSERT(FIELD_OFFSET(NVME_IDENTIFY_NAMESPACE, FormattedLbaSize)    == 26);
+C_ASSERT(FIELD_OFFSET(NVME_IDENTIFY_NAMESPACE, LbaFormat)           == 128);
+C_ASSERT(sizeof(NVME_IDENTIFY_NAMESPACE)                            == 4096);
+
+C_ASSERT(sizeof(NVME_SRB_EXTENSION) <= NVME_SRB_EXTENSION_ALIGNMENT);
@@ -99,6 +99,59 @@ PortFdoConnectInterrupt(
 }
 
 
+static
+NTSTATUS
+PortFdoGetDmaAdapter(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension)
+{
+    PPORT_CONFIGURATION_INFORMATION PortConfig;
+    DEVICE_DESCRIPTION DeviceDescription;
+    ULONG MapRegisters = 0;
+
+    DPRINT1("PortFdoGetDmaAdapter(%p)\n", DeviceExtension);
+
+    if (DeviceExtension->DmaAdapter != NULL)
+        return STATUS_SUCCESS;
+
+    PortConfig = &DeviceExtension->Miniport.PortConfig;
+
+    /* Storport miniports are bus masters and always get scatter/gather lists */
+    RtlZeroMemory(&DeviceDescription, sizeof(DEVICE_DESCRIPTION));
+    DeviceDescription.Version = DEVICE_DESCRIPTION_VERSION;
+    DeviceDescription.Master = TRUE;
+    DeviceDescription.ScatterGather = TRUE;
+    DeviceDescription.Dma32BitAddresses = PortConfig->Dma32BitAddresses;
+    DeviceDescription.Dma64BitAddresses = (PortConfig->Dma64BitAddresses & SCSI_DMA64_MINIPORT_SUPPORTED) != 0;
+    DeviceDescription.BusNumber = PortConfig->SystemIoBusNumber;
+    DeviceDescription.InterfaceType = PortConfig->AdapterInterfaceType;
+    DeviceDescription.MaximumLength = PortConfig->MaximumTransferLength;
+
+    DeviceExtension->DmaAdapter = IoGetDmaAdapter(DeviceExtension->PhysicalDevice,
+                                                  &DeviceDescription,
+                                                  &MapRegisters);
+    if (DeviceExtension->DmaAdapter == NULL)
+    {
+        DPRINT1("IoGetDmaAdapter() failed\n");
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    /* A request can't have more pages than the adapter has breaks */
+    if (PortConfig->NumberOfPhysicalBreaks != 0 &&
+        PortConfig->NumberOfPhysicalBreaks < MapRegisters)
+    {
+        DeviceExtension->MaximumPhysicalPages = PortConfig->NumberOfPhysicalBreaks;
+    }
+    else
+    {
+        DeviceExtension->MaximumPhysicalPages = MapRegisters;
+    }
+
+    DPRINT1("MaximumPhysicalPages: %lu\n", DeviceExtension->MaximumPhysicalPages);
+
+    return STATUS_SUCCESS;
+}
+
+
 static
 NTSTATUS
 PortFdoStartMiniport(
@@ -139,6 +192,28 @@ PortFdoStartMiniport(
         return Status;
     }
 
+    /* The miniport has told us how it does DMA */
+    Status = PortFdoGetDmaAdapter(DeviceExtension);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("PortFdoGetDmaAdapter() failed (Status 0x%08lx)\n", Status);
+        return Status;
+    }
+
+    /* Requests get their SRB extensions from here */
+    if (DeviceExtension->Miniport.PortConfig.SrbExtensionSize != 0 &&
+        !DeviceExtension->SrbExtensionListInitialized)
+    {
+        ExInitializeNPagedLookasideList(&DeviceExtension->SrbExtensionList,
+                                        NULL,
+                                        NULL,
+                                        0,
+                                        DeviceExtension->Miniport.PortConfig.SrbExtensionSize,
+                                        TAG_SRB_EXTENSION,
+                                        0);
+        DeviceExtension->SrbExtensionListInitialized = TRUE;
+    }
+
     /* Connect the configured interrupt */
     Status = PortFdoConnectInterrupt(DeviceExtension);
     if (!NT_SUCCESS(Status))
@@ -480,6 +555,10 @@ PortFdoScanBus(
         {
             DPRINT("  Scanning target %ld:%ld\n", Bus, Target);
 
+            /* Units found by an earlier scan are kept */
+            if (PortGetPdoExtension(DeviceExtension, Bus, Target, 0) != NULL)
+                continue;
+
             DPRINT("    Scanning logical unit %ld:%ld:%ld\n", Bus, Target, 0);
             Status = PortCreatePdo(DeviceExtension, Bus, Target, 0, &PdoExtension);
             if (NT_SUCCESS(Status))
@@ -526,18 +605,46 @@ PortFdoQueryBusRelations(
     _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
     _Out_ PULONG_PTR Information)
 {
-    NTSTATUS Status = STATUS_SUCCESS;;
+    PPDO_DEVICE_EXTENSION PdoExtension;
+    PDEVICE_RELATIONS DeviceRelations;
+    PLIST_ENTRY ListEntry;
+    ULONG Count = 0;
+    NTSTATUS Status;
 
     DPRINT1("PortFdoQueryBusRelations(%p %p)\n",
             DeviceExtension, Information);
 
     Status = PortFdoScanBus(DeviceExtension);
+    if (!NT_SUCCESS(Status))
+        return Status;
 
     DPRINT1("Units found: %lu\n", DeviceExtension->PdoCount);
 
-    *Information = 0;
+    /* The PDO list only changes while the bus is scanned, which is us */
+    DeviceRelations = ExAllocatePoolWithTag(PagedPool,
+                                            FIELD_OFFSET(DEVICE_RELATIONS, Objects[DeviceExtension->PdoCount]),
+                                            TAG_PNP_DATA);
+    if (DeviceRelations == NULL)
+        return STATUS_INSUFFICIENT_RESOURCES;
 
-    return Status;
+    ListEntry = DeviceExtension->PdoListHead.Flink;
+    while (ListEntry != &DeviceExtension->PdoListHead)
+    {
+        PdoExtension = CONTAINING_RECORD(ListEntry,
+                                         PDO_DEVICE_EXTENSION,
+                                         PdoListEntry);
+
+        ObReferenceObject(PdoExtension->Device);
+        DeviceRelations->Objects[Count++] = PdoExtension->Device;
+
+        ListEntry = ListEntry->Flink;
+    }
+
+    DeviceRelations->Count = Count;
+
+    *Information = (ULONG_PTR)DeviceRelations;
+
+    return STATUS_SUCCESS;
 }
 
 
@@ -563,6 +670,490 @@ PortFdoFilterRequirements(
 }
 
 
+static
+NTSTATUS
+PortSrbStatusToNtStatus(
+    _In_ UCHAR SrbStatus)
+{
+    switch (SRB_STATUS(SrbStatus))
+    {
+        case SRB_STATUS_SUCCESS:
+            return STATUS_SUCCESS;
+
+        case SRB_STATUS_TIMEOUT:
+        case SRB_STATUS_COMMAND_TIMEOUT:
+            return STATUS_IO_TIMEOUT;
+
+        case SRB_STATUS_BAD_SRB_BLOCK_LENGTH:
+        case SRB_STATUS_BAD_FUNCTION:
+            return STATUS_INVALID_DEVICE_REQUEST;
+
+        case SRB_STATUS_NO_DEVICE:
+        case SRB_STATUS_INVALID_LUN:
+        case SRB_STATUS_INVALID_TARGET_ID:
+        case SRB_STATUS_NO_HBA:
+            return STATUS_DEVICE_DOES_NOT_EXIST;
+
+        case SRB_STATUS_DATA_OVERRUN:
+            return STATUS_BUFFER_OVERFLOW;
+
+        case SRB_STATUS_SELECTION_TIMEOUT:
+            return STATUS_DEVICE_NOT_CONNECTED;
+
+        default:
+            return STATUS_IO_DEVICE_ERROR;
+    }
+}
+
+
+static
+VOID
+PortFdoCountDownBusy(
+    _Inout_ PLONG BusyRequestsToComplete)
+{
+    LONG Count;
+
+    /* The miniport may make us busy again at any time */
+    do
+    {
+        Count = *BusyRequestsToComplete;
+        if (Count == 0)
+            return;
+    }
+    while (InterlockedCompareExchange(BusyRequestsToComplete, Count - 1, Count) != Count);
+}
+
+
+static
+VOID
+PortFdoReleaseRequest(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ PPDO_DEVICE_EXTENSION PdoExtension,
+    _In_ PIRP Irp,
+    _In_ PSCSI_REQUEST_BLOCK Srb)
+{
+    /* Called with the StartIo lock held */
+    if (Srb->QueueTag == SP_UNTAGGED)
+    {
+        if (PdoExtension->UntaggedSrb == Srb)
+            PdoExtension->UntaggedSrb = NULL;
+    }
+    else
+    {
+        PdoExtension->TagTable[Srb->QueueTag] = NULL;
+        RtlClearBit(&PdoExtension->TagBitmap, Srb->QueueTag);
+    }
+
+    PdoExtension->OutstandingCount--;
+    DeviceExtension->OutstandingCount--;
+    PORT_IRP_STARTED(Irp) = (PVOID)FALSE;
+}
+
+
+static
+VOID
+PortFdoStartUnitRequests(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ PPDO_DEVICE_EXTENSION PdoExtension)
+{
+    PSCSI_REQUEST_BLOCK Srb;
+    PLIST_ENTRY ListEntry;
+    PIRP Irp;
+    ULONG Tag;
+
+    while (!IsListEmpty(&PdoExtension->RequestListHead))
+    {
+        if (DeviceExtension->BusyRequestsToComplete != 0 ||
+            PdoExtension->BusyRequestsToComplete != 0)
+            break;
+
+        /* An untagged request has the unit to itself */
+        if (PdoExtension->UntaggedSrb != NULL ||
+            PdoExtension->OutstandingCount >= PdoExtension->QueueDepth)
+            break;
+
+        ListEntry = PdoExtension->RequestListHead.Flink;
+        Irp = CONTAINING_RECORD(ListEntry, IRP, Tail.Overlay.ListEntry);
+        Srb = IoGetCurrentIrpStackLocation(Irp)->Parameters.Scsi.Srb;
+
+        if (Srb->SrbFlags & SRB_FLAGS_QUEUE_ACTION_ENABLE)
+        {
+            Tag = RtlFindClearBitsAndSet(&PdoExtension->TagBitmap, 1, 0);
+            if (Tag == MAXULONG)
+                break;
+
+            Srb->QueueTag = (UCHAR)Tag;
+            PdoExtension->TagTable[Tag] = Srb;
+        }
+        else
+        {
+            /* Let the tagged requests drain first */
+            if (PdoExtension->OutstandingCount != 0)
+                break;
+
+            Srb->QueueTag = SP_UNTAGGED;
+            PdoExtension->UntaggedSrb = Srb;
+        }
+
+        RemoveEntryList(ListEntry);
+        PdoExtension->OutstandingCount++;
+        DeviceExtension->OutstandingCount++;
+        PORT_IRP_STARTED(Irp) = (PVOID)TRUE;
+
+        if (!MiniportStartIo(&DeviceExtension->Miniport, Srb))
+        {
+            /* The miniport can't take it now, retry after the next completion */
+            DPRINT1("HwStartIo() refused Srb %p\n", Srb);
+            PortFdoReleaseRequest(DeviceExtension, PdoExtension, Irp, Srb);
+            InsertHeadList(&PdoExtension->RequestListHead, ListEntry);
+            InterlockedCompareExchange(&DeviceExtension->BusyRequestsToComplete, 1, 0);
+            break;
+        }
+    }
+}
+
+
+VOID
+PortFdoStartNextRequests(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension)
+{
+    PPDO_DEVICE_EXTENSION PdoExtension;
+    PLIST_ENTRY ListEntry;
+    KLOCK_QUEUE_HANDLE LockHandle;
+    LARGE_INTEGER DueTime;
+    BOOLEAN Stalled = FALSE;
+
+    /* Called at DISPATCH_LEVEL with the StartIo lock held */
+    KeAcquireInStackQueuedSpinLockAtDpcLevel(&DeviceExtension->PdoListLock,
+                                             &LockHandle);
+
+    ListEntry = DeviceExtension->PdoListHead.Flink;
+    while (ListEntry != &DeviceExtension->PdoListHead)
+    {
+        PdoExtension = CONTAINING_RECORD(ListEntry,
+                                         PDO_DEVICE_EXTENSION,
+                                         PdoListEntry);
+
+        PortFdoStartUnitRequests(DeviceExtension, PdoExtension);
+
+        if (PdoExtension->BusyRequestsToComplete != 0 &&
+            PdoExtension->OutstandingCount == 0)
+            Stalled = TRUE;
+
+        ListEntry = ListEntry->Flink;
+    }
+
+    KeReleaseInStackQueuedSpinLockFromDpcLevel(&LockHandle);
+
+    if (DeviceExtension->BusyRequestsToComplete != 0 &&
+        DeviceExtension->OutstandingCount == 0)
+        Stalled = TRUE;
+
+    /* No completion is going to end the busy state, give it a while */
+    if (Stalled)
+    {
+        DueTime.QuadPart = -(LONGLONG)PORT_BUSY_TIMEOUT * 10000;
+        KeSetTimer(&DeviceExtension->BusyTimer,
+                   DueTime,
+                   &DeviceExtension->BusyTimerDpc);
+    }
+}
+
+
+VOID
+NTAPI
+PortFdoCompletionDpc(
+    _In_ PKDPC Dpc,
+    _In_opt_ PVOID DeferredContext,
+    _In_opt_ PVOID SystemArgument1,
+    _In_opt_ PVOID SystemArgument2)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension = DeferredContext;
+    PPDO_DEVICE_EXTENSION PdoExtension;
+    PIO_STACK_LOCATION Stack;
+    PSCSI_REQUEST_BLOCK Srb;
+    LIST_ENTRY CompletedListHead;
+    PLIST_ENTRY ListEntry;
+    PIRP Irp;
+
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(SystemArgument1);
+    UNREFERENCED_PARAMETER(SystemArgument2);
+
+    /* Take everything the miniport has completed so far */
+    InitializeListHead(&CompletedListHead);
+    while ((ListEntry = ExInterlockedRemoveHeadList(&DeviceExtension->CompletionListHead,
+                                                    &DeviceExtension->CompletionListLock)) != NULL)
+    {
+        InsertTailList(&CompletedListHead, ListEntry);
+    }
+
+    /* Account for the whole batch and refill the unit queues at once */
+    KeAcquireSpinLockAtDpcLevel(&DeviceExtension->StartIoLock);
+
+    ListEntry = CompletedListHead.Flink;
+    while (ListEntry != &CompletedListHead)
+    {
+        Irp = CONTAINING_RECORD(ListEntry, IRP, Tail.Overlay.ListEntry);
+        ListEntry = ListEntry->Flink;
+
+        Stack = IoGetCurrentIrpStackLocation(Irp);
+        Srb = Stack->Parameters.Scsi.Srb;
+        PdoExtension = (PPDO_DEVICE_EXTENSION)Stack->DeviceObject->DeviceExtension;
+
+        /* Requests the miniport refused in HwBuildIo were never started */
+        if (PORT_IRP_STARTED(Irp))
+        {
+            PortFdoReleaseRequest(DeviceExtension, PdoExtension, Irp, Srb);
+            PortFdoCountDownBusy(&DeviceExtension->BusyRequestsToComplete);
+            PortFdoCountDownBusy(&PdoExtension->BusyRequestsToComplete);
+        }
+
+        /* A busy unit gets the request again once something else completed */
+        if (SRB_STATUS(Srb->SrbStatus) == SRB_STATUS_BUSY)
+        {
+            DPRINT("Srb %p busy, requeueing\n", Srb);
+            RemoveEntryList(&Irp->Tail.Overlay.ListEntry);
+            Srb->SrbStatus = SRB_STATUS_PENDING;
+            InsertHeadList(&PdoExtension->RequestListHead,
+                           &Irp->Tail.Overlay.ListEntry);
+            InterlockedCompareExchange(&PdoExtension->BusyRequestsToComplete, 1, 0);
+        }
+    }
+
+    PortFdoStartNextRequests(DeviceExtension);
+
+    KeReleaseSpinLockFromDpcLevel(&DeviceExtension->StartIoLock);
+
+    /* Complete the IRPs outside of the lock */
+    while (!IsListEmpty(&CompletedListHead))
+    {
+        ListEntry = RemoveHeadList(&CompletedListHead);
+        Irp = CONTAINING_RECORD(ListEntry, IRP, Tail.Overlay.ListEntry);
+        Srb = IoGetCurrentIrpStackLocation(Irp)->Parameters.Scsi.Srb;
+
+        if (PORT_IRP_SG_LIST(Irp) != NULL)
+        {
+            DeviceExtension->DmaAdapter->DmaOperations->PutScatterGatherList(DeviceExtension->DmaAdapter,
+                                                                            PORT_IRP_SG_LIST(Irp),
+                                                                            (Srb->SrbFlags & SRB_FLAGS_DATA_OUT) != 0);
+            PORT_IRP_SG_LIST(Irp) = NULL;
+        }
+
+        if (PORT_IRP_MDL(Irp) != NULL)
+        {
+            IoFreeMdl(PORT_IRP_MDL(Irp));
+            PORT_IRP_MDL(Irp) = NULL;
+        }
+
+        if (Srb->SrbExtension != NULL)
+        {
+            ExFreeToNPagedLookasideList(&DeviceExtension->SrbExtensionList,
+                                        Srb->SrbExtension);
+            Srb->SrbExtension = NULL;
+        }
+
+        Irp->IoStatus.Status = PortSrbStatusToNtStatus(Srb->SrbStatus);
+        if (NT_SUCCESS(Irp->IoStatus.Status) ||
+            SRB_STATUS(Srb->SrbStatus) == SRB_STATUS_DATA_OVERRUN)
+            Irp->IoStatus.Information = Srb->DataTransferLength;
+        else
+            Irp->IoStatus.Information = 0;
+
+        IoCompleteRequest(Irp, IO_DISK_INCREMENT);
+    }
+}
+
+
+VOID
+NTAPI
+PortFdoBusyTimerDpc(
+    _In_ PKDPC Dpc,
+    _In_opt_ PVOID DeferredContext,
+    _In_opt_ PVOID SystemArgument1,
+    _In_opt_ PVOID SystemArgument2)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension = DeferredContext;
+    PPDO_DEVICE_EXTENSION PdoExtension;
+    PLIST_ENTRY ListEntry;
+    KLOCK_QUEUE_HANDLE LockHandle;
+
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(SystemArgument1);
+    UNREFERENCED_PARAMETER(SystemArgument2);
+
+    KeAcquireSpinLockAtDpcLevel(&DeviceExtension->StartIoLock);
+
+    /* Whatever is busy with nothing outstanding has waited long enough */
+    if (DeviceExtension->OutstandingCount == 0)
+        InterlockedExchange(&DeviceExtension->BusyRequestsToComplete, 0);
+
+    KeAcquireInStackQueuedSpinLockAtDpcLevel(&DeviceExtension->PdoListLock,
+                                             &LockHandle);
+
+    ListEntry = DeviceExtension->PdoListHead.Flink;
+    while (ListEntry != &DeviceExtension->PdoListHead)
+    {
+        PdoExtension = CONTAINING_RECORD(ListEntry,
+                                         PDO_DEVICE_EXTENSION,
+                                         PdoListEntry);
+        if (PdoExtension->OutstandingCount == 0)
+            InterlockedExchange(&PdoExtension->BusyRequestsToComplete, 0);
+
+        ListEntry = ListEntry->Flink;
+    }
+
+    KeReleaseInStackQueuedSpinLockFromDpcLevel(&LockHandle);
+
+    PortFdoStartNextRequests(DeviceExtension);
+
+    KeReleaseSpinLockFromDpcLevel(&DeviceExtension->StartIoLock);
+}
+
+
+NTSTATUS
+PortFdoQueryAdapterProperty(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _Inout_ PIRP Irp)
+{
+    PIO_STACK_LOCATION Stack;
+    PSTORAGE_PROPERTY_QUERY PropertyQuery;
+    PSTORAGE_DESCRIPTOR_HEADER DescriptorHeader;
+    PSTORAGE_ADAPTER_DESCRIPTOR AdapterDescriptor;
+    PPORT_CONFIGURATION_INFORMATION PortConfig;
+    ULONG OutputLength;
+
+    DPRINT("PortFdoQueryAdapterProperty(%p %p)\n", DeviceExtension, Irp);
+
+    Stack = IoGetCurrentIrpStackLocation(Irp);
+    PropertyQuery = Irp->AssociatedIrp.SystemBuffer;
+    OutputLength = Stack->Parameters.DeviceIoControl.OutputBufferLength;
+
+    if (PropertyQuery->QueryType == PropertyExistsQuery)
+        return STATUS_SUCCESS;
+
+    if (PropertyQuery->QueryType != PropertyStandardQuery)
+        return STATUS_INVALID_PARAMETER;
+
+    /* Tell the caller how much room the descriptor needs */
+    if (OutputLength < sizeof(STORAGE_ADAPTER_DESCRIPTOR))
+    {
+        if (OutputLength < sizeof(STORAGE_DESCRIPTOR_HEADER))
+            return STATUS_BUFFER_TOO_SMALL;
+
+        DescriptorHeader = Irp->AssociatedIrp.SystemBuffer;
+        DescriptorHeader->Version = sizeof(STORAGE_ADAPTER_DESCRIPTOR);
+        DescriptorHeader->Size = sizeof(STORAGE_ADAPTER_DESCRIPTOR);
+
+        Irp->IoStatus.Information = sizeof(STORAGE_DESCRIPTOR_HEADER);
+        return STATUS_SUCCESS;
+    }
+
+    PortConfig = &DeviceExtension->Miniport.PortConfig;
+
+    AdapterDescriptor = Irp->AssociatedIrp.SystemBuffer;
+    RtlZeroMemory(AdapterDescriptor, sizeof(STORAGE_ADAPTER_DESCRIPTOR));
+
+    AdapterDescriptor->Version = sizeof(STORAGE_ADAPTER_DESCRIPTOR);
+    AdapterDescriptor->Size = sizeof(STORAGE_ADAPTER_DESCRIPTOR);
+    AdapterDescriptor->MaximumTransferLength = PortConfig->MaximumTransferLength;
+    AdapterDescriptor->MaximumPhysicalPages = DeviceExtension->MaximumPhysicalPages;
+    AdapterDescriptor->AlignmentMask = PortConfig->AlignmentMask;
+    AdapterDescriptor->AdapterUsesPio = FALSE;
+    AdapterDescriptor->AdapterScansDown = PortConfig->AdapterScansDown;
+    AdapterDescriptor->AcceleratedTransfer = TRUE;
+    AdapterDescriptor->BusType = BusTypeScsi; // FIXME
+    AdapterDescriptor->BusMajorVersion = 2;
+    AdapterDescriptor->BusMinorVersion = 0;
+
+    /* The class drivers only send tagged requests if the adapter queues them */
+    AdapterDescriptor->CommandQueueing = DeviceExtension->Miniport.InitData->TaggedQueuing &&
+                                         PortConfig->TaggedQueuing;
+
+    Irp->IoStatus.Information = sizeof(STORAGE_ADAPTER_DESCRIPTOR);
+
+    return STATUS_SUCCESS;
+}
+
+
+NTSTATUS
+NTAPI
+PortFdoDeviceControl(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+    PIO_STACK_LOCATION Stack;
+    PSTORAGE_PROPERTY_QUERY PropertyQuery;
+    PIO_SCSI_CAPABILITIES Capabilities;
+    NTSTATUS Status;
+
+    DPRINT("PortFdoDeviceControl(%p %p)\n", DeviceObject, Irp);
+
+    DeviceExtension = (PFDO_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
+    ASSERT(DeviceExtension);
+    ASSERT(DeviceExtension->ExtensionType == FdoExtension);
+
+    Stack = IoGetCurrentIrpStackLocation(Irp);
+
+    Irp->IoStatus.Information = 0;
+
+    switch (Stack->Parameters.DeviceIoControl.IoControlCode)
+    {
+        case IOCTL_STORAGE_QUERY_PROPERTY:
+            DPRINT("IOCTL_STORAGE_QUERY_PROPERTY\n");
+            if (Stack->Parameters.DeviceIoControl.InputBufferLength < sizeof(STORAGE_PROPERTY_QUERY))
+            {
+                Status = STATUS_INVALID_PARAMETER;
+                break;
+            }
+
+            /* The adapter has no device properties */
+            PropertyQuery = Irp->AssociatedIrp.SystemBuffer;
+            if (PropertyQuery->PropertyId != StorageAdapterProperty)
+            {
+                Status = STATUS_INVALID_DEVICE_REQUEST;
+                break;
+            }
+
+            Status = PortFdoQueryAdapterProperty(DeviceExtension, Irp);
+            break;
+
+        case IOCTL_SCSI_GET_CAPABILITIES:
+            DPRINT("IOCTL_SCSI_GET_CAPABILITIES\n");
+            if (Stack->Parameters.DeviceIoControl.OutputBufferLength < sizeof(IO_SCSI_CAPABILITIES))
+            {
+                Status = STATUS_BUFFER_TOO_SMALL;
+                break;
+            }
+
+            Capabilities = Irp->AssociatedIrp.SystemBuffer;
+            RtlZeroMemory(Capabilities, sizeof(IO_SCSI_CAPABILITIES));
+            Capabilities->Length = sizeof(IO_SCSI_CAPABILITIES);
+            Capabilities->MaximumTransferLength = DeviceExtension->Miniport.PortConfig.MaximumTransferLength;
+            Capabilities->MaximumPhysicalPages = DeviceExtension->MaximumPhysicalPages;
+            Capabilities->AlignmentMask = DeviceExtension->Miniport.PortConfig.AlignmentMask;
+            Capabilities->TaggedQueuing = DeviceExtension->Miniport.PortConfig.TaggedQueuing;
+            Capabilities->AdapterScansDown = DeviceExtension->Miniport.PortConfig.AdapterScansDown;
+            Capabilities->AdapterUsesPio = FALSE;
+
+            Irp->IoStatus.Information = sizeof(IO_SCSI_CAPABILITIES);
+            Status = STATUS_SUCCESS;
+            break;
+
+        default:
+            DPRINT1("Unsupported IOCTL 0x%lx\n", Stack->Parameters.DeviceIoControl.IoControlCode);
+            Status = STATUS_NOT_SUPPORTED;
+            break;
+    }
+
+    Irp->IoStatus.Status = Status;
+    IoCompleteRequest(Irp, IO_NO_INCREMENT);
+
+    return Status;
+}
+
+
 NTSTATUS
 NTAPI
 PortFdoScsi(
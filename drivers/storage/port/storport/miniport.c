@@ -365,6 +365,27 @@ MiniportHwInterrupt(
 }
 
 
+BOOLEAN
+MiniportBuildIo(
+    _In_ PMINIPORT Miniport,
+    _In_ PSCSI_REQUEST_BLOCK Srb)
+{
+    BOOLEAN Result;
+
+    DPRINT("MiniportBuildIo(%p %p)\n",
+           Miniport, Srb);
+
+    /* HwBuildIo is optional */
+    if (Miniport->InitData->HwBuildIo == NULL)
+        return TRUE;
+
+    Result = Miniport->InitData->HwBuildIo(&Miniport->MiniportExtension->HwDeviceExtension, Srb);
+    DPRINT("HwBuildIo() returned %u\n", Result);
+
+    return Result;
+}
+
+
 BOOLEAN
 MiniportStartIo(
     _In_ PMINIPORT Miniport,
@@ -372,11 +393,11 @@ MiniportStartIo(
 {
     BOOLEAN Result;
 
-    DPRINT1("MiniportHwStartIo(%p %p)\n",
-            Miniport, Srb);
+    DPRINT("MiniportHwStartIo(%p %p)\n",
+           Miniport, Srb);
 
     Result = Miniport->InitData->HwStartIo(&Miniport->MiniportExtension->HwDeviceExtension, Srb);
-    DPRINT1("HwStartIo() returned %u\n", Result);
+    DPRINT("HwStartIo() returned %u\n", Result);
 
     return Result;
 }
@@ -58,7 +58,36 @@ PortCreatePdo(
     DeviceExtension->FdoExtension = FdoDeviceExtension;
     DeviceExtension->PnpState = dsStopped;
 
-    /* Add the PDO to the PDO list*/
+    DeviceExtension->Bus = Bus;
+    DeviceExtension->Target = Target;
+    DeviceExtension->Lun = Lun;
+
+    /* Initialize the request queue, tagged requests go until the miniport
+       sets another depth */
+    InitializeListHead(&DeviceExtension->RequestListHead);
+    DeviceExtension->QueueDepth = PORT_DEFAULT_QUEUE_DEPTH;
+    RtlInitializeBitMap(&DeviceExtension->TagBitmap,
+                        DeviceExtension->TagBitmapBuffer,
+                        PORT_MAX_QUEUE_DEPTH);
+    RtlClearAllBits(&DeviceExtension->TagBitmap);
+
+    /* Allocate the miniports logical unit extension */
+    if (FdoDeviceExtension->Miniport.PortConfig.SpecificLuExtensionSize != 0)
+    {
+        DeviceExtension->LuExtension = ExAllocatePoolWithTag(NonPagedPool,
+                                                             FdoDeviceExtension->Miniport.PortConfig.SpecificLuExtensionSize,
+                                                             TAG_LUN_EXTENSION);
+        if (DeviceExtension->LuExtension == NULL)
+        {
+            IoDeleteDevice(Pdo);
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        RtlZeroMemory(DeviceExtension->LuExtension,
+                      FdoDeviceExtension->Miniport.PortConfig.SpecificLuExtensionSize);
+    }
+
+    /* Add the PDO to the PDO list, miniports can find it from now on */
     KeAcquireInStackQueuedSpinLock(&FdoDeviceExtension->PdoListLock,
                                    &LockHandle);
     InsertHeadList(&FdoDeviceExtension->PdoListHead,
@@ -66,11 +95,6 @@ PortCreatePdo(
     FdoDeviceExtension->PdoCount++;
     KeReleaseInStackQueuedSpinLock(&LockHandle);
 
-    DeviceExtension->Bus = Bus;
-    DeviceExtension->Target = Target;
-    DeviceExtension->Lun = Lun;
-
-
     // FIXME: More initialization
 
 
@@ -104,6 +128,11 @@ PortDeletePdo(
         PdoExtension->InquiryBuffer = NULL;
     }
 
+    if (PdoExtension->LuExtension)
+    {
+        ExFreePoolWithTag(PdoExtension->LuExtension, TAG_LUN_EXTENSION);
+        PdoExtension->LuExtension = NULL;
+    }
 
     // FIXME: More uninitialization
 
@@ -115,33 +144,755 @@ PortDeletePdo(
 }
 
 
+PPDO_DEVICE_EXTENSION
+PortGetPdoExtension(
+    _In_ PFDO_DEVICE_EXTENSION FdoExtension,
+    _In_ ULONG Bus,
+    _In_ ULONG Target,
+    _In_ ULONG Lun)
+{
+    PPDO_DEVICE_EXTENSION PdoExtension;
+    PLIST_ENTRY ListEntry;
+
+    /* Miniports look units up at any IRQL. The list only changes while the
+       bus is scanned, before the units get any requests. */
+    ListEntry = FdoExtension->PdoListHead.Flink;
+    while (ListEntry != &FdoExtension->PdoListHead)
+    {
+        PdoExtension = CONTAINING_RECORD(ListEntry,
+                                         PDO_DEVICE_EXTENSION,
+                                         PdoListEntry);
+        if (PdoExtension->Bus == Bus &&
+            PdoExtension->Target == Target &&
+            PdoExtension->Lun == Lun)
+        {
+            return PdoExtension;
+        }
+
+        ListEntry = ListEntry->Flink;
+    }
+
+    return NULL;
+}
+
+
+static
+VOID
+PortPdoStartRequest(
+    _In_ PPDO_DEVICE_EXTENSION PdoExtension,
+    _In_ PIRP Irp,
+    _In_ PSCSI_REQUEST_BLOCK Srb)
+{
+    PFDO_DEVICE_EXTENSION FdoExtension = PdoExtension->FdoExtension;
+
+    /* Called at DISPATCH_LEVEL. The miniport prepares the request outside of
+       the StartIo lock. If it refuses it, it has completed the request already. */
+    if (MiniportBuildIo(&FdoExtension->Miniport, Srb))
+    {
+        KeAcquireSpinLockAtDpcLevel(&FdoExtension->StartIoLock);
+        InsertTailList(&PdoExtension->RequestListHead,
+                       &Irp->Tail.Overlay.ListEntry);
+        PortFdoStartNextRequests(FdoExtension);
+        KeReleaseSpinLockFromDpcLevel(&FdoExtension->StartIoLock);
+    }
+}
+
+
+static
+VOID
+NTAPI
+PortPdoListControl(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp,
+    _In_ PSCATTER_GATHER_LIST ScatterGather,
+    _In_ PVOID Context)
+{
+    PIRP OriginalIrp = Context;
+    PIO_STACK_LOCATION Stack;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+    UNREFERENCED_PARAMETER(Irp);
+
+    /* The HAL list has the layout of a STOR_SCATTER_GATHER_LIST */
+    PORT_IRP_SG_LIST(OriginalIrp) = ScatterGather;
+
+    Stack = IoGetCurrentIrpStackLocation(OriginalIrp);
+    PortPdoStartRequest(Stack->DeviceObject->DeviceExtension,
+                        OriginalIrp,
+                        Stack->Parameters.Scsi.Srb);
+}
+
+
+static
+NTSTATUS
+PortPdoMapRequest(
+    _In_ PPDO_DEVICE_EXTENSION PdoExtension,
+    _In_ PIRP Irp,
+    _In_ PSCSI_REQUEST_BLOCK Srb)
+{
+    PDMA_ADAPTER DmaAdapter = PdoExtension->FdoExtension->DmaAdapter;
+    ULONG_PTR Address = (ULONG_PTR)Srb->DataBuffer;
+    PMDL Mdl = Irp->MdlAddress;
+
+    /* Called at DISPATCH_LEVEL. Requests built by the class drivers for their
+       own nonpaged buffers come without an MDL, describe them here. */
+    if (Mdl == NULL ||
+        Address < (ULONG_PTR)MmGetMdlVirtualAddress(Mdl) ||
+        Address + Srb->DataTransferLength > (ULONG_PTR)MmGetMdlVirtualAddress(Mdl) + MmGetMdlByteCount(Mdl))
+    {
+        Mdl = IoAllocateMdl(Srb->DataBuffer,
+                            Srb->DataTransferLength,
+                            FALSE,
+                            FALSE,
+                            NULL);
+        if (Mdl == NULL)
+            return STATUS_INSUFFICIENT_RESOURCES;
+
+        MmBuildMdlForNonPagedPool(Mdl);
+        PORT_IRP_MDL(Irp) = Mdl;
+    }
+
+    /* The request is started once the list is built, which need not be now */
+    return DmaAdapter->DmaOperations->GetScatterGatherList(DmaAdapter,
+                                                           PdoExtension->FdoExtension->Device,
+                                                           Mdl,
+                                                           Srb->DataBuffer,
+                                                           Srb->DataTransferLength,
+                                                           PortPdoListControl,
+                                                           Irp,
+                                                           (Srb->SrbFlags & SRB_FLAGS_DATA_OUT) != 0);
+}
+
+
+static
+VOID
+PortPdoFailRequest(
+    _In_ PFDO_DEVICE_EXTENSION FdoExtension,
+    _In_ PIRP Irp,
+    _In_ PSCSI_REQUEST_BLOCK Srb,
+    _In_ NTSTATUS Status)
+{
+    DPRINT1("Failed to queue Srb %p (Status 0x%08lx)\n", Srb, Status);
+
+    if (PORT_IRP_MDL(Irp) != NULL)
+    {
+        IoFreeMdl(PORT_IRP_MDL(Irp));
+        PORT_IRP_MDL(Irp) = NULL;
+    }
+
+    if (Srb->SrbExtension != NULL)
+    {
+        ExFreeToNPagedLookasideList(&FdoExtension->SrbExtensionList, Srb->SrbExtension);
+        Srb->SrbExtension = NULL;
+    }
+
+    Srb->SrbStatus = SRB_STATUS_ERROR;
+    Irp->IoStatus.Information = 0;
+    Irp->IoStatus.Status = Status;
+    IoCompleteRequest(Irp, IO_NO_INCREMENT);
+}
+
+
+static
+NTSTATUS
+PortPdoQueueRequest(
+    _In_ PPDO_DEVICE_EXTENSION PdoExtension,
+    _In_ PIRP Irp,
+    _In_ PSCSI_REQUEST_BLOCK Srb)
+{
+    PFDO_DEVICE_EXTENSION FdoExtension = PdoExtension->FdoExtension;
+    NTSTATUS Status = STATUS_SUCCESS;
+    KIRQL OldIrql;
+
+    /* Address the unit the request was sent to */
+    Srb->PathId = (UCHAR)PdoExtension->Bus;
+    Srb->TargetId = (UCHAR)PdoExtension->Target;
+    Srb->Lun = (UCHAR)PdoExtension->Lun;
+    Srb->QueueTag = SP_UNTAGGED;
+    Srb->SrbStatus = SRB_STATUS_PENDING;
+    Srb->SrbExtension = NULL;
+
+    PORT_IRP_STARTED(Irp) = (PVOID)FALSE;
+    PORT_IRP_SG_LIST(Irp) = NULL;
+    PORT_IRP_MDL(Irp) = NULL;
+
+    if (FdoExtension->SrbExtensionListInitialized)
+    {
+        Srb->SrbExtension = ExAllocateFromNPagedLookasideList(&FdoExtension->SrbExtensionList);
+        if (Srb->SrbExtension == NULL)
+        {
+            PortPdoFailRequest(FdoExtension, Irp, Srb, STATUS_INSUFFICIENT_RESOURCES);
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        RtlZeroMemory(Srb->SrbExtension,
+                      FdoExtension->Miniport.PortConfig.SrbExtensionSize);
+    }
+
+    IoMarkIrpPending(Irp);
+
+    KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+
+    if (Srb->DataBuffer != NULL && Srb->DataTransferLength != 0)
+        Status = PortPdoMapRequest(PdoExtension, Irp, Srb);
+    else
+        PortPdoStartRequest(PdoExtension, Irp, Srb);
+
+    KeLowerIrql(OldIrql);
+
+    if (!NT_SUCCESS(Status))
+        PortPdoFailRequest(FdoExtension, Irp, Srb, Status);
+
+    return STATUS_PENDING;
+}
+
+
 NTSTATUS
 NTAPI
 PortPdoScsi(
     _In_ PDEVICE_OBJECT DeviceObject,
     _In_ PIRP Irp)
 {
-    DPRINT1("PortPdoScsi(%p %p)\n", DeviceObject, Irp);
+    PPDO_DEVICE_EXTENSION DeviceExtension;
+    PIO_STACK_LOCATION Stack;
+    PSCSI_REQUEST_BLOCK Srb;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    DPRINT("PortPdoScsi(%p %p)\n", DeviceObject, Irp);
+
+    DeviceExtension = (PPDO_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
+    ASSERT(DeviceExtension);
+    ASSERT(DeviceExtension->ExtensionType == PdoExtension);
+
+    Stack = IoGetCurrentIrpStackLocation(Irp);
+    Srb = Stack->Parameters.Scsi.Srb;
+    if (Srb == NULL)
+    {
+        Status = STATUS_INVALID_PARAMETER;
+        goto done;
+    }
 
+    switch (Srb->Function)
+    {
+        case SRB_FUNCTION_CLAIM_DEVICE:
+            Srb->DataBuffer = DeviceObject;
+            Srb->SrbStatus = SRB_STATUS_SUCCESS;
+            break;
+
+        case SRB_FUNCTION_ATTACH_DEVICE:
+        case SRB_FUNCTION_RELEASE_DEVICE:
+        case SRB_FUNCTION_RELEASE_QUEUE:
+        case SRB_FUNCTION_FLUSH_QUEUE:
+            /* The unit queues are never frozen */
+            Srb->SrbStatus = SRB_STATUS_SUCCESS;
+            break;
+
+        default:
+            return PortPdoQueueRequest(DeviceExtension, Irp, Srb);
+    }
+
+done:
     Irp->IoStatus.Information = 0;
-    Irp->IoStatus.Status = STATUS_SUCCESS;
+    Irp->IoStatus.Status = Status;
     IoCompleteRequest(Irp, IO_NO_INCREMENT);
+    return Status;
+}
+
+
+static
+PCSTR
+PortGetDeviceType(
+    _In_ PINQUIRYDATA InquiryData)
+{
+    switch (InquiryData->DeviceType)
+    {
+        case DIRECT_ACCESS_DEVICE:
+            return "Disk";
+        case SEQUENTIAL_ACCESS_DEVICE:
+            return "Sequential";
+        case WRITE_ONCE_READ_MULTIPLE_DEVICE:
+            return "Worm";
+        case READ_ONLY_DIRECT_ACCESS_DEVICE:
+            return "CdRom";
+        case OPTICAL_DEVICE:
+            return "Optical";
+        case MEDIUM_CHANGER:
+            return "Changer";
+        case ARRAY_CONTROLLER_DEVICE:
+            return "Array";
+        case SCSI_ENCLOSURE_DEVICE:
+            return "Enclosure";
+        default:
+            return "Other";
+    }
+}
+
+
+static
+PCSTR
+PortGetGenericType(
+    _In_ PINQUIRYDATA InquiryData)
+{
+    switch (InquiryData->DeviceType)
+    {
+        case DIRECT_ACCESS_DEVICE:
+            return "GenDisk";
+        case WRITE_ONCE_READ_MULTIPLE_DEVICE:
+            return "GenWorm";
+        case READ_ONLY_DIRECT_ACCESS_DEVICE:
+            return "GenCdRom";
+        case OPTICAL_DEVICE:
+            return "GenOptical";
+        case MEDIUM_CHANGER:
+            return "ScsiChanger";
+        case ARRAY_CONTROLLER_DEVICE:
+            return "ScsiArray";
+        case SCSI_ENCLOSURE_DEVICE:
+            return "ScsiEnclosure";
+        default:
+            return "ScsiOther";
+    }
+}
+
+
+static
+ULONG
+PortCopyField(
+    _In_ PUCHAR Name,
+    _Out_ PCHAR Buffer,
+    _In_ ULONG MaxLength,
+    _In_ CHAR DefaultCharacter,
+    _In_ BOOLEAN Trim)
+{
+    ULONG Index, Length = 0;
+
+    /* Replace the characters that can't be part of an ID */
+    for (Index = 0; Index < MaxLength; Index++)
+    {
+        if (Name[Index] <= ' ' || Name[Index] >= 0x7F || Name[Index] == ',')
+        {
+            Buffer[Index] = DefaultCharacter;
+        }
+        else
+        {
+            Buffer[Index] = Name[Index];
+            Length = Index + 1;
+        }
+    }
+
+    return Trim ? Length : MaxLength;
+}
+
+
+static
+NTSTATUS
+PortPdoReturnString(
+    _Inout_ PIRP Irp,
+    _In_ PCHAR Buffer,
+    _In_ ULONG Length)
+{
+    PWSTR String;
+    ULONG Index;
+
+    /* Length includes all terminators, the IDs are plain ASCII */
+    String = ExAllocatePoolWithTag(PagedPool,
+                                   Length * sizeof(WCHAR),
+                                   TAG_PNP_DATA);
+    if (String == NULL)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    for (Index = 0; Index < Length; Index++)
+        String[Index] = (WCHAR)Buffer[Index];
+
+    Irp->IoStatus.Information = (ULONG_PTR)String;
+
     return STATUS_SUCCESS;
 }
 
 
+static
+NTSTATUS
+PortPdoQueryDeviceText(
+    _In_ PPDO_DEVICE_EXTENSION DeviceExtension,
+    _Inout_ PIRP Irp)
+{
+    PINQUIRYDATA InquiryData = DeviceExtension->InquiryBuffer;
+    PIO_STACK_LOCATION Stack;
+    CHAR Buffer[128];
+    ULONG Offset = 0;
+
+    Stack = IoGetCurrentIrpStackLocation(Irp);
+
+    switch (Stack->Parameters.QueryDeviceText.DeviceTextType)
+    {
+        case DeviceTextDescription:
+            Offset += PortCopyField(InquiryData->VendorId, &Buffer[Offset], 8, ' ', TRUE);
+            Buffer[Offset++] = ' ';
+            Offset += PortCopyField(InquiryData->ProductId, &Buffer[Offset], 16, ' ', TRUE);
+            Offset += sprintf(&Buffer[Offset], " SCSI %s Device", PortGetDeviceType(InquiryData)) + 1;
+            break;
+
+        case DeviceTextLocationInformation:
+            Offset = sprintf(Buffer,
+                             "Bus Number %lu, Target ID %lu, LUN %lu",
+                             DeviceExtension->Bus,
+                             DeviceExtension->Target,
+                             DeviceExtension->Lun) + 1;
+            break;
+
+        default:
+            return Irp->IoStatus.Status;
+    }
+
+    return PortPdoReturnString(Irp, Buffer, Offset);
+}
+
+
+static
+NTSTATUS
+PortPdoQueryId(
+    _In_ PPDO_DEVICE_EXTENSION DeviceExtension,
+    _Inout_ PIRP Irp)
+{
+    PINQUIRYDATA InquiryData = DeviceExtension->InquiryBuffer;
+    PIO_STACK_LOCATION Stack;
+    PCSTR DeviceType;
+    CHAR Buffer[512];
+    ULONG Offset = 0;
+
+    Stack = IoGetCurrentIrpStackLocation(Irp);
+
+    DeviceType = PortGetDeviceType(InquiryData);
+
+    /* See "Identifiers for SCSI Devices" */
+    switch (Stack->Parameters.QueryId.IdType)
+    {
+        case BusQueryDeviceID:
+            /* SCSI\Type&Ven_Vendor&Prod_Product&Rev_Revision */
+            Offset += sprintf(&Buffer[Offset], "SCSI\\%s&Ven_", DeviceType);
+            Offset += PortCopyField(InquiryData->VendorId, &Buffer[Offset], 8, '_', TRUE);
+            Offset += sprintf(&Buffer[Offset], "&Prod_");
+            Offset += PortCopyField(InquiryData->ProductId, &Buffer[Offset], 16, '_', TRUE);
+            Offset += sprintf(&Buffer[Offset], "&Rev_");
+            Offset += PortCopyField(InquiryData->ProductRevisionLevel, &Buffer[Offset], 4, '_', TRUE);
+            Buffer[Offset++] = ANSI_NULL;
+            break;
+
+        case BusQueryHardwareIDs:
+            /* SCSI\TypeVendorProductRevision */
+            Offset += sprintf(&Buffer[Offset], "SCSI\\%s", DeviceType);
+            Offset += PortCopyField(InquiryData->VendorId, &Buffer[Offset], 8, '_', FALSE);
+            Offset += PortCopyField(InquiryData->ProductId, &Buffer[Offset], 16, '_', FALSE);
+            Offset += PortCopyField(InquiryData->ProductRevisionLevel, &Buffer[Offset], 4, '_', FALSE);
+            Buffer[Offset++] = ANSI_NULL;
+
+            /* SCSI\TypeVendorProduct */
+            Offset += sprintf(&Buffer[Offset], "SCSI\\%s", DeviceType);
+            Offset += PortCopyField(InquiryData->VendorId, &Buffer[Offset], 8, '_', FALSE);
+            Offset += PortCopyField(InquiryData->ProductId, &Buffer[Offset], 16, '_', FALSE);
+            Buffer[Offset++] = ANSI_NULL;
+
+            /* SCSI\TypeVendor */
+            Offset += sprintf(&Buffer[Offset], "SCSI\\%s", DeviceType);
+            Offset += PortCopyField(InquiryData->VendorId, &Buffer[Offset], 8, '_', FALSE);
+            Buffer[Offset++] = ANSI_NULL;
+
+            /* SCSI\VendorProductRevision(1) */
+            Offset += sprintf(&Buffer[Offset], "SCSI\\");
+            Offset += PortCopyField(InquiryData->VendorId, &Buffer[Offset], 8, '_', FALSE);
+            Offset += PortCopyField(InquiryData->ProductId, &Buffer[Offset], 16, '_', FALSE);
+            Offset += PortCopyField(InquiryData->ProductRevisionLevel, &Buffer[Offset], 1, '_', FALSE);
+            Buffer[Offset++] = ANSI_NULL;
+
+            /* VendorProductRevision(1) */
+            Offset += PortCopyField(InquiryData->VendorId, &Buffer[Offset], 8, '_', FALSE);
+            Offset += PortCopyField(InquiryData->ProductId, &Buffer[Offset], 16, '_', FALSE);
+            Offset += PortCopyField(InquiryData->ProductRevisionLevel, &Buffer[Offset], 1, '_', FALSE);
+            Buffer[Offset++] = ANSI_NULL;
+
+            /* GenericType */
+            Offset += sprintf(&Buffer[Offset], "%s", PortGetGenericType(InquiryData)) + 1;
+            Buffer[Offset++] = ANSI_NULL;
+            break;
+
+        case BusQueryCompatibleIDs:
+            Offset += sprintf(&Buffer[Offset], "SCSI\\%s", DeviceType) + 1;
+            Offset += sprintf(&Buffer[Offset], "SCSI\\RAW") + 1;
+            Buffer[Offset++] = ANSI_NULL;
+            break;
+
+        case BusQueryInstanceID:
+            Offset = sprintf(Buffer,
+                             "%lx%lx%lx",
+                             DeviceExtension->Bus,
+                             DeviceExtension->Target,
+                             DeviceExtension->Lun) + 1;
+            break;
+
+        default:
+            return Irp->IoStatus.Status;
+    }
+
+    return PortPdoReturnString(Irp, Buffer, Offset);
+}
+
+
+static
+NTSTATUS
+PortPdoQueryTargetRelations(
+    _In_ PPDO_DEVICE_EXTENSION DeviceExtension,
+    _Inout_ PIRP Irp)
+{
+    PDEVICE_RELATIONS DeviceRelations;
+
+    DeviceRelations = ExAllocatePoolWithTag(PagedPool,
+                                            sizeof(DEVICE_RELATIONS),
+                                            TAG_PNP_DATA);
+    if (DeviceRelations == NULL)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    ObReferenceObject(DeviceExtension->Device);
+    DeviceRelations->Count = 1;
+    DeviceRelations->Objects[0] = DeviceExtension->Device;
+
+    Irp->IoStatus.Information = (ULONG_PTR)DeviceRelations;
+
+    return STATUS_SUCCESS;
+}
+
+
+static
+ULONG
+PortGetFieldLength(
+    _In_ PUCHAR Name,
+    _In_ ULONG MaxLength)
+{
+    ULONG Index, Length = 0;
+
+    /* Trailing blanks are padding */
+    for (Index = 0; Index < MaxLength; Index++)
+    {
+        if (Name[Index] != ' ')
+            Length = Index + 1;
+    }
+
+    return Length;
+}
+
+
+static
+NTSTATUS
+PortPdoQueryDeviceProperty(
+    _In_ PPDO_DEVICE_EXTENSION DeviceExtension,
+    _Inout_ PIRP Irp)
+{
+    PINQUIRYDATA InquiryData = DeviceExtension->InquiryBuffer;
+    PSTORAGE_PROPERTY_QUERY PropertyQuery;
+    PSTORAGE_DESCRIPTOR_HEADER DescriptorHeader;
+    PSTORAGE_DEVICE_DESCRIPTOR DeviceDescriptor;
+    PIO_STACK_LOCATION Stack;
+    ULONG VendorLength, ProductLength, RevisionLength;
+    ULONG OutputLength, TotalLength;
+    PUCHAR Buffer;
+
+    Stack = IoGetCurrentIrpStackLocation(Irp);
+    PropertyQuery = Irp->AssociatedIrp.SystemBuffer;
+    OutputLength = Stack->Parameters.DeviceIoControl.OutputBufferLength;
+
+    if (PropertyQuery->QueryType == PropertyExistsQuery)
+        return STATUS_SUCCESS;
+
+    if (PropertyQuery->QueryType != PropertyStandardQuery)
+        return STATUS_INVALID_PARAMETER;
+
+    VendorLength = PortGetFieldLength(InquiryData->VendorId, 8);
+    ProductLength = PortGetFieldLength(InquiryData->ProductId, 16);
+    RevisionLength = PortGetFieldLength(InquiryData->ProductRevisionLevel, 4);
+
+    /* The strings follow the descriptor, each with its terminator */
+    TotalLength = FIELD_OFFSET(STORAGE_DEVICE_DESCRIPTOR, RawDeviceProperties) +
+                  VendorLength + 1 + ProductLength + 1 + RevisionLength + 1;
+
+    /* Tell the caller how much room the descriptor needs */
+    if (OutputLength < TotalLength)
+    {
+        if (OutputLength < sizeof(STORAGE_DESCRIPTOR_HEADER))
+            return STATUS_BUFFER_TOO_SMALL;
+
+        DescriptorHeader = Irp->AssociatedIrp.SystemBuffer;
+        DescriptorHeader->Version = sizeof(STORAGE_DEVICE_DESCRIPTOR);
+        DescriptorHeader->Size = TotalLength;
+
+        Irp->IoStatus.Information = sizeof(STORAGE_DESCRIPTOR_HEADER);
+        return STATUS_SUCCESS;
+    }
+
+    DeviceDescriptor = Irp->AssociatedIrp.SystemBuffer;
+    RtlZeroMemory(DeviceDescriptor, TotalLength);
+
+    DeviceDescriptor->Version = sizeof(STORAGE_DEVICE_DESCRIPTOR);
+    DeviceDescriptor->Size = TotalLength;
+    DeviceDescriptor->DeviceType = InquiryData->DeviceType;
+    DeviceDescriptor->DeviceTypeModifier = InquiryData->DeviceTypeModifier;
+    DeviceDescriptor->RemovableMedia = InquiryData->RemovableMedia;
+    DeviceDescriptor->CommandQueueing = InquiryData->CommandQueue;
+    DeviceDescriptor->BusType = BusTypeScsi; // FIXME
+    DeviceDescriptor->SerialNumberOffset = 0;
+    DeviceDescriptor->RawPropertiesLength = TotalLength -
+        FIELD_OFFSET(STORAGE_DEVICE_DESCRIPTOR, RawDeviceProperties);
+
+    Buffer = DeviceDescriptor->RawDeviceProperties;
+
+    DeviceDescriptor->VendorIdOffset = (ULONG)(Buffer - (PUCHAR)DeviceDescriptor);
+    RtlCopyMemory(Buffer, InquiryData->VendorId, VendorLength);
+    Buffer += VendorLength + 1;
+
+    DeviceDescriptor->ProductIdOffset = (ULONG)(Buffer - (PUCHAR)DeviceDescriptor);
+    RtlCopyMemory(Buffer, InquiryData->ProductId, ProductLength);
+    Buffer += ProductLength + 1;
+
+    DeviceDescriptor->ProductRevisionOffset = (ULONG)(Buffer - (PUCHAR)DeviceDescriptor);
+    RtlCopyMemory(Buffer, InquiryData->ProductRevisionLevel, RevisionLength);
+
+    Irp->IoStatus.Information = TotalLength;
+
+    return STATUS_SUCCESS;
+}
+
+
+NTSTATUS
+NTAPI
+PortPdoDeviceControl(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp)
+{
+    PPDO_DEVICE_EXTENSION DeviceExtension;
+    PIO_STACK_LOCATION Stack;
+    PSTORAGE_PROPERTY_QUERY PropertyQuery;
+    NTSTATUS Status;
+
+    DPRINT("PortPdoDeviceControl(%p %p)\n", DeviceObject, Irp);
+
+    DeviceExtension = (PPDO_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
+    ASSERT(DeviceExtension);
+    ASSERT(DeviceExtension->ExtensionType == PdoExtension);
+
+    Stack = IoGetCurrentIrpStackLocation(Irp);
+
+    Irp->IoStatus.Information = 0;
+
+    switch (Stack->Parameters.DeviceIoControl.IoControlCode)
+    {
+        case IOCTL_STORAGE_QUERY_PROPERTY:
+            DPRINT("IOCTL_STORAGE_QUERY_PROPERTY\n");
+            if (Stack->Parameters.DeviceIoControl.InputBufferLength < sizeof(STORAGE_PROPERTY_QUERY))
+            {
+                Status = STATUS_INVALID_PARAMETER;
+                break;
+            }
+
+            PropertyQuery = Irp->AssociatedIrp.SystemBuffer;
+            switch (PropertyQuery->PropertyId)
+            {
+                case StorageDeviceProperty:
+                    Status = PortPdoQueryDeviceProperty(DeviceExtension, Irp);
+                    break;
+
+                case StorageAdapterProperty:
+                    Status = PortFdoQueryAdapterProperty(DeviceExtension->FdoExtension, Irp);
+                    break;
+
+                default:
+                    Status = STATUS_NOT_SUPPORTED;
+                    break;
+            }
+            break;
+
+        default:
+            DPRINT1("Unsupported IOCTL 0x%lx\n", Stack->Parameters.DeviceIoControl.IoControlCode);
+            Status = STATUS_NOT_SUPPORTED;
+            break;
+    }
+
+    Irp->IoStatus.Status = Status;
+    IoCompleteRequest(Irp, IO_NO_INCREMENT);
+
+    return Status;
+}
+
+
 NTSTATUS
 NTAPI
 PortPdoPnp(
     _In_ PDEVICE_OBJECT DeviceObject,
     _In_ PIRP Irp)
 {
+    PPDO_DEVICE_EXTENSION DeviceExtension;
+    PIO_STACK_LOCATION Stack;
+    NTSTATUS Status;
+
     DPRINT1("PortPdoPnp(%p %p)\n", DeviceObject, Irp);
 
-    Irp->IoStatus.Information = 0;
-    Irp->IoStatus.Status = STATUS_SUCCESS;
+    DeviceExtension = (PPDO_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
+    ASSERT(DeviceExtension);
+    ASSERT(DeviceExtension->ExtensionType == PdoExtension);
+
+    Stack = IoGetCurrentIrpStackLocation(Irp);
+
+    switch (Stack->MinorFunction)
+    {
+        case IRP_MN_START_DEVICE: /* 0x00 */
+            DPRINT1("IRP_MJ_PNP / IRP_MN_START_DEVICE\n");
+            DeviceExtension->PnpState = dsStarted;
+            Status = STATUS_SUCCESS;
+            break;
+
+        case IRP_MN_QUERY_REMOVE_DEVICE: /* 0x01 */
+        case IRP_MN_REMOVE_DEVICE: /* 0x02 */
+        case IRP_MN_CANCEL_REMOVE_DEVICE: /* 0x03 */
+        case IRP_MN_STOP_DEVICE: /* 0x04 */
+        case IRP_MN_QUERY_STOP_DEVICE: /* 0x05 */
+        case IRP_MN_CANCEL_STOP_DEVICE: /* 0x06 */
+        case IRP_MN_SURPRISE_REMOVAL: /* 0x17 */
+            /* The unit stays on the bus until the adapter goes away */
+            Status = STATUS_SUCCESS;
+            break;
+
+        case IRP_MN_QUERY_DEVICE_RELATIONS: /* 0x07 */
+            DPRINT1("IRP_MJ_PNP / IRP_MN_QUERY_DEVICE_RELATIONS\n");
+            if (Stack->Parameters.QueryDeviceRelations.Type == TargetDeviceRelation)
+                Status = PortPdoQueryTargetRelations(DeviceExtension, Irp);
+            else
+                Status = Irp->IoStatus.Status;
+            break;
+
+        case IRP_MN_QUERY_CAPABILITIES: /* 0x09 */
+            DPRINT1("IRP_MJ_PNP / IRP_MN_QUERY_CAPABILITIES\n");
+            Stack->Parameters.DeviceCapabilities.Capabilities->Address = DeviceExtension->Target;
+            Stack->Parameters.DeviceCapabilities.Capabilities->UINumber = DeviceExtension->Target;
+            Status = STATUS_SUCCESS;
+            break;
+
+        case IRP_MN_QUERY_DEVICE_TEXT: /* 0x0c */
+            DPRINT1("IRP_MJ_PNP / IRP_MN_QUERY_DEVICE_TEXT\n");
+            Status = PortPdoQueryDeviceText(DeviceExtension, Irp);
+            break;
+
+        case IRP_MN_QUERY_ID: /* 0x13 */
+            DPRINT1("IRP_MJ_PNP / IRP_MN_QUERY_ID\n");
+            Status = PortPdoQueryId(DeviceExtension, Irp);
+            break;
+
+        default:
+            DPRINT1("IRP_MJ_PNP / Unknown IOCTL 0x%lx\n", Stack->MinorFunction);
+            Status = Irp->IoStatus.Status;
+            break;
+    }
+
+    Irp->IoStatus.Status = Status;
     IoCompleteRequest(Irp, IO_NO_INCREMENT);
-    return STATUS_SUCCESS;
+
+    return Status;
 }
 
 /* EOF */
@@ -31,6 +31,21 @@
 #define TAG_ADDRESS_MAPPING 'MAtS'
 #define TAG_INQUIRY_DATA    'QItS'
 #define TAG_SENSE_DATA      'NStS'
+#define TAG_SRB_EXTENSION   'EStS'
+#define TAG_LUN_EXTENSION   'ELtS'
+#define TAG_PNP_DATA        'NPtS'
+
+/* Queue tags are UCHARs and SP_UNTAGGED is not one of them */
+#define PORT_MAX_QUEUE_DEPTH        254
+#define PORT_DEFAULT_QUEUE_DEPTH    20
+
+/* How long a busy adapter or unit with nothing outstanding is left alone */
+#define PORT_BUSY_TIMEOUT           10 /* ms */
+
+/* Port driver state of a request, kept in its IRP */
+#define PORT_IRP_SG_LIST(Irp)       ((Irp)->Tail.Overlay.DriverContext[0])
+#define PORT_IRP_STARTED(Irp)       ((Irp)->Tail.Overlay.DriverContext[1])
+#define PORT_IRP_MDL(Irp)           ((Irp)->Tail.Overlay.DriverContext[2])
 
 typedef enum
 {
@@ -112,9 +127,30 @@ typedef struct _FDO_DEVICE_EXTENSION
     PKINTERRUPT Interrupt;
     ULONG InterruptIrql;
 
+    /* Maps the data buffers of the requests for the adapter */
+    PDMA_ADAPTER DmaAdapter;
+    ULONG MaximumPhysicalPages;
+
     KSPIN_LOCK PdoListLock;
     LIST_ENTRY PdoListHead;
     ULONG PdoCount;
+
+    /* Serializes HwStartIo and the unit request queues */
+    KSPIN_LOCK StartIoLock;
+    ULONG OutstandingCount;
+
+    /* Requests the miniport completed, handed to the DPC in batches */
+    KSPIN_LOCK CompletionListLock;
+    LIST_ENTRY CompletionListHead;
+    KDPC CompletionDpc;
+
+    /* StorPortBusy, counts down as requests complete */
+    LONG BusyRequestsToComplete;
+    KTIMER BusyTimer;
+    KDPC BusyTimerDpc;
+
+    NPAGED_LOOKASIDE_LIST SrbExtensionList;
+    BOOLEAN SrbExtensionListInitialized;
 } FDO_DEVICE_EXTENSION, *PFDO_DEVICE_EXTENSION;
 
 
@@ -131,8 +167,21 @@ typedef struct _PDO_DEVICE_EXTENSION
     ULONG Target;
     ULONG Lun;
     PINQUIRYDATA InquiryBuffer;
+    PVOID LuExtension;
+
+    /* Everything below is protected by the FDO's StartIoLock */
+    LIST_ENTRY RequestListHead;
+    ULONG QueueDepth;
+    ULONG OutstandingCount;
 
+    /* An untagged request runs alone */
+    PSCSI_REQUEST_BLOCK UntaggedSrb;
+    RTL_BITMAP TagBitmap;
+    ULONG TagBitmapBuffer[(PORT_MAX_QUEUE_DEPTH + 31) / 32];
+    PSCSI_REQUEST_BLOCK TagTable[PORT_MAX_QUEUE_DEPTH];
 
+    /* StorPortDeviceBusy, counts down as requests complete */
+    LONG BusyRequestsToComplete;
 } PDO_DEVICE_EXTENSION, *PPDO_DEVICE_EXTENSION;
 
 
@@ -150,6 +199,37 @@ PortFdoPnp(
     _In_ PDEVICE_OBJECT DeviceObject,
     _In_ PIRP Irp);
 
+NTSTATUS
+NTAPI
+PortFdoDeviceControl(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp);
+
+NTSTATUS
+PortFdoQueryAdapterProperty(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _Inout_ PIRP Irp);
+
+VOID
+PortFdoStartNextRequests(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension);
+
+VOID
+NTAPI
+PortFdoCompletionDpc(
+    _In_ PKDPC Dpc,
+    _In_opt_ PVOID DeferredContext,
+    _In_opt_ PVOID SystemArgument1,
+    _In_opt_ PVOID SystemArgument2);
+
+VOID
+NTAPI
+PortFdoBusyTimerDpc(
+    _In_ PKDPC Dpc,
+    _In_opt_ PVOID DeferredContext,
+    _In_opt_ PVOID SystemArgument1,
+    _In_opt_ PVOID SystemArgument2);
+
 
 /* miniport.c */
 
@@ -171,6 +251,11 @@ BOOLEAN
 MiniportHwInterrupt(
     _In_ PMINIPORT Miniport);
 
+BOOLEAN
+MiniportBuildIo(
+    _In_ PMINIPORT Miniport,
+    _In_ PSCSI_REQUEST_BLOCK Srb);
+
 BOOLEAN
 MiniportStartIo(
     _In_ PMINIPORT Miniport,
@@ -243,12 +328,25 @@ NTSTATUS
 PortDeletePdo(
     _In_ PPDO_DEVICE_EXTENSION PdoExtension);
 
+PPDO_DEVICE_EXTENSION
+PortGetPdoExtension(
+    _In_ PFDO_DEVICE_EXTENSION FdoExtension,
+    _In_ ULONG Bus,
+    _In_ ULONG Target,
+    _In_ ULONG Lun);
+
 NTSTATUS
 NTAPI
 PortPdoScsi(
     _In_ PDEVICE_OBJECT DeviceObject,
     _In_ PIRP Irp);
 
+NTSTATUS
+NTAPI
+PortPdoDeviceControl(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp);
+
 NTSTATUS
 NTAPI
 PortPdoPnp(
@@ -108,23 +108,28 @@ PortAcquireSpinLock(
     PVOID LockContext,
     PSTOR_LOCK_HANDLE LockHandle)
 {
-    DPRINT1("PortAcquireSpinLock(%p %lu %p %p)\n",
-            DeviceExtension, SpinLock, LockContext, LockHandle);
+    DPRINT("PortAcquireSpinLock(%p %lu %p %p)\n",
+           DeviceExtension, SpinLock, LockContext, LockHandle);
 
     LockHandle->Lock = SpinLock;
 
     switch (SpinLock)
     {
         case DpcLock: /* 1, */
-            DPRINT1("DpcLock\n");
+            DPRINT("DpcLock\n");
+            LockHandle->Context.LockQueue.Lock = &((PSTOR_DPC)LockContext)->Lock;
+            KeAcquireSpinLock((PKSPIN_LOCK)LockHandle->Context.LockQueue.Lock,
+                              &LockHandle->Context.OldIrql);
             break;
 
         case StartIoLock: /* 2 */
-            DPRINT1("StartIoLock\n");
+            DPRINT("StartIoLock\n");
+            KeAcquireSpinLock(&DeviceExtension->StartIoLock,
+                              &LockHandle->Context.OldIrql);
             break;
 
         case InterruptLock: /* 3 */
-            DPRINT1("InterruptLock\n");
+            DPRINT("InterruptLock\n");
             if (DeviceExtension->Interrupt == NULL)
                 LockHandle->Context.OldIrql = 0;
             else
@@ -140,21 +145,25 @@ PortReleaseSpinLock(
     PFDO_DEVICE_EXTENSION DeviceExtension,
     PSTOR_LOCK_HANDLE LockHandle)
 {
-    DPRINT1("PortReleaseSpinLock(%p %p)\n",
-            DeviceExtension, LockHandle);
+    DPRINT("PortReleaseSpinLock(%p %p)\n",
+           DeviceExtension, LockHandle);
 
     switch (LockHandle->Lock)
     {
         case DpcLock: /* 1, */
-            DPRINT1("DpcLock\n");
+            DPRINT("DpcLock\n");
+            KeReleaseSpinLock((PKSPIN_LOCK)LockHandle->Context.LockQueue.Lock,
+                              LockHandle->Context.OldIrql);
             break;
 
         case StartIoLock: /* 2 */
-            DPRINT1("StartIoLock\n");
+            DPRINT("StartIoLock\n");
+            KeReleaseSpinLock(&DeviceExtension->StartIoLock,
+                              LockHandle->Context.OldIrql);
             break;
 
         case InterruptLock: /* 3 */
-            DPRINT1("InterruptLock\n");
+            DPRINT("InterruptLock\n");
             if (DeviceExtension->Interrupt != NULL)
                 KeReleaseInterruptSpinLock(DeviceExtension->Interrupt,
                                            LockHandle->Context.OldIrql);
@@ -226,6 +235,18 @@ PortAddDevice(
     KeInitializeSpinLock(&DeviceExtension->PdoListLock);
     InitializeListHead(&DeviceExtension->PdoListHead);
 
+    /* Initialize the request dispatching */
+    KeInitializeSpinLock(&DeviceExtension->StartIoLock);
+    KeInitializeSpinLock(&DeviceExtension->CompletionListLock);
+    InitializeListHead(&DeviceExtension->CompletionListHead);
+    KeInitializeDpc(&DeviceExtension->CompletionDpc,
+                    PortFdoCompletionDpc,
+                    DeviceExtension);
+    KeInitializeTimer(&DeviceExtension->BusyTimer);
+    KeInitializeDpc(&DeviceExtension->BusyTimerDpc,
+                    PortFdoBusyTimerDpc,
+                    DeviceExtension);
+
     /* Attach the FDO to the device stack */
     Status = IoAttachDeviceToDeviceStackSafe(Fdo,
                                              PhysicalDeviceObject,
@@ -327,15 +348,29 @@ PortDispatchDeviceControl(
     IN PDEVICE_OBJECT DeviceObject,
     IN PIRP Irp)
 {
-    DPRINT1("PortDispatchDeviceControl(%p %p)\n",
-            DeviceObject, Irp);
+    PFDO_DEVICE_EXTENSION DeviceExtension;
 
-    Irp->IoStatus.Status = STATUS_SUCCESS;
-    Irp->IoStatus.Information = 0;
+    DPRINT("PortDispatchDeviceControl(%p %p)\n",
+           DeviceObject, Irp);
 
-    IoCompleteRequest(Irp, IO_NO_INCREMENT);
+    DeviceExtension = (PFDO_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
 
-    return STATUS_SUCCESS;
+    switch (DeviceExtension->ExtensionType)
+    {
+        case FdoExtension:
+            return PortFdoDeviceControl(DeviceObject,
+                                        Irp);
+
+        case PdoExtension:
+            return PortPdoDeviceControl(DeviceObject,
+                                        Irp);
+
+        default:
+            Irp->IoStatus.Status = STATUS_UNSUCCESSFUL;
+            Irp->IoStatus.Information = 0;
+            IoCompleteRequest(Irp, IO_NO_INCREMENT);
+            return STATUS_UNSUCCESSFUL;
+    }
 }
 
 
@@ -480,7 +515,7 @@ StorPortAllocateRegistryBuffer(
 
 
 /*
- * @unimplemented
+ * @implemented
  */
 STORPORT_API
 BOOLEAN
@@ -489,9 +524,23 @@ StorPortBusy(
     _In_ PVOID HwDeviceExtension,
     _In_ ULONG RequestsToComplete)
 {
-    DPRINT1("StorPortBuzy()\n");
-    UNIMPLEMENTED;
-    return FALSE;
+    PMINIPORT_DEVICE_EXTENSION MiniportExtension;
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+
+    DPRINT("StorPortBusy(%p %lu)\n",
+           HwDeviceExtension, RequestsToComplete);
+
+    MiniportExtension = CONTAINING_RECORD(HwDeviceExtension,
+                                          MINIPORT_DEVICE_EXTENSION,
+                                          HwDeviceExtension);
+    DeviceExtension = MiniportExtension->Miniport->DeviceExtension;
+
+    /* This may be called at DIRQL, the completion DPC sorts it out */
+    InterlockedExchange(&DeviceExtension->BusyRequestsToComplete,
+                        (LONG)max(RequestsToComplete, 1));
+    KeInsertQueueDpc(&DeviceExtension->CompletionDpc, NULL, NULL);
+
+    return TRUE;
 }
 
 
@@ -565,7 +614,7 @@ StorPortDebugPrint(
 
 
 /*
- * @unimplemented
+ * @implemented
  */
 STORPORT_API
 BOOLEAN
@@ -577,14 +626,32 @@ StorPortDeviceBusy(
     _In_ UCHAR Lun,
     _In_ ULONG RequestsToComplete)
 {
-    DPRINT1("StorPortDeviceBusy()\n");
-    UNIMPLEMENTED;
-    return FALSE;
+    PMINIPORT_DEVICE_EXTENSION MiniportExtension;
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+    PPDO_DEVICE_EXTENSION PdoExtension;
+
+    DPRINT("StorPortDeviceBusy(%p %u %u %u %lu)\n",
+           HwDeviceExtension, PathId, TargetId, Lun, RequestsToComplete);
+
+    MiniportExtension = CONTAINING_RECORD(HwDeviceExtension,
+                                          MINIPORT_DEVICE_EXTENSION,
+                                          HwDeviceExtension);
+    DeviceExtension = MiniportExtension->Miniport->DeviceExtension;
+
+    PdoExtension = PortGetPdoExtension(DeviceExtension, PathId, TargetId, Lun);
+    if (PdoExtension == NULL)
+        return FALSE;
+
+    InterlockedExchange(&PdoExtension->BusyRequestsToComplete,
+                        (LONG)max(RequestsToComplete, 1));
+    KeInsertQueueDpc(&DeviceExtension->CompletionDpc, NULL, NULL);
+
+    return TRUE;
 }
 
 
 /*
- * @unimplemented
+ * @implemented
  */
 STORPORT_API
 BOOLEAN
@@ -595,9 +662,27 @@ StorPortDeviceReady(
     _In_ UCHAR TargetId,
     _In_ UCHAR Lun)
 {
-    DPRINT1("StorPortDeviceReady()\n");
-    UNIMPLEMENTED;
-    return FALSE;
+    PMINIPORT_DEVICE_EXTENSION MiniportExtension;
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+    PPDO_DEVICE_EXTENSION PdoExtension;
+
+    DPRINT("StorPortDeviceReady(%p %u %u %u)\n",
+           HwDeviceExtension, PathId, TargetId, Lun);
+
+    MiniportExtension = CONTAINING_RECORD(HwDeviceExtension,
+                                          MINIPORT_DEVICE_EXTENSION,
+                                          HwDeviceExtension);
+    DeviceExtension = MiniportExtension->Miniport->DeviceExtension;
+
+    PdoExtension = PortGetPdoExtension(DeviceExtension, PathId, TargetId, Lun);
+    if (PdoExtension == NULL)
+        return FALSE;
+
+    /* Restart the unit queue from the completion DPC */
+    InterlockedExchange(&PdoExtension->BusyRequestsToComplete, 0);
+    KeInsertQueueDpc(&DeviceExtension->CompletionDpc, NULL, NULL);
+
+    return TRUE;
 }
 
 
@@ -765,7 +850,7 @@ StorPortGetDeviceBase(
 
 
 /*
- * @unimplemented
+ * @implemented
  */
 STORPORT_API
 PVOID
@@ -776,9 +861,21 @@ StorPortGetLogicalUnit(
     _In_ UCHAR TargetId,
     _In_ UCHAR Lun)
 {
-    DPRINT1("StorPortGetLogicalUnit()\n");
-    UNIMPLEMENTED;
-    return NULL;
+    PMINIPORT_DEVICE_EXTENSION MiniportExtension;
+    PPDO_DEVICE_EXTENSION PdoExtension;
+
+    DPRINT("StorPortGetLogicalUnit()\n");
+
+    MiniportExtension = CONTAINING_RECORD(HwDeviceExtension,
+                                          MINIPORT_DEVICE_EXTENSION,
+                                          HwDeviceExtension);
+
+    PdoExtension = PortGetPdoExtension(MiniportExtension->Miniport->DeviceExtension,
+                                       PathId, TargetId, Lun);
+    if (PdoExtension == NULL)
+        return NULL;
+
+    return PdoExtension->LuExtension;
 }
 
 
@@ -838,7 +935,7 @@ StorPortGetPhysicalAddress(
 
 
 /*
- * @unimplemented
+ * @implemented
  */
 STORPORT_API
 PSTOR_SCATTER_GATHER_LIST
@@ -847,9 +944,13 @@ StorPortGetScatterGatherList(
     _In_ PVOID DeviceExtension,
     _In_ PSCSI_REQUEST_BLOCK Srb)
 {
-    DPRINT1("StorPortGetScatterGatherList()\n");
-    UNIMPLEMENTED;
-    return NULL;
+    DPRINT("StorPortGetScatterGatherList()\n");
+
+    /* Built by the DMA adapter before the request was started */
+    if (Srb->OriginalRequest == NULL)
+        return NULL;
+
+    return PORT_IRP_SG_LIST((PIRP)Srb->OriginalRequest);
 }
 
 
@@ -866,8 +967,27 @@ StorPortGetSrb(
     _In_ UCHAR Lun,
     _In_ LONG QueueTag)
 {
+    PMINIPORT_DEVICE_EXTENSION MiniportExtension;
+    PPDO_DEVICE_EXTENSION PdoExtension;
+
     DPRINT("StorPortGetSrb()\n");
-    return NULL;
+
+    MiniportExtension = CONTAINING_RECORD(DeviceExtension,
+                                          MINIPORT_DEVICE_EXTENSION,
+                                          HwDeviceExtension);
+
+    PdoExtension = PortGetPdoExtension(MiniportExtension->Miniport->DeviceExtension,
+                                       PathId, TargetId, Lun);
+    if (PdoExtension == NULL)
+        return NULL;
+
+    if (QueueTag == SP_UNTAGGED)
+        return PdoExtension->UntaggedSrb;
+
+    if (QueueTag < 0 || QueueTag >= PORT_MAX_QUEUE_DEPTH)
+        return NULL;
+
+    return PdoExtension->TagTable[QueueTag];
 }
 
 
@@ -1086,7 +1206,7 @@ StorPortMoveMemory(
 
 
 /*
- * @unimplemented
+ * @implemented
  */
 STORPORT_API
 VOID
@@ -1102,6 +1222,9 @@ StorPortNotification(
     PBOOLEAN Result;
     PSTOR_DPC Dpc;
     PHW_DPC_ROUTINE HwDpcRoutine;
+    PVOID SystemArgument1, SystemArgument2;
+    PLONG Succ;
+    PIRP Irp;
     va_list ap;
 
     STOR_SPINLOCK SpinLock;
@@ -1109,8 +1232,8 @@ StorPortNotification(
     PSTOR_LOCK_HANDLE LockHandle;
     PSCSI_REQUEST_BLOCK Srb;
 
-    DPRINT1("StorPortNotification(%x %p)\n",
-            NotificationType, HwDeviceExtension);
+    DPRINT("StorPortNotification(%x %p)\n",
+           NotificationType, HwDeviceExtension);
 
     /* Get the miniport extension */
     if (HwDeviceExtension != NULL)
@@ -1118,8 +1241,8 @@ StorPortNotification(
         MiniportExtension = CONTAINING_RECORD(HwDeviceExtension,
                                               MINIPORT_DEVICE_EXTENSION,
                                               HwDeviceExtension);
-        DPRINT1("HwDeviceExtension %p  MiniportExtension %p\n",
-                HwDeviceExtension, MiniportExtension);
+        DPRINT("HwDeviceExtension %p  MiniportExtension %p\n",
+               HwDeviceExtension, MiniportExtension);
 
         DeviceExtension = MiniportExtension->Miniport->DeviceExtension;
     }
@@ -1129,14 +1252,25 @@ StorPortNotification(
     switch (NotificationType)
     {
         case RequestComplete:
-            DPRINT1("RequestComplete\n");
+            DPRINT("RequestComplete\n");
             Srb = (PSCSI_REQUEST_BLOCK)va_arg(ap, PSCSI_REQUEST_BLOCK);
-            DPRINT1("Srb %p\n", Srb);
-            if (Srb->OriginalRequest != NULL)
+            DPRINT("Srb %p\n", Srb);
+            if (Srb->OriginalRequest == NULL)
             {
-                DPRINT1("Need to complete the IRP!\n");
-
+                DPRINT1("Srb %p has no IRP\n", Srb);
+                break;
             }
+
+            /* This is usually called from HwInterrupt, leave the rest to the DPC */
+            Irp = (PIRP)Srb->OriginalRequest;
+            ExInterlockedInsertTailList(&DeviceExtension->CompletionListHead,
+                                        &Irp->Tail.Overlay.ListEntry,
+                                        &DeviceExtension->CompletionListLock);
+            KeInsertQueueDpc(&DeviceExtension->CompletionDpc, NULL, NULL);
+            break;
+
+        case NextRequest:
+            /* The unit queues are restarted after each completion anyway */
             break;
 
         case GetExtendedFunctionTable:
@@ -1171,18 +1305,29 @@ StorPortNotification(
 
             KeInitializeDpc((PRKDPC)&Dpc->Dpc,
                             (PKDEFERRED_ROUTINE)HwDpcRoutine,
-                            (PVOID)DeviceExtension);
+                            HwDeviceExtension);
             KeInitializeSpinLock(&Dpc->Lock);
             break;
 
+        case IssueDpc:
+            DPRINT("IssueDpc\n");
+            Dpc = (PSTOR_DPC)va_arg(ap, PSTOR_DPC);
+            SystemArgument1 = (PVOID)va_arg(ap, PVOID);
+            SystemArgument2 = (PVOID)va_arg(ap, PVOID);
+            Succ = (PLONG)va_arg(ap, PLONG);
+            *Succ = KeInsertQueueDpc((PRKDPC)&Dpc->Dpc,
+                                     SystemArgument1,
+                                     SystemArgument2);
+            break;
+
         case AcquireSpinLock:
-            DPRINT1("AcquireSpinLock\n");
+            DPRINT("AcquireSpinLock\n");
             SpinLock = (STOR_SPINLOCK)va_arg(ap, STOR_SPINLOCK);
-            DPRINT1("SpinLock %lu\n", SpinLock);
+            DPRINT("SpinLock %lu\n", SpinLock);
             LockContext = (PVOID)va_arg(ap, PVOID);
-            DPRINT1("LockContext %p\n", LockContext);
+            DPRINT("LockContext %p\n", LockContext);
             LockHandle = (PSTOR_LOCK_HANDLE)va_arg(ap, PSTOR_LOCK_HANDLE);
-            DPRINT1("LockHandle %p\n", LockHandle);
+            DPRINT("LockHandle %p\n", LockHandle);
             PortAcquireSpinLock(DeviceExtension,
                                 SpinLock,
                                 LockContext,
@@ -1190,9 +1335,9 @@ StorPortNotification(
             break;
 
         case ReleaseSpinLock:
-            DPRINT1("ReleaseSpinLock\n");
+            DPRINT("ReleaseSpinLock\n");
             LockHandle = (PSTOR_LOCK_HANDLE)va_arg(ap, PSTOR_LOCK_HANDLE);
-            DPRINT1("LockHandle %p\n", LockHandle);
+            DPRINT("LockHandle %p\n", LockHandle);
             PortReleaseSpinLock(DeviceExtension,
                                 LockHandle);
             break;
@@ -1261,7 +1406,7 @@ StorPortQuerySystemTime(
 
 
 /*
- * @unimplemented
+ * @implemented
  */
 STORPORT_API
 BOOLEAN
@@ -1269,9 +1414,21 @@ NTAPI
 StorPortReady(
     _In_ PVOID HwDeviceExtension)
 {
-    DPRINT1("StorPortReady()\n");
-    UNIMPLEMENTED;
-    return FALSE;
+    PMINIPORT_DEVICE_EXTENSION MiniportExtension;
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+
+    DPRINT("StorPortReady(%p)\n", HwDeviceExtension);
+
+    MiniportExtension = CONTAINING_RECORD(HwDeviceExtension,
+                                          MINIPORT_DEVICE_EXTENSION,
+                                          HwDeviceExtension);
+    DeviceExtension = MiniportExtension->Miniport->DeviceExtension;
+
+    /* Restart the unit queues from the completion DPC */
+    InterlockedExchange(&DeviceExtension->BusyRequestsToComplete, 0);
+    KeInsertQueueDpc(&DeviceExtension->CompletionDpc, NULL, NULL);
+
+    return TRUE;
 }
 
 
@@ -1390,7 +1547,7 @@ StorPortSetBusDataByOffset(
 
 
 /*
- * @unimplemented
+ * @implemented
  */
 STORPORT_API
 BOOLEAN
@@ -1402,9 +1559,31 @@ StorPortSetDeviceQueueDepth(
     _In_ UCHAR Lun,
     _In_ ULONG Depth)
 {
-    DPRINT1("StorPortSetDeviceQueueDepth()\n");
-    UNIMPLEMENTED;
-    return FALSE;
+    PMINIPORT_DEVICE_EXTENSION MiniportExtension;
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+    PPDO_DEVICE_EXTENSION PdoExtension;
+
+    DPRINT("StorPortSetDeviceQueueDepth(%p %u %u %u %lu)\n",
+           HwDeviceExtension, PathId, TargetId, Lun, Depth);
+
+    if (Depth == 0)
+        return FALSE;
+
+    MiniportExtension = CONTAINING_RECORD(HwDeviceExtension,
+                                          MINIPORT_DEVICE_EXTENSION,
+                                          HwDeviceExtension);
+    DeviceExtension = MiniportExtension->Miniport->DeviceExtension;
+
+    PdoExtension = PortGetPdoExtension(DeviceExtension, PathId, TargetId, Lun);
+    if (PdoExtension == NULL)
+        return FALSE;
+
+    /* A smaller depth takes effect as the outstanding requests complete,
+       a larger one as soon as the completion DPC refills the queue */
+    PdoExtension->QueueDepth = min(Depth, PORT_MAX_QUEUE_DEPTH);
+    KeInsertQueueDpc(&DeviceExtension->CompletionDpc, NULL, NULL);
+
+    return TRUE;
 }
 
 
@@ -0,0 +1,271 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     CopyFileEx with several buffers in flight, with and without caching
+ */
+
+#include "precomp.h"
+
+/* Not a multiple of any chunk or sector size, so the tail gets exercised */
+#define FILE_SIZE (24 * 1024 * 1024 + 1234)
+
+#ifndef COPY_FILE_NO_BUFFERING
+#define COPY_FILE_NO_BUFFERING 0x00001000
+#endif
+
+typedef struct _PROGRESS_CONTEXT
+{
+    ULONG StreamSwitches;
+    ULONG Chunks;
+    LARGE_INTEGER LastTransferred;
+    BOOL OutOfOrder;
+    DWORD Result;
+} PROGRESS_CONTEXT, *PPROGRESS_CONTEXT;
+
+static WCHAR SourceName[MAX_PATH];
+static WCHAR DestName[MAX_PATH];
+
+static
+DWORD
+CALLBACK
+CopyProgress(
+    _In_ LARGE_INTEGER TotalFileSize,
+    _In_ LARGE_INTEGER TotalBytesTransferred,
+    _In_ LARGE_INTEGER StreamSize,
+    _In_ LARGE_INTEGER StreamBytesTransferred,
+    _In_ DWORD dwStreamNumber,
+    _In_ DWORD dwCallbackReason,
+    _In_ HANDLE hSourceFile,
+    _In_ HANDLE hDestinationFile,
+    _In_opt_ LPVOID lpData)
+{
+    PPROGRESS_CONTEXT Context = lpData;
+
+    if (dwCallbackReason == CALLBACK_STREAM_SWITCH)
+    {
+        Context->StreamSwitches++;
+        if (Context->Chunks != 0)
+            Context->OutOfOrder = TRUE;
+    }
+    else
+    {
+        Context->Chunks++;
+        if (TotalBytesTransferred.QuadPart <= Context->LastTransferred.QuadPart ||
+            TotalBytesTransferred.QuadPart > TotalFileSize.QuadPart)
+        {
+            Context->OutOfOrder = TRUE;
+        }
+    }
+    Context->LastTransferred = TotalBytesTransferred;
+
+    return Context->Result;
+}
+
+static
+BOOL
+CreateSourceFile(VOID)
+{
+    HANDLE File;
+    PULONG Buffer;
+    ULONG i, Chunk, Written = 0;
+    DWORD Bytes;
+
+    Buffer = HeapAlloc(GetProcessHeap(), 0, 1024 * 1024);
+    if (!Buffer)
+        return FALSE;
+
+    File = CreateFileW(SourceName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    ok(File != INVALID_HANDLE_VALUE, "CreateFileW failed: %lu\n", GetLastError());
+    if (File == INVALID_HANDLE_VALUE)
+    {
+        HeapFree(GetProcessHeap(), 0, Buffer);
+        return FALSE;
+    }
+
+    /* Every ULONG holds its own offset, misplaced chunks show up */
+    while (Written < FILE_SIZE)
+    {
+        for (i = 0; i < 1024 * 1024 / sizeof(ULONG); i++)
+            Buffer[i] = Written + i * sizeof(ULONG);
+
+        Chunk = min(FILE_SIZE - Written, 1024 * 1024);
+        if (!WriteFile(File, Buffer, Chunk, &Bytes, NULL) || Bytes != Chunk)
+            break;
+        Written += Chunk;
+    }
+    ok_eq_ulong(Written, (ULONG)FILE_SIZE);
+
+    CloseHandle(File);
+    HeapFree(GetProcessHeap(), 0, Buffer);
+    return Written == FILE_SIZE;
+}
+
+static
+VOID
+CheckDestFile(
+    _In_ PCSTR Description)
+{
+    HANDLE File;
+    PULONG Buffer;
+    ULONG i, Offset = 0, Mismatch = 0;
+    DWORD Bytes;
+
+    Buffer = HeapAlloc(GetProcessHeap(), 0, 1024 * 1024);
+    if (!Buffer)
+        return;
+
+    File = CreateFileW(DestName, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    ok(File != INVALID_HANDLE_VALUE, "%s: CreateFileW failed: %lu\n", Description, GetLastError());
+    if (File == INVALID_HANDLE_VALUE)
+    {
+        HeapFree(GetProcessHeap(), 0, Buffer);
+        return;
+    }
+
+    ok_eq_ulong(GetFileSize(File, NULL), (ULONG)FILE_SIZE);
+
+    while (ReadFile(File, Buffer, 1024 * 1024, &Bytes, NULL) && Bytes != 0)
+    {
+        for (i = 0; i < Bytes / sizeof(ULONG); i++)
+        {
+            if (Buffer[i] != Offset + i * sizeof(ULONG))
+                Mismatch++;
+        }
+        Offset += Bytes;
+    }
+    ok_eq_ulong(Offset, (ULONG)FILE_SIZE);
+    ok(Mismatch == 0, "%s: %lu ULONGs differ\n", Description, Mismatch);
+
+    CloseHandle(File);
+    HeapFree(GetProcessHeap(), 0, Buffer);
+}
+
+static
+VOID
+TestCopy(
+    _In_ DWORD Flags,
+    _In_ PCSTR Description)
+{
+    PROGRESS_CONTEXT Context;
+    LARGE_INTEGER Frequency, Start, End;
+    LONGLONG Time;
+    BOOL Ret;
+
+    DeleteFileW(DestName);
+
+    ZeroMemory(&Context, sizeof(Context));
+    Context.Result = PROGRESS_CONTINUE;
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    Ret = CopyFileExW(SourceName, DestName, CopyProgress, &Context, NULL, Flags);
+    QueryPerformanceCounter(&End);
+    ok(Ret, "%s: CopyFileExW failed: %lu\n", Description, GetLastError());
+    if (!Ret)
+        return;
+
+    ok_eq_ulong(Context.StreamSwitches, 1UL);
+    ok(Context.Chunks != 0, "%s: no chunk finished\n", Description);
+    ok(!Context.OutOfOrder, "%s: progress went backwards\n", Description);
+    ok(Context.LastTransferred.QuadPart == FILE_SIZE,
+       "%s: last progress at %I64d\n", Description, Context.LastTransferred.QuadPart);
+
+    CheckDestFile(Description);
+
+    Time = (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart;
+    if (Time)
+    {
+        trace("%s: %lu bytes in %I64d us, %I64d MB/s, %lu callbacks\n",
+              Description, (ULONG)FILE_SIZE, Time,
+              FILE_SIZE * 1000000LL / Time / (1024 * 1024), Context.Chunks);
+    }
+}
+
+static
+VOID
+TestFlags(VOID)
+{
+    PROGRESS_CONTEXT Context;
+    BOOL Ret;
+
+    /* The destination exists now */
+    SetLastError(0xdeadbeef);
+    Ret = CopyFileExW(SourceName, DestName, NULL, NULL, NULL, COPY_FILE_FAIL_IF_EXISTS);
+    ok(!Ret, "CopyFileExW succeeded over an existing file\n");
+    ok_eq_ulong(GetLastError(), (DWORD)ERROR_FILE_EXISTS);
+
+    /* Only COPY_FILE_FAIL_IF_EXISTS keeps it from being replaced */
+    Ret = CopyFileExW(SourceName, DestName, NULL, NULL, NULL, COPY_FILE_RESTARTABLE);
+    ok(Ret, "CopyFileExW failed: %lu\n", GetLastError());
+
+    /* Cancelling from the callback removes the partial copy */
+    DeleteFileW(DestName);
+    ZeroMemory(&Context, sizeof(Context));
+    Context.Result = PROGRESS_CANCEL;
+    SetLastError(0xdeadbeef);
+    Ret = CopyFileExW(SourceName, DestName, CopyProgress, &Context, NULL, 0);
+    ok(!Ret, "CopyFileExW succeeded\n");
+    ok_eq_ulong(GetLastError(), (DWORD)ERROR_REQUEST_ABORTED);
+    ok_eq_ulong(Context.StreamSwitches, 1UL);
+    ok_eq_ulong(Context.Chunks, 0UL);
+    ok(GetFileAttributesW(DestName) == INVALID_FILE_ATTRIBUTES, "Cancelled copy was kept\n");
+
+    /* Stopping keeps it */
+    ZeroMemory(&Context, sizeof(Context));
+    Context.Result = PROGRESS_STOP;
+    Ret = CopyFileExW(SourceName, DestName, CopyProgress, &Context, NULL, 0);
+    ok(!Ret, "CopyFileExW succeeded\n");
+    ok(GetFileAttributesW(DestName) != INVALID_FILE_ATTRIBUTES, "Stopped copy was removed\n");
+}
+
+static
+VOID
+TestEmptyFile(VOID)
+{
+    PROGRESS_CONTEXT Context;
+    HANDLE File;
+    BOOL Ret;
+
+    File = CreateFileW(SourceName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    ok(File != INVALID_HANDLE_VALUE, "CreateFileW failed: %lu\n", GetLastError());
+    if (File == INVALID_HANDLE_VALUE)
+        return;
+    CloseHandle(File);
+
+    DeleteFileW(DestName);
+    ZeroMemory(&Context, sizeof(Context));
+    Context.Result = PROGRESS_CONTINUE;
+    Ret = CopyFileExW(SourceName, DestName, CopyProgress, &Context, NULL, COPY_FILE_NO_BUFFERING);
+    ok(Ret, "CopyFileExW failed: %lu\n", GetLastError());
+    ok_eq_ulong(Context.StreamSwitches, 1UL);
+    ok_eq_ulong(Context.Chunks, 0UL);
+
+    File = CreateFileW(DestName, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    ok(File != INVALID_HANDLE_VALUE, "CreateFileW failed: %lu\n", GetLastError());
+    if (File != INVALID_HANDLE_VALUE)
+    {
+        ok_eq_ulong(GetFileSize(File, NULL), 0UL);
+        CloseHandle(File);
+    }
+}
+
+START_TEST(CopyFileThroughput)
+{
+    WCHAR TempPath[MAX_PATH];
+
+    GetTempPathW(_countof(TempPath), TempPath);
+    GetTempFileNameW(TempPath, L"cfs", 0, SourceName);
+    GetTempFileNameW(TempPath, L"cfd", 0, DestName);
+
+    if (CreateSourceFile())
+    {
+        TestCopy(0, "Cached");
+        TestCopy(COPY_FILE_NO_BUFFERING, "Unbuffered");
+        TestFlags();
+        TestEmptyFile();
+    }
+
+    SetFileAttributesW(DestName, FILE_ATTRIBUTE_NORMAL);
+    DeleteFileW(DestName);
+    DeleteFileW(SourceName);
+}
@@ -0,0 +1,293 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Enumerate and open the files of large directories on an NTFS volume
+ */
+
+#include "precomp.h"
+
+#define DIRECTORIES 100
+#define FILES_PER_DIRECTORY 1000
+#define TOTAL_FILES (DIRECTORIES * FILES_PER_DIRECTORY)
+
+/* A single directory, so every open is a lookup in one big index */
+#define LARGE_DIRECTORY_FILES 50000
+#define RANDOM_OPENS 10000
+
+static WCHAR Root[MAX_PATH];
+
+static
+BOOL
+FindNtfsVolume(VOID)
+{
+    WCHAR Drive[] = L"A:\\";
+    WCHAR FileSystem[MAX_PATH];
+    DWORD Drives;
+
+    for (Drives = GetLogicalDrives(); Drives; Drives >>= 1, Drive[0]++)
+    {
+        if (!(Drives & 1) || GetDriveTypeW(Drive) != DRIVE_FIXED)
+            continue;
+
+        if (GetVolumeInformationW(Drive, NULL, 0, NULL, NULL, NULL, FileSystem, _countof(FileSystem)) &&
+            !wcscmp(FileSystem, L"NTFS"))
+        {
+            swprintf(Root, L"%lsDirectoryTraversal", Drive);
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static
+BOOL
+CreateFiles(
+    _In_ PCWSTR Directory,
+    _In_ ULONG Count)
+{
+    WCHAR Path[MAX_PATH];
+    HANDLE File;
+    ULONG i;
+
+    if (!CreateDirectoryW(Directory, NULL))
+        return FALSE;
+
+    for (i = 0; i < Count; i++)
+    {
+        swprintf(Path, L"%ls\\File%05lu.txt", Directory, i);
+        File = CreateFileW(Path, GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (File == INVALID_HANDLE_VALUE)
+            return FALSE;
+        CloseHandle(File);
+    }
+
+    return TRUE;
+}
+
+static
+VOID
+DeleteFiles(
+    _In_ PCWSTR Directory,
+    _In_ ULONG Count)
+{
+    WCHAR Path[MAX_PATH];
+    ULONG i;
+
+    for (i = 0; i < Count; i++)
+    {
+        swprintf(Path, L"%ls\\File%05lu.txt", Directory, i);
+        DeleteFileW(Path);
+    }
+
+    RemoveDirectoryW(Directory);
+}
+
+/* Every open walks the path, directory by directory */
+static
+BOOL
+OpenMixedCase(
+    _In_ PCWSTR Directory,
+    _In_ ULONG Index)
+{
+    WCHAR Path[MAX_PATH];
+    HANDLE File;
+
+    /* The lookup has to ignore the case */
+    swprintf(Path, (Index & 1) ? L"%ls\\FILE%05lu.TXT" : L"%ls\\File%05lu.txt", Directory, Index);
+    File = CreateFileW(Path, FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                       NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (File == INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    CloseHandle(File);
+    return TRUE;
+}
+
+static
+BOOL
+CreateTree(VOID)
+{
+    WCHAR Directory[MAX_PATH];
+    ULONG i;
+
+    for (i = 0; i < DIRECTORIES; i++)
+    {
+        swprintf(Directory, L"%ls\\Directory%03lu", Root, i);
+        if (!CreateFiles(Directory, FILES_PER_DIRECTORY))
+            break;
+    }
+
+    ok(i == DIRECTORIES, "Creating the tree failed in directory %lu: %lu\n", i, GetLastError());
+    return i == DIRECTORIES;
+}
+
+static
+VOID
+DeleteTree(VOID)
+{
+    WCHAR Directory[MAX_PATH];
+    ULONG i;
+
+    for (i = 0; i < DIRECTORIES; i++)
+    {
+        swprintf(Directory, L"%ls\\Directory%03lu", Root, i);
+        DeleteFiles(Directory, FILES_PER_DIRECTORY);
+    }
+}
+
+static
+ULONG
+EnumerateTree(VOID)
+{
+    WCHAR Pattern[MAX_PATH];
+    WIN32_FIND_DATAW FindData;
+    HANDLE Find;
+    ULONG Directory, Files = 0;
+
+    for (Directory = 0; Directory < DIRECTORIES; Directory++)
+    {
+        swprintf(Pattern, L"%ls\\Directory%03lu\\*", Root, Directory);
+        Find = FindFirstFileW(Pattern, &FindData);
+        if (Find == INVALID_HANDLE_VALUE)
+            continue;
+
+        do
+        {
+            if (!(FindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+                Files++;
+        } while (FindNextFileW(Find, &FindData));
+
+        FindClose(Find);
+    }
+
+    return Files;
+}
+
+static
+ULONG
+OpenTree(VOID)
+{
+    WCHAR Directory[MAX_PATH];
+    ULONG i, j, Opened = 0;
+
+    for (i = 0; i < DIRECTORIES; i++)
+    {
+        swprintf(Directory, L"%ls\\DIRECTORY%03lu", Root, i);
+        for (j = 0; j < FILES_PER_DIRECTORY; j++)
+        {
+            if (OpenMixedCase(Directory, j))
+                Opened++;
+        }
+    }
+
+    return Opened;
+}
+
+static
+VOID
+TestTree(VOID)
+{
+    LARGE_INTEGER Frequency, Start, End;
+    ULONG Count, Pass;
+
+    if (!CreateTree())
+    {
+        DeleteTree();
+        return;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+
+    QueryPerformanceCounter(&Start);
+    Count = EnumerateTree();
+    QueryPerformanceCounter(&End);
+    ok(Count == TOTAL_FILES, "Enumerated %lu files, expected %lu\n", Count, (ULONG)TOTAL_FILES);
+    trace("Enumerating %lu files: %I64d ms\n", Count,
+          (End.QuadPart - Start.QuadPart) * 1000 / Frequency.QuadPart);
+
+    /* The directory FCBs stay in the table, the second pass finds them there */
+    for (Pass = 0; Pass < 2; Pass++)
+    {
+        QueryPerformanceCounter(&Start);
+        Count = OpenTree();
+        QueryPerformanceCounter(&End);
+        ok(Count == TOTAL_FILES, "Opened %lu files, expected %lu\n", Count, (ULONG)TOTAL_FILES);
+        if (Count)
+        {
+            trace("Opening %lu files, pass %lu: %I64d us per file\n", Count, Pass + 1,
+                  (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart / Count);
+        }
+    }
+
+    DeleteTree();
+}
+
+static
+VOID
+TestLargeDirectory(VOID)
+{
+    WCHAR Directory[MAX_PATH];
+    WCHAR Path[MAX_PATH];
+    LARGE_INTEGER Frequency, Start, End;
+    ULONG Seed = 0x12345678;
+    ULONG Opened = 0, i;
+    HANDLE File;
+
+    swprintf(Directory, L"%ls\\Large", Root);
+    if (!CreateFiles(Directory, LARGE_DIRECTORY_FILES))
+    {
+        ok(FALSE, "Creating %lu files failed: %lu\n", (ULONG)LARGE_DIRECTORY_FILES, GetLastError());
+        DeleteFiles(Directory, LARGE_DIRECTORY_FILES);
+        return;
+    }
+
+    /* A fixed seed keeps the order of the opens the same from run to run */
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < RANDOM_OPENS; i++)
+    {
+        if (OpenMixedCase(Directory, RtlRandom(&Seed) % LARGE_DIRECTORY_FILES))
+            Opened++;
+    }
+    QueryPerformanceCounter(&End);
+
+    ok(Opened == RANDOM_OPENS, "Opened %lu files, expected %lu\n", Opened, (ULONG)RANDOM_OPENS);
+    if (Opened)
+    {
+        trace("Opening %lu random files of %lu: %I64d us per file\n", Opened, (ULONG)LARGE_DIRECTORY_FILES,
+              (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart / Opened);
+    }
+
+    /* A name that sorts between two existing ones */
+    swprintf(Path, L"%ls\\File%05lu.tx", Directory, 0UL);
+    File = CreateFileW(Path, FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                       NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    ok(File == INVALID_HANDLE_VALUE, "Opened a file that doesn't exist\n");
+    ok(GetLastError() == ERROR_FILE_NOT_FOUND || GetLastError() == ERROR_PATH_NOT_FOUND,
+       "GetLastError() = %lu\n", GetLastError());
+    if (File != INVALID_HANDLE_VALUE)
+        CloseHandle(File);
+
+    DeleteFiles(Directory, LARGE_DIRECTORY_FILES);
+}
+
+START_TEST(DirectoryTraversal)
+{
+    if (!FindNtfsVolume())
+    {
+        skip("No NTFS volume\n");
+        return;
+    }
+
+    if (!CreateDirectoryW(Root, NULL))
+    {
+        skip("Cannot create %ls: %lu\n", Root, GetLastError());
+        return;
+    }
+
+    TestTree();
+    TestLargeDirectory();
+
+    RemoveDirectoryW(Root);
+}
@@ -0,0 +1,171 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Random 4K reads from the boot disk with several requests in flight
+ */
+
+#include "precomp.h"
+
+#include <winioctl.h>
+
+#define BLOCK_SIZE 4096
+#define MAX_DEPTH 32
+#define READS_PER_TEST 8192
+
+/* Keep to the start of the disk, large disks would only measure seeks */
+#define MAX_SPAN (1024 * 1024 * 1024LL)
+
+static HANDLE Disk = INVALID_HANDLE_VALUE;
+static ULONG BlockCount;
+static ULONG Seed = 0x12345678;
+
+static
+ULONG
+NextBlock(VOID)
+{
+    /* Same sequence every run, so runs can be compared */
+    Seed = Seed * 1103515245 + 12345;
+    return (Seed >> 8) % BlockCount;
+}
+
+static
+BOOL
+StartRead(
+    _In_ PVOID Buffer,
+    _Inout_ LPOVERLAPPED Overlapped)
+{
+    LARGE_INTEGER Offset;
+
+    Offset.QuadPart = (LONGLONG)NextBlock() * BLOCK_SIZE;
+    Overlapped->Offset = Offset.LowPart;
+    Overlapped->OffsetHigh = Offset.HighPart;
+
+    if (ReadFile(Disk, Buffer, BLOCK_SIZE, NULL, Overlapped))
+        return TRUE;
+
+    return GetLastError() == ERROR_IO_PENDING;
+}
+
+static
+VOID
+TestIops(
+    _In_ ULONG Depth)
+{
+    OVERLAPPED Overlapped[MAX_DEPTH];
+    HANDLE Events[MAX_DEPTH];
+    PUCHAR Buffers;
+    LARGE_INTEGER Frequency, Start, End;
+    LONGLONG Time;
+    ULONG Started = 0, Completed = 0, Failed = 0, i;
+    DWORD Wait, Bytes;
+
+    /* Unbuffered I/O wants sector aligned buffers, VirtualAlloc gives pages */
+    Buffers = VirtualAlloc(NULL, Depth * BLOCK_SIZE, MEM_COMMIT, PAGE_READWRITE);
+    ok(Buffers != NULL, "VirtualAlloc failed: %lu\n", GetLastError());
+    if (!Buffers)
+        return;
+
+    ZeroMemory(Overlapped, sizeof(Overlapped));
+    for (i = 0; i < Depth; i++)
+    {
+        Events[i] = CreateEventW(NULL, TRUE, FALSE, NULL);
+        Overlapped[i].hEvent = Events[i];
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+
+    for (i = 0; i < Depth; i++)
+    {
+        if (!StartRead(Buffers + i * BLOCK_SIZE, &Overlapped[i]))
+            break;
+        Started++;
+    }
+    ok(Started == Depth, "Only %lu of %lu reads started: %lu\n", Started, Depth, GetLastError());
+
+    /* Reissue every read as soon as it completes */
+    while (Completed < Started)
+    {
+        Wait = WaitForMultipleObjects(Depth, Events, FALSE, 30000);
+        if (Wait >= WAIT_OBJECT_0 + Depth)
+            break;
+
+        i = Wait - WAIT_OBJECT_0;
+        if (!GetOverlappedResult(Disk, &Overlapped[i], &Bytes, FALSE) || Bytes != BLOCK_SIZE)
+            Failed++;
+        Completed++;
+
+        /* A slot that isn't reused must not be reported again */
+        ResetEvent(Events[i]);
+        if (Started < READS_PER_TEST)
+        {
+            if (StartRead(Buffers + i * BLOCK_SIZE, &Overlapped[i]))
+                Started++;
+            else
+                Failed++;
+        }
+    }
+
+    QueryPerformanceCounter(&End);
+
+    ok(Completed == Started, "%lu of %lu reads completed\n", Completed, Started);
+    ok(Failed == 0, "%lu reads failed at depth %lu\n", Failed, Depth);
+
+    /* Nothing may still write into the buffers */
+    if (Completed < Started)
+    {
+        CancelIo(Disk);
+        for (i = 0; i < Depth; i++)
+            GetOverlappedResult(Disk, &Overlapped[i], &Bytes, TRUE);
+    }
+
+    Time = (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart;
+    if (Time)
+    {
+        trace("Random %u byte reads at queue depth %lu: %I64d IOPS\n",
+              BLOCK_SIZE, Depth, (LONGLONG)Completed * 1000000 / Time);
+    }
+
+    for (i = 0; i < Depth; i++)
+        CloseHandle(Events[i]);
+    VirtualFree(Buffers, 0, MEM_RELEASE);
+}
+
+START_TEST(DiskIops)
+{
+    GET_LENGTH_INFORMATION LengthInfo;
+    DWORD Bytes;
+    ULONG Depth;
+
+    Disk = CreateFileW(L"\\\\.\\PhysicalDrive0",
+                       GENERIC_READ,
+                       FILE_SHARE_READ | FILE_SHARE_WRITE,
+                       NULL,
+                       OPEN_EXISTING,
+                       FILE_FLAG_NO_BUFFERING | FILE_FLAG_OVERLAPPED,
+                       NULL);
+    if (Disk == INVALID_HANDLE_VALUE)
+    {
+        skip("Cannot open the boot disk: %lu\n", GetLastError());
+        return;
+    }
+
+    if (!DeviceIoControl(Disk, IOCTL_DISK_GET_LENGTH_INFO, NULL, 0,
+                         &LengthInfo, sizeof(LengthInfo), &Bytes, NULL))
+    {
+        skip("IOCTL_DISK_GET_LENGTH_INFO failed: %lu\n", GetLastError());
+        CloseHandle(Disk);
+        return;
+    }
+
+    BlockCount = (ULONG)(min(LengthInfo.Length.QuadPart, MAX_SPAN) / BLOCK_SIZE);
+    ok(BlockCount != 0, "Disk is %I64d bytes\n", LengthInfo.Length.QuadPart);
+    if (BlockCount != 0)
+    {
+        /* Without tagged queuing down to the disk, every depth does about as well */
+        for (Depth = 1; Depth <= MAX_DEPTH; Depth *= 2)
+            TestIops(Depth);
+    }
+
+    CloseHandle(Disk);
+}
@@ -0,0 +1,199 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Small block allocation throughput with and without the low fragmentation heap
+ */
+
+#include "precomp.h"
+
+#define ALLOCS_PER_ROUND 64
+#define ROUNDS 20000
+#define MAX_THREADS 16
+
+typedef struct _THROUGHPUT_CONTEXT
+{
+    HANDLE Heap;
+    HANDLE StartEvent;
+    ULONG Failures;
+} THROUGHPUT_CONTEXT, *PTHROUGHPUT_CONTEXT;
+
+static
+DWORD
+WINAPI
+AllocThread(
+    _In_ PVOID Parameter)
+{
+    PTHROUGHPUT_CONTEXT Context = Parameter;
+    PVOID Blocks[ALLOCS_PER_ROUND];
+    ULONG Round, i;
+
+    WaitForSingleObject(Context->StartEvent, INFINITE);
+
+    for (Round = 0; Round < ROUNDS; Round++)
+    {
+        /* A typical mix of small sizes, all freed again right away */
+        for (i = 0; i < ALLOCS_PER_ROUND; i++)
+        {
+            Blocks[i] = HeapAlloc(Context->Heap, 0, 16 + (i * 24) % 1000);
+            if (!Blocks[i])
+                InterlockedIncrement((PLONG)&Context->Failures);
+        }
+
+        for (i = 0; i < ALLOCS_PER_ROUND; i++)
+            HeapFree(Context->Heap, 0, Blocks[i]);
+    }
+
+    return 0;
+}
+
+static
+ULONGLONG
+MeasureThroughput(
+    _In_ HANDLE Heap,
+    _In_ ULONG ThreadCount)
+{
+    HANDLE Threads[MAX_THREADS];
+    THROUGHPUT_CONTEXT Context;
+    LARGE_INTEGER Frequency, Start, End;
+    ULONG i;
+
+    Context.Heap = Heap;
+    Context.Failures = 0;
+    Context.StartEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    ok(Context.StartEvent != NULL, "CreateEventW failed: %lu\n", GetLastError());
+    if (!Context.StartEvent)
+        return 0;
+
+    for (i = 0; i < ThreadCount; i++)
+    {
+        Threads[i] = CreateThread(NULL, 0, AllocThread, &Context, 0, NULL);
+        ok(Threads[i] != NULL, "CreateThread failed: %lu\n", GetLastError());
+        if (!Threads[i])
+        {
+            ThreadCount = i;
+            break;
+        }
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    SetEvent(Context.StartEvent);
+
+    ok_eq_ulong(WaitForMultipleObjects(ThreadCount, Threads, TRUE, 5 * 60 * 1000), (DWORD)WAIT_OBJECT_0);
+    QueryPerformanceCounter(&End);
+
+    for (i = 0; i < ThreadCount; i++)
+        CloseHandle(Threads[i]);
+    CloseHandle(Context.StartEvent);
+
+    ok_eq_ulong(Context.Failures, 0UL);
+    ok(HeapValidate(Heap, 0, NULL), "HeapValidate failed\n");
+
+    /* Allocations plus frees per millisecond */
+    End.QuadPart = (End.QuadPart - Start.QuadPart) * 1000 / Frequency.QuadPart;
+    return (ULONGLONG)ThreadCount * ROUNDS * ALLOCS_PER_ROUND * 2 / max(End.QuadPart, 1);
+}
+
+static
+VOID
+TestFrontEnd(
+    _In_ HANDLE Heap)
+{
+    PUCHAR Block, Blocks[32];
+    SIZE_T Size;
+    ULONG i;
+
+    /* Sizes must come back exactly as asked for, whatever bucket served them */
+    for (i = 0; i < RTL_NUMBER_OF(Blocks); i++)
+    {
+        Size = i * 37;
+        Blocks[i] = HeapAlloc(Heap, HEAP_ZERO_MEMORY, Size);
+        ok(Blocks[i] != NULL, "HeapAlloc(%Iu) failed\n", Size);
+        if (!Blocks[i])
+            continue;
+
+        ok(HeapSize(Heap, 0, Blocks[i]) == Size, "HeapSize returned %Iu, expected %Iu\n",
+           HeapSize(Heap, 0, Blocks[i]), Size);
+        ok(Size == 0 || (Blocks[i][0] == 0 && Blocks[i][Size - 1] == 0), "Block %lu not zeroed\n", i);
+        memset(Blocks[i], 0xCC, Size);
+    }
+
+    for (i = 0; i < RTL_NUMBER_OF(Blocks); i++)
+        ok(HeapFree(Heap, 0, Blocks[i]), "HeapFree failed: %lu\n", GetLastError());
+
+    /* A recycled block still has to honour HEAP_ZERO_MEMORY */
+    Block = HeapAlloc(Heap, HEAP_ZERO_MEMORY, 37);
+    ok(Block != NULL, "HeapAlloc failed\n");
+    if (Block)
+    {
+        for (i = 0; i < 37; i++)
+        {
+            if (Block[i] != 0)
+                break;
+        }
+        ok_eq_ulong(i, 37UL);
+
+        /* Growing and shrinking must work on front end blocks too */
+        Block = HeapReAlloc(Heap, 0, Block, 3000);
+        ok(Block != NULL, "HeapReAlloc failed\n");
+        if (Block)
+        {
+            ok_eq_size(HeapSize(Heap, 0, Block), (SIZE_T)3000);
+            ok(HeapFree(Heap, 0, Block), "HeapFree failed: %lu\n", GetLastError());
+        }
+    }
+
+    ok(HeapValidate(Heap, 0, NULL), "HeapValidate failed\n");
+}
+
+START_TEST(HeapThroughput)
+{
+    SYSTEM_INFO SystemInfo;
+    HANDLE BackEndHeap, LfhHeap, UnserializedHeap;
+    ULONG Info, ThreadCount;
+    ULONGLONG BackEnd, Lfh;
+
+    GetSystemInfo(&SystemInfo);
+
+    BackEndHeap = HeapCreate(0, 0, 0);
+    LfhHeap = HeapCreate(0, 0, 0);
+    UnserializedHeap = HeapCreate(HEAP_NO_SERIALIZE, 0, 0);
+    ok(BackEndHeap && LfhHeap && UnserializedHeap, "HeapCreate failed: %lu\n", GetLastError());
+    if (!BackEndHeap || !LfhHeap || !UnserializedHeap)
+        return;
+
+    /* Opt in to the front end */
+    Info = 2;
+    ok(HeapSetInformation(LfhHeap, HeapCompatibilityInformation, &Info, sizeof(Info)),
+       "HeapSetInformation failed: %lu\n", GetLastError());
+    Info = 0xdeadbeef;
+    ok(HeapQueryInformation(LfhHeap, HeapCompatibilityInformation, &Info, sizeof(Info), NULL),
+       "HeapQueryInformation failed: %lu\n", GetLastError());
+    ok_eq_ulong(Info, 2UL);
+
+    /* It can't work without a heap lock */
+    Info = 2;
+    ok(!HeapSetInformation(UnserializedHeap, HeapCompatibilityInformation, &Info, sizeof(Info)),
+       "HeapSetInformation succeeded on a HEAP_NO_SERIALIZE heap\n");
+
+    TestFrontEnd(LfhHeap);
+
+    for (ThreadCount = 1; ThreadCount <= min(SystemInfo.dwNumberOfProcessors * 2, MAX_THREADS); ThreadCount *= 2)
+    {
+        BackEnd = MeasureThroughput(BackEndHeap, ThreadCount);
+        Lfh = MeasureThroughput(LfhHeap, ThreadCount);
+
+        trace("%lu threads: %I64u ops/ms back end, %I64u ops/ms front end\n",
+              ThreadCount, BackEnd, Lfh);
+    }
+
+    /* Enough contention switches the plain heap over on its own */
+    Info = 0xdeadbeef;
+    ok(HeapQueryInformation(BackEndHeap, HeapCompatibilityInformation, &Info, sizeof(Info), NULL),
+       "HeapQueryInformation failed: %lu\n", GetLastError());
+    trace("Plain heap front end type is %lu\n", Info);
+
+    HeapDestroy(UnserializedHeap);
+    HeapDestroy(LfhHeap);
+    HeapDestroy(BackEndHeap);
+}
@@ -0,0 +1,123 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Startup cost of touching a large image mapping
+ */
+
+#include "precomp.h"
+
+#include <ndk/psfuncs.h>
+#include <versionhelpers.h>
+
+static
+ULONG
+GetPageFaultCount(VOID)
+{
+    VM_COUNTERS Counters;
+    NTSTATUS Status;
+
+    Status = NtQueryInformationProcess(NtCurrentProcess(),
+                                       ProcessVmCounters,
+                                       &Counters,
+                                       sizeof(Counters),
+                                       NULL);
+    ok(NT_SUCCESS(Status), "NtQueryInformationProcess failed: 0x%lx\n", Status);
+    return NT_SUCCESS(Status) ? Counters.PageFaultCount : 0;
+}
+
+/* One fault brings in the whole window, so the next page costs nothing */
+static
+VOID
+TestNeighbourResident(
+    _In_ volatile UCHAR *Base,
+    _In_ PIMAGE_NT_HEADERS NtHeaders)
+{
+    PIMAGE_SECTION_HEADER Section, Largest = NULL;
+    ULONG FaultsBefore, Faults;
+    ULONG Page, i;
+    UCHAR Value;
+
+    /* Both pages must be in one section, or they get different protections */
+    Section = IMAGE_FIRST_SECTION(NtHeaders);
+    for (i = 0; i < NtHeaders->FileHeader.NumberOfSections; i++, Section++)
+    {
+        if (!Largest || Section->Misc.VirtualSize > Largest->Misc.VirtualSize)
+            Largest = Section;
+    }
+    if (!Largest || Largest->Misc.VirtualSize < 3 * PAGE_SIZE)
+    {
+        skip("No section is large enough\n");
+        return;
+    }
+
+    /* An even page and the one after it are always in the same window */
+    Page = (Largest->VirtualAddress + PAGE_SIZE - 1) / PAGE_SIZE;
+    Page = (Page + 1) & ~1UL;
+
+    Value = Base[Page * PAGE_SIZE];
+    FaultsBefore = GetPageFaultCount();
+    Value += Base[(Page + 1) * PAGE_SIZE];
+    Faults = GetPageFaultCount() - FaultsBefore;
+
+    ok(Faults == 0, "Touching page %lu after page %lu took %lu faults (%x)\n",
+       Page + 1, Page, Faults, Value);
+}
+
+static
+VOID
+TestLoadLargeImage(
+    _In_ PCWSTR DllName)
+{
+    LARGE_INTEGER Frequency, Start, End;
+    PIMAGE_NT_HEADERS NtHeaders;
+    ULONG FaultsBefore, Faults;
+    ULONG Pages, i;
+    volatile UCHAR *Base;
+    ULONG Sum = 0;
+    HMODULE Module;
+
+    QueryPerformanceFrequency(&Frequency);
+
+    /* Map the image without running any of its code, so only our touches fault */
+    QueryPerformanceCounter(&Start);
+    Module = LoadLibraryExW(DllName, NULL, DONT_RESOLVE_DLL_REFERENCES);
+    ok(Module != NULL, "LoadLibraryExW(%ls) failed: %lu\n", DllName, GetLastError());
+    if (!Module)
+        return;
+
+    Base = (volatile UCHAR *)Module;
+    NtHeaders = RtlImageNtHeader((PVOID)Base);
+    ok(NtHeaders != NULL, "No NT headers for %ls\n", DllName);
+    if (!NtHeaders)
+    {
+        FreeLibrary(Module);
+        return;
+    }
+
+    Pages = NtHeaders->OptionalHeader.SizeOfImage / PAGE_SIZE;
+
+    /* Windows doesn't map the neighbours of a fault */
+    if (IsReactOS())
+        TestNeighbourResident(Base, NtHeaders);
+
+    /* Walk the whole image like a loader touching code and data on startup */
+    FaultsBefore = GetPageFaultCount();
+    for (i = 0; i < Pages; i++)
+        Sum += Base[i * PAGE_SIZE];
+    Faults = GetPageFaultCount() - FaultsBefore;
+    QueryPerformanceCounter(&End);
+
+    trace("%ls: %lu pages, %lu faults, %I64d us (checksum %lx)\n",
+          DllName,
+          Pages,
+          Faults,
+          (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart,
+          Sum);
+
+    FreeLibrary(Module);
+}
+
+START_TEST(ImageFaultAround)
+{
+    TestLoadLargeImage(L"shell32.dll");
+}
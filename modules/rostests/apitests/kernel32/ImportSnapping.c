@@ -0,0 +1,133 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Export lookups by name, and the start-up cost of small processes
+ */
+
+#include "precomp.h"
+
+#define SHORT_STARTS 50
+
+/* Compare every named export with the same export looked up by ordinal */
+static
+VOID
+TestExportsByName(
+    _In_ PCWSTR DllName)
+{
+    HMODULE Module;
+    PIMAGE_NT_HEADERS NtHeaders;
+    PIMAGE_EXPORT_DIRECTORY Exports;
+    PULONG NameTable;
+    PUSHORT OrdinalTable;
+    FARPROC ByName, ByOrdinal;
+    LARGE_INTEGER Frequency, Start, End;
+    ULONG i, Round, Mismatch = 0;
+
+    Module = GetModuleHandleW(DllName);
+    if (!Module)
+        Module = LoadLibraryW(DllName);
+    ok(Module != NULL, "%S not loaded: %lu\n", DllName, GetLastError());
+    if (!Module)
+        return;
+
+    NtHeaders = (PIMAGE_NT_HEADERS)((ULONG_PTR)Module + ((PIMAGE_DOS_HEADER)Module)->e_lfanew);
+    Exports = (PIMAGE_EXPORT_DIRECTORY)((ULONG_PTR)Module +
+              NtHeaders->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT].VirtualAddress);
+    NameTable = (PULONG)((ULONG_PTR)Module + Exports->AddressOfNames);
+    OrdinalTable = (PUSHORT)((ULONG_PTR)Module + Exports->AddressOfNameOrdinals);
+    ok(Exports->NumberOfNames != 0, "%S has no named exports\n", DllName);
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+
+    /* More than one round, so lookups run against a hashed name table too */
+    for (Round = 0; Round < 3; Round++)
+    {
+        for (i = 0; i < Exports->NumberOfNames; i++)
+        {
+            ByName = GetProcAddress(Module, (PCSTR)((ULONG_PTR)Module + NameTable[i]));
+            ByOrdinal = GetProcAddress(Module, MAKEINTRESOURCEA(Exports->Base + OrdinalTable[i]));
+
+            /* Forwarders to missing DLLs fail both ways */
+            if (ByName != ByOrdinal)
+            {
+                if (Mismatch++ < 5)
+                    trace("%S!%s: %p by name, %p by ordinal\n", DllName,
+                          (PCSTR)((ULONG_PTR)Module + NameTable[i]), ByName, ByOrdinal);
+            }
+        }
+    }
+
+    QueryPerformanceCounter(&End);
+    ok(Mismatch == 0, "%S: %lu lookups by name went wrong\n", DllName, Mismatch);
+
+    SetLastError(0xdeadbeef);
+    ok(GetProcAddress(Module, "ThisExportDoesNotExist") == NULL, "%S: found a missing export\n", DllName);
+    ok_eq_ulong(GetLastError(), (DWORD)ERROR_PROC_NOT_FOUND);
+
+    trace("%S: %lu names looked up 3 times in %I64d us\n", DllName, Exports->NumberOfNames,
+          (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart);
+}
+
+static
+VOID
+TestShortProcesses(
+    _In_ PCSTR Self)
+{
+    CHAR CommandLine[MAX_PATH + 64];
+    STARTUPINFOA StartupInfo;
+    PROCESS_INFORMATION ProcessInfo;
+    LARGE_INTEGER Frequency, Start, End;
+    DWORD ExitCode;
+    ULONG i, Started = 0;
+
+    sprintf(CommandLine, "\"%s\" ImportSnapping child", Self);
+    ZeroMemory(&StartupInfo, sizeof(StartupInfo));
+    StartupInfo.cb = sizeof(StartupInfo);
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+
+    for (i = 0; i < SHORT_STARTS; i++)
+    {
+        if (!CreateProcessA(NULL, CommandLine, NULL, NULL, FALSE, 0, NULL, NULL, &StartupInfo, &ProcessInfo))
+        {
+            ok(FALSE, "CreateProcessA failed: %lu\n", GetLastError());
+            break;
+        }
+        WaitForSingleObject(ProcessInfo.hProcess, INFINITE);
+
+        ExitCode = 0xdeadbeef;
+        GetExitCodeProcess(ProcessInfo.hProcess, &ExitCode);
+        ok_eq_ulong(ExitCode, 0UL);
+
+        CloseHandle(ProcessInfo.hThread);
+        CloseHandle(ProcessInfo.hProcess);
+        Started++;
+    }
+
+    QueryPerformanceCounter(&End);
+    if (Started)
+    {
+        trace("%lu short processes: %I64d us average\n", Started,
+              (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart / Started);
+    }
+}
+
+START_TEST(ImportSnapping)
+{
+    char **argv;
+    int argc;
+
+    argc = winetest_get_mainargs(&argv);
+    if (argc >= 3 && !strcmp(argv[2], "child"))
+    {
+        /* The imports got snapped already, that's all we wanted */
+        ExitProcess(0);
+    }
+
+    TestExportsByName(L"kernel32.dll");
+    TestExportsByName(L"ntdll.dll");
+    TestExportsByName(L"user32.dll");
+    TestShortProcesses(argv[0]);
+}
@@ -0,0 +1,315 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Batched completion port dequeue and skipping the port on success
+ */
+
+#include "precomp.h"
+
+#define COMPLETIONS 200000
+#define BATCH_SIZE 64
+
+#ifndef FILE_SKIP_COMPLETION_PORT_ON_SUCCESS
+#define FILE_SKIP_COMPLETION_PORT_ON_SUCCESS 0x1
+#endif
+#ifndef FILE_SKIP_SET_EVENT_ON_HANDLE
+#define FILE_SKIP_SET_EVENT_ON_HANDLE 0x2
+#endif
+
+typedef BOOL (WINAPI *FN_GetQueuedCompletionStatusEx)(HANDLE, LPOVERLAPPED_ENTRY, ULONG, PULONG, DWORD, BOOL);
+typedef BOOL (WINAPI *FN_SetFileCompletionNotificationModes)(HANDLE, UCHAR);
+
+static FN_GetQueuedCompletionStatusEx pGetQueuedCompletionStatusEx;
+static FN_SetFileCompletionNotificationModes pSetFileCompletionNotificationModes;
+
+static
+VOID
+CALLBACK
+DummyApc(
+    _In_ ULONG_PTR Parameter)
+{
+}
+
+static
+VOID
+PostCompletions(
+    _In_ HANDLE Port,
+    _In_ ULONG Count)
+{
+    ULONG i;
+
+    for (i = 0; i < Count; i++)
+    {
+        if (!PostQueuedCompletionStatus(Port, i, 0x1234, (LPOVERLAPPED)(ULONG_PTR)(i + 1)))
+        {
+            ok(FALSE, "PostQueuedCompletionStatus failed: %lu\n", GetLastError());
+            break;
+        }
+    }
+}
+
+static
+VOID
+TestBatch(
+    _In_ HANDLE Port)
+{
+    OVERLAPPED_ENTRY Entries[BATCH_SIZE];
+    ULONG Removed, i;
+    BOOL Ret;
+
+    /* Nothing there yet */
+    Removed = 0xdeadbeef;
+    SetLastError(0xdeadbeef);
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, BATCH_SIZE, &Removed, 0, FALSE);
+    ok(!Ret, "GetQueuedCompletionStatusEx succeeded on an empty port\n");
+    ok_eq_ulong(GetLastError(), (DWORD)WAIT_TIMEOUT);
+    ok_eq_ulong(Removed, 0UL);
+
+    SetLastError(0xdeadbeef);
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, 0, &Removed, 0, FALSE);
+    ok(!Ret, "GetQueuedCompletionStatusEx succeeded without entries\n");
+    ok_eq_ulong(GetLastError(), (DWORD)ERROR_INVALID_PARAMETER);
+
+    /* Fewer than asked for come back in one go, in order */
+    PostCompletions(Port, 10);
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, BATCH_SIZE, &Removed, 0, FALSE);
+    ok(Ret, "GetQueuedCompletionStatusEx failed: %lu\n", GetLastError());
+    ok_eq_ulong(Removed, 10UL);
+    for (i = 0; i < min(Removed, 10); i++)
+    {
+        ok_eq_ulong((ULONG)Entries[i].lpCompletionKey, 0x1234UL);
+        ok_eq_pointer(Entries[i].lpOverlapped, (LPOVERLAPPED)(ULONG_PTR)(i + 1));
+        ok_eq_ulong(Entries[i].dwNumberOfBytesTransferred, i);
+    }
+
+    /* More than asked for stay queued */
+    PostCompletions(Port, 3);
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, 2, &Removed, 0, FALSE);
+    ok(Ret, "GetQueuedCompletionStatusEx failed: %lu\n", GetLastError());
+    ok_eq_ulong(Removed, 2UL);
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, BATCH_SIZE, &Removed, 0, FALSE);
+    ok(Ret, "GetQueuedCompletionStatusEx failed: %lu\n", GetLastError());
+    ok_eq_ulong(Removed, 1UL);
+
+    /* An alertable wait returns for APCs */
+    ok(QueueUserAPC(DummyApc, GetCurrentThread(), 0), "QueueUserAPC failed: %lu\n", GetLastError());
+    SetLastError(0xdeadbeef);
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, BATCH_SIZE, &Removed, 5000, TRUE);
+    ok(!Ret, "GetQueuedCompletionStatusEx succeeded\n");
+    ok_eq_ulong(GetLastError(), (DWORD)WAIT_IO_COMPLETION);
+    ok_eq_ulong(Removed, 0UL);
+}
+
+static
+VOID
+TestThroughput(
+    _In_ HANDLE Port)
+{
+    OVERLAPPED_ENTRY Entries[BATCH_SIZE];
+    LARGE_INTEGER Frequency, Start, End;
+    LONGLONG SingleTime, BatchTime;
+    LPOVERLAPPED Overlapped;
+    ULONG_PTR Key;
+    DWORD Bytes;
+    ULONG Count, Removed;
+
+    QueryPerformanceFrequency(&Frequency);
+
+    /* One system call per completion */
+    PostCompletions(Port, COMPLETIONS);
+    QueryPerformanceCounter(&Start);
+    for (Count = 0; Count < COMPLETIONS; Count++)
+    {
+        if (!GetQueuedCompletionStatus(Port, &Bytes, &Key, &Overlapped, 0))
+            break;
+    }
+    QueryPerformanceCounter(&End);
+    ok_eq_ulong(Count, (ULONG)COMPLETIONS);
+    SingleTime = (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart;
+
+    /* Up to a batch per system call */
+    PostCompletions(Port, COMPLETIONS);
+    QueryPerformanceCounter(&Start);
+    for (Count = 0; Count < COMPLETIONS; Count += Removed)
+    {
+        if (!pGetQueuedCompletionStatusEx(Port, Entries, BATCH_SIZE, &Removed, 0, FALSE))
+            break;
+    }
+    QueryPerformanceCounter(&End);
+    ok_eq_ulong(Count, (ULONG)COMPLETIONS);
+    BatchTime = (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart;
+
+    trace("%lu completions: %I64d us one by one, %I64d us in batches of %lu\n",
+          (ULONG)COMPLETIONS, SingleTime, BatchTime, (ULONG)BATCH_SIZE);
+    if (SingleTime && BatchTime)
+    {
+        trace("%I64d completions/s one by one, %I64d completions/s batched\n",
+              COMPLETIONS * 1000000LL / SingleTime, COMPLETIONS * 1000000LL / BatchTime);
+    }
+}
+
+static
+VOID
+TestSkipOnSuccess(VOID)
+{
+    static const CHAR Data[] = "completion";
+    WCHAR PipeName[64];
+    OVERLAPPED Overlapped;
+    LPOVERLAPPED Result;
+    HANDLE Server, Client, Port;
+    ULONG_PTR Key;
+    DWORD Bytes;
+    BOOL Ret;
+
+    swprintf(PipeName, L"\\\\.\\pipe\\IoCompletionBatch_%lu", GetCurrentProcessId());
+    Server = CreateNamedPipeW(PipeName,
+                              PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED,
+                              PIPE_TYPE_BYTE,
+                              1,
+                              4096,
+                              4096,
+                              0,
+                              NULL);
+    ok(Server != INVALID_HANDLE_VALUE, "CreateNamedPipeW failed: %lu\n", GetLastError());
+    if (Server == INVALID_HANDLE_VALUE)
+        return;
+
+    Client = CreateFileW(PipeName, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
+    ok(Client != INVALID_HANDLE_VALUE, "CreateFileW failed: %lu\n", GetLastError());
+    if (Client == INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(Server);
+        return;
+    }
+
+    Port = CreateIoCompletionPort(Client, NULL, 0x42, 0);
+    ok(Port != NULL, "CreateIoCompletionPort failed: %lu\n", GetLastError());
+    ok(pSetFileCompletionNotificationModes(Client, FILE_SKIP_COMPLETION_PORT_ON_SUCCESS),
+       "SetFileCompletionNotificationModes failed: %lu\n", GetLastError());
+
+    /* The pipe has room, so this completes right away and nothing gets queued */
+    ZeroMemory(&Overlapped, sizeof(Overlapped));
+    Ret = WriteFile(Client, Data, sizeof(Data), &Bytes, &Overlapped);
+    if (Ret)
+    {
+        ok(!GetQueuedCompletionStatus(Port, &Bytes, &Key, &Result, 0),
+           "Got a completion for a request that succeeded synchronously\n");
+        ok_eq_ulong(GetLastError(), (DWORD)WAIT_TIMEOUT);
+    }
+    else
+    {
+        /* A request that pended still goes through the port */
+        ok_eq_ulong(GetLastError(), (DWORD)ERROR_IO_PENDING);
+        ok(GetQueuedCompletionStatus(Port, &Bytes, &Key, &Result, 5000),
+           "GetQueuedCompletionStatus failed: %lu\n", GetLastError());
+        ok_eq_pointer(Result, &Overlapped);
+    }
+
+    CloseHandle(Port);
+    CloseHandle(Client);
+    CloseHandle(Server);
+}
+
+static
+DWORD
+WINAPI
+SynchronousReadThread(
+    _In_ PVOID Parameter)
+{
+    CHAR Buffer[16];
+    DWORD Bytes;
+
+    if (!ReadFile((HANDLE)Parameter, Buffer, sizeof(Buffer), &Bytes, NULL))
+        return 0;
+
+    return Bytes;
+}
+
+static
+VOID
+TestSkipSetEventSynchronous(VOID)
+{
+    static const CHAR Data[] = "event";
+    WCHAR PipeName[64];
+    HANDLE Server, Client, Thread;
+    DWORD Bytes, Wait;
+
+    swprintf(PipeName, L"\\\\.\\pipe\\IoCompletionEvent_%lu", GetCurrentProcessId());
+    Server = CreateNamedPipeW(PipeName, PIPE_ACCESS_DUPLEX, PIPE_TYPE_BYTE, 1, 4096, 4096, 0, NULL);
+    ok(Server != INVALID_HANDLE_VALUE, "CreateNamedPipeW failed: %lu\n", GetLastError());
+    if (Server == INVALID_HANDLE_VALUE)
+        return;
+
+    /* No FILE_FLAG_OVERLAPPED, the I/O manager waits on the file object for us */
+    Client = CreateFileW(PipeName, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+    ok(Client != INVALID_HANDLE_VALUE, "CreateFileW failed: %lu\n", GetLastError());
+    if (Client == INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(Server);
+        return;
+    }
+
+    ok(pSetFileCompletionNotificationModes(Client, FILE_SKIP_SET_EVENT_ON_HANDLE),
+       "SetFileCompletionNotificationModes failed: %lu\n", GetLastError());
+
+    /* The pipe is empty, so the read pends until the server writes */
+    Thread = CreateThread(NULL, 0, SynchronousReadThread, Client, 0, NULL);
+    ok(Thread != NULL, "CreateThread failed: %lu\n", GetLastError());
+    if (Thread)
+    {
+        Sleep(200);
+        ok(WriteFile(Server, Data, sizeof(Data), &Bytes, NULL), "WriteFile failed: %lu\n", GetLastError());
+
+        Wait = WaitForSingleObject(Thread, 5000);
+        ok_eq_ulong(Wait, (DWORD)WAIT_OBJECT_0);
+        if (Wait == WAIT_OBJECT_0)
+        {
+            GetExitCodeThread(Thread, &Bytes);
+            ok_eq_ulong(Bytes, (DWORD)sizeof(Data));
+        }
+        else
+        {
+            /* The read never saw its completion, don't leave it behind */
+            TerminateThread(Thread, 0);
+        }
+        CloseHandle(Thread);
+    }
+
+    CloseHandle(Client);
+    CloseHandle(Server);
+}
+
+START_TEST(IoCompletionBatch)
+{
+    HMODULE Kernel32 = GetModuleHandleW(L"kernel32.dll");
+    HANDLE Port;
+
+    pGetQueuedCompletionStatusEx = (FN_GetQueuedCompletionStatusEx)
+        GetProcAddress(Kernel32, "GetQueuedCompletionStatusEx");
+    pSetFileCompletionNotificationModes = (FN_SetFileCompletionNotificationModes)
+        GetProcAddress(Kernel32, "SetFileCompletionNotificationModes");
+    if (!pGetQueuedCompletionStatusEx)
+    {
+        skip("GetQueuedCompletionStatusEx not available\n");
+    }
+    else
+    {
+        Port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 0);
+        ok(Port != NULL, "CreateIoCompletionPort failed: %lu\n", GetLastError());
+        if (Port)
+        {
+            TestBatch(Port);
+            TestThroughput(Port);
+            CloseHandle(Port);
+        }
+    }
+
+    if (!pSetFileCompletionNotificationModes)
+    {
+        skip("SetFileCompletionNotificationModes not available\n");
+        return;
+    }
+
+    TestSkipOnSuccess();
+    TestSkipSetEventSynchronous();
+}
@@ -0,0 +1,192 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Process start-up with many DLLs, and loading DLLs from several threads
+ */
+
+#include "precomp.h"
+
+#define WARM_STARTS 10
+#define LOAD_THREADS 4
+#define LOAD_ROUNDS 20
+
+/* A mix with deep and overlapping import trees, like a large application has */
+static const PCWSTR DllNames[] =
+{
+    L"shell32.dll",
+    L"ole32.dll",
+    L"oleaut32.dll",
+    L"comctl32.dll",
+    L"comdlg32.dll",
+    L"setupapi.dll",
+    L"crypt32.dll",
+    L"winmm.dll",
+    L"ws2_32.dll",
+    L"wininet.dll",
+    L"urlmon.dll",
+    L"shlwapi.dll",
+};
+
+static HANDLE StartEvent;
+
+static
+ULONG
+LoadAll(
+    _Out_opt_ HMODULE *Modules)
+{
+    HMODULE Module;
+    ULONG i, Loaded = 0;
+
+    for (i = 0; i < _countof(DllNames); i++)
+    {
+        Module = LoadLibraryW(DllNames[i]);
+        if (Module) Loaded++;
+        if (Modules) Modules[i] = Module;
+    }
+
+    return Loaded;
+}
+
+static
+LONGLONG
+StartChild(
+    _In_ PCSTR Self)
+{
+    CHAR CommandLine[MAX_PATH + 64];
+    STARTUPINFOA StartupInfo;
+    PROCESS_INFORMATION ProcessInfo;
+    LARGE_INTEGER Frequency, Start, End;
+    DWORD ExitCode = 0;
+
+    sprintf(CommandLine, "\"%s\" LoaderStartup child", Self);
+    ZeroMemory(&StartupInfo, sizeof(StartupInfo));
+    StartupInfo.cb = sizeof(StartupInfo);
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    if (!CreateProcessA(NULL, CommandLine, NULL, NULL, FALSE, 0, NULL, NULL, &StartupInfo, &ProcessInfo))
+    {
+        ok(FALSE, "CreateProcessA failed: %lu\n", GetLastError());
+        return -1;
+    }
+    WaitForSingleObject(ProcessInfo.hProcess, INFINITE);
+    QueryPerformanceCounter(&End);
+
+    GetExitCodeProcess(ProcessInfo.hProcess, &ExitCode);
+    ok_eq_ulong(ExitCode, (ULONG)_countof(DllNames));
+
+    CloseHandle(ProcessInfo.hThread);
+    CloseHandle(ProcessInfo.hProcess);
+    return (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart;
+}
+
+static
+VOID
+TestStartup(
+    _In_ PCSTR Self)
+{
+    LONGLONG Cold, Warm = 0, Time;
+    ULONG i;
+
+    /* The first start has the least in the cache, there's no way to drop it */
+    Cold = StartChild(Self);
+    if (Cold < 0)
+        return;
+
+    for (i = 0; i < WARM_STARTS; i++)
+    {
+        Time = StartChild(Self);
+        if (Time < 0)
+            return;
+        Warm += Time;
+    }
+
+    trace("Loading %lu DLLs: %I64d us first start, %I64d us average warm start\n",
+          (ULONG)_countof(DllNames), Cold, Warm / WARM_STARTS);
+}
+
+static
+DWORD
+WINAPI
+LoadThread(
+    _In_ LPVOID Parameter)
+{
+    HMODULE Modules[_countof(DllNames)];
+    ULONG Round, i, Failures = 0;
+
+    WaitForSingleObject(StartEvent, INFINITE);
+
+    for (Round = 0; Round < LOAD_ROUNDS; Round++)
+    {
+        if (LoadAll(Modules) != _countof(DllNames))
+            Failures++;
+
+        for (i = 0; i < _countof(DllNames); i++)
+        {
+            /* Everyone must get the same copy */
+            if (Modules[i] && GetModuleHandleW(DllNames[i]) != Modules[i])
+                Failures++;
+            if (Modules[i])
+                FreeLibrary(Modules[i]);
+        }
+    }
+
+    return Failures;
+}
+
+static
+VOID
+TestConcurrentLoads(VOID)
+{
+    HANDLE Threads[LOAD_THREADS];
+    LARGE_INTEGER Frequency, Start, End;
+    DWORD ExitCode;
+    ULONG i, Count = 0;
+
+    StartEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    ok(StartEvent != NULL, "CreateEventW failed: %lu\n", GetLastError());
+    if (!StartEvent)
+        return;
+
+    for (i = 0; i < LOAD_THREADS; i++)
+    {
+        Threads[Count] = CreateThread(NULL, 0, LoadThread, NULL, 0, NULL);
+        ok(Threads[Count] != NULL, "CreateThread failed: %lu\n", GetLastError());
+        if (Threads[Count])
+            Count++;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    SetEvent(StartEvent);
+    WaitForMultipleObjects(Count, Threads, TRUE, INFINITE);
+    QueryPerformanceCounter(&End);
+
+    for (i = 0; i < Count; i++)
+    {
+        GetExitCodeThread(Threads[i], &ExitCode);
+        ok_eq_ulong(ExitCode, 0UL);
+        CloseHandle(Threads[i]);
+    }
+    CloseHandle(StartEvent);
+
+    trace("%lu threads loading and freeing %lu DLLs %lu times: %I64d us\n",
+          Count, (ULONG)_countof(DllNames), (ULONG)LOAD_ROUNDS,
+          (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart);
+}
+
+START_TEST(LoaderStartup)
+{
+    char **argv;
+    int argc;
+
+    argc = winetest_get_mainargs(&argv);
+    if (argc >= 3 && !strcmp(argv[2], "child"))
+    {
+        /* Report back how many loaded, the parent checks it */
+        ExitProcess(LoadAll(NULL));
+    }
+
+    TestStartup(argv[0]);
+    TestConcurrentLoads();
+}
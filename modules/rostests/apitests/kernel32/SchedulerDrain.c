@@ -0,0 +1,106 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Time to drain CPU-bound threads on a growing number of cores
+ */
+
+#include "precomp.h"
+
+#define WORK_ITERATIONS 20000000UL
+#define THREADS_PER_CORE 4
+
+static
+DWORD
+WINAPI
+SpinThread(
+    _In_ PVOID Parameter)
+{
+    volatile ULONG Counter = 0;
+    ULONG i;
+
+    UNREFERENCED_PARAMETER(Parameter);
+
+    for (i = 0; i < WORK_ITERATIONS; i++)
+        Counter++;
+
+    return Counter == WORK_ITERATIONS ? 0 : 1;
+}
+
+static
+ULONGLONG
+DrainThreads(
+    _In_ ULONG Cores,
+    _In_ ULONG ThreadCount)
+{
+    HANDLE Threads[MAXIMUM_WAIT_OBJECTS];
+    LARGE_INTEGER Frequency, Start, End;
+    DWORD_PTR Affinity;
+    DWORD ExitCode;
+    ULONG i;
+
+    /* Restrict ourselves to the first Cores processors */
+    Affinity = (Cores == sizeof(DWORD_PTR) * 8) ? ~(DWORD_PTR)0 : (((DWORD_PTR)1 << Cores) - 1);
+    ok(SetProcessAffinityMask(GetCurrentProcess(), Affinity),
+       "SetProcessAffinityMask(%Ix) failed: %lu\n", Affinity, GetLastError());
+
+    /* Create them all first, so that they are all ready at the same time */
+    for (i = 0; i < ThreadCount; i++)
+    {
+        Threads[i] = CreateThread(NULL, 0, SpinThread, NULL, CREATE_SUSPENDED, NULL);
+        ok(Threads[i] != NULL, "CreateThread failed: %lu\n", GetLastError());
+        if (!Threads[i])
+        {
+            while (i--)
+            {
+                TerminateThread(Threads[i], 0);
+                CloseHandle(Threads[i]);
+            }
+            return 0;
+        }
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+
+    for (i = 0; i < ThreadCount; i++)
+        ResumeThread(Threads[i]);
+
+    ok_eq_ulong(WaitForMultipleObjects(ThreadCount, Threads, TRUE, 5 * 60 * 1000), (DWORD)WAIT_OBJECT_0);
+
+    QueryPerformanceCounter(&End);
+
+    for (i = 0; i < ThreadCount; i++)
+    {
+        ok(GetExitCodeThread(Threads[i], &ExitCode), "GetExitCodeThread failed: %lu\n", GetLastError());
+        ok_eq_ulong(ExitCode, 0UL);
+        CloseHandle(Threads[i]);
+    }
+
+    return (End.QuadPart - Start.QuadPart) * 1000 / Frequency.QuadPart;
+}
+
+START_TEST(SchedulerDrain)
+{
+    SYSTEM_INFO SystemInfo;
+    ULONGLONG BaseTime = 0, Time;
+    DWORD_PTR ProcessAffinity, SystemAffinity;
+    ULONG Cores, ThreadCount;
+
+    GetSystemInfo(&SystemInfo);
+    ok(GetProcessAffinityMask(GetCurrentProcess(), &ProcessAffinity, &SystemAffinity),
+       "GetProcessAffinityMask failed: %lu\n", GetLastError());
+
+    /* Same work per core each round, so perfect scaling keeps the time flat */
+    for (Cores = 1; Cores <= SystemInfo.dwNumberOfProcessors; Cores *= 2)
+    {
+        ThreadCount = min(Cores * THREADS_PER_CORE, MAXIMUM_WAIT_OBJECTS);
+        Time = DrainThreads(Cores, ThreadCount);
+        if (Cores == 1)
+            BaseTime = Time;
+
+        trace("%lu threads on %lu cores drained in %I64u ms (%I64u%% of single core)\n",
+              ThreadCount, Cores, Time, BaseTime ? (Time * 100 / BaseTime) : 0);
+    }
+
+    SetProcessAffinityMask(GetCurrentProcess(), ProcessAffinity);
+}
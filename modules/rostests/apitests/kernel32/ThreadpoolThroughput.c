@@ -0,0 +1,335 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Thread pool callbacks and work item throughput
+ */
+
+#include "precomp.h"
+
+#define WORK_ITEMS 100000
+
+typedef PTP_POOL (WINAPI *FN_CreateThreadpool)(PVOID);
+typedef VOID (WINAPI *FN_CloseThreadpool)(PTP_POOL);
+typedef VOID (WINAPI *FN_SetThreadpoolThreadMaximum)(PTP_POOL, DWORD);
+typedef PTP_CLEANUP_GROUP (WINAPI *FN_CreateThreadpoolCleanupGroup)(VOID);
+typedef VOID (WINAPI *FN_CloseThreadpoolCleanupGroup)(PTP_CLEANUP_GROUP);
+typedef VOID (WINAPI *FN_CloseThreadpoolCleanupGroupMembers)(PTP_CLEANUP_GROUP, BOOL, PVOID);
+typedef BOOL (WINAPI *FN_TrySubmitThreadpoolCallback)(PTP_SIMPLE_CALLBACK, PVOID, PTP_CALLBACK_ENVIRON);
+typedef PTP_WORK (WINAPI *FN_CreateThreadpoolWork)(PTP_WORK_CALLBACK, PVOID, PTP_CALLBACK_ENVIRON);
+typedef VOID (WINAPI *FN_SubmitThreadpoolWork)(PTP_WORK);
+typedef VOID (WINAPI *FN_WaitForThreadpoolWorkCallbacks)(PTP_WORK, BOOL);
+typedef VOID (WINAPI *FN_CloseThreadpoolWork)(PTP_WORK);
+typedef PTP_TIMER (WINAPI *FN_CreateThreadpoolTimer)(PTP_TIMER_CALLBACK, PVOID, PTP_CALLBACK_ENVIRON);
+typedef VOID (WINAPI *FN_SetThreadpoolTimer)(PTP_TIMER, PFILETIME, DWORD, DWORD);
+typedef BOOL (WINAPI *FN_IsThreadpoolTimerSet)(PTP_TIMER);
+typedef VOID (WINAPI *FN_WaitForThreadpoolTimerCallbacks)(PTP_TIMER, BOOL);
+typedef VOID (WINAPI *FN_CloseThreadpoolTimer)(PTP_TIMER);
+typedef PTP_WAIT (WINAPI *FN_CreateThreadpoolWait)(PTP_WAIT_CALLBACK, PVOID, PTP_CALLBACK_ENVIRON);
+typedef VOID (WINAPI *FN_SetThreadpoolWait)(PTP_WAIT, HANDLE, PFILETIME);
+typedef VOID (WINAPI *FN_WaitForThreadpoolWaitCallbacks)(PTP_WAIT, BOOL);
+typedef VOID (WINAPI *FN_CloseThreadpoolWait)(PTP_WAIT);
+
+static FN_CreateThreadpool pCreateThreadpool;
+static FN_CloseThreadpool pCloseThreadpool;
+static FN_SetThreadpoolThreadMaximum pSetThreadpoolThreadMaximum;
+static FN_CreateThreadpoolCleanupGroup pCreateThreadpoolCleanupGroup;
+static FN_CloseThreadpoolCleanupGroup pCloseThreadpoolCleanupGroup;
+static FN_CloseThreadpoolCleanupGroupMembers pCloseThreadpoolCleanupGroupMembers;
+static FN_TrySubmitThreadpoolCallback pTrySubmitThreadpoolCallback;
+static FN_CreateThreadpoolWork pCreateThreadpoolWork;
+static FN_SubmitThreadpoolWork pSubmitThreadpoolWork;
+static FN_WaitForThreadpoolWorkCallbacks pWaitForThreadpoolWorkCallbacks;
+static FN_CloseThreadpoolWork pCloseThreadpoolWork;
+static FN_CreateThreadpoolTimer pCreateThreadpoolTimer;
+static FN_SetThreadpoolTimer pSetThreadpoolTimer;
+static FN_IsThreadpoolTimerSet pIsThreadpoolTimerSet;
+static FN_WaitForThreadpoolTimerCallbacks pWaitForThreadpoolTimerCallbacks;
+static FN_CloseThreadpoolTimer pCloseThreadpoolTimer;
+static FN_CreateThreadpoolWait pCreateThreadpoolWait;
+static FN_SetThreadpoolWait pSetThreadpoolWait;
+static FN_WaitForThreadpoolWaitCallbacks pWaitForThreadpoolWaitCallbacks;
+static FN_CloseThreadpoolWait pCloseThreadpoolWait;
+
+static LONG CallbackCount;
+static HANDLE DoneEvent;
+static HANDLE ReleaseEvent;
+static LONG BlockedTarget;
+static DWORD WaitResultSeen;
+
+static
+VOID
+NTAPI
+CountingWork(
+    _Inout_ PTP_CALLBACK_INSTANCE Instance,
+    _Inout_opt_ PVOID Context,
+    _Inout_ PTP_WORK Work)
+{
+    InterlockedIncrement(&CallbackCount);
+}
+
+static
+DWORD
+WINAPI
+CountingWorkItem(
+    _In_ PVOID Parameter)
+{
+    if (InterlockedIncrement(&CallbackCount) == WORK_ITEMS)
+        SetEvent(DoneEvent);
+    return 0;
+}
+
+static
+VOID
+NTAPI
+BlockingCallback(
+    _Inout_ PTP_CALLBACK_INSTANCE Instance,
+    _Inout_opt_ PVOID Context)
+{
+    /* Only returns once everybody is running at the same time */
+    if (InterlockedIncrement(&CallbackCount) == BlockedTarget)
+        SetEvent(ReleaseEvent);
+    WaitForSingleObject(ReleaseEvent, 30000);
+}
+
+static
+VOID
+NTAPI
+TimerCallback(
+    _Inout_ PTP_CALLBACK_INSTANCE Instance,
+    _Inout_opt_ PVOID Context,
+    _Inout_ PTP_TIMER Timer)
+{
+    InterlockedIncrement(&CallbackCount);
+}
+
+static
+VOID
+NTAPI
+WaitCallback(
+    _Inout_ PTP_CALLBACK_INSTANCE Instance,
+    _Inout_opt_ PVOID Context,
+    _Inout_ PTP_WAIT Wait,
+    _In_ TP_WAIT_RESULT WaitResult)
+{
+    WaitResultSeen = WaitResult;
+    SetEvent(DoneEvent);
+}
+
+static
+VOID
+TestWorkThroughput(VOID)
+{
+    LARGE_INTEGER Frequency, Start, End;
+    LONGLONG PoolTime, WorkItemTime;
+    PTP_WORK Work;
+    ULONG i;
+
+    QueryPerformanceFrequency(&Frequency);
+
+    Work = pCreateThreadpoolWork(CountingWork, NULL, NULL);
+    ok(Work != NULL, "CreateThreadpoolWork failed: %lu\n", GetLastError());
+    if (!Work)
+        return;
+
+    CallbackCount = 0;
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < WORK_ITEMS; i++)
+        pSubmitThreadpoolWork(Work);
+    pWaitForThreadpoolWorkCallbacks(Work, FALSE);
+    QueryPerformanceCounter(&End);
+    PoolTime = (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart;
+
+    ok_eq_long(CallbackCount, (LONG)WORK_ITEMS);
+    pCloseThreadpoolWork(Work);
+
+    /* The same through the old work item API */
+    CallbackCount = 0;
+    ResetEvent(DoneEvent);
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < WORK_ITEMS; i++)
+        QueueUserWorkItem(CountingWorkItem, NULL, WT_EXECUTEDEFAULT);
+    ok_eq_ulong(WaitForSingleObject(DoneEvent, 60000), (DWORD)WAIT_OBJECT_0);
+    QueryPerformanceCounter(&End);
+    WorkItemTime = (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart;
+
+    trace("%lu callbacks: %I64d us thread pool, %I64d us QueueUserWorkItem\n",
+          (ULONG)WORK_ITEMS, PoolTime, WorkItemTime);
+}
+
+static
+VOID
+TestBlockedCallbacks(VOID)
+{
+    SYSTEM_INFO SystemInfo;
+    DWORD StartTime;
+    LONG i;
+
+    /* More blocked callbacks than processors, the pool has to notice and add threads */
+    GetSystemInfo(&SystemInfo);
+    BlockedTarget = SystemInfo.dwNumberOfProcessors + 2;
+    CallbackCount = 0;
+    ResetEvent(ReleaseEvent);
+
+    StartTime = GetTickCount();
+    for (i = 0; i < BlockedTarget; i++)
+    {
+        ok(pTrySubmitThreadpoolCallback(BlockingCallback, NULL, NULL),
+           "TrySubmitThreadpoolCallback failed: %lu\n", GetLastError());
+    }
+
+    ok_eq_ulong(WaitForSingleObject(ReleaseEvent, 30000), (DWORD)WAIT_OBJECT_0);
+    trace("%ld blocking callbacks all running after %lu ms\n", BlockedTarget, GetTickCount() - StartTime);
+}
+
+static
+VOID
+TestTimer(VOID)
+{
+    LARGE_INTEGER DueTime;
+    PTP_TIMER Timer;
+
+    Timer = pCreateThreadpoolTimer(TimerCallback, NULL, NULL);
+    ok(Timer != NULL, "CreateThreadpoolTimer failed: %lu\n", GetLastError());
+    if (!Timer)
+        return;
+
+    ok(!pIsThreadpoolTimerSet(Timer), "Timer set before SetThreadpoolTimer\n");
+
+    /* Every 10 ms, starting in 10 ms */
+    CallbackCount = 0;
+    DueTime.QuadPart = -10 * 10000LL;
+    pSetThreadpoolTimer(Timer, (PFILETIME)&DueTime, 10, 0);
+    ok(pIsThreadpoolTimerSet(Timer), "Timer not set\n");
+
+    Sleep(500);
+    pSetThreadpoolTimer(Timer, NULL, 0, 0);
+    pWaitForThreadpoolTimerCallbacks(Timer, TRUE);
+    ok(!pIsThreadpoolTimerSet(Timer), "Timer still set\n");
+    ok(CallbackCount >= 5, "Only %ld timer callbacks\n", CallbackCount);
+
+    pCloseThreadpoolTimer(Timer);
+}
+
+static
+VOID
+TestWait(VOID)
+{
+    LARGE_INTEGER Timeout;
+    HANDLE Event;
+    PTP_WAIT Wait;
+
+    Event = CreateEventW(NULL, FALSE, FALSE, NULL);
+    Wait = pCreateThreadpoolWait(WaitCallback, NULL, NULL);
+    ok(Wait != NULL, "CreateThreadpoolWait failed: %lu\n", GetLastError());
+    if (!Wait || !Event)
+        return;
+
+    /* Signaled */
+    ResetEvent(DoneEvent);
+    WaitResultSeen = 0xdeadbeef;
+    pSetThreadpoolWait(Wait, Event, NULL);
+    SetEvent(Event);
+    ok_eq_ulong(WaitForSingleObject(DoneEvent, 5000), (DWORD)WAIT_OBJECT_0);
+    pWaitForThreadpoolWaitCallbacks(Wait, FALSE);
+    ok_eq_ulong(WaitResultSeen, (DWORD)WAIT_OBJECT_0);
+
+    /* Timed out */
+    ResetEvent(DoneEvent);
+    WaitResultSeen = 0xdeadbeef;
+    Timeout.QuadPart = -50 * 10000LL;
+    pSetThreadpoolWait(Wait, Event, (PFILETIME)&Timeout);
+    ok_eq_ulong(WaitForSingleObject(DoneEvent, 5000), (DWORD)WAIT_OBJECT_0);
+    pWaitForThreadpoolWaitCallbacks(Wait, FALSE);
+    ok_eq_ulong(WaitResultSeen, (DWORD)WAIT_TIMEOUT);
+
+    pCloseThreadpoolWait(Wait);
+    CloseHandle(Event);
+}
+
+static
+VOID
+TestCleanupGroup(VOID)
+{
+    TP_CALLBACK_ENVIRON Environ;
+    PTP_CLEANUP_GROUP Group;
+    PTP_POOL Pool;
+    PTP_WORK Work;
+    ULONG i;
+
+    Pool = pCreateThreadpool(NULL);
+    Group = pCreateThreadpoolCleanupGroup();
+    ok(Pool && Group, "Pool %p group %p: %lu\n", Pool, Group, GetLastError());
+    if (!Pool || !Group)
+        return;
+
+    pSetThreadpoolThreadMaximum(Pool, 1);
+
+    ZeroMemory(&Environ, sizeof(Environ));
+    Environ.Version = 1;
+    Environ.Pool = Pool;
+    Environ.CleanupGroup = Group;
+
+    Work = pCreateThreadpoolWork(CountingWork, NULL, &Environ);
+    ok(Work != NULL, "CreateThreadpoolWork failed: %lu\n", GetLastError());
+    if (Work)
+    {
+        /* Closing the members waits for all of them, and closes the work for us */
+        CallbackCount = 0;
+        for (i = 0; i < 100; i++)
+            pSubmitThreadpoolWork(Work);
+        pCloseThreadpoolCleanupGroupMembers(Group, FALSE, NULL);
+        ok_eq_long(CallbackCount, 100L);
+    }
+
+    pCloseThreadpoolCleanupGroup(Group);
+    pCloseThreadpool(Pool);
+}
+
+START_TEST(ThreadpoolThroughput)
+{
+    HMODULE Kernel32 = GetModuleHandleW(L"kernel32.dll");
+
+#define GET_PROC(Name) p##Name = (FN_##Name)GetProcAddress(Kernel32, #Name)
+    GET_PROC(CreateThreadpool);
+    GET_PROC(CloseThreadpool);
+    GET_PROC(SetThreadpoolThreadMaximum);
+    GET_PROC(CreateThreadpoolCleanupGroup);
+    GET_PROC(CloseThreadpoolCleanupGroup);
+    GET_PROC(CloseThreadpoolCleanupGroupMembers);
+    GET_PROC(TrySubmitThreadpoolCallback);
+    GET_PROC(CreateThreadpoolWork);
+    GET_PROC(SubmitThreadpoolWork);
+    GET_PROC(WaitForThreadpoolWorkCallbacks);
+    GET_PROC(CloseThreadpoolWork);
+    GET_PROC(CreateThreadpoolTimer);
+    GET_PROC(SetThreadpoolTimer);
+    GET_PROC(IsThreadpoolTimerSet);
+    GET_PROC(WaitForThreadpoolTimerCallbacks);
+    GET_PROC(CloseThreadpoolTimer);
+    GET_PROC(CreateThreadpoolWait);
+    GET_PROC(SetThreadpoolWait);
+    GET_PROC(WaitForThreadpoolWaitCallbacks);
+    GET_PROC(CloseThreadpoolWait);
+#undef GET_PROC
+
+    if (!pCreateThreadpoolWork || !pCloseThreadpoolWait)
+    {
+        skip("Thread pool API not available\n");
+        return;
+    }
+
+    DoneEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    ReleaseEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    ok(DoneEvent && ReleaseEvent, "CreateEventW failed: %lu\n", GetLastError());
+    if (!DoneEvent || !ReleaseEvent)
+        return;
+
+    TestWorkThroughput();
+    TestBlockedCallbacks();
+    TestTimer();
+    TestWait();
+    TestCleanupGroup();
+
+    CloseHandle(ReleaseEvent);
+    CloseHandle(DoneEvent);
+}
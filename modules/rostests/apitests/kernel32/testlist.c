@@ -5,9 +5,12 @@
 
 extern void func_ActCtxWithXmlNamespaces(void);
 extern void func_ConsoleCP(void);
+extern void func_CopyFileThroughput(void);
 extern void func_CreateProcess(void);
 extern void func_DefaultActCtx(void);
 extern void func_DeviceIoControl(void);
+extern void func_DirectoryTraversal(void);
+extern void func_DiskIops(void);
 extern void func_dosdev(void);
 extern void func_FindActCtxSectionStringW(void);
 extern void func_FindFiles(void);
@@ -18,23 +21,30 @@ extern void func_GetCurrentDirectory(void);
 extern void func_GetDriveType(void);
 extern void func_GetModuleFileName(void);
 extern void func_GetVolumeInformation(void);
+extern void func_HeapThroughput(void);
+extern void func_ImageFaultAround(void);
+extern void func_ImportSnapping(void);
 extern void func_InitOnce(void);
+extern void func_IoCompletionBatch(void);
 extern void func_interlck(void);
 extern void func_IsDBCSLeadByteEx(void);
 extern void func_JapaneseCalendar(void);
 extern void func_LoadLibraryExW(void);
+extern void func_LoaderStartup(void);
 extern void func_lstrcpynW(void);
 extern void func_lstrlen(void);
 extern void func_Mailslot(void);
 extern void func_MultiByteToWideChar(void);
 extern void func_PrivMoveFileIdentityW(void);
 extern void func_QueueUserAPC(void);
+extern void func_SchedulerDrain(void);
 extern void func_SetComputerNameExW(void);
 extern void func_SetConsoleWindowInfo(void);
 extern void func_SetCurrentDirectory(void);
 extern void func_SetUnhandledExceptionFilter(void);
 extern void func_SystemFirmware(void);
 extern void func_TerminateProcess(void);
+extern void func_ThreadpoolThroughput(void);
 extern void func_TunnelCache(void);
 extern void func_UEFIFirmware(void);
 extern void func_WideCharToMultiByte(void);
@@ -42,9 +52,12 @@ extern void func_WideCharToMultiByte(void);
 const struct test winetest_testlist[] =
 {
     { "ConsoleCP",                   func_ConsoleCP },
+    { "CopyFileThroughput",          func_CopyFileThroughput },
     { "CreateProcess",               func_CreateProcess },
     { "DefaultActCtx",               func_DefaultActCtx },
     { "DeviceIoControl",             func_DeviceIoControl },
+    { "DirectoryTraversal",          func_DirectoryTraversal },
+    { "DiskIops",                    func_DiskIops },
     { "dosdev",                      func_dosdev },
     { "FindActCtxSectionStringW",    func_FindActCtxSectionStringW },
     { "FindFiles",                   func_FindFiles },
@@ -55,23 +68,30 @@ const struct test winetest_testlist[] =
     { "GetDriveType",                func_GetDriveType },
     { "GetModuleFileName",           func_GetModuleFileName },
     { "GetVolumeInformation",        func_GetVolumeInformation },
+    { "HeapThroughput",              func_HeapThroughput },
+    { "ImageFaultAround",            func_ImageFaultAround },
+    { "ImportSnapping",              func_ImportSnapping },
     { "InitOnce",                    func_InitOnce },
+    { "IoCompletionBatch",           func_IoCompletionBatch },
     { "interlck",                    func_interlck },
     { "IsDBCSLeadByteEx",            func_IsDBCSLeadByteEx },
     { "JapaneseCalendar",            func_JapaneseCalendar },
     { "LoadLibraryExW",              func_LoadLibraryExW },
+    { "LoaderStartup",               func_LoaderStartup },
     { "lstrcpynW",                   func_lstrcpynW },
     { "lstrlen",                     func_lstrlen },
     { "MailslotRead",                func_Mailslot },
     { "MultiByteToWideChar",         func_MultiByteToWideChar },
     { "PrivMoveFileIdentityW",       func_PrivMoveFileIdentityW },
     { "QueueUserAPC",                func_QueueUserAPC },
+    { "SchedulerDrain",              func_SchedulerDrain },
     { "SetComputerNameExW",          func_SetComputerNameExW },
     { "SetConsoleWindowInfo",        func_SetConsoleWindowInfo },
     { "SetCurrentDirectory",         func_SetCurrentDirectory },
     { "SetUnhandledExceptionFilter", func_SetUnhandledExceptionFilter },
     { "SystemFirmware",              func_SystemFirmware },
     { "TerminateProcess",            func_TerminateProcess },
+    { "ThreadpoolThroughput",        func_ThreadpoolThroughput },
     { "TunnelCache",                 func_TunnelCache },
     { "UEFIFirmware",                func_UEFIFirmware },
     { "WideCharToMultiByte",         func_WideCharToMultiByte },
@@ -0,0 +1,241 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Bulk TCP throughput with small and large buffers through msafd
+ */
+
+#include "ws2_32.h"
+
+#define TRANSFER_SIZE (32 * 1024 * 1024)
+#define RECEIVE_DEPTH 4
+
+typedef struct _TRANSFER
+{
+    SOCKET Client;
+    SOCKET Server;
+    ULONG ChunkSize;
+    ULONG Depth;
+    ULONG Received;
+    BOOL Corrupt;
+} TRANSFER, *PTRANSFER;
+
+static HANDLE StartEvent;
+
+static
+DWORD
+WINAPI
+SendThread(
+    _In_ LPVOID Parameter)
+{
+    PTRANSFER Transfer = Parameter;
+
+    return SendStream(Transfer->Client, TRANSFER_SIZE, Transfer->ChunkSize, StartEvent) ==
+           TRANSFER_SIZE ? 0 : 1;
+}
+
+static
+DWORD
+WINAPI
+ReceiveThread(
+    _In_ LPVOID Parameter)
+{
+    PTRANSFER Transfer = Parameter;
+    WSAOVERLAPPED Overlapped[RECEIVE_DEPTH];
+    WSABUF Buffers[RECEIVE_DEPTH];
+    BOOL Pending[RECEIVE_DEPTH];
+    PUCHAR Memory;
+    DWORD Length, Flags;
+    ULONG i;
+    DWORD Result = 1;
+
+    Memory = HeapAlloc(GetProcessHeap(), 0, Transfer->Depth * Transfer->ChunkSize);
+    if (!Memory)
+        return 1;
+
+    ZeroMemory(Overlapped, sizeof(Overlapped));
+    for (i = 0; i < Transfer->Depth; i++)
+    {
+        Buffers[i].buf = (PCHAR)Memory + i * Transfer->ChunkSize;
+        Buffers[i].len = Transfer->ChunkSize;
+        Overlapped[i].hEvent = WSACreateEvent();
+        Pending[i] = FALSE;
+    }
+
+    WaitForSingleObject(StartEvent, INFINITE);
+
+    /* Keep receives posted ahead of the data, they complete in order */
+    for (i = 0; i < Transfer->Depth; i++)
+    {
+        Flags = 0;
+        if (WSARecv(Transfer->Server, &Buffers[i], 1, NULL, &Flags, &Overlapped[i], NULL) &&
+            WSAGetLastError() != WSA_IO_PENDING)
+        {
+            break;
+        }
+        Pending[i] = TRUE;
+    }
+
+    i = 0;
+    while (Pending[i])
+    {
+        Pending[i] = FALSE;
+        if (!WSAGetOverlappedResult(Transfer->Server, &Overlapped[i], &Length, TRUE, &Flags))
+            break;
+
+        /* Graceful closure, everything got here */
+        if (Length == 0)
+        {
+            Result = 0;
+            break;
+        }
+
+        if (!CheckStream((PUCHAR)Buffers[i].buf, Length, Transfer->Received))
+            Transfer->Corrupt = TRUE;
+        Transfer->Received += Length;
+
+        Flags = 0;
+        if (WSARecv(Transfer->Server, &Buffers[i], 1, NULL, &Flags, &Overlapped[i], NULL) &&
+            WSAGetLastError() != WSA_IO_PENDING)
+        {
+            break;
+        }
+        Pending[i] = TRUE;
+
+        i = (i + 1) % Transfer->Depth;
+    }
+
+    /* The buffers can't go while receives still use them */
+    CancelIo((HANDLE)Transfer->Server);
+    for (i = 0; i < Transfer->Depth; i++)
+    {
+        if (Pending[i])
+            WSAGetOverlappedResult(Transfer->Server, &Overlapped[i], &Length, TRUE, &Flags);
+        WSACloseEvent(Overlapped[i].hEvent);
+    }
+
+    HeapFree(GetProcessHeap(), 0, Memory);
+    return Result;
+}
+
+static
+BOOL
+OpenTransfer(
+    _Out_ PTRANSFER Transfer)
+{
+    SOCKET Listener;
+    struct sockaddr_in Address;
+    BOOL Connected;
+
+    Transfer->Client = Transfer->Server = INVALID_SOCKET;
+
+    Listener = CreateLoopbackListener(&Address);
+    if (Listener == INVALID_SOCKET)
+        return FALSE;
+
+    Connected = ConnectLoopback(Listener, &Address, &Transfer->Client, &Transfer->Server);
+    ok(Connected, "Connecting failed: %d\n", WSAGetLastError());
+
+    closesocket(Listener);
+    return Connected;
+}
+
+static
+VOID
+TestThroughput(
+    _In_ ULONG ChunkSize,
+    _In_ ULONG Depth)
+{
+    TRANSFER Transfer;
+    HANDLE Threads[2];
+    LARGE_INTEGER Frequency, Start, End;
+    LONGLONG Time;
+    DWORD ExitCode;
+    ULONG i;
+
+    ZeroMemory(&Transfer, sizeof(Transfer));
+    Transfer.ChunkSize = ChunkSize;
+    Transfer.Depth = Depth;
+
+    if (!OpenTransfer(&Transfer))
+    {
+        if (Transfer.Client != INVALID_SOCKET)
+            closesocket(Transfer.Client);
+        return;
+    }
+
+    ResetEvent(StartEvent);
+    Threads[0] = CreateThread(NULL, 0, SendThread, &Transfer, 0, NULL);
+    Threads[1] = CreateThread(NULL, 0, ReceiveThread, &Transfer, 0, NULL);
+    ok(Threads[0] && Threads[1], "CreateThread failed: %lu\n", GetLastError());
+    if (!Threads[0] || !Threads[1])
+    {
+        /* Let whatever started fail on the closed sockets */
+        closesocket(Transfer.Client);
+        closesocket(Transfer.Server);
+        SetEvent(StartEvent);
+        for (i = 0; i < 2; i++)
+        {
+            if (Threads[i])
+            {
+                WaitForSingleObject(Threads[i], INFINITE);
+                CloseHandle(Threads[i]);
+            }
+        }
+        return;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    SetEvent(StartEvent);
+    WaitForMultipleObjects(2, Threads, TRUE, INFINITE);
+    QueryPerformanceCounter(&End);
+
+    for (i = 0; i < 2; i++)
+    {
+        GetExitCodeThread(Threads[i], &ExitCode);
+        ok(ExitCode == 0, "%s thread failed for %lu byte buffers\n",
+           i ? "Receive" : "Send", ChunkSize);
+        CloseHandle(Threads[i]);
+    }
+    ok(Transfer.Received == TRANSFER_SIZE, "Received %lu bytes\n", Transfer.Received);
+    ok(!Transfer.Corrupt, "Received corrupt data with %lu byte buffers\n", ChunkSize);
+
+    Time = (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart;
+    if (Time)
+    {
+        trace("%lu byte buffers, %lu receives posted: %I64d MB/s\n", ChunkSize, Depth,
+              (LONGLONG)TRANSFER_SIZE / Time * 1000000 / (1024 * 1024));
+    }
+
+    closesocket(Transfer.Client);
+    closesocket(Transfer.Server);
+}
+
+START_TEST(bulk)
+{
+    WSADATA WsaData;
+
+    if (WSAStartup(MAKEWORD(2, 2), &WsaData) != 0)
+    {
+        skip("WSAStartup failed\n");
+        return;
+    }
+
+    StartEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    ok(StartEvent != NULL, "CreateEventW failed: %lu\n", GetLastError());
+    if (!StartEvent)
+    {
+        WSACleanup();
+        return;
+    }
+
+    /* Small buffers go through the socket's own buffers */
+    TestThroughput(8 * 1024, 1);
+
+    /* Large sends and receives posted ahead of the data avoid that copy */
+    TestThroughput(256 * 1024, 1);
+    TestThroughput(256 * 1024, RECEIVE_DEPTH);
+
+    CloseHandle(StartEvent);
+    WSACleanup();
+}
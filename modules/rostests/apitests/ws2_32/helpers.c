@@ -63,3 +63,105 @@ int GetRequestAndWait(SOCKET sck)
 
     return 1;
 }
+
+/* A TCP listener on a free loopback port, Address receives where it is */
+SOCKET
+CreateLoopbackListener(
+    _Out_ struct sockaddr_in *Address)
+{
+    SOCKET Listener;
+    int AddressLength = sizeof(*Address);
+
+    Listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    ok(Listener != INVALID_SOCKET, "socket failed: %d\n", WSAGetLastError());
+    if (Listener == INVALID_SOCKET)
+        return INVALID_SOCKET;
+
+    ZeroMemory(Address, sizeof(*Address));
+    Address->sin_family = AF_INET;
+    Address->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(Listener, (struct sockaddr *)Address, sizeof(*Address)) ||
+        getsockname(Listener, (struct sockaddr *)Address, &AddressLength) ||
+        listen(Listener, SOMAXCONN))
+    {
+        ok(FALSE, "Setting up the listener failed: %d\n", WSAGetLastError());
+        closesocket(Listener);
+        return INVALID_SOCKET;
+    }
+
+    return Listener;
+}
+
+/* Whatever got created is returned even on failure, the caller closes it */
+BOOL
+ConnectLoopback(
+    _In_ SOCKET Listener,
+    _In_ const struct sockaddr_in *Address,
+    _Out_ SOCKET *Client,
+    _Out_ SOCKET *Server)
+{
+    *Server = INVALID_SOCKET;
+    *Client = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (*Client == INVALID_SOCKET ||
+        connect(*Client, (const struct sockaddr *)Address, sizeof(*Address)))
+    {
+        return FALSE;
+    }
+
+    *Server = accept(Listener, NULL, NULL);
+    return *Server != INVALID_SOCKET;
+}
+
+/* Every byte holds its stream offset, lost or reordered data shows up.
+ * Starting at the right place in a 256 byte longer buffer spares filling
+ * it for each send. Returns the number of bytes sent. */
+ULONG
+SendStream(
+    _In_ SOCKET Socket,
+    _In_ ULONG Length,
+    _In_ ULONG ChunkSize,
+    _In_opt_ HANDLE StartEvent)
+{
+    PUCHAR Buffer;
+    ULONG Sent = 0, i;
+    int Result;
+
+    Buffer = HeapAlloc(GetProcessHeap(), 0, ChunkSize + 256);
+    if (!Buffer)
+        return 0;
+    for (i = 0; i < ChunkSize + 256; i++)
+        Buffer[i] = (UCHAR)i;
+
+    if (StartEvent)
+        WaitForSingleObject(StartEvent, INFINITE);
+
+    while (Sent < Length)
+    {
+        Result = send(Socket, (PCHAR)Buffer + (Sent & 0xFF), min(ChunkSize, Length - Sent), 0);
+        if (Result <= 0)
+            break;
+        Sent += Result;
+    }
+
+    shutdown(Socket, SD_SEND);
+    HeapFree(GetProcessHeap(), 0, Buffer);
+    return Sent;
+}
+
+/* Checks data that SendStream sent, Offset is where it is in the stream */
+BOOL
+CheckStream(
+    _In_reads_(Length) const UCHAR *Buffer,
+    _In_ ULONG Length,
+    _In_ ULONG Offset)
+{
+    ULONG i;
+
+    for (i = 0; i < Length; i++)
+    {
+        if (Buffer[i] != (UCHAR)(Offset + i))
+            return FALSE;
+    }
+
+    return TRUE;
+}
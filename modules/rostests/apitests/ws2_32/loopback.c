@@ -0,0 +1,206 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     TCP throughput over loopback with many connections at once
+ */
+
+#include "ws2_32.h"
+
+#define CONNECTIONS_PER_THREAD 4
+#define MAX_THREADS 16
+#define BYTES_PER_CONNECTION (4 * 1024 * 1024)
+#define CHUNK_SIZE (64 * 1024)
+
+typedef struct _CONNECTION
+{
+    SOCKET Client;
+    SOCKET Server;
+    ULONG Received;
+    BOOL Corrupt;
+} CONNECTION, *PCONNECTION;
+
+static HANDLE StartEvent;
+
+static
+DWORD
+WINAPI
+SendThread(
+    _In_ LPVOID Parameter)
+{
+    PCONNECTION Connection = Parameter;
+
+    return SendStream(Connection->Client, BYTES_PER_CONNECTION, CHUNK_SIZE, StartEvent) ==
+           BYTES_PER_CONNECTION ? 0 : 1;
+}
+
+static
+DWORD
+WINAPI
+ReceiveThread(
+    _In_ LPVOID Parameter)
+{
+    PCONNECTION Connection = Parameter;
+    PUCHAR Buffer;
+    int Length;
+
+    Buffer = HeapAlloc(GetProcessHeap(), 0, CHUNK_SIZE);
+    if (!Buffer)
+        return 1;
+
+    WaitForSingleObject(StartEvent, INFINITE);
+
+    while ((Length = recv(Connection->Server, (PCHAR)Buffer, CHUNK_SIZE, 0)) > 0)
+    {
+        if (!CheckStream(Buffer, Length, Connection->Received))
+            Connection->Corrupt = TRUE;
+        Connection->Received += Length;
+    }
+
+    HeapFree(GetProcessHeap(), 0, Buffer);
+    return Length == 0 ? 0 : 1;
+}
+
+static
+BOOL
+OpenConnections(
+    _Out_writes_(Count) PCONNECTION Connections,
+    _In_ ULONG Count)
+{
+    SOCKET Listener;
+    struct sockaddr_in Address;
+    ULONG i;
+
+    ZeroMemory(Connections, Count * sizeof(*Connections));
+    for (i = 0; i < Count; i++)
+        Connections[i].Client = Connections[i].Server = INVALID_SOCKET;
+
+    Listener = CreateLoopbackListener(&Address);
+    if (Listener == INVALID_SOCKET)
+        return FALSE;
+
+    for (i = 0; i < Count; i++)
+    {
+        if (!ConnectLoopback(Listener, &Address, &Connections[i].Client, &Connections[i].Server))
+            break;
+    }
+    ok(i == Count, "Connection %lu failed: %d\n", i, WSAGetLastError());
+
+    closesocket(Listener);
+    return i == Count;
+}
+
+static
+VOID
+CloseConnections(
+    _In_reads_(Count) PCONNECTION Connections,
+    _In_ ULONG Count)
+{
+    ULONG i;
+
+    for (i = 0; i < Count; i++)
+    {
+        if (Connections[i].Client != INVALID_SOCKET)
+            closesocket(Connections[i].Client);
+        if (Connections[i].Server != INVALID_SOCKET)
+            closesocket(Connections[i].Server);
+    }
+}
+
+static
+VOID
+TestThroughput(
+    _In_ ULONG ThreadCount)
+{
+    CONNECTION Connections[MAX_THREADS * CONNECTIONS_PER_THREAD];
+    HANDLE Threads[2 * MAX_THREADS * CONNECTIONS_PER_THREAD];
+    ULONG Count = ThreadCount * CONNECTIONS_PER_THREAD;
+    ULONG i, Started = 0, Failed = 0, Corrupt = 0;
+    LARGE_INTEGER Frequency, Start, End;
+    LONGLONG Time;
+    DWORD ExitCode;
+
+    if (!OpenConnections(Connections, Count))
+    {
+        CloseConnections(Connections, Count);
+        return;
+    }
+
+    ResetEvent(StartEvent);
+    for (i = 0; i < Count; i++)
+    {
+        Threads[Started] = CreateThread(NULL, 0, SendThread, &Connections[i], 0, NULL);
+        if (Threads[Started])
+            Started++;
+        Threads[Started] = CreateThread(NULL, 0, ReceiveThread, &Connections[i], 0, NULL);
+        if (Threads[Started])
+            Started++;
+    }
+    ok(Started == 2 * Count, "Only %lu of %lu threads started\n", Started, 2 * Count);
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    SetEvent(StartEvent);
+
+    /* WaitForMultipleObjects can't take more than MAXIMUM_WAIT_OBJECTS */
+    for (i = 0; i < Started; i++)
+    {
+        WaitForSingleObject(Threads[i], INFINITE);
+        GetExitCodeThread(Threads[i], &ExitCode);
+        if (ExitCode)
+            Failed++;
+        CloseHandle(Threads[i]);
+    }
+    QueryPerformanceCounter(&End);
+
+    for (i = 0; i < Count; i++)
+    {
+        ok(Connections[i].Received == BYTES_PER_CONNECTION,
+           "Connection %lu received %lu bytes\n", i, Connections[i].Received);
+        if (Connections[i].Corrupt)
+            Corrupt++;
+    }
+    ok(Failed == 0, "%lu threads failed\n", Failed);
+    ok(Corrupt == 0, "%lu connections received corrupt data\n", Corrupt);
+
+    Time = (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart;
+    if (Time)
+    {
+        trace("%lu connections on %lu threads: %I64d MB/s\n", Count, ThreadCount,
+              (LONGLONG)Count * BYTES_PER_CONNECTION / Time * 1000000 / (1024 * 1024));
+    }
+
+    CloseConnections(Connections, Count);
+}
+
+START_TEST(loopback)
+{
+    WSADATA WsaData;
+    SYSTEM_INFO SystemInfo;
+    ULONG ThreadCount;
+
+    if (WSAStartup(MAKEWORD(2, 2), &WsaData) != 0)
+    {
+        skip("WSAStartup failed\n");
+        return;
+    }
+
+    StartEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    ok(StartEvent != NULL, "CreateEventW failed: %lu\n", GetLastError());
+    if (!StartEvent)
+    {
+        WSACleanup();
+        return;
+    }
+
+    /* Throughput should grow with the thread count, up to the processor count */
+    GetSystemInfo(&SystemInfo);
+    for (ThreadCount = 1; ThreadCount <= MAX_THREADS; ThreadCount *= 2)
+    {
+        TestThroughput(ThreadCount);
+        if (ThreadCount >= SystemInfo.dwNumberOfProcessors)
+            break;
+    }
+
+    CloseHandle(StartEvent);
+    WSACleanup();
+}
@@ -0,0 +1,283 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     select and WSAPoll on many mostly idle sockets
+ */
+
+#include "ws2_32.h"
+
+#define CONNECTIONS 256
+#define ROUNDS 200
+
+/* Bigger than FD_SETSIZE, which select itself doesn't care about */
+typedef struct _BIG_FD_SET
+{
+    u_int fd_count;
+    SOCKET fd_array[CONNECTIONS];
+} BIG_FD_SET, *PBIG_FD_SET;
+
+typedef struct _POLL_FD
+{
+    SOCKET fd;
+    SHORT events;
+    SHORT revents;
+} POLL_FD, *PPOLL_FD;
+
+#define POLL_RDNORM 0x0100
+#define POLL_RDBAND 0x0200
+#define POLL_WRNORM 0x0010
+#define POLL_ERR    0x0001
+#define POLL_HUP    0x0002
+#define POLL_NVAL   0x0004
+
+typedef int (WSAAPI *PWSAPOLL)(PPOLL_FD, ULONG, INT);
+
+static SOCKET Clients[CONNECTIONS];
+static SOCKET Servers[CONNECTIONS];
+static SOCKET Listener = INVALID_SOCKET;
+static struct sockaddr_in ListenAddress;
+
+static
+BOOL
+OpenConnection(
+    _In_ ULONG Index)
+{
+    return ConnectLoopback(Listener, &ListenAddress, &Clients[Index], &Servers[Index]);
+}
+
+static
+BOOL
+OpenConnections(VOID)
+{
+    ULONG i;
+
+    for (i = 0; i < CONNECTIONS; i++)
+        Clients[i] = Servers[i] = INVALID_SOCKET;
+
+    Listener = CreateLoopbackListener(&ListenAddress);
+    if (Listener == INVALID_SOCKET)
+        return FALSE;
+
+    for (i = 0; i < CONNECTIONS; i++)
+    {
+        if (!OpenConnection(i))
+            break;
+    }
+    ok(i == CONNECTIONS, "Connection %lu failed: %d\n", i, WSAGetLastError());
+
+    return i == CONNECTIONS;
+}
+
+static
+VOID
+CloseConnections(VOID)
+{
+    ULONG i;
+
+    for (i = 0; i < CONNECTIONS; i++)
+    {
+        if (Clients[i] != INVALID_SOCKET)
+            closesocket(Clients[i]);
+        if (Servers[i] != INVALID_SOCKET)
+            closesocket(Servers[i]);
+    }
+
+    if (Listener != INVALID_SOCKET)
+        closesocket(Listener);
+}
+
+/* Make one connection readable, select on all of them, and drain it again */
+static
+BOOL
+SelectOne(
+    _In_ ULONG Index)
+{
+    BIG_FD_SET ReadSet;
+    struct timeval Timeout = { 5, 0 };
+    CHAR Byte = 'x';
+    ULONG i;
+    int Ready;
+
+    if (send(Clients[Index], &Byte, 1, 0) != 1)
+        return FALSE;
+
+    ReadSet.fd_count = CONNECTIONS;
+    for (i = 0; i < CONNECTIONS; i++)
+        ReadSet.fd_array[i] = Servers[i];
+
+    Ready = select(0, (fd_set *)&ReadSet, NULL, NULL, &Timeout);
+    ok(Ready == 1, "select returned %d for connection %lu: %d\n", Ready, Index, WSAGetLastError());
+    ok(ReadSet.fd_count == 1 && ReadSet.fd_array[0] == Servers[Index],
+       "Connection %lu: %u sockets ready, the first is %Iu\n",
+       Index, ReadSet.fd_count, ReadSet.fd_count ? ReadSet.fd_array[0] : 0);
+
+    return recv(Servers[Index], &Byte, 1, 0) == 1 && Ready == 1;
+}
+
+static
+VOID
+TestSelect(VOID)
+{
+    BIG_FD_SET ReadSet;
+    struct timeval Timeout = { 0, 0 };
+    LARGE_INTEGER Frequency, Start, End;
+    ULONG i, Round;
+    int Ready;
+
+    /* Nothing to read anywhere */
+    ReadSet.fd_count = CONNECTIONS;
+    for (i = 0; i < CONNECTIONS; i++)
+        ReadSet.fd_array[i] = Servers[i];
+    Ready = select(0, (fd_set *)&ReadSet, NULL, NULL, &Timeout);
+    ok(Ready == 0, "select returned %d: %d\n", Ready, WSAGetLastError());
+    ok(ReadSet.fd_count == 0, "%u sockets ready\n", ReadSet.fd_count);
+
+    /* The same set over and over, the usual event loop */
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    for (Round = 0; Round < ROUNDS; Round++)
+    {
+        if (!SelectOne((Round * 7) % CONNECTIONS))
+            break;
+    }
+    QueryPerformanceCounter(&End);
+    ok(Round == ROUNDS, "Round %lu failed\n", Round);
+
+    if (Round)
+    {
+        trace("select on %lu sockets with one ready: %I64d us\n", (ULONG)CONNECTIONS,
+              (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart / Round);
+    }
+
+    /* A closed socket's handle may come back for another one, which must
+     * still be seen */
+    closesocket(Clients[0]);
+    closesocket(Servers[0]);
+    Clients[0] = Servers[0] = INVALID_SOCKET;
+    ok(OpenConnection(0), "Reconnecting failed: %d\n", WSAGetLastError());
+    if (Servers[0] != INVALID_SOCKET)
+        SelectOne(0);
+}
+
+static
+DWORD
+WINAPI
+SendLaterThread(
+    _In_ PVOID Context)
+{
+    CHAR Byte = 'x';
+
+    UNREFERENCED_PARAMETER(Context);
+
+    /* First to the socket that is only watched for hangups */
+    Sleep(100);
+    send(Clients[3], &Byte, 1, 0);
+    Sleep(100);
+    send(Clients[4], &Byte, 1, 0);
+    return 0;
+}
+
+static
+VOID
+TestPoll(VOID)
+{
+    PWSAPOLL pWSAPoll;
+    POLL_FD PollFds[CONNECTIONS + 1];
+    CHAR Byte = 'x';
+    HANDLE Thread;
+    ULONG i;
+    int Ready;
+
+    pWSAPoll = (PWSAPOLL)GetProcAddress(GetModuleHandleA("ws2_32.dll"), "WSAPoll");
+    if (!pWSAPoll)
+    {
+        skip("WSAPoll is not available\n");
+        return;
+    }
+
+    for (i = 0; i < CONNECTIONS; i++)
+    {
+        PollFds[i].fd = Servers[i];
+        PollFds[i].events = POLL_RDNORM;
+    }
+
+    Ready = pWSAPoll(PollFds, CONNECTIONS, 0);
+    ok(Ready == 0, "WSAPoll returned %d: %d\n", Ready, WSAGetLastError());
+
+    if (send(Clients[CONNECTIONS - 1], &Byte, 1, 0) != 1)
+        return;
+
+    Ready = pWSAPoll(PollFds, CONNECTIONS, 5000);
+    ok(Ready == 1, "WSAPoll returned %d: %d\n", Ready, WSAGetLastError());
+    ok(PollFds[CONNECTIONS - 1].revents == POLL_RDNORM, "revents %x\n", PollFds[CONNECTIONS - 1].revents);
+    ok(PollFds[0].revents == 0, "revents %x\n", PollFds[0].revents);
+    recv(Servers[CONNECTIONS - 1], &Byte, 1, 0);
+
+    /* Out-of-band data is its own band, not an error */
+    if (send(Clients[1], &Byte, 1, MSG_OOB) == 1)
+    {
+        PollFds[1].events = POLL_RDBAND;
+        Ready = pWSAPoll(&PollFds[1], 1, 5000);
+        ok(Ready == 1, "WSAPoll returned %d: %d\n", Ready, WSAGetLastError());
+        ok(PollFds[1].revents == POLL_RDBAND, "revents %x\n", PollFds[1].revents);
+        recv(Servers[1], &Byte, 1, MSG_OOB);
+        PollFds[1].events = POLL_RDNORM;
+    }
+
+    /* A peer that went away is a hangup, even when only writing was asked for */
+    closesocket(Clients[2]);
+    Clients[2] = INVALID_SOCKET;
+    PollFds[2].events = POLL_WRNORM;
+    Ready = pWSAPoll(&PollFds[2], 1, 5000);
+    ok(Ready == 1, "WSAPoll returned %d: %d\n", Ready, WSAGetLastError());
+    ok(PollFds[2].revents & POLL_HUP, "revents %x\n", PollFds[2].revents);
+    ok(!(PollFds[2].revents & POLL_ERR), "revents %x\n", PollFds[2].revents);
+
+    /* It would stay ready, leave it out from now on */
+    PollFds[2].fd = INVALID_SOCKET;
+
+    /* Data for a socket that isn't read from doesn't end the wait */
+    PollFds[3].events = 0;
+    PollFds[4].events = POLL_RDNORM;
+    Thread = CreateThread(NULL, 0, SendLaterThread, NULL, 0, NULL);
+    ok(Thread != NULL, "CreateThread failed: %lu\n", GetLastError());
+    if (Thread)
+    {
+        Ready = pWSAPoll(&PollFds[3], 2, -1);
+        ok(Ready == 1, "WSAPoll returned %d: %d\n", Ready, WSAGetLastError());
+        ok(PollFds[3].revents == 0, "revents %x\n", PollFds[3].revents);
+        ok(PollFds[4].revents == POLL_RDNORM, "revents %x\n", PollFds[4].revents);
+        WaitForSingleObject(Thread, INFINITE);
+        CloseHandle(Thread);
+        recv(Servers[3], &Byte, 1, 0);
+        recv(Servers[4], &Byte, 1, 0);
+    }
+    PollFds[3].events = POLL_RDNORM;
+
+    /* Something that isn't a socket is reported at once */
+    PollFds[CONNECTIONS].fd = (SOCKET)0xdead0;
+    PollFds[CONNECTIONS].events = POLL_RDNORM;
+    Ready = pWSAPoll(PollFds, CONNECTIONS + 1, 5000);
+    ok(Ready == 1, "WSAPoll returned %d: %d\n", Ready, WSAGetLastError());
+    ok(PollFds[CONNECTIONS].revents == POLL_NVAL, "revents %x\n", PollFds[CONNECTIONS].revents);
+}
+
+START_TEST(select)
+{
+    WSADATA WsaData;
+
+    if (WSAStartup(MAKEWORD(2, 2), &WsaData) != 0)
+    {
+        skip("WSAStartup failed\n");
+        return;
+    }
+
+    if (OpenConnections())
+    {
+        TestSelect();
+        TestPoll();
+    }
+
+    CloseConnections();
+    WSACleanup();
+}
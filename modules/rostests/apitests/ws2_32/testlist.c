@@ -4,6 +4,7 @@
 #include <apitest.h>
 
 extern void func_bind(void);
+extern void func_bulk(void);
 extern void func_close(void);
 extern void func_getaddrinfo(void);
 extern void func_gethostname(void);
@@ -11,10 +12,12 @@ extern void func_getnameinfo(void);
 extern void func_getservbyname(void);
 extern void func_getservbyport(void);
 extern void func_ioctlsocket(void);
+extern void func_loopback(void);
 extern void func_nonblocking(void);
 extern void func_nostartup(void);
 extern void func_open_osfhandle(void);
 extern void func_recv(void);
+extern void func_select(void);
 extern void func_send(void);
 extern void func_WSAAsync(void);
 extern void func_WSAIoctl(void);
@@ -24,6 +27,7 @@ extern void func_WSAStartup(void);
 const struct test winetest_testlist[] =
 {
     { "bind", func_bind },
+    { "bulk", func_bulk },
     { "close", func_close },
     { "getaddrinfo", func_getaddrinfo },
     { "gethostname", func_gethostname },
@@ -31,10 +35,12 @@ const struct test winetest_testlist[] =
     { "getservbyname", func_getservbyname },
     { "getservbyport", func_getservbyport },
     { "ioctlsocket", func_ioctlsocket },
+    { "loopback", func_loopback },
     { "nonblocking", func_nonblocking },
     { "nostartup", func_nostartup },
     { "open_osfhandle", func_open_osfhandle },
     { "recv", func_recv },
+    { "select", func_select },
     { "send", func_send },
     { "WSAAsync", func_WSAAsync },
     { "WSAIoctl", func_WSAIoctl },
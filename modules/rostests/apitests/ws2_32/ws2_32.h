@@ -37,6 +37,10 @@
 int CreateSocket(SOCKET* sck);
 int ConnectToReactOSWebsite(SOCKET sck);
 int GetRequestAndWait(SOCKET sck);
+SOCKET CreateLoopbackListener(_Out_ struct sockaddr_in *Address);
+BOOL ConnectLoopback(_In_ SOCKET Listener, _In_ const struct sockaddr_in *Address, _Out_ SOCKET *Client, _Out_ SOCKET *Server);
+ULONG SendStream(_In_ SOCKET Socket, _In_ ULONG Length, _In_ ULONG ChunkSize, _In_opt_ HANDLE StartEvent);
+BOOL CheckStream(_In_reads_(Length) const UCHAR *Buffer, _In_ ULONG Length, _In_ ULONG Offset);
 
 /* ws2_32.c */
 extern HANDLE g_hHeap;
@@ -12,6 +12,7 @@ KMT_TESTFUNC Test_CcMapData;
 KMT_TESTFUNC Test_CcPinMappedData;
 KMT_TESTFUNC Test_CcPinRead;
 KMT_TESTFUNC Test_CcSetFileSizes;
+KMT_TESTFUNC Test_CcWriteBehind;
 KMT_TESTFUNC Test_Example;
 KMT_TESTFUNC Test_FileAttributes;
 KMT_TESTFUNC Test_FindFile;
@@ -47,6 +48,7 @@ const KMT_TEST TestList[] =
     { "-CcPinMappedData",              Test_CcPinMappedData },
     { "-CcPinRead",                    Test_CcPinRead },
     { "-CcSetFileSizes",               Test_CcSetFileSizes },
+    { "-CcWriteBehind",                Test_CcWriteBehind },
     { "-Example",                     Test_Example },
     { "FileAttributes",               Test_FileAttributes },
     { "FindFile",                     Test_FindFile },
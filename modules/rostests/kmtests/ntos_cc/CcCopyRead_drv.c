@@ -23,6 +23,7 @@ static PDEVICE_OBJECT TestDeviceObject;
 static KMT_IRP_HANDLER TestIrpHandler;
 static FAST_IO_DISPATCH TestFastIoDispatch;
 static BOOLEAN InBehaviourTest;
+static BOOLEAN InLookupTest;
 
 BOOLEAN ReadCalledNonCached;
 LARGE_INTEGER ReadOffset;
@@ -274,6 +275,82 @@ Test_CcCopyRead(PFILE_OBJECT FileObject)
     ok_eq_char(Ret, 'x');
 }
 
+/* Views this far apart share a bucket of the VACB index (64 buckets), so
+ * the lookups below have to walk a chain */
+#define LOOKUP_VIEWS 4
+#define LOOKUP_VIEW_STRIDE 64
+#define LOOKUP_FILE_SIZE ((LONGLONG)LOOKUP_VIEWS * LOOKUP_VIEW_STRIDE * VACB_MAPPING_GRANULARITY)
+
+static
+VOID
+CheckVacbLookup(
+    PFILE_OBJECT FileObject,
+    ULONG Purged)
+{
+    ULONG i;
+    BOOLEAN Ret;
+    CHAR Buffer[10];
+    LARGE_INTEGER Offset;
+    IO_STATUS_BLOCK IoStatus;
+
+    /* Every view that is still there is found without going to the disk */
+    for (i = 0; i < LOOKUP_VIEWS; i++)
+    {
+        if (i == Purged)
+            continue;
+
+        Offset.QuadPart = (LONGLONG)i * LOOKUP_VIEW_STRIDE * VACB_MAPPING_GRANULARITY;
+        memset(Buffer, 0xAC, sizeof(Buffer));
+        reset_read();
+        Ret = CcCopyRead(FileObject, &Offset, sizeof(Buffer), FALSE, Buffer, &IoStatus);
+        ok_bool_true(Ret, "CcCopyRead should find the view\n");
+        ok_read_not_called();
+        ok_eq_hex(*(PUSHORT)Buffer, 0xBABA);
+    }
+}
+
+static
+VOID
+Test_VacbLookup(PFILE_OBJECT FileObject)
+{
+    ULONG i;
+    BOOLEAN Ret;
+    CHAR Buffer[10];
+    LARGE_INTEGER Offset;
+    IO_STATUS_BLOCK IoStatus;
+
+    /* Get a VACB for each view */
+    for (i = 0; i < LOOKUP_VIEWS; i++)
+    {
+        Offset.QuadPart = (LONGLONG)i * LOOKUP_VIEW_STRIDE * VACB_MAPPING_GRANULARITY;
+        reset_read();
+        Ret = CcCopyRead(FileObject, &Offset, sizeof(Buffer), TRUE, Buffer, &IoStatus);
+        ok_bool_true(Ret, "CcCopyRead should succeed\n");
+        ok(ReadCalledNonCached, "CcCopyRead should have triggered a non-cached read\n");
+        ok_eq_longlong(ReadOffset.QuadPart, Offset.QuadPart);
+    }
+
+    CheckVacbLookup(FileObject, MAXULONG);
+
+    /* Unmap a view in the middle of the chain. The purge only drops the
+     * views that end before the range does. */
+    Offset.QuadPart = (LONGLONG)(LOOKUP_VIEWS / 2) * LOOKUP_VIEW_STRIDE * VACB_MAPPING_GRANULARITY;
+    Ret = CcPurgeCacheSection(FileObject->SectionObjectPointer, &Offset, 2 * VACB_MAPPING_GRANULARITY, FALSE);
+    ok_bool_true(Ret, "CcPurgeCacheSection should succeed\n");
+
+    /* The others are still linked */
+    CheckVacbLookup(FileObject, LOOKUP_VIEWS / 2);
+
+    /* And the purged one has to be read again */
+    reset_read();
+    Ret = CcCopyRead(FileObject, &Offset, sizeof(Buffer), FALSE, Buffer, &IoStatus);
+    ok_bool_false(Ret, "CcCopyRead shouldn't find the purged view\n");
+    ok(ReadCalledNonCached, "CcCopyRead should have triggered a non-cached read\n");
+    ok_eq_longlong(ReadOffset.QuadPart, Offset.QuadPart);
+
+    /* Which put it back */
+    CheckVacbLookup(FileObject, MAXULONG);
+}
 
 static
 NTSTATUS
@@ -332,6 +409,13 @@ TestIrpHandler(
             Fcb->Header.FileSize.QuadPart = 62;
             Fcb->Header.ValidDataLength.QuadPart = 62;
         }
+        else if (IoStack->FileObject->FileName.Length >= 2 * sizeof(WCHAR) &&
+                 IoStack->FileObject->FileName.Buffer[1] == 'V')
+        {
+            Fcb->Header.AllocationSize.QuadPart = LOOKUP_FILE_SIZE;
+            Fcb->Header.FileSize.QuadPart = LOOKUP_FILE_SIZE;
+            Fcb->Header.ValidDataLength.QuadPart = LOOKUP_FILE_SIZE;
+        }
         else if (IoStack->FileObject->FileName.Length >= 2 * sizeof(WCHAR) &&
                  IoStack->FileObject->FileName.Buffer[1] == 'F')
         {
@@ -364,6 +448,7 @@ TestIrpHandler(
         PVOID Buffer;
         LARGE_INTEGER Offset;
         static const UNICODE_STRING BehaviourTestFileName = RTL_CONSTANT_STRING(L"\\BehaviourTestFile");
+        static const UNICODE_STRING VacbLookupTestFileName = RTL_CONSTANT_STRING(L"\\VacbLookupTestFile");
 
         Offset = IoStack->Parameters.Read.ByteOffset;
         Length = IoStack->Parameters.Read.Length;
@@ -374,6 +459,7 @@ TestIrpHandler(
 
         /* Check special file name */
         InBehaviourTest = RtlCompareUnicodeString(&IoStack->FileObject->FileName, &BehaviourTestFileName, TRUE) == 0;
+        InLookupTest = RtlCompareUnicodeString(&IoStack->FileObject->FileName, &VacbLookupTestFileName, TRUE) == 0;
 
         if (!FlagOn(Irp->Flags, IRP_NOCACHE))
         {
@@ -384,6 +470,11 @@ TestIrpHandler(
                 Test_CcCopyRead(IoStack->FileObject);
                 Status = Irp->IoStatus.Status = STATUS_SUCCESS;
             }
+            else if (InLookupTest)
+            {
+                Test_VacbLookup(IoStack->FileObject);
+                Status = Irp->IoStatus.Status = STATUS_SUCCESS;
+            }
             else
             {
                 /* We don't want to test alignement for big files (not the purpose of the test) */
@@ -461,6 +552,7 @@ TestIrpHandler(
         }
 
         InBehaviourTest = FALSE;
+        InLookupTest = FALSE;
     }
     else if (IoStack->MajorFunction == IRP_MJ_CLEANUP)
     {
@@ -20,6 +20,7 @@ START_TEST(CcCopyRead)
     UNICODE_STRING ReallySmallAlignmentTest = RTL_CONSTANT_STRING(L"\\Device\\Kmtest-CcCopyRead\\ReallySmallAlignmentTest");
     UNICODE_STRING FileBig = RTL_CONSTANT_STRING(L"\\Device\\Kmtest-CcCopyRead\\FileBig");
     UNICODE_STRING BehaviourTestFile = RTL_CONSTANT_STRING(L"\\Device\\Kmtest-CcCopyRead\\BehaviourTestFile");
+    UNICODE_STRING VacbLookupTestFile = RTL_CONSTANT_STRING(L"\\Device\\Kmtest-CcCopyRead\\VacbLookupTestFile");
     DWORD Error;
 
     Error = KmtLoadAndOpenDriver(L"CcCopyRead", FALSE);
@@ -114,6 +115,16 @@ START_TEST(CcCopyRead)
 
     NtClose(Handle);
 
+    InitializeObjectAttributes(&ObjectAttributes, &VacbLookupTestFile, OBJ_CASE_INSENSITIVE, NULL, NULL);
+    Status = NtOpenFile(&Handle, FILE_ALL_ACCESS, &ObjectAttributes, &IoStatusBlock, 0, FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+
+    ByteOffset.QuadPart = 0;
+    Status = NtReadFile(Handle, NULL, NULL, NULL, &IoStatusBlock, Buffer, 1024, &ByteOffset, NULL);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+
+    NtClose(Handle);
+
     RtlFreeHeap(RtlGetProcessHeap(), 0, Buffer);
     KmtCloseDriver();
     KmtUnloadDriver();
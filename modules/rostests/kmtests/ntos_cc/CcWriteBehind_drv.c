@@ -0,0 +1,492 @@
+/*
+ * PROJECT:     ReactOS kernel-mode tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Test driver measuring lazy writer throughput to two RAM disks at once
+ */
+
+#include <kmt_test.h>
+
+#define NDEBUG
+#include <debug.h>
+
+#define IOCTL_RUN_BENCHMARK 1
+
+#define RAM_DISK_COUNT 2
+#define RAM_DISK_SIZE (8 * 1024 * 1024)
+#define FILL_CHUNK_SIZE (64 * 1024)
+#define WRITE_BEHIND_TIMEOUT (60 * 1000 * 10000ULL)
+
+typedef struct _TEST_FCB
+{
+    FSRTL_ADVANCED_FCB_HEADER Header;
+    SECTION_OBJECT_POINTERS SectionObjectPointers;
+    FAST_MUTEX HeaderMutex;
+} TEST_FCB, *PTEST_FCB;
+
+/* Every RAM disk is a device object of its own, so the lazy writer sees
+ * the file cached on it as living on a separate volume.
+ */
+typedef struct _RAM_DISK
+{
+    ULONG Index;
+    PDEVICE_OBJECT DeviceObject;
+    PFILE_OBJECT FileObject;
+    PULONG Data;
+    LONG WritesInFlight;
+    ULONG BytesWritten;
+    ULONGLONG FirstWrite;
+    ULONGLONG LastWrite;
+    BOOLEAN Corrupt;
+} RAM_DISK, *PRAM_DISK;
+
+static RAM_DISK RamDisks[RAM_DISK_COUNT];
+static KSPIN_LOCK StatsLock;
+static BOOLEAN WritesOverlapped;
+static KMT_IRP_HANDLER TestIrpHandler;
+static KMT_MESSAGE_HANDLER TestMessageHandler;
+
+NTSTATUS
+TestEntry(
+    _In_ PDRIVER_OBJECT DriverObject,
+    _In_ PCUNICODE_STRING RegistryPath,
+    _Out_ PCWSTR *DeviceName,
+    _Inout_ INT *Flags)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    ULONG i;
+
+    PAGED_CODE();
+
+    UNREFERENCED_PARAMETER(RegistryPath);
+
+    *DeviceName = L"CcWriteBehind";
+    *Flags = TESTENTRY_NO_EXCLUSIVE_DEVICE |
+             TESTENTRY_BUFFERED_IO_DEVICE |
+             TESTENTRY_NO_READONLY_DEVICE;
+
+    KeInitializeSpinLock(&StatsLock);
+
+    for (i = 0; i < RAM_DISK_COUNT; i++)
+    {
+        RamDisks[i].Index = i;
+        Status = IoCreateDevice(DriverObject, 0, NULL,
+                                FILE_DEVICE_DISK,
+                                FILE_DEVICE_SECURE_OPEN,
+                                FALSE,
+                                &RamDisks[i].DeviceObject);
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("Could not create RAM disk %lu: %lx\n", i, Status);
+            break;
+        }
+        RamDisks[i].DeviceObject->Flags &= ~DO_DEVICE_INITIALIZING;
+
+        KmtRegisterIrpHandler(IRP_MJ_READ, RamDisks[i].DeviceObject, TestIrpHandler);
+        KmtRegisterIrpHandler(IRP_MJ_WRITE, RamDisks[i].DeviceObject, TestIrpHandler);
+    }
+
+    KmtRegisterMessageHandler(0, NULL, TestMessageHandler);
+
+    return Status;
+}
+
+VOID
+TestUnload(
+    _In_ PDRIVER_OBJECT DriverObject)
+{
+    ULONG i;
+
+    PAGED_CODE();
+
+    for (i = 0; i < RAM_DISK_COUNT; i++)
+    {
+        if (RamDisks[i].DeviceObject != NULL)
+        {
+            IoDeleteDevice(RamDisks[i].DeviceObject);
+            RamDisks[i].DeviceObject = NULL;
+        }
+    }
+}
+
+BOOLEAN
+NTAPI
+AcquireForLazyWrite(
+    _In_ PVOID Context,
+    _In_ BOOLEAN Wait)
+{
+    return TRUE;
+}
+
+VOID
+NTAPI
+ReleaseFromLazyWrite(
+    _In_ PVOID Context)
+{
+    return;
+}
+
+BOOLEAN
+NTAPI
+AcquireForReadAhead(
+    _In_ PVOID Context,
+    _In_ BOOLEAN Wait)
+{
+    return TRUE;
+}
+
+VOID
+NTAPI
+ReleaseFromReadAhead(
+    _In_ PVOID Context)
+{
+    return;
+}
+
+static CACHE_MANAGER_CALLBACKS Callbacks = {
+    AcquireForLazyWrite,
+    ReleaseFromLazyWrite,
+    AcquireForReadAhead,
+    ReleaseFromReadAhead,
+};
+
+/* Every ULONG holds its offset, tagged with the disk it was written to */
+static
+ULONG
+RamDiskPattern(
+    _In_ PRAM_DISK Disk,
+    _In_ ULONG Offset)
+{
+    return Offset ^ ((Disk->Index + 1) << 28);
+}
+
+static
+BOOLEAN
+OpenRamDisk(
+    _In_ PRAM_DISK Disk)
+{
+    PTEST_FCB Fcb;
+
+    Disk->BytesWritten = 0;
+    Disk->FirstWrite = Disk->LastWrite = 0;
+    Disk->Corrupt = FALSE;
+
+    Disk->Data = ExAllocatePoolWithTag(PagedPool, RAM_DISK_SIZE, 'DRcC');
+    if (skip(Disk->Data != NULL, "No memory for RAM disk %lu\n", Disk->Index))
+        return FALSE;
+    RtlZeroMemory(Disk->Data, RAM_DISK_SIZE);
+
+    Disk->FileObject = IoCreateStreamFileObject(NULL, Disk->DeviceObject);
+    if (skip(Disk->FileObject != NULL, "Failed to allocate FO\n"))
+        return FALSE;
+
+    Fcb = ExAllocatePoolWithTag(NonPagedPool, sizeof(TEST_FCB), 'FBcC');
+    if (skip(Fcb != NULL, "ExAllocatePoolWithTag failed\n"))
+        return FALSE;
+
+    RtlZeroMemory(Fcb, sizeof(TEST_FCB));
+    ExInitializeFastMutex(&Fcb->HeaderMutex);
+    FsRtlSetupAdvancedHeader(&Fcb->Header, &Fcb->HeaderMutex);
+    Fcb->Header.AllocationSize.QuadPart = RAM_DISK_SIZE;
+    Fcb->Header.FileSize.QuadPart = RAM_DISK_SIZE;
+    Fcb->Header.ValidDataLength.QuadPart = RAM_DISK_SIZE;
+
+    Disk->FileObject->FsContext = Fcb;
+    Disk->FileObject->SectionObjectPointer = &Fcb->SectionObjectPointers;
+
+    KmtStartSeh();
+    CcInitializeCacheMap(Disk->FileObject, (PCC_FILE_SIZES)&Fcb->Header.AllocationSize, FALSE, &Callbacks, NULL);
+    KmtEndSeh(STATUS_SUCCESS);
+
+    return !skip(CcIsFileCached(Disk->FileObject) == TRUE, "CcInitializeCacheMap failed\n");
+}
+
+static
+VOID
+CloseRamDisk(
+    _In_ PRAM_DISK Disk)
+{
+    LARGE_INTEGER Zero = RTL_CONSTANT_LARGE_INTEGER(0LL);
+    CACHE_UNINITIALIZE_EVENT CacheUninitEvent;
+
+    if (Disk->FileObject != NULL)
+    {
+        if (Disk->FileObject->FsContext != NULL)
+        {
+            if (CcIsFileCached(Disk->FileObject))
+            {
+                KeInitializeEvent(&CacheUninitEvent.Event, NotificationEvent, FALSE);
+                CcUninitializeCacheMap(Disk->FileObject, &Zero, &CacheUninitEvent);
+                KeWaitForSingleObject(&CacheUninitEvent.Event, Executive, KernelMode, FALSE, NULL);
+            }
+
+            ExFreePoolWithTag(Disk->FileObject->FsContext, 'FBcC');
+            Disk->FileObject->FsContext = NULL;
+            Disk->FileObject->SectionObjectPointer = NULL;
+        }
+
+        ObDereferenceObject(Disk->FileObject);
+        Disk->FileObject = NULL;
+    }
+
+    if (Disk->Data != NULL)
+    {
+        ExFreePoolWithTag(Disk->Data, 'DRcC');
+        Disk->Data = NULL;
+    }
+}
+
+static
+VOID
+NTAPI
+FillRamDisk(
+    _In_ PVOID Context)
+{
+    PRAM_DISK Disk = Context;
+    LARGE_INTEGER Offset;
+    PULONG Buffer;
+    BOOLEAN Ret;
+    ULONG i;
+
+    Buffer = ExAllocatePoolWithTag(PagedPool, FILL_CHUNK_SIZE, 'BFcC');
+    if (skip(Buffer != NULL, "ExAllocatePoolWithTag failed\n"))
+        return;
+
+    FsRtlEnterFileSystem();
+
+    for (Offset.QuadPart = 0; Offset.QuadPart < RAM_DISK_SIZE; Offset.QuadPart += FILL_CHUNK_SIZE)
+    {
+        for (i = 0; i < FILL_CHUNK_SIZE / sizeof(ULONG); i++)
+            Buffer[i] = RamDiskPattern(Disk, Offset.LowPart + i * sizeof(ULONG));
+
+        Ret = FALSE;
+        KmtStartSeh();
+        Ret = CcCopyWrite(Disk->FileObject, &Offset, FILL_CHUNK_SIZE, TRUE, Buffer);
+        KmtEndSeh(STATUS_SUCCESS);
+        if (!Ret)
+        {
+            ok(Ret, "CcCopyWrite to RAM disk %lu failed at %I64d\n", Disk->Index, Offset.QuadPart);
+            break;
+        }
+    }
+
+    FsRtlExitFileSystem();
+
+    ExFreePoolWithTag(Buffer, 'BFcC');
+}
+
+static
+BOOLEAN
+RamDisksWrittenBack(VOID)
+{
+    ULONG i;
+
+    for (i = 0; i < RAM_DISK_COUNT; i++)
+    {
+        if (RamDisks[i].BytesWritten < RAM_DISK_SIZE)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static
+ULONGLONG
+KiloBytesPerSecond(
+    _In_ ULONGLONG Bytes,
+    _In_ ULONGLONG Elapsed)
+{
+    return Bytes / 1024 * 10000000ULL / max(Elapsed, 1);
+}
+
+static
+VOID
+RunBenchmark(VOID)
+{
+    PKTHREAD Threads[RAM_DISK_COUNT];
+    LARGE_INTEGER Interval;
+    ULONGLONG Filled, Clean, FirstWrite, LastWrite, Elapsed;
+    ULONG i, j, Mismatches;
+
+    WritesOverlapped = FALSE;
+
+    for (i = 0; i < RAM_DISK_COUNT; i++)
+    {
+        if (skip(RamDisks[i].DeviceObject != NULL, "No RAM disk %lu\n", i) ||
+            !OpenRamDisk(&RamDisks[i]))
+        {
+            goto Cleanup;
+        }
+    }
+
+    /* Dirty both files at once, then leave them to the lazy writer */
+    for (i = 0; i < RAM_DISK_COUNT; i++)
+        Threads[i] = KmtStartThread(FillRamDisk, &RamDisks[i]);
+    for (i = 0; i < RAM_DISK_COUNT; i++)
+        KmtFinishThread(Threads[i], NULL);
+    Filled = KeQueryInterruptTime();
+
+    Interval.QuadPart = -100 * 10000LL;
+    while (!RamDisksWrittenBack() && KeQueryInterruptTime() - Filled < WRITE_BEHIND_TIMEOUT)
+        KeDelayExecutionThread(KernelMode, FALSE, &Interval);
+    Clean = KeQueryInterruptTime();
+
+    FirstWrite = MAXULONGLONG;
+    LastWrite = 0;
+    for (i = 0; i < RAM_DISK_COUNT; i++)
+    {
+        PRAM_DISK Disk = &RamDisks[i];
+
+        ok(Disk->BytesWritten >= RAM_DISK_SIZE, "RAM disk %lu: %lu bytes written back\n", i, Disk->BytesWritten);
+        ok(!Disk->Corrupt, "RAM disk %lu received corrupt data\n", i);
+
+        for (j = 0, Mismatches = 0; j < RAM_DISK_SIZE / sizeof(ULONG); j++)
+        {
+            if (Disk->Data[j] != RamDiskPattern(Disk, j * sizeof(ULONG)))
+                Mismatches++;
+        }
+        ok(Mismatches == 0, "RAM disk %lu: %lu ULONGs differ from what was written\n", i, Mismatches);
+
+        if (Disk->BytesWritten == 0)
+            continue;
+
+        Elapsed = Disk->LastWrite - Disk->FirstWrite;
+        trace("RAM disk %lu: %lu KB written back in %I64u ms, %I64u KB/s\n",
+              i, Disk->BytesWritten / 1024, Elapsed / 10000,
+              KiloBytesPerSecond(Disk->BytesWritten, Elapsed));
+
+        FirstWrite = min(FirstWrite, Disk->FirstWrite);
+        LastWrite = max(LastWrite, Disk->LastWrite);
+    }
+
+    if (LastWrite != 0)
+    {
+        Elapsed = LastWrite - FirstWrite;
+        trace("All RAM disks: %lu KB written back in %I64u ms, %I64u KB/s, clean %I64u ms after filling\n",
+              (ULONG)(RAM_DISK_COUNT * RAM_DISK_SIZE / 1024), Elapsed / 10000,
+              KiloBytesPerSecond(RAM_DISK_COUNT * RAM_DISK_SIZE, Elapsed),
+              (Clean - Filled) / 10000);
+    }
+
+    /* With one write-behind item per volume, the disks are written back by
+     * different Cc worker threads. They can only be seen overlapping for sure
+     * when there is a processor for each of them.
+     */
+    if (!skip(KeNumberProcessors > 1, "Single processor, write-behind may not overlap\n"))
+        ok(WritesOverlapped, "The RAM disks were never written back at the same time\n");
+
+Cleanup:
+    for (i = 0; i < RAM_DISK_COUNT; i++)
+        CloseRamDisk(&RamDisks[i]);
+}
+
+static
+NTSTATUS
+TestIrpHandler(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp,
+    _In_ PIO_STACK_LOCATION IoStack)
+{
+    NTSTATUS Status;
+    PRAM_DISK Disk = NULL;
+    LARGE_INTEGER Offset;
+    ULONG Length, i;
+    PULONG Buffer;
+    KIRQL OldIrql;
+
+    PAGED_CODE();
+
+    DPRINT("IRP %x/%x\n", IoStack->MajorFunction, IoStack->MinorFunction);
+    ASSERT(IoStack->MajorFunction == IRP_MJ_READ ||
+           IoStack->MajorFunction == IRP_MJ_WRITE);
+
+    for (i = 0; i < RAM_DISK_COUNT; i++)
+    {
+        if (RamDisks[i].DeviceObject == DeviceObject)
+            Disk = &RamDisks[i];
+    }
+    ok(Disk != NULL, "IRP for unknown device %p\n", DeviceObject);
+
+    Offset = IoStack->Parameters.Read.ByteOffset;
+    Length = IoStack->Parameters.Read.Length;
+    Irp->IoStatus.Information = 0;
+
+    ok(BooleanFlagOn(Irp->Flags, IRP_NOCACHE), "IRP not coming from Cc!\n");
+    ok((Irp->Flags & IRP_PAGING_IO) != 0, "Non paging IO\n");
+    ok(Offset.QuadPart % PAGE_SIZE == 0, "Offset is not aligned: %I64i\n", Offset.QuadPart);
+    ok(Length % PAGE_SIZE == 0, "Length is not aligned: %lu\n", Length);
+
+    Buffer = NULL;
+    if (Irp->MdlAddress != NULL)
+        Buffer = MmGetSystemAddressForMdlSafe(Irp->MdlAddress, NormalPagePriority);
+
+    if (Disk == NULL || Buffer == NULL || Offset.QuadPart + Length > RAM_DISK_SIZE)
+    {
+        Status = STATUS_INVALID_PARAMETER;
+    }
+    else if (IoStack->MajorFunction == IRP_MJ_READ)
+    {
+        RtlCopyMemory(Buffer, (PUCHAR)Disk->Data + Offset.LowPart, Length);
+
+        Irp->IoStatus.Information = Length;
+        Status = STATUS_SUCCESS;
+    }
+    else
+    {
+        KeAcquireSpinLock(&StatsLock, &OldIrql);
+        for (i = 0; i < RAM_DISK_COUNT; i++)
+        {
+            if (&RamDisks[i] != Disk && RamDisks[i].WritesInFlight != 0)
+                WritesOverlapped = TRUE;
+        }
+        Disk->WritesInFlight++;
+        if (Disk->FirstWrite == 0)
+            Disk->FirstWrite = KeQueryInterruptTime();
+        KeReleaseSpinLock(&StatsLock, OldIrql);
+
+        for (i = 0; i < Length / sizeof(ULONG); i++)
+        {
+            if (Buffer[i] != RamDiskPattern(Disk, Offset.LowPart + i * sizeof(ULONG)))
+                Disk->Corrupt = TRUE;
+        }
+        RtlCopyMemory((PUCHAR)Disk->Data + Offset.LowPart, Buffer, Length);
+
+        KeAcquireSpinLock(&StatsLock, &OldIrql);
+        Disk->WritesInFlight--;
+        Disk->BytesWritten += Length;
+        Disk->LastWrite = KeQueryInterruptTime();
+        KeReleaseSpinLock(&StatsLock, OldIrql);
+
+        Irp->IoStatus.Information = Length;
+        Status = STATUS_SUCCESS;
+    }
+
+    Irp->IoStatus.Status = Status;
+    IoCompleteRequest(Irp, IO_NO_INCREMENT);
+
+    return Status;
+}
+
+static
+NTSTATUS
+TestMessageHandler(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ ULONG ControlCode,
+    _In_opt_ PVOID Buffer,
+    _In_ SIZE_T InLength,
+    _Inout_ PSIZE_T OutLength)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    switch (ControlCode)
+    {
+        case IOCTL_RUN_BENCHMARK:
+            RunBenchmark();
+            break;
+
+        default:
+            Status = STATUS_NOT_IMPLEMENTED;
+            break;
+    }
+
+    return Status;
+}
@@ -0,0 +1,25 @@
+/*
+ * PROJECT:     ReactOS kernel-mode tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Kernel-Mode Test Suite CcWriteBehind test user-mode part
+ */
+
+#include <kmt_test.h>
+
+#define IOCTL_RUN_BENCHMARK 1
+
+START_TEST(CcWriteBehind)
+{
+    DWORD Ret;
+
+    Ret = KmtLoadAndOpenDriver(L"CcWriteBehind", FALSE);
+    ok_eq_int(Ret, ERROR_SUCCESS);
+    if (Ret)
+        return;
+
+    Ret = KmtSendToDriver(IOCTL_RUN_BENCHMARK);
+    ok(Ret == ERROR_SUCCESS, "KmtSendToDriver failed: %lx\n", Ret);
+
+    KmtCloseDriver();
+    KmtUnloadDriver();
+}
@@ -305,6 +305,105 @@ TestBigPoolExpansion(VOID)
     }
 }
 
+#define SCALING_MAX_THREADS 8
+#define SCALING_ITERATIONS 20000
+#define SCALING_BATCH 16
+
+typedef struct _POOL_SCALING_CONTEXT
+{
+    PKEVENT StartEvent;
+    POOL_TYPE PoolType;
+    KAFFINITY Affinity;
+    ULONGLONG Ticks;
+    ULONG Failures;
+} POOL_SCALING_CONTEXT, *PPOOL_SCALING_CONTEXT;
+
+static
+VOID
+NTAPI
+PoolScalingThread(
+    _In_ PVOID Parameter)
+{
+    PPOOL_SCALING_CONTEXT Context = Parameter;
+    PVOID Blocks[SCALING_BATCH];
+    LARGE_INTEGER Start, End;
+    ULONG i, j;
+
+    /* Stay on our own CPU, so that each of them uses its lookaside lists */
+    KeSetSystemAffinityThread(Context->Affinity);
+    KeWaitForSingleObject(Context->StartEvent, Executive, KernelMode, FALSE, NULL);
+
+    Start = KeQueryPerformanceCounter(NULL);
+    for (i = 0; i < SCALING_ITERATIONS; i++)
+    {
+        /* A few small blocks of various sizes, like a network stack would do */
+        for (j = 0; j < SCALING_BATCH; j++)
+        {
+            Blocks[j] = ExAllocatePoolWithTag(Context->PoolType, 16 + 24 * (j % 8), 'SPmK');
+            if (!Blocks[j])
+                Context->Failures++;
+        }
+        for (j = 0; j < SCALING_BATCH; j++)
+        {
+            if (Blocks[j])
+                ExFreePoolWithTag(Blocks[j], 'SPmK');
+        }
+    }
+    End = KeQueryPerformanceCounter(NULL);
+
+    Context->Ticks = End.QuadPart - Start.QuadPart;
+    KeRevertToUserAffinityThread();
+}
+
+static
+VOID
+TestPoolScaling(VOID)
+{
+    POOL_SCALING_CONTEXT Contexts[SCALING_MAX_THREADS];
+    PKTHREAD Threads[SCALING_MAX_THREADS];
+    KEVENT StartEvent;
+    LARGE_INTEGER Frequency;
+    POOL_TYPE PoolType;
+    ULONG ThreadCount, MaxThreads, i;
+    ULONGLONG OpsPerSecond;
+
+    KeQueryPerformanceCounter(&Frequency);
+    MaxThreads = min(KeNumberProcessors, SCALING_MAX_THREADS);
+
+    for (PoolType = NonPagedPool; PoolType <= PagedPool; PoolType++)
+    {
+        for (ThreadCount = 1; ThreadCount <= MaxThreads; ThreadCount *= 2)
+        {
+            KeInitializeEvent(&StartEvent, NotificationEvent, FALSE);
+            for (i = 0; i < ThreadCount; i++)
+            {
+                Contexts[i].StartEvent = &StartEvent;
+                Contexts[i].PoolType = PoolType;
+                Contexts[i].Affinity = (KAFFINITY)1 << i;
+                Contexts[i].Ticks = 0;
+                Contexts[i].Failures = 0;
+                Threads[i] = KmtStartThread(PoolScalingThread, &Contexts[i]);
+            }
+
+            /* Let them all go at once */
+            KeSetEvent(&StartEvent, IO_NO_INCREMENT, FALSE);
+
+            for (i = 0; i < ThreadCount; i++)
+            {
+                KmtFinishThread(Threads[i], NULL);
+                ok_eq_ulong(Contexts[i].Failures, 0UL);
+                if (Contexts[i].Ticks == 0)
+                    continue;
+
+                /* An allocation and a free count as two operations */
+                OpsPerSecond = (2ULL * SCALING_ITERATIONS * SCALING_BATCH * Frequency.QuadPart) / Contexts[i].Ticks;
+                trace("PoolType %d, %lu threads: CPU %lu did %I64u ops/s\n",
+                      PoolType, ThreadCount, i, OpsPerSecond);
+            }
+        }
+    }
+}
+
 START_TEST(ExPools)
 {
     PoolsTest();
@@ -312,4 +411,5 @@ START_TEST(ExPools)
     TestPoolTags();
     TestPoolQuota();
     TestBigPoolExpansion();
+    TestPoolScaling();
 }
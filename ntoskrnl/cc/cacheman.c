@@ -20,6 +20,17 @@ MM_SYSTEMSIZE CcCapturedSystemSize;
 
 static ULONG BugCheckFileId = 0x4 << 16;
 
+/* Read ahead stream counters:
+ * - Reads continuing a stream that were satisfied from the cache
+ * - Reads continuing a stream that had to wait for the disk
+ * - Streams detected
+ * - Streams dropped before their read ahead data was consumed
+ */
+ULONG CcReadAheadHits = 0;
+ULONG CcReadAheadMisses = 0;
+ULONG CcReadAheadStreams = 0;
+ULONG CcReadAheadWasted = 0;
+
 /* FUNCTIONS *****************************************************************/
 
 CODE_SEG("INIT")
@@ -149,21 +160,76 @@ CcRemapBcb (
     return 0;
 }
 
-/*
- * @unimplemented
- */
+static
+PCC_READ_AHEAD_STREAM
+CcpFindReadAheadStream(
+    _In_ PROS_PRIVATE_CACHE_MAP PrivateMap,
+    _In_ LONGLONG FileOffset,
+    _In_ ULONG Granularity)
+{
+    ULONG i;
+    PCC_READ_AHEAD_STREAM Stream;
+    PCC_READ_AHEAD_STREAM Oldest = NULL;
+
+    /* A read continues a stream if it starts where the stream stopped,
+     * give or take the read ahead granularity
+     */
+    for (i = 0; i < CC_READ_AHEAD_STREAMS; i++)
+    {
+        Stream = &PrivateMap->Streams[i];
+
+        if (Stream->LastUse != 0 &&
+            FileOffset + Granularity >= Stream->NextOffset &&
+            FileOffset <= Stream->NextOffset + Granularity)
+        {
+            return Stream;
+        }
+
+        if (Oldest == NULL || Stream->LastUse < Oldest->LastUse)
+        {
+            Oldest = Stream;
+        }
+    }
+
+    /* No match, this is a new stream: recycle the least recently used one */
+    if (Oldest->LastUse != 0)
+    {
+        /* If it was read ahead further than it was consumed, the window was
+         * too large for this handle. Otherwise, it was useful: keep it.
+         */
+        if (Oldest->ReadAheadEnd > Oldest->NextOffset + Granularity)
+        {
+            ++CcReadAheadWasted;
+            PrivateMap->DefaultWindow = max(PrivateMap->DefaultWindow / 2, CC_MIN_READ_AHEAD_WINDOW);
+        }
+        else
+        {
+            PrivateMap->DefaultWindow = Oldest->Window;
+        }
+    }
+
+    RtlZeroMemory(Oldest, sizeof(*Oldest));
+    Oldest->Window = max(PrivateMap->DefaultWindow, Granularity);
+    ++CcReadAheadStreams;
+
+    return Oldest;
+}
+
 VOID
-NTAPI
-CcScheduleReadAhead (
-	IN	PFILE_OBJECT		FileObject,
-	IN	PLARGE_INTEGER		FileOffset,
-	IN	ULONG			Length
-	)
+CcRosScheduleReadAhead(
+    _In_ PFILE_OBJECT FileObject,
+    _In_ PLARGE_INTEGER FileOffset,
+    _In_ ULONG Length,
+    _In_ BOOLEAN Missed)
 {
     KIRQL OldIrql;
-    LARGE_INTEGER NewOffset;
+    ULONG Granularity;
+    LONGLONG ReadEnd;
+    LONGLONG ReadAheadEnd;
     PROS_SHARED_CACHE_MAP SharedCacheMap;
     PPRIVATE_CACHE_MAP PrivateCacheMap;
+    PROS_PRIVATE_CACHE_MAP PrivateMap;
+    PCC_READ_AHEAD_STREAM Stream;
 
     SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
     PrivateCacheMap = FileObject->PrivateCacheMap;
@@ -175,48 +241,72 @@ CcScheduleReadAhead (
         return;
     }
 
-    /* Round read length with read ahead mask */
-    Length = ROUND_UP(Length, PrivateCacheMap->ReadAheadMask + 1);
-    /* Compute the offset we'll reach */
-    NewOffset.QuadPart = FileOffset->QuadPart + Length;
+    PrivateMap = CONTAINING_RECORD(PrivateCacheMap, ROS_PRIVATE_CACHE_MAP, PrivateMap);
+    Granularity = PrivateCacheMap->ReadAheadMask + 1;
+    ReadEnd = FileOffset->QuadPart + Length;
 
     /* Lock read ahead spin lock */
     KeAcquireSpinLock(&PrivateCacheMap->ReadAheadSpinLock, &OldIrql);
-    /* Easy case: the file is sequentially read */
-    if (BooleanFlagOn(FileObject->Flags, FO_SEQUENTIAL_ONLY))
-    {
-        /* If we went backward, this is no go! */
-        if (NewOffset.QuadPart < PrivateCacheMap->ReadAheadOffset[1].QuadPart)
-        {
-            KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
-            return;
-        }
 
-        /* FIXME: hackish, but will do the job for now */
-        PrivateCacheMap->ReadAheadOffset[1].QuadPart = NewOffset.QuadPart;
-        PrivateCacheMap->ReadAheadLength[1] = Length;
+    /* Keep the read history up to date */
+    PrivateCacheMap->FileOffset1.QuadPart = PrivateCacheMap->FileOffset2.QuadPart;
+    PrivateCacheMap->BeyondLastByte1.QuadPart = PrivateCacheMap->BeyondLastByte2.QuadPart;
+    PrivateCacheMap->FileOffset2.QuadPart = FileOffset->QuadPart;
+    PrivateCacheMap->BeyondLastByte2.QuadPart = ReadEnd;
+
+    Stream = CcpFindReadAheadStream(PrivateMap, FileOffset->QuadPart, Granularity);
+    if (Stream->LastUse != 0 && ReadEnd <= Stream->NextOffset)
+    {
+        /* Read again something the stream already read, nothing new to learn */
+        Stream->LastUse = ++PrivateMap->StreamTick;
+        KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
+        return;
     }
-    /* Other cases: try to find some logic in that mess... */
-    else
+    else if (Stream->LastUse != 0)
     {
-        /* Let's check if we always read the same way (like going down in the file)
-         * and pretend it's enough for now
-         */
-        if (PrivateCacheMap->FileOffset2.QuadPart >= PrivateCacheMap->FileOffset1.QuadPart &&
-            FileOffset->QuadPart >= PrivateCacheMap->FileOffset2.QuadPart)
+        ++Stream->SequentialReads;
+
+        /* The reader caught up with read ahead: make it go further */
+        if (Missed)
         {
-            /* FIXME: hackish, but will do the job for now */
-            PrivateCacheMap->ReadAheadOffset[1].QuadPart = NewOffset.QuadPart;
-            PrivateCacheMap->ReadAheadLength[1] = Length;
+            ++CcReadAheadMisses;
+            Stream->Window = min(Stream->Window * 2, CC_MAX_READ_AHEAD_WINDOW);
         }
         else
         {
-            /* FIXME: handle the other cases */
-            KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
-            UNIMPLEMENTED_ONCE;
-            return;
+            ++CcReadAheadHits;
         }
     }
+    else if (BooleanFlagOn(FileObject->Flags, FO_SEQUENTIAL_ONLY))
+    {
+        /* Caller told us it reads sequentially, don't wait for proof */
+        Stream->SequentialReads = 1;
+        Stream->Window = CC_MAX_READ_AHEAD_WINDOW;
+    }
+
+    Stream->LastUse = ++PrivateMap->StreamTick;
+    Stream->NextOffset = ReadEnd;
+    if (Stream->ReadAheadEnd < ReadEnd)
+    {
+        Stream->ReadAheadEnd = ReadEnd;
+    }
+
+    /* Only read ahead for streams, and only once half of the previous read ahead was consumed */
+    if (Stream->SequentialReads == 0 ||
+        Stream->ReadAheadEnd - ReadEnd >= Stream->Window / 2)
+    {
+        KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
+        return;
+    }
+
+    /* Queue what's missing for a full window, merging with what's not done yet */
+    ReadAheadEnd = ROUND_UP(ReadEnd + Stream->Window, Granularity);
+    if (Stream->PendingLength == 0)
+    {
+        Stream->PendingOffset = Stream->ReadAheadEnd;
+    }
+    Stream->PendingLength = (ULONG)(ReadAheadEnd - Stream->PendingOffset);
+    Stream->ReadAheadEnd = ReadAheadEnd;
 
     /* If read ahead isn't active yet */
     if (!PrivateCacheMap->Flags.ReadAheadActive)
@@ -246,15 +336,34 @@ CcScheduleReadAhead (
             return;
         }
 
-        /* Fail path: lock again, and revert read ahead active */
+        /* Fail path: lock again, and revert read ahead active.
+         * Pending ranges will be picked up by the next scheduling.
+         */
         KeAcquireSpinLock(&PrivateCacheMap->ReadAheadSpinLock, &OldIrql);
         InterlockedAnd((volatile long *)&PrivateCacheMap->UlongFlags, ~PRIVATE_CACHE_MAP_READ_AHEAD_ACTIVE);
     }
 
-    /* Done (fail) */
+    /* Done (either queued, or the active worker will pick it up) */
     KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
 }
 
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+CcScheduleReadAhead (
+	IN	PFILE_OBJECT		FileObject,
+	IN	PLARGE_INTEGER		FileOffset,
+	IN	ULONG			Length
+	)
+{
+    CCTRACE(CC_API_DEBUG, "FileObject=%p FileOffset=%I64d Length=%lu\n",
+        FileObject, FileOffset->QuadPart, Length);
+
+    CcRosScheduleReadAhead(FileObject, FileOffset, Length, FALSE);
+}
+
 /*
  * @implemented
  */
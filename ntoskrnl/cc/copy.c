@@ -43,6 +43,17 @@ ULONG CcFastReadResourceMiss;
 ULONG CcDataPages = 0;
 ULONG CcDataFlushes = 0;
 
+/* Counters:
+ * - CcCopyRead calls, depending on whether the caller can wait
+ * - Those of them that didn't find all the data in the cache
+ * - Read ahead operations performed
+ */
+ULONG CcCopyReadWait = 0;
+ULONG CcCopyReadNoWait = 0;
+ULONG CcCopyReadWaitMiss = 0;
+ULONG CcCopyReadNoWaitMiss = 0;
+ULONG CcReadAheadIos = 0;
+
 /* FUNCTIONS *****************************************************************/
 
 VOID
@@ -126,70 +137,30 @@ CcPostDeferredWrites(VOID)
     }
 }
 
-VOID
-CcPerformReadAhead(
-    IN PFILE_OBJECT FileObject)
+static
+BOOLEAN
+CcpReadAheadRange(
+    _In_ PROS_SHARED_CACHE_MAP SharedCacheMap,
+    _In_ LONGLONG CurrentOffset,
+    _In_ ULONG Length)
 {
     NTSTATUS Status;
-    LONGLONG CurrentOffset;
-    KIRQL OldIrql;
-    PROS_SHARED_CACHE_MAP SharedCacheMap;
     PROS_VACB Vacb;
     ULONG PartialLength;
-    ULONG Length;
-    PPRIVATE_CACHE_MAP PrivateCacheMap;
-    BOOLEAN Locked;
     BOOLEAN Success;
 
-    SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
-
-    /* Critical:
-     * PrivateCacheMap might disappear in-between if the handle
-     * to the file is closed (private is attached to the handle not to
-     * the file), so we need to lock the master lock while we deal with
-     * it. It won't disappear without attempting to lock such lock.
-     */
-    OldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
-    PrivateCacheMap = FileObject->PrivateCacheMap;
-    /* If the handle was closed since the read ahead was scheduled, just quit */
-    if (PrivateCacheMap == NULL)
-    {
-        KeReleaseQueuedSpinLock(LockQueueMasterLock, OldIrql);
-        ObDereferenceObject(FileObject);
-        return;
-    }
-    /* Otherwise, extract read offset and length and release private map */
-    else
-    {
-        KeAcquireSpinLockAtDpcLevel(&PrivateCacheMap->ReadAheadSpinLock);
-        CurrentOffset = PrivateCacheMap->ReadAheadOffset[1].QuadPart;
-        Length = PrivateCacheMap->ReadAheadLength[1];
-        KeReleaseSpinLockFromDpcLevel(&PrivateCacheMap->ReadAheadSpinLock);
-    }
-    KeReleaseQueuedSpinLock(LockQueueMasterLock, OldIrql);
-
-    /* Time to go! */
-    DPRINT("Doing ReadAhead for %p\n", FileObject);
-    /* Lock the file, first */
-    if (!SharedCacheMap->Callbacks->AcquireForReadAhead(SharedCacheMap->LazyWriteContext, FALSE))
-    {
-        Locked = FALSE;
-        goto Clear;
-    }
-
-    /* Remember it's locked */
-    Locked = TRUE;
-
     /* Don't read past the end of the file */
     if (CurrentOffset >= SharedCacheMap->FileSize.QuadPart)
     {
-        goto Clear;
+        return TRUE;
     }
     if (CurrentOffset + Length > SharedCacheMap->FileSize.QuadPart)
     {
         Length = SharedCacheMap->FileSize.QuadPart - CurrentOffset;
     }
 
+    ++CcReadAheadIos;
+
     /* Next of the algorithm will lock like CcCopyData with the slight
      * difference that we don't copy data back to an user-backed buffer
      * We just bring data into Cc
@@ -204,7 +175,7 @@ CcPerformReadAhead(
         if (!NT_SUCCESS(Status))
         {
             DPRINT1("Failed to request VACB: %lx!\n", Status);
-            goto Clear;
+            return FALSE;
         }
 
         _SEH2_TRY
@@ -218,15 +189,14 @@ CcPerformReadAhead(
         }
         _SEH2_END
 
+        CcRosReleaseVacb(SharedCacheMap, Vacb, FALSE, FALSE);
+
         if (!Success)
         {
-            CcRosReleaseVacb(SharedCacheMap, Vacb, FALSE, FALSE);
             DPRINT1("Failed to read data: %lx!\n", Status);
-            goto Clear;
+            return FALSE;
         }
 
-        CcRosReleaseVacb(SharedCacheMap, Vacb, FALSE, FALSE);
-
         Length -= PartialLength;
         CurrentOffset += PartialLength;
     }
@@ -241,7 +211,7 @@ CcPerformReadAhead(
         if (!NT_SUCCESS(Status))
         {
             DPRINT1("Failed to request VACB: %lx!\n", Status);
-            goto Clear;
+            return FALSE;
         }
 
         _SEH2_TRY
@@ -254,19 +224,123 @@ CcPerformReadAhead(
         }
         _SEH2_END
 
+        CcRosReleaseVacb(SharedCacheMap, Vacb, FALSE, FALSE);
+
         if (!Success)
         {
-            CcRosReleaseVacb(SharedCacheMap, Vacb, FALSE, FALSE);
             DPRINT1("Failed to read data: %lx!\n", Status);
-            goto Clear;
+            return FALSE;
         }
 
-        CcRosReleaseVacb(SharedCacheMap, Vacb, FALSE, FALSE);
-
         Length -= PartialLength;
         CurrentOffset += PartialLength;
     }
 
+    return TRUE;
+}
+
+/* Must be called with the read ahead spin lock held */
+static
+ULONG
+CcpDequeueReadAhead(
+    _In_ PPRIVATE_CACHE_MAP PrivateCacheMap,
+    _Out_ PLONGLONG FileOffset)
+{
+    ULONG i, Length;
+    PROS_PRIVATE_CACHE_MAP PrivateMap;
+    PCC_READ_AHEAD_STREAM Stream;
+
+    PrivateMap = CONTAINING_RECORD(PrivateCacheMap, ROS_PRIVATE_CACHE_MAP, PrivateMap);
+    for (i = 0; i < CC_READ_AHEAD_STREAMS; i++)
+    {
+        Stream = &PrivateMap->Streams[i];
+        if (Stream->PendingLength != 0)
+        {
+            *FileOffset = Stream->PendingOffset;
+            Length = Stream->PendingLength;
+            Stream->PendingLength = 0;
+            return Length;
+        }
+    }
+
+    return 0;
+}
+
+VOID
+CcPerformReadAhead(
+    IN PFILE_OBJECT FileObject)
+{
+    LONGLONG CurrentOffset;
+    KIRQL OldIrql;
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+    ULONG Length;
+    PPRIVATE_CACHE_MAP PrivateCacheMap;
+    BOOLEAN Locked = FALSE;
+
+    SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
+
+    /* Critical:
+     * PrivateCacheMap might disappear in-between if the handle
+     * to the file is closed (private is attached to the handle not to
+     * the file), so we need to lock the master lock while we deal with
+     * it. It won't disappear without attempting to lock such lock.
+     */
+    OldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
+    PrivateCacheMap = FileObject->PrivateCacheMap;
+    KeReleaseQueuedSpinLock(LockQueueMasterLock, OldIrql);
+    /* If the handle was closed since the read ahead was scheduled, just quit */
+    if (PrivateCacheMap == NULL)
+    {
+        ObDereferenceObject(FileObject);
+        return;
+    }
+
+    /* Time to go! */
+    DPRINT("Doing ReadAhead for %p\n", FileObject);
+    /* Lock the file, first */
+    if (!SharedCacheMap->Callbacks->AcquireForReadAhead(SharedCacheMap->LazyWriteContext, FALSE))
+    {
+        goto Clear;
+    }
+
+    /* Remember it's locked */
+    Locked = TRUE;
+
+    /* Serve the streams until none of them has pending read ahead.
+     * Readers keep queuing ranges while we're active, see CcRosScheduleReadAhead
+     */
+    while (TRUE)
+    {
+        /* See previous comment about private cache map */
+        OldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
+        PrivateCacheMap = FileObject->PrivateCacheMap;
+        if (PrivateCacheMap == NULL)
+        {
+            KeReleaseQueuedSpinLock(LockQueueMasterLock, OldIrql);
+            goto Clear;
+        }
+
+        KeAcquireSpinLockAtDpcLevel(&PrivateCacheMap->ReadAheadSpinLock);
+        Length = CcpDequeueReadAhead(PrivateCacheMap, &CurrentOffset);
+        if (Length == 0)
+        {
+            /* Nothing left, mark read ahead as unactive while still holding the lock */
+            InterlockedAnd((volatile long *)&PrivateCacheMap->UlongFlags, ~PRIVATE_CACHE_MAP_READ_AHEAD_ACTIVE);
+        }
+        KeReleaseSpinLockFromDpcLevel(&PrivateCacheMap->ReadAheadSpinLock);
+        KeReleaseQueuedSpinLock(LockQueueMasterLock, OldIrql);
+
+        if (Length == 0)
+        {
+            goto Done;
+        }
+
+        if (!CcpReadAheadRange(SharedCacheMap, CurrentOffset, Length))
+        {
+            goto Clear;
+        }
+    }
+
 Clear:
     /* See previous comment about private cache map */
     OldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
@@ -280,6 +354,7 @@ Clear:
     }
     KeReleaseQueuedSpinLock(LockQueueMasterLock, OldIrql);
 
+Done:
     /* If file was locked, release it */
     if (Locked)
     {
@@ -499,6 +574,7 @@ CcCopyRead (
     LONGLONG CurrentOffset;
     LONGLONG ReadEnd = FileOffset->QuadPart + Length;
     ULONG ReadLength = 0;
+    BOOLEAN Missed = FALSE;
 
     CCTRACE(CC_API_DEBUG, "FileObject=%p FileOffset=%I64d Length=%lu Wait=%d\n",
         FileObject, FileOffset->QuadPart, Length, Wait);
@@ -514,6 +590,11 @@ CcCopyRead (
     /* Documented to ASSERT, but KMTests test this case... */
     // ASSERT((FileOffset->QuadPart + Length) <= SharedCacheMap->FileSize.QuadPart);
 
+    if (Wait)
+        ++CcCopyReadWait;
+    else
+        ++CcCopyReadNoWait;
+
     CurrentOffset = FileOffset->QuadPart;
     while(CurrentOffset < ReadEnd)
     {
@@ -530,8 +611,21 @@ CcCopyRead (
             ULONG VacbLength = min(Length, VACB_MAPPING_GRANULARITY - VacbOffset);
             SIZE_T CopyLength = VacbLength;
 
-            if (!CcRosEnsureVacbResident(Vacb, Wait, FALSE, VacbOffset, VacbLength))
-                return FALSE;
+            if (!CcRosEnsureVacbResident(Vacb, FALSE, FALSE, VacbOffset, VacbLength))
+            {
+                /* Not in the cache, we'll have to wait for the disk */
+                if (!Missed)
+                {
+                    Missed = TRUE;
+                    if (Wait)
+                        ++CcCopyReadWaitMiss;
+                    else
+                        ++CcCopyReadNoWaitMiss;
+                }
+
+                if (!CcRosEnsureVacbResident(Vacb, Wait, FALSE, VacbOffset, VacbLength))
+                    return FALSE;
+            }
 
             _SEH2_TRY
             {
@@ -559,28 +653,13 @@ CcCopyRead (
     IoStatus->Status = STATUS_SUCCESS;
     IoStatus->Information = ReadLength;
 
-#if 0
-    /* If that was a successful sync read operation, let's handle read ahead */
-    if (Length == 0 && Wait)
+    /* If that was a successful read operation, feed the read ahead stream detection,
+     * it will tell whether the read ahead window was large enough
+     */
+    if (ReadLength != 0 && !BooleanFlagOn(FileObject->Flags, FO_RANDOM_ACCESS))
     {
-        PPRIVATE_CACHE_MAP PrivateCacheMap = FileObject->PrivateCacheMap;
-
-        /* If file isn't random access and next read may get us cross VACB boundary,
-         * schedule next read
-         */
-        if (!BooleanFlagOn(FileObject->Flags, FO_RANDOM_ACCESS) &&
-            (CurrentOffset - 1) / VACB_MAPPING_GRANULARITY != (CurrentOffset + ReadLength - 1) / VACB_MAPPING_GRANULARITY)
-        {
-            CcScheduleReadAhead(FileObject, FileOffset, ReadLength);
-        }
-
-        /* And update read history in private cache map */
-        PrivateCacheMap->FileOffset1.QuadPart = PrivateCacheMap->FileOffset2.QuadPart;
-        PrivateCacheMap->BeyondLastByte1.QuadPart = PrivateCacheMap->BeyondLastByte2.QuadPart;
-        PrivateCacheMap->FileOffset2.QuadPart = FileOffset->QuadPart;
-        PrivateCacheMap->BeyondLastByte2.QuadPart = FileOffset->QuadPart + ReadLength;
+        CcRosScheduleReadAhead(FileObject, FileOffset, ReadLength, Missed);
     }
-#endif
 
     return TRUE;
 }
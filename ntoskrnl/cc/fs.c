@@ -239,7 +239,8 @@ CcPurgeCacheSection (
                       SharedCacheMap->SectionSize.QuadPart);
         if (ViewEnd >= EndOffset)
         {
-            break;
+            /* The VACB list isn't sorted by offset, keep looking */
+            continue;
         }
 
         /* Still in use, it cannot be purged, fail
@@ -262,6 +263,7 @@ CcPurgeCacheSection (
             CcRosUnmarkDirtyVacb(Vacb, FALSE);
         }
         RemoveEntryList(&Vacb->CacheMapVacbListEntry);
+        CcRosRemoveVacbFromIndex(Vacb);
         InsertHeadList(&FreeList, &Vacb->CacheMapVacbListEntry);
     }
     KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
@@ -114,21 +114,22 @@ CcScanDpc(
 }
 
 VOID
-CcWriteBehind(VOID)
+CcWriteBehind(
+    IN PDEVICE_OBJECT DeviceObject,
+    IN ULONG Target)
 {
-    ULONG Target, Count;
+    ULONG Count;
 
-    Target = CcTotalDirtyPages / 8;
     if (Target != 0)
     {
         /* Flush! */
-        DPRINT("Lazy writer starting (%d)\n", Target);
-        CcRosFlushDirtyPages(Target, &Count, FALSE, TRUE);
+        DPRINT("Lazy writer starting (%p, %d)\n", DeviceObject, Target);
+        CcRosFlushDirtyPages(Target, &Count, FALSE, TRUE, DeviceObject);
 
-        /* And update stats */
-        CcLazyWritePages += Count;
-        ++CcLazyWriteIos;
-        DPRINT("Lazy writer done (%d)\n", Count);
+        /* And update stats, other volumes may be flushed concurrently */
+        InterlockedExchangeAdd((PLONG)&CcLazyWritePages, Count);
+        InterlockedIncrement((PLONG)&CcLazyWriteIos);
+        DPRINT("Lazy writer done (%p, %d)\n", DeviceObject, Count);
     }
 
     /* Make sure we're not throttling writes after this */
@@ -142,6 +143,76 @@ CcWriteBehind(VOID)
     }
 }
 
+static
+VOID
+CcPostWriteBehind(VOID)
+{
+    KIRQL OldIrql;
+    PLIST_ENTRY ListEntry;
+    PWORK_QUEUE_ENTRY WorkItem;
+    PDEVICE_OBJECT Volumes[CC_MAX_LAZY_WRITE_VOLUMES];
+    ULONG DirtyPages[CC_MAX_LAZY_WRITE_VOLUMES];
+    ULONG VolumeCount, i;
+
+    /* Find out which volumes have dirty data, and how much.
+     * If there are too many of them, the last writer gets the leftovers.
+     */
+    VolumeCount = 0;
+    OldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
+    for (ListEntry = DirtyVacbListHead.Flink;
+         ListEntry != &DirtyVacbListHead;
+         ListEntry = ListEntry->Flink)
+    {
+        PROS_VACB Vacb = CONTAINING_RECORD(ListEntry, ROS_VACB, DirtyVacbListEntry);
+        PDEVICE_OBJECT DeviceObject = Vacb->SharedCacheMap->FileObject->DeviceObject;
+
+        for (i = 0; i < VolumeCount; i++)
+        {
+            if (Volumes[i] == DeviceObject || Volumes[i] == NULL)
+                break;
+        }
+
+        if (i == VolumeCount)
+        {
+            if (VolumeCount == CC_MAX_LAZY_WRITE_VOLUMES)
+            {
+                /* Table is full, turn the last writer into a catch-all */
+                i = VolumeCount - 1;
+                Volumes[i] = NULL;
+            }
+            else
+            {
+                Volumes[i] = DeviceObject;
+                DirtyPages[i] = 0;
+                VolumeCount++;
+            }
+        }
+
+        DirtyPages[i] += VACB_MAPPING_GRANULARITY / PAGE_SIZE;
+    }
+    KeReleaseQueuedSpinLock(LockQueueMasterLock, OldIrql);
+
+    /* Now, schedule one write-behind operation per volume, so that
+     * a slow disk doesn't hold the others back. Each of them will get
+     * its own worker thread, as long as there are idle ones.
+     */
+    for (i = 0; i < VolumeCount; i++)
+    {
+        /* Allocate a work item */
+        WorkItem = ExAllocateFromNPagedLookasideList(&CcTwilightLookasideList);
+        if (WorkItem == NULL)
+        {
+            break;
+        }
+
+        /* Our target is one-eighth of the dirty pages of that volume */
+        WorkItem->Function = WriteBehind;
+        WorkItem->Parameters.Write.DeviceObject = Volumes[i];
+        WorkItem->Parameters.Write.Target = max(DirtyPages[i] / 8, 1);
+        CcPostWorkQueue(WorkItem, &CcRegularWorkQueue);
+    }
+}
+
 VOID
 CcLazyWriteScan(VOID)
 {
@@ -170,15 +241,8 @@ CcLazyWriteScan(VOID)
     Target = CcTotalDirtyPages / 8;
     if (Target != 0)
     {
-        /* There is stuff to flush, schedule a write-behind operation */
-
-        /* Allocate a work item */
-        WorkItem = ExAllocateFromNPagedLookasideList(&CcTwilightLookasideList);
-        if (WorkItem != NULL)
-        {
-            WorkItem->Function = WriteBehind;
-            CcPostWorkQueue(WorkItem, &CcRegularWorkQueue);
-        }
+        /* There is stuff to flush, schedule write-behind operations */
+        CcPostWriteBehind();
     }
 
     /* Post items that were due for end of run */
@@ -318,7 +382,8 @@ CcWorkerThread(
 
             case WriteBehind:
                 PsGetCurrentThread()->MemoryMaker = 1;
-                CcWriteBehind();
+                CcWriteBehind(WorkItem->Parameters.Write.DeviceObject,
+                              WorkItem->Parameters.Write.Target);
                 PsGetCurrentThread()->MemoryMaker = 0;
                 WritePerformed = TRUE;
                 break;
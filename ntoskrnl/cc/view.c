@@ -158,51 +158,79 @@ CcRosTraceCacheMap (
 #endif
 }
 
+static
 NTSTATUS
-CcRosFlushVacb (
-    _In_ PROS_VACB Vacb,
+CcRosFlushVacbs (
+    _In_reads_(Count) PROS_VACB *Vacbs,
+    _In_ ULONG Count,
     _Out_opt_ PIO_STATUS_BLOCK Iosb)
+/*
+ * FUNCTION: Writes a run of adjacent VACBs of the same file with a single flush
+ */
 {
     NTSTATUS Status;
+    ULONG i;
+    LONGLONG FlushEnd;
     BOOLEAN HaveLock = FALSE;
-    PROS_SHARED_CACHE_MAP SharedCacheMap = Vacb->SharedCacheMap;
+    PROS_SHARED_CACHE_MAP SharedCacheMap = Vacbs[0]->SharedCacheMap;
+
+    for (i = 0; i < Count; i++)
+    {
+        ASSERT(Vacbs[i]->SharedCacheMap == SharedCacheMap);
+        ASSERT(Vacbs[i]->FileOffset.QuadPart ==
+               Vacbs[0]->FileOffset.QuadPart + (LONGLONG)i * VACB_MAPPING_GRANULARITY);
 
-    CcRosUnmarkDirtyVacb(Vacb, TRUE);
+        CcRosUnmarkDirtyVacb(Vacbs[i], TRUE);
+    }
 
     /* Lock for flush, if we are not already the top-level */
     if (IoGetTopLevelIrp() != (PIRP)FSRTL_CACHE_TOP_LEVEL_IRP)
     {
-        Status = FsRtlAcquireFileForCcFlushEx(Vacb->SharedCacheMap->FileObject);
+        Status = FsRtlAcquireFileForCcFlushEx(SharedCacheMap->FileObject);
         if (!NT_SUCCESS(Status))
             goto quit;
         HaveLock = TRUE;
     }
 
     Status = MmFlushSegment(SharedCacheMap->FileObject->SectionObjectPointer,
-                            &Vacb->FileOffset,
-                            VACB_MAPPING_GRANULARITY,
+                            &Vacbs[0]->FileOffset,
+                            Count * VACB_MAPPING_GRANULARITY,
                             Iosb);
 
     if (HaveLock)
     {
-        FsRtlReleaseFileForCcFlush(Vacb->SharedCacheMap->FileObject);
+        FsRtlReleaseFileForCcFlush(SharedCacheMap->FileObject);
     }
 
 quit:
     if (!NT_SUCCESS(Status))
-        CcRosMarkDirtyVacb(Vacb);
+    {
+        for (i = 0; i < Count; i++)
+        {
+            CcRosMarkDirtyVacb(Vacbs[i]);
+        }
+    }
     else
     {
         /* Update VDL */
-        if (SharedCacheMap->ValidDataLength.QuadPart < (Vacb->FileOffset.QuadPart + VACB_MAPPING_GRANULARITY))
+        FlushEnd = Vacbs[0]->FileOffset.QuadPart + (LONGLONG)Count * VACB_MAPPING_GRANULARITY;
+        if (SharedCacheMap->ValidDataLength.QuadPart < FlushEnd)
         {
-            SharedCacheMap->ValidDataLength.QuadPart = Vacb->FileOffset.QuadPart + VACB_MAPPING_GRANULARITY;
+            SharedCacheMap->ValidDataLength.QuadPart = FlushEnd;
         }
     }
 
     return Status;
 }
 
+NTSTATUS
+CcRosFlushVacb (
+    _In_ PROS_VACB Vacb,
+    _Out_opt_ PIO_STATUS_BLOCK Iosb)
+{
+    return CcRosFlushVacbs(&Vacb, 1, Iosb);
+}
+
 static
 NTSTATUS
 CcRosDeleteFileCache (
@@ -253,6 +281,7 @@ CcRosDeleteFileCache (
         ULONG RefCount;
 
         InitializeListHead(&Vacb->CacheMapVacbListEntry);
+        CcRosRemoveVacbFromIndex(Vacb);
 
         /* Flush to disk, if needed */
         if (Vacb->Dirty)
@@ -304,19 +333,62 @@ CcRosDeleteFileCache (
     return STATUS_SUCCESS;
 }
 
+/* Must be called with the shared cache map lock held */
+static
+PROS_VACB
+CcRosFindVacbInIndex (
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    LONGLONG FileOffset)
+{
+    PLIST_ENTRY Bucket;
+    PLIST_ENTRY current_entry;
+    PROS_VACB current;
+
+    /* Only the VACB mapping the slot of FileOffset can be chained in its bucket */
+    Bucket = CcRosVacbHashBucket(SharedCacheMap, FileOffset);
+    current_entry = Bucket->Flink;
+    while (current_entry != Bucket)
+    {
+        current = CONTAINING_RECORD(current_entry,
+                                    ROS_VACB,
+                                    CacheMapVacbHashEntry);
+        if (IsPointInRange(current->FileOffset.QuadPart,
+                           VACB_MAPPING_GRANULARITY,
+                           FileOffset))
+        {
+            return current;
+        }
+        current_entry = current_entry->Flink;
+    }
+
+    return NULL;
+}
+
 NTSTATUS
 CcRosFlushDirtyPages (
     ULONG Target,
     PULONG Count,
     BOOLEAN Wait,
-    BOOLEAN CalledFromLazy)
+    BOOLEAN CalledFromLazy,
+    PDEVICE_OBJECT DeviceObject)
+/*
+ * FUNCTION: Writes dirty VACBs to disk, grouping adjacent ones.
+ * ARGUMENTS:
+ *       Target - The number of pages to write, MAXULONG for all of them.
+ *       DeviceObject - If set, only write VACBs of files on this volume.
+ */
 {
     PLIST_ENTRY current_entry;
     NTSTATUS Status;
     KIRQL OldIrql;
     BOOLEAN FlushAll = (Target == MAXULONG);
+    PROS_VACB Run[CC_MAX_FLUSH_RUN];
+    ULONG RunLength, i;
+
+    DPRINT("CcRosFlushDirtyPages(Target %lu, DeviceObject %p)\n", Target, DeviceObject);
 
-    DPRINT("CcRosFlushDirtyPages(Target %lu)\n", Target);
+    /* We would never see the end of the list while skipping other volumes */
+    ASSERT(!FlushAll || DeviceObject == NULL);
 
     (*Count) = 0;
 
@@ -333,6 +405,7 @@ CcRosFlushDirtyPages (
     {
         PROS_SHARED_CACHE_MAP SharedCacheMap;
         PROS_VACB current;
+        LONGLONG RunStart;
         BOOLEAN Locked;
 
         if (current_entry == &DirtyVacbListHead)
@@ -348,10 +421,16 @@ CcRosFlushDirtyPages (
                                     DirtyVacbListEntry);
         current_entry = current_entry->Flink;
 
-        CcRosVacbIncRefCount(current);
-
         SharedCacheMap = current->SharedCacheMap;
 
+        /* Leave the other volumes to their own writer */
+        if (DeviceObject != NULL && SharedCacheMap->FileObject->DeviceObject != DeviceObject)
+        {
+            continue;
+        }
+
+        CcRosVacbIncRefCount(current);
+
         /* When performing lazy write, don't handle temporary files */
         if (CalledFromLazy && BooleanFlagOn(SharedCacheMap->FileObject->Flags, FO_TEMPORARY_FILE))
         {
@@ -380,6 +459,31 @@ CcRosFlushDirtyPages (
         /* Keep a ref on the shared cache map */
         SharedCacheMap->OpenCount++;
 
+        /* Write the dirty VACBs adjacent to this one along with it.
+         * Find where the run starts, then gather it, it includes current.
+         */
+        KeAcquireSpinLockAtDpcLevel(&SharedCacheMap->CacheMapLock);
+        RunStart = current->FileOffset.QuadPart;
+        for (i = 1; i < CC_MAX_FLUSH_RUN && RunStart >= VACB_MAPPING_GRANULARITY; i++)
+        {
+            PROS_VACB Previous = CcRosFindVacbInIndex(SharedCacheMap, RunStart - VACB_MAPPING_GRANULARITY);
+            if (Previous == NULL || !Previous->Dirty)
+                break;
+            RunStart -= VACB_MAPPING_GRANULARITY;
+        }
+        for (RunLength = 0; RunLength < CC_MAX_FLUSH_RUN; RunLength++)
+        {
+            PROS_VACB Next = CcRosFindVacbInIndex(SharedCacheMap,
+                                                  RunStart + (LONGLONG)RunLength * VACB_MAPPING_GRANULARITY);
+            if (Next == NULL || !Next->Dirty)
+                break;
+            if (Next != current)
+                CcRosVacbIncRefCount(Next);
+            Run[RunLength] = Next;
+        }
+        KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
+        ASSERT(RunLength > 0);
+
         KeReleaseQueuedSpinLock(LockQueueMasterLock, OldIrql);
 
         Locked = SharedCacheMap->Callbacks->AcquireForLazyWrite(SharedCacheMap->LazyWriteContext, Wait);
@@ -387,7 +491,10 @@ CcRosFlushDirtyPages (
         {
             DPRINT("Not locked!");
             ASSERT(!Wait);
-            CcRosVacbDecRefCount(current);
+            for (i = 0; i < RunLength; i++)
+            {
+                CcRosVacbDecRefCount(Run[i]);
+            }
             OldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
             SharedCacheMap->Flags &= ~SHARED_CACHE_MAP_IN_LAZYWRITE;
 
@@ -398,15 +505,18 @@ CcRosFlushDirtyPages (
         }
 
         IO_STATUS_BLOCK Iosb;
-        Status = CcRosFlushVacb(current, &Iosb);
+        Status = CcRosFlushVacbs(Run, RunLength, &Iosb);
 
         SharedCacheMap->Callbacks->ReleaseFromLazyWrite(SharedCacheMap->LazyWriteContext);
 
-        /* We release the VACB before acquiring the lock again, because
-         * CcRosVacbDecRefCount might free the VACB, as CcRosFlushVacb dropped a
+        /* We release the VACBs before acquiring the lock again, because
+         * CcRosVacbDecRefCount might free the VACB, as CcRosFlushVacbs dropped a
          * Refcount. Freeing must be done outside of the lock.
          * The refcount is decremented atomically. So this is OK. */
-        CcRosVacbDecRefCount(current);
+        for (i = 0; i < RunLength; i++)
+        {
+            CcRosVacbDecRefCount(Run[i]);
+        }
         OldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
 
         SharedCacheMap->Flags &= ~SHARED_CACHE_MAP_IN_LAZYWRITE;
@@ -520,6 +630,7 @@ retry:
             ASSERT(Refs == 1);
 
             RemoveEntryList(&current->CacheMapVacbListEntry);
+            CcRosRemoveVacbFromIndex(current);
             RemoveEntryList(&current->VacbLruListEntry);
             InitializeListHead(&current->VacbLruListEntry);
             InsertHeadList(&FreeList, &current->CacheMapVacbListEntry);
@@ -539,7 +650,7 @@ retry:
     if ((Target > 0) && !FlushedPages)
     {
         /* Flush dirty pages to disk */
-        CcRosFlushDirtyPages(Target, &PagesFreed, FALSE, FALSE);
+        CcRosFlushDirtyPages(Target, &PagesFreed, FALSE, FALSE, NULL);
         FlushedPages = TRUE;
 
         /* We can only swap as many pages as we flushed */
@@ -601,13 +712,12 @@ CcRosReleaseVacb (
     return STATUS_SUCCESS;
 }
 
-/* Returns with VACB Lock Held! */
+/* Returns with a reference on the VACB, if found */
 PROS_VACB
 CcRosLookupVacb (
     PROS_SHARED_CACHE_MAP SharedCacheMap,
     LONGLONG FileOffset)
 {
-    PLIST_ENTRY current_entry;
     PROS_VACB current;
     KIRQL oldIrql;
 
@@ -619,30 +729,16 @@ CcRosLookupVacb (
     oldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
     KeAcquireSpinLockAtDpcLevel(&SharedCacheMap->CacheMapLock);
 
-    current_entry = SharedCacheMap->CacheMapVacbListHead.Flink;
-    while (current_entry != &SharedCacheMap->CacheMapVacbListHead)
+    current = CcRosFindVacbInIndex(SharedCacheMap, FileOffset);
+    if (current != NULL)
     {
-        current = CONTAINING_RECORD(current_entry,
-                                    ROS_VACB,
-                                    CacheMapVacbListEntry);
-        if (IsPointInRange(current->FileOffset.QuadPart,
-                           VACB_MAPPING_GRANULARITY,
-                           FileOffset))
-        {
-            CcRosVacbIncRefCount(current);
-            KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
-            KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
-            return current;
-        }
-        if (current->FileOffset.QuadPart > FileOffset)
-            break;
-        current_entry = current_entry->Flink;
+        CcRosVacbIncRefCount(current);
     }
 
     KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
     KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
 
-    return NULL;
+    return current;
 }
 
 VOID
@@ -750,6 +846,7 @@ CcRosFreeOneUnusedVacb(
             /* Reset it, this is the one we want to free */
             RemoveEntryList(&current->CacheMapVacbListEntry);
             InitializeListHead(&current->CacheMapVacbListEntry);
+            CcRosRemoveVacbFromIndex(current);
             RemoveEntryList(&current->VacbLruListEntry);
             InitializeListHead(&current->VacbLruListEntry);
 
@@ -783,8 +880,6 @@ CcRosCreateVacb (
     PROS_VACB *Vacb)
 {
     PROS_VACB current;
-    PROS_VACB previous;
-    PLIST_ENTRY current_entry;
     NTSTATUS Status;
     KIRQL oldIrql;
     ULONG Refs;
@@ -803,6 +898,7 @@ CcRosCreateVacb (
     current->MappedCount = 0;
     current->ReferenceCount = 0;
     InitializeListHead(&current->CacheMapVacbListEntry);
+    InitializeListHead(&current->CacheMapVacbHashEntry);
     InitializeListHead(&current->DirtyVacbListEntry);
     InitializeListHead(&current->VacbLruListEntry);
 
@@ -845,56 +941,33 @@ CcRosCreateVacb (
      * our newly created VACB and return the existing one.
      */
     KeAcquireSpinLockAtDpcLevel(&SharedCacheMap->CacheMapLock);
-    current_entry = SharedCacheMap->CacheMapVacbListHead.Flink;
-    previous = NULL;
-    while (current_entry != &SharedCacheMap->CacheMapVacbListHead)
+    current = CcRosFindVacbInIndex(SharedCacheMap, FileOffset);
+    if (current != NULL)
     {
-        current = CONTAINING_RECORD(current_entry,
-                                    ROS_VACB,
-                                    CacheMapVacbListEntry);
-        if (IsPointInRange(current->FileOffset.QuadPart,
-                           VACB_MAPPING_GRANULARITY,
-                           FileOffset))
-        {
-            CcRosVacbIncRefCount(current);
-            KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
+        CcRosVacbIncRefCount(current);
+        KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
 #if DBG
-            if (SharedCacheMap->Trace)
-            {
-                DPRINT1("CacheMap 0x%p: deleting newly created VACB 0x%p ( found existing one 0x%p )\n",
-                        SharedCacheMap,
-                        (*Vacb),
-                        current);
-            }
+        if (SharedCacheMap->Trace)
+        {
+            DPRINT1("CacheMap 0x%p: deleting newly created VACB 0x%p ( found existing one 0x%p )\n",
+                    SharedCacheMap,
+                    (*Vacb),
+                    current);
+        }
 #endif
-            KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
+        KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
 
-            Refs = CcRosVacbDecRefCount(*Vacb);
-            ASSERT(Refs == 0);
+        Refs = CcRosVacbDecRefCount(*Vacb);
+        ASSERT(Refs == 0);
 
-            *Vacb = current;
-            return STATUS_SUCCESS;
-        }
-        if (current->FileOffset.QuadPart < FileOffset)
-        {
-            ASSERT(previous == NULL ||
-                   previous->FileOffset.QuadPart < current->FileOffset.QuadPart);
-            previous = current;
-        }
-        if (current->FileOffset.QuadPart > FileOffset)
-            break;
-        current_entry = current_entry->Flink;
+        *Vacb = current;
+        return STATUS_SUCCESS;
     }
-    /* There was no existing VACB. */
+    /* There was no existing VACB. The VACB list isn't sorted, lookups go through the index */
     current = *Vacb;
-    if (previous)
-    {
-        InsertHeadList(&previous->CacheMapVacbListEntry, &current->CacheMapVacbListEntry);
-    }
-    else
-    {
-        InsertHeadList(&SharedCacheMap->CacheMapVacbListHead, &current->CacheMapVacbListEntry);
-    }
+    InsertTailList(&SharedCacheMap->CacheMapVacbListHead, &current->CacheMapVacbListEntry);
+    InsertTailList(CcRosVacbHashBucket(SharedCacheMap, current->FileOffset.QuadPart),
+                   &current->CacheMapVacbHashEntry);
     KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
     InsertTailList(&VacbLruListHead, &current->VacbLruListEntry);
 
@@ -1056,6 +1129,7 @@ CcRosInternalFreeVacb (
 
     ASSERT(Vacb->ReferenceCount == 0);
     ASSERT(IsListEmpty(&Vacb->CacheMapVacbListEntry));
+    ASSERT(IsListEmpty(&Vacb->CacheMapVacbHashEntry));
     ASSERT(IsListEmpty(&Vacb->DirtyVacbListEntry));
     ASSERT(IsListEmpty(&Vacb->VacbLruListEntry));
 
@@ -1234,7 +1308,7 @@ CcRosReleaseFileCache (
             KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
 
             /* And free it. */
-            if (PrivateMap != &SharedCacheMap->PrivateCacheMap)
+            if (PrivateMap != &SharedCacheMap->PrivateCacheMap.PrivateMap)
             {
                 ExFreePoolWithTag(PrivateMap, TAG_PRIVATE_CACHE_MAP);
             }
@@ -1300,6 +1374,10 @@ CcRosInitializeFileCache (
         InitializeListHead(&SharedCacheMap->PrivateList);
         KeInitializeSpinLock(&SharedCacheMap->CacheMapLock);
         InitializeListHead(&SharedCacheMap->CacheMapVacbListHead);
+        for (ULONG i = 0; i < CC_VACB_HASH_BUCKETS; i++)
+        {
+            InitializeListHead(&SharedCacheMap->VacbHashTable[i]);
+        }
         InitializeListHead(&SharedCacheMap->BcbList);
 
         SharedCacheMap->Flags = SHARED_CACHE_MAP_IN_CREATION;
@@ -1337,13 +1415,13 @@ CcRosInitializeFileCache (
         PPRIVATE_CACHE_MAP PrivateMap;
 
         /* Allocate the private cache map for this handle */
-        if (SharedCacheMap->PrivateCacheMap.NodeTypeCode != 0)
+        if (SharedCacheMap->PrivateCacheMap.PrivateMap.NodeTypeCode != 0)
         {
-            PrivateMap = ExAllocatePoolWithTag(NonPagedPool, sizeof(PRIVATE_CACHE_MAP), TAG_PRIVATE_CACHE_MAP);
+            PrivateMap = ExAllocatePoolWithTag(NonPagedPool, sizeof(ROS_PRIVATE_CACHE_MAP), TAG_PRIVATE_CACHE_MAP);
         }
         else
         {
-            PrivateMap = &SharedCacheMap->PrivateCacheMap;
+            PrivateMap = &SharedCacheMap->PrivateCacheMap.PrivateMap;
         }
 
         if (PrivateMap == NULL)
@@ -1363,11 +1441,12 @@ CcRosInitializeFileCache (
         }
 
         /* Initialize it */
-        RtlZeroMemory(PrivateMap, sizeof(PRIVATE_CACHE_MAP));
+        RtlZeroMemory(PrivateMap, sizeof(ROS_PRIVATE_CACHE_MAP));
         PrivateMap->NodeTypeCode = NODE_TYPE_PRIVATE_MAP;
         PrivateMap->ReadAheadMask = PAGE_SIZE - 1;
         PrivateMap->FileObject = FileObject;
         KeInitializeSpinLock(&PrivateMap->ReadAheadSpinLock);
+        CONTAINING_RECORD(PrivateMap, ROS_PRIVATE_CACHE_MAP, PrivateMap)->DefaultWindow = CC_MIN_READ_AHEAD_WINDOW;
 
         /* Link it to the file */
         KeAcquireSpinLockAtDpcLevel(&SharedCacheMap->CacheMapLock);
@@ -1576,6 +1655,25 @@ ExpKdbgExtDefWrites(ULONG Argc, PCHAR Argv[])
     return TRUE;
 }
 
+BOOLEAN
+ExpKdbgExtReadAhead(ULONG Argc, PCHAR Argv[])
+{
+    KdbpPrint("CcCopyReadWait:\t\t%lu (%lu missed)\n", CcCopyReadWait, CcCopyReadWaitMiss);
+    KdbpPrint("CcCopyReadNoWait:\t%lu (%lu missed)\n", CcCopyReadNoWait, CcCopyReadNoWaitMiss);
+    KdbpPrint("CcReadAheadIos:\t\t%lu\n", CcReadAheadIos);
+    KdbpPrint("CcReadAheadStreams:\t%lu (%lu wasted)\n", CcReadAheadStreams, CcReadAheadWasted);
+    KdbpPrint("CcReadAheadHits:\t%lu\n", CcReadAheadHits);
+    KdbpPrint("CcReadAheadMisses:\t%lu\n", CcReadAheadMisses);
+
+    if (CcReadAheadHits + CcReadAheadMisses != 0)
+    {
+        KdbpPrint("Streams hit ratio:\t%lu%%\n",
+                  (ULONG)(((ULONGLONG)CcReadAheadHits * 100) / (CcReadAheadHits + CcReadAheadMisses)));
+    }
+
+    return TRUE;
+}
+
 #endif // DBG && defined(KDBG)
 
 /* EOF */
@@ -323,6 +323,20 @@ DATA_SEG("INITDATA") CM_SYSTEM_CONTROL_VECTOR CmControlVector[] =
         NULL,
         NULL
     },
+    {
+        L"Session Manager\\Memory Management",
+        L"ImageFaultAroundPages",
+        &MmImageFaultAroundPages,
+        NULL,
+        NULL
+    },
+    {
+        L"Session Manager\\Memory Management",
+        L"DataFaultAroundPages",
+        &MmDataFaultAroundPages,
+        NULL,
+        NULL
+    },
     {
         L"Session Manager\\Memory Management",
         L"SystemPages",
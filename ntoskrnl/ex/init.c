@@ -1567,6 +1567,10 @@ Phase1InitializationDiscard(IN PVOID Context)
     /* Initialize all processors */
     if (!HalAllProcessorsStarted()) KeBugCheck(HAL1_INITIALIZATION_FAILED);
 
+    /* Now that they are all up, give them their own pool lookaside lists */
+    ExInitPerProcessorPoolLookasides();
+    ExInitPerProcessorPoolTracker();
+
 #ifdef CONFIG_SMP
     /* HACK: We should use RtlFindMessage and not only fallback to this */
     MpString = "MultiProcessor Kernel\r\n";
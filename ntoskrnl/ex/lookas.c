@@ -83,6 +83,55 @@ ExInitPoolLookasidePointers(VOID)
     }
 }
 
+CODE_SEG("INIT")
+VOID
+NTAPI
+ExInitPerProcessorPoolLookasides(VOID)
+{
+    ULONG i;
+    CCHAR Cpu;
+    PKPRCB Prcb;
+    PGENERAL_LOOKASIDE Lists;
+
+    /* The boot processors all share the pool lists, now give each of them its own */
+    for (Cpu = 0; Cpu < KeNumberProcessors; Cpu++)
+    {
+        /* Get the PRCB for this CPU */
+        Prcb = KiProcessorBlock[(int)Cpu];
+
+        /* Allocate the non-paged and paged lists in one go */
+        Lists = ExAllocatePoolWithTag(NonPagedPool,
+                                      2 * NUMBER_POOL_LOOKASIDE_LISTS * sizeof(GENERAL_LOOKASIDE),
+                                      'looP');
+        if (!Lists)
+        {
+            /* Keep using the shared lists */
+            continue;
+        }
+
+        for (i = 0; i < NUMBER_POOL_LOOKASIDE_LISTS; i++)
+        {
+            /* Initialize the non-paged list and link it */
+            ExInitializeSystemLookasideList(&Lists[i],
+                                            NonPagedPool,
+                                            (i + 1) * 8,
+                                            'looP',
+                                            256,
+                                            &ExPoolLookasideListHead);
+            Prcb->PPNPagedLookasideList[i].P = &Lists[i];
+
+            /* Initialize the paged list and link it */
+            ExInitializeSystemLookasideList(&Lists[NUMBER_POOL_LOOKASIDE_LISTS + i],
+                                            PagedPool,
+                                            (i + 1) * 8,
+                                            'looP',
+                                            256,
+                                            &ExPoolLookasideListHead);
+            Prcb->PPPagedLookasideList[i].P = &Lists[NUMBER_POOL_LOOKASIDE_LISTS + i];
+        }
+    }
+}
+
 CODE_SEG("INIT")
 VOID
 NTAPI
@@ -119,6 +168,74 @@ ExpInitLookasideLists(VOID)
     }
 }
 
+static
+VOID
+ExpComputeLookasideDepth(IN PGENERAL_LOOKASIDE List,
+                         IN ULONG Misses)
+{
+    ULONG Allocates, MissRatio, Depth;
+
+    /* How much was the list used since the last scan? */
+    Allocates = List->TotalAllocates - List->LastTotalAllocates;
+    List->LastTotalAllocates = List->TotalAllocates;
+
+    Depth = List->Depth;
+    if (Allocates < 75)
+    {
+        /* Barely used, give the memory back slowly */
+        Depth = (Depth > 4 + 10) ? Depth - 10 : 4;
+    }
+    else
+    {
+        /* Misses per thousand allocations */
+        MissRatio = (ULONG)(((ULONGLONG)Misses * 1000) / Allocates);
+        if (MissRatio < 5)
+        {
+            /* Good enough, shrink a bit */
+            if (Depth > 4) Depth--;
+        }
+        else
+        {
+            /* Grow in proportion to the misses */
+            Depth += ((List->MaximumDepth - Depth) * MissRatio) / 2000 + 5;
+            if (Depth > List->MaximumDepth) Depth = List->MaximumDepth;
+        }
+    }
+
+    List->Depth = (USHORT)Depth;
+}
+
+VOID
+NTAPI
+ExAdjustLookasideDepth(VOID)
+{
+    PLIST_ENTRY ListEntry;
+    PGENERAL_LOOKASIDE List;
+    ULONG Hits;
+
+    /* The pool lists count their hits */
+    for (ListEntry = ExPoolLookasideListHead.Flink;
+         ListEntry != &ExPoolLookasideListHead;
+         ListEntry = ListEntry->Flink)
+    {
+        List = CONTAINING_RECORD(ListEntry, GENERAL_LOOKASIDE, ListEntry);
+        Hits = List->AllocateHits - List->LastAllocateHits;
+        List->LastAllocateHits = List->AllocateHits;
+        ExpComputeLookasideDepth(List,
+                                 (List->TotalAllocates - List->LastTotalAllocates) - Hits);
+    }
+
+    /* While the system lists count their misses */
+    for (ListEntry = ExSystemLookasideListHead.Flink;
+         ListEntry != &ExSystemLookasideListHead;
+         ListEntry = ListEntry->Flink)
+    {
+        List = CONTAINING_RECORD(ListEntry, GENERAL_LOOKASIDE, ListEntry);
+        ExpComputeLookasideDepth(List, List->AllocateMisses - List->LastAllocateMisses);
+        List->LastAllocateMisses = List->AllocateMisses;
+    }
+}
+
 /* PUBLIC FUNCTIONS **********************************************************/
 
 /*
@@ -15,6 +15,7 @@
 /* DATA **********************************************************************/
 
 ULONG ExPushLockSpinCount = 0;
+KI_SPIN_POLICY ExpPushLockSpinPolicy;
 
 #undef EX_PUSH_LOCK
 #undef PEX_PUSH_LOCK
@@ -49,6 +50,9 @@ ExpInitializePushLocks(VOID)
     if (KeNumberProcessors > 1)
         ExPushLockSpinCount = 1024;
 #endif
+
+    /* Start the adaptive spin from there */
+    ExpPushLockSpinPolicy.SpinLimit = ExPushLockSpinCount;
 }
 
 /*++
@@ -327,22 +331,15 @@ ExTimedWaitForUnblockPushLock(IN PEX_PUSH_LOCK PushLock,
                       SynchronizationEvent,
                       FALSE);
 
-#ifdef CONFIG_SMP
-    /* Spin on the push lock if necessary */
-    if (ExPushLockSpinCount)
+    /* Spin on the push lock, and leave early if we got lucky */
+    if (KiSpinOnContendedLock(&ExpPushLockSpinPolicy,
+                              &((PEX_PUSH_LOCK_WAIT_BLOCK)WaitBlock)->Flags,
+                              EX_PUSH_LOCK_WAITING,
+                              0,
+                              NULL))
     {
-        ULONG i = ExPushLockSpinCount;
-
-        do
-        {
-            /* Check if we got lucky and can leave early */
-            if (!(*(volatile LONG *)&((PEX_PUSH_LOCK_WAIT_BLOCK)WaitBlock)->Flags & EX_PUSH_LOCK_WAITING))
-                return STATUS_SUCCESS;
-
-            YieldProcessor();
-        } while (--i);
+        return STATUS_SUCCESS;
     }
-#endif
 
     /* Now try to remove the wait bit */
     if (InterlockedBitTestAndReset(&((PEX_PUSH_LOCK_WAIT_BLOCK)WaitBlock)->Flags,
@@ -592,21 +589,12 @@ ExfAcquirePushLockExclusive(PEX_PUSH_LOCK PushLock)
             /* Set up the Wait Gate */
             KeInitializeGate(&WaitBlock->WakeGate);
 
-#ifdef CONFIG_SMP
-            /* Now spin on the push lock if necessary */
-            if (ExPushLockSpinCount)
-            {
-                ULONG i = ExPushLockSpinCount;
-
-                do
-                {
-                    if (!(*(volatile LONG *)&WaitBlock->Flags & EX_PUSH_LOCK_WAITING))
-                        break;
-
-                    YieldProcessor();
-                } while (--i);
-            }
-#endif
+            /* Now spin on the push lock, the owner doesn't take long usually */
+            KiSpinOnContendedLock(&ExpPushLockSpinPolicy,
+                                  &WaitBlock->Flags,
+                                  EX_PUSH_LOCK_WAITING,
+                                  0,
+                                  NULL);
 
             /* Now try to remove the wait bit */
             if (InterlockedBitTestAndReset(&WaitBlock->Flags, 1))
@@ -759,21 +747,12 @@ ExfAcquirePushLockShared(PEX_PUSH_LOCK PushLock)
             /* Set up the Wait Gate */
             KeInitializeGate(&WaitBlock->WakeGate);
 
-#ifdef CONFIG_SMP
-            /* Now spin on the push lock if necessary */
-            if (ExPushLockSpinCount)
-            {
-                ULONG i = ExPushLockSpinCount;
-
-                do
-                {
-                    if (!(*(volatile LONG *)&WaitBlock->Flags & EX_PUSH_LOCK_WAITING))
-                        break;
-
-                    YieldProcessor();
-                } while (--i);
-            }
-#endif
+            /* Now spin on the push lock, the owner doesn't take long usually */
+            KiSpinOnContendedLock(&ExpPushLockSpinPolicy,
+                                  &WaitBlock->Flags,
+                                  EX_PUSH_LOCK_WAITING,
+                                  0,
+                                  NULL);
 
             /* Now try to remove the wait bit */
             if (InterlockedBitTestAndReset(&WaitBlock->Flags, 1))
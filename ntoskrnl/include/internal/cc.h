@@ -65,6 +65,15 @@ extern ULONG CcPinReadNoWait;
 extern ULONG CcPinMappedDataCount;
 extern ULONG CcDataPages;
 extern ULONG CcDataFlushes;
+extern ULONG CcCopyReadWait;
+extern ULONG CcCopyReadNoWait;
+extern ULONG CcCopyReadWaitMiss;
+extern ULONG CcCopyReadNoWaitMiss;
+extern ULONG CcReadAheadIos;
+extern ULONG CcReadAheadHits;
+extern ULONG CcReadAheadMisses;
+extern ULONG CcReadAheadStreams;
+extern ULONG CcReadAheadWasted;
 
 typedef struct _PF_SCENARIO_ID
 {
@@ -167,6 +176,46 @@ typedef struct _PFSN_PREFETCHER_GLOBALS
     LONG ActivePrefetches;
 } PFSN_PREFETCHER_GLOBALS, *PPFSN_PREFETCHER_GLOBALS;
 
+/* Number of interleaved sequential streams tracked per handle */
+#define CC_READ_AHEAD_STREAMS 4
+
+/* Bounds of the adaptive read ahead window */
+#define CC_MIN_READ_AHEAD_WINDOW (64 * 1024)
+#define CC_MAX_READ_AHEAD_WINDOW (4 * VACB_MAPPING_GRANULARITY)
+
+typedef struct _CC_READ_AHEAD_STREAM
+{
+    /* Offset where the next read of the stream is expected */
+    LONGLONG NextOffset;
+    /* End of the data already scheduled for read ahead */
+    LONGLONG ReadAheadEnd;
+    /* Range the read ahead worker still has to bring in */
+    LONGLONG PendingOffset;
+    ULONG PendingLength;
+    /* Current read ahead length, grows on misses */
+    ULONG Window;
+    /* Number of reads that continued the stream */
+    ULONG SequentialReads;
+    /* Last time (in StreamTick) the stream was used, 0 if free */
+    ULONG LastUse;
+} CC_READ_AHEAD_STREAM, *PCC_READ_AHEAD_STREAM;
+
+typedef struct _ROS_PRIVATE_CACHE_MAP
+{
+    /* Must be first, this is what FileObject->PrivateCacheMap points to */
+    PRIVATE_CACHE_MAP PrivateMap;
+
+    /* ROS specific, protected by the read ahead spin lock */
+    ULONG StreamTick;
+    /* Window new streams start with, adapted when streams are recycled */
+    ULONG DefaultWindow;
+    CC_READ_AHEAD_STREAM Streams[CC_READ_AHEAD_STREAMS];
+} ROS_PRIVATE_CACHE_MAP, *PROS_PRIVATE_CACHE_MAP;
+
+/* Number of buckets in the per shared cache map VACB index. Must be a power of 2.
+ * The number of VACBs is bounded by the system view space, so chains stay short. */
+#define CC_VACB_HASH_BUCKETS 64
+
 typedef struct _ROS_SHARED_CACHE_MAP
 {
     CSHORT NodeTypeCode;
@@ -187,10 +236,11 @@ typedef struct _ROS_SHARED_CACHE_MAP
     LIST_ENTRY PrivateList;
     ULONG DirtyPageThreshold;
     KSPIN_LOCK BcbSpinLock;
-    PRIVATE_CACHE_MAP PrivateCacheMap;
+    ROS_PRIVATE_CACHE_MAP PrivateCacheMap;
 
     /* ROS specific */
     LIST_ENTRY CacheMapVacbListHead;
+    LIST_ENTRY VacbHashTable[CC_VACB_HASH_BUCKETS];
     BOOLEAN PinAccess;
     KSPIN_LOCK CacheMapLock;
 #if DBG
@@ -214,6 +264,8 @@ typedef struct _ROS_VACB
     ULONG MappedCount;
     /* Entry in the list of VACBs for this shared cache map. */
     LIST_ENTRY CacheMapVacbListEntry;
+    /* Entry in the shared cache map VACB index, keyed by file offset. */
+    LIST_ENTRY CacheMapVacbHashEntry;
     /* Entry in the list of VACBs which are dirty. */
     LIST_ENTRY DirtyVacbListEntry;
     /* Entry in the list of VACBs. */
@@ -260,6 +312,9 @@ typedef struct _WORK_QUEUE_ENTRY
         struct
         {
             SHARED_CACHE_MAP *SharedCacheMap;
+            /* Volume to write behind for, NULL for any */
+            PDEVICE_OBJECT DeviceObject;
+            ULONG Target;
         } Write;
         struct
         {
@@ -283,6 +338,12 @@ typedef enum _WORK_QUEUE_FUNCTIONS
 
 extern LAZY_WRITER LazyWriter;
 
+/* Maximum number of volumes written behind in parallel */
+#define CC_MAX_LAZY_WRITE_VOLUMES 8
+
+/* Maximum number of adjacent dirty VACBs written at once */
+#define CC_MAX_FLUSH_RUN 16
+
 #define NODE_TYPE_DEFERRED_WRITE 0x02FC
 #define NODE_TYPE_PRIVATE_MAP    0x02FE
 #define NODE_TYPE_SHARED_MAP     0x02FF
@@ -368,7 +429,8 @@ CcRosFlushDirtyPages(
     ULONG Target,
     PULONG Count,
     BOOLEAN Wait,
-    BOOLEAN CalledFromLazy
+    BOOLEAN CalledFromLazy,
+    PDEVICE_OBJECT DeviceObject
 );
 
 VOID
@@ -437,6 +499,13 @@ VOID
 CcPerformReadAhead(
     IN PFILE_OBJECT FileObject);
 
+VOID
+CcRosScheduleReadAhead(
+    _In_ PFILE_OBJECT FileObject,
+    _In_ PLARGE_INTEGER FileOffset,
+    _In_ ULONG Length,
+    _In_ BOOLEAN Missed);
+
 NTSTATUS
 CcRosInternalFreeVacb(
     IN PROS_VACB Vacb);
@@ -466,6 +535,27 @@ IsPointInRange(
     return DoRangesIntersect(Offset1, Length1, Point, 1);
 }
 
+FORCEINLINE
+PLIST_ENTRY
+CcRosVacbHashBucket(
+    _In_ PROS_SHARED_CACHE_MAP SharedCacheMap,
+    _In_ LONGLONG FileOffset)
+{
+    ULONG Index = (ULONG)(FileOffset / VACB_MAPPING_GRANULARITY) & (CC_VACB_HASH_BUCKETS - 1);
+
+    return &SharedCacheMap->VacbHashTable[Index];
+}
+
+/* Must be called with the shared cache map lock held */
+FORCEINLINE
+VOID
+CcRosRemoveVacbFromIndex(
+    _In_ PROS_VACB Vacb)
+{
+    RemoveEntryList(&Vacb->CacheMapVacbHashEntry);
+    InitializeListHead(&Vacb->CacheMapVacbHashEntry);
+}
+
 #define CcBugCheck(A, B, C) KeBugCheckEx(CACHE_MANAGER, BugCheckFileId | ((ULONG)(__LINE__)), A, B, C)
 
 #if DBG
@@ -11,6 +11,7 @@ extern RTL_TIME_ZONE_INFORMATION ExpTimeZoneInfo;
 extern LARGE_INTEGER ExpTimeZoneBias;
 extern ULONG ExpTimeZoneId;
 extern ULONG ExpTickCountMultiplier;
+extern KI_SPIN_POLICY ExpPushLockSpinPolicy;
 extern ULONG ExpLastTimeZoneBias;
 extern POBJECT_TYPE ExEventPairObjectType;
 extern POBJECT_TYPE _ExEventObjectType, _ExSemaphoreObjectType;
@@ -316,6 +317,20 @@ VOID
 NTAPI
 ExInitPoolLookasidePointers(VOID);
 
+CODE_SEG("INIT")
+VOID
+NTAPI
+ExInitPerProcessorPoolLookasides(VOID);
+
+CODE_SEG("INIT")
+VOID
+NTAPI
+ExInitPerProcessorPoolTracker(VOID);
+
+VOID
+NTAPI
+ExAdjustLookasideDepth(VOID);
+
 /* Callback Functions ********************************************************/
 
 VOID
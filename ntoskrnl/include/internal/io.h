@@ -90,6 +90,11 @@
 //
 #define IOP_MAX_REPARSE_TRAVERSAL 0x20
 
+//
+// Max completion packets removed by a single NtRemoveIoCompletionEx call
+//
+#define IOP_MAX_REMOVE_ENTRIES 64
+
 //
 // Private flags for IoCreateFile / IoParseDevice
 //
@@ -1321,6 +1326,15 @@ IopDeleteIoCompletion(
     PVOID ObjectBody
 );
 
+VOID
+NTAPI
+IopUnpackCompletionPacket(
+    IN PLIST_ENTRY ListEntry,
+    OUT PVOID *KeyContext,
+    OUT PVOID *ApcContext,
+    OUT PIO_STATUS_BLOCK IoStatusBlock
+);
+
 NTSTATUS
 NTAPI
 IoSetIoCompletion(
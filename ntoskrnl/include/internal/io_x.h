@@ -165,3 +165,23 @@ IopValidateOpenPacket(IN POPEN_PACKET OpenPacket)
     /* Good packet */
     return TRUE;
 }
+
+FORCEINLINE
+BOOLEAN
+IopSkipCompletionPort(IN PFILE_OBJECT FileObject,
+                      IN NTSTATUS Status)
+{
+    /* The caller already saw this result and handles it inline */
+    return ((FileObject->Flags & FO_SKIP_COMPLETION_PORT) && NT_SUCCESS(Status));
+}
+
+FORCEINLINE
+BOOLEAN
+IopSkipSetEvent(IN PFILE_OBJECT FileObject,
+                IN NTSTATUS Status)
+{
+    /* Synchronous I/O and failures are still waited on through the file object */
+    return ((FileObject->Flags & FO_SKIP_SET_EVENT) &&
+            !(FileObject->Flags & FO_SYNCHRONOUS_IO) &&
+            NT_SUCCESS(Status));
+}
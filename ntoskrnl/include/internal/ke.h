@@ -83,6 +83,18 @@ typedef struct _KNMI_HANDLER_CALLBACK
     PVOID Handle;
 } KNMI_HANDLER_CALLBACK, *PKNMI_HANDLER_CALLBACK;
 
+//
+// Adaptive spin state shared by all locks of one kind. The spin limit grows
+// when spinning got the lock and shrinks when it had to block anyway.
+//
+typedef struct _KI_SPIN_POLICY
+{
+    LONG SpinLimit;
+    LONG Contentions;
+    LONG SpinAcquires;
+    LONG BlockedAcquires;
+} KI_SPIN_POLICY, *PKI_SPIN_POLICY;
+
 typedef PCHAR
 (NTAPI *PKE_BUGCHECK_UNICODE_TO_ANSI)(
     IN PUNICODE_STRING Unicode,
@@ -91,6 +103,8 @@ typedef PCHAR
 );
 
 extern KAFFINITY KeActiveProcessors;
+extern KI_SPIN_POLICY KiFastMutexSpinPolicy;
+extern KI_SPIN_POLICY KiGuardedMutexSpinPolicy;
 extern PKNMI_HANDLER_CALLBACK KiNmiCallbackListHead;
 extern KSPIN_LOCK KiNmiCallbackListLock;
 extern PVOID KeUserApcDispatcher;
@@ -323,6 +337,16 @@ KiAcquireFastMutex(
     IN PFAST_MUTEX FastMutex
 );
 
+BOOLEAN
+FASTCALL
+KiSpinOnContendedLock(
+    IN OUT PKI_SPIN_POLICY Policy,
+    IN volatile LONG *Value,
+    IN LONG Mask,
+    IN LONG Expected,
+    IN PKTHREAD volatile *Owner
+);
+
 /* gate.c **********************************************************************/
 
 VOID
@@ -721,6 +745,19 @@ VOID
 FASTCALL
 KiActivateWaiterQueue(IN PKQUEUE Queue);
 
+#if (NTDDI_VERSION < NTDDI_VISTA)
+ULONG
+NTAPI
+KeRemoveQueueEx(
+    IN PKQUEUE Queue,
+    IN KPROCESSOR_MODE WaitMode,
+    IN BOOLEAN Alertable,
+    IN PLARGE_INTEGER Timeout OPTIONAL,
+    OUT PLIST_ENTRY *EntryArray,
+    IN ULONG Count
+);
+#endif
+
 ULONG
 NTAPI
 KeQueryRuntimeProcess(IN PKPROCESS Process,
@@ -825,6 +862,11 @@ FASTCALL
 KeZeroPages(IN PVOID Address,
             IN ULONG Size);
 
+VOID
+FASTCALL
+KeZeroPagesNonTemporal(IN PVOID Address,
+                       IN ULONG Size);
+
 BOOLEAN
 FASTCALL
 KeInvalidAccessAllowed(IN PVOID TrapInformation OPTIONAL);
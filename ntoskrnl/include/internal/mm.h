@@ -46,6 +46,9 @@ extern SIZE_T MmPagedPoolCommit;
 extern SIZE_T MmPeakCommitment;
 extern SIZE_T MmtotalCommitLimitMaximum;
 
+extern ULONG MmImageFaultAroundPages;
+extern ULONG MmDataFaultAroundPages;
+
 extern PVOID MiDebugMapping; // internal
 extern PMMPTE MmDebugPte; // internal
 
@@ -1107,8 +1110,10 @@ MiUnmapPageInHyperSpace(IN PEPROCESS Process,
 
 PVOID
 NTAPI
-MiMapPagesInZeroSpace(IN PMMPFN Pfn1,
-                      IN PFN_NUMBER NumberOfPages);
+MiMapPagesInZeroSpace(IN PMMPTE ZeroingPte,
+                      IN PMMPFN Pfn1,
+                      IN PFN_NUMBER NumberOfPages,
+                      IN BOOLEAN NonTemporal);
 
 VOID
 NTAPI
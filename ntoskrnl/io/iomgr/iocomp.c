@@ -95,6 +95,50 @@ IopFreeMiniPacket(PIOP_MINI_COMPLETION_PACKET Packet)
     InterlockedPushEntrySList(&List->L.ListHead, (PSLIST_ENTRY)Packet);
 }
 
+VOID
+NTAPI
+IopUnpackCompletionPacket(IN PLIST_ENTRY ListEntry,
+                          OUT PVOID *KeyContext,
+                          OUT PVOID *ApcContext,
+                          OUT PIO_STATUS_BLOCK IoStatusBlock)
+{
+    PIOP_MINI_COMPLETION_PACKET Packet;
+    PIRP Irp;
+
+    /* Get the Packet Data */
+    Packet = CONTAINING_RECORD(ListEntry,
+                               IOP_MINI_COMPLETION_PACKET,
+                               ListEntry);
+
+    /* Check if this is piggybacked on an IRP */
+    if (Packet->PacketType == IopCompletionPacketIrp)
+    {
+        /* Get the IRP */
+        Irp = CONTAINING_RECORD(ListEntry,
+                                IRP,
+                                Tail.Overlay.ListEntry);
+
+        /* Save values */
+        *KeyContext = Irp->Tail.CompletionKey;
+        *ApcContext = Irp->Overlay.AsynchronousParameters.UserApcContext;
+        *IoStatusBlock = Irp->IoStatus;
+
+        /* Free the IRP */
+        IoFreeIrp(Irp);
+    }
+    else
+    {
+        /* Save values */
+        *KeyContext = Packet->KeyContext;
+        *ApcContext = Packet->ApcContext;
+        IoStatusBlock->Status = Packet->IoStatus;
+        IoStatusBlock->Information = Packet->IoStatusInformation;
+
+        /* Free the packet */
+        IopFreeMiniPacket(Packet);
+    }
+}
+
 VOID
 NTAPI
 IopDeleteIoCompletion(PVOID ObjectBody)
@@ -450,11 +494,9 @@ NtRemoveIoCompletion(IN HANDLE IoCompletionHandle,
 {
     LARGE_INTEGER SafeTimeout;
     PKQUEUE Queue;
-    PIOP_MINI_COMPLETION_PACKET Packet;
     PLIST_ENTRY ListEntry;
     KPROCESSOR_MODE PreviousMode = ExGetPreviousMode();
     NTSTATUS Status;
-    PIRP Irp;
     PVOID Apc, Key;
     IO_STATUS_BLOCK IoStatus;
     PAGED_CODE();
@@ -507,38 +549,8 @@ NtRemoveIoCompletion(IN HANDLE IoCompletionHandle,
         }
         else
         {
-            /* Get the Packet Data */
-            Packet = CONTAINING_RECORD(ListEntry,
-                                       IOP_MINI_COMPLETION_PACKET,
-                                       ListEntry);
-
-            /* Check if this is piggybacked on an IRP */
-            if (Packet->PacketType == IopCompletionPacketIrp)
-            {
-                /* Get the IRP */
-                Irp = CONTAINING_RECORD(ListEntry,
-                                        IRP,
-                                        Tail.Overlay.ListEntry);
-
-                /* Save values */
-                Key = Irp->Tail.CompletionKey;
-                Apc = Irp->Overlay.AsynchronousParameters.UserApcContext;
-                IoStatus = Irp->IoStatus;
-
-                /* Free the IRP */
-                IoFreeIrp(Irp);
-            }
-            else
-            {
-                /* Save values */
-                Key = Packet->KeyContext;
-                Apc = Packet->ApcContext;
-                IoStatus.Status = Packet->IoStatus;
-                IoStatus.Information = Packet->IoStatusInformation;
-
-                /* Free the packet */
-                IopFreeMiniPacket(Packet);
-            }
+            /* Get the Packet Data and free the packet */
+            IopUnpackCompletionPacket(ListEntry, &Key, &Apc, &IoStatus);
 
             /* Enter SEH to write back the values */
             _SEH2_TRY
@@ -564,6 +576,124 @@ NtRemoveIoCompletion(IN HANDLE IoCompletionHandle,
     return Status;
 }
 
+NTSTATUS
+NTAPI
+NtRemoveIoCompletionEx(IN HANDLE IoCompletionHandle,
+                       OUT PFILE_IO_COMPLETION_INFORMATION IoCompletionInformation,
+                       IN ULONG Count,
+                       OUT PULONG NumEntriesRemoved,
+                       IN PLARGE_INTEGER Timeout OPTIONAL,
+                       IN BOOLEAN Alertable)
+{
+    LARGE_INTEGER SafeTimeout;
+    PKQUEUE Queue;
+    PLIST_ENTRY EntryArray[IOP_MAX_REMOVE_ENTRIES];
+    FILE_IO_COMPLETION_INFORMATION Information;
+    KPROCESSOR_MODE PreviousMode = ExGetPreviousMode();
+    NTSTATUS Status;
+    ULONG Removed, i;
+    PAGED_CODE();
+
+    /* We need room for at least one entry */
+    if (!Count) return STATUS_INVALID_PARAMETER;
+
+    /* Check if the call was from user mode */
+    if (PreviousMode != KernelMode)
+    {
+        /* Protect probes in SEH */
+        _SEH2_TRY
+        {
+            /* Probe the entry array, without letting the size wrap */
+            if (Count > MAXULONG / sizeof(FILE_IO_COMPLETION_INFORMATION))
+            {
+                _SEH2_YIELD(return STATUS_INVALID_PARAMETER);
+            }
+            ProbeForWrite(IoCompletionInformation,
+                          Count * sizeof(FILE_IO_COMPLETION_INFORMATION),
+                          sizeof(PVOID));
+
+            /* Probe the count */
+            ProbeForWriteUlong(NumEntriesRemoved);
+            if (Timeout)
+            {
+                /* Probe and capture the timeout */
+                SafeTimeout = ProbeForReadLargeInteger(Timeout);
+                Timeout = &SafeTimeout;
+            }
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            /* Return the exception code */
+            _SEH2_YIELD(return _SEH2_GetExceptionCode());
+        }
+        _SEH2_END;
+    }
+
+    /* Open the Object */
+    Status = ObReferenceObjectByHandle(IoCompletionHandle,
+                                       IO_COMPLETION_MODIFY_STATE,
+                                       IoCompletionType,
+                                       PreviousMode,
+                                       (PVOID*)&Queue,
+                                       NULL);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    /* Remove up to a stack full of entries, the caller simply calls again for more */
+    Removed = KeRemoveQueueEx(Queue,
+                              PreviousMode,
+                              Alertable,
+                              Timeout,
+                              EntryArray,
+                              min(Count, IOP_MAX_REMOVE_ENTRIES));
+
+    /* If we got a timeout or an alert back, return the status */
+    if ((Removed == 1) &&
+        (((NTSTATUS)(ULONG_PTR)EntryArray[0] == STATUS_TIMEOUT) ||
+         ((NTSTATUS)(ULONG_PTR)EntryArray[0] == STATUS_USER_APC) ||
+         ((NTSTATUS)(ULONG_PTR)EntryArray[0] == STATUS_ALERTED)))
+    {
+        Status = (NTSTATUS)(ULONG_PTR)EntryArray[0];
+        Removed = 0;
+    }
+
+    /* Enter SEH to write back the values */
+    _SEH2_TRY
+    {
+        for (i = 0; i < Removed; i++)
+        {
+            /* Get the Packet Data and free the packet, then write it out */
+            IopUnpackCompletionPacket(EntryArray[i],
+                                      &Information.KeyContext,
+                                      &Information.ApcContext,
+                                      &Information.IoStatusBlock);
+            IoCompletionInformation[i] = Information;
+        }
+
+        *NumEntriesRemoved = Removed;
+    }
+    _SEH2_EXCEPT(ExSystemExceptionFilter())
+    {
+        /* Free what we couldn't hand out */
+        for (i++; i < Removed; i++)
+        {
+            IopUnpackCompletionPacket(EntryArray[i],
+                                      &Information.KeyContext,
+                                      &Information.ApcContext,
+                                      &Information.IoStatusBlock);
+        }
+
+        /* Get the exception code */
+        Status = _SEH2_GetExceptionCode();
+    }
+    _SEH2_END;
+
+    /* Dereference the Object */
+    ObDereferenceObject(Queue);
+
+    /* Return status */
+    return Status;
+}
+
 NTSTATUS
 NTAPI
 NtSetIoCompletion(IN HANDLE IoCompletionPortHandle,
@@ -433,10 +433,11 @@ IopDeviceFsIoControl(IN HANDLE DeviceHandle,
                     CompletionInfo = *(FileObject->CompletionContext);
                 }
 
-                /* If we had an event, signal it */
+                /* If we had an event, signal it, unless the caller opted out */
                 if (Event)
                 {
-                    KeSetEvent(EventObject, IO_NO_INCREMENT, FALSE);
+                    if (!(FileObject->Flags & FO_SKIP_SET_FAST_IO))
+                        KeSetEvent(EventObject, IO_NO_INCREMENT, FALSE);
                     ObDereferenceObject(EventObject);
                 }
 
@@ -447,7 +448,8 @@ IopDeviceFsIoControl(IN HANDLE DeviceHandle,
                 }
 
                 /* Set completion if required */
-                if (CompletionInfo.Port != NULL && UserApcContext != NULL)
+                if (CompletionInfo.Port != NULL && UserApcContext != NULL &&
+                    !IopSkipCompletionPort(FileObject, KernelIosb.Status))
                 {
                     if (!NT_SUCCESS(IoSetIoCompletion(CompletionInfo.Port,
                                                       CompletionInfo.Key,
@@ -1886,15 +1888,17 @@ NtLockFile(IN HANDLE FileHandle,
             }
             _SEH2_END;
 
-            /* If we had an event, signal it */
+            /* If we had an event, signal it, unless the caller opted out */
             if (EventHandle)
             {
-                KeSetEvent(Event, IO_NO_INCREMENT, FALSE);
+                if (!(FileObject->Flags & FO_SKIP_SET_FAST_IO))
+                    KeSetEvent(Event, IO_NO_INCREMENT, FALSE);
                 ObDereferenceObject(Event);
             }
 
             /* Set completion if required */
-            if (FileObject->CompletionContext != NULL && ApcContext != NULL)
+            if (FileObject->CompletionContext != NULL && ApcContext != NULL &&
+                !IopSkipCompletionPort(FileObject, KernelIosb.Status))
             {
                 if (!NT_SUCCESS(IoSetIoCompletion(FileObject->CompletionContext->Port,
                                                   FileObject->CompletionContext->Key,
@@ -2917,13 +2921,29 @@ NtReadFile(IN HANDLE FileHandle,
                 }
                 _SEH2_END;
 
-                /* Signal the completion event */
+                /* Signal the completion event, unless the caller opted out */
                 if (EventObject)
                 {
-                    KeSetEvent(EventObject, 0, FALSE);
+                    if (!(FileObject->Flags & FO_SKIP_SET_FAST_IO))
+                        KeSetEvent(EventObject, 0, FALSE);
                     ObDereferenceObject(EventObject);
                 }
 
+                /* Set completion if required */
+                if (FileObject->CompletionContext != NULL && ApcContext != NULL &&
+                    !IopSkipCompletionPort(FileObject, KernelIosb.Status))
+                {
+                    if (!NT_SUCCESS(IoSetIoCompletion(FileObject->CompletionContext->Port,
+                                                      FileObject->CompletionContext->Key,
+                                                      ApcContext,
+                                                      KernelIosb.Status,
+                                                      KernelIosb.Information,
+                                                      TRUE)))
+                    {
+                        KernelIosb.Status = STATUS_INSUFFICIENT_RESOURCES;
+                    }
+                }
+
                 /* Clean up */
                 IopUnlockFileObject(FileObject);
                 ObDereferenceObject(FileObject);
@@ -3113,6 +3133,7 @@ NtSetInformationFile(IN HANDLE FileHandle,
     IO_STATUS_BLOCK KernelIosb;
     PVOID Queue;
     PFILE_COMPLETION_INFORMATION CompletionInfo = FileInformation;
+    PFILE_IO_COMPLETION_NOTIFICATION_INFORMATION NotificationInfo;
     PIO_COMPLETION_CONTEXT Context;
     PFILE_RENAME_INFORMATION RenameInfo;
     HANDLE TargetHandle = NULL;
@@ -3377,6 +3398,32 @@ NtSetInformationFile(IN HANDLE FileHandle,
         Irp->IoStatus.Status = Status;
         Irp->IoStatus.Information = 0;
     }
+    else if (FileInformationClass == FileIoCompletionNotificationInformation)
+    {
+        /* This one is for us as well, check the modes first */
+        NotificationInfo = Irp->AssociatedIrp.SystemBuffer;
+        if (NotificationInfo->Flags & ~(FILE_SKIP_COMPLETION_PORT_ON_SUCCESS |
+                                        FILE_SKIP_SET_EVENT_ON_HANDLE |
+                                        FILE_SKIP_SET_USER_EVENT_ON_FAST_IO))
+        {
+            Status = STATUS_INVALID_PARAMETER;
+        }
+        else
+        {
+            /* Modes can only be turned on, and other flags may change meanwhile */
+            if (NotificationInfo->Flags & FILE_SKIP_COMPLETION_PORT_ON_SUCCESS)
+                InterlockedOr((PLONG)&FileObject->Flags, FO_SKIP_COMPLETION_PORT);
+            if (NotificationInfo->Flags & FILE_SKIP_SET_EVENT_ON_HANDLE)
+                InterlockedOr((PLONG)&FileObject->Flags, FO_SKIP_SET_EVENT);
+            if (NotificationInfo->Flags & FILE_SKIP_SET_USER_EVENT_ON_FAST_IO)
+                InterlockedOr((PLONG)&FileObject->Flags, FO_SKIP_SET_FAST_IO);
+            Status = STATUS_SUCCESS;
+        }
+
+        /* Set the IRP Status */
+        Irp->IoStatus.Status = Status;
+        Irp->IoStatus.Information = 0;
+    }
     else if (FileInformationClass == FileRenameInformation ||
              FileInformationClass == FileLinkInformation ||
              FileInformationClass == FileMoveClusterInformation)
@@ -3992,13 +4039,29 @@ NtWriteFile(IN HANDLE FileHandle,
                 }
                 _SEH2_END;
 
-                /* Signal the completion event */
+                /* Signal the completion event, unless the caller opted out */
                 if (EventObject)
                 {
-                    KeSetEvent(EventObject, 0, FALSE);
+                    if (!(FileObject->Flags & FO_SKIP_SET_FAST_IO))
+                        KeSetEvent(EventObject, 0, FALSE);
                     ObDereferenceObject(EventObject);
                 }
 
+                /* Set completion if required */
+                if (FileObject->CompletionContext != NULL && ApcContext != NULL &&
+                    !IopSkipCompletionPort(FileObject, KernelIosb.Status))
+                {
+                    if (!NT_SUCCESS(IoSetIoCompletion(FileObject->CompletionContext->Port,
+                                                      FileObject->CompletionContext->Key,
+                                                      ApcContext,
+                                                      KernelIosb.Status,
+                                                      KernelIosb.Information,
+                                                      TRUE)))
+                    {
+                        KernelIosb.Status = STATUS_INSUFFICIENT_RESOURCES;
+                    }
+                }
+
                 /* Clean up */
                 IopUnlockFileObject(FileObject);
                 ObDereferenceObject(FileObject);
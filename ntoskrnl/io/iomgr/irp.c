@@ -332,8 +332,14 @@ IopCompleteRequest(IN PKAPC Apc,
         (Irp->PendingReturned &&
          !IsIrpSynchronous(Irp, FileObject)))
     {
-        /* Get any information we need from the FO before we kill it */
-        if ((FileObject) && (FileObject->CompletionContext))
+        /*
+         * Get any information we need from the FO before we kill it. A request
+         * that didn't pend already told the caller about its success, so skip
+         * the port if the caller asked for it.
+         */
+        if ((FileObject) && (FileObject->CompletionContext) &&
+            ((Irp->PendingReturned) ||
+             !(IopSkipCompletionPort(FileObject, Irp->IoStatus.Status))))
         {
             /* Save Completion Data */
             Port = FileObject->CompletionContext->Port;
@@ -399,8 +405,9 @@ IopCompleteRequest(IN PKAPC Apc,
         }
         else if (FileObject)
         {
-            /* Signal the file object and set the status */
-            KeSetEvent(&FileObject->Event, 0, FALSE);
+            /* Signal the file object, unless the caller doesn't wait on it */
+            if (!IopSkipSetEvent(FileObject, Irp->IoStatus.Status))
+                KeSetEvent(&FileObject->Event, 0, FALSE);
             FileObject->FinalStatus = Irp->IoStatus.Status;
 
             /*
@@ -86,6 +86,9 @@ BOOLEAN ExpKdbgExtPoolUsed(ULONG Argc, PCHAR Argv[]);
 BOOLEAN ExpKdbgExtPoolFind(ULONG Argc, PCHAR Argv[]);
 BOOLEAN ExpKdbgExtFileCache(ULONG Argc, PCHAR Argv[]);
 BOOLEAN ExpKdbgExtDefWrites(ULONG Argc, PCHAR Argv[]);
+BOOLEAN ExpKdbgExtReadAhead(ULONG Argc, PCHAR Argv[]);
+BOOLEAN ExpKdbgExtZeroPages(ULONG Argc, PCHAR Argv[]);
+BOOLEAN KiKdbgExtLockSpin(ULONG Argc, PCHAR Argv[]);
 BOOLEAN ExpKdbgExtIrpFind(ULONG Argc, PCHAR Argv[]);
 BOOLEAN ExpKdbgExtHandle(ULONG Argc, PCHAR Argv[]);
 
@@ -400,6 +403,9 @@ static const struct
     { "!poolfind", "!poolfind Tag [Pool]", "Search for pool tag allocations.", ExpKdbgExtPoolFind },
     { "!filecache", "!filecache", "Display cache usage.", ExpKdbgExtFileCache },
     { "!defwrites", "!defwrites", "Display cache write values.", ExpKdbgExtDefWrites },
+    { "!readahead", "!readahead", "Display cache read ahead statistics.", ExpKdbgExtReadAhead },
+    { "!zeropages", "!zeropages", "Display page zeroing statistics.", ExpKdbgExtZeroPages },
+    { "!lockspin", "!lockspin", "Display lock contention and spinning statistics.", KiKdbgExtLockSpin },
     { "!irpfind", "!irpfind [Pool [startaddress [criteria data]]]", "Lists IRPs potentially matching criteria.", ExpKdbgExtIrpFind },
     { "!handle", "!handle [Handle]", "Displays info about handles.", ExpKdbgExtHandle },
 };
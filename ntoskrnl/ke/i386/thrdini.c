@@ -283,6 +283,16 @@ KiIdleLoop(VOID)
             KiRetireDpcList(Prcb);
         }
 
+#ifdef CONFIG_SMP
+        /* Nothing for us, see if a busy processor has work we can take */
+        if (!(Prcb->NextThread))
+        {
+            _enable();
+            KiIdleSchedule(Prcb);
+            _disable();
+        }
+#endif
+
         /* Check if a new thread is scheduled for execution */
         if (Prcb->NextThread)
         {
@@ -376,6 +386,9 @@ KiSwapContextExit(IN PKTHREAD OldThread,
     /* Increase thread context switches */
     NewThread->ContextSwitches++;
 
+    /* We are off the old thread's stack, another processor may run it now */
+    OldThread->SwapBusy = FALSE;
+
     /* Load data from switch frame */
     Pcr->NtTib.ExceptionList = SwitchFrame->ExceptionList;
 
@@ -437,8 +450,10 @@ KiSwapContextEntry(IN PKSWITCHFRAME SwitchFrame,
     /* Get the old thread and set its kernel stack */
     OldThread->KernelStack = SwitchFrame;
 
-    /* Set swapbusy to false for the new thread */
-    NewThread->SwapBusy = FALSE;
+#ifdef CONFIG_SMP
+    /* The new thread may still be switching out on the processor it was stolen from */
+    while (NewThread->SwapBusy) YieldProcessor();
+#endif
 
     /* ISRs can change FPU state, so disable interrupts while checking */
     _disable();
@@ -62,6 +62,56 @@ KiActivateWaiterQueue(IN PKQUEUE Queue)
     }
 }
 
+FORCEINLINE
+BOOLEAN
+KiIsQueueWaitStatus(IN PLIST_ENTRY QueueEntry)
+{
+    /* A queue wait returns either an entry or one of these */
+    return ((QueueEntry == (PLIST_ENTRY)STATUS_TIMEOUT) ||
+            (QueueEntry == (PLIST_ENTRY)STATUS_USER_APC) ||
+            (QueueEntry == (PLIST_ENTRY)STATUS_ALERTED));
+}
+
+/*
+ * Moves queued entries to the array until it is full, the caller holds
+ * the dispatcher lock and accounts for the running thread itself
+ */
+static
+ULONG
+KiRemoveQueueEntries(IN PKQUEUE Queue,
+                     OUT PLIST_ENTRY *EntryArray,
+                     IN ULONG Removed,
+                     IN ULONG Count)
+{
+    PLIST_ENTRY QueueEntry;
+
+    while ((Removed < Count) && !IsListEmpty(&Queue->EntryListHead))
+    {
+        /* Decrease the number of entries */
+        QueueEntry = Queue->EntryListHead.Flink;
+        Queue->Header.SignalState--;
+
+        /* Check if the entry is valid. If not, bugcheck */
+        if (!(QueueEntry->Flink) || !(QueueEntry->Blink))
+        {
+            /* Invalid item */
+            KeBugCheckEx(INVALID_WORK_QUEUE_ITEM,
+                         (ULONG_PTR)QueueEntry,
+                         (ULONG_PTR)Queue,
+                         (ULONG_PTR)NULL,
+                         (ULONG_PTR)((PWORK_QUEUE_ITEM)QueueEntry)->
+                                     WorkerRoutine);
+        }
+
+        /* Remove the Entry */
+        RemoveEntryList(QueueEntry);
+        QueueEntry->Flink = NULL;
+        EntryArray[Removed++] = QueueEntry;
+    }
+
+    return Removed;
+}
+
 /*
  * Returns the previous number of entries in the queue
  */
@@ -240,6 +290,28 @@ KeRemoveQueue(IN PKQUEUE Queue,
               IN PLARGE_INTEGER Timeout OPTIONAL)
 {
     PLIST_ENTRY QueueEntry;
+
+    /* A single entry, in a wait that can't be alerted */
+    KeRemoveQueueEx(Queue, WaitMode, FALSE, Timeout, &QueueEntry, 1);
+    return QueueEntry;
+}
+
+/*
+ * @implemented
+ *
+ * Returns the number of entries stored in EntryArray. If the wait ended
+ * without an entry, EntryArray[0] holds the wait status instead.
+ */
+ULONG
+NTAPI
+KeRemoveQueueEx(IN PKQUEUE Queue,
+                IN KPROCESSOR_MODE WaitMode,
+                IN BOOLEAN Alertable,
+                IN PLARGE_INTEGER Timeout OPTIONAL,
+                OUT PLIST_ENTRY *EntryArray,
+                IN ULONG Count)
+{
+    PLIST_ENTRY QueueEntry;
     LONG_PTR Status;
     PKTHREAD Thread = KeGetCurrentThread();
     PKQUEUE PreviousQueue;
@@ -250,8 +322,11 @@ KeRemoveQueue(IN PKQUEUE Queue,
     PLARGE_INTEGER OriginalDueTime = Timeout;
     LARGE_INTEGER DueTime = {{0}}, NewDueTime, InterruptTime;
     ULONG Hand = 0;
+    ULONG Removed = 0;
+    KIRQL OldIrql;
     ASSERT_QUEUE(Queue);
     ASSERT_IRQL_LESS_OR_EQUAL(DISPATCH_LEVEL);
+    ASSERT(Count != 0);
 
     /* Check if the Lock is already held */
     if (Thread->WaitNext)
@@ -306,27 +381,11 @@ KeRemoveQueue(IN PKQUEUE Queue,
         if ((Queue->CurrentCount < Queue->MaximumCount) &&
             (QueueEntry != &Queue->EntryListHead))
         {
-            /* Decrease the number of entries */
-            Queue->Header.SignalState--;
-
             /* Increase numbef of running threads */
             Queue->CurrentCount++;
 
-            /* Check if the entry is valid. If not, bugcheck */
-            if (!(QueueEntry->Flink) || !(QueueEntry->Blink))
-            {
-                /* Invalid item */
-                KeBugCheckEx(INVALID_WORK_QUEUE_ITEM,
-                             (ULONG_PTR)QueueEntry,
-                             (ULONG_PTR)Queue,
-                             (ULONG_PTR)NULL,
-                             (ULONG_PTR)((PWORK_QUEUE_ITEM)QueueEntry)->
-                                         WorkerRoutine);
-            }
-
-            /* Remove the Entry */
-            RemoveEntryList(QueueEntry);
-            QueueEntry->Flink = NULL;
+            /* Take as many entries as the caller wants, we only count once */
+            Removed = KiRemoveQueueEntries(Queue, EntryArray, 0, Count);
 
             /* Nothing to wait on */
             break;
@@ -344,12 +403,13 @@ KeRemoveQueue(IN PKQUEUE Queue,
             }
             else
             {
-                /* Fail if there's a User APC Pending */
-                if ((WaitMode != KernelMode) &&
-                    (Thread->ApcState.UserApcPending))
+                /* Fail if we were alerted or there's a User APC Pending */
+                Status = KiCheckAlertability(Thread, Alertable, WaitMode);
+                if (Status != STATUS_WAIT_0)
                 {
                     /* Return the status and increase the pending threads */
-                    QueueEntry = (PLIST_ENTRY)STATUS_USER_APC;
+                    EntryArray[0] = (PLIST_ENTRY)Status;
+                    Removed = 1;
                     Queue->CurrentCount++;
                     break;
                 }
@@ -362,7 +422,8 @@ KeRemoveQueue(IN PKQUEUE Queue,
                     if ((ULONG64)InterruptTime.QuadPart >= Timer->DueTime.QuadPart)
                     {
                         /* It did, so we don't need to wait */
-                        QueueEntry = (PLIST_ENTRY)STATUS_TIMEOUT;
+                        EntryArray[0] = (PLIST_ENTRY)STATUS_TIMEOUT;
+                        Removed = 1;
                         Queue->CurrentCount++;
                         break;
                     }
@@ -404,7 +465,18 @@ KeRemoveQueue(IN PKQUEUE Queue,
                 Thread->WaitReason = 0;
 
                 /* Check if we were executing an APC */
-                if (Status != STATUS_KERNEL_APC) return (PLIST_ENTRY)Status;
+                if (Status != STATUS_KERNEL_APC)
+                {
+                    /* Either a wait status, or the entry we were handed */
+                    EntryArray[0] = (PLIST_ENTRY)Status;
+                    if ((Count == 1) || KiIsQueueWaitStatus(EntryArray[0])) return 1;
+
+                    /* Pick up whatever else was queued meanwhile */
+                    OldIrql = KiAcquireDispatcherLock();
+                    Removed = KiRemoveQueueEntries(Queue, EntryArray, 1, Count);
+                    KiReleaseDispatcherLock(OldIrql);
+                    return Removed;
+                }
 
                 /* Check if we had a timeout */
                 if (Timeout)
@@ -427,7 +499,7 @@ KeRemoveQueue(IN PKQUEUE Queue,
     /* Unlock Database and return */
     KiReleaseDispatcherLockFromSynchLevel();
     KiExitDispatcher(Thread->WaitIrql);
-    return QueueEntry;
+    return Removed;
 }
 
 /*
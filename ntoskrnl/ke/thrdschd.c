@@ -20,6 +20,12 @@
     InterlockedOr((PLONG)Destination, SetMember);
 #endif
 
+/*
+ * Maximum number of ready threads an idle processor looks at on another
+ * processor before moving on, so that both PRCB locks are only held briefly.
+ */
+#define KI_STEAL_SCAN_LIMIT 8
+
 /* GLOBALS *******************************************************************/
 
 KAFFINITY KiIdleSummary;
@@ -27,12 +33,130 @@ KAFFINITY KiIdleSMTSummary;
 
 /* FUNCTIONS *****************************************************************/
 
+#ifdef CONFIG_SMP
+static
+VOID
+KiAcquireTwoPrcbLocks(IN PKPRCB FirstPrcb,
+                      IN PKPRCB SecondPrcb)
+{
+    /* Always lock in processor order to avoid deadlocking with another thief */
+    if (FirstPrcb->Number < SecondPrcb->Number)
+    {
+        KiAcquirePrcbLock(FirstPrcb);
+        KiAcquirePrcbLock(SecondPrcb);
+    }
+    else
+    {
+        KiAcquirePrcbLock(SecondPrcb);
+        KiAcquirePrcbLock(FirstPrcb);
+    }
+}
+
+static
+PKTHREAD
+KiStealReadyThread(IN PKPRCB Prcb,
+                   IN PKPRCB VictimPrcb)
+{
+    ULONG PrioritySet;
+    ULONG Priority;
+    ULONG Scanned = 0;
+    PLIST_ENTRY ListHead, ListEntry;
+    PKTHREAD Thread;
+
+    /* Walk the ready lists from the highest priority down */
+    PrioritySet = VictimPrcb->ReadySummary;
+    while (BitScanReverse(&Priority, PrioritySet))
+    {
+        ListHead = &VictimPrcb->DispatcherReadyListHead[Priority];
+        for (ListEntry = ListHead->Flink;
+             ListEntry != ListHead;
+             ListEntry = ListEntry->Flink)
+        {
+            Thread = CONTAINING_RECORD(ListEntry, KTHREAD, WaitListEntry);
+            ASSERT(Thread->State == Ready);
+            ASSERT(Thread->NextProcessor == VictimPrcb->Number);
+
+            /* Only take what this processor is allowed to run */
+            if (Thread->Affinity & Prcb->SetMember)
+            {
+                /* Remove it from the victim and update its ready summary */
+                if (RemoveEntryList(&Thread->WaitListEntry))
+                {
+                    VictimPrcb->ReadySummary ^= PRIORITY_MASK(Priority);
+                }
+
+                /* It's ours now */
+                Thread->NextProcessor = (UCHAR)Prcb->Number;
+                return Thread;
+            }
+
+            /* Give up on this processor if its queue is mostly pinned threads */
+            if (++Scanned >= KI_STEAL_SCAN_LIMIT) return NULL;
+        }
+
+        PrioritySet ^= PRIORITY_MASK(Priority);
+    }
+
+    return NULL;
+}
+#endif
+
+//
+// Called by an idle processor to look for work on the other processors.
+// If it finds a ready thread it may run, the thread is made the next thread
+// of this processor and returned.
+//
 PKTHREAD
 FASTCALL
 KiIdleSchedule(IN PKPRCB Prcb)
 {
-    /* FIXME: TODO */
-    ASSERTMSG("SMP: Not yet implemented\n", FALSE);
+#ifdef CONFIG_SMP
+    PKPRCB VictimPrcb;
+    PKTHREAD Thread;
+    ULONG Processor, Count;
+
+    ASSERT(KeGetCurrentIrql() >= DISPATCH_LEVEL);
+    Prcb->IdleSchedule = FALSE;
+
+    /* Start with our neighbour so that idle processors spread over the victims */
+    Processor = Prcb->Number;
+    for (Count = 1; Count < (ULONG)KeNumberProcessors; Count++)
+    {
+        if (++Processor == (ULONG)KeNumberProcessors) Processor = 0;
+        VictimPrcb = KiProcessorBlock[Processor];
+
+        /* Peek without the lock first, most processors have nothing queued */
+        if (!VictimPrcb || !VictimPrcb->ReadySummary) continue;
+
+        KiAcquireTwoPrcbLocks(Prcb, VictimPrcb);
+
+        /* Someone may have given us work in the meantime */
+        if (Prcb->NextThread)
+        {
+            KiReleasePrcbLock(VictimPrcb);
+            KiReleasePrcbLock(Prcb);
+            return NULL;
+        }
+
+        Thread = KiStealReadyThread(Prcb, VictimPrcb);
+        if (Thread)
+        {
+            /* Set it on standby here, we're not idle anymore */
+            Thread->State = Standby;
+            Prcb->NextThread = Thread;
+            InterlockedBitTestAndResetAffinity(&KiIdleSummary, Prcb->Number);
+        }
+
+        KiReleasePrcbLock(VictimPrcb);
+        KiReleasePrcbLock(Prcb);
+
+        if (Thread) return Thread;
+    }
+#else
+    UNREFERENCED_PARAMETER(Prcb);
+#endif
+
+    /* Nothing to do */
     return NULL;
 }
 
@@ -83,6 +207,9 @@ KiDeferredReadyThread(IN PKTHREAD Thread)
     ULONG Processor = 0;
     KPRIORITY OldPriority;
     PKTHREAD NextThread;
+#ifdef CONFIG_SMP
+    KAFFINITY Affinity, IdleSet;
+#endif
 
     /* Sanity checks */
     ASSERT(Thread->State == DeferredReady);
@@ -228,21 +355,59 @@ KiDeferredReadyThread(IN PKTHREAD Thread)
     OldPriority = Thread->Priority;
     Thread->Preempted = FALSE;
 
-    /* Queue the thread on CPU 0 and get the PRCB and lock it */
-    Thread->NextProcessor = 0;
-    Prcb = KiProcessorBlock[0];
+#ifdef CONFIG_SMP
+    /* Prefer an idle processor this thread may run on */
+    Affinity = Thread->Affinity & KeActiveProcessors;
+    ASSERT(Affinity != 0);
+    IdleSet = KiIdleSummary & Affinity;
+    if (IdleSet)
+    {
+        /* Keep its cache warm if the processor it last ran on is idle */
+        if (!(IdleSet & AFFINITY_MASK(Thread->NextProcessor)))
+        {
+            BitScanForwardAffinity(&Processor, IdleSet);
+        }
+        else
+        {
+            Processor = Thread->NextProcessor;
+        }
+    }
+    else if (Affinity & AFFINITY_MASK(Thread->NextProcessor))
+    {
+        /* Everyone is busy, stay where we were */
+        Processor = Thread->NextProcessor;
+    }
+    else if (Affinity & AFFINITY_MASK(Thread->IdealProcessor))
+    {
+        Processor = Thread->IdealProcessor;
+    }
+    else
+    {
+        BitScanForwardAffinity(&Processor, Affinity);
+    }
+#endif
+
+    /* Queue the thread on the chosen CPU and get the PRCB and lock it */
+    Thread->NextProcessor = (UCHAR)Processor;
+    Prcb = KiProcessorBlock[Processor];
     KiAcquirePrcbLock(Prcb);
 
-    /* Check if we have an idle summary */
-    if (KiIdleSummary)
+    /* Check if this CPU is idle */
+    if ((KiIdleSummary & Prcb->SetMember) && !(Prcb->NextThread))
     {
         /* Clear it and set this thread as the next one */
-        KiIdleSummary = 0;
+        InterlockedBitTestAndResetAffinity(&KiIdleSummary, Prcb->Number);
         Thread->State = Standby;
         Prcb->NextThread = Thread;
 
-        /* Unlock the PRCB and return */
+        /* Unlock the PRCB */
         KiReleasePrcbLock(Prcb);
+
+        /* Wake it up if it's not us */
+        if (KeGetCurrentProcessorNumber() != Processor)
+        {
+            KiIpiSend(AFFINITY_MASK(Processor), IPI_DPC);
+        }
         return;
     }
 
@@ -336,12 +501,9 @@ KiSelectNextThread(IN PKPRCB Prcb)
         /* Didn't find any, get the current idle thread */
         Thread = Prcb->IdleThread;
 
-        /* Enable idle scheduling */
+        /* Enable idle scheduling, the idle loop will look for work elsewhere */
         InterlockedOrSetMember(&KiIdleSummary, Prcb->SetMember);
         Prcb->IdleSchedule = TRUE;
-
-        /* FIXME: SMT support */
-        ASSERTMSG("SMP: Not yet implemented\n", FALSE);
     }
 
     /* Sanity checks and return the thread */
@@ -13,8 +13,99 @@
 #define NDEBUG
 #include <debug.h>
 
+/* Bounds of the adaptive spin, in iterations */
+#define KI_SPIN_MINIMUM     64
+#define KI_SPIN_MAXIMUM     4096
+
+/* GLOBALS *******************************************************************/
+
+KI_SPIN_POLICY KiFastMutexSpinPolicy = { 512 };
+KI_SPIN_POLICY KiGuardedMutexSpinPolicy = { 512 };
+
 /* PRIVATE FUNCTIONS *********************************************************/
 
+//
+// Spins until (*Value & Mask) == Expected, giving up when the spin limit of
+// the policy runs out or as soon as the owner of the lock (if known) stops
+// running, since it can't release the lock before it is scheduled again.
+// Returns TRUE if the condition was met, in which case the caller should not
+// need to block.
+//
+BOOLEAN
+FASTCALL
+KiSpinOnContendedLock(IN OUT PKI_SPIN_POLICY Policy,
+                      IN volatile LONG *Value,
+                      IN LONG Mask,
+                      IN LONG Expected,
+                      IN PKTHREAD volatile *Owner)
+{
+#ifdef CONFIG_SMP
+    PKTHREAD OwnerThread;
+    LONG SpinLimit, i;
+#endif
+
+    InterlockedIncrement(&Policy->Contentions);
+
+#ifdef CONFIG_SMP
+    /* Nobody can release it while we spin on a single processor */
+    if (KeNumberProcessors > 1)
+    {
+        SpinLimit = Policy->SpinLimit;
+        for (i = 0; i < SpinLimit; i++)
+        {
+            if ((*Value & Mask) == Expected)
+            {
+                /* It paid off, allow a bit more next time */
+                if (SpinLimit < KI_SPIN_MAXIMUM)
+                    Policy->SpinLimit = SpinLimit + (SpinLimit / 8);
+
+                InterlockedIncrement(&Policy->SpinAcquires);
+                return TRUE;
+            }
+
+            /* The owner is waiting or preempted, don't waste our time */
+            OwnerThread = Owner ? *Owner : NULL;
+            if ((OwnerThread) && (OwnerThread->State != Running)) break;
+
+            YieldProcessor();
+        }
+
+        /* We ran out of budget, be more pessimistic next time */
+        if ((i == SpinLimit) && (SpinLimit > KI_SPIN_MINIMUM))
+            Policy->SpinLimit = SpinLimit - (SpinLimit / 4);
+    }
+#endif
+
+    InterlockedIncrement(&Policy->BlockedAcquires);
+    return FALSE;
+}
+
+#if DBG && defined(KDBG)
+static
+VOID
+KiKdbgDumpSpinPolicy(IN PCSTR Name,
+                     IN PKI_SPIN_POLICY Policy)
+{
+    KdbpPrint("%-14s %10ld %12ld %12ld %12ld\n",
+              Name,
+              Policy->SpinLimit,
+              Policy->Contentions,
+              Policy->SpinAcquires,
+              Policy->BlockedAcquires);
+}
+
+BOOLEAN
+KiKdbgExtLockSpin(ULONG Argc, PCHAR Argv[])
+{
+    KdbpPrint("Lock           Spin limit  Contentions   Spun to get      Blocked\n");
+    KiKdbgDumpSpinPolicy("Fast mutex", &KiFastMutexSpinPolicy);
+    KiKdbgDumpSpinPolicy("Guarded mutex", &KiGuardedMutexSpinPolicy);
+    KiKdbgDumpSpinPolicy("Push lock", &ExpPushLockSpinPolicy);
+
+    return TRUE;
+}
+#endif
+
 VOID
 FASTCALL
 KiWaitTest(IN PVOID ObjectPointer,
@@ -109,6 +200,17 @@ KiAcquireFastMutex(IN PFAST_MUTEX FastMutex)
     /* Increase contention count */
     FastMutex->Contention++;
 
+    /*
+     * We are already counted as a waiter, so the release will signal the
+     * event. If it gets signaled while we spin, the wait below is satisfied
+     * right away instead of costing us two context switches.
+     */
+    KiSpinOnContendedLock(&KiFastMutexSpinPolicy,
+                          &FastMutex->Event.Header.SignalState,
+                          MAXLONG,
+                          1,
+                          (PKTHREAD volatile *)&FastMutex->Owner);
+
     /* Wait for the event */
     KeWaitForSingleObject(&FastMutex->Event,
                           WrMutex,
@@ -130,6 +232,13 @@ KiAcquireGuardedMutex(IN OUT PKGUARDED_MUTEX GuardedMutex)
     /* Increase the contention count */
     GuardedMutex->Contention++;
 
+    /* Give the owner a chance to release it while it is running */
+    KiSpinOnContendedLock(&KiGuardedMutexSpinPolicy,
+                          &GuardedMutex->Count,
+                          GM_LOCK_BIT,
+                          GM_LOCK_BIT,
+                          (PKTHREAD volatile *)&GuardedMutex->Owner);
+
     /* Start by unlocking the Guarded Mutex */
     BitsToRemove = GM_LOCK_BIT;
     BitsToAdd = GM_LOCK_WAITER_INC;
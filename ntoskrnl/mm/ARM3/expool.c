@@ -30,13 +30,11 @@
  */
 #define POOL_BIG_TABLE_USE_RATE 4
 
-typedef struct _POOL_DPC_CONTEXT
-{
-    PPOOL_TRACKER_TABLE PoolTrackTable;
-    SIZE_T PoolTrackTableSize;
-    PPOOL_TRACKER_TABLE PoolTrackTableExpansion;
-    SIZE_T PoolTrackTableSizeExpansion;
-} POOL_DPC_CONTEXT, *PPOOL_DPC_CONTEXT;
+/*
+ * Number of blocks moved at once between the per-CPU lookaside lists and
+ * the pool descriptor, when they run empty or full.
+ */
+#define POOL_LOOKASIDE_BATCH 8
 
 ULONG ExpNumberOfPagedPools;
 POOL_DESCRIPTOR NonPagedPoolDescriptor;
@@ -47,6 +45,7 @@ SIZE_T PoolTrackTableSize, PoolTrackTableMask;
 SIZE_T PoolBigPageTableSize, PoolBigPageTableHash;
 ULONG ExpBigTableExpansionFailed;
 PPOOL_TRACKER_TABLE PoolTrackTable;
+PPOOL_TRACKER_TABLE ExpPoolTrackTables[MAXIMUM_PROCESSORS];
 PPOOL_TRACKER_BIG_PAGES PoolBigPageTable;
 KSPIN_LOCK ExpTaggedPoolLock;
 ULONG PoolHitTag;
@@ -492,6 +491,49 @@ ExpComputePartialHashForAddress(IN PVOID BaseAddress)
     DPRINT1(fmt, ##__VA_ARGS__)
 #endif
 
+//
+// Returns the counters of a tracker entry, summed over all the processors.
+// This is done without any synchronization, but the frees are summed before
+// the allocations so that no free can be seen without its allocation.
+//
+static
+VOID
+ExpCapturePoolTrackerEntry(IN SIZE_T Index,
+                           OUT PPOOL_TRACKER_TABLE Capture)
+{
+    PPOOL_TRACKER_TABLE LocalTable;
+    CCHAR i;
+
+    Capture->Key = PoolTrackTable[Index].Key;
+    Capture->NonPagedFrees = PoolTrackTable[Index].NonPagedFrees;
+    Capture->PagedFrees = PoolTrackTable[Index].PagedFrees;
+    for (i = 0; i < KeNumberProcessors; i++)
+    {
+        LocalTable = ExpPoolTrackTables[i];
+        if (!LocalTable) continue;
+
+        Capture->NonPagedFrees += LocalTable[Index].NonPagedFrees;
+        Capture->PagedFrees += LocalTable[Index].PagedFrees;
+    }
+
+    KeMemoryBarrier();
+
+    Capture->NonPagedAllocs = PoolTrackTable[Index].NonPagedAllocs;
+    Capture->NonPagedBytes = PoolTrackTable[Index].NonPagedBytes;
+    Capture->PagedAllocs = PoolTrackTable[Index].PagedAllocs;
+    Capture->PagedBytes = PoolTrackTable[Index].PagedBytes;
+    for (i = 0; i < KeNumberProcessors; i++)
+    {
+        LocalTable = ExpPoolTrackTables[i];
+        if (!LocalTable) continue;
+
+        Capture->NonPagedAllocs += LocalTable[Index].NonPagedAllocs;
+        Capture->NonPagedBytes += LocalTable[Index].NonPagedBytes;
+        Capture->PagedAllocs += LocalTable[Index].PagedAllocs;
+        Capture->PagedBytes += LocalTable[Index].PagedBytes;
+    }
+}
+
 VOID
 MiDumpPoolConsumers(BOOLEAN CalledFromDbg, ULONG Tag, ULONG Mask, ULONG Flags)
 {
@@ -538,9 +580,10 @@ MiDumpPoolConsumers(BOOLEAN CalledFromDbg, ULONG Tag, ULONG Mask, ULONG Flags)
     //
     for (i = 0; i < PoolTrackTableSize; ++i)
     {
-        PPOOL_TRACKER_TABLE TableEntry;
+        POOL_TRACKER_TABLE Capture;
+        PPOOL_TRACKER_TABLE TableEntry = &Capture;
 
-        TableEntry = &PoolTrackTable[i];
+        ExpCapturePoolTrackerEntry(i, &Capture);
 
         //
         // We only care about tags which have allocated memory
@@ -755,6 +798,123 @@ ExpSeedHotTags(VOID)
     }
 }
 
+CODE_SEG("INIT")
+VOID
+NTAPI
+ExInitPerProcessorPoolTracker(VOID)
+{
+    CCHAR i;
+    SIZE_T TableSize;
+    PPOOL_TRACKER_TABLE LocalTable;
+
+    //
+    // Give each processor its own set of counters, matching the global table.
+    // Keys still only live in the global table, so they are left empty.
+    //
+    TableSize = PoolTrackTableSize * sizeof(POOL_TRACKER_TABLE);
+    for (i = 0; i < KeNumberProcessors; i++)
+    {
+        LocalTable = ExAllocatePoolWithTag(NonPagedPool, TableSize, 'looP');
+        if (!LocalTable)
+        {
+            //
+            // This processor will keep using the global table
+            //
+            DPRINT1("No tracker table for processor %d\n", i);
+            continue;
+        }
+
+        RtlZeroMemory(LocalTable, TableSize);
+        ExpPoolTrackTables[i] = LocalTable;
+    }
+}
+
+//
+// Updates the counters of a tracker entry. Once the processors have their own
+// tables, this is done in there without any interlocked operation: raising to
+// DISPATCH_LEVEL is enough to keep anyone else on this processor away.
+//
+static
+VOID
+ExpUpdatePoolTrackerEntry(IN PPOOL_TRACKER_TABLE TableEntry,
+                          IN SIZE_T NumberOfBytes,
+                          IN POOL_TYPE PoolType,
+                          IN BOOLEAN Free)
+{
+    PPOOL_TRACKER_TABLE LocalTable;
+    KIRQL OldIrql;
+
+    OldIrql = KeRaiseIrqlToDpcLevel();
+    LocalTable = ExpPoolTrackTables[KeGetCurrentProcessorNumber()];
+    if (LocalTable)
+    {
+        //
+        // Work on the same entry in the table of this processor
+        //
+        TableEntry = &LocalTable[TableEntry - PoolTrackTable];
+        if ((PoolType & BASE_POOL_TYPE_MASK) == NonPagedPool)
+        {
+            if (Free)
+            {
+                TableEntry->NonPagedFrees++;
+                TableEntry->NonPagedBytes -= NumberOfBytes;
+            }
+            else
+            {
+                TableEntry->NonPagedAllocs++;
+                TableEntry->NonPagedBytes += NumberOfBytes;
+            }
+        }
+        else
+        {
+            if (Free)
+            {
+                TableEntry->PagedFrees++;
+                TableEntry->PagedBytes -= NumberOfBytes;
+            }
+            else
+            {
+                TableEntry->PagedAllocs++;
+                TableEntry->PagedBytes += NumberOfBytes;
+            }
+        }
+        KeLowerIrql(OldIrql);
+        return;
+    }
+    KeLowerIrql(OldIrql);
+
+    //
+    // Otherwise, use the global table, and interlocked operations
+    //
+    if ((PoolType & BASE_POOL_TYPE_MASK) == NonPagedPool)
+    {
+        if (Free)
+        {
+            InterlockedIncrement(&TableEntry->NonPagedFrees);
+            InterlockedExchangeAddSizeT(&TableEntry->NonPagedBytes,
+                                        -(SSIZE_T)NumberOfBytes);
+        }
+        else
+        {
+            InterlockedIncrement(&TableEntry->NonPagedAllocs);
+            InterlockedExchangeAddSizeT(&TableEntry->NonPagedBytes, NumberOfBytes);
+        }
+        return;
+    }
+
+    if (Free)
+    {
+        InterlockedIncrement(&TableEntry->PagedFrees);
+        InterlockedExchangeAddSizeT(&TableEntry->PagedBytes,
+                                    -(SSIZE_T)NumberOfBytes);
+    }
+    else
+    {
+        InterlockedIncrement(&TableEntry->PagedAllocs);
+        InterlockedExchangeAddSizeT(&TableEntry->PagedBytes, NumberOfBytes);
+    }
+}
+
 VOID
 NTAPI
 ExpRemovePoolTracker(IN ULONG Key,
@@ -806,16 +966,7 @@ ExpRemovePoolTracker(IN ULONG Key,
             // Decrement the counters depending on if this was paged or nonpaged
             // pool
             //
-            if ((PoolType & BASE_POOL_TYPE_MASK) == NonPagedPool)
-            {
-                InterlockedIncrement(&TableEntry->NonPagedFrees);
-                InterlockedExchangeAddSizeT(&TableEntry->NonPagedBytes,
-                                            -(SSIZE_T)NumberOfBytes);
-                return;
-            }
-            InterlockedIncrement(&TableEntry->PagedFrees);
-            InterlockedExchangeAddSizeT(&TableEntry->PagedBytes,
-                                        -(SSIZE_T)NumberOfBytes);
+            ExpUpdatePoolTrackerEntry(TableEntry, NumberOfBytes, PoolType, TRUE);
             return;
         }
 
@@ -908,14 +1059,7 @@ ExpInsertPoolTracker(IN ULONG Key,
             // Increment the counters depending on if this was paged or nonpaged
             // pool
             //
-            if ((PoolType & BASE_POOL_TYPE_MASK) == NonPagedPool)
-            {
-                InterlockedIncrement(&TableEntry->NonPagedAllocs);
-                InterlockedExchangeAddSizeT(&TableEntry->NonPagedBytes, NumberOfBytes);
-                return;
-            }
-            InterlockedIncrement(&TableEntry->PagedAllocs);
-            InterlockedExchangeAddSizeT(&TableEntry->PagedBytes, NumberOfBytes);
+            ExpUpdatePoolTrackerEntry(TableEntry, NumberOfBytes, PoolType, FALSE);
             return;
         }
 
@@ -942,7 +1086,7 @@ ExpInsertPoolTracker(IN ULONG Key,
 
             //
             // Now we force the loop to run again, and we should now end up in
-            // the code path above which does the interlocked increments...
+            // the code path above which does the increments...
             //
             continue;
         }
@@ -1316,53 +1460,18 @@ ExUnlockPool(IN PPOOL_DESCRIPTOR Descriptor,
     }
 }
 
-VOID
-NTAPI
-ExpGetPoolTagInfoTarget(IN PKDPC Dpc,
-                        IN PVOID DeferredContext,
-                        IN PVOID SystemArgument1,
-                        IN PVOID SystemArgument2)
-{
-    PPOOL_DPC_CONTEXT Context = DeferredContext;
-    UNREFERENCED_PARAMETER(Dpc);
-    ASSERT(KeGetCurrentIrql() == DISPATCH_LEVEL);
-
-    //
-    // Make sure we win the race, and if we did, copy the data atomically
-    //
-    if (KeSignalCallDpcSynchronize(SystemArgument2))
-    {
-        RtlCopyMemory(Context->PoolTrackTable,
-                      PoolTrackTable,
-                      Context->PoolTrackTableSize * sizeof(POOL_TRACKER_TABLE));
-
-        //
-        // This is here because ReactOS does not yet support expansion
-        //
-        ASSERT(Context->PoolTrackTableSizeExpansion == 0);
-    }
-
-    //
-    // Regardless of whether we won or not, we must now synchronize and then
-    // decrement the barrier since this is one more processor that has completed
-    // the callback.
-    //
-    KeSignalCallDpcSynchronize(SystemArgument2);
-    KeSignalCallDpcDone(SystemArgument1);
-}
-
 NTSTATUS
 NTAPI
 ExGetPoolTagInfo(IN PSYSTEM_POOLTAG_INFORMATION SystemInformation,
                  IN ULONG SystemInformationLength,
                  IN OUT PULONG ReturnLength OPTIONAL)
 {
-    ULONG TableSize, CurrentLength;
-    ULONG EntryCount;
+    ULONG CurrentLength;
+    ULONG EntryCount, i;
     NTSTATUS Status = STATUS_SUCCESS;
     PSYSTEM_POOLTAG TagEntry;
-    PPOOL_TRACKER_TABLE Buffer, TrackerEntry;
-    POOL_DPC_CONTEXT Context;
+    POOL_TRACKER_TABLE Capture;
+    PPOOL_TRACKER_TABLE TrackerEntry = &Capture;
     ASSERT(KeGetCurrentIrql() == PASSIVE_LEVEL);
 
     //
@@ -1377,36 +1486,21 @@ ExGetPoolTagInfo(IN PSYSTEM_POOLTAG_INFORMATION SystemInformation,
     SystemInformation->Count = 0;
 
     //
-    // Capture the number of entries, and the total size needed to make a copy
-    // of the table
+    // Capture the number of entries. This is here because ReactOS does not yet
+    // support expansion
     //
     EntryCount = (ULONG)PoolTrackTableSize;
-    TableSize = EntryCount * sizeof(POOL_TRACKER_TABLE);
-
-    //
-    // Allocate the "Generic DPC" temporary buffer
-    //
-    Buffer = ExAllocatePoolWithTag(NonPagedPool, TableSize, 'ofnI');
-    if (!Buffer) return STATUS_INSUFFICIENT_RESOURCES;
-
-    //
-    // Do a "Generic DPC" to atomically retrieve the tag and allocation data
-    //
-    Context.PoolTrackTable = Buffer;
-    Context.PoolTrackTableSize = PoolTrackTableSize;
-    Context.PoolTrackTableExpansion = NULL;
-    Context.PoolTrackTableSizeExpansion = 0;
-    KeGenericCallDpc(ExpGetPoolTagInfoTarget, &Context);
 
     //
-    // Now parse the results
+    // Now parse the table, summing the counters of all the processors
     //
-    for (TrackerEntry = Buffer; TrackerEntry < (Buffer + EntryCount); TrackerEntry++)
+    for (i = 0; i < EntryCount; i++)
     {
         //
         // If the entry is empty, skip it
         //
-        if (!TrackerEntry->Key) continue;
+        if (!PoolTrackTable[i].Key) continue;
+        ExpCapturePoolTrackerEntry(i, &Capture);
 
         //
         // Otherwise, add one more entry to the caller's buffer, and ensure that
@@ -1449,9 +1543,8 @@ ExGetPoolTagInfo(IN PSYSTEM_POOLTAG_INFORMATION SystemInformation,
     }
 
     //
-    // Free the "Generic DPC" temporary buffer, return the buffer length and status
+    // Return the buffer length and status
     //
-    ExFreePoolWithTag(Buffer, 'ofnI');
     if (ReturnLength) *ReturnLength = CurrentLength;
     return Status;
 }
@@ -1896,6 +1989,77 @@ ExReturnPoolQuota(IN PVOID P)
 
 /* PUBLIC FUNCTIONS ***********************************************************/
 
+//
+// Takes a batch of free blocks of the given size from the pool descriptor in a
+// single lock acquisition. One of them is returned, the others are pushed to
+// the lookaside list. They are all accounted for as allocated, like any other
+// block sitting on a lookaside list.
+//
+static
+PVOID
+ExpRefillPoolLookaside(IN PPOOL_DESCRIPTOR PoolDesc,
+                       IN PGENERAL_LOOKASIDE LookasideList,
+                       IN USHORT BlockSize,
+                       IN POOL_TYPE PoolType)
+{
+    PLIST_ENTRY ListHead;
+    PPOOL_HEADER Batch[POOL_LOOKASIDE_BATCH + 1];
+    ULONG Count, Wanted, Depth;
+    KIRQL OldIrql;
+
+    //
+    // Only take blocks of the exact size, without splitting larger ones
+    //
+    ListHead = &PoolDesc->ListHeads[BlockSize - 1];
+    if (ExpIsPoolListEmpty(ListHead)) return NULL;
+
+    //
+    // Don't take more than the list can hold
+    //
+    Depth = ExQueryDepthSList(&LookasideList->ListHead);
+    Wanted = (Depth < LookasideList->Depth) ? LookasideList->Depth - Depth : 0;
+    Wanted = min(Wanted, POOL_LOOKASIDE_BATCH) + 1;
+
+    OldIrql = ExLockPool(PoolDesc);
+    for (Count = 0; Count < Wanted && !ExpIsPoolListEmpty(ListHead); Count++)
+    {
+        ExpCheckPoolLinks(ListHead);
+        Batch[Count] = POOL_ENTRY(ExpRemovePoolHeadList(ListHead));
+        ExpCheckPoolLinks(ListHead);
+        ExpCheckPoolBlocks(Batch[Count]);
+        ASSERT(Batch[Count]->BlockSize == BlockSize);
+        ASSERT(Batch[Count]->PoolType == 0);
+
+        //
+        // Mark it as in use, so that it doesn't get combined
+        //
+        Batch[Count]->PoolType = PoolType + 1;
+    }
+    ExUnlockPool(PoolDesc, OldIrql);
+
+    //
+    // Someone raced us (and won) before we had a chance to acquire the lock
+    //
+    if (!Count) return NULL;
+
+    //
+    // Increment required counters
+    //
+    InterlockedExchangeAddSizeT(&PoolDesc->TotalBytes, Count * BlockSize * POOL_BLOCK_SIZE);
+    InterlockedExchangeAdd((PLONG)&PoolDesc->RunningAllocs, Count);
+
+    //
+    // Keep the first one for the caller
+    //
+    while (--Count)
+    {
+        InterlockedPushEntrySList(&LookasideList->ListHead,
+                                  (PSLIST_ENTRY)POOL_FREE_BLOCK(Batch[Count]));
+    }
+
+    return POOL_FREE_BLOCK(Batch[0]);
+}
+
 /*
  * @implemented
  */
@@ -2106,12 +2270,29 @@ ExAllocatePoolWithTag(IN POOL_TYPE PoolType,
         }
 
         //
-        // If we were able to pop it, update the accounting and return the block
+        // If we were able to pop it, update the accounting
         //
         if (Entry)
         {
             LookasideList->AllocateHits++;
+        }
+        else
+        {
+            //
+            // Both lists are empty, refill the per-CPU one in a single trip to
+            // the pool descriptor
+            //
+            LookasideList = (PoolType == PagedPool) ?
+                             Prcb->PPPagedLookasideList[i - 1].P :
+                             Prcb->PPNPagedLookasideList[i - 1].P;
+            Entry = ExpRefillPoolLookaside(PoolDesc, LookasideList, i, PoolType);
+        }
 
+        //
+        // If we got a block, return it
+        //
+        if (Entry)
+        {
             //
             // Get the real entry, write down its pool type, and track it
             //
@@ -2486,6 +2667,161 @@ ExAllocatePool(POOL_TYPE PoolType,
     return ExAllocatePoolWithTag(PoolType, NumberOfBytes, Tag);
 }
 
+//
+// Gives a block back to the free lists of its descriptor, combining it with
+// its free neighbours. Must be called with the pool lock held. Returns the
+// page if the block ended up covering it entirely, the caller then has to
+// free it after releasing the lock.
+//
+static
+PPOOL_HEADER
+ExpFreePoolBlockLocked(IN PPOOL_DESCRIPTOR PoolDesc,
+                       IN PPOOL_HEADER Entry)
+{
+    PPOOL_HEADER NextEntry;
+    USHORT BlockSize;
+    BOOLEAN Combined = FALSE;
+
+    //
+    // Get the pointer to the next entry
+    //
+    NextEntry = POOL_NEXT_BLOCK(Entry);
+
+
+    //
+    // Check if the next allocation is at the end of the page
+    //
+    ExpCheckPoolBlocks(Entry);
+    if (PAGE_ALIGN(NextEntry) != NextEntry)
+    {
+        //
+        // We may be able to combine the block if it's free
+        //
+        if (NextEntry->PoolType == 0)
+        {
+            //
+            // The next block is free, so we'll do a combine
+            //
+            Combined = TRUE;
+
+            //
+            // Make sure there's actual data in the block -- anything smaller
+            // than this means we only have the header, so there's no linked list
+            // for us to remove
+            //
+            if ((NextEntry->BlockSize != 1))
+            {
+                //
+                // The block is at least big enough to have a linked list, so go
+                // ahead and remove it
+                //
+                ExpCheckPoolLinks(POOL_FREE_BLOCK(NextEntry));
+                ExpRemovePoolEntryList(POOL_FREE_BLOCK(NextEntry));
+                ExpCheckPoolLinks(ExpDecodePoolLink((POOL_FREE_BLOCK(NextEntry))->Flink));
+                ExpCheckPoolLinks(ExpDecodePoolLink((POOL_FREE_BLOCK(NextEntry))->Blink));
+            }
+
+            //
+            // Our entry is now combined with the next entry
+            //
+            Entry->BlockSize = Entry->BlockSize + NextEntry->BlockSize;
+        }
+    }
+
+    //
+    // Now check if there was a previous entry on the same page as us
+    //
+    if (Entry->PreviousSize)
+    {
+        //
+        // Great, grab that entry and check if it's free
+        //
+        NextEntry = POOL_PREV_BLOCK(Entry);
+        if (NextEntry->PoolType == 0)
+        {
+            //
+            // It is, so we can do a combine
+            //
+            Combined = TRUE;
+
+            //
+            // Make sure there's actual data in the block -- anything smaller
+            // than this means we only have the header so there's no linked list
+            // for us to remove
+            //
+            if ((NextEntry->BlockSize != 1))
+            {
+                //
+                // The block is at least big enough to have a linked list, so go
+                // ahead and remove it
+                //
+                ExpCheckPoolLinks(POOL_FREE_BLOCK(NextEntry));
+                ExpRemovePoolEntryList(POOL_FREE_BLOCK(NextEntry));
+                ExpCheckPoolLinks(ExpDecodePoolLink((POOL_FREE_BLOCK(NextEntry))->Flink));
+                ExpCheckPoolLinks(ExpDecodePoolLink((POOL_FREE_BLOCK(NextEntry))->Blink));
+            }
+
+            //
+            // Combine our original block (which might've already been combined
+            // with the next block), into the previous block
+            //
+            NextEntry->BlockSize = NextEntry->BlockSize + Entry->BlockSize;
+
+            //
+            // And now we'll work with the previous block instead
+            //
+            Entry = NextEntry;
+        }
+    }
+
+    //
+    // By now, it may have been possible for our combined blocks to actually
+    // have made up a full page (if there were only 2-3 allocations on the
+    // page, they could've all been combined).
+    //
+    if ((PAGE_ALIGN(Entry) == Entry) &&
+        (PAGE_ALIGN(POOL_NEXT_BLOCK(Entry)) == POOL_NEXT_BLOCK(Entry)))
+    {
+        //
+        // In this case, let the caller free the page once it dropped the lock
+        //
+        return Entry;
+    }
+
+    //
+    // Otherwise, we now have a free block (or a combination of 2 or 3)
+    //
+    Entry->PoolType = 0;
+    BlockSize = Entry->BlockSize;
+    ASSERT(BlockSize != 1);
+
+    //
+    // Check if we actually did combine it with anyone
+    //
+    if (Combined)
+    {
+        //
+        // Get the first combined block (either our original to begin with, or
+        // the one after the original, depending if we combined with the previous)
+        //
+        NextEntry = POOL_NEXT_BLOCK(Entry);
+
+        //
+        // As long as the next block isn't on a page boundary, have it point
+        // back to us
+        //
+        if (PAGE_ALIGN(NextEntry) != NextEntry) NextEntry->PreviousSize = BlockSize;
+    }
+
+    //
+    // Insert this new free block
+    //
+    ExpInsertPoolHeadList(&PoolDesc->ListHeads[BlockSize - 1], POOL_FREE_BLOCK(Entry));
+    ExpCheckPoolLinks(POOL_FREE_BLOCK(Entry));
+    return NULL;
+}
+
+
 /*
  * @implemented
  */
@@ -2494,17 +2830,19 @@ NTAPI
 ExFreePoolWithTag(IN PVOID P,
                   IN ULONG TagToFree)
 {
-    PPOOL_HEADER Entry, NextEntry;
+    PPOOL_HEADER Entry;
     USHORT BlockSize;
     KIRQL OldIrql;
     POOL_TYPE PoolType;
     PPOOL_DESCRIPTOR PoolDesc;
     ULONG Tag;
-    BOOLEAN Combined = FALSE;
     PFN_NUMBER PageCount, RealPageCount;
     PKPRCB Prcb = KeGetCurrentPrcb();
     PGENERAL_LOOKASIDE LookasideList;
     PEPROCESS Process;
+    PSLIST_ENTRY ListEntry;
+    PPOOL_HEADER Batch[POOL_LOOKASIDE_BATCH];
+    ULONG BatchCount = 0, i;
 
     //
     // Check if any of the debug flags are enabled
@@ -2757,159 +3095,57 @@ ExFreePoolWithTag(IN PVOID P,
             InterlockedPushEntrySList(&LookasideList->ListHead, P);
             return;
         }
-    }
 
-    //
-    // Get the pointer to the next entry
-    //
-    NextEntry = POOL_BLOCK(Entry, BlockSize);
-
-    //
-    // Update performance counters
-    //
-    InterlockedIncrement((PLONG)&PoolDesc->RunningDeAllocs);
-    InterlockedExchangeAddSizeT(&PoolDesc->TotalBytes, -BlockSize * POOL_BLOCK_SIZE);
-
-    //
-    // Acquire the pool lock
-    //
-    OldIrql = ExLockPool(PoolDesc);
-
-    //
-    // Check if the next allocation is at the end of the page
-    //
-    ExpCheckPoolBlocks(Entry);
-    if (PAGE_ALIGN(NextEntry) != NextEntry)
-    {
         //
-        // We may be able to combine the block if it's free
+        // Both are full, so drain a batch of the per-CPU list along with this
+        // block, to avoid coming back to the pool lock on each of the next frees
         //
-        if (NextEntry->PoolType == 0)
+        LookasideList = (PoolType == PagedPool) ?
+                         Prcb->PPPagedLookasideList[BlockSize - 1].P :
+                         Prcb->PPNPagedLookasideList[BlockSize - 1].P;
+        while (BatchCount < POOL_LOOKASIDE_BATCH)
         {
-            //
-            // The next block is free, so we'll do a combine
-            //
-            Combined = TRUE;
-
-            //
-            // Make sure there's actual data in the block -- anything smaller
-            // than this means we only have the header, so there's no linked list
-            // for us to remove
-            //
-            if ((NextEntry->BlockSize != 1))
-            {
-                //
-                // The block is at least big enough to have a linked list, so go
-                // ahead and remove it
-                //
-                ExpCheckPoolLinks(POOL_FREE_BLOCK(NextEntry));
-                ExpRemovePoolEntryList(POOL_FREE_BLOCK(NextEntry));
-                ExpCheckPoolLinks(ExpDecodePoolLink((POOL_FREE_BLOCK(NextEntry))->Flink));
-                ExpCheckPoolLinks(ExpDecodePoolLink((POOL_FREE_BLOCK(NextEntry))->Blink));
-            }
-
-            //
-            // Our entry is now combined with the next entry
-            //
-            Entry->BlockSize = Entry->BlockSize + NextEntry->BlockSize;
+            ListEntry = InterlockedPopEntrySList(&LookasideList->ListHead);
+            if (!ListEntry) break;
+            Batch[BatchCount++] = POOL_ENTRY(ListEntry);
         }
     }
 
     //
-    // Now check if there was a previous entry on the same page as us
+    // Update performance counters
     //
-    if (Entry->PreviousSize)
-    {
-        //
-        // Great, grab that entry and check if it's free
-        //
-        NextEntry = POOL_PREV_BLOCK(Entry);
-        if (NextEntry->PoolType == 0)
-        {
-            //
-            // It is, so we can do a combine
-            //
-            Combined = TRUE;
+    InterlockedExchangeAdd((PLONG)&PoolDesc->RunningDeAllocs, 1 + BatchCount);
+    InterlockedExchangeAddSizeT(&PoolDesc->TotalBytes,
+                                -(LONG_PTR)((1 + BatchCount) * BlockSize * POOL_BLOCK_SIZE));
 
-            //
-            // Make sure there's actual data in the block -- anything smaller
-            // than this means we only have the header so there's no linked list
-            // for us to remove
-            //
-            if ((NextEntry->BlockSize != 1))
-            {
-                //
-                // The block is at least big enough to have a linked list, so go
-                // ahead and remove it
-                //
-                ExpCheckPoolLinks(POOL_FREE_BLOCK(NextEntry));
-                ExpRemovePoolEntryList(POOL_FREE_BLOCK(NextEntry));
-                ExpCheckPoolLinks(ExpDecodePoolLink((POOL_FREE_BLOCK(NextEntry))->Flink));
-                ExpCheckPoolLinks(ExpDecodePoolLink((POOL_FREE_BLOCK(NextEntry))->Blink));
-            }
-
-            //
-            // Combine our original block (which might've already been combined
-            // with the next block), into the previous block
-            //
-            NextEntry->BlockSize = NextEntry->BlockSize + Entry->BlockSize;
-
-            //
-            // And now we'll work with the previous block instead
-            //
-            Entry = NextEntry;
-        }
+    //
+    // Acquire the pool lock, and give back all the blocks
+    //
+    OldIrql = ExLockPool(PoolDesc);
+    Entry = ExpFreePoolBlockLocked(PoolDesc, Entry);
+    for (i = 0; i < BatchCount; i++)
+    {
+        ASSERT(Batch[i]->BlockSize == BlockSize);
+        Batch[i] = ExpFreePoolBlockLocked(PoolDesc, Batch[i]);
     }
+    ExUnlockPool(PoolDesc, OldIrql);
 
     //
-    // By now, it may have been possible for our combined blocks to actually
-    // have made up a full page (if there were only 2-3 allocations on the
-    // page, they could've all been combined).
+    // Now free the pages that were released, and update the performance counter
     //
-    if ((PAGE_ALIGN(Entry) == Entry) &&
-        (PAGE_ALIGN(POOL_NEXT_BLOCK(Entry)) == POOL_NEXT_BLOCK(Entry)))
+    if (Entry)
     {
-        //
-        // In this case, release the pool lock, update the performance counter,
-        // and free the page
-        //
-        ExUnlockPool(PoolDesc, OldIrql);
         InterlockedExchangeAdd((PLONG)&PoolDesc->TotalPages, -1);
         MiFreePoolPages(Entry);
-        return;
     }
-
-    //
-    // Otherwise, we now have a free block (or a combination of 2 or 3)
-    //
-    Entry->PoolType = 0;
-    BlockSize = Entry->BlockSize;
-    ASSERT(BlockSize != 1);
-
-    //
-    // Check if we actually did combine it with anyone
-    //
-    if (Combined)
+    for (i = 0; i < BatchCount; i++)
     {
-        //
-        // Get the first combined block (either our original to begin with, or
-        // the one after the original, depending if we combined with the previous)
-        //
-        NextEntry = POOL_NEXT_BLOCK(Entry);
-
-        //
-        // As long as the next block isn't on a page boundary, have it point
-        // back to us
-        //
-        if (PAGE_ALIGN(NextEntry) != NextEntry) NextEntry->PreviousSize = BlockSize;
+        if (Batch[i])
+        {
+            InterlockedExchangeAdd((PLONG)&PoolDesc->TotalPages, -1);
+            MiFreePoolPages(Batch[i]);
+        }
     }
-
-    //
-    // Insert this new free block, and release the pool lock
-    //
-    ExpInsertPoolHeadList(&PoolDesc->ListHeads[BlockSize - 1], POOL_FREE_BLOCK(Entry));
-    ExpCheckPoolLinks(POOL_FREE_BLOCK(Entry));
-    ExUnlockPool(PoolDesc, OldIrql);
 }
 
 /*
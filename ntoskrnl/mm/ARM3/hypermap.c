@@ -108,8 +108,10 @@ MiUnmapPageInHyperSpace(IN PEPROCESS Process,
 
 PVOID
 NTAPI
-MiMapPagesInZeroSpace(IN PMMPFN Pfn1,
-                      IN PFN_NUMBER NumberOfPages)
+MiMapPagesInZeroSpace(IN PMMPTE ZeroingPte,
+                      IN PMMPFN Pfn1,
+                      IN PFN_NUMBER NumberOfPages,
+                      IN BOOLEAN NonTemporal)
 {
     MMPTE TempPte;
     PMMPTE PointerPte;
@@ -123,9 +125,9 @@ MiMapPagesInZeroSpace(IN PMMPFN Pfn1,
     ASSERT(NumberOfPages <= MI_ZERO_PTES);
 
     //
-    // Pick the first zeroing PTE
+    // Pick the first zeroing PTE of the caller's range
     //
-    PointerPte = MiFirstReservedZeroingPte;
+    PointerPte = ZeroingPte;
 
     //
     // Now get the first free PTE
@@ -150,9 +152,14 @@ MiMapPagesInZeroSpace(IN PMMPFN Pfn1,
     PointerPte += (Offset + 1);
     TempPte = ValidKernelPte;
 
-    /* Disable cache. Write through */
-    MI_PAGE_DISABLE_CACHE(&TempPte);
-    MI_PAGE_WRITE_THROUGH(&TempPte);
+    /* Non-temporal stores bypass the caches on their own, and are slow on
+       uncached memory. Anything else must not pull the pages into the caches. */
+    if (!NonTemporal)
+    {
+        /* Disable cache. Write through */
+        MI_PAGE_DISABLE_CACHE(&TempPte);
+        MI_PAGE_WRITE_THROUGH(&TempPte);
+    }
 
     /* Make sure the list isn't empty and loop it */
     ASSERT(Pfn1 != (PVOID)LIST_HEAD);
@@ -632,6 +632,9 @@ extern PFN_NUMBER MmSystemPageDirectory[PPE_PER_PAGE];
 extern PMMPTE MmSharedUserDataPte;
 extern LIST_ENTRY MmProcessList;
 extern KEVENT MmZeroingPageEvent;
+extern ULONG MmBackgroundZeroedPages;
+extern ULONG MmInlineZeroedPages;
+extern ULONG MmZeroPageWorkers;
 extern ULONG MmSystemPageColor;
 extern ULONG MmProcessColorSeed;
 extern PMMWSL MmWorkingSetList;
@@ -526,6 +526,9 @@ MiZeroPfn(IN PFN_NUMBER PageFrameNumber)
 
     /* Now get rid of it */
     MiReleaseSystemPtes(ZeroPte, 1, SystemPteSpace);
+
+    /* The zero page thread didn't keep up */
+    InterlockedIncrement((PLONG)&MmInlineZeroedPages);
 }
 
 VOID
@@ -594,7 +594,11 @@ MiRemoveZeroPage(IN ULONG Color)
     ASSERT(Pfn1 == MI_PFN_ELEMENT(PageIndex));
 
     /* Zero it, if needed */
-    if (Zero) MiZeroPhysicalPage(PageIndex);
+    if (Zero)
+    {
+        MiZeroPhysicalPage(PageIndex);
+        InterlockedIncrement((PLONG)&MmInlineZeroedPages);
+    }
 
     /* Sanity checks */
     ASSERT(Pfn1->u3.e2.ReferenceCount == 0);
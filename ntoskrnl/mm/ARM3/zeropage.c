@@ -19,6 +19,23 @@
 
 KEVENT MmZeroingPageEvent;
 
+/* Counters:
+ * - Number of pages zeroed in the background
+ * - Number of pages that had to be zeroed inline, for lack of zeroed ones
+ * - Number of zeroing threads
+ */
+ULONG MmBackgroundZeroedPages;
+ULONG MmInlineZeroedPages;
+ULONG MmZeroPageWorkers;
+
+typedef struct _MI_ZERO_PAGE_WORKER
+{
+    PMMPTE ZeroingPte;
+    KAFFINITY Affinity;
+    ULONG FirstColor;
+    ULONG NextColor;
+} MI_ZERO_PAGE_WORKER, *PMI_ZERO_PAGE_WORKER;
+
 /* PRIVATE FUNCTIONS **********************************************************/
 
 VOID
@@ -31,23 +48,103 @@ NTAPI
 MiFreeInitializationCode(IN PVOID StartVa,
 IN PVOID EndVa);
 
+static
+PMMPFN
+MiGrabPagesToZero(
+    _Inout_ PMI_ZERO_PAGE_WORKER Worker,
+    _Out_ PULONG PageCount)
+{
+    PMMPFN Pfn1 = (PMMPFN)LIST_HEAD;
+    PMMPFN Pfn2;
+    PFN_NUMBER PageIndex, FreePage;
+    ULONG Color, i;
+
+    MI_ASSERT_PFN_LOCK_HELD();
+    *PageCount = 0;
+
+    /* First look for a run of pages in the colors this worker is in charge of */
+    for (i = 0; i < MmSecondaryColors; i += MmZeroPageWorkers)
+    {
+        Color = Worker->NextColor;
+        Worker->NextColor += MmZeroPageWorkers;
+        if (Worker->NextColor >= MmSecondaryColors)
+            Worker->NextColor = Worker->FirstColor;
+
+        while (*PageCount < MI_ZERO_PTES)
+        {
+            PageIndex = MmFreePagesByColor[FreePageList][Color].Flink;
+            if (PageIndex == LIST_HEAD)
+                break;
+
+            MI_SET_USAGE(MI_USAGE_ZERO_LOOP);
+            MI_SET_PROCESS2("Kernel 0 Loop");
+            FreePage = MiRemoveAnyPage(Color);
+            ASSERT(FreePage == PageIndex);
+
+            Pfn2 = MiGetPfnEntry(FreePage);
+            Pfn2->u1.Flink = (PFN_NUMBER)Pfn1;
+            Pfn1 = Pfn2;
+            (*PageCount)++;
+        }
+
+        if (*PageCount != 0)
+            return Pfn1;
+    }
+
+    /* Nothing in our colors, help with whatever is left */
+    while (*PageCount < MI_ZERO_PTES)
+    {
+        if (!MmFreePageListHead.Total)
+            break;
+
+        PageIndex = MmFreePageListHead.Flink;
+        ASSERT(PageIndex != LIST_HEAD);
+        MI_SET_USAGE(MI_USAGE_ZERO_LOOP);
+        MI_SET_PROCESS2("Kernel 0 Loop");
+        FreePage = MiRemoveAnyPage(MI_GET_PAGE_COLOR(PageIndex));
+
+        /* The first global free page should also be the first on its own list */
+        if (FreePage != PageIndex)
+        {
+            KeBugCheckEx(PFN_LIST_CORRUPT,
+                        0x8F,
+                        FreePage,
+                        PageIndex,
+                        0);
+        }
+
+        Pfn2 = MiGetPfnEntry(PageIndex);
+        Pfn2->u1.Flink = (PFN_NUMBER)Pfn1;
+        Pfn1 = Pfn2;
+        (*PageCount)++;
+    }
+
+    return Pfn1;
+}
+
+static
 VOID
-NTAPI
-MmZeroPageThread(VOID)
+MiZeroPageWorker(
+    _Inout_ PMI_ZERO_PAGE_WORKER Worker)
 {
     PKTHREAD Thread = KeGetCurrentThread();
-    PVOID StartAddress, EndAddress;
     PVOID WaitObjects[2];
+    BOOLEAN NonTemporal;
 
-    /* Get the discardable sections to free them */
-    MiFindInitializationCode(&StartAddress, &EndAddress);
-    if (StartAddress) MiFreeInitializationCode(StartAddress, EndAddress);
-    DPRINT("Free pages: %lx\n", MmAvailablePages);
-
-    /* Set our priority to 0 */
+    /* Set our priority to 0, so that we only run when the processor is idle */
     Thread->BasePriority = 0;
     KeSetPriorityThread(Thread, 0);
 
+    /* Stay on our processor, so that the zeroing PTEs are only cached there */
+    KeSetSystemAffinityThread(Worker->Affinity);
+
+    /* Don't pollute the caches with the pages we zero, if we can */
+#if defined(_M_IX86) || defined(_M_AMD64)
+    NonTemporal = BooleanFlagOn(KeFeatureBits, KF_XMMI64);
+#else
+    NonTemporal = FALSE;
+#endif
+
     /* Setup the wait objects */
     WaitObjects[0] = &MmZeroingPageEvent;
 //    WaitObjects[1] = &PoSystemIdleTimer; FIXME: Implement idle timer
@@ -68,39 +165,12 @@ MmZeroPageThread(VOID)
 
         while (TRUE)
         {
-            ULONG PageCount = 0;
-            PMMPFN Pfn1 = (PMMPFN)LIST_HEAD;
+            ULONG PageCount;
+            PMMPFN Pfn1;
             PVOID ZeroAddress;
-            PFN_NUMBER PageIndex, FreePage;
+            PFN_NUMBER PageIndex;
 
-            while (PageCount < MI_ZERO_PTES)
-            {
-                PMMPFN Pfn2;
-
-                if (!MmFreePageListHead.Total)
-                    break;
-
-                PageIndex = MmFreePageListHead.Flink;
-                ASSERT(PageIndex != LIST_HEAD);
-                MI_SET_USAGE(MI_USAGE_ZERO_LOOP);
-                MI_SET_PROCESS2("Kernel 0 Loop");
-                FreePage = MiRemoveAnyPage(MI_GET_PAGE_COLOR(PageIndex));
-
-                /* The first global free page should also be the first on its own list */
-                if (FreePage != PageIndex)
-                {
-                    KeBugCheckEx(PFN_LIST_CORRUPT,
-                                0x8F,
-                                FreePage,
-                                PageIndex,
-                                0);
-                }
-
-                Pfn2 = MiGetPfnEntry(PageIndex);
-                Pfn2->u1.Flink = (PFN_NUMBER)Pfn1;
-                Pfn1 = Pfn2;
-                PageCount++;
-            }
+            Pfn1 = MiGrabPagesToZero(Worker, &PageCount);
             MiReleasePfnLock(OldIrql);
 
             if (PageCount == 0)
@@ -109,9 +179,12 @@ MmZeroPageThread(VOID)
                 break;
             }
 
-            ZeroAddress = MiMapPagesInZeroSpace(Pfn1, PageCount);
+            ZeroAddress = MiMapPagesInZeroSpace(Worker->ZeroingPte, Pfn1, PageCount, NonTemporal);
             ASSERT(ZeroAddress);
-            KeZeroPages(ZeroAddress, PageCount * PAGE_SIZE);
+            if (NonTemporal)
+                KeZeroPagesNonTemporal(ZeroAddress, PageCount * PAGE_SIZE);
+            else
+                KeZeroPages(ZeroAddress, PageCount * PAGE_SIZE);
             MiUnmapPagesInZeroSpace(ZeroAddress, PageCount);
 
             OldIrql = MiAcquirePfnLock();
@@ -122,8 +195,110 @@ MmZeroPageThread(VOID)
                 Pfn1 = (PMMPFN)Pfn1->u1.Flink;
                 MiInsertPageInList(&MmZeroedPageListHead, PageIndex);
             }
+
+            MmBackgroundZeroedPages += PageCount;
         }
     }
 }
 
+static
+VOID
+NTAPI
+MiZeroPageWorkerThread(
+    _In_ PVOID Context)
+{
+    MiZeroPageWorker(Context);
+}
+
+VOID
+NTAPI
+MmZeroPageThread(VOID)
+{
+    PVOID StartAddress, EndAddress;
+    PMI_ZERO_PAGE_WORKER Workers;
+    HANDLE ThreadHandle;
+    NTSTATUS Status;
+    ULONG i;
+
+    /* Get the discardable sections to free them */
+    MiFindInitializationCode(&StartAddress, &EndAddress);
+    if (StartAddress) MiFreeInitializationCode(StartAddress, EndAddress);
+    DPRINT("Free pages: %lx\n", MmAvailablePages);
+
+    /* One worker per processor, and each of them zeroes its own set of colors */
+    MmZeroPageWorkers = min((ULONG)KeNumberProcessors, MmSecondaryColors);
+    Workers = ExAllocatePoolWithTag(NonPagedPool,
+                                    MmZeroPageWorkers * sizeof(MI_ZERO_PAGE_WORKER),
+                                    'ZPmM');
+    if (!Workers)
+    {
+        /* Do it all by ourselves */
+        static MI_ZERO_PAGE_WORKER BootWorker;
+        MmZeroPageWorkers = 1;
+        Workers = &BootWorker;
+    }
+
+    for (i = 0; i < MmZeroPageWorkers; i++)
+    {
+        Workers[i].Affinity = (KAFFINITY)1 << i;
+        Workers[i].FirstColor = i;
+        Workers[i].NextColor = i;
+
+        /* We're the first worker, and we use the boot zeroing PTEs */
+        if (i == 0)
+        {
+            Workers[i].ZeroingPte = MiFirstReservedZeroingPte;
+            continue;
+        }
+
+        /* The others get their own */
+        Workers[i].ZeroingPte = MiReserveSystemPtes(MI_ZERO_PTES + 1, SystemPteSpace);
+        if (!Workers[i].ZeroingPte)
+        {
+            DPRINT1("No zeroing PTEs for worker %lu\n", i);
+            break;
+        }
+        RtlZeroMemory(Workers[i].ZeroingPte, (MI_ZERO_PTES + 1) * sizeof(MMPTE));
+        Workers[i].ZeroingPte->u.Hard.PageFrameNumber = MI_ZERO_PTES;
+
+        Status = PsCreateSystemThread(&ThreadHandle,
+                                      THREAD_ALL_ACCESS,
+                                      NULL,
+                                      NULL,
+                                      NULL,
+                                      MiZeroPageWorkerThread,
+                                      &Workers[i]);
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("Failed to start zeroing worker %lu: %lx\n", i, Status);
+            MiReleaseSystemPtes(Workers[i].ZeroingPte, MI_ZERO_PTES + 1, SystemPteSpace);
+            break;
+        }
+        ZwClose(ThreadHandle);
+    }
+
+    /* If we couldn't start them all, the colors of the missing ones are
+     * still zeroed by the others once they're done with theirs */
+    DPRINT("%lu zeroing workers\n", i);
+
+    /* And now become the first worker */
+    MiZeroPageWorker(&Workers[0]);
+}
+
+#if DBG && defined(KDBG)
+
+BOOLEAN
+ExpKdbgExtZeroPages(ULONG Argc, PCHAR Argv[])
+{
+    KdbpPrint("Zeroing workers:\t%lu\n", MmZeroPageWorkers);
+    KdbpPrint("Zeroed pages:\t\t%lu\n", MmZeroedPageListHead.Total);
+    KdbpPrint("Free pages:\t\t%lu\n", MmFreePageListHead.Total);
+    KdbpPrint("Zeroed in background:\t%lu\n", MmBackgroundZeroedPages);
+    KdbpPrint("Zeroed inline:\t\t%lu\n", MmInlineZeroedPages);
+
+    return TRUE;
+}
+
+#endif // DBG && defined(KDBG)
+
 /* EOF */
@@ -36,6 +36,9 @@ static KTIMER MiBalancerTimer;
 
 static LONG PageOutThreadActive;
 
+/* Number of balancer visits without access after which a user page is cold */
+#define MI_USER_PAGE_COLD_AGE 3
+
 /* FUNCTIONS ****************************************************************/
 
 CODE_SEG("INIT")
@@ -134,134 +137,196 @@ MiTrimMemoryConsumer(ULONG Consumer, ULONG InitialTarget)
     return (InitialTarget > NrFreedPages) ? (InitialTarget - NrFreedPages) : 0;
 }
 
+/*
+ * Clear the accessed bit of every process mapping of a user page, and tell
+ * whether any of them was set since the last time we looked.
+ */
+static
+BOOLEAN
+MiTestAndClearUserPageAccessed(PFN_NUMBER Page)
+{
+    PEPROCESS Process = NULL;
+    PVOID Address = NULL;
+    BOOLEAN Accessed = FALSE;
+
+    /*
+     * We have a lock-ordering problem here. We cant lock the PFN DB before the Process address space.
+     * So we must use circonvoluted loops.
+     * Well...
+     */
+    while (TRUE)
+    {
+        KAPC_STATE ApcState;
+        KIRQL OldIrql = MiAcquirePfnLock();
+        PMM_RMAP_ENTRY Entry = MmGetRmapListHeadPage(Page);
+        while (Entry)
+        {
+            if (RMAP_IS_SEGMENT(Entry->Address))
+            {
+                Entry = Entry->Next;
+                continue;
+            }
+
+            /* Check that we didn't treat this entry before */
+            if (Entry->Address < Address)
+            {
+                Entry = Entry->Next;
+                continue;
+            }
+
+            if ((Entry->Address == Address) && (Entry->Process <= Process))
+            {
+                Entry = Entry->Next;
+                continue;
+            }
+
+            break;
+        }
+
+        if (!Entry)
+        {
+            MiReleasePfnLock(OldIrql);
+            break;
+        }
+
+        Process = Entry->Process;
+        Address = Entry->Address;
+
+        ObReferenceObject(Process);
+
+        if (!ExAcquireRundownProtection(&Process->RundownProtect))
+        {
+            ObDereferenceObject(Process);
+            MiReleasePfnLock(OldIrql);
+            continue;
+        }
+
+        MiReleasePfnLock(OldIrql);
+
+        KeStackAttachProcess(&Process->Pcb, &ApcState);
+        MiLockProcessWorkingSet(Process, PsGetCurrentThread());
+
+        /* Be sure this is still valid. */
+        if (MmIsAddressValid(Address))
+        {
+            PMMPTE Pte = MiAddressToPte(Address);
+            if (Pte->u.Hard.Accessed)
+            {
+                Accessed = TRUE;
+                Pte->u.Hard.Accessed = 0;
+
+                /* Drop the cached translation, or the CPU won't set the bit again */
+                KeInvalidateTlbEntry(Address);
+            }
+        }
+
+        MiUnlockProcessWorkingSet(Process, PsGetCurrentThread());
+
+        KeUnstackDetachProcess(&ApcState);
+        ExReleaseRundownProtection(&Process->RundownProtect);
+        ObDereferenceObject(Process);
+    }
+
+    return Accessed;
+}
+
+/*
+ * Clock-style aging of user pages. Every visit of the balancer makes a page
+ * young again if it was touched since the previous visit, or older if it
+ * was not. The age lives in the PFN's WSLE until legacy pages get real
+ * working set list entries.
+ */
+static
+ULONG
+MiAgeUserPage(PFN_NUMBER Page)
+{
+    BOOLEAN Accessed = MiTestAndClearUserPageAccessed(Page);
+    KIRQL OldIrql = MiAcquirePfnLock();
+    PMMPFN Pfn = MiGetPfnEntry(Page);
+    ULONG Age;
+
+    if (Accessed)
+        Pfn->Wsle.u1.e1.Age = 0;
+    else if (Pfn->Wsle.u1.e1.Age < MI_USER_PAGE_COLD_AGE)
+        Pfn->Wsle.u1.e1.Age++;
+    Age = Pfn->Wsle.u1.e1.Age;
+
+    MiReleasePfnLock(OldIrql);
+
+    return Accessed ? 0 : Age;
+}
+
+static
+VOID
+MiAgeUserPages(ULONG Count)
+{
+    PFN_NUMBER FirstPage, CurrentPage;
+
+    /* Walking the list moves mapped pages to its tail, this is our clock hand */
+    FirstPage = MmGetLRUFirstUserPage();
+    CurrentPage = FirstPage;
+    while (CurrentPage != 0 && Count > 0)
+    {
+        MiAgeUserPage(CurrentPage);
+        Count--;
+
+        CurrentPage = MmGetLRUNextUserPage(CurrentPage, TRUE);
+        if (CurrentPage == FirstPage)
+            break;
+    }
+
+    if (CurrentPage)
+    {
+        KIRQL OldIrql = MiAcquirePfnLock();
+        MmDereferencePage(CurrentPage);
+        MiReleasePfnLock(OldIrql);
+    }
+}
+
 NTSTATUS
 MmTrimUserMemory(ULONG Target, ULONG Priority, PULONG NrFreedPages)
 {
     PFN_NUMBER FirstPage, CurrentPage;
+    ULONG MinimumAge;
     NTSTATUS Status;
 
     (*NrFreedPages) = 0;
 
-    DPRINT("MM BALANCER: %s\n", Priority ? "Paging out!" : "Removing access bit!");
+    DPRINT("MM BALANCER: %s\n", Priority ? "Paging out!" : "Aging pages!");
+
+    /*
+     * When not in a hurry, only get rid of pages which went unused for several
+     * of our visits, and count visited pages against the target. When paging
+     * out aggressively, start with the pages nobody touched since the last
+     * visit, and only take the hot ones if a whole round was not enough.
+     */
+    MinimumAge = Priority ? 1 : MI_USER_PAGE_COLD_AGE;
 
     FirstPage = MmGetLRUFirstUserPage();
     CurrentPage = FirstPage;
     while (CurrentPage != 0 && Target > 0)
     {
-        if (Priority)
+        ULONG Age = (MinimumAge != 0) ? MiAgeUserPage(CurrentPage) : 0;
+
+        if (Age >= MinimumAge)
         {
             Status = MmPageOutPhysicalAddress(CurrentPage);
             if (NT_SUCCESS(Status))
             {
                 DPRINT("Succeeded\n");
-                Target--;
                 (*NrFreedPages)++;
+                if (Priority)
+                    Target--;
                 if (CurrentPage == FirstPage)
                 {
                     FirstPage = 0;
                 }
             }
         }
-        else
-        {
-            /* When not paging-out agressively, just reset the accessed bit */
-            PEPROCESS Process = NULL;
-            PVOID Address = NULL;
-            BOOLEAN Accessed = FALSE;
-
-            /*
-             * We have a lock-ordering problem here. We cant lock the PFN DB before the Process address space.
-             * So we must use circonvoluted loops.
-             * Well...
-             */
-            while (TRUE)
-            {
-                KAPC_STATE ApcState;
-                KIRQL OldIrql = MiAcquirePfnLock();
-                PMM_RMAP_ENTRY Entry = MmGetRmapListHeadPage(CurrentPage);
-                while (Entry)
-                {
-                    if (RMAP_IS_SEGMENT(Entry->Address))
-                    {
-                        Entry = Entry->Next;
-                        continue;
-                    }
-
-                    /* Check that we didn't treat this entry before */
-                    if (Entry->Address < Address)
-                    {
-                        Entry = Entry->Next;
-                        continue;
-                    }
-
-                    if ((Entry->Address == Address) && (Entry->Process <= Process))
-                    {
-                        Entry = Entry->Next;
-                        continue;
-                    }
-
-                    break;
-                }
-
-                if (!Entry)
-                {
-                    MiReleasePfnLock(OldIrql);
-                    break;
-                }
-
-                Process = Entry->Process;
-                Address = Entry->Address;
-
-                ObReferenceObject(Process);
-
-                if (!ExAcquireRundownProtection(&Process->RundownProtect))
-                {
-                    ObDereferenceObject(Process);
-                    MiReleasePfnLock(OldIrql);
-                    continue;
-                }
-
-                MiReleasePfnLock(OldIrql);
-
-                KeStackAttachProcess(&Process->Pcb, &ApcState);
-                MiLockProcessWorkingSet(Process, PsGetCurrentThread());
-
-                /* Be sure this is still valid. */
-                if (MmIsAddressValid(Address))
-                {
-                    PMMPTE Pte = MiAddressToPte(Address);
-                    Accessed = Accessed || Pte->u.Hard.Accessed;
-                    Pte->u.Hard.Accessed = 0;
-
-                    /* There is no need to invalidate, the balancer thread is never on a user process */
-                    //KeInvalidateTlbEntry(Address);
-                }
-
-                MiUnlockProcessWorkingSet(Process, PsGetCurrentThread());
 
-                KeUnstackDetachProcess(&ApcState);
-                ExReleaseRundownProtection(&Process->RundownProtect);
-                ObDereferenceObject(Process);
-            }
-
-            if (!Accessed)
-            {
-                /* Nobody accessed this page since the last time we check. Time to clean up */
-
-                Status = MmPageOutPhysicalAddress(CurrentPage);
-                if (NT_SUCCESS(Status))
-                {
-                    if (CurrentPage == FirstPage)
-                    {
-                        FirstPage = 0;
-                    }
-                }
-                // DPRINT1("Paged-out one page: %s\n", NT_SUCCESS(Status) ? "Yes" : "No");
-            }
-
-            /* Done for this page. */
+        /* Done for this page. */
+        if (!Priority)
             Target--;
-        }
 
         CurrentPage = MmGetLRUNextUserPage(CurrentPage, TRUE);
         if (FirstPage == 0)
@@ -270,8 +335,16 @@ MmTrimUserMemory(ULONG Target, ULONG Priority, PULONG NrFreedPages)
         }
         else if (CurrentPage == FirstPage)
         {
+            if (Priority && (MinimumAge != 0))
+            {
+                /* Cold pages were not enough. Take whatever we find now. */
+                DPRINT("No more cold pages, %lu left to free\n", Target);
+                MinimumAge = 0;
+                continue;
+            }
+
             DPRINT1("We are back at the start, abort!\n");
-            return STATUS_SUCCESS;
+            break;
         }
     }
 
@@ -403,6 +476,10 @@ MiBalancerThread(PVOID Unused)
             }
             while (InitialTarget != 0);
 
+            /* Keep the clock going, so that page ages mean something once memory gets tight */
+            if (Status == STATUS_WAIT_1)
+                MiAgeUserPages(MiMinimumPagesPerRun);
+
             if (Status == STATUS_WAIT_0)
                 InterlockedDecrement(&PageOutThreadActive);
         }
@@ -641,6 +641,7 @@ MmAllocPage(ULONG Type)
 
     Pfn1->NextLRU = NULL;
     Pfn1->PreviousLRU = NULL;
+    Pfn1->Wsle.u1.e1.Age = 0;
 
     if (Type == MC_USER)
     {
@@ -215,6 +215,10 @@ MmAccessFault(IN ULONG FaultCode,
     NTSTATUS Status;
     BOOLEAN IsArm3Fault = FALSE;
 
+    /* Account user faults to the process, for the VM counters */
+    if (Address <= MM_HIGHEST_USER_ADDRESS)
+        InterlockedIncrement((PLONG)&PsGetCurrentProcess()->Vm.PageFaultCount);
+
     /* Cute little hack for ROS */
     if ((ULONG_PTR)Address >= (ULONG_PTR)MmSystemRangeStart)
     {
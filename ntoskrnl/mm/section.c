@@ -195,6 +195,17 @@ POBJECT_TYPE MmSectionObjectType = NULL;
 
 ULONG_PTR MmSubsectionBase;
 
+/*
+ * Fault-around window, in pages. A not-present fault on a section view pages
+ * in the whole aligned window around the faulting address, and maps the
+ * neighbours which are already resident, so that walking through a freshly
+ * mapped image does not take one fault per page. The image window is twice
+ * the 64K chunk MmMakeSegmentResident reads on its own. 0 or 1 disables it.
+ * Both values can be set from the Memory Management registry key.
+ */
+ULONG MmImageFaultAroundPages = 32;
+ULONG MmDataFaultAroundPages = 0;
+
 static ULONG SectionCharacteristicsToProtect[16] =
 {
     PAGE_NOACCESS,          /* 0 = NONE */
@@ -1527,6 +1538,107 @@ MmAlterViewAttributes(PMMSUPPORT AddressSpace,
     MmUnlockSectionSegment(Segment);
 }
 
+static
+BOOLEAN
+MiGetFaultAroundWindow(
+    _In_ PEPROCESS Process,
+    _In_ PMEMORY_AREA MemoryArea,
+    _In_ PVOID PAddress,
+    _Out_ PULONG_PTR WindowStart,
+    _Out_ PULONG_PTR WindowEnd)
+{
+    PMM_SECTION_SEGMENT Segment = MemoryArea->SectionData.Segment;
+    ULONG_PTR WindowSize;
+    ULONG Pages;
+
+    /* Only user views, system views are the cache manager's business */
+    if (!Process)
+        return FALSE;
+
+    if (MemoryArea->VadNode.u.VadFlags.VadType == VadImageMap)
+        Pages = MmImageFaultAroundPages;
+    else
+        Pages = MmDataFaultAroundPages;
+
+    /* Honour the caller's access pattern hint */
+    if ((Pages <= 1) ||
+        (Segment->FileObject && FlagOn(Segment->FileObject->Flags, FO_RANDOM_ACCESS)))
+        return FALSE;
+
+    WindowSize = (ULONG_PTR)Pages << PAGE_SHIFT;
+    *WindowStart = (ULONG_PTR)PAddress - ((ULONG_PTR)PAddress % WindowSize);
+    *WindowEnd = *WindowStart + WindowSize;
+
+    /* Stay inside the view */
+    if (*WindowStart < MA_GetStartingAddress(MemoryArea))
+        *WindowStart = MA_GetStartingAddress(MemoryArea);
+    if (*WindowEnd > MA_GetEndingAddress(MemoryArea))
+        *WindowEnd = MA_GetEndingAddress(MemoryArea);
+
+    return TRUE;
+}
+
+static
+VOID
+MiMapFaultAroundPages(
+    _In_ PEPROCESS Process,
+    _In_ PMEMORY_AREA MemoryArea,
+    _In_ PMM_REGION Region,
+    _In_ PVOID PAddress,
+    _In_ ULONG Attributes)
+{
+    PMM_SECTION_SEGMENT Segment = MemoryArea->SectionData.Segment;
+    ULONG_PTR WindowStart, WindowEnd, Current;
+    LARGE_INTEGER Offset;
+    ULONG_PTR Entry;
+    PFN_NUMBER Page;
+    NTSTATUS Status;
+
+    /* The segment must be locked by the caller */
+    if (!MiGetFaultAroundWindow(Process, MemoryArea, PAddress, &WindowStart, &WindowEnd))
+        return;
+
+    for (Current = WindowStart; Current < WindowEnd; Current += PAGE_SIZE)
+    {
+        if (Current == (ULONG_PTR)PAddress)
+            continue;
+
+        /* Neighbours must share the protection of the faulting page */
+        if (MmFindRegion((PVOID)MA_GetStartingAddress(MemoryArea),
+                         &MemoryArea->SectionData.RegionListHead,
+                         (PVOID)Current, NULL) != Region)
+        {
+            continue;
+        }
+
+        /* Leave alone anything which is already mapped, private or in transition */
+        if (MmIsPagePresent(Process, (PVOID)Current) ||
+            MmIsPageSwapEntry(Process, (PVOID)Current) ||
+            MmIsDisabledPage(Process, (PVOID)Current))
+        {
+            continue;
+        }
+
+        Offset.QuadPart = Current - MA_GetStartingAddress(MemoryArea)
+                          + MemoryArea->SectionData.ViewOffset;
+        Entry = MmGetPageEntrySectionSegment(Segment, &Offset);
+        if ((Entry == 0) || IS_SWAP_FROM_SSE(Entry))
+            continue;
+
+        Page = PFN_FROM_SSE(Entry);
+        Status = MmCreateVirtualMapping(Process, (PVOID)Current, Attributes, Page);
+        if (!NT_SUCCESS(Status))
+        {
+            /* Not fatal, the page will simply fault on its own */
+            DPRINT("Fault-around mapping of %p failed: 0x%08lx\n", (PVOID)Current, Status);
+            break;
+        }
+
+        MmInsertRmap(Page, Process, (PVOID)Current);
+        MmSharePageEntrySectionSegment(Segment, &Offset);
+    }
+}
+
 NTSTATUS
 NTAPI
 MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
@@ -1767,6 +1879,20 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
             return STATUS_SUCCESS;
         }
 
+        LONGLONG ReadOffset = Offset.QuadPart;
+        ULONG ReadLength = PAGE_SIZE;
+        ULONG_PTR WindowStart, WindowEnd;
+
+        /* Bring in the whole fault-around window with as few reads as possible.
+         * The memory area may go as soon as the address space is unlocked,
+         * so work out the range now. */
+        if (MiGetFaultAroundWindow(Process, MemoryArea, PAddress, &WindowStart, &WindowEnd))
+        {
+            ReadOffset = WindowStart - MA_GetStartingAddress(MemoryArea)
+                         + MemoryArea->SectionData.ViewOffset;
+            ReadLength = (ULONG)(WindowEnd - WindowStart);
+        }
+
         MmUnlockSectionSegment(Segment);
         MmUnlockAddressSpace(AddressSpace);
 
@@ -1775,7 +1901,7 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
 
         PFSRTL_COMMON_FCB_HEADER FcbHeader = Segment->FileObject->FsContext;
 
-        Status = MmMakeSegmentResident(Segment, Offset.QuadPart, PAGE_SIZE, &FcbHeader->ValidDataLength, FALSE);
+        Status = MmMakeSegmentResident(Segment, ReadOffset, ReadLength, &FcbHeader->ValidDataLength, FALSE);
 
         FsRtlReleaseFile(Segment->FileObject);
 
@@ -1898,6 +2024,9 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
 
         /* Take a reference on it */
         MmSharePageEntrySectionSegment(Segment, &Offset);
+
+        /* Map whatever else is resident around it while we hold the segment */
+        MiMapFaultAroundPages(Process, MemoryArea, Region, PAddress, Attributes);
         MmUnlockSectionSegment(Segment);
 
         DPRINT("Address 0x%p\n", Address);
@@ -472,6 +472,13 @@ typedef enum _STOR_SYNCHRONIZATION_MODEL
     StorSynchronizeFullDuplex
 } STOR_SYNCHRONIZATION_MODEL;
 
+typedef enum _INTERRUPT_SYNCHRONIZATION_MODE
+{
+    InterruptSupportNone,
+    InterruptSynchronizeAll,
+    InterruptSynchronizePerMessage
+} INTERRUPT_SYNCHRONIZATION_MODE;
+
 typedef enum _STOR_DMA_WIDTH
 {
     DmaUnknown,
@@ -592,6 +599,11 @@ typedef enum _VPD_IDENTIFIER_TYPE
     VpdIdentifierTypeSCSINameString = 8
 } VPD_IDENTIFIER_TYPE, *PVPD_IDENTIFIER_TYPE;
 
+#define STOR_STATUS_SUCCESS                 (0x00000000L)
+#define STOR_STATUS_UNSUCCESSFUL            (0xC1000001L)
+#define STOR_STATUS_NOT_IMPLEMENTED         (0xC1000002L)
+#define STOR_STATUS_INVALID_PARAMETER       (0xC1000005L)
+
 typedef enum _STORPORT_FUNCTION_CODE
 {
     ExtFunctionAllocatePool,
@@ -2031,6 +2043,12 @@ typedef struct _MEMORY_REGION
     ULONG Length;
 } MEMORY_REGION, *PMEMORY_REGION;
 
+typedef
+BOOLEAN
+(NTAPI *PHW_MESSAGE_SIGNALED_INTERRUPT_ROUTINE)(
+    _In_ PVOID HwDeviceExtension,
+    _In_ ULONG MessageId);
+
 typedef struct _PORT_CONFIGURATION_INFORMATION
 {
     ULONG Length;
@@ -2085,6 +2103,8 @@ typedef struct _PORT_CONFIGURATION_INFORMATION
     UCHAR MaximumNumberOfLogicalUnits;
     BOOLEAN WmiDataProvider;
     STOR_SYNCHRONIZATION_MODEL SynchronizationModel;
+    PHW_MESSAGE_SIGNALED_INTERRUPT_ROUTINE HwMSInterruptRoutine;
+    INTERRUPT_SYNCHRONIZATION_MODE InterruptSynchronizationMode;
 } PORT_CONFIGURATION_INFORMATION, *PPORT_CONFIGURATION_INFORMATION;
 
 typedef struct _STOR_SCATTER_GATHER_ELEMENT
@@ -696,6 +696,20 @@ typedef NTSTATUS
 );
 #endif
 
+//
+// Thread Pool I/O completion callback
+//
+#ifdef NTOS_MODE_USER
+typedef VOID
+(NTAPI *PTP_IO_CALLBACK)(
+    _Inout_ PTP_CALLBACK_INSTANCE Instance,
+    _Inout_opt_ PVOID Context,
+    _In_ PVOID ApcContext,
+    _In_ struct _IO_STATUS_BLOCK *IoStatusBlock,
+    _In_ PTP_IO Io
+);
+#endif
+
 //
 // RTL Range List callbacks
 //
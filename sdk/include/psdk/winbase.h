@@ -206,6 +206,10 @@ extern "C" {
 #define COPY_FILE_RESTARTABLE                   0x00000002
 #define COPY_FILE_OPEN_SOURCE_FOR_WRITE         0x00000004
 #define COPY_FILE_ALLOW_DECRYPTED_DESTINATION   0x00000008
+#if (_WIN32_WINNT >= 0x0600)
+#define COPY_FILE_COPY_SYMLINK                  0x00000800
+#define COPY_FILE_NO_BUFFERING                  0x00001000
+#endif
 
 #define FILE_FLAG_WRITE_THROUGH                 0x80000000
 #define FILE_FLAG_OVERLAPPED                    0x40000000
@@ -2395,6 +2399,9 @@ GetProfileStringW(
   _In_ DWORD nSize);
 
 BOOL WINAPI GetQueuedCompletionStatus(HANDLE,PDWORD,PULONG_PTR,LPOVERLAPPED*,DWORD);
+#if (_WIN32_WINNT >= 0x0600)
+BOOL WINAPI GetQueuedCompletionStatusEx(HANDLE,LPOVERLAPPED_ENTRY,ULONG,PULONG,DWORD,BOOL);
+#endif
 BOOL WINAPI GetSecurityDescriptorControl(PSECURITY_DESCRIPTOR,PSECURITY_DESCRIPTOR_CONTROL,PDWORD);
 BOOL WINAPI GetSecurityDescriptorDacl(PSECURITY_DESCRIPTOR,LPBOOL,PACL*,LPBOOL);
 BOOL WINAPI GetSecurityDescriptorGroup(PSECURITY_DESCRIPTOR,PSID*,LPBOOL);
@@ -4098,6 +4105,320 @@ InitOnceExecuteOnce(
     _Inout_opt_ PVOID Parameter,
     _Outptr_opt_result_maybenull_ LPVOID *Context);
 
+#if (_WIN32_WINNT >= _WIN32_WINNT_VISTA) || (DLL_EXPORT_VERSION >= _WIN32_WINNT_VISTA)
+
+typedef VOID
+(WINAPI *PTP_WIN32_IO_CALLBACK)(
+  _Inout_ PTP_CALLBACK_INSTANCE Instance,
+  _Inout_opt_ PVOID Context,
+  _Inout_opt_ PVOID Overlapped,
+  _In_ ULONG IoResult,
+  _In_ ULONG_PTR NumberOfBytesTransferred,
+  _Inout_ PTP_IO Io);
+
+WINBASEAPI
+_Must_inspect_result_
+PTP_POOL
+WINAPI
+CreateThreadpool(
+  _Reserved_ PVOID reserved);
+
+WINBASEAPI
+VOID
+WINAPI
+CloseThreadpool(
+  _Inout_ PTP_POOL ptpp);
+
+WINBASEAPI
+VOID
+WINAPI
+SetThreadpoolThreadMaximum(
+  _Inout_ PTP_POOL ptpp,
+  _In_ DWORD cthrdMost);
+
+WINBASEAPI
+BOOL
+WINAPI
+SetThreadpoolThreadMinimum(
+  _Inout_ PTP_POOL ptpp,
+  _In_ DWORD cthrdMic);
+
+WINBASEAPI
+_Must_inspect_result_
+PTP_CLEANUP_GROUP
+WINAPI
+CreateThreadpoolCleanupGroup(VOID);
+
+WINBASEAPI
+VOID
+WINAPI
+CloseThreadpoolCleanupGroup(
+  _Inout_ PTP_CLEANUP_GROUP ptpcg);
+
+WINBASEAPI
+VOID
+WINAPI
+CloseThreadpoolCleanupGroupMembers(
+  _Inout_ PTP_CLEANUP_GROUP ptpcg,
+  _In_ BOOL fCancelPendingCallbacks,
+  _Inout_opt_ PVOID pvCleanupContext);
+
+WINBASEAPI
+_Must_inspect_result_
+BOOL
+WINAPI
+TrySubmitThreadpoolCallback(
+  _In_ PTP_SIMPLE_CALLBACK pfns,
+  _Inout_opt_ PVOID pv,
+  _In_opt_ PTP_CALLBACK_ENVIRON pcbe);
+
+WINBASEAPI
+_Must_inspect_result_
+PTP_WORK
+WINAPI
+CreateThreadpoolWork(
+  _In_ PTP_WORK_CALLBACK pfnwk,
+  _Inout_opt_ PVOID pv,
+  _In_opt_ PTP_CALLBACK_ENVIRON pcbe);
+
+WINBASEAPI
+VOID
+WINAPI
+SubmitThreadpoolWork(
+  _Inout_ PTP_WORK pwk);
+
+WINBASEAPI
+VOID
+WINAPI
+WaitForThreadpoolWorkCallbacks(
+  _Inout_ PTP_WORK pwk,
+  _In_ BOOL fCancelPendingCallbacks);
+
+WINBASEAPI
+VOID
+WINAPI
+CloseThreadpoolWork(
+  _Inout_ PTP_WORK pwk);
+
+WINBASEAPI
+_Must_inspect_result_
+PTP_TIMER
+WINAPI
+CreateThreadpoolTimer(
+  _In_ PTP_TIMER_CALLBACK pfnti,
+  _Inout_opt_ PVOID pv,
+  _In_opt_ PTP_CALLBACK_ENVIRON pcbe);
+
+WINBASEAPI
+VOID
+WINAPI
+SetThreadpoolTimer(
+  _Inout_ PTP_TIMER pti,
+  _In_opt_ PFILETIME pftDueTime,
+  _In_ DWORD msPeriod,
+  _In_opt_ DWORD msWindowLength);
+
+WINBASEAPI
+BOOL
+WINAPI
+IsThreadpoolTimerSet(
+  _Inout_ PTP_TIMER pti);
+
+WINBASEAPI
+VOID
+WINAPI
+WaitForThreadpoolTimerCallbacks(
+  _Inout_ PTP_TIMER pti,
+  _In_ BOOL fCancelPendingCallbacks);
+
+WINBASEAPI
+VOID
+WINAPI
+CloseThreadpoolTimer(
+  _Inout_ PTP_TIMER pti);
+
+WINBASEAPI
+_Must_inspect_result_
+PTP_WAIT
+WINAPI
+CreateThreadpoolWait(
+  _In_ PTP_WAIT_CALLBACK pfnwa,
+  _Inout_opt_ PVOID pv,
+  _In_opt_ PTP_CALLBACK_ENVIRON pcbe);
+
+WINBASEAPI
+VOID
+WINAPI
+SetThreadpoolWait(
+  _Inout_ PTP_WAIT pwa,
+  _In_opt_ HANDLE h,
+  _In_opt_ PFILETIME pftTimeout);
+
+WINBASEAPI
+VOID
+WINAPI
+WaitForThreadpoolWaitCallbacks(
+  _Inout_ PTP_WAIT pwa,
+  _In_ BOOL fCancelPendingCallbacks);
+
+WINBASEAPI
+VOID
+WINAPI
+CloseThreadpoolWait(
+  _Inout_ PTP_WAIT pwa);
+
+WINBASEAPI
+_Must_inspect_result_
+PTP_IO
+WINAPI
+CreateThreadpoolIo(
+  _In_ HANDLE fl,
+  _In_ PTP_WIN32_IO_CALLBACK pfnio,
+  _Inout_opt_ PVOID pv,
+  _In_opt_ PTP_CALLBACK_ENVIRON pcbe);
+
+WINBASEAPI
+VOID
+WINAPI
+StartThreadpoolIo(
+  _Inout_ PTP_IO pio);
+
+WINBASEAPI
+VOID
+WINAPI
+CancelThreadpoolIo(
+  _Inout_ PTP_IO pio);
+
+WINBASEAPI
+VOID
+WINAPI
+WaitForThreadpoolIoCallbacks(
+  _Inout_ PTP_IO pio,
+  _In_ BOOL fCancelPendingCallbacks);
+
+WINBASEAPI
+VOID
+WINAPI
+CloseThreadpoolIo(
+  _Inout_ PTP_IO pio);
+
+WINBASEAPI
+BOOL
+WINAPI
+CallbackMayRunLong(
+  _Inout_ PTP_CALLBACK_INSTANCE pci);
+
+WINBASEAPI
+VOID
+WINAPI
+DisassociateCurrentThreadFromCallback(
+  _Inout_ PTP_CALLBACK_INSTANCE pci);
+
+WINBASEAPI
+VOID
+WINAPI
+SetEventWhenCallbackReturns(
+  _Inout_ PTP_CALLBACK_INSTANCE pci,
+  _In_ HANDLE evt);
+
+WINBASEAPI
+VOID
+WINAPI
+ReleaseSemaphoreWhenCallbackReturns(
+  _Inout_ PTP_CALLBACK_INSTANCE pci,
+  _In_ HANDLE sem,
+  _In_ DWORD crel);
+
+WINBASEAPI
+VOID
+WINAPI
+ReleaseMutexWhenCallbackReturns(
+  _Inout_ PTP_CALLBACK_INSTANCE pci,
+  _In_ HANDLE mut);
+
+WINBASEAPI
+VOID
+WINAPI
+LeaveCriticalSectionWhenCallbackReturns(
+  _Inout_ PTP_CALLBACK_INSTANCE pci,
+  _Inout_ PCRITICAL_SECTION pcs);
+
+WINBASEAPI
+VOID
+WINAPI
+FreeLibraryWhenCallbackReturns(
+  _Inout_ PTP_CALLBACK_INSTANCE pci,
+  _In_ HMODULE mod);
+
+#if !defined(MIDL_PASS)
+
+FORCEINLINE
+VOID
+InitializeThreadpoolEnvironment(
+  _Out_ PTP_CALLBACK_ENVIRON pcbe)
+{
+  TpInitializeCallbackEnviron(pcbe);
+}
+
+FORCEINLINE
+VOID
+SetThreadpoolCallbackPool(
+  _Inout_ PTP_CALLBACK_ENVIRON pcbe,
+  _In_ PTP_POOL ptpp)
+{
+  TpSetCallbackThreadpool(pcbe, ptpp);
+}
+
+FORCEINLINE
+VOID
+SetThreadpoolCallbackCleanupGroup(
+  _Inout_ PTP_CALLBACK_ENVIRON pcbe,
+  _In_ PTP_CLEANUP_GROUP ptpcg,
+  _In_opt_ PTP_CLEANUP_GROUP_CANCEL_CALLBACK pfng)
+{
+  TpSetCallbackCleanupGroup(pcbe, ptpcg, pfng);
+}
+
+FORCEINLINE
+VOID
+SetThreadpoolCallbackRunsLong(
+  _Inout_ PTP_CALLBACK_ENVIRON pcbe)
+{
+  TpSetCallbackLongFunction(pcbe);
+}
+
+FORCEINLINE
+VOID
+SetThreadpoolCallbackLibrary(
+  _Inout_ PTP_CALLBACK_ENVIRON pcbe,
+  _In_ PVOID mod)
+{
+  TpSetCallbackRaceWithDll(pcbe, mod);
+}
+
+#if (_WIN32_WINNT >= _WIN32_WINNT_WIN7)
+FORCEINLINE
+VOID
+SetThreadpoolCallbackPriority(
+  _Inout_ PTP_CALLBACK_ENVIRON pcbe,
+  _In_ TP_CALLBACK_PRIORITY Priority)
+{
+  TpSetCallbackPriority(pcbe, Priority);
+}
+#endif
+
+FORCEINLINE
+VOID
+DestroyThreadpoolEnvironment(
+  _Inout_ PTP_CALLBACK_ENVIRON pcbe)
+{
+  TpDestroyCallbackEnviron(pcbe);
+}
+
+#endif /* !defined(MIDL_PASS) */
+
+#endif /* (_WIN32_WINNT >= _WIN32_WINNT_VISTA) || (DLL_EXPORT_VERSION >= _WIN32_WINNT_VISTA) */
+
 
 #if defined(_SLIST_HEADER_) && !defined(_NTOS_) && !defined(_NTOSP_)
 
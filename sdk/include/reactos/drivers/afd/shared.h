@@ -59,6 +59,13 @@ typedef struct _AFD_POLL_INFO {
     AFD_HANDLE			        Handles[1];
 } AFD_POLL_INFO, *PAFD_POLL_INFO;
 
+/* Sockets stay in a poll set until they are taken out (Events 0) or closed,
+ * waits on the set only return the ones that are ready */
+typedef struct _AFD_POLL_SET_INFO {
+    ULONG				HandleCount;
+    AFD_HANDLE			        Handles[1];
+} AFD_POLL_SET_INFO, *PAFD_POLL_SET_INFO;
+
 typedef struct _AFD_ACCEPT_DATA {
     ULONG				UseSAN;
     ULONG				SequenceNumber;
@@ -261,6 +268,9 @@ typedef struct _AFD_TDI_HANDLE_DATA
 #define AFD_DEFER_ACCEPT		35
 #define AFD_GET_PENDING_CONNECT_DATA	41
 #define AFD_VALIDATE_GROUP		42
+/* ReactOS specific */
+#define AFD_POLL_SET_UPDATE		43
+#define AFD_POLL_SET_WAIT		44
 
 /* AFD IOCTLs */
 
@@ -336,6 +346,10 @@ typedef struct _AFD_TDI_HANDLE_DATA
   _AFD_CONTROL_CODE(AFD_ENUM_NETWORK_EVENTS, METHOD_NEITHER)
 #define IOCTL_AFD_VALIDATE_GROUP \
   _AFD_CONTROL_CODE(AFD_VALIDATE_GROUP, METHOD_NEITHER)
+#define IOCTL_AFD_POLL_SET_UPDATE \
+  _AFD_CONTROL_CODE(AFD_POLL_SET_UPDATE, METHOD_BUFFERED )
+#define IOCTL_AFD_POLL_SET_WAIT \
+  _AFD_CONTROL_CODE(AFD_POLL_SET_WAIT, METHOD_BUFFERED )
 
 typedef struct _AFD_SOCKET_INFORMATION {
     BOOL CommandChannel;
@@ -161,6 +161,9 @@ RtlpInitializeHeap(OUT PHEAP Heap,
     /* Initialise the Heap header */
     Heap->Signature = HEAP_SIGNATURE;
     Heap->Flags = Flags;
+    Heap->FrontEndHeap = NULL;
+    Heap->FrontEndHeapType = HEAP_FRONT_END_NONE;
+    RtlZeroMemory(&Heap->Counters, sizeof(Heap->Counters));
     Heap->ForceFlags = (Flags & (HEAP_NO_SERIALIZE |
                                  HEAP_GENERATE_EXCEPTIONS |
                                  HEAP_ZERO_MEMORY |
@@ -1766,6 +1769,9 @@ RtlDestroyHeap(HANDLE HeapPtr) /* [in] Handle of heap */
                             MEM_RELEASE);
     }
 
+    /* Free the front end, the blocks it caches go away with the segments */
+    RtlpDestroyLowFragmentationHeap(Heap);
+
     /* Delete tags and remove heap from the process heaps list in user mode */
     if (RtlpGetMode() == UserMode)
     {
@@ -2057,6 +2063,7 @@ RtlAllocateHeap(IN PVOID HeapPtr,
     BOOLEAN HeapLocked = FALSE;
     PHEAP_VIRTUAL_ALLOC_ENTRY VirtualBlock = NULL;
     PHEAP_ENTRY_EXTRA Extra;
+    PVOID FrontEndBlock;
     NTSTATUS Status;
 
     /* Force flags */
@@ -2106,10 +2113,35 @@ RtlAllocateHeap(IN PVOID HeapPtr,
 
     Index = AllocationSize >> HEAP_ENTRY_SHIFT;
 
+    /* Small plain blocks come from the front end, without taking the lock */
+    if (Heap->FrontEndHeap &&
+        !(Flags & HEAP_NO_SERIALIZE) &&
+        EntryFlags == HEAP_ENTRY_BUSY)
+    {
+        FrontEndBlock = RtlpLowFragHeapAlloc(Heap, Flags, Size, Index);
+        if (FrontEndBlock) return FrontEndBlock;
+    }
+
     /* Acquire the lock if necessary */
     if (!(Flags & HEAP_NO_SERIALIZE))
     {
-        RtlEnterHeapLock(Heap->LockVariable, TRUE);
+        if (RtlpGetMode() == KernelMode)
+        {
+            RtlEnterHeapLock(Heap->LockVariable, TRUE);
+        }
+        else if (!RtlTryEnterHeapLock(Heap->LockVariable, TRUE))
+        {
+            RtlEnterHeapLock(Heap->LockVariable, TRUE);
+
+            /* Small blocks fighting over the lock are what the front end is for */
+            if (Index <= HEAP_LFH_MAX_UNITS &&
+                ++Heap->Counters.LockCollisions == HEAP_LFH_ACTIVATION_COLLISIONS)
+            {
+                RtlpActivateLowFragmentationHeap(Heap);
+            }
+        }
+
+        Heap->Counters.LockAcquires++;
         HeapLocked = TRUE;
     }
 
@@ -2298,7 +2330,8 @@ BOOLEAN NTAPI RtlFreeHeap(
         /* Check this entry, fail if it's invalid */
         if (!(HeapEntry->Flags & HEAP_ENTRY_BUSY) ||
             (((ULONG_PTR)Ptr & 0x7) != 0) ||
-            (HeapEntry->SegmentOffset >= HEAP_SEGMENTS))
+            (HeapEntry->SegmentOffset >= HEAP_SEGMENTS) ||
+            (Heap->FrontEndHeap && HeapEntry->SmallTagIndex == HEAP_LFH_CACHED_TAG))
         {
             /* This is an invalid block */
             DPRINT1("HEAP: Trying to free an invalid address %p!\n", Ptr);
@@ -2315,6 +2348,14 @@ BOOLEAN NTAPI RtlFreeHeap(
     }
     _SEH2_END;
 
+    /* Small plain blocks go back to the front end, without taking the lock */
+    if (Heap->FrontEndHeap &&
+        !(Flags & HEAP_NO_SERIALIZE) &&
+        RtlpLowFragHeapFree(Heap, HeapEntry))
+    {
+        return TRUE;
+    }
+
     /* Lock if necessary */
     if (!(Flags & HEAP_NO_SERIALIZE))
     {
@@ -4061,13 +4102,18 @@ RtlSetHeapInformation(IN HANDLE HeapHandle OPTIONAL,
         }
 
         /* Check for a special magic value for enabling LFH */
-        if (*(PULONG)HeapInformation != 2)
+        if (*(PULONG)HeapInformation != HEAP_FRONT_END_LFH)
         {
             return STATUS_UNSUCCESSFUL;
         }
 
-        DPRINT1("RtlSetHeapInformation() needs to enable LFH\n");
-        return STATUS_SUCCESS;
+        /* It needs a heap to go with it */
+        if (!HeapHandle)
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        return RtlpActivateLowFragmentationHeap((PHEAP)HeapHandle);
     }
 
     return STATUS_SUCCESS;
@@ -313,6 +313,37 @@ typedef struct _HEAP_VIRTUAL_ALLOC_ENTRY
     HEAP_ENTRY BusyBlock;
 } HEAP_VIRTUAL_ALLOC_ENTRY, *PHEAP_VIRTUAL_ALLOC_ENTRY;
 
+/* Low fragmentation front end heap */
+#define HEAP_FRONT_END_NONE         0
+#define HEAP_FRONT_END_LFH          2
+
+#define HEAP_LFH_BUCKETS            80
+#define HEAP_LFH_MAX_UNITS          256
+#define HEAP_LFH_MAX_SLOTS          16
+#define HEAP_LFH_SLOT_CACHE_SIZE    0x4000
+#define HEAP_LFH_MIN_DEPTH          8
+#define HEAP_LFH_MAX_DEPTH          128
+#define HEAP_LFH_ACTIVATION_COLLISIONS 32
+
+/* Marks a block sitting in a front end cache, to catch double frees */
+#define HEAP_LFH_CACHED_TAG         0xFE
+
+/* One set of cached block lists per thread affinity slot */
+typedef struct _HEAP_LFH_AFFINITY_SLOT
+{
+    SLIST_HEADER Buckets[HEAP_LFH_BUCKETS];
+} HEAP_LFH_AFFINITY_SLOT, *PHEAP_LFH_AFFINITY_SLOT;
+
+typedef struct _HEAP_LFH
+{
+    SIZE_T CommitSize;
+    ULONG SlotMask;
+    ULONG Refills;
+    USHORT BucketUnits[HEAP_LFH_BUCKETS];
+    USHORT BucketDepth[HEAP_LFH_BUCKETS];
+    HEAP_LFH_AFFINITY_SLOT Slots[ANYSIZE_ARRAY];
+} HEAP_LFH, *PHEAP_LFH;
+
 /* Global variables */
 extern RTL_CRITICAL_SECTION RtlpProcessHeapsListLock;
 extern BOOLEAN RtlpPageHeapEnabled;
@@ -338,6 +369,23 @@ RtlpValidateHeapEntry(PHEAP Heap, PHEAP_ENTRY HeapEntry);
 BOOLEAN NTAPI
 RtlpValidateHeapHeaders(PHEAP Heap, BOOLEAN Recalculate);
 
+/* heaplfh.c */
+NTSTATUS NTAPI
+RtlpActivateLowFragmentationHeap(PHEAP Heap);
+
+VOID NTAPI
+RtlpDestroyLowFragmentationHeap(PHEAP Heap);
+
+PVOID NTAPI
+RtlpLowFragHeapAlloc(PHEAP Heap,
+                     ULONG Flags,
+                     SIZE_T Size,
+                     SIZE_T Index);
+
+BOOLEAN NTAPI
+RtlpLowFragHeapFree(PHEAP Heap,
+                    PHEAP_ENTRY HeapEntry);
+
 /* heapdbg.c */
 NTSYSAPI
 HANDLE NTAPI
@@ -0,0 +1,267 @@
+/*
+ * COPYRIGHT:       See COPYING in the top level directory
+ * PROJECT:         ReactOS system libraries
+ * FILE:            lib/rtl/heaplfh.c
+ * PURPOSE:         RTL Heap low fragmentation front end
+ */
+
+/* Small blocks freed by the application are kept busy in per size class,
+   per affinity slot lock free lists and handed out again without taking the
+   heap lock. Empty lists are refilled from the back end a batch at a time.
+   The cached blocks remain ordinary back end blocks, so every other heap
+   routine keeps working on them unchanged. */
+
+/* INCLUDES *****************************************************************/
+
+#include <rtl.h>
+#include <heap.h>
+
+#define NDEBUG
+#include <debug.h>
+
+/* FUNCTIONS *****************************************************************/
+
+static
+ULONG
+RtlpLfhBucketIndex(SIZE_T Units)
+{
+    ULONG Shift;
+
+    /* Exact sizes for the smallest blocks */
+    if (Units <= 32) return (ULONG)Units - 1;
+    if (Units > HEAP_LFH_MAX_UNITS) return HEAP_LFH_BUCKETS;
+
+    /* Then 16 buckets for every doubling of the size */
+    Shift = (Units <= 64) ? 1 : (Units <= 128) ? 2 : 3;
+    return 16 + 16 * Shift + (ULONG)((Units - (32 << (Shift - 1)) - 1) >> Shift);
+}
+
+static
+USHORT
+RtlpLfhBucketUnits(ULONG Bucket)
+{
+    ULONG Shift;
+
+    /* Return the largest size, in heap entry units, served by this bucket */
+    if (Bucket < 32) return (USHORT)(Bucket + 1);
+
+    Shift = (Bucket - 16) / 16;
+    return (USHORT)((32 << (Shift - 1)) + ((Bucket - 16 - 16 * Shift + 1) << Shift));
+}
+
+FORCEINLINE
+PHEAP_LFH_AFFINITY_SLOT
+RtlpLfhCurrentSlot(PHEAP_LFH Lfh)
+{
+    ULONG ThreadId = HandleToUlong(NtCurrentTeb()->ClientId.UniqueThread);
+
+    /* Thread IDs are multiples of 4 */
+    return &Lfh->Slots[(ThreadId >> 2) & Lfh->SlotMask];
+}
+
+NTSTATUS NTAPI
+RtlpActivateLowFragmentationHeap(PHEAP Heap)
+{
+    PHEAP_LFH Lfh = NULL;
+    SIZE_T CommitSize;
+    ULONG Slots, Slot, Bucket, Depth;
+    NTSTATUS Status;
+
+    /* Nothing to do if it's already there */
+    if (Heap->FrontEndHeap) return STATUS_SUCCESS;
+
+    /* The front end needs a lock to refill from, and plain unchecked blocks */
+    if (RtlpGetMode() != UserMode ||
+        Heap->Signature != HEAP_SIGNATURE ||
+        (Heap->ForceFlags & HEAP_FLAG_PAGE_ALLOCS) ||
+        RtlpHeapIsSpecial(Heap->Flags) ||
+        (Heap->Flags & (HEAP_NO_SERIALIZE | HEAP_FREE_CHECKING_ENABLED)) ||
+        Heap->PseudoTagEntries ||
+        Heap->AlignRound != 2 * sizeof(HEAP_ENTRY) - 1 ||
+        Heap->VirtualMemoryThreshold < HEAP_LFH_MAX_UNITS)
+    {
+        DPRINT("Heap %p can't have a low fragmentation front end\n", Heap);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    /* One affinity slot per processor, rounded up to a power of two */
+    Slots = 1;
+    while (Slots < NtCurrentPeb()->NumberOfProcessors && Slots < HEAP_LFH_MAX_SLOTS)
+        Slots <<= 1;
+
+    CommitSize = FIELD_OFFSET(HEAP_LFH, Slots[Slots]);
+    Status = ZwAllocateVirtualMemory(NtCurrentProcess(),
+                                     (PVOID *)&Lfh,
+                                     0,
+                                     &CommitSize,
+                                     MEM_COMMIT,
+                                     PAGE_READWRITE);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    Lfh->CommitSize = CommitSize;
+    Lfh->SlotMask = Slots - 1;
+
+    for (Bucket = 0; Bucket < HEAP_LFH_BUCKETS; Bucket++)
+    {
+        /* Cache about the same amount of memory in every bucket */
+        Lfh->BucketUnits[Bucket] = RtlpLfhBucketUnits(Bucket);
+        Depth = HEAP_LFH_SLOT_CACHE_SIZE / (Lfh->BucketUnits[Bucket] << HEAP_ENTRY_SHIFT);
+        Depth = max(Depth, HEAP_LFH_MIN_DEPTH);
+        Lfh->BucketDepth[Bucket] = (USHORT)min(Depth, HEAP_LFH_MAX_DEPTH);
+
+        for (Slot = 0; Slot < Slots; Slot++)
+            RtlInitializeSListHead(&Lfh->Slots[Slot].Buckets[Bucket]);
+    }
+
+    /* Publish it, unless somebody else was faster */
+    if (InterlockedCompareExchangePointer(&Heap->FrontEndHeap, Lfh, NULL) != NULL)
+    {
+        CommitSize = 0;
+        ZwFreeVirtualMemory(NtCurrentProcess(), (PVOID *)&Lfh, &CommitSize, MEM_RELEASE);
+        return STATUS_SUCCESS;
+    }
+
+    Heap->FrontEndHeapType = HEAP_FRONT_END_LFH;
+
+    DPRINT("Heap %p got a low fragmentation front end with %lu slots\n", Heap, Slots);
+    return STATUS_SUCCESS;
+}
+
+VOID NTAPI
+RtlpDestroyLowFragmentationHeap(PHEAP Heap)
+{
+    PVOID BaseAddress = Heap->FrontEndHeap;
+    SIZE_T Size = 0;
+
+    if (!BaseAddress) return;
+
+    Heap->FrontEndHeap = NULL;
+    Heap->FrontEndHeapType = HEAP_FRONT_END_NONE;
+
+    /* The cached blocks themselves live in the heap segments */
+    ZwFreeVirtualMemory(NtCurrentProcess(), &BaseAddress, &Size, MEM_RELEASE);
+}
+
+static
+PSLIST_ENTRY
+RtlpLowFragHeapRefill(PHEAP Heap,
+                      PHEAP_LFH Lfh,
+                      PHEAP_LFH_AFFINITY_SLOT Slot,
+                      ULONG Bucket)
+{
+    PSLIST_HEADER ListHead = &Slot->Buckets[Bucket];
+    PHEAP_ENTRY HeapEntry;
+    SIZE_T BlockSize;
+    ULONG Count, i;
+    PVOID Block;
+
+    /* Carve half a cache worth of blocks under a single lock acquisition */
+    BlockSize = ((SIZE_T)Lfh->BucketUnits[Bucket] << HEAP_ENTRY_SHIFT) - sizeof(HEAP_ENTRY);
+    Count = Lfh->BucketDepth[Bucket] / 2;
+
+    RtlEnterHeapLock(Heap->LockVariable, TRUE);
+
+    _SEH2_TRY
+    {
+        for (i = 0; i < Count; i++)
+        {
+            /* We are holding the lock already, which also bypasses the front end */
+            Block = RtlAllocateHeap(Heap, HEAP_NO_SERIALIZE, BlockSize);
+            if (!Block) break;
+
+            HeapEntry = (PHEAP_ENTRY)Block - 1;
+            HeapEntry->SmallTagIndex = HEAP_LFH_CACHED_TAG;
+            RtlInterlockedPushEntrySList(ListHead, Block);
+        }
+
+        Lfh->Refills++;
+    }
+    _SEH2_FINALLY
+    {
+        RtlLeaveHeapLock(Heap->LockVariable);
+    }
+    _SEH2_END;
+
+    /* Another thread may have emptied the list again already, the caller copes with that */
+    return RtlInterlockedPopEntrySList(ListHead);
+}
+
+PVOID NTAPI
+RtlpLowFragHeapAlloc(PHEAP Heap,
+                     ULONG Flags,
+                     SIZE_T Size,
+                     SIZE_T Index)
+{
+    PHEAP_LFH Lfh = (PHEAP_LFH)Heap->FrontEndHeap;
+    PHEAP_LFH_AFFINITY_SLOT Slot;
+    PSLIST_ENTRY Block;
+    PHEAP_ENTRY HeapEntry;
+    ULONG Bucket, SlotIndex, i;
+
+    Bucket = RtlpLfhBucketIndex(Index);
+    if (Bucket >= HEAP_LFH_BUCKETS) return NULL;
+
+    /* Try our own slot first */
+    Slot = RtlpLfhCurrentSlot(Lfh);
+    Block = RtlInterlockedPopEntrySList(&Slot->Buckets[Bucket]);
+
+    /* Then the other slots, before bothering the back end */
+    SlotIndex = (ULONG)(Slot - Lfh->Slots);
+    for (i = 1; !Block && i <= Lfh->SlotMask; i++)
+    {
+        Block = RtlInterlockedPopEntrySList(&Lfh->Slots[(SlotIndex + i) & Lfh->SlotMask].Buckets[Bucket]);
+    }
+
+    if (!Block)
+    {
+        Block = RtlpLowFragHeapRefill(Heap, Lfh, Slot, Bucket);
+        if (!Block) return NULL;
+    }
+
+    /* Hand it out with the size the caller asked for */
+    HeapEntry = (PHEAP_ENTRY)Block - 1;
+    ASSERT(HeapEntry->SmallTagIndex == HEAP_LFH_CACHED_TAG);
+    HeapEntry->SmallTagIndex = 0;
+    HeapEntry->UnusedBytes = (UCHAR)((HeapEntry->Size << HEAP_ENTRY_SHIFT) - Size);
+
+    if (Flags & HEAP_ZERO_MEMORY)
+        RtlZeroMemory(HeapEntry + 1, Size);
+
+    return HeapEntry + 1;
+}
+
+BOOLEAN NTAPI
+RtlpLowFragHeapFree(PHEAP Heap,
+                    PHEAP_ENTRY HeapEntry)
+{
+    PHEAP_LFH Lfh = (PHEAP_LFH)Heap->FrontEndHeap;
+    PSLIST_HEADER ListHead;
+    SIZE_T Units;
+    ULONG Bucket;
+
+    /* Only plain blocks can be handed out again as they are */
+    if ((HeapEntry->Flags & ~HEAP_ENTRY_LAST_ENTRY) != HEAP_ENTRY_BUSY)
+        return FALSE;
+
+    /* Find the bucket, allowing for the unit the back end couldn't split off */
+    Units = HeapEntry->Size;
+    Bucket = RtlpLfhBucketIndex(Units);
+    if (Bucket >= HEAP_LFH_BUCKETS || Lfh->BucketUnits[Bucket] != Units)
+    {
+        Units--;
+        Bucket = RtlpLfhBucketIndex(Units);
+        if (Bucket >= HEAP_LFH_BUCKETS || Lfh->BucketUnits[Bucket] != Units)
+            return FALSE;
+    }
+
+    /* Keep the cache bounded, the back end takes the rest */
+    ListHead = &RtlpLfhCurrentSlot(Lfh)->Buckets[Bucket];
+    if (RtlQueryDepthSList(ListHead) >= Lfh->BucketDepth[Bucket])
+        return FALSE;
+
+    HeapEntry->SmallTagIndex = HEAP_LFH_CACHED_TAG;
+    RtlInterlockedPushEntrySList(ListHead, (PSLIST_ENTRY)(HeapEntry + 1));
+    return TRUE;
+}
+
+/* EOF */
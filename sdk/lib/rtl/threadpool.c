@@ -0,0 +1,1969 @@
+/*
+ * COPYRIGHT:       See COPYING in the top level directory
+ * PROJECT:         ReactOS system libraries
+ * FILE:            lib/rtl/threadpool.c
+ * PURPOSE:         Vista style thread pool (Tp* routines)
+ */
+
+/* Every pool owns an I/O completion port. Its worker threads block on the
+   port and receive either I/O completions, keyed by the I/O object, or a
+   plain packet telling them to pick the next callback from the pool's
+   priority queues. The port's concurrency value keeps the number of running
+   workers close to the number of processors, new workers are only added
+   while the busy ones don't already saturate them, and a gate check in the
+   service thread adds one more whenever callbacks are queued but none has
+   completed for a while. Idle workers above the minimum go away again.
+
+   A single service thread handles all timers, wait objects are spread over
+   wait threads holding up to MAXIMUM_WAIT_OBJECTS - 1 handles each. */
+
+/* INCLUDES *****************************************************************/
+
+#include <rtl_vista.h>
+
+#define NDEBUG
+#include <debug.h>
+
+/* TYPES *********************************************************************/
+
+#define TPP_OBJECT_WORK             0
+#define TPP_OBJECT_SIMPLE           1
+#define TPP_OBJECT_TIMER            2
+#define TPP_OBJECT_WAIT             3
+#define TPP_OBJECT_IO               4
+
+/* Completion keys other than the I/O objects themselves */
+#define TPP_KEY_CALLBACK            NULL
+#define TPP_KEY_QUIT                ((PVOID)1)
+
+#define TPP_DEFAULT_MAX_THREADS     500
+#define TPP_WAITS_PER_BUCKET        (MAXIMUM_WAIT_OBJECTS - 1)
+#define TPP_NO_ACTIVATION_CONTEXT   ((PVOID)(LONG_PTR)-1)
+
+/* In 100ns units */
+#define TPP_IDLE_TIMEOUT            (20 * 10000000LL)
+#define TPP_GATE_INTERVAL           (1 * 10000000LL)
+
+/* The Windows 7 callback environment. We are built for Vista, which only has the first version */
+typedef struct _TPP_CALLBACK_ENVIRON_V3
+{
+    TP_VERSION Version;
+    PTP_POOL Pool;
+    PTP_CLEANUP_GROUP CleanupGroup;
+    PTP_CLEANUP_GROUP_CANCEL_CALLBACK CleanupGroupCancelCallback;
+    PVOID RaceDll;
+    struct _ACTIVATION_CONTEXT *ActivationContext;
+    PTP_SIMPLE_CALLBACK FinalizationCallback;
+    union
+    {
+        DWORD Flags;
+        struct
+        {
+            DWORD LongFunction:1;
+            DWORD Persistent:1;
+            DWORD Private:30;
+        } s;
+    } u;
+    TP_CALLBACK_PRIORITY CallbackPriority;
+    DWORD Size;
+} TPP_CALLBACK_ENVIRON_V3, *PTPP_CALLBACK_ENVIRON_V3;
+
+typedef struct _TPP_WAIT_BUCKET
+{
+    LIST_ENTRY BucketEntry;
+    LIST_ENTRY Waits;
+    ULONG Count;
+    HANDLE UpdateEvent;
+} TPP_WAIT_BUCKET, *PTPP_WAIT_BUCKET;
+
+struct _TP_POOL
+{
+    LONG RefCount;
+    BOOLEAN Released;
+    RTL_CRITICAL_SECTION Lock;
+    HANDLE CompletionPort;
+    LIST_ENTRY PoolEntry;
+    LIST_ENTRY Queues[TP_CALLBACK_PRIORITY_COUNT];
+    LONG QueuedCallbacks;
+    LONG OutstandingIo;
+    LONG ObjectCount;
+    LONG MinThreads;
+    LONG MaxThreads;
+    LONG TotalThreads;
+    LONG LongThreads;
+    volatile LONG IdleThreads;
+    ULONG Completed;
+    ULONG GateCompleted;
+};
+
+typedef struct _TPP_OBJECT
+{
+    /* Must stay first, kernel32 keeps its Win32 I/O callback here */
+    PVOID Win32Callback;
+
+    LONG RefCount;
+    LONG Released;
+    ULONG Type;
+    PTP_POOL Pool;
+    PVOID Callback;
+    PVOID Context;
+
+    /* Captured from the callback environment */
+    PTP_CLEANUP_GROUP Group;
+    LIST_ENTRY GroupEntry;
+    PTP_CLEANUP_GROUP_CANCEL_CALLBACK GroupCancelCallback;
+    PTP_SIMPLE_CALLBACK FinalizationCallback;
+    PVOID RaceDll;
+    PVOID ActivationContext;
+    BOOLEAN LongFunction;
+    TP_CALLBACK_PRIORITY Priority;
+
+    /* Protected by the pool lock */
+    LIST_ENTRY QueueEntry;
+    LONG Pending;
+    LONG Running;
+    LONG Signaled;
+    RTL_CONDITION_VARIABLE Finished;
+
+    union
+    {
+        /* Protected by the timer lock */
+        struct
+        {
+            LIST_ENTRY TimerEntry;
+            LONGLONG DueTime;
+            LONG Period;
+            BOOLEAN Set;
+        } Timer;
+
+        /* Protected by the wait lock */
+        struct
+        {
+            LIST_ENTRY WaitEntry;
+            PTPP_WAIT_BUCKET Bucket;
+            HANDLE Handle;
+            LONGLONG Timeout;
+            ULONG Generation;
+        } Wait;
+
+        /* Protected by the pool lock */
+        struct
+        {
+            HANDLE File;
+            LONG Outstanding;
+            LONG Skipped;
+        } Io;
+    } u;
+} TPP_OBJECT, *PTPP_OBJECT;
+
+struct _TP_CLEANUP_GROUP
+{
+    LONG RefCount;
+    RTL_CRITICAL_SECTION Lock;
+    LIST_ENTRY Members;
+};
+
+struct _TP_CALLBACK_INSTANCE
+{
+    PTPP_OBJECT Object;
+    BOOLEAN Associated;
+    BOOLEAN MayRunLong;
+
+    /* Things to do once the callback has returned */
+    PRTL_CRITICAL_SECTION CriticalSection;
+    HANDLE Mutex;
+    HANDLE Semaphore;
+    LONG SemaphoreCount;
+    HANDLE Event;
+    PVOID Dll;
+};
+
+/* GLOBALS *******************************************************************/
+
+static RTL_RUN_ONCE TppServiceOnce = RTL_RUN_ONCE_INIT;
+static PTP_POOL TppDefaultPool;
+
+static RTL_CRITICAL_SECTION TppPoolListLock;
+static LIST_ENTRY TppPoolList;
+
+static RTL_CRITICAL_SECTION TppTimerLock;
+static LIST_ENTRY TppTimerList;
+static HANDLE TppTimerEvent;
+
+static RTL_CRITICAL_SECTION TppWaitLock;
+static LIST_ENTRY TppWaitBuckets;
+
+/* PRIVATE FUNCTIONS *********************************************************/
+
+static ULONG NTAPI TppWorkerThread(PVOID Parameter);
+
+static
+NTSTATUS
+TppCreateThread(
+    _In_ PTHREAD_START_ROUTINE StartAddress,
+    _In_ PVOID Parameter)
+{
+    HANDLE ThreadHandle;
+    NTSTATUS Status;
+
+    Status = RtlCreateUserThread(NtCurrentProcess(),
+                                 NULL,
+                                 FALSE,
+                                 0,
+                                 0,
+                                 0,
+                                 StartAddress,
+                                 Parameter,
+                                 &ThreadHandle,
+                                 NULL);
+    if (NT_SUCCESS(Status))
+        NtClose(ThreadHandle);
+
+    return Status;
+}
+
+static
+VOID
+TppReleasePool(
+    _In_ PTP_POOL Pool)
+{
+    if (InterlockedDecrement(&Pool->RefCount))
+        return;
+
+    ASSERT(!Pool->TotalThreads && !Pool->ObjectCount);
+
+    RtlEnterCriticalSection(&TppPoolListLock);
+    RemoveEntryList(&Pool->PoolEntry);
+    RtlLeaveCriticalSection(&TppPoolListLock);
+
+    NtClose(Pool->CompletionPort);
+    RtlDeleteCriticalSection(&Pool->Lock);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Pool);
+}
+
+/* Must be called with the pool lock held */
+static
+BOOLEAN
+TppStartWorker(
+    _In_ PTP_POOL Pool)
+{
+    NTSTATUS Status;
+
+    /* The new thread holds a reference on the pool */
+    Pool->TotalThreads++;
+    InterlockedIncrement(&Pool->RefCount);
+
+    Status = TppCreateThread(TppWorkerThread, Pool);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Failed to start a worker for pool %p: 0x%lx\n", Pool, Status);
+        Pool->TotalThreads--;
+        InterlockedDecrement(&Pool->RefCount);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* Must be called with the pool lock held */
+static
+VOID
+TppCheckWorkers(
+    _In_ PTP_POOL Pool)
+{
+    LONG Demand;
+
+    while (Pool->TotalThreads < Pool->MinThreads)
+    {
+        if (!TppStartWorker(Pool))
+            return;
+    }
+
+    /* Somebody has to be around to pick up I/O completions */
+    Demand = Pool->QueuedCallbacks + (Pool->OutstandingIo ? 1 : 0);
+
+    /* Don't add threads if the busy ones already keep every processor busy,
+       long running callbacks don't count. The gate check helps out when the
+       busy ones are actually blocked */
+    if (Demand > Pool->IdleThreads &&
+        Pool->TotalThreads < Pool->MaxThreads &&
+        Pool->TotalThreads - Pool->LongThreads < (LONG)NtCurrentPeb()->NumberOfProcessors)
+    {
+        TppStartWorker(Pool);
+    }
+}
+
+/* Must be called with the pool lock held */
+static
+VOID
+TppStopWorkers(
+    _In_ PTP_POOL Pool)
+{
+    LONG i;
+
+    for (i = 0; i < Pool->TotalThreads; i++)
+        NtSetIoCompletion(Pool->CompletionPort, TPP_KEY_QUIT, NULL, STATUS_SUCCESS, 0);
+}
+
+static
+VOID
+TppReleaseCleanupGroup(
+    _In_ PTP_CLEANUP_GROUP Group)
+{
+    if (InterlockedDecrement(&Group->RefCount))
+        return;
+
+    ASSERT(IsListEmpty(&Group->Members));
+
+    RtlDeleteCriticalSection(&Group->Lock);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Group);
+}
+
+static
+BOOLEAN
+TppReferenceObjectIfAlive(
+    _In_ PTPP_OBJECT Object)
+{
+    LONG RefCount, OldRefCount;
+
+    RefCount = Object->RefCount;
+    while (RefCount)
+    {
+        OldRefCount = InterlockedCompareExchange(&Object->RefCount, RefCount + 1, RefCount);
+        if (OldRefCount == RefCount)
+            return TRUE;
+
+        RefCount = OldRefCount;
+    }
+
+    /* It's being freed already */
+    return FALSE;
+}
+
+static
+VOID
+TppReleaseObject(
+    _In_ PTPP_OBJECT Object)
+{
+    PTP_CLEANUP_GROUP Group = Object->Group;
+    PTP_POOL Pool = Object->Pool;
+
+    if (InterlockedDecrement(&Object->RefCount))
+        return;
+
+    ASSERT(!Object->Pending && !Object->Running);
+
+    if (Group)
+    {
+        RtlEnterCriticalSection(&Group->Lock);
+        RemoveEntryList(&Object->GroupEntry);
+        RtlLeaveCriticalSection(&Group->Lock);
+
+        TppReleaseCleanupGroup(Group);
+    }
+
+    if (Object->ActivationContext)
+        RtlReleaseActivationContext(Object->ActivationContext);
+
+    if (Object->RaceDll)
+        LdrUnloadDll(Object->RaceDll);
+
+    /* A released pool goes away with its last object */
+    RtlEnterCriticalSection(&Pool->Lock);
+    if (!--Pool->ObjectCount && Pool->Released)
+        TppStopWorkers(Pool);
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    TppReleasePool(Pool);
+
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Object);
+}
+
+static
+ULONG
+NTAPI
+TppInitializeService(
+    _Inout_ PRTL_RUN_ONCE RunOnce,
+    _Inout_opt_ PVOID Parameter,
+    _Inout_opt_ PVOID *Context);
+
+static
+NTSTATUS
+TppAllocPool(
+    _Out_ PTP_POOL *PoolReturn)
+{
+    PTP_POOL Pool;
+    NTSTATUS Status;
+    ULONG i;
+
+    /* Timers and the gate check need the service thread */
+    Status = RtlRunOnceExecuteOnce(&TppServiceOnce, TppInitializeService, NULL, NULL);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    Pool = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*Pool));
+    if (!Pool)
+        return STATUS_NO_MEMORY;
+
+    /* Concurrency 0 means one running worker per processor */
+    Status = NtCreateIoCompletion(&Pool->CompletionPort, IO_COMPLETION_ALL_ACCESS, NULL, 0);
+    if (!NT_SUCCESS(Status))
+    {
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Pool);
+        return Status;
+    }
+
+    Status = RtlInitializeCriticalSection(&Pool->Lock);
+    if (!NT_SUCCESS(Status))
+    {
+        NtClose(Pool->CompletionPort);
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Pool);
+        return Status;
+    }
+
+    Pool->RefCount = 1;
+    Pool->MaxThreads = TPP_DEFAULT_MAX_THREADS;
+    for (i = 0; i < TP_CALLBACK_PRIORITY_COUNT; i++)
+        InitializeListHead(&Pool->Queues[i]);
+
+    RtlEnterCriticalSection(&TppPoolListLock);
+    InsertTailList(&TppPoolList, &Pool->PoolEntry);
+    RtlLeaveCriticalSection(&TppPoolListLock);
+
+    *PoolReturn = Pool;
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+TppGetDefaultPool(
+    _Out_ PTP_POOL *PoolReturn)
+{
+    PTP_POOL Pool = TppDefaultPool;
+    NTSTATUS Status;
+
+    if (!Pool)
+    {
+        Status = TppAllocPool(&Pool);
+        if (!NT_SUCCESS(Status))
+            return Status;
+
+        /* Somebody else may have been faster. The default pool is never released */
+        if (InterlockedCompareExchangePointer((PVOID *)&TppDefaultPool, Pool, NULL) != NULL)
+        {
+            TpReleasePool(Pool);
+            Pool = TppDefaultPool;
+        }
+    }
+
+    *PoolReturn = Pool;
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+TppAllocObject(
+    _In_ ULONG Type,
+    _In_ PVOID Callback,
+    _In_opt_ PVOID Context,
+    _In_opt_ PTP_CALLBACK_ENVIRON CallbackEnviron,
+    _Out_ PTPP_OBJECT *ObjectReturn)
+{
+    PTPP_CALLBACK_ENVIRON_V3 Environ = (PTPP_CALLBACK_ENVIRON_V3)CallbackEnviron;
+    TP_CALLBACK_PRIORITY Priority = TP_CALLBACK_PRIORITY_NORMAL;
+    PTP_POOL Pool = NULL;
+    PTPP_OBJECT Object;
+    NTSTATUS Status;
+
+    if (!Callback)
+        return STATUS_INVALID_PARAMETER;
+
+    if (Environ)
+    {
+        if (Environ->Version < 1 || Environ->Version > 3)
+            return STATUS_INVALID_PARAMETER;
+
+        /* Only the Windows 7 environment has a priority */
+        if (Environ->Version >= 3)
+        {
+            if ((ULONG)Environ->CallbackPriority >= TP_CALLBACK_PRIORITY_COUNT)
+                return STATUS_INVALID_PARAMETER;
+
+            Priority = Environ->CallbackPriority;
+        }
+
+        Pool = Environ->Pool;
+    }
+
+    if (!Pool)
+    {
+        Status = TppGetDefaultPool(&Pool);
+        if (!NT_SUCCESS(Status))
+            return Status;
+    }
+
+    Object = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*Object));
+    if (!Object)
+        return STATUS_NO_MEMORY;
+
+    Object->RefCount = 1;
+    Object->Type = Type;
+    Object->Pool = Pool;
+    Object->Callback = Callback;
+    Object->Context = Context;
+    Object->Priority = Priority;
+    InitializeListHead(&Object->GroupEntry);
+    RtlInitializeConditionVariable(&Object->Finished);
+
+    if (Environ)
+    {
+        /* Keep the DLL with the callback code loaded as long as we exist */
+        if (Environ->RaceDll)
+        {
+            Status = LdrAddRefDll(0, Environ->RaceDll);
+            if (!NT_SUCCESS(Status))
+            {
+                RtlFreeHeap(RtlGetProcessHeap(), 0, Object);
+                return Status;
+            }
+
+            Object->RaceDll = Environ->RaceDll;
+        }
+
+        if (Environ->ActivationContext &&
+            Environ->ActivationContext != TPP_NO_ACTIVATION_CONTEXT)
+        {
+            RtlAddRefActivationContext(Environ->ActivationContext);
+            Object->ActivationContext = Environ->ActivationContext;
+        }
+
+        Object->Group = Environ->CleanupGroup;
+        Object->GroupCancelCallback = Environ->CleanupGroupCancelCallback;
+        Object->FinalizationCallback = Environ->FinalizationCallback;
+        Object->LongFunction = (BOOLEAN)Environ->u.s.LongFunction;
+    }
+
+    InterlockedIncrement(&Pool->RefCount);
+    RtlEnterCriticalSection(&Pool->Lock);
+    Pool->ObjectCount++;
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    if (Object->Group)
+    {
+        InterlockedIncrement(&Object->Group->RefCount);
+        RtlEnterCriticalSection(&Object->Group->Lock);
+        InsertTailList(&Object->Group->Members, &Object->GroupEntry);
+        RtlLeaveCriticalSection(&Object->Group->Lock);
+    }
+
+    *ObjectReturn = Object;
+    return STATUS_SUCCESS;
+}
+
+static
+VOID
+TppSubmitCallback(
+    _In_ PTPP_OBJECT Object,
+    _In_ BOOLEAN Signaled)
+{
+    PTP_POOL Pool = Object->Pool;
+
+    RtlEnterCriticalSection(&Pool->Lock);
+
+    /* The queue holds a single reference, however many callbacks are pending */
+    if (!Object->Pending++)
+    {
+        InterlockedIncrement(&Object->RefCount);
+        InsertTailList(&Pool->Queues[Object->Priority], &Object->QueueEntry);
+    }
+
+    if (Signaled)
+        Object->Signaled++;
+
+    Pool->QueuedCallbacks++;
+    TppCheckWorkers(Pool);
+
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    /* Wake up a worker */
+    NtSetIoCompletion(Pool->CompletionPort, TPP_KEY_CALLBACK, NULL, STATUS_SUCCESS, 0);
+}
+
+/* Must be called with the pool lock held, and a reference on the object */
+static
+LONG
+TppCancelPending(
+    _In_ PTPP_OBJECT Object)
+{
+    LONG Cancelled = Object->Pending;
+
+    if (Cancelled)
+    {
+        RemoveEntryList(&Object->QueueEntry);
+        Object->Pool->QueuedCallbacks -= Cancelled;
+        Object->Pending = 0;
+        Object->Signaled = 0;
+
+        /* This is never the last reference, the caller has one */
+        InterlockedDecrement(&Object->RefCount);
+    }
+
+    /* Completions for I/O that has already been started are dropped when they arrive */
+    if (Object->Type == TPP_OBJECT_IO)
+    {
+        Object->u.Io.Skipped += Object->u.Io.Outstanding;
+        Object->u.Io.Outstanding = 0;
+    }
+
+    return Cancelled;
+}
+
+static
+LONG
+TppWaitForObject(
+    _In_ PTPP_OBJECT Object,
+    _In_ BOOLEAN CancelPending)
+{
+    PTP_POOL Pool = Object->Pool;
+    LONG Cancelled = 0;
+
+    RtlEnterCriticalSection(&Pool->Lock);
+
+    if (CancelPending)
+        Cancelled = TppCancelPending(Object);
+
+    while (Object->Pending ||
+           Object->Running ||
+           (Object->Type == TPP_OBJECT_IO && Object->u.Io.Outstanding))
+    {
+        RtlSleepConditionVariableCS(&Object->Finished, &Pool->Lock, NULL);
+    }
+
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    return Cancelled;
+}
+
+/* Must be called with the wait lock held */
+static
+VOID
+TppRemoveWait(
+    _In_ PTPP_OBJECT Wait)
+{
+    PTPP_WAIT_BUCKET Bucket = Wait->u.Wait.Bucket;
+
+    if (!Bucket)
+        return;
+
+    RemoveEntryList(&Wait->u.Wait.WaitEntry);
+    Wait->u.Wait.Bucket = NULL;
+    Bucket->Count--;
+
+    /* Make the wait thread let go of the handle */
+    NtSetEvent(Bucket->UpdateEvent, NULL);
+}
+
+static
+BOOLEAN
+TppShutdownObject(
+    _In_ PTPP_OBJECT Object)
+{
+    /* Only the first one to get here owns the creator's reference */
+    if (InterlockedExchange(&Object->Released, TRUE))
+        return FALSE;
+
+    /* Timers and waits mustn't queue any more callbacks */
+    if (Object->Type == TPP_OBJECT_TIMER)
+    {
+        RtlEnterCriticalSection(&TppTimerLock);
+        if (Object->u.Timer.Set)
+        {
+            RemoveEntryList(&Object->u.Timer.TimerEntry);
+            Object->u.Timer.Set = FALSE;
+        }
+        RtlLeaveCriticalSection(&TppTimerLock);
+    }
+    else if (Object->Type == TPP_OBJECT_WAIT)
+    {
+        RtlEnterCriticalSection(&TppWaitLock);
+        TppRemoveWait(Object);
+        RtlLeaveCriticalSection(&TppWaitLock);
+    }
+
+    return TRUE;
+}
+
+static
+VOID
+TppReleaseOwnerReference(
+    _In_ PTPP_OBJECT Object)
+{
+    if (!TppShutdownObject(Object))
+    {
+        DPRINT1("Object %p released twice\n", Object);
+        return;
+    }
+
+    TppReleaseObject(Object);
+}
+
+static
+VOID
+TppExecuteCallback(
+    _In_ PTPP_OBJECT Object,
+    _In_ TP_WAIT_RESULT WaitResult,
+    _In_opt_ PVOID ApcContext,
+    _In_opt_ PIO_STATUS_BLOCK IoStatusBlock)
+{
+    PTP_POOL Pool = Object->Pool;
+    TP_CALLBACK_INSTANCE Instance;
+    ULONG_PTR Cookie = 0;
+
+    RtlZeroMemory(&Instance, sizeof(Instance));
+    Instance.Object = Object;
+    Instance.Associated = TRUE;
+
+    if (Object->LongFunction)
+        TpCallbackMayRunLong(&Instance);
+
+    if (Object->ActivationContext)
+        RtlActivateActivationContextEx(0, NtCurrentTeb(), Object->ActivationContext, &Cookie);
+
+    switch (Object->Type)
+    {
+        case TPP_OBJECT_WORK:
+            ((PTP_WORK_CALLBACK)Object->Callback)(&Instance, Object->Context, (PTP_WORK)Object);
+            break;
+
+        case TPP_OBJECT_SIMPLE:
+            ((PTP_SIMPLE_CALLBACK)Object->Callback)(&Instance, Object->Context);
+            break;
+
+        case TPP_OBJECT_TIMER:
+            ((PTP_TIMER_CALLBACK)Object->Callback)(&Instance, Object->Context, (PTP_TIMER)Object);
+            break;
+
+        case TPP_OBJECT_WAIT:
+            ((PTP_WAIT_CALLBACK)Object->Callback)(&Instance, Object->Context, (PTP_WAIT)Object, WaitResult);
+            break;
+
+        case TPP_OBJECT_IO:
+            ((PTP_IO_CALLBACK)Object->Callback)(&Instance, Object->Context, ApcContext, IoStatusBlock, (PTP_IO)Object);
+            break;
+    }
+
+    if (Object->FinalizationCallback)
+        Object->FinalizationCallback(&Instance, Object->Context);
+
+    if (Cookie)
+        RtlDeactivateActivationContext(0, Cookie);
+
+    /* Do what the callback asked for */
+    if (Instance.CriticalSection)
+        RtlLeaveCriticalSection(Instance.CriticalSection);
+    if (Instance.Mutex)
+        NtReleaseMutant(Instance.Mutex, NULL);
+    if (Instance.Semaphore)
+        NtReleaseSemaphore(Instance.Semaphore, Instance.SemaphoreCount, NULL);
+    if (Instance.Event)
+        NtSetEvent(Instance.Event, NULL);
+    if (Instance.Dll)
+        LdrUnloadDll(Instance.Dll);
+
+    RtlEnterCriticalSection(&Pool->Lock);
+    if (Instance.MayRunLong)
+        Pool->LongThreads--;
+    if (Instance.Associated)
+    {
+        Object->Running--;
+        RtlWakeAllConditionVariable(&Object->Finished);
+    }
+    Pool->Completed++;
+    RtlLeaveCriticalSection(&Pool->Lock);
+}
+
+static
+VOID
+TppRunQueuedCallback(
+    _In_ PTP_POOL Pool)
+{
+    PTPP_OBJECT Object = NULL;
+    BOOLEAN Signaled = FALSE;
+    ULONG i;
+
+    RtlEnterCriticalSection(&Pool->Lock);
+
+    for (i = 0; i < TP_CALLBACK_PRIORITY_COUNT; i++)
+    {
+        if (IsListEmpty(&Pool->Queues[i]))
+            continue;
+
+        Object = CONTAINING_RECORD(Pool->Queues[i].Flink, TPP_OBJECT, QueueEntry);
+        RemoveEntryList(&Object->QueueEntry);
+        Pool->QueuedCallbacks--;
+
+        /* The queue's reference passes on to us, unless there is more to come */
+        if (--Object->Pending)
+        {
+            InsertTailList(&Pool->Queues[i], &Object->QueueEntry);
+            InterlockedIncrement(&Object->RefCount);
+        }
+
+        if (Object->Type == TPP_OBJECT_WAIT && Object->Signaled)
+        {
+            Object->Signaled--;
+            Signaled = TRUE;
+        }
+
+        Object->Running++;
+        break;
+    }
+
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    /* Cancelled after the packet was sent */
+    if (!Object)
+        return;
+
+    TppExecuteCallback(Object, Signaled ? STATUS_WAIT_0 : STATUS_TIMEOUT, NULL, NULL);
+    TppReleaseObject(Object);
+}
+
+static
+VOID
+TppRunIoCallback(
+    _In_ PTP_POOL Pool,
+    _In_ PTPP_OBJECT Io,
+    _In_opt_ PVOID ApcContext,
+    _In_ PIO_STATUS_BLOCK IoStatusBlock)
+{
+    BOOLEAN Run;
+
+    RtlEnterCriticalSection(&Pool->Lock);
+
+    if (Io->u.Io.Outstanding)
+    {
+        Io->u.Io.Outstanding--;
+        Io->Running++;
+        Run = TRUE;
+    }
+    else if (Io->u.Io.Skipped)
+    {
+        Io->u.Io.Skipped--;
+        Run = FALSE;
+    }
+    else
+    {
+        RtlLeaveCriticalSection(&Pool->Lock);
+        DPRINT1("Completion for I/O object %p without TpStartAsyncIoOperation\n", Io);
+        return;
+    }
+
+    Pool->OutstandingIo--;
+
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    if (Run)
+        TppExecuteCallback(Io, 0, ApcContext, IoStatusBlock);
+
+    /* The reference TpStartAsyncIoOperation took */
+    TppReleaseObject(Io);
+}
+
+static
+ULONG
+NTAPI
+TppWorkerThread(
+    _In_ PVOID Parameter)
+{
+    PTP_POOL Pool = Parameter;
+    IO_STATUS_BLOCK IoStatusBlock;
+    LARGE_INTEGER Timeout;
+    PVOID Key, ApcContext;
+    NTSTATUS Status;
+    BOOLEAN Retire;
+
+    for (;;)
+    {
+        Timeout.QuadPart = -TPP_IDLE_TIMEOUT;
+
+        InterlockedIncrement(&Pool->IdleThreads);
+        Status = NtRemoveIoCompletion(Pool->CompletionPort,
+                                      &Key,
+                                      &ApcContext,
+                                      &IoStatusBlock,
+                                      &Timeout);
+        InterlockedDecrement(&Pool->IdleThreads);
+
+        if (Status == STATUS_SUCCESS)
+        {
+            if (Key == TPP_KEY_QUIT)
+            {
+                RtlEnterCriticalSection(&Pool->Lock);
+                Pool->TotalThreads--;
+                RtlLeaveCriticalSection(&Pool->Lock);
+                break;
+            }
+
+            if (Key == TPP_KEY_CALLBACK)
+                TppRunQueuedCallback(Pool);
+            else
+                TppRunIoCallback(Pool, Key, ApcContext, &IoStatusBlock);
+
+            continue;
+        }
+
+        if (Status != STATUS_TIMEOUT)
+            DPRINT1("NtRemoveIoCompletion failed for pool %p: 0x%lx\n", Pool, Status);
+
+        /* Been idle for a while, leave if the pool can spare us */
+        RtlEnterCriticalSection(&Pool->Lock);
+        Retire = Pool->TotalThreads > Pool->MinThreads &&
+                 !Pool->QueuedCallbacks &&
+                 (!Pool->OutstandingIo || Pool->TotalThreads > 1);
+        if (Retire)
+            Pool->TotalThreads--;
+        RtlLeaveCriticalSection(&Pool->Lock);
+
+        if (Retire)
+            break;
+    }
+
+    TppReleasePool(Pool);
+    RtlExitUserThread(STATUS_SUCCESS);
+    return 0;
+}
+
+/* Must be called with the timer lock held */
+static
+VOID
+TppInsertTimer(
+    _In_ PTPP_OBJECT Timer)
+{
+    PLIST_ENTRY Entry;
+
+    /* The list is sorted by due time */
+    for (Entry = TppTimerList.Flink; Entry != &TppTimerList; Entry = Entry->Flink)
+    {
+        if (CONTAINING_RECORD(Entry, TPP_OBJECT, u.Timer.TimerEntry)->u.Timer.DueTime > Timer->u.Timer.DueTime)
+            break;
+    }
+
+    InsertTailList(Entry, &Timer->u.Timer.TimerEntry);
+    Timer->u.Timer.Set = TRUE;
+}
+
+static
+VOID
+TppCheckStarvedPools(VOID)
+{
+    PLIST_ENTRY Entry;
+    PTP_POOL Pool;
+
+    RtlEnterCriticalSection(&TppPoolListLock);
+
+    for (Entry = TppPoolList.Flink; Entry != &TppPoolList; Entry = Entry->Flink)
+    {
+        Pool = CONTAINING_RECORD(Entry, TP_POOL, PoolEntry);
+
+        RtlEnterCriticalSection(&Pool->Lock);
+
+        /* Callbacks are waiting, but nothing completed since we last looked:
+           the busy workers are blocked, so add one beyond the processor count */
+        if (Pool->QueuedCallbacks &&
+            !Pool->IdleThreads &&
+            Pool->Completed == Pool->GateCompleted &&
+            Pool->TotalThreads < Pool->MaxThreads)
+        {
+            DPRINT("Pool %p is starving, adding a worker to %ld\n", Pool, Pool->TotalThreads);
+            TppStartWorker(Pool);
+        }
+
+        Pool->GateCompleted = Pool->Completed;
+
+        RtlLeaveCriticalSection(&Pool->Lock);
+    }
+
+    RtlLeaveCriticalSection(&TppPoolListLock);
+}
+
+static
+ULONG
+NTAPI
+TppServiceThread(
+    _In_ PVOID Parameter)
+{
+    LARGE_INTEGER Now, Timeout;
+    LONGLONG NextGate = 0, WakeTime;
+    PTPP_OBJECT Timer;
+    BOOLEAN CheckGate;
+
+    UNREFERENCED_PARAMETER(Parameter);
+
+    for (;;)
+    {
+        NtQuerySystemTime(&Now);
+
+        RtlEnterCriticalSection(&TppTimerLock);
+
+        while (!IsListEmpty(&TppTimerList))
+        {
+            Timer = CONTAINING_RECORD(TppTimerList.Flink, TPP_OBJECT, u.Timer.TimerEntry);
+            if (Timer->u.Timer.DueTime > Now.QuadPart)
+                break;
+
+            RemoveEntryList(&Timer->u.Timer.TimerEntry);
+            Timer->u.Timer.Set = FALSE;
+
+            /* Periodic timers go back in line, without catching up on missed periods */
+            if (Timer->u.Timer.Period)
+            {
+                Timer->u.Timer.DueTime += Timer->u.Timer.Period * 10000LL;
+                if (Timer->u.Timer.DueTime <= Now.QuadPart)
+                    Timer->u.Timer.DueTime = Now.QuadPart + Timer->u.Timer.Period * 10000LL;
+
+                TppInsertTimer(Timer);
+            }
+
+            TppSubmitCallback(Timer, FALSE);
+        }
+
+        CheckGate = (Now.QuadPart >= NextGate);
+        if (CheckGate)
+            NextGate = Now.QuadPart + TPP_GATE_INTERVAL;
+
+        /* Sleep until the next timer or gate check is due */
+        WakeTime = NextGate;
+        if (!IsListEmpty(&TppTimerList))
+        {
+            Timer = CONTAINING_RECORD(TppTimerList.Flink, TPP_OBJECT, u.Timer.TimerEntry);
+            WakeTime = min(WakeTime, Timer->u.Timer.DueTime);
+        }
+
+        RtlLeaveCriticalSection(&TppTimerLock);
+
+        if (CheckGate)
+            TppCheckStarvedPools();
+
+        Timeout.QuadPart = min(Now.QuadPart - WakeTime, 0);
+        NtWaitForSingleObject(TppTimerEvent, FALSE, &Timeout);
+    }
+
+    return 0;
+}
+
+/* Must be called with the wait lock held */
+static
+VOID
+TppFireWait(
+    _In_ PTPP_WAIT_BUCKET Bucket,
+    _In_ PTPP_OBJECT Wait,
+    _In_ ULONG Generation,
+    _In_ BOOLEAN Signaled)
+{
+    /* Ignore it if the wait has been cancelled or set again meanwhile */
+    if (Wait->u.Wait.Bucket != Bucket || Wait->u.Wait.Generation != Generation)
+        return;
+
+    /* Waits are one shot */
+    RemoveEntryList(&Wait->u.Wait.WaitEntry);
+    Wait->u.Wait.Bucket = NULL;
+    Bucket->Count--;
+
+    TppSubmitCallback(Wait, Signaled);
+}
+
+static
+ULONG
+NTAPI
+TppWaitThread(
+    _In_ PVOID Parameter)
+{
+    PTPP_WAIT_BUCKET Bucket = Parameter;
+    PTPP_OBJECT Waits[TPP_WAITS_PER_BUCKET];
+    ULONG Generations[TPP_WAITS_PER_BUCKET];
+    HANDLE Handles[TPP_WAITS_PER_BUCKET + 1];
+    LARGE_INTEGER Now, Timeout;
+    LONGLONG NextTimeout;
+    PLIST_ENTRY Entry;
+    PTPP_OBJECT Wait;
+    NTSTATUS Status;
+    ULONG Count, i;
+
+    for (;;)
+    {
+        /* Waits can come and go while we sleep, so keep them alive until we are back */
+        RtlEnterCriticalSection(&TppWaitLock);
+
+        Count = 0;
+        NextTimeout = MAXLONGLONG;
+        for (Entry = Bucket->Waits.Flink; Entry != &Bucket->Waits; Entry = Entry->Flink)
+        {
+            Wait = CONTAINING_RECORD(Entry, TPP_OBJECT, u.Wait.WaitEntry);
+            InterlockedIncrement(&Wait->RefCount);
+
+            Waits[Count] = Wait;
+            Generations[Count] = Wait->u.Wait.Generation;
+            Handles[Count] = Wait->u.Wait.Handle;
+            NextTimeout = min(NextTimeout, Wait->u.Wait.Timeout);
+            Count++;
+        }
+        Handles[Count] = Bucket->UpdateEvent;
+
+        RtlLeaveCriticalSection(&TppWaitLock);
+
+        NtQuerySystemTime(&Now);
+        if (!Count)
+            Timeout.QuadPart = -TPP_IDLE_TIMEOUT;
+        else if (NextTimeout != MAXLONGLONG)
+            Timeout.QuadPart = min(Now.QuadPart - NextTimeout, 0);
+
+        Status = NtWaitForMultipleObjects(Count + 1,
+                                          Handles,
+                                          WaitAny,
+                                          FALSE,
+                                          (Count && NextTimeout == MAXLONGLONG) ? NULL : &Timeout);
+
+        RtlEnterCriticalSection(&TppWaitLock);
+
+        if (!Count && Status == STATUS_TIMEOUT && !Bucket->Count)
+        {
+            /* Nothing to do for a while, we are not needed anymore */
+            RemoveEntryList(&Bucket->BucketEntry);
+            RtlLeaveCriticalSection(&TppWaitLock);
+            break;
+        }
+
+        if ((ULONG)Status < Count)
+        {
+            TppFireWait(Bucket, Waits[Status], Generations[Status], TRUE);
+        }
+        else if (Status >= STATUS_ABANDONED_WAIT_0 && Status < STATUS_ABANDONED_WAIT_0 + (LONG)Count)
+        {
+            /* An abandoned mutex is signaled all the same */
+            i = Status - STATUS_ABANDONED_WAIT_0;
+            TppFireWait(Bucket, Waits[i], Generations[i], TRUE);
+        }
+        else if (Status == STATUS_TIMEOUT)
+        {
+            NtQuerySystemTime(&Now);
+            for (i = 0; i < Count; i++)
+            {
+                if (Waits[i]->u.Wait.Timeout <= Now.QuadPart)
+                    TppFireWait(Bucket, Waits[i], Generations[i], FALSE);
+            }
+        }
+        else if (!NT_SUCCESS(Status))
+        {
+            /* Somebody closed a handle behind our back, find it and drop its wait */
+            for (i = 0; i < Count; i++)
+            {
+                Timeout.QuadPart = 0;
+                if (NtWaitForSingleObject(Handles[i], FALSE, &Timeout) == STATUS_INVALID_HANDLE &&
+                    Waits[i]->u.Wait.Bucket == Bucket &&
+                    Waits[i]->u.Wait.Generation == Generations[i])
+                {
+                    DPRINT1("Dropping wait %p on invalid handle %p\n", Waits[i], Handles[i]);
+                    RemoveEntryList(&Waits[i]->u.Wait.WaitEntry);
+                    Waits[i]->u.Wait.Bucket = NULL;
+                    Bucket->Count--;
+                }
+            }
+        }
+
+        RtlLeaveCriticalSection(&TppWaitLock);
+
+        for (i = 0; i < Count; i++)
+            TppReleaseObject(Waits[i]);
+    }
+
+    NtClose(Bucket->UpdateEvent);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Bucket);
+    RtlExitUserThread(STATUS_SUCCESS);
+    return 0;
+}
+
+/* Must be called with the wait lock held */
+static
+NTSTATUS
+TppGetWaitBucket(
+    _Out_ PTPP_WAIT_BUCKET *BucketReturn)
+{
+    PTPP_WAIT_BUCKET Bucket;
+    PLIST_ENTRY Entry;
+    NTSTATUS Status;
+
+    for (Entry = TppWaitBuckets.Flink; Entry != &TppWaitBuckets; Entry = Entry->Flink)
+    {
+        Bucket = CONTAINING_RECORD(Entry, TPP_WAIT_BUCKET, BucketEntry);
+        if (Bucket->Count < TPP_WAITS_PER_BUCKET)
+        {
+            *BucketReturn = Bucket;
+            return STATUS_SUCCESS;
+        }
+    }
+
+    /* All full, start another wait thread */
+    Bucket = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*Bucket));
+    if (!Bucket)
+        return STATUS_NO_MEMORY;
+
+    InitializeListHead(&Bucket->Waits);
+
+    Status = NtCreateEvent(&Bucket->UpdateEvent, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE);
+    if (!NT_SUCCESS(Status))
+    {
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Bucket);
+        return Status;
+    }
+
+    Status = TppCreateThread(TppWaitThread, Bucket);
+    if (!NT_SUCCESS(Status))
+    {
+        NtClose(Bucket->UpdateEvent);
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Bucket);
+        return Status;
+    }
+
+    InsertTailList(&TppWaitBuckets, &Bucket->BucketEntry);
+
+    *BucketReturn = Bucket;
+    return STATUS_SUCCESS;
+}
+
+static
+ULONG
+NTAPI
+TppInitializeService(
+    _Inout_ PRTL_RUN_ONCE RunOnce,
+    _Inout_opt_ PVOID Parameter,
+    _Inout_opt_ PVOID *Context)
+{
+    NTSTATUS Status;
+
+    UNREFERENCED_PARAMETER(RunOnce);
+    UNREFERENCED_PARAMETER(Parameter);
+    UNREFERENCED_PARAMETER(Context);
+
+    InitializeListHead(&TppPoolList);
+    InitializeListHead(&TppTimerList);
+    InitializeListHead(&TppWaitBuckets);
+
+    Status = RtlInitializeCriticalSection(&TppPoolListLock);
+    if (!NT_SUCCESS(Status))
+        goto Quit;
+
+    Status = RtlInitializeCriticalSection(&TppTimerLock);
+    if (!NT_SUCCESS(Status))
+        goto DeletePoolListLock;
+
+    Status = RtlInitializeCriticalSection(&TppWaitLock);
+    if (!NT_SUCCESS(Status))
+        goto DeleteTimerLock;
+
+    Status = NtCreateEvent(&TppTimerEvent, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE);
+    if (!NT_SUCCESS(Status))
+        goto DeleteWaitLock;
+
+    Status = TppCreateThread(TppServiceThread, NULL);
+    if (NT_SUCCESS(Status))
+        return TRUE;
+
+    NtClose(TppTimerEvent);
+DeleteWaitLock:
+    RtlDeleteCriticalSection(&TppWaitLock);
+DeleteTimerLock:
+    RtlDeleteCriticalSection(&TppTimerLock);
+DeletePoolListLock:
+    RtlDeleteCriticalSection(&TppPoolListLock);
+Quit:
+    DPRINT1("Failed to start the thread pool service thread: 0x%lx\n", Status);
+    return FALSE;
+}
+
+/* PUBLIC FUNCTIONS **********************************************************/
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocPool(
+    _Out_ PTP_POOL *PoolReturn,
+    _Reserved_ PVOID Reserved)
+{
+    UNREFERENCED_PARAMETER(Reserved);
+
+    return TppAllocPool(PoolReturn);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleasePool(
+    _Inout_ PTP_POOL Pool)
+{
+    /* The workers leave once the last object is gone */
+    RtlEnterCriticalSection(&Pool->Lock);
+    Pool->Released = TRUE;
+    if (!Pool->ObjectCount)
+        TppStopWorkers(Pool);
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    TppReleasePool(Pool);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpSetPoolMaxThreads(
+    _Inout_ PTP_POOL Pool,
+    _In_ LONG MaxThreads)
+{
+    RtlEnterCriticalSection(&Pool->Lock);
+
+    /* Excess workers retire by themselves once they are idle */
+    Pool->MaxThreads = max(MaxThreads, 1);
+    Pool->MinThreads = min(Pool->MinThreads, Pool->MaxThreads);
+
+    RtlLeaveCriticalSection(&Pool->Lock);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpSetPoolMinThreads(
+    _Inout_ PTP_POOL Pool,
+    _In_ LONG MinThreads)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    RtlEnterCriticalSection(&Pool->Lock);
+
+    Pool->MinThreads = max(MinThreads, 0);
+    Pool->MaxThreads = max(Pool->MaxThreads, Pool->MinThreads);
+
+    while (Pool->TotalThreads < Pool->MinThreads)
+    {
+        if (!TppStartWorker(Pool))
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            break;
+        }
+    }
+
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    return Status;
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocCleanupGroup(
+    _Out_ PTP_CLEANUP_GROUP *CleanupGroupReturn)
+{
+    PTP_CLEANUP_GROUP Group;
+    NTSTATUS Status;
+
+    Group = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*Group));
+    if (!Group)
+        return STATUS_NO_MEMORY;
+
+    Status = RtlInitializeCriticalSection(&Group->Lock);
+    if (!NT_SUCCESS(Status))
+    {
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Group);
+        return Status;
+    }
+
+    Group->RefCount = 1;
+    InitializeListHead(&Group->Members);
+
+    *CleanupGroupReturn = Group;
+    return STATUS_SUCCESS;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseCleanupGroup(
+    _Inout_ PTP_CLEANUP_GROUP CleanupGroup)
+{
+    TppReleaseCleanupGroup(CleanupGroup);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseCleanupGroupMembers(
+    _Inout_ PTP_CLEANUP_GROUP CleanupGroup,
+    _In_ BOOLEAN CancelPendingCallbacks,
+    _Inout_opt_ PVOID CleanupParameter)
+{
+    LIST_ENTRY Members;
+    PLIST_ENTRY Entry, NextEntry;
+    PTPP_OBJECT Object;
+    BOOLEAN OwnerReference;
+    LONG Cancelled;
+
+    InitializeListHead(&Members);
+
+    /* Take over everything that isn't being freed already */
+    RtlEnterCriticalSection(&CleanupGroup->Lock);
+    for (Entry = CleanupGroup->Members.Flink; Entry != &CleanupGroup->Members; Entry = NextEntry)
+    {
+        NextEntry = Entry->Flink;
+        Object = CONTAINING_RECORD(Entry, TPP_OBJECT, GroupEntry);
+
+        if (!TppReferenceObjectIfAlive(Object))
+            continue;
+
+        RemoveEntryList(Entry);
+        InsertTailList(&Members, Entry);
+    }
+    RtlLeaveCriticalSection(&CleanupGroup->Lock);
+
+    while (!IsListEmpty(&Members))
+    {
+        Entry = RemoveHeadList(&Members);
+        InitializeListHead(Entry);
+        Object = CONTAINING_RECORD(Entry, TPP_OBJECT, GroupEntry);
+
+        /* Stop timers and waits before waiting for them */
+        OwnerReference = TppShutdownObject(Object);
+
+        Cancelled = TppWaitForObject(Object, CancelPendingCallbacks);
+        while (Cancelled-- > 0 && Object->GroupCancelCallback)
+            Object->GroupCancelCallback(Object->Context, CleanupParameter);
+
+        /* Release it on behalf of the owner, unless they already did */
+        if (OwnerReference)
+            TppReleaseObject(Object);
+
+        TppReleaseObject(Object);
+    }
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpSimpleTryPost(
+    _In_ PTP_SIMPLE_CALLBACK Callback,
+    _Inout_opt_ PVOID Context,
+    _In_opt_ PTP_CALLBACK_ENVIRON CallbackEnviron)
+{
+    PTPP_OBJECT Object;
+    NTSTATUS Status;
+
+    Status = TppAllocObject(TPP_OBJECT_SIMPLE, Callback, Context, CallbackEnviron, &Object);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    /* Nobody owns it, the pending callback keeps it alive until it has run */
+    Object->Released = TRUE;
+    TppSubmitCallback(Object, FALSE);
+    TppReleaseObject(Object);
+
+    return STATUS_SUCCESS;
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocWork(
+    _Out_ PTP_WORK *WorkReturn,
+    _In_ PTP_WORK_CALLBACK Callback,
+    _Inout_opt_ PVOID Context,
+    _In_opt_ PTP_CALLBACK_ENVIRON CallbackEnviron)
+{
+    PTPP_OBJECT Object;
+    NTSTATUS Status;
+
+    Status = TppAllocObject(TPP_OBJECT_WORK, Callback, Context, CallbackEnviron, &Object);
+    if (NT_SUCCESS(Status))
+        *WorkReturn = (PTP_WORK)Object;
+
+    return Status;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpPostWork(
+    _Inout_ PTP_WORK Work)
+{
+    TppSubmitCallback((PTPP_OBJECT)Work, FALSE);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpWaitForWork(
+    _Inout_ PTP_WORK Work,
+    _In_ BOOLEAN CancelPendingCallbacks)
+{
+    TppWaitForObject((PTPP_OBJECT)Work, CancelPendingCallbacks);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseWork(
+    _Inout_ PTP_WORK Work)
+{
+    TppReleaseOwnerReference((PTPP_OBJECT)Work);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocTimer(
+    _Out_ PTP_TIMER *Timer,
+    _In_ PTP_TIMER_CALLBACK Callback,
+    _Inout_opt_ PVOID Context,
+    _In_opt_ PTP_CALLBACK_ENVIRON CallbackEnviron)
+{
+    PTPP_OBJECT Object;
+    NTSTATUS Status;
+
+    Status = TppAllocObject(TPP_OBJECT_TIMER, Callback, Context, CallbackEnviron, &Object);
+    if (NT_SUCCESS(Status))
+        *Timer = (PTP_TIMER)Object;
+
+    return Status;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpSetTimer(
+    _Inout_ PTP_TIMER Timer,
+    _In_opt_ PLARGE_INTEGER DueTime,
+    _In_ LONG Period,
+    _In_opt_ LONG WindowLength)
+{
+    PTPP_OBJECT Object = (PTPP_OBJECT)Timer;
+    LARGE_INTEGER Now;
+    BOOLEAN First = FALSE;
+
+    /* We don't coalesce timers, so the window is of no use to us */
+    UNREFERENCED_PARAMETER(WindowLength);
+
+    NtQuerySystemTime(&Now);
+
+    RtlEnterCriticalSection(&TppTimerLock);
+
+    if (Object->u.Timer.Set)
+    {
+        RemoveEntryList(&Object->u.Timer.TimerEntry);
+        Object->u.Timer.Set = FALSE;
+    }
+
+    /* No due time just cancels it. Zero fires right away, negative values are relative */
+    if (DueTime)
+    {
+        if (DueTime->QuadPart <= 0)
+            Object->u.Timer.DueTime = Now.QuadPart - DueTime->QuadPart;
+        else
+            Object->u.Timer.DueTime = DueTime->QuadPart;
+
+        Object->u.Timer.Period = max(Period, 0);
+        TppInsertTimer(Object);
+
+        First = (TppTimerList.Flink == &Object->u.Timer.TimerEntry);
+    }
+
+    RtlLeaveCriticalSection(&TppTimerLock);
+
+    /* The service thread has to sleep less now */
+    if (First)
+        NtSetEvent(TppTimerEvent, NULL);
+}
+
+/*
+ * @implemented
+ */
+BOOLEAN
+NTAPI
+TpIsTimerSet(
+    _In_ PTP_TIMER Timer)
+{
+    return ((PTPP_OBJECT)Timer)->u.Timer.Set;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpWaitForTimer(
+    _Inout_ PTP_TIMER Timer,
+    _In_ BOOLEAN CancelPendingCallbacks)
+{
+    TppWaitForObject((PTPP_OBJECT)Timer, CancelPendingCallbacks);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseTimer(
+    _Inout_ PTP_TIMER Timer)
+{
+    TppReleaseOwnerReference((PTPP_OBJECT)Timer);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocWait(
+    _Out_ PTP_WAIT *WaitReturn,
+    _In_ PTP_WAIT_CALLBACK Callback,
+    _Inout_opt_ PVOID Context,
+    _In_opt_ PTP_CALLBACK_ENVIRON CallbackEnviron)
+{
+    PTPP_OBJECT Object;
+    NTSTATUS Status;
+
+    Status = TppAllocObject(TPP_OBJECT_WAIT, Callback, Context, CallbackEnviron, &Object);
+    if (NT_SUCCESS(Status))
+        *WaitReturn = (PTP_WAIT)Object;
+
+    return Status;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpSetWait(
+    _Inout_ PTP_WAIT Wait,
+    _In_opt_ HANDLE Handle,
+    _In_opt_ PLARGE_INTEGER Timeout)
+{
+    PTPP_OBJECT Object = (PTPP_OBJECT)Wait;
+    PTPP_WAIT_BUCKET Bucket;
+    LARGE_INTEGER Now;
+    NTSTATUS Status;
+
+    RtlEnterCriticalSection(&TppWaitLock);
+
+    TppRemoveWait(Object);
+
+    /* No handle just cancels it */
+    if (Handle)
+    {
+        NtQuerySystemTime(&Now);
+
+        if (!Timeout)
+            Object->u.Wait.Timeout = MAXLONGLONG;
+        else if (Timeout->QuadPart <= 0)
+            Object->u.Wait.Timeout = Now.QuadPart - Timeout->QuadPart;
+        else
+            Object->u.Wait.Timeout = Timeout->QuadPart;
+
+        Object->u.Wait.Handle = Handle;
+        Object->u.Wait.Generation++;
+
+        Status = TppGetWaitBucket(&Bucket);
+        if (NT_SUCCESS(Status))
+        {
+            InsertTailList(&Bucket->Waits, &Object->u.Wait.WaitEntry);
+            Object->u.Wait.Bucket = Bucket;
+            Bucket->Count++;
+
+            NtSetEvent(Bucket->UpdateEvent, NULL);
+        }
+        else
+        {
+            DPRINT1("No wait thread for wait %p: 0x%lx\n", Object, Status);
+        }
+    }
+
+    RtlLeaveCriticalSection(&TppWaitLock);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpWaitForWait(
+    _Inout_ PTP_WAIT Wait,
+    _In_ BOOLEAN CancelPendingCallbacks)
+{
+    TppWaitForObject((PTPP_OBJECT)Wait, CancelPendingCallbacks);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseWait(
+    _Inout_ PTP_WAIT Wait)
+{
+    TppReleaseOwnerReference((PTPP_OBJECT)Wait);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocIoCompletion(
+    _Out_ PTP_IO *IoReturn,
+    _In_ HANDLE File,
+    _In_ PTP_IO_CALLBACK Callback,
+    _Inout_opt_ PVOID Context,
+    _In_opt_ PTP_CALLBACK_ENVIRON CallbackEnviron)
+{
+    FILE_COMPLETION_INFORMATION CompletionInformation;
+    IO_STATUS_BLOCK IoStatusBlock;
+    PTPP_OBJECT Object;
+    NTSTATUS Status;
+
+    Status = TppAllocObject(TPP_OBJECT_IO, Callback, Context, CallbackEnviron, &Object);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    Object->u.Io.File = File;
+
+    /* Completions go straight to the workers, keyed by the object */
+    CompletionInformation.Port = Object->Pool->CompletionPort;
+    CompletionInformation.Key = Object;
+    Status = NtSetInformationFile(File,
+                                  &IoStatusBlock,
+                                  &CompletionInformation,
+                                  sizeof(CompletionInformation),
+                                  FileCompletionInformation);
+    if (!NT_SUCCESS(Status))
+    {
+        TppReleaseOwnerReference(Object);
+        return Status;
+    }
+
+    *IoReturn = (PTP_IO)Object;
+    return STATUS_SUCCESS;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpStartAsyncIoOperation(
+    _Inout_ PTP_IO Io)
+{
+    PTPP_OBJECT Object = (PTPP_OBJECT)Io;
+    PTP_POOL Pool = Object->Pool;
+
+    /* Every outstanding operation holds a reference until its completion arrives */
+    InterlockedIncrement(&Object->RefCount);
+
+    RtlEnterCriticalSection(&Pool->Lock);
+    Object->u.Io.Outstanding++;
+    Pool->OutstandingIo++;
+    TppCheckWorkers(Pool);
+    RtlLeaveCriticalSection(&Pool->Lock);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCancelAsyncIoOperation(
+    _Inout_ PTP_IO Io)
+{
+    PTPP_OBJECT Object = (PTPP_OBJECT)Io;
+    PTP_POOL Pool = Object->Pool;
+    BOOLEAN Release = FALSE;
+
+    /* The operation failed synchronously, no completion is coming */
+    RtlEnterCriticalSection(&Pool->Lock);
+    if (Object->u.Io.Outstanding)
+    {
+        Object->u.Io.Outstanding--;
+        Pool->OutstandingIo--;
+        RtlWakeAllConditionVariable(&Object->Finished);
+        Release = TRUE;
+    }
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    if (Release)
+        TppReleaseObject(Object);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpWaitForIoCompletion(
+    _Inout_ PTP_IO Io,
+    _In_ BOOLEAN CancelPendingCallbacks)
+{
+    TppWaitForObject((PTPP_OBJECT)Io, CancelPendingCallbacks);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseIoCompletion(
+    _Inout_ PTP_IO Io)
+{
+    TppReleaseOwnerReference((PTPP_OBJECT)Io);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpCallbackMayRunLong(
+    _Inout_ PTP_CALLBACK_INSTANCE Instance)
+{
+    PTP_POOL Pool = Instance->Object->Pool;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    if (Instance->MayRunLong)
+        return STATUS_SUCCESS;
+
+    RtlEnterCriticalSection(&Pool->Lock);
+
+    /* We no longer count against the processors */
+    Instance->MayRunLong = TRUE;
+    Pool->LongThreads++;
+
+    /* Make sure somebody is left for the other callbacks */
+    if (!Pool->IdleThreads &&
+        (Pool->TotalThreads >= Pool->MaxThreads || !TppStartWorker(Pool)))
+    {
+        Status = STATUS_TOO_MANY_THREADS;
+    }
+
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    return Status;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpDisassociateCallback(
+    _Inout_ PTP_CALLBACK_INSTANCE Instance)
+{
+    PTPP_OBJECT Object = Instance->Object;
+    PTP_POOL Pool = Object->Pool;
+
+    if (!Instance->Associated)
+        return;
+
+    /* Waiters on the object no longer wait for us */
+    RtlEnterCriticalSection(&Pool->Lock);
+    Object->Running--;
+    RtlWakeAllConditionVariable(&Object->Finished);
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    Instance->Associated = FALSE;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCallbackSetEventOnCompletion(
+    _Inout_ PTP_CALLBACK_INSTANCE Instance,
+    _In_ HANDLE Event)
+{
+    Instance->Event = Event;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCallbackReleaseSemaphoreOnCompletion(
+    _Inout_ PTP_CALLBACK_INSTANCE Instance,
+    _In_ HANDLE Semaphore,
+    _In_ LONG ReleaseCount)
+{
+    Instance->Semaphore = Semaphore;
+    Instance->SemaphoreCount = ReleaseCount;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCallbackReleaseMutexOnCompletion(
+    _Inout_ PTP_CALLBACK_INSTANCE Instance,
+    _In_ HANDLE Mutex)
+{
+    Instance->Mutex = Mutex;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCallbackLeaveCriticalSectionOnCompletion(
+    _Inout_ PTP_CALLBACK_INSTANCE Instance,
+    _Inout_ PRTL_CRITICAL_SECTION CriticalSection)
+{
+    Instance->CriticalSection = CriticalSection;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCallbackUnloadDllOnCompletion(
+    _Inout_ PTP_CALLBACK_INSTANCE Instance,
+    _In_ PVOID DllHandle)
+{
+    Instance->Dll = DllHandle;
+}
+
+/* EOF */